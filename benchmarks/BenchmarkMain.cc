@@ -0,0 +1,44 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The hardware counters every benchmark reports when none are asked for with
+// `--benchmark_perf_counters`, as a comma-separated list of libpfm event
+// names, or empty for none. Counting them needs a benchmark library built
+// with libpfm and permission to open perf events.
+#ifndef COCKTAIL_BENCHMARK_PERF_COUNTERS
+#define COCKTAIL_BENCHMARK_PERF_COUNTERS ""
+#endif
+
+// Runs the benchmarks linked in, as `BENCHMARK_MAIN` does, but counting the
+// default hardware events so that `--benchmark_out` records them alongside
+// the times.
+auto main(int argc, char** argv) -> int {
+  std::vector<char*> args(argv, argv + argc);
+  std::string counters_flag =
+      std::string("--benchmark_perf_counters=") +
+      COCKTAIL_BENCHMARK_PERF_COUNTERS;
+  bool has_counters_flag = false;
+  for (char* arg : args) {
+    if (std::strncmp(arg, "--benchmark_perf_counters",
+                     std::strlen("--benchmark_perf_counters")) == 0) {
+      has_counters_flag = true;
+    }
+  }
+  if (!has_counters_flag &&
+      std::strlen(COCKTAIL_BENCHMARK_PERF_COUNTERS) != 0) {
+    args.insert(args.begin() + 1, counters_flag.data());
+  }
+  int args_size = args.size();
+  args.push_back(nullptr);
+
+  benchmark::Initialize(&args_size, args.data());
+  if (benchmark::ReportUnrecognizedArguments(args_size, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include <optional>
+#include <string>
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Compares two `--benchmark_out` JSON files of the same benchmark executable,
+// a baseline and a current run, printing how each benchmark's time and
+// counters changed. With hardware counters recorded, the instructions per
+// cycle are derived from them, so that a change to a hot loop shows whether
+// it retires fewer instructions or stalls less, not just its time.
+
+namespace {
+
+// A benchmark's time and counters, per iteration.
+struct Result {
+  double real_time = 0;
+  std::string time_unit;
+  llvm::MapVector<std::string, double> counters;
+};
+
+using Results = llvm::MapVector<std::string, Result>;
+
+// The numeric fields of a run that aren't counters.
+const llvm::StringSet<> RunFields = {
+    "family_index", "per_family_instance_index", "repetitions",
+    "repetition_index", "threads", "iterations", "real_time", "cpu_time"};
+
+// Reads the results of each benchmark in the file at `path`. Of repeated
+// runs, the median is used if it was reported, and otherwise the first run.
+auto ReadResults(llvm::StringRef path) -> std::optional<Results> {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    llvm::errs() << "Error reading `" << path
+                 << "`: " << buffer.getError().message() << "\n";
+    return std::nullopt;
+  }
+  llvm::Expected<llvm::json::Value> json =
+      llvm::json::parse((*buffer)->getBuffer());
+  if (!json) {
+    llvm::errs() << "Error parsing `" << path
+                 << "`: " << llvm::toString(json.takeError()) << "\n";
+    return std::nullopt;
+  }
+  const llvm::json::Object* root = json->getAsObject();
+  const llvm::json::Array* runs =
+      root ? root->getArray("benchmarks") : nullptr;
+  if (!runs) {
+    llvm::errs() << "Error: `" << path << "` has no benchmarks\n";
+    return std::nullopt;
+  }
+
+  Results results;
+  llvm::StringSet<> medians;
+  for (const llvm::json::Value& value : *runs) {
+    const llvm::json::Object* run = value.getAsObject();
+    if (!run || run->getBoolean("error_occurred").value_or(false)) {
+      continue;
+    }
+    llvm::StringRef name = run->getString("run_name").value_or(
+        run->getString("name").value_or(""));
+    bool is_median =
+        run->getString("aggregate_name").value_or("") == "median";
+    if (run->getString("run_type").value_or("") == "aggregate" &&
+        !is_median) {
+      continue;
+    }
+    if (medians.contains(name) ||
+        (!is_median && results.find(name.str()) != results.end())) {
+      continue;
+    }
+    if (is_median) {
+      medians.insert(name);
+    }
+    Result& result = results[name.str()];
+    result = Result();
+    result.real_time = run->getNumber("real_time").value_or(0);
+    result.time_unit = run->getString("time_unit").value_or("ns").str();
+    for (const auto& [key, field] : *run) {
+      auto number = field.getAsNumber();
+      if (number && !RunFields.contains(key)) {
+        result.counters.insert({key.str().str(), *number});
+      }
+    }
+  }
+  return results;
+}
+
+auto FindCounter(const Result& result, llvm::StringRef counter)
+    -> std::optional<double> {
+  auto it = result.counters.find(counter.str());
+  if (it == result.counters.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+auto PercentChange(double baseline, double current) -> double {
+  return baseline == 0 ? 0 : (current - baseline) / baseline * 100;
+}
+
+// Prints a row of a field's baseline and current values, and the change
+// between them as a percentage, or as a difference if `absolute`.
+void PrintRow(llvm::StringRef field, double baseline, double current,
+              bool absolute = false) {
+  llvm::outs() << llvm::format("  %-34s %14.4f -> %14.4f", field.str().c_str(),
+                               baseline, current);
+  if (absolute) {
+    llvm::outs() << llvm::format("  %+8.3f\n", current - baseline);
+  } else {
+    llvm::outs() << llvm::format("  %+7.1f%%\n",
+                                 PercentChange(baseline, current));
+  }
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  if (argc != 3) {
+    llvm::errs() << "Usage: " << argv[0]
+                 << " <baseline.json> <current.json>\n";
+    return 2;
+  }
+  std::optional<Results> baseline = ReadResults(argv[1]);
+  std::optional<Results> current = ReadResults(argv[2]);
+  if (!baseline || !current) {
+    return 1;
+  }
+
+  for (const auto& [name, result] : *current) {
+    auto it = baseline->find(name);
+    if (it == baseline->end()) {
+      llvm::outs() << name << ": not in the baseline\n";
+      continue;
+    }
+    const Result& base = it->second;
+    llvm::outs() << name << "\n";
+    PrintRow("real_time (" + result.time_unit + ")", base.real_time,
+             result.real_time);
+    std::optional<double> base_cycles = FindCounter(base, "CYCLES");
+    std::optional<double> base_insts = FindCounter(base, "INSTRUCTIONS");
+    std::optional<double> cycles = FindCounter(result, "CYCLES");
+    std::optional<double> insts = FindCounter(result, "INSTRUCTIONS");
+    if (base_cycles && base_insts && cycles && insts && *base_cycles != 0 &&
+        *cycles != 0) {
+      PrintRow("IPC", *base_insts / *base_cycles, *insts / *cycles,
+               /*absolute=*/true);
+    }
+    for (const auto& [counter, value] : result.counters) {
+      if (std::optional<double> base_value = FindCounter(base, counter)) {
+        PrintRow(counter, *base_value, value);
+      }
+    }
+  }
+  for (const auto& [name, result] : *baseline) {
+    if (current->find(name) == current->end()) {
+      llvm::outs() << name << ": only in the baseline\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <string>
+
+#include "Cocktail/CppRefactor/FnInserter.h"
+#include "Cocktail/CppRefactor/ForRange.h"
+#include "Cocktail/CppRefactor/MatcherManager.h"
+#include "Cocktail/CppRefactor/VarDecl.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr char Filename[] = "corpus.cc";
+
+// Returns a file of `num_functions` functions, each with a range-based for
+// loop and a few variables, which every matcher has work in.
+static auto MakeCorpus(int num_functions) -> std::string {
+  std::string code = R"cpp(
+    struct Items {
+      auto begin() -> int*;
+      auto end() -> int*;
+    };
+  )cpp";
+  for (int i = 0; i < num_functions; ++i) {
+    std::string n = std::to_string(i);
+    code += R"cpp(
+      auto Sum)cpp" + n + R"cpp((Items& items) -> int {
+        int sum = 0;
+        const int scale = )cpp" + n + R"cpp(;
+        for (int item : items) {
+          sum += item * scale;
+        }
+        return sum;
+      }
+    )cpp";
+  }
+  return code;
+}
+
+static auto Seconds(Clock::duration duration) -> double {
+  return std::chrono::duration<double>(duration).count();
+}
+
+// Translates a file of `state.range(0)` functions each iteration. Reports how
+// many files and matches are translated a second, and how the time of each
+// file splits between parsing it, finding its matches, and making their
+// replacements.
+static void BM_Translate(benchmark::State& state) {
+  std::string code = MakeCorpus(state.range(0));
+  Matcher::ReplacementMap replacements;
+  MatcherManager matchers(&replacements);
+  matchers.Register(std::make_unique<FnInserterFactory>());
+  matchers.Register(std::make_unique<ForRangeFactory>());
+  matchers.Register(std::make_unique<VarDeclFactory>());
+
+  Clock::duration parse_time{};
+  Clock::duration match_time{};
+  for (auto _ : state) {
+    replacements.clear();
+    replacements.insert({Filename, {}});
+    auto start = Clock::now();
+    std::unique_ptr<clang::ASTUnit> ast =
+        clang::tooling::buildASTFromCodeWithArgs(code, {"-std=c++17"},
+                                                 Filename);
+    auto parsed = Clock::now();
+    matchers.GetFinder()->matchAST(ast->getASTContext());
+    auto matched = Clock::now();
+    parse_time += parsed - start;
+    match_time += matched - parsed;
+    benchmark::DoNotOptimize(replacements);
+  }
+
+  int64_t matches = 0;
+  Clock::duration replace_time{};
+  for (const MatcherStats& matcher : matchers.GetStats()) {
+    matches += matcher.matches;
+    replace_time += matcher.time;
+  }
+  // The time spent in the matchers is replacing, not finding matches.
+  match_time -= replace_time;
+  state.counters["TUs/s"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["matches/s"] =
+      benchmark::Counter(matches, benchmark::Counter::kIsRate);
+  state.counters["parse_s"] = benchmark::Counter(
+      Seconds(parse_time), benchmark::Counter::kAvgIterations);
+  state.counters["match_s"] = benchmark::Counter(
+      Seconds(match_time), benchmark::Counter::kAvgIterations);
+  state.counters["replace_s"] = benchmark::Counter(
+      Seconds(replace_time), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_Translate)->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -0,0 +1,44 @@
+#include "Cocktail/Driver/Driver.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "Cocktail/Source/SourceBufferCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+// Runs `args` the way a freshly spawned driver would: with a driver and a
+// source cache of its own, reading `input_file` from disk. An empty input
+// file leaves nothing but the work every invocation does before it gets to
+// the first token.
+static void BM_Startup(benchmark::State& state,
+                       llvm::ArrayRef<llvm::StringRef> subcommand_args) {
+  llvm::SmallString<256> input_file;
+  if (llvm::sys::fs::createTemporaryFile("startup", "cocktail", input_file)) {
+    state.SkipWithError("Unable to create an input file.");
+    return;
+  }
+  llvm::SmallVector<llvm::StringRef> args(subcommand_args.begin(),
+                                          subcommand_args.end());
+  args.push_back(input_file);
+  for (auto _ : state) {
+    SourceBufferCache source_cache(*llvm::vfs::getRealFileSystem());
+    Driver driver(llvm::nulls(), llvm::nulls(), source_cache);
+    benchmark::DoNotOptimize(driver.RunFullCommand(args));
+  }
+  llvm::sys::fs::remove(input_file);
+}
+
+BENCHMARK_CAPTURE(BM_Startup, DumpTokens, {"dump-tokens"});
+BENCHMARK_CAPTURE(BM_Startup, DumpParseTree, {"dump-parse-tree"});
+// Lowering creates an LLVM context, which the dumps above never pay for.
+BENCHMARK_CAPTURE(BM_Startup, EmitLLVM, {"emit-llvm"});
+
+}  // namespace
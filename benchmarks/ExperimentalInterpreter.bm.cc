@@ -0,0 +1,253 @@
+#include <benchmark/benchmark.h>
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "experimental/AST/Declaration.h"
+#include "experimental/Interpreter/Interpreter.h"
+#include "experimental/Interpreter/Profile.h"
+#include "experimental/Interpreter/Resolve.h"
+#include "experimental/Interpreter/TypeCheck.h"
+#include "experimental/Interpreter/VM.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using Fields = std::vector<std::pair<std::string, Expression*>>;
+using Program = std::list<Declaration*>;
+
+// Shorthands for the syntax of the programs below, which is all on line 1.
+static auto Int(int i) -> Expression* { return MakeInt(1, i); }
+static auto Var(const char* name) -> Expression* { return MakeVar(1, name); }
+static auto Op(Operator op, Expression* a, Expression* b) -> Expression* {
+  return MakeBinOp(1, op, a, b);
+}
+static auto Tuple(Fields fields) -> Expression* {
+  return MakeTuple(1, new Fields(std::move(fields)));
+}
+static auto Call(Expression* fun, Fields args) -> Expression* {
+  return MakeCall(1, fun, Tuple(std::move(args)));
+}
+static auto Param(const char* name, Expression* type)
+    -> std::pair<std::string, Expression*> {
+  return {"", MakeVarPat(1, name, type)};
+}
+static auto VarDef(const char* name, Expression* type, Expression* init)
+    -> Statement* {
+  return MakeVarDef(1, MakeVarPat(1, name, type), init);
+}
+static auto Assign(const char* name, Expression* e) -> Statement* {
+  return MakeAssign(1, Var(name), e);
+}
+static auto Return(Expression* e) -> Statement* { return MakeReturn(1, e); }
+static auto Seq(const std::vector<Statement*>& stmts) -> Statement* {
+  Statement* seq = nullptr;
+  for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+    seq = MakeSeq(1, *it, seq);
+  }
+  return seq;
+}
+static auto Fn(const char* name, Fields params, Statement* body)
+    -> Declaration* {
+  return MakeFunDecl(
+      MakeFunDef(1, name, MakeIntType(1), Tuple(std::move(params)), body));
+}
+
+// fn main() -> Int {
+//   var Int: s = 0; var Int: i = 0;
+//   while (not (i == n)) { <body> i = i + 1; }
+//   return s;
+// }
+static auto MainLoop(int n, std::vector<Statement*> body) -> Declaration* {
+  body.push_back(Assign("i", Op(Operator::Add, Var("i"), Int(1))));
+  return Fn(
+      "main", {},
+      Seq({VarDef("s", MakeIntType(1), Int(0)),
+           VarDef("i", MakeIntType(1), Int(0)),
+           MakeWhile(1, MakeUnOp(1, Operator::Not, Op(Operator::Eq, Var("i"),
+                                                       Int(n))),
+                     MakeBlock(1, Seq(body))),
+           Return(Var("s"))}));
+}
+
+// fn fib(Int: n, Int: z) -> Int {
+//   if (n == 0) { return 0; }
+//   if (n == 1) { return 1; }
+//   return fib(n - 1, 0) + fib(n - 2, 0);
+// }
+// fn main() -> Int { return fib(n, 0); }
+static auto MakeFib(int n) -> Program* {
+  auto* fib = Fn(
+      "fib", {Param("n", MakeIntType(1)), Param("z", MakeIntType(1))},
+      Seq({MakeIf(1, Op(Operator::Eq, Var("n"), Int(0)),
+                  MakeBlock(1, Return(Int(0))), nullptr),
+           MakeIf(1, Op(Operator::Eq, Var("n"), Int(1)),
+                  MakeBlock(1, Return(Int(1))), nullptr),
+           Return(Op(Operator::Add,
+                     Call(Var("fib"), {{"", Op(Operator::Sub, Var("n"),
+                                               Int(1))},
+                                       {"", Int(0)}}),
+                     Call(Var("fib"), {{"", Op(Operator::Sub, Var("n"),
+                                               Int(2))},
+                                       {"", Int(0)}})))}));
+  auto* main = Fn("main", {}, Return(Call(Var("fib"), {{"", Int(n)},
+                                                       {"", Int(0)}})));
+  return new Program{fib, main};
+}
+
+// A loop of `n` iterations of `s = (s + i) - i + 1;`.
+static auto MakeLoop(int n) -> Program* {
+  return new Program{MainLoop(
+      n, {Assign("s", Op(Operator::Add,
+                         Op(Operator::Sub, Op(Operator::Add, Var("s"),
+                                              Var("i")),
+                            Var("i")),
+                         Int(1)))})};
+}
+
+// struct Point { var Int: x; var Int: y; }
+// A loop of `n` iterations of
+//   var Point: p = Point(.x = i, .y = 1);
+//   var auto: t = (p.y, p.x);
+//   s = s + t[0];
+static auto MakeStructs(int n) -> Program* {
+  auto* point = MakeStructDecl(
+      1, "Point",
+      new std::list<Member*>{MakeField(1, "x", MakeIntType(1)),
+                             MakeField(1, "y", MakeIntType(1))});
+  auto* main = MainLoop(
+      n, {VarDef("p", Var("Point"),
+                 Call(Var("Point"), {{"x", Var("i")}, {"y", Int(1)}})),
+          VarDef("t", MakeAutoType(1),
+                 Tuple({{"", MakeGetField(1, Var("p"), "y")},
+                        {"", MakeGetField(1, Var("p"), "x")}})),
+          Assign("s", Op(Operator::Add, Var("s"),
+                         MakeIndex(1, Var("t"), Int(0))))});
+  return new Program{point, main};
+}
+
+// choice Ints { None(); Two(Int, Int); }
+// fn pick(Ints: c, Int: z) -> Int {
+//   var Int: r = 0;
+//   match (c) { case Ints.Two(3, 4) => r = 2; default => r = 1; }
+//   return r;
+// }
+// A loop of `n` iterations of
+//   s = s + pick(Ints.Two(3, 4), 0) + pick(Ints.None(), 0);
+static auto MakeMatch(int n) -> Program* {
+  auto* ints = MakeChoiceDecl(
+      1, "Ints",
+      new std::list<std::pair<std::string, Expression*>>{
+          {"None", Tuple({})},
+          {"Two", Tuple({{"", MakeIntType(1)}, {"", MakeIntType(1)}})}});
+  auto two = [] {
+    return Call(MakeGetField(1, Var("Ints"), "Two"),
+                {{"", Int(3)}, {"", Int(4)}});
+  };
+  auto* clauses = new std::list<std::pair<Expression*, Statement*>>{
+      {two(), Assign("r", Int(2))},
+      {MakeVarPat(1, "_", MakeAutoType(1)), Assign("r", Int(1))}};
+  auto* pick = Fn("pick", {Param("c", Var("Ints")), Param("z", MakeIntType(1))},
+                  Seq({VarDef("r", MakeIntType(1), Int(0)),
+                       MakeMatch(1, Var("c"), clauses), Return(Var("r"))}));
+  auto* main = MainLoop(
+      n, {Assign("s", Op(Operator::Add,
+                         Op(Operator::Add, Var("s"),
+                            Call(Var("pick"), {{"", two()}, {"", Int(0)}})),
+                         Call(Var("pick"),
+                              {{"", Call(MakeGetField(1, Var("Ints"), "None"),
+                                         {})},
+                               {"", Int(0)}})))});
+  return new Program{ints, pick, main};
+}
+
+// fn down(Int: n, Int: z) -> Int {
+//   if (n == 0) { return 0; }
+//   return 1 + down(n - 1, 0);
+// }
+// fn main() -> Int { return down(n, 0); }
+static auto MakeCalls(int n) -> Program* {
+  auto* down = Fn(
+      "down", {Param("n", MakeIntType(1)), Param("z", MakeIntType(1))},
+      Seq({MakeIf(1, Op(Operator::Eq, Var("n"), Int(0)),
+                  MakeBlock(1, Return(Int(0))), nullptr),
+           Return(Op(Operator::Add, Int(1),
+                     Call(Var("down"), {{"", Op(Operator::Sub, Var("n"),
+                                                Int(1))},
+                                        {"", Int(0)}})))}));
+  auto* main = Fn("main", {}, Return(Call(Var("down"), {{"", Int(n)},
+                                                         {"", Int(0)}})));
+  return new Program{down, main};
+}
+
+// Type checks and resolves `fs`, as `ExecProgram` does before running it,
+// so that only the runs are timed.
+static auto CheckProgram(Program* fs) -> Program* {
+  Cocktail::state = new State();
+  auto* checked = new Program(TypeCheckProgram(fs, /*jobs=*/1));
+  ResolveProgram(checked);
+  return checked;
+}
+
+// Frees the values of the program last run, none of which are reachable
+// once it's done, so that the runs of a benchmark don't pile up.
+static void FreeRun() {
+  HeapMarker marker;
+  SweepHeap(marker);
+  delete Cocktail::state;
+  Cocktail::state = nullptr;
+}
+
+using Engine = auto (*)(Program* fs) -> int;
+using MakeProgram = auto (*)(int n) -> Program*;
+
+// Runs the program that `make` makes of the benchmark's argument on
+// `engine`. Reports the steps the engine takes a second, which are actions
+// for the small-step machine and instructions for the bytecode machine, and
+// the heap addresses and collections of a run.
+static void BM_Run(benchmark::State& state, Engine engine, MakeProgram make) {
+  tracing_output = false;
+  Program* fs = CheckProgram(make(state.range(0)));
+  Profiler steps;
+  profiler = &steps;
+  engine(fs);
+  profiler = nullptr;
+  FreeRun();
+  int heap_size = 0;
+  int collections = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(engine(fs));
+    heap_size = Cocktail::state->heap.size();
+    collections = Cocktail::state->stats.collections;
+    FreeRun();
+  }
+  state.counters["steps"] = benchmark::Counter(
+      steps.TotalSteps(), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["heap"] = heap_size;
+  state.counters["collections"] = collections;
+}
+
+static void BM_StepMachine(benchmark::State& state, MakeProgram make) {
+  BM_Run(state, InterpProgram, make);
+}
+
+static void BM_Bytecode(benchmark::State& state, MakeProgram make) {
+  BM_Run(state, RunCompiledProgram, make);
+}
+
+BENCHMARK_CAPTURE(BM_StepMachine, Fib, MakeFib)->Arg(10)->Arg(15);
+BENCHMARK_CAPTURE(BM_Bytecode, Fib, MakeFib)->Arg(10)->Arg(15);
+BENCHMARK_CAPTURE(BM_StepMachine, Loop, MakeLoop)->Arg(1000)->Arg(10000);
+BENCHMARK_CAPTURE(BM_Bytecode, Loop, MakeLoop)->Arg(1000)->Arg(10000);
+BENCHMARK_CAPTURE(BM_StepMachine, Structs, MakeStructs)->Arg(1000);
+BENCHMARK_CAPTURE(BM_Bytecode, Structs, MakeStructs)->Arg(1000);
+BENCHMARK_CAPTURE(BM_StepMachine, Match, MakeMatch)->Arg(1000);
+BENCHMARK_CAPTURE(BM_Bytecode, Match, MakeMatch)->Arg(1000);
+// Deep enough that the stacks of both machines grow well past a page.
+BENCHMARK_CAPTURE(BM_StepMachine, Calls, MakeCalls)->Arg(100)->Arg(10000);
+BENCHMARK_CAPTURE(BM_Bytecode, Calls, MakeCalls)->Arg(100)->Arg(10000);
+
+}  // namespace
@@ -2,8 +2,15 @@
 
 #include <benchmark/benchmark.h>
 
+#include <string>
+#include <variant>
+
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lexer/RealLiteralConversion.h"
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Error.h"
 
 namespace {
 
@@ -39,11 +46,107 @@ static void BM_ComputeValue_Integer(benchmark::State& state) {
   }
 }
 
+static void BM_ComputeValue(benchmark::State& state, llvm::StringRef text) {
+  auto val = LexedNumericLiteral::Lex(text);
+  auto emitter = NullDiagnosticEmitter<const char*>();
+  COCKTAIL_CHECK(val);
+  for (auto _ : state) {
+    val->ComputeValue(emitter);
+  }
+}
+
+static void BM_ComputeValue_LongDecimal(benchmark::State& state) {
+  BM_ComputeValue(state, "1234567890123456789");
+}
+
+static void BM_ComputeValue_WideDecimal(benchmark::State& state) {
+  BM_ComputeValue(state, "123456789012345678901234567890");
+}
+
+static void BM_ComputeValue_Hexadecimal(benchmark::State& state) {
+  BM_ComputeValue(state, "0x1234_ABCD_5678_EF90");
+}
+
+static void BM_ComputeValue_Binary(benchmark::State& state) {
+  BM_ComputeValue(state, "0b1010_1010_0101_0101_1100_0011_0011_1100");
+}
+
+static void BM_ComputeValue_Separators(benchmark::State& state) {
+  BM_ComputeValue(state, "1_000_000_000_000_000_000");
+}
+
+static auto ComputeRealValue(llvm::StringRef text)
+    -> LexedNumericLiteral::RealValue {
+  auto val = LexedNumericLiteral::Lex(text);
+  COCKTAIL_CHECK(val);
+  auto emitter = NullDiagnosticEmitter<const char*>();
+  auto value = val->ComputeValue(emitter);
+  COCKTAIL_CHECK(std::holds_alternative<LexedNumericLiteral::RealValue>(value));
+  return std::get<LexedNumericLiteral::RealValue>(value);
+}
+
+static void BM_ToDouble(benchmark::State& state, llvm::StringRef text) {
+  auto real = ComputeRealValue(text);
+  bool is_decimal = real.radix == LexedNumericLiteral::Radix::Decimal;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        RealLiteralToDouble(real.mantissa, real.exponent, is_decimal));
+  }
+}
+
+// Converts as lowering would without `RealLiteralToDouble`, by printing the
+// value and having `llvm::APFloat` read it back.
+static void BM_ToDoubleByAPFloat(benchmark::State& state,
+                                 llvm::StringRef text) {
+  auto real = ComputeRealValue(text);
+  bool is_decimal = real.radix == LexedNumericLiteral::Radix::Decimal;
+  for (auto _ : state) {
+    llvm::SmallString<64> value_text;
+    if (!is_decimal) {
+      value_text += "0x";
+    }
+    real.mantissa.toStringUnsigned(value_text, is_decimal ? 10 : 16);
+    value_text += is_decimal ? 'e' : 'p';
+    value_text += std::to_string(real.exponent.getSExtValue());
+    llvm::APFloat value(llvm::APFloat::IEEEdouble());
+    auto status =
+        value.convertFromString(value_text, llvm::APFloat::rmNearestTiesToEven);
+    COCKTAIL_CHECK(static_cast<bool>(status));
+    benchmark::DoNotOptimize(value.convertToDouble());
+  }
+}
+
+static void BM_ToFloat(benchmark::State& state, llvm::StringRef text) {
+  auto real = ComputeRealValue(text);
+  bool is_decimal = real.radix == LexedNumericLiteral::Radix::Decimal;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        RealLiteralToFloat(real.mantissa, real.exponent, is_decimal));
+  }
+}
+
 BENCHMARK(BM_Lex_Float);
 BENCHMARK(BM_Lex_Integer);
 BENCHMARK(BM_ComputeValue_Float);
 BENCHMARK(BM_ComputeValue_Integer);
+BENCHMARK(BM_ComputeValue_LongDecimal);
+BENCHMARK(BM_ComputeValue_WideDecimal);
+BENCHMARK(BM_ComputeValue_Hexadecimal);
+BENCHMARK(BM_ComputeValue_Binary);
+BENCHMARK(BM_ComputeValue_Separators);
 
-}  // namespace
+// Exactly representable, long, tiny and hexadecimal values.
+BENCHMARK_CAPTURE(BM_ToDouble, Short, "1.5");
+BENCHMARK_CAPTURE(BM_ToDouble, Long, "3.141592653589793238");
+BENCHMARK_CAPTURE(BM_ToDouble, Wide, "2.7182818284590452353602874713527");
+BENCHMARK_CAPTURE(BM_ToDouble, Tiny, "4.9406564584124654e-324");
+BENCHMARK_CAPTURE(BM_ToDouble, Hexadecimal, "0x1.921FB54442D18p1");
+BENCHMARK_CAPTURE(BM_ToDoubleByAPFloat, Short, "1.5");
+BENCHMARK_CAPTURE(BM_ToDoubleByAPFloat, Long, "3.141592653589793238");
+BENCHMARK_CAPTURE(BM_ToDoubleByAPFloat, Wide,
+                  "2.7182818284590452353602874713527");
+BENCHMARK_CAPTURE(BM_ToDoubleByAPFloat, Tiny, "4.9406564584124654e-324");
+BENCHMARK_CAPTURE(BM_ToDoubleByAPFloat, Hexadecimal, "0x1.921FB54442D18p1");
+BENCHMARK_CAPTURE(BM_ToFloat, Long, "3.141592653589793238");
 
-BENCHMARK_MAIN();
+}  // namespace
@@ -0,0 +1,229 @@
+#include "Cocktail/Parser/ParseTree.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace {
+
+using namespace Cocktail;
+
+static constexpr llvm::StringLiteral TestFileName = "test.cocktail";
+
+// Which phases a benchmark measures. Parsing alone is measured on tokens lexed
+// up front, so that a regression in the parser shows up on its own.
+enum class Phase {
+  Lex,
+  Parse,
+  LexAndParse,
+  // Parsing without function bodies, as tools that only need declarations do.
+  ParseSkippingBodies,
+};
+
+static void BM_Text(benchmark::State& state, Phase phase,
+                    const std::string& text) {
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(TestFileName, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer(text));
+  auto source =
+      SourceBuffer::CreateFromFile(fs, TestFileName, NullDiagnosticConsumer());
+  auto tokens = TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
+  auto tree = ParseTree::Parse(tokens, NullDiagnosticConsumer());
+  for (auto _ : state) {
+    switch (phase) {
+      case Phase::Lex:
+        benchmark::DoNotOptimize(
+            TokenizedBuffer::Lex(*source, NullDiagnosticConsumer()));
+        break;
+      case Phase::Parse:
+        benchmark::DoNotOptimize(
+            ParseTree::Parse(tokens, NullDiagnosticConsumer()));
+        break;
+      case Phase::LexAndParse: {
+        auto lexed = TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
+        benchmark::DoNotOptimize(
+            ParseTree::Parse(lexed, NullDiagnosticConsumer()));
+        break;
+      }
+      case Phase::ParseSkippingBodies:
+        benchmark::DoNotOptimize(ParseTree::Parse(
+            tokens, NullDiagnosticConsumer(), ParseTree::NodeStorage::Reserved,
+            ParseTree::FunctionBodies::Skipped));
+        break;
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations() * text.size());
+  state.counters["tokens"] = benchmark::Counter(
+      tokens.size(), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["nodes"] = benchmark::Counter(
+      tree.size(), benchmark::Counter::kIsIterationInvariantRate);
+  // How much node storage the parser allocates for each token.
+  state.counters["node_bytes_per_token"] =
+      static_cast<double>(tree.node_storage_bytes()) / tokens.size();
+}
+
+static void BM_ParseFunctions(benchmark::State& state) {
+  std::string text;
+  // Aim for about 100k of ordinary function bodies.
+  for (int i = 0; text.size() < 100000; ++i) {
+    std::string name = "F" + std::to_string(i);
+    text += "fn " + name + "(n: i32, s: String) -> i32 {\n";
+    text += "  var total: i32 = 0;\n";
+    text += "  while (total < n) {\n";
+    text += "    if (a.b.Check(total, (n - 1) * 2)) {\n";
+    text += "      total = total + 1;\n";
+    text += "    } else {\n";
+    text += "      break;\n";
+    text += "    }\n";
+    text += "  }\n";
+    text += "  return total;\n";
+    text += "}\n";
+  }
+  BM_Text(state, Phase::Parse, text);
+}
+
+BENCHMARK(BM_ParseFunctions);
+
+// A flat list of `state.range(0)` small functions.
+static void BM_FlatFunctions(benchmark::State& state, Phase phase) {
+  std::string text;
+  for (int i = 0; i < state.range(0); ++i) {
+    text += "fn F" + std::to_string(i) + "(a: i32, b: i32) -> i32 {\n";
+    text += "  return a + b;\n";
+    text += "}\n";
+  }
+  BM_Text(state, phase, text);
+}
+
+BENCHMARK_CAPTURE(BM_FlatFunctions, Lex, Phase::Lex)->Arg(1000)->Arg(10000);
+BENCHMARK_CAPTURE(BM_FlatFunctions, Parse, Phase::Parse)
+    ->Arg(1000)
+    ->Arg(10000);
+BENCHMARK_CAPTURE(BM_FlatFunctions, LexAndParse, Phase::LexAndParse)
+    ->Arg(1000)
+    ->Arg(10000);
+BENCHMARK_CAPTURE(BM_FlatFunctions, ParseSkippingBodies,
+                  Phase::ParseSkippingBodies)
+    ->Arg(1000)
+    ->Arg(10000);
+
+// Functions whose bodies are `if` and `while` blocks nested `state.range(0)`
+// deep.
+static void BM_NestedBlocks(benchmark::State& state, Phase phase) {
+  int depth = state.range(0);
+  std::string text;
+  // Aim for about 100k however deep the blocks are.
+  for (int i = 0; text.size() < 100000; ++i) {
+    text += "fn F" + std::to_string(i) + "(n: i32) {\n";
+    for (int level = 0; level < depth; ++level) {
+      text.append(level * 2 + 2, ' ');
+      text += level % 2 ? "while (n > 0) {\n" : "if (n == 1) {\n";
+    }
+    text.append(depth * 2 + 2, ' ');
+    text += "n = n - 1;\n";
+    for (int level = depth - 1; level >= 0; --level) {
+      text.append(level * 2 + 2, ' ');
+      text += level % 2 ? "}\n" : "} else {}\n";
+    }
+    text += "}\n";
+  }
+  BM_Text(state, phase, text);
+}
+
+BENCHMARK_CAPTURE(BM_NestedBlocks, Parse, Phase::Parse)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(32)
+    ->Arg(1024);
+BENCHMARK_CAPTURE(BM_NestedBlocks, LexAndParse, Phase::LexAndParse)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(32)
+    ->Arg(1024);
+
+// Variable initializers that chain `state.range(0)` binary operators.
+static void BM_OperatorChains(benchmark::State& state, Phase phase) {
+  int length = state.range(0);
+  std::string text;
+  // Aim for about 100k however long the chains are.
+  for (int i = 0; text.size() < 100000; ++i) {
+    text += "var v" + std::to_string(i) + ": i32 = x0";
+    for (int j = 1; j <= length; ++j) {
+      text += j % 2 ? " * x" : " + x";
+      text += std::to_string(j);
+    }
+    text += ";\n";
+  }
+  BM_Text(state, phase, text);
+}
+
+BENCHMARK_CAPTURE(BM_OperatorChains, Parse, Phase::Parse)
+    ->Arg(8)
+    ->Arg(1000);
+BENCHMARK_CAPTURE(BM_OperatorChains, LexAndParse, Phase::LexAndParse)
+    ->Arg(8)
+    ->Arg(1000);
+
+// A variable whose type and value are struct literals with `state.range(0)`
+// fields.
+static void BM_StructLiterals(benchmark::State& state, Phase phase) {
+  int fields = state.range(0);
+  std::string type = "{";
+  std::string value = "{";
+  for (int i = 0; i < fields; ++i) {
+    std::string field = "field" + std::to_string(i);
+    type += "." + field + ": i32, ";
+    value += "." + field + " = " + std::to_string(i) + ", ";
+  }
+  type += "}";
+  value += "}";
+  BM_Text(state, phase, "var s: " + type + " = " + value + ";\n");
+}
+
+BENCHMARK_CAPTURE(BM_StructLiterals, Parse, Phase::Parse)
+    ->Arg(100)
+    ->Arg(100000);
+BENCHMARK_CAPTURE(BM_StructLiterals, LexAndParse, Phase::LexAndParse)
+    ->Arg(100)
+    ->Arg(100000);
+
+// Parses `state.range(0)` small functions in parallel on a scheduler of
+// `state.range(1)` threads.
+static void BM_ParallelParse(benchmark::State& state) {
+  std::string text;
+  for (int i = 0; i < state.range(0); ++i) {
+    text += "fn F" + std::to_string(i) + "(a: i32, b: i32) -> i32 {\n";
+    text += "  return a + b;\n";
+    text += "}\n";
+  }
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(TestFileName, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer(text));
+  auto source =
+      SourceBuffer::CreateFromFile(fs, TestFileName, NullDiagnosticConsumer());
+  auto tokens = TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
+  TaskScheduler scheduler(state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        ParseTree::Parse(tokens, NullDiagnosticConsumer(), scheduler));
+  }
+
+  state.SetBytesProcessed(state.iterations() * text.size());
+  state.counters["tokens"] = benchmark::Counter(
+      tokens.size(), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK(BM_ParallelParse)
+    ->Args({100000, 1})
+    ->Args({100000, 4})
+    ->Args({100000, 16})
+    ->UseRealTime();
+
+}  // namespace
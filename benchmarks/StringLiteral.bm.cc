@@ -2,6 +2,10 @@
 
 #include <benchmark/benchmark.h>
 
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "llvm/Support/Allocator.h"
+
 namespace {
 
 using namespace Cocktail;
@@ -67,6 +71,24 @@ BENCHMARK(BM_IncompleteWithEscapes_Simple);
 BENCHMARK(BM_IncompleteWithEscapes_Multiline);
 BENCHMARK(BM_IncompleteWithEscapes_Raw);
 
-}  // namespace
+static void BM_ComputeValue_Multiline(benchmark::State& state) {
+  // About 100k of an indented block, like an embedded SQL query.
+  std::string x = "\"\"\"\n";
+  while (x.size() < 100000) {
+    x.append("    SELECT name, \\\"value\\\" FROM table  \n");
+    x.append("    WHERE id = 1 \\\n");
+    x.append("\n");
+  }
+  x.append("    \"\"\"");
+  auto literal = LexedStringLiteral::Lex(x);
+  COCKTAIL_CHECK(literal && literal->is_terminated());
+  auto emitter = NullDiagnosticEmitter<const char*>();
+  for (auto _ : state) {
+    llvm::BumpPtrAllocator allocator;
+    benchmark::DoNotOptimize(literal->ComputeValue(allocator, emitter));
+  }
+}
 
-BENCHMARK_MAIN();
+BENCHMARK(BM_ComputeValue_Multiline);
+
+}  // namespace
@@ -0,0 +1,372 @@
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+static constexpr llvm::StringLiteral TestFileName = "test.cocktail";
+
+// Reports the throughput of lexing `bytes` bytes into `tokens` tokens per
+// iteration, in bytes per second and tokens per second.
+static void SetLexCounters(benchmark::State& state, int64_t bytes,
+                           int64_t tokens) {
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.counters["tokens"] = benchmark::Counter(
+      tokens, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_LexText(benchmark::State& state, const std::string& text) {
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(TestFileName, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer(text));
+  auto source =
+      SourceBuffer::CreateFromFile(fs, TestFileName, NullDiagnosticConsumer());
+  int64_t tokens = 0;
+  for (auto _ : state) {
+    auto buffer = TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
+    tokens = buffer.size();
+    benchmark::DoNotOptimize(buffer);
+  }
+  SetLexCounters(state, text.size(), tokens);
+}
+
+static void BM_LexWords(benchmark::State& state,
+                        llvm::ArrayRef<llvm::StringRef> words) {
+  std::string text;
+  // Aim for about 100k to emphasize per-word costs.
+  while (text.size() < 100000) {
+    for (llvm::StringRef word : words) {
+      text.append(word.begin(), word.end());
+      text.append(" ");
+    }
+  }
+  BM_LexText(state, text);
+}
+
+static void BM_LexWords_Keywords(benchmark::State& state) {
+  BM_LexWords(state, {"fn", "var", "if", "else", "while", "return", "class",
+                      "interface", "package", "let", "match", "where"});
+}
+
+static void BM_LexWords_Identifiers(benchmark::State& state) {
+  BM_LexWords(state, {"f", "value", "iffy", "elsewhere", "whilst", "returned",
+                      "classy", "interfaces", "packages", "letter", "matches",
+                      "wherever"});
+}
+
+// Identifiers in other languages, whose non-ASCII characters are decoded and
+// looked up rather than scanned a vector at a time: "valeur", "compteur",
+// "résultat", "größe", "значение", "値", "索引", "크기" and "xʹ".
+static void BM_LexWords_UnicodeIdentifiers(benchmark::State& state) {
+  BM_LexWords(state, {"valeur", "compteur", "r\xC3\xA9sultat",
+                      "gr\xC3\xB6\xC3\x9F" "e",
+                      "\xD0\xB7\xD0\xBD\xD0\xB0\xD1\x87\xD0\xB5\xD0\xBD"
+                      "\xD0\xB8\xD0\xB5",
+                      "\xE5\x80\xA4", "\xE7\xB4\xA2\xE5\xBC\x95",
+                      "\xED\x81\xAC\xEA\xB8\xB0", "x\xCA\xB9"});
+}
+
+BENCHMARK(BM_LexWords_Keywords);
+BENCHMARK(BM_LexWords_Identifiers);
+BENCHMARK(BM_LexWords_UnicodeIdentifiers);
+
+static void BM_LexComments(benchmark::State& state, int indent) {
+  std::string text;
+  // Aim for about 100k, like a long license header or doc comment block.
+  while (text.size() < 100000) {
+    text.append(indent, ' ');
+    text.append("// Lorem ipsum dolor sit amet, consectetur adipiscing.\n");
+  }
+  BM_LexText(state, text);
+}
+
+static void BM_LexComments_Unindented(benchmark::State& state) {
+  BM_LexComments(state, 0);
+}
+
+static void BM_LexComments_Indented(benchmark::State& state) {
+  BM_LexComments(state, 24);
+}
+
+BENCHMARK(BM_LexComments_Unindented);
+BENCHMARK(BM_LexComments_Indented);
+
+// The synthesized inputs below are large enough that the source and the
+// tokens don't fit in cache, as for a large file. Each is deterministic, so
+// runs can be compared.
+static constexpr int64_t SynthesizedSize = 4 << 20;
+
+static auto MakeIdentifier(std::mt19937& rng) -> std::string {
+  static constexpr llvm::StringLiteral Parts[] = {
+      "value", "count", "node", "index", "buffer", "token", "x", "i",
+      "result", "Make", "Get", "size", "begin", "end", "parse", "Tree"};
+  std::string identifier(Parts[rng() % std::size(Parts)]);
+  if (rng() % 2) {
+    identifier += '_';
+    identifier += Parts[rng() % std::size(Parts)];
+  }
+  if (rng() % 4 == 0) {
+    identifier += std::to_string(rng() % 100);
+  }
+  return identifier;
+}
+
+// Mostly identifiers, a few of them keywords, as in declarations and calls.
+static void BM_Lex_IdentifierHeavy(benchmark::State& state) {
+  std::mt19937 rng(1);
+  std::string text;
+  while (static_cast<int64_t>(text.size()) < SynthesizedSize) {
+    text += "  var ";
+    text += MakeIdentifier(rng);
+    text += ": ";
+    text += MakeIdentifier(rng);
+    text += " = ";
+    text += MakeIdentifier(rng);
+    text += '.';
+    text += MakeIdentifier(rng);
+    text += '(';
+    text += MakeIdentifier(rng);
+    text += ", ";
+    text += MakeIdentifier(rng);
+    text += ");\n";
+  }
+  BM_LexText(state, text);
+}
+
+// Operators and punctuation, mostly without spaces between them.
+static void BM_Lex_SymbolHeavy(benchmark::State& state) {
+  static constexpr llvm::StringLiteral Symbols[] = {
+      "+", "-", "*", "/", "%", "==", "!=", "<=", ">=", "<", ">", "->",
+      "=>", "&", "|", "^", "~", ".", ",", ";", ":", "=", "+=", "<<", ">>",
+      "<=>", "!", "?", "@", "++", "--", ":="};
+  std::mt19937 rng(2);
+  std::string text;
+  while (static_cast<int64_t>(text.size()) < SynthesizedSize) {
+    for (int i = 0; i < 16; ++i) {
+      text += Symbols[rng() % std::size(Symbols)];
+      if (rng() % 4 == 0) {
+        text += ' ';
+      }
+    }
+    text += '\n';
+  }
+  BM_LexText(state, text);
+}
+
+// Blocks of doc comments between short functions, as in a documented API.
+static void BM_Lex_CommentHeavy(benchmark::State& state) {
+  std::string text;
+  while (static_cast<int64_t>(text.size()) < SynthesizedSize) {
+    text +=
+        "  // Returns the number of elements in the range, which must be\n"
+        "  // valid. This is linear in the size of the range unless its\n"
+        "  // iterators are random access.\n"
+        "  //\n"
+        "  // Example: `Count(values)`\n"
+        "  fn Count(values: Range) -> i64 { return values.size(); }\n"
+        "\n";
+  }
+  BM_LexText(state, text);
+}
+
+// Numeric and string literals of every form, including wide integers,
+// escapes and block strings.
+static void BM_Lex_LiteralHeavy(benchmark::State& state) {
+  std::mt19937 rng(3);
+  std::string text;
+  while (static_cast<int64_t>(text.size()) < SynthesizedSize) {
+    text += std::to_string(rng());
+    text += " 0x";
+    text += llvm::utohexstr(rng());
+    text += " 0b1010_1010 ";
+    text += std::to_string(rng() % 1000);
+    text += '.';
+    text += std::to_string(rng() % 1000);
+    text += "e";
+    text += std::to_string(rng() % 30);
+    text += " 123456789012345678901234567890 \"a string\" ";
+    text += "\"with \\t escapes\\n\" i32 u64 f64\n";
+    if (rng() % 8 == 0) {
+      text += "\"\"\"\n  a block string\n  of two lines\n  \"\"\"\n";
+    }
+  }
+  BM_LexText(state, text);
+}
+
+// Groups nested `state.range(0)` deep, which stresses matching opening and
+// closing symbols.
+static void BM_Lex_NestedGroups(benchmark::State& state) {
+  static constexpr llvm::StringLiteral Openings[] = {"(", "[", "{"};
+  static constexpr llvm::StringLiteral Closings[] = {")", "]", "}"};
+  int depth = state.range(0);
+  std::string text;
+  while (static_cast<int64_t>(text.size()) < SynthesizedSize) {
+    for (int i = 0; i < depth; ++i) {
+      text += Openings[i % 3];
+      text += "x, ";
+    }
+    for (int i = depth - 1; i >= 0; --i) {
+      text += Closings[i % 3];
+    }
+    text += '\n';
+  }
+  BM_LexText(state, text);
+}
+
+// Many short or blank lines, which stresses the per-line costs.
+static void BM_Lex_ShortLines(benchmark::State& state) {
+  std::string text;
+  while (static_cast<int64_t>(text.size()) < SynthesizedSize) {
+    text += "{\n  x;\n\n  y = z;\n}\n\n";
+  }
+  BM_LexText(state, text);
+}
+
+BENCHMARK(BM_Lex_IdentifierHeavy);
+BENCHMARK(BM_Lex_SymbolHeavy);
+BENCHMARK(BM_Lex_CommentHeavy);
+BENCHMARK(BM_Lex_LiteralHeavy);
+BENCHMARK(BM_Lex_NestedGroups)->Arg(4)->Arg(64)->Arg(1024);
+BENCHMARK(BM_Lex_ShortLines);
+
+// Returns the contents of every file under `directory` in the source tree.
+// Files in the fuzzer corpus start with the length of a filename and the
+// filename, which are dropped.
+static auto ReadCorpus(llvm::StringRef directory, bool is_fuzzer_corpus)
+    -> std::vector<std::string> {
+  std::vector<std::string> files;
+  std::error_code ec;
+  for (llvm::sys::fs::recursive_directory_iterator
+           it(llvm::Twine(COCKTAIL_SOURCE_DIR) + "/" + directory, ec),
+       end;
+       it != end && !ec; it.increment(ec)) {
+    if (it->type() != llvm::sys::fs::file_type::regular_file) {
+      continue;
+    }
+    auto file = llvm::MemoryBuffer::getFile(it->path());
+    COCKTAIL_CHECK(file) << "Unable to read " << it->path();
+    llvm::StringRef text = (*file)->getBuffer();
+    if (is_fuzzer_corpus) {
+      if (text.size() < 2) {
+        continue;
+      }
+      uint16_t filename_length;
+      std::memcpy(&filename_length, text.data(), 2);
+      text = text.drop_front(2);
+      if (text.size() < filename_length) {
+        continue;
+      }
+      text = text.drop_front(filename_length);
+    }
+    files.push_back(text.str());
+  }
+  COCKTAIL_CHECK(!ec) << "Unable to read " << directory << ": "
+                      << ec.message();
+  return files;
+}
+
+// Lexes each file of a corpus in turn, as a build of many small files does.
+static void BM_LexCorpus(benchmark::State& state, llvm::StringRef directory,
+                         bool is_fuzzer_corpus) {
+  std::vector<std::string> files = ReadCorpus(directory, is_fuzzer_corpus);
+  llvm::vfs::InMemoryFileSystem fs;
+  std::vector<SourceBuffer> sources;
+  int64_t bytes = 0;
+  for (int i = 0, size = files.size(); i != size; ++i) {
+    std::string filename = std::to_string(i) + ".cocktail";
+    fs.addFile(filename, /*ModificationTime=*/0,
+               llvm::MemoryBuffer::getMemBuffer(files[i]));
+    auto source =
+        SourceBuffer::CreateFromFile(fs, filename, NullDiagnosticConsumer());
+    // Some fuzzer inputs aren't valid UTF-8, so they are never lexed.
+    if (!source) {
+      continue;
+    }
+    sources.push_back(std::move(*source));
+    bytes += files[i].size();
+  }
+  int64_t tokens = 0;
+  for (auto _ : state) {
+    tokens = 0;
+    for (SourceBuffer& source : sources) {
+      auto buffer = TokenizedBuffer::Lex(source, NullDiagnosticConsumer());
+      tokens += buffer.size();
+      benchmark::DoNotOptimize(buffer);
+    }
+  }
+  SetLexCounters(state, bytes, tokens);
+}
+
+static void BM_LexCorpus_TestCases(benchmark::State& state) {
+  BM_LexCorpus(state, "unittests/TestCase", /*is_fuzzer_corpus=*/false);
+}
+
+static void BM_LexCorpus_Fuzzer(benchmark::State& state) {
+  BM_LexCorpus(state, "unittests/Fuzzer/Lexer/fuzzer_corpus",
+               /*is_fuzzer_corpus=*/true);
+}
+
+// The fuzzer corpus minimized by the `minimize-fuzzer-corpus` target.
+static void BM_LexCorpus_FuzzerSeeds(benchmark::State& state) {
+  constexpr llvm::StringLiteral Seeds =
+      "unittests/Fuzzer/Lexer/fuzzer_seeds/tokenized_buffer";
+  if (!llvm::sys::fs::is_directory(llvm::Twine(COCKTAIL_SOURCE_DIR) + "/" +
+                                   Seeds)) {
+    state.SkipWithError("No seeds; build `minimize-fuzzer-corpus` first.");
+    return;
+  }
+  BM_LexCorpus(state, Seeds, /*is_fuzzer_corpus=*/true);
+}
+
+BENCHMARK(BM_LexCorpus_TestCases);
+BENCHMARK(BM_LexCorpus_Fuzzer);
+BENCHMARK(BM_LexCorpus_FuzzerSeeds);
+
+// Measures `Print`, as used by `dump-tokens`, which asks for the spelling of
+// every token.
+static void BM_PrintTokens(benchmark::State& state, const std::string& text) {
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(TestFileName, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer(text));
+  auto source =
+      SourceBuffer::CreateFromFile(fs, TestFileName, NullDiagnosticConsumer());
+  auto tokens = TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
+  llvm::raw_null_ostream output;
+  for (auto _ : state) {
+    tokens.Print(output);
+  }
+}
+
+static void BM_PrintTokens_Literals(benchmark::State& state) {
+  std::string text;
+  // Aim for about 100k of numeric and string literals.
+  while (text.size() < 100000) {
+    text.append("12345 0x12_3ABC 0b1010 3.14159 1.5e10 \"a string literal\"\n");
+    text.append("\"\"\"\nblock string\n\"\"\"\n");
+  }
+  BM_PrintTokens(state, text);
+}
+
+BENCHMARK(BM_PrintTokens_Literals);
+
+}  // namespace
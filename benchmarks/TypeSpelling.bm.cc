@@ -0,0 +1,66 @@
+#include "Cocktail/CppRefactor/TypeSpelling.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "Cocktail/Common/Check.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+
+namespace {
+
+using namespace Cocktail;
+
+namespace cam = ::clang::ast_matchers;
+
+// Returns the type of `depth` templates nested in each other, such as
+// `const Box<const Box<int>*>*` for 2. It's one part of the type, whose
+// spelling is long.
+static auto MakeTemplates(int depth) -> std::string {
+  std::string type = "int";
+  for (int i = 0; i < depth; ++i) {
+    type = "const Box<" + type + ">*";
+  }
+  return type;
+}
+
+// Returns the type of `depth` const pointers nested in each other, such as
+// `const int* const* const` for 2, which has a part per qualifier and
+// pointer.
+static auto MakePointers(int depth) -> std::string {
+  std::string type = "const int";
+  for (int i = 0; i < depth; ++i) {
+    type += "* const";
+  }
+  return type;
+}
+
+static void BM_SpellType(benchmark::State& state,
+                         std::string (*make_type)(int depth)) {
+  std::string code = "template <typename T> struct Box {};\n" +
+                     make_type(state.range(0)) + " x = {};\n";
+  std::unique_ptr<clang::ASTUnit> ast = clang::tooling::buildASTFromCode(code);
+  auto matches = cam::match(cam::varDecl(cam::hasName("x")).bind("x"),
+                            ast->getASTContext());
+  COCKTAIL_CHECK(matches.size() == 1);
+  const auto* decl = matches[0].getNodeAs<clang::VarDecl>("x");
+  clang::TypeLoc type_loc = decl->getTypeSourceInfo()->getTypeLoc();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        SpellType(type_loc, ast->getSourceManager(), ast->getLangOpts()));
+  }
+}
+
+BENCHMARK_CAPTURE(BM_SpellType, Templates, MakeTemplates)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(128);
+BENCHMARK_CAPTURE(BM_SpellType, Pointers, MakePointers)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(128);
+
+}  // namespace
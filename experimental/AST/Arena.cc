@@ -0,0 +1,52 @@
+#include "experimental/AST/Arena.h"
+
+#include <iterator>
+#include <memory>
+
+namespace Cocktail {
+
+thread_local Arena* syntax_arena = nullptr;
+
+Arena::~Arena() {
+  // Destroy the objects in the reverse of the order they were made in, as
+  // objects are destroyed in general.
+  for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it) {
+    it->second(it->first);
+  }
+}
+
+void Arena::Adopt(Arena& other) {
+  // This arena goes on bumping through the block it's in.
+  blocks_.insert(blocks_.end(), std::make_move_iterator(other.blocks_.begin()),
+                 std::make_move_iterator(other.blocks_.end()));
+  destructors_.insert(destructors_.end(), other.destructors_.begin(),
+                      other.destructors_.end());
+  other.blocks_.clear();
+  other.destructors_.clear();
+  other.next_ = nullptr;
+  other.end_ = nullptr;
+}
+
+auto Arena::Allocate(size_t size, size_t align) -> void* {
+  if (size + align > BlockSize / 4) {
+    // Too big to share a block without wasting much of it.
+    blocks_.push_back(std::make_unique<char[]>(size + align));
+    void* p = blocks_.back().get();
+    size_t space = size + align;
+    return std::align(align, size, p, space);
+  }
+  void* p = next_;
+  auto space = static_cast<size_t>(end_ - next_);
+  if (!next_ || !std::align(align, size, p, space)) {
+    blocks_.push_back(std::make_unique<char[]>(BlockSize));
+    next_ = blocks_.back().get();
+    end_ = next_ + BlockSize;
+    p = next_;
+    space = BlockSize;
+    std::align(align, size, p, space);
+  }
+  next_ = static_cast<char*>(p) + size;
+  return p;
+}
+
+}  // namespace Cocktail
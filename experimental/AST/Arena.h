@@ -0,0 +1,66 @@
+#ifndef COCKTAIL_EXPERIMENTAL_AST_ARENA_H
+#define COCKTAIL_EXPERIMENTAL_AST_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Cocktail {
+
+// Makes objects of any type by bumping a pointer through blocks of memory,
+// and frees them all at once when the arena is destroyed. The syntax of a
+// program is made in one, as it's made a node at a time by the parser and
+// lives as long as the program does. Of the objects made, only those that
+// own memory of their own, such as names and lists, are destroyed one by one.
+class Arena {
+ public:
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  auto operator=(const Arena&) -> Arena& = delete;
+  ~Arena();
+
+  // Takes the objects made in `other`, which are then destroyed along with
+  // this arena's, leaving `other` empty.
+  void Adopt(Arena& other);
+
+  // Returns a new `T` made from `args`.
+  template <class T, class... Args>
+  auto New(Args&&... args) -> T* {
+    T* x = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destructors_.push_back({x, [](void* y) { static_cast<T*>(y)->~T(); }});
+    }
+    return x;
+  }
+
+ private:
+  static constexpr size_t BlockSize = 64 * 1024;
+
+  auto Allocate(size_t size, size_t align) -> void*;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_ = nullptr;
+  char* end_ = nullptr;
+  // The objects to destroy with the arena, with how to destroy each.
+  std::vector<std::pair<void*, void (*)(void*)>> destructors_;
+};
+
+// The arena that the syntax made on this thread goes in. Without one, each
+// piece of syntax is allocated on its own and never freed.
+extern thread_local Arena* syntax_arena;
+
+// Returns a new `T` made from `args`, in `syntax_arena` if there is one.
+template <class T, class... Args>
+auto NewSyntax(Args&&... args) -> T* {
+  if (syntax_arena) {
+    return syntax_arena->New<T>(std::forward<Args>(args)...);
+  }
+  return new T(std::forward<Args>(args)...);
+}
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_AST_ARENA_H
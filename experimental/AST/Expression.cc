@@ -2,31 +2,33 @@
 
 #include <iostream>
 
+#include "experimental/AST/Arena.h"
+
 namespace Cocktail {
 
 auto MakeTypeType(int line_num) -> Expression* {
-  auto* t = new Expression();
+  auto* t = NewSyntax<Expression>();
   t->tag = ExpressionKind::TypeT;
   t->line_num = line_num;
   return t;
 }
 
 auto MakeIntType(int line_num) -> Expression* {
-  auto* t = new Expression();
+  auto* t = NewSyntax<Expression>();
   t->tag = ExpressionKind::IntT;
   t->line_num = line_num;
   return t;
 }
 
 auto MakeBoolType(int line_num) -> Expression* {
-  auto* t = new Expression();
+  auto* t = NewSyntax<Expression>();
   t->tag = ExpressionKind::BoolT;
   t->line_num = line_num;
   return t;
 }
 
 auto MakeAutoType(int line_num) -> Expression* {
-  auto* t = new Expression();
+  auto* t = NewSyntax<Expression>();
   t->tag = ExpressionKind::AutoT;
   t->line_num = line_num;
   return t;
@@ -34,7 +36,7 @@ auto MakeAutoType(int line_num) -> Expression* {
 
 auto MakeFunType(int line_num, Expression* param, Expression* ret)
     -> Expression* {
-  auto* t = new Expression();
+  auto* t = NewSyntax<Expression>();
   t->tag = ExpressionKind::FunctionT;
   t->line_num = line_num;
   t->u.function_type.parameter = param;
@@ -43,25 +45,28 @@ auto MakeFunType(int line_num, Expression* param, Expression* ret)
 }
 
 auto MakeVar(int line_num, std::string var) -> Expression* {
-  auto* v = new Expression();
+  auto* v = NewSyntax<Expression>();
   v->line_num = line_num;
   v->tag = ExpressionKind::Variable;
-  v->u.variable.name = new std::string(std::move(var));
+  v->u.variable.name = NewSyntax<std::string>(std::move(var));
+  v->u.variable.depth = -1;
+  v->u.variable.slot = -1;
   return v;
 }
 
 auto MakeVarPat(int line_num, std::string var, Expression* type)
     -> Expression* {
-  auto* v = new Expression();
+  auto* v = NewSyntax<Expression>();
   v->line_num = line_num;
   v->tag = ExpressionKind::PatternVariable;
-  v->u.pattern_variable.name = new std::string(std::move(var));
+  v->u.pattern_variable.name = NewSyntax<std::string>(std::move(var));
   v->u.pattern_variable.type = type;
+  v->u.pattern_variable.slot = -1;
   return v;
 }
 
 auto MakeInt(int line_num, int i) -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::Integer;
   e->u.integer = i;
@@ -69,7 +74,7 @@ auto MakeInt(int line_num, int i) -> Expression* {
 }
 
 auto MakeBool(int line_num, bool b) -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::Boolean;
   e->u.boolean = b;
@@ -78,7 +83,7 @@ auto MakeBool(int line_num, bool b) -> Expression* {
 
 auto MakeOp(int line_num, enum Operator op, std::vector<Expression*>* args)
     -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::PrimitiveOp;
   e->u.primitive_op.op = op;
@@ -87,11 +92,11 @@ auto MakeOp(int line_num, enum Operator op, std::vector<Expression*>* args)
 }
 
 auto MakeUnOp(int line_num, enum Operator op, Expression* arg) -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::PrimitiveOp;
   e->u.primitive_op.op = op;
-  auto* args = new std::vector<Expression*>();
+  auto* args = NewSyntax<std::vector<Expression*>>();
   args->push_back(arg);
   e->u.primitive_op.arguments = args;
   return e;
@@ -99,11 +104,11 @@ auto MakeUnOp(int line_num, enum Operator op, Expression* arg) -> Expression* {
 
 auto MakeBinOp(int line_num, enum Operator op, Expression* arg1,
                Expression* arg2) -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::PrimitiveOp;
   e->u.primitive_op.op = op;
-  auto* args = new std::vector<Expression*>();
+  auto* args = NewSyntax<std::vector<Expression*>>();
   args->push_back(arg1);
   args->push_back(arg2);
   e->u.primitive_op.arguments = args;
@@ -111,7 +116,7 @@ auto MakeBinOp(int line_num, enum Operator op, Expression* arg1,
 }
 
 auto MakeCall(int line_num, Expression* fun, Expression* arg) -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::Call;
   e->u.call.function = fun;
@@ -121,18 +126,19 @@ auto MakeCall(int line_num, Expression* fun, Expression* arg) -> Expression* {
 
 auto MakeGetField(int line_num, Expression* exp, std::string field)
     -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::GetField;
   e->u.get_field.aggregate = exp;
-  e->u.get_field.field = new std::string(std::move(field));
+  e->u.get_field.field = NewSyntax<std::string>(std::move(field));
+  e->u.get_field.position = -1;
   return e;
 }
 
 auto MakeTuple(int line_num,
                std::vector<std::pair<std::string, Expression*>>* args)
     -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::Tuple;
   int i = 0;
@@ -147,11 +153,12 @@ auto MakeTuple(int line_num,
 }
 
 auto MakeIndex(int line_num, Expression* exp, Expression* i) -> Expression* {
-  auto* e = new Expression();
+  auto* e = NewSyntax<Expression>();
   e->line_num = line_num;
   e->tag = ExpressionKind::Index;
   e->u.index.aggregate = exp;
   e->u.index.offset = i;
+  e->u.index.position = -1;
   return e;
 }
 
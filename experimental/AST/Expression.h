@@ -39,21 +39,37 @@ struct Expression {
   union {
     struct {
       std::string* name;
+      // Where the variable lives, once `ResolveProgram` has resolved it:
+      // `depth` is 0 for the parameters and locals of the enclosing function
+      // and 1 for globals, and `slot` is the variable's index among them.
+      // Both are -1 until then, and the variable is looked up by name.
+      int depth;
+      int slot;
     } variable;
 
     struct {
       Expression* aggregate;
       std::string* field;
+      // Where the field is among those of the aggregate's type, once type
+      // checking has found it, and -1 until then or for a method or an
+      // alternative.
+      int position;
     } get_field;
 
     struct {
       Expression* aggregate;
       Expression* offset;
+      // Where the element is among those of the tuple's type, once type
+      // checking has found it, and -1 until then.
+      int position;
     } index;
 
     struct {
       std::string* name;
       Expression* type;
+      // The slot of the enclosing function's frame that the variable is bound
+      // to, once `ResolveProgram` has resolved it, and -1 until then.
+      int slot;
     } pattern_variable;
 
     int integer;
@@ -1,5 +1,6 @@
 #include <iostream>
 
+#include "experimental/AST/Arena.h"
 #include "experimental/AST/FunctionDefinition.h"
 
 namespace Cocktail {
@@ -7,7 +8,7 @@ namespace Cocktail {
 auto MakeFunDef(int line_num, std::string name, Expression* ret_type,
                 Expression* param_pattern, Statement* body)
     -> struct FunctionDefinition* {
-  auto* f = new struct FunctionDefinition();
+  auto* f = NewSyntax<struct FunctionDefinition>();
   f->line_num = line_num;
   f->name = std::move(name);
   f->return_type = ret_type;
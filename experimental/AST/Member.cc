@@ -2,13 +2,15 @@
 
 #include <iostream>
 
+#include "experimental/AST/Arena.h"
+
 namespace Cocktail {
 
 auto MakeField(int line_num, std::string name, Expression* type) -> Member* {
-  auto m = new Member();
+  auto m = NewSyntax<Member>();
   m->line_num = line_num;
   m->tag = MemberKind::FieldMember;
-  m->u.field.name = new std::string(std::move(name));
+  m->u.field.name = NewSyntax<std::string>(std::move(name));
   m->u.field.type = type;
   return m;
 }
@@ -21,6 +21,8 @@ enum class StatementKind {
   Match
 };
 
+struct MatchTree;
+
 struct Statement {
   int line_num;
   StatementKind tag;
@@ -63,6 +65,9 @@ struct Statement {
     struct {
       Expression* exp;
       std::list<std::pair<Expression*, Statement*>>* clauses;
+      // The clauses compiled to a decision tree by type checking, or null
+      // until then or if they can't be.
+      MatchTree* tree;
     } match_stmt;
 
   } u;
@@ -0,0 +1,380 @@
+#include "experimental/FromParseTree.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Lex/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseNodeKind.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "experimental/AST/Arena.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace Cocktail {
+
+namespace {
+
+using TupleFields = std::vector<std::pair<std::string, Expression*>>;
+
+// Translates a parse tree without errors into the interpreter's syntax.
+class Translator {
+ public:
+  Translator(const TokenizedBuffer& tokens, const ParseTree& parse_tree)
+      : tokens_(&tokens), parse_tree_(&parse_tree) {}
+
+  auto TranslateFile() -> std::list<Declaration*>*;
+
+ private:
+  // The children of `node` in the order they're written in, which is the
+  // reverse of the order the tree visits them in.
+  auto Children(ParseTree::Node node) const
+      -> llvm::SmallVector<ParseTree::Node>;
+  auto Kind(ParseTree::Node node) const -> ParseNodeKind {
+    return parse_tree_->node_kind(node);
+  }
+  auto TokenKindOf(ParseTree::Node node) const -> TokenKind {
+    return tokens_->GetKind(parse_tree_->node_token(node));
+  }
+  auto Line(ParseTree::Node node) const -> int {
+    return tokens_->GetLineNumber(parse_tree_->node_token(node));
+  }
+  auto Name(ParseTree::Node node) const -> std::string {
+    return parse_tree_->GetNodeText(node).str();
+  }
+  // Reports that the interpreter has no counterpart for `what` at `node`.
+  [[noreturn]] void Unsupported(ParseTree::Node node, const char* what) const;
+
+  auto TranslateFunction(ParseTree::Node node) -> Declaration*;
+  auto TranslateParameters(ParseTree::Node node) -> Expression*;
+  auto TranslateBinding(ParseTree::Node node) -> Expression*;
+  // Returns the statements of the code block `node` chained in sequence, or
+  // null for an empty block, as the interpreter's parser does.
+  auto TranslateStatements(ParseTree::Node node) -> Statement*;
+  auto TranslateBlock(ParseTree::Node node) -> Statement*;
+  auto TranslateStatement(ParseTree::Node node) -> Statement*;
+  auto TranslateCondition(ParseTree::Node node) -> Expression*;
+  auto TranslateExpression(ParseTree::Node node) -> Expression*;
+  auto TranslateLiteral(ParseTree::Node node) -> Expression*;
+  auto TranslateStruct(ParseTree::Node node) -> Expression*;
+  auto MakeTupleOf(int line_num, TupleFields fields) -> Expression* {
+    return MakeTuple(line_num, NewSyntax<TupleFields>(std::move(fields)));
+  }
+
+  const TokenizedBuffer* tokens_;
+  const ParseTree* parse_tree_;
+};
+
+auto Translator::Children(ParseTree::Node node) const
+    -> llvm::SmallVector<ParseTree::Node> {
+  llvm::SmallVector<ParseTree::Node> children(
+      parse_tree_->children(node).begin(), parse_tree_->children(node).end());
+  std::reverse(children.begin(), children.end());
+  return children;
+}
+
+void Translator::Unsupported(ParseTree::Node node, const char* what) const {
+  std::cerr << Line(node) << ": " << what
+            << " can't be run by the interpreter: `"
+            << parse_tree_->GetNodeText(node).str() << "`" << std::endl;
+  exit(-1);
+}
+
+auto Translator::TranslateFile() -> std::list<Declaration*>* {
+  auto* decls = NewSyntax<std::list<Declaration*>>();
+  llvm::SmallVector<ParseTree::Node> roots(parse_tree_->roots().begin(),
+                                           parse_tree_->roots().end());
+  for (ParseTree::Node node : llvm::reverse(roots)) {
+    ParseNodeKind kind = Kind(node);
+    if (kind == ParseNodeKind::FunctionDeclaration()) {
+      decls->push_back(TranslateFunction(node));
+    } else if (kind == ParseNodeKind::VariableDeclaration()) {
+      Unsupported(node, "a global variable");
+    }
+    // What's left is `;` and the end of the file.
+  }
+  return decls;
+}
+
+auto Translator::TranslateFunction(ParseTree::Node node) -> Declaration* {
+  std::string name;
+  Expression* params = nullptr;
+  // Without a return type, a function returns `()`.
+  Expression* ret_type = nullptr;
+  Statement* body = nullptr;
+  for (ParseTree::Node child : Children(node)) {
+    ParseNodeKind kind = Kind(child);
+    if (kind == ParseNodeKind::DeclaredName()) {
+      name = Name(child);
+    } else if (kind == ParseNodeKind::ParameterList()) {
+      params = TranslateParameters(child);
+    } else if (kind == ParseNodeKind::ReturnType()) {
+      ret_type = TranslateExpression(Children(child).front());
+    } else if (kind == ParseNodeKind::CodeBlock()) {
+      body = TranslateStatements(child);
+    } else if (kind == ParseNodeKind::SkippedCodeBlock()) {
+      Unsupported(child, "a function body that wasn't parsed");
+    }
+  }
+  int line_num = Line(node);
+  if (!ret_type) {
+    ret_type = MakeTupleOf(line_num, {});
+  }
+  return MakeFunDecl(MakeFunDef(line_num, name, ret_type, params, body));
+}
+
+auto Translator::TranslateParameters(ParseTree::Node node) -> Expression* {
+  TupleFields params;
+  for (ParseTree::Node child : Children(node)) {
+    if (Kind(child) == ParseNodeKind::PatternBinding()) {
+      params.push_back({"", TranslateBinding(child)});
+    }
+  }
+  return MakeTupleOf(Line(node), std::move(params));
+}
+
+auto Translator::TranslateBinding(ParseTree::Node node) -> Expression* {
+  // The name comes first, then its type.
+  llvm::SmallVector<ParseTree::Node> parts = Children(node);
+  return MakeVarPat(Line(node), Name(parts[0]),
+                    TranslateExpression(parts[1]));
+}
+
+auto Translator::TranslateStatements(ParseTree::Node node) -> Statement* {
+  llvm::SmallVector<ParseTree::Node> children = Children(node);
+  Statement* seq = nullptr;
+  // The last child is the block's `}`.
+  for (auto it = children.rbegin() + 1; it != children.rend(); ++it) {
+    seq = MakeSeq(Line(*it), TranslateStatement(*it), seq);
+  }
+  return seq;
+}
+
+auto Translator::TranslateBlock(ParseTree::Node node) -> Statement* {
+  return MakeBlock(Line(node), TranslateStatements(node));
+}
+
+auto Translator::TranslateStatement(ParseTree::Node node) -> Statement* {
+  ParseNodeKind kind = Kind(node);
+  int line_num = Line(node);
+  llvm::SmallVector<ParseTree::Node> children = Children(node);
+  if (kind == ParseNodeKind::ExpressionStatement()) {
+    ParseTree::Node exp = children[0];
+    if (Kind(exp) == ParseNodeKind::InfixOperator() &&
+        TokenKindOf(exp) == TokenKind::Equal()) {
+      llvm::SmallVector<ParseTree::Node> operands = Children(exp);
+      return MakeAssign(line_num, TranslateExpression(operands[0]),
+                        TranslateExpression(operands[1]));
+    }
+    return MakeExpStmt(line_num, TranslateExpression(exp));
+  }
+  if (kind == ParseNodeKind::VariableDeclaration()) {
+    // `var` is followed by the binding, then its initializer if any.
+    if (Kind(children[1]) != ParseNodeKind::VariableInitializer()) {
+      Unsupported(node, "a variable without an initializer");
+    }
+    return MakeVarDef(line_num, TranslateBinding(children[0]),
+                      TranslateExpression(Children(children[1]).front()));
+  }
+  if (kind == ParseNodeKind::IfStatement()) {
+    Statement* else_stmt = nullptr;
+    // An `else` is followed by either a block or another `if`.
+    if (children.size() > 3) {
+      ParseTree::Node else_node = children[3];
+      else_stmt = Kind(else_node) == ParseNodeKind::IfStatement()
+                      ? TranslateStatement(else_node)
+                      : TranslateBlock(else_node);
+    }
+    return MakeIf(line_num, TranslateCondition(children[0]),
+                  TranslateBlock(children[1]), else_stmt);
+  }
+  if (kind == ParseNodeKind::WhileStatement()) {
+    return MakeWhile(line_num, TranslateCondition(children[0]),
+                     TranslateBlock(children[1]));
+  }
+  if (kind == ParseNodeKind::ReturnStatement()) {
+    // Without a value, `return;` returns `()`.
+    if (children.size() == 1) {
+      return MakeReturn(line_num, MakeTupleOf(line_num, {}));
+    }
+    return MakeReturn(line_num, TranslateExpression(children[0]));
+  }
+  if (kind == ParseNodeKind::BreakStatement()) {
+    return MakeBreak(line_num);
+  }
+  if (kind == ParseNodeKind::ContinueStatement()) {
+    return MakeContinue(line_num);
+  }
+  Unsupported(node, "this statement");
+}
+
+auto Translator::TranslateCondition(ParseTree::Node node) -> Expression* {
+  // The expression is followed by the condition's `)`.
+  return TranslateExpression(Children(node).front());
+}
+
+auto Translator::TranslateExpression(ParseTree::Node node) -> Expression* {
+  ParseNodeKind kind = Kind(node);
+  int line_num = Line(node);
+  if (kind == ParseNodeKind::Literal()) {
+    return TranslateLiteral(node);
+  }
+  if (kind == ParseNodeKind::NameReference()) {
+    return MakeVar(line_num, Name(node));
+  }
+  if (kind == ParseNodeKind::ParenExpression()) {
+    return TranslateExpression(Children(node).front());
+  }
+  if (kind == ParseNodeKind::TupleLiteral() ||
+      kind == ParseNodeKind::CallExpression()) {
+    llvm::SmallVector<ParseTree::Node> children = Children(node);
+    // A call's callee comes before its arguments.
+    auto args = children.begin();
+    if (kind == ParseNodeKind::CallExpression()) {
+      ++args;
+    }
+    TupleFields fields;
+    for (auto it = args; it != children.end(); ++it) {
+      ParseNodeKind child_kind = Kind(*it);
+      if (child_kind != ParseNodeKind::TupleLiteralComma() &&
+          child_kind != ParseNodeKind::TupleLiteralEnd() &&
+          child_kind != ParseNodeKind::CallExpressionComma() &&
+          child_kind != ParseNodeKind::CallExpressionEnd()) {
+        fields.push_back({"", TranslateExpression(*it)});
+      }
+    }
+    Expression* tuple = MakeTupleOf(line_num, std::move(fields));
+    if (kind == ParseNodeKind::TupleLiteral()) {
+      return tuple;
+    }
+    return MakeCall(line_num, TranslateExpression(children[0]), tuple);
+  }
+  if (kind == ParseNodeKind::StructLiteral() ||
+      kind == ParseNodeKind::StructTypeLiteral()) {
+    return TranslateStruct(node);
+  }
+  if (kind == ParseNodeKind::DesignatorExpression()) {
+    llvm::SmallVector<ParseTree::Node> children = Children(node);
+    return MakeGetField(line_num, TranslateExpression(children[0]),
+                        Name(children[1]));
+  }
+  if (kind == ParseNodeKind::PrefixOperator()) {
+    Expression* operand = TranslateExpression(Children(node).front());
+    TokenKind op = TokenKindOf(node);
+    if (op == TokenKind::Minus()) {
+      return MakeUnOp(line_num, Operator::Neg, operand);
+    }
+    if (op == TokenKind::Not()) {
+      return MakeUnOp(line_num, Operator::Not, operand);
+    }
+    Unsupported(node, "this operator");
+  }
+  if (kind == ParseNodeKind::InfixOperator()) {
+    llvm::SmallVector<ParseTree::Node> operands = Children(node);
+    TokenKind op = TokenKindOf(node);
+    if (op == TokenKind::Equal()) {
+      Unsupported(node, "an assignment inside an expression");
+    }
+    Expression* lhs = TranslateExpression(operands[0]);
+    Expression* rhs = TranslateExpression(operands[1]);
+    if (op == TokenKind::Plus()) {
+      return MakeBinOp(line_num, Operator::Add, lhs, rhs);
+    }
+    if (op == TokenKind::Minus()) {
+      return MakeBinOp(line_num, Operator::Sub, lhs, rhs);
+    }
+    if (op == TokenKind::EqualEqual()) {
+      return MakeBinOp(line_num, Operator::Eq, lhs, rhs);
+    }
+    if (op == TokenKind::ExclaimEqual()) {
+      // The interpreter has no `!=` of its own.
+      return MakeUnOp(line_num, Operator::Not,
+                      MakeBinOp(line_num, Operator::Eq, lhs, rhs));
+    }
+    if (op == TokenKind::And()) {
+      return MakeBinOp(line_num, Operator::And, lhs, rhs);
+    }
+    if (op == TokenKind::Or()) {
+      return MakeBinOp(line_num, Operator::Or, lhs, rhs);
+    }
+    Unsupported(node, "this operator");
+  }
+  Unsupported(node, "this expression");
+}
+
+auto Translator::TranslateLiteral(ParseTree::Node node) -> Expression* {
+  int line_num = Line(node);
+  TokenizedBuffer::Token token = parse_tree_->node_token(node);
+  TokenKind kind = tokens_->GetKind(token);
+  if (kind == TokenKind::IntegerLiteral()) {
+    llvm::APInt value = tokens_->GetIntegerLiteral(token);
+    if (value.getActiveBits() > 31) {
+      Unsupported(node, "an integer this large");
+    }
+    return MakeInt(line_num, static_cast<int>(value.getZExtValue()));
+  }
+  // The interpreter's integers have a single width, which each of the
+  // integer types is taken to be.
+  if (kind == TokenKind::IntegerTypeLiteral()) {
+    return MakeIntType(line_num);
+  }
+  if (kind == TokenKind::Bool()) {
+    return MakeBoolType(line_num);
+  }
+  if (kind == TokenKind::Type()) {
+    return MakeTypeType(line_num);
+  }
+  if (kind == TokenKind::Auto()) {
+    return MakeAutoType(line_num);
+  }
+  if (kind == TokenKind::True() || kind == TokenKind::False()) {
+    return MakeBool(line_num, kind == TokenKind::True());
+  }
+  Unsupported(node, "this literal");
+}
+
+auto Translator::TranslateStruct(ParseTree::Node node) -> Expression* {
+  // Both `{.x = 1}` and `{.x: i32}` are tuples with named fields to the
+  // interpreter.
+  TupleFields fields;
+  for (ParseTree::Node field : Children(node)) {
+    ParseNodeKind kind = Kind(field);
+    if (kind != ParseNodeKind::StructFieldValue() &&
+        kind != ParseNodeKind::StructFieldType()) {
+      continue;
+    }
+    // The field's designator, whose only child is its name, comes first.
+    llvm::SmallVector<ParseTree::Node> parts = Children(field);
+    fields.push_back({Name(Children(parts[0]).front()),
+                      TranslateExpression(parts[1])});
+  }
+  return MakeTupleOf(Line(node), std::move(fields));
+}
+
+}  // namespace
+
+auto ParseWithToolchain(const char* filename) -> std::list<Declaration*>* {
+  DiagnosticConsumer& consumer = ConsoleDiagnosticConsumer();
+  std::optional<SourceBuffer> source = SourceBuffer::CreateFromFile(
+      *llvm::vfs::getRealFileSystem(), filename, consumer);
+  if (!source) {
+    return nullptr;
+  }
+  TokenizedBuffer tokens = TokenizedBuffer::Lex(*source, consumer);
+  ParseTree parse_tree = ParseTree::Parse(tokens, consumer);
+  if (tokens.has_errors() || parse_tree.has_errors()) {
+    return nullptr;
+  }
+  // The syntax made copies what it needs of the names, so the tokens and the
+  // tree can go once it's made.
+  return Translator(tokens, parse_tree).TranslateFile();
+}
+
+}  // namespace Cocktail
@@ -0,0 +1,21 @@
+#ifndef COCKTAIL_EXPERIMENTAL_FROM_PARSE_TREE_H
+#define COCKTAIL_EXPERIMENTAL_FROM_PARSE_TREE_H
+
+#include <list>
+
+#include "experimental/AST/Declaration.h"
+
+namespace Cocktail {
+
+// Lexes and parses the file `filename` with the toolchain's front end rather
+// than the interpreter's own parser, and translates its parse tree into the
+// interpreter's syntax, so that a program is read the same way whether it's
+// compiled or run. Returns null after reporting any errors in the file. The
+// interpreter has no counterpart for some of the toolchain's syntax, such as
+// pointers and global variables; the first such construct is reported as an
+// error, and the program exits.
+auto ParseWithToolchain(const char* filename) -> std::list<Declaration*>*;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_FROM_PARSE_TREE_H
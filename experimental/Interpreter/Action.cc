@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 #include <map>
@@ -8,10 +9,85 @@
 #include "experimental/AST/Expression.h"
 #include "experimental/AST/FunctionDefinition.h"
 #include "experimental/Interpreter/Interpreter.h"
+#include "experimental/Interpreter/Pool.h"
 #include "experimental/Interpreter/TypeCheck.h"
 
 namespace Cocktail {
 
+static thread_local Pool<Action> action_pool;
+
+// Returns a new action, which is collected once it's unreachable.
+static auto NewAction() -> Action* {
+  auto* act = action_pool.New();
+  if (state) {
+    state->actions.push_back(act);
+  }
+  return act;
+}
+
+void FreeAction(Action* act) { action_pool.Delete(act); }
+
+void ActionResults::Reserve(int n) {
+  if (n <= capacity_) {
+    return;
+  }
+  auto heap = std::make_unique<Value*[]>(n);
+  std::copy(begin(), end(), heap.get());
+  heap_ = std::move(heap);
+  data_ = heap_.get();
+  capacity_ = n;
+}
+
+// Returns how many subexpression values an action for `e` is handed.
+static auto ResultCount(Expression* e) -> int {
+  switch (e->tag) {
+    case ExpressionKind::Tuple:
+      return e->u.tuple.fields->size();
+    case ExpressionKind::PrimitiveOp:
+      return e->u.primitive_op.arguments->size();
+    case ExpressionKind::Call:
+    case ExpressionKind::FunctionT:
+    case ExpressionKind::Index:
+      return 2;
+    case ExpressionKind::GetField:
+    case ExpressionKind::PatternVariable:
+      return 1;
+    case ExpressionKind::AutoT:
+    case ExpressionKind::BoolT:
+    case ExpressionKind::Boolean:
+    case ExpressionKind::IntT:
+    case ExpressionKind::Integer:
+    case ExpressionKind::TypeT:
+    case ExpressionKind::Variable:
+      return 0;
+  }
+  return 0;
+}
+
+// Returns how many subexpression values an action for `s` is handed. A match
+// without a tree is handed the value matched and then the pattern of each
+// clause it tries.
+static auto ResultCount(Statement* s) -> int {
+  switch (s->tag) {
+    case StatementKind::Assign:
+    case StatementKind::VariableDefinition:
+      return 2;
+    case StatementKind::ExpressionStatement:
+    case StatementKind::If:
+    case StatementKind::Return:
+    case StatementKind::While:
+      return 1;
+    case StatementKind::Match:
+      return s->u.match_stmt.tree ? 1 : 1 + s->u.match_stmt.clauses->size();
+    case StatementKind::Sequence:
+    case StatementKind::Block:
+    case StatementKind::Break:
+    case StatementKind::Continue:
+      return 0;
+  }
+  return 0;
+}
+
 void PrintAct(Action* act, std::ostream& out) {
   switch (act->tag) {
     case ActionKind::DeleteTmpAction:
@@ -44,42 +120,45 @@ void PrintAct(Action* act, std::ostream& out) {
   }
 }
 
-void PrintActList(Cons<Action*>* ls, std::ostream& out) {
-  if (ls) {
-    PrintAct(ls->curr, out);
-    if (ls->next) {
+void PrintActList(const Stack<Action*>& ls, std::ostream& out) {
+  auto it = ls.begin();
+  while (it != ls.end()) {
+    PrintAct(*it, out);
+    if (++it != ls.end()) {
       out << " :: ";
-      PrintActList(ls->next, out);
     }
   }
 }
 
 auto MakeExpAct(Expression* e) -> Action* {
-  auto* act = new Action();
+  auto* act = NewAction();
   act->tag = ActionKind::ExpressionAction;
   act->u.exp = e;
   act->pos = -1;
+  act->results.Reserve(ResultCount(e));
   return act;
 }
 
 auto MakeLvalAct(Expression* e) -> Action* {
-  auto* act = new Action();
+  auto* act = NewAction();
   act->tag = ActionKind::LValAction;
   act->u.exp = e;
   act->pos = -1;
+  act->results.Reserve(ResultCount(e));
   return act;
 }
 
 auto MakeStmtAct(Statement* s) -> Action* {
-  auto* act = new Action();
+  auto* act = NewAction();
   act->tag = ActionKind::StatementAction;
   act->u.stmt = s;
   act->pos = -1;
+  act->results.Reserve(ResultCount(s));
   return act;
 }
 
 auto MakeValAct(Value* v) -> Action* {
-  auto* act = new Action();
+  auto* act = NewAction();
   act->tag = ActionKind::ValAction;
   act->u.val = v;
   act->pos = -1;
@@ -87,14 +166,14 @@ auto MakeValAct(Value* v) -> Action* {
 }
 
 auto MakeExpToLvalAct() -> Action* {
-  auto* act = new Action();
+  auto* act = NewAction();
   act->tag = ActionKind::ExpToLValAction;
   act->pos = -1;
   return act;
 }
 
 auto MakeDeleteAct(Address a) -> Action* {
-  auto* act = new Action();
+  auto* act = NewAction();
   act->tag = ActionKind::DeleteTmpAction;
   act->pos = -1;
   act->u.delete_tmp = a;
@@ -2,12 +2,13 @@
 #define COCKTAIL_EXPERIMENTAL_INTERPRETER_ACTION_H
 
 #include <iostream>
-#include <vector>
+#include <memory>
 
 #include "experimental/AST/Expression.h"
 #include "experimental/AST/Statement.h"
-#include "experimental/Interpreter/ConsList.h"
+#include "experimental/Interpreter/Stack.h"
 #include "experimental/Interpreter/Value.h"
+#include "llvm/ADT/ArrayRef.h"
 
 namespace Cocktail {
 
@@ -20,26 +21,71 @@ enum class ActionKind {
   DeleteTmpAction
 };
 
+// The values of an action's subexpressions, kept as they complete. How many
+// there will be is known from the action's expression or statement, so room
+// for them is set aside when the action is made: in the action itself for the
+// one or two that operators, calls and most statements take, and on the heap
+// only for longer tuples and matches.
+class ActionResults {
+ public:
+  static constexpr int InlineCapacity = 2;
+
+  ActionResults() = default;
+  ActionResults(const ActionResults&) = delete;
+  auto operator=(const ActionResults&) -> ActionResults& = delete;
+
+  // Makes room for `n` results, keeping those there are.
+  void Reserve(int n);
+
+  void push_back(Value* v) {
+    if (size_ == capacity_) {
+      Reserve(2 * capacity_);
+    }
+    data_[size_++] = v;
+  }
+  void clear() { size_ = 0; }
+
+  auto size() const -> int { return size_; }
+  auto operator[](int i) const -> Value* { return data_[i]; }
+  auto begin() const -> Value* const* { return data_; }
+  auto end() const -> Value* const* { return data_ + size_; }
+
+  // NOLINTNEXTLINE(google-explicit-constructor)
+  operator llvm::ArrayRef<Value*>() const { return {data_, end()}; }
+
+ private:
+  Value** data_ = inline_;
+  int size_ = 0;
+  int capacity_ = InlineCapacity;
+  Value* inline_[InlineCapacity];
+  std::unique_ptr<Value*[]> heap_;
+};
+
 struct Action {
   ActionKind tag;
+  // The epoch of the last garbage collection that found the action live.
+  unsigned int gc_epoch;
   union {
     Expression* exp;  // for LValAction and ExpressionAction
     Statement* stmt;
     Value* val;  // for finished actions with a value (ValAction)
     Address delete_tmp;
   } u;
-  int pos;                      // position or state of the action
-  std::vector<Value*> results;  // results from subexpression
+  int pos;                // position or state of the action
+  ActionResults results;  // results from subexpression
 };
 
 void PrintAct(Action* act, std::ostream& out);
-void PrintActList(Cons<Action*>* ls, std::ostream& out);
+void PrintActList(const Stack<Action*>& ls, std::ostream& out);
 auto MakeExpAct(Expression* e) -> Action*;
 auto MakeLvalAct(Expression* e) -> Action*;
 auto MakeStmtAct(Statement* s) -> Action*;
 auto MakeValAct(Value* v) -> Action*;
 auto MakeExpToLvalAct() -> Action*;
 auto MakeDeleteAct(Address a) -> Action*;
+// Frees `act`, which the garbage collector found unreachable, keeping its
+// memory for the actions made after it.
+void FreeAction(Action* act);
 
 }  // namespace Cocktail
 
@@ -0,0 +1,363 @@
+#include "experimental/Interpreter/Bytecode.h"
+
+#include <utility>
+#include <vector>
+
+#include "experimental/Interpreter/Value.h"
+
+namespace Cocktail {
+
+// The loops that a `break` or `continue` can leave.
+struct LoopLabels {
+  // Where the loop's condition starts.
+  int start;
+  // The number of blocks entered when the loop started.
+  int block_depth;
+  // The jumps to the end of the loop, which is known only once it's done.
+  std::vector<int> breaks;
+};
+
+struct CompileState {
+  Code code;
+  // The number of blocks entered at the current instruction.
+  int block_depth = 0;
+  // The loops around the current instruction, the innermost last.
+  std::vector<LoopLabels> loops;
+  // Whether the expression being compiled makes temporaries.
+  bool made_temporaries = false;
+};
+
+auto Emit(CompileState* cs, Opcode op, int line_num, int arg = 0,
+          Expression* exp = nullptr) -> int {
+  Instruction in;
+  in.op = op;
+  in.arg = arg;
+  in.line_num = line_num;
+  in.exp = exp;
+  cs->code.instructions.push_back(in);
+  return cs->code.instructions.size() - 1;
+}
+
+// Makes the jump at `at` go to the next instruction emitted.
+void PatchJump(CompileState* cs, int at) {
+  cs->code.instructions[at].arg = cs->code.instructions.size();
+}
+
+void CompileExp(Expression* e, CompileState* cs);
+
+// Compiles `e` to push a pointer to what it denotes, or to a temporary
+// holding its value if it's not an lvalue.
+void CompileLvalue(Expression* e, CompileState* cs) {
+  switch (e->tag) {
+    case ExpressionKind::Variable:
+      switch (e->u.variable.depth) {
+        case 0:
+          Emit(cs, Opcode::AddressOfLocal, e->line_num, e->u.variable.slot);
+          break;
+        case 1:
+          Emit(cs, Opcode::AddressOfGlobal, e->line_num, e->u.variable.slot,
+               e);
+          break;
+        default:
+          Emit(cs, Opcode::AddressOfName, e->line_num, 0, e);
+          break;
+      }
+      break;
+    case ExpressionKind::GetField:
+      CompileLvalue(e->u.get_field.aggregate, cs);
+      Emit(cs, Opcode::FieldAddress, e->line_num, 0, e);
+      break;
+    case ExpressionKind::Index:
+      CompileExp(e->u.index.aggregate, cs);
+      CompileExp(e->u.index.offset, cs);
+      Emit(cs, Opcode::IndexAddress, e->line_num, 0, e);
+      break;
+    case ExpressionKind::Tuple:
+      for (auto& field : *e->u.tuple.fields) {
+        CompileLvalue(field.second, cs);
+      }
+      Emit(cs, Opcode::Tuple, e->line_num, e->u.tuple.fields->size(), e);
+      break;
+    case ExpressionKind::Integer:
+    case ExpressionKind::Boolean:
+    case ExpressionKind::Call:
+    case ExpressionKind::PrimitiveOp:
+    case ExpressionKind::IntT:
+    case ExpressionKind::BoolT:
+    case ExpressionKind::TypeT:
+    case ExpressionKind::FunctionT:
+    case ExpressionKind::AutoT:
+    case ExpressionKind::PatternVariable:
+      CompileExp(e, cs);
+      Emit(cs, Opcode::Temporary, e->line_num);
+      cs->made_temporaries = true;
+      break;
+  }
+}
+
+void CompileExp(Expression* e, CompileState* cs) {
+  switch (e->tag) {
+    case ExpressionKind::Variable:
+      switch (e->u.variable.depth) {
+        case 0:
+          Emit(cs, Opcode::LoadLocal, e->line_num, e->u.variable.slot);
+          break;
+        case 1:
+          Emit(cs, Opcode::LoadGlobal, e->line_num, e->u.variable.slot, e);
+          break;
+        default:
+          Emit(cs, Opcode::LoadName, e->line_num, 0, e);
+          break;
+      }
+      break;
+    case ExpressionKind::PatternVariable: {
+      CompileExp(e->u.pattern_variable.type, cs);
+      int at = Emit(cs, Opcode::MakeVarPattern, e->line_num,
+                    e->u.pattern_variable.slot, e);
+      cs->code.instructions[at].name =
+          InternName(*e->u.pattern_variable.name);
+      break;
+    }
+    case ExpressionKind::GetField:
+      // As in the step machine, the aggregate is found as an lvalue, so that
+      // a field of a variable isn't copied to be read.
+      CompileLvalue(e->u.get_field.aggregate, cs);
+      Emit(cs, Opcode::Field, e->line_num, 0, e);
+      break;
+    case ExpressionKind::Index:
+      CompileExp(e->u.index.aggregate, cs);
+      CompileExp(e->u.index.offset, cs);
+      Emit(cs, Opcode::Index, e->line_num, 0, e);
+      break;
+    case ExpressionKind::Tuple:
+      for (auto& field : *e->u.tuple.fields) {
+        CompileExp(field.second, cs);
+      }
+      Emit(cs, Opcode::Tuple, e->line_num, e->u.tuple.fields->size(), e);
+      break;
+    case ExpressionKind::PrimitiveOp:
+      for (Expression* arg : *e->u.primitive_op.arguments) {
+        CompileExp(arg, cs);
+      }
+      Emit(cs, Opcode::PrimitiveOp, e->line_num,
+           e->u.primitive_op.arguments->size(), e);
+      break;
+    case ExpressionKind::Call:
+      CompileExp(e->u.call.function, cs);
+      CompileExp(e->u.call.argument, cs);
+      Emit(cs, Opcode::Call, e->line_num);
+      break;
+    case ExpressionKind::FunctionT:
+      CompileExp(e->u.function_type.parameter, cs);
+      CompileExp(e->u.function_type.return_type, cs);
+      Emit(cs, Opcode::MakeFunctionType, e->line_num);
+      break;
+    case ExpressionKind::Integer:
+      Emit(cs, Opcode::PushInt, e->line_num, e->u.integer);
+      break;
+    case ExpressionKind::Boolean:
+      Emit(cs, Opcode::PushBool, e->line_num, e->u.boolean);
+      break;
+    case ExpressionKind::IntT:
+      Emit(cs, Opcode::PushIntType, e->line_num);
+      break;
+    case ExpressionKind::BoolT:
+      Emit(cs, Opcode::PushBoolType, e->line_num);
+      break;
+    case ExpressionKind::TypeT:
+      Emit(cs, Opcode::PushTypeType, e->line_num);
+      break;
+    case ExpressionKind::AutoT:
+      Emit(cs, Opcode::PushAutoType, e->line_num);
+      break;
+  }
+}
+
+// Compiles an expression that's an immediate part of a statement, after
+// which the temporaries it made die, as they do in the step machine.
+void CompileStmtExp(Expression* e, CompileState* cs, bool lvalue = false) {
+  cs->made_temporaries = false;
+  if (lvalue) {
+    CompileLvalue(e, cs);
+  } else {
+    CompileExp(e, cs);
+  }
+  if (cs->made_temporaries) {
+    Emit(cs, Opcode::KillTemporaries, e->line_num);
+  }
+}
+
+// Whether evaluating the type `e` can only make a value, so that a pattern
+// variable of that type can be bound without evaluating it.
+auto IsPlainType(Expression* e) -> bool {
+  switch (e->tag) {
+    case ExpressionKind::IntT:
+    case ExpressionKind::BoolT:
+    case ExpressionKind::TypeT:
+    case ExpressionKind::AutoT:
+    case ExpressionKind::Variable:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Leaves the blocks entered since the innermost loop started.
+void LeaveLoopBlocks(int line_num, CompileState* cs) {
+  for (int i = cs->loops.back().block_depth; i < cs->block_depth; ++i) {
+    Emit(cs, Opcode::LeaveBlock, line_num);
+  }
+}
+
+void CompileStmt(Statement* s, CompileState* cs) {
+  if (!s) {
+    return;
+  }
+  switch (s->tag) {
+    case StatementKind::ExpressionStatement:
+      CompileStmtExp(s->u.exp, cs);
+      Emit(cs, Opcode::Pop, s->line_num);
+      break;
+    case StatementKind::VariableDefinition: {
+      Expression* pat = s->u.variable_definition.pat;
+      CompileStmtExp(s->u.variable_definition.init, cs);
+      if (pat->tag == ExpressionKind::PatternVariable &&
+          IsPlainType(pat->u.pattern_variable.type)) {
+        Emit(cs, Opcode::BindLocal, s->line_num, pat->u.pattern_variable.slot);
+      } else {
+        CompileStmtExp(pat, cs);
+        Emit(cs, Opcode::Bind, s->line_num);
+      }
+      break;
+    }
+    case StatementKind::Assign: {
+      Expression* lhs = s->u.assign.lhs;
+      if (lhs->tag == ExpressionKind::Variable &&
+          (lhs->u.variable.depth == 0 || lhs->u.variable.depth == 1)) {
+        CompileStmtExp(s->u.assign.rhs, cs);
+        Emit(cs,
+             lhs->u.variable.depth == 0 ? Opcode::StoreLocal
+                                        : Opcode::StoreGlobal,
+             s->line_num, lhs->u.variable.slot, lhs);
+      } else {
+        CompileStmtExp(lhs, cs, /*lvalue=*/true);
+        CompileStmtExp(s->u.assign.rhs, cs);
+        Emit(cs, Opcode::Assign, s->line_num);
+      }
+      break;
+    }
+    case StatementKind::If: {
+      CompileStmtExp(s->u.if_stmt.cond, cs);
+      int to_else = Emit(cs, Opcode::JumpIfFalse, s->line_num);
+      CompileStmt(s->u.if_stmt.then_stmt, cs);
+      if (s->u.if_stmt.else_stmt) {
+        int to_end = Emit(cs, Opcode::Jump, s->line_num);
+        PatchJump(cs, to_else);
+        CompileStmt(s->u.if_stmt.else_stmt, cs);
+        PatchJump(cs, to_end);
+      } else {
+        PatchJump(cs, to_else);
+      }
+      break;
+    }
+    case StatementKind::While: {
+      int start = cs->code.instructions.size();
+      CompileStmtExp(s->u.while_stmt.cond, cs);
+      int to_end = Emit(cs, Opcode::JumpIfFalse, s->line_num);
+      cs->loops.push_back({start, cs->block_depth, {}});
+      CompileStmt(s->u.while_stmt.body, cs);
+      Emit(cs, Opcode::Jump, s->line_num, start);
+      PatchJump(cs, to_end);
+      for (int at : cs->loops.back().breaks) {
+        PatchJump(cs, at);
+      }
+      cs->loops.pop_back();
+      break;
+    }
+    case StatementKind::Break:
+      LeaveLoopBlocks(s->line_num, cs);
+      cs->loops.back().breaks.push_back(Emit(cs, Opcode::Jump, s->line_num));
+      break;
+    case StatementKind::Continue:
+      LeaveLoopBlocks(s->line_num, cs);
+      Emit(cs, Opcode::Jump, s->line_num, cs->loops.back().start);
+      break;
+    case StatementKind::Block:
+      Emit(cs, Opcode::EnterBlock, s->line_num);
+      ++cs->block_depth;
+      CompileStmt(s->u.block.stmt, cs);
+      --cs->block_depth;
+      Emit(cs, Opcode::LeaveBlock, s->line_num);
+      break;
+    case StatementKind::Return:
+      if (s->u.return_stmt->tag == ExpressionKind::Call) {
+        // The temporaries of the call die as its function is entered.
+        CompileExp(s->u.return_stmt->u.call.function, cs);
+        CompileExp(s->u.return_stmt->u.call.argument, cs);
+        Emit(cs, Opcode::TailCall, s->line_num);
+      } else {
+        CompileStmtExp(s->u.return_stmt, cs);
+        Emit(cs, Opcode::Return, s->line_num);
+      }
+      break;
+    case StatementKind::Sequence:
+      CompileStmt(s->u.sequence.stmt, cs);
+      CompileStmt(s->u.sequence.next, cs);
+      break;
+    case StatementKind::Match: {
+      CompileStmtExp(s->u.match_stmt.exp, cs);
+      std::vector<int> to_end;
+      if (s->u.match_stmt.tree) {
+        // The tree picks a jump to the body of the clause that matches, which
+        // is a block holding its pattern's variables.
+        int at = Emit(cs, Opcode::MatchTree, s->line_num);
+        cs->code.instructions[at].tree = s->u.match_stmt.tree;
+        to_end.push_back(at);
+        std::vector<int> to_bodies;
+        for (size_t i = 0; i < s->u.match_stmt.clauses->size(); ++i) {
+          to_bodies.push_back(Emit(cs, Opcode::Jump, s->line_num));
+        }
+        int clause_num = 0;
+        for (auto& clause : *s->u.match_stmt.clauses) {
+          PatchJump(cs, to_bodies[clause_num++]);
+          ++cs->block_depth;
+          CompileStmt(clause.second, cs);
+          --cs->block_depth;
+          Emit(cs, Opcode::LeaveBlock, s->line_num);
+          to_end.push_back(Emit(cs, Opcode::Jump, s->line_num));
+        }
+        for (int jump : to_end) {
+          PatchJump(cs, jump);
+        }
+        break;
+      }
+      // Otherwise the value matched stays on the stack until a clause matches
+      // it, and the body of that clause is a block holding its pattern's
+      // variables.
+      for (auto& clause : *s->u.match_stmt.clauses) {
+        CompileStmtExp(clause.first, cs);
+        int to_next = Emit(cs, Opcode::MatchClause, s->line_num);
+        ++cs->block_depth;
+        CompileStmt(clause.second, cs);
+        --cs->block_depth;
+        Emit(cs, Opcode::LeaveBlock, s->line_num);
+        to_end.push_back(Emit(cs, Opcode::Jump, s->line_num));
+        PatchJump(cs, to_next);
+      }
+      Emit(cs, Opcode::Pop, s->line_num);
+      for (int at : to_end) {
+        PatchJump(cs, at);
+      }
+      break;
+    }
+  }
+}
+
+auto CompileFunctionBody(Statement* body) -> Code {
+  CompileState cs;
+  CompileStmt(body, &cs);
+  Emit(&cs, Opcode::FallOff, body ? body->line_num : 0);
+  return std::move(cs.code);
+}
+
+}  // namespace Cocktail
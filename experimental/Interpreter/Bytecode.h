@@ -0,0 +1,120 @@
+#ifndef COCKTAIL_EXPERIMENTAL_INTERPRETER_BYTECODE_H
+#define COCKTAIL_EXPERIMENTAL_INTERPRETER_BYTECODE_H
+
+#include <string>
+#include <vector>
+
+#include "experimental/AST/Expression.h"
+#include "experimental/AST/Statement.h"
+
+namespace Cocktail {
+
+struct MatchTree;
+
+// The instructions of the bytecode machine, which works on a stack of
+// operands. Each is listed with the operands it pops and pushes; `arg` and
+// `exp` are the fields of the instruction.
+enum class Opcode {
+  // -> the integer `arg`.
+  PushInt,
+  // -> the boolean `arg`.
+  PushBool,
+  // -> the type named by the opcode.
+  PushIntType,
+  PushBoolType,
+  PushTypeType,
+  PushAutoType,
+  // -> the value of the local in slot `arg`, the global with index `arg`, or
+  // the variable `exp` looked up by name.
+  LoadLocal,
+  LoadGlobal,
+  LoadName,
+  // -> a pointer to the same.
+  AddressOfLocal,
+  AddressOfGlobal,
+  AddressOfName,
+  // value -> . Stores into the local in slot `arg` or global with index
+  // `arg`.
+  StoreLocal,
+  StoreGlobal,
+  // `arg` values -> a tuple of them, with the field names of the tuple `exp`.
+  Tuple,
+  // tuple, index -> the element of the index expression `exp`, or a pointer
+  // to it.
+  Index,
+  IndexAddress,
+  // pointer -> the field of `exp` of what it points to, or a pointer to it.
+  Field,
+  FieldAddress,
+  // value -> a pointer to a copy of it, which dies with the temporaries.
+  Temporary,
+  // Kills the frame's temporaries.
+  KillTemporaries,
+  // `arg` values -> the result of the primitive operation `exp`.
+  PrimitiveOp,
+  // function, argument -> , entering the function, whose return pushes its
+  // result. Structs and alternatives are made and pushed right away.
+  Call,
+  // function, argument -> , like a `Call` followed by a `Return`, but a
+  // function is entered in the frame of the caller, whose variables die.
+  TailCall,
+  // type -> a pattern binding the variable `exp` to its slot.
+  MakeVarPattern,
+  // parameter type, return type -> the function type.
+  MakeFunctionType,
+  // value -> .
+  Pop,
+  // value, pattern -> . Binds the pattern's variables in the current block.
+  Bind,
+  // value -> . Binds a copy of it to the local in slot `arg`.
+  BindLocal,
+  // pointer or pattern of pointers, value -> . Assigns through them.
+  Assign,
+  // Continues at `arg`.
+  Jump,
+  // boolean -> . Continues at `arg` if it's false.
+  JumpIfFalse,
+  // Starts and ends a block, killing the variables bound in it at its end.
+  EnterBlock,
+  LeaveBlock,
+  // value, pattern -> value if the value doesn't match the pattern, which
+  // continues at `arg`. Otherwise -> , entering a block with the pattern's
+  // variables bound.
+  MatchClause,
+  // value -> . Enters a block with the variables bound of the first clause
+  // of the decision tree `tree` that the value matches, continuing at the
+  // jump after the instruction that's the clause's by its index, or at `arg`
+  // if none matches.
+  MatchTree,
+  // value -> , returning a copy of it from the function.
+  Return,
+  // Reports that control reached the end of the function without a return.
+  FallOff,
+};
+
+struct Instruction {
+  Opcode op;
+  // A slot, count, jump target or literal, depending on `op`.
+  int arg = 0;
+  int line_num = 0;
+  // The expression the instruction was compiled from, for the names and
+  // operators it holds.
+  Expression* exp = nullptr;
+  // The variable of a `MakeVarPattern`, as interned by `InternName`.
+  const std::string* name = nullptr;
+  // The decision tree of a `MatchTree`.
+  const MatchTree* tree = nullptr;
+};
+
+// The bytecode of a function body.
+struct Code {
+  std::vector<Instruction> instructions;
+};
+
+// Compiles the body of a function of a program that has been type checked
+// and resolved by `ResolveProgram`.
+auto CompileFunctionBody(Statement* body) -> Code;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_INTERPRETER_BYTECODE_H
@@ -1,5 +1,6 @@
 #include "experimental/Interpreter/Interpreter.h"
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 #include <map>
@@ -9,14 +10,37 @@
 
 #include "experimental/AST/Expression.h"
 #include "experimental/AST/FunctionDefinition.h"
+#include "experimental/Interpreter/MatchTree.h"
+#include "experimental/Interpreter/Pool.h"
+#include "experimental/Interpreter/Profile.h"
 #include "experimental/Interpreter/TypeCheck.h"
 
 namespace Cocktail {
 
-State* state = nullptr;
+static thread_local Pool<Frame> frame_pool;
+static thread_local Pool<Scope> scope_pool;
+
+thread_local State* state = nullptr;
+thread_local bool tracing_output = false;
+thread_local bool step_mode = false;
+thread_local std::ostream* error_stream = nullptr;
+
+auto ErrorStream() -> std::ostream& {
+  return error_stream ? *error_stream : std::cerr;
+}
+
+void ExitWithError() {
+  if (error_stream) {
+    throw ProgramError();
+  }
+  exit(-1);
+}
+
+thread_local Env* globals;
+// The address of each global, by its position among the declarations, which
+// is how `ResolveProgram` resolves variables naming it.
+thread_local std::vector<Address> global_addresses;
 
-auto PatternMatch(Value* pat, Value* val, Env*, std::list<std::string>*, int)
-    -> Env*;
 void HandleValue();
 
 template <class T>
@@ -31,6 +55,18 @@ static auto FindField(const std::string& field,
   return std::nullopt;
 }
 
+auto FindElement(const std::string& f, int position,
+                 const std::vector<std::pair<std::string, Address>>& elts)
+    -> std::optional<Address> {
+  // The elements of a tuple are usually in the order of its type, but one
+  // with named fields may be given them in another order.
+  if (position >= 0 && position < static_cast<int>(elts.size()) &&
+      elts[position].first == f) {
+    return elts[position].second;
+  }
+  return FindField(f, elts);
+}
+
 /**** Auxiliary Functions ****/
 
 auto AllocateValue(Value* v) -> Address {
@@ -38,25 +74,59 @@ auto AllocateValue(Value* v) -> Address {
   // ensures that we don't do anything else in between, which is really bad!
   // Consider whether to include a copy of the input v in this function
   // or to leave it up to the caller.
+  if (profiler) {
+    profiler->Allocate();
+  }
+  if (!state->free_addresses.empty()) {
+    Address a = state->free_addresses.back();
+    state->free_addresses.pop_back();
+    state->heap[a] = v;
+    return a;
+  }
   Address a = state->heap.size();
   state->heap.push_back(v);
   return a;
 }
 
+// Returns new elements holding copies of the values of `elts`.
+static auto CopyElements(const TupleElements& elts, int line_num)
+    -> TupleElements* {
+  auto copy = new TupleElements();
+  copy->reserve(elts.size());
+  for (auto& i : elts) {
+    Value* elt = CopyVal(state->heap[i.second], line_num);
+    copy->push_back(make_pair(i.first, AllocateValue(elt)));
+  }
+  return copy;
+}
+
+// Stops `tuple` sharing its elements, before it's given elements of its own.
+static void ReleaseElements(Value* tuple) {
+  TupleElements* elts = tuple->u.tuple.elts;
+  --elts->refs;
+  if (tuple->alive) {
+    --elts->live;
+  }
+}
+
 auto CopyVal(Value* val, int line_num) -> Value* {
   CheckAlive(val, line_num);
+  if (IsShared(val)) {
+    return val;
+  }
   switch (val->tag) {
     case ValKind::TupleV: {
-      auto elts = new std::vector<std::pair<std::string, Address>>();
-      for (auto& i : *val->u.tuple.elts) {
-        Value* elt = CopyVal(state->heap[i.second], line_num);
-        elts->push_back(make_pair(i.first, AllocateValue(elt)));
+      TupleElements* elts = val->u.tuple.elts;
+      if (elts->exposed) {
+        return MakeTupleVal(CopyElements(*elts, line_num));
       }
+      ++elts->refs;
+      ++elts->live;
       return MakeTupleVal(elts);
     }
     case ValKind::AltV: {
       Value* arg = CopyVal(val->u.alt.arg, line_num);
-      return MakeAltVal(*val->u.alt.alt_name, *val->u.alt.choice_name, arg);
+      return MakeAltVal(val->u.alt.alt_name, val->u.alt.choice_name, arg);
     }
     case ValKind::StructV: {
       Value* inits = CopyVal(val->u.struct_val.inits, line_num);
@@ -67,7 +137,7 @@ auto CopyVal(Value* val, int line_num) -> Value* {
     case ValKind::BoolV:
       return MakeBoolVal(val->u.boolean);
     case ValKind::FunV:
-      return MakeFunVal(*val->u.fun.name, val->u.fun.param, val->u.fun.body);
+      return MakeFunVal(val->u.fun.name, val->u.fun.param, val->u.fun.body);
     case ValKind::PtrV:
       return MakePtrVal(val->u.ptr);
     case ValKind::FunctionTV:
@@ -83,7 +153,7 @@ auto CopyVal(Value* val, int line_num) -> Value* {
     case ValKind::TypeTV:
       return MakeTypeTypeVal();
     case ValKind::VarTV:
-      return MakeVarTypeVal(*val->u.var_type);
+      return MakeVarTypeVal(val->u.var_type);
     case ValKind::AutoTV:
       return MakeAutoTypeVal();
     case ValKind::TupleTV: {
@@ -103,7 +173,56 @@ auto CopyVal(Value* val, int line_num) -> Value* {
   }
 }
 
+auto InitStruct(Value* type, Value* args, int line_num) -> Value* {
+  Value* inits = CopyVal(args, line_num);
+  TupleElements* elts = inits->u.tuple.elts;
+  size_t i = 0;
+  for (auto& field : *type->u.struct_type.fields) {
+    if (i == elts->size()) {
+      break;
+    }
+    if ((*elts)[i].first != field.first) {
+      if (elts->refs > 1) {
+        // The fields are reordered in elements of the struct's own.
+        ReleaseElements(inits);
+        elts = CopyElements(*elts, line_num);
+        inits->u.tuple.elts = elts;
+      }
+      for (size_t j = i + 1; j != elts->size(); ++j) {
+        if ((*elts)[j].first == field.first) {
+          std::swap((*elts)[i], (*elts)[j]);
+          break;
+        }
+      }
+    }
+    ++i;
+  }
+  return MakeStructVal(type, inits);
+}
+
+void OwnElements(Value* v, int line_num) {
+  Value* tuple = v->tag == ValKind::StructV ? v->u.struct_val.inits : v;
+  if (tuple->tag != ValKind::TupleV) {
+    return;
+  }
+  TupleElements* elts = tuple->u.tuple.elts;
+  if (elts->refs > 1) {
+    ReleaseElements(tuple);
+    elts = CopyElements(*elts, line_num);
+    tuple->u.tuple.elts = elts;
+  }
+  elts->exposed = true;
+}
+
+void KillAddress(Address a);
+
 void KillValue(Value* val) {
+  if (IsShared(val)) {
+    // Only those at an address can be used after they're killed, and
+    // `KillAddress` boxes those.
+    return;
+  }
+  bool was_alive = val->alive;
   val->alive = false;
   switch (val->tag) {
     case ValKind::AltV:
@@ -113,13 +232,18 @@ void KillValue(Value* val) {
       KillValue(val->u.struct_val.inits);
       break;
     case ValKind::TupleV:
+      // Elements shared with a tuple that's alive stay alive with it.
+      if (was_alive ? --val->u.tuple.elts->live > 0
+                    : val->u.tuple.elts->live > 0) {
+        break;
+      }
       for (auto& elt : *val->u.tuple.elts) {
         if (state->heap[elt.second]->alive) {
-          KillValue(state->heap[elt.second]);
+          KillAddress(elt.second);
         } else {
-          std::cerr << "runtime error, killing an already dead value"
-                    << std::endl;
-          exit(-1);
+          ErrorStream() << "runtime error, killing an already dead value"
+                        << std::endl;
+          ExitWithError();
         }
       }
       break;
@@ -128,11 +252,21 @@ void KillValue(Value* val) {
   }
 }
 
+// Kills the value at `a`. A shared value there is first replaced by a copy
+// of its own, so that the address reads as dead afterwards without killing
+// the other uses of the shared value.
+void KillAddress(Address a) {
+  if (IsShared(state->heap[a])) {
+    state->heap[a] = Unshare(state->heap[a]);
+  }
+  KillValue(state->heap[a]);
+}
+
 void PrintEnv(Env* env, std::ostream& out) {
   if (env) {
-    std::cout << env->key << ": ";
+    out << env->key << ": ";
     PrintValue(state->heap[env->value], out);
-    std::cout << ", ";
+    out << ", ";
     PrintEnv(env->next, out);
   }
 }
@@ -140,18 +274,18 @@ void PrintEnv(Env* env, std::ostream& out) {
 /***** Frame and State Operations *****/
 
 void PrintFrame(Frame* frame, std::ostream& out) {
-  out << frame->name;
+  out << *frame->name;
   out << "{";
   PrintActList(frame->todo, out);
   out << "}";
 }
 
-void PrintStack(Cons<Frame*>* ls, std::ostream& out) {
-  if (ls) {
-    PrintFrame(ls->curr, out);
-    if (ls->next) {
+void PrintStack(const Stack<Frame*>& ls, std::ostream& out) {
+  auto it = ls.begin();
+  while (it != ls.end()) {
+    PrintFrame(*it, out);
+    if (++it != ls.end()) {
       out << " :: ";
-      PrintStack(ls->next, out);
     }
   }
 }
@@ -168,8 +302,8 @@ void PrintHeap(const std::vector<Value*>& heap, std::ostream& out) {
 }
 
 auto CurrentEnv(State* state) -> Env* {
-  Frame* frame = state->stack->curr;
-  return frame->scopes->curr->env;
+  Frame* frame = state->stack.Top();
+  return frame->scopes.Top()->env;
 }
 
 void PrintState(std::ostream& out) {
@@ -183,6 +317,200 @@ void PrintState(std::ostream& out) {
   out << std::endl << "}" << std::endl;
 }
 
+/***** Garbage Collection *****/
+
+HeapMarker::HeapMarker() : address_marks_(state->heap.size(), false) {
+  ++state->gc_epoch;
+}
+
+void HeapMarker::MarkValue(Value* v) {
+  // Shared values aren't collected, and have only shared parts. Some are
+  // shared between threads, so they aren't marked either.
+  if (v && !v->shared && v->gc_epoch != state->gc_epoch) {
+    v->gc_epoch = state->gc_epoch;
+    worklist_.push_back(v);
+  }
+}
+
+void HeapMarker::MarkAddress(Address a) {
+  if (a < address_marks_.size() && !address_marks_[a]) {
+    address_marks_[a] = true;
+    MarkValue(state->heap[a]);
+  }
+}
+
+void HeapMarker::MarkEnv(Env* env) {
+  for (; env; env = env->next) {
+    MarkAddress(env->value);
+  }
+}
+
+void HeapMarker::MarkAction(Action* act) {
+  act->gc_epoch = state->gc_epoch;
+  switch (act->tag) {
+    case ActionKind::ValAction:
+      MarkValue(act->u.val);
+      break;
+    case ActionKind::DeleteTmpAction:
+      MarkAddress(act->u.delete_tmp);
+      break;
+    case ActionKind::LValAction:
+    case ActionKind::ExpressionAction:
+    case ActionKind::StatementAction:
+    case ActionKind::ExpToLValAction:
+      break;
+  }
+  for (Value* result : act->results) {
+    MarkValue(result);
+  }
+}
+
+void HeapMarker::MarkGlobals() {
+  MarkEnv(globals);
+  for (Address a : global_addresses) {
+    MarkAddress(a);
+  }
+  for (auto& entry : state->compile_time_values) {
+    MarkValue(entry.second);
+  }
+  for (auto& entry : state->tuple_types) {
+    MarkValue(entry.first);
+    MarkValue(entry.second);
+  }
+}
+
+void HeapMarker::Trace() {
+  while (!worklist_.empty()) {
+    Value* v = worklist_.back();
+    worklist_.pop_back();
+    switch (v->tag) {
+      case ValKind::TupleV:
+        for (auto& elt : *v->u.tuple.elts) {
+          MarkAddress(elt.second);
+        }
+        break;
+      case ValKind::PtrV:
+        MarkAddress(v->u.ptr);
+        break;
+      case ValKind::AltV:
+        MarkValue(v->u.alt.arg);
+        break;
+      case ValKind::StructV:
+        MarkValue(v->u.struct_val.type);
+        MarkValue(v->u.struct_val.inits);
+        break;
+      case ValKind::FunV:
+        MarkValue(v->u.fun.param);
+        break;
+      case ValKind::FunctionTV:
+        MarkValue(v->u.fun_type.param);
+        MarkValue(v->u.fun_type.ret);
+        break;
+      case ValKind::PointerTV:
+        MarkValue(v->u.ptr_type.type);
+        break;
+      case ValKind::VarPatV:
+        MarkValue(v->u.var_pat.type);
+        break;
+      case ValKind::TupleTV:
+        MarkFields(v->u.tuple_type.fields);
+        break;
+      case ValKind::StructTV:
+        MarkFields(v->u.struct_type.fields);
+        MarkFields(v->u.struct_type.methods);
+        break;
+      case ValKind::ChoiceTV:
+        MarkFields(v->u.choice_type.alternatives);
+        break;
+      case ValKind::IntV:
+      case ValKind::BoolV:
+      case ValKind::VarTV:
+      case ValKind::IntTV:
+      case ValKind::BoolTV:
+      case ValKind::TypeTV:
+      case ValKind::AutoTV:
+      case ValKind::AltConsV:
+        break;
+    }
+  }
+}
+
+void HeapMarker::MarkFields(VarValues* fields) {
+  for (auto& field : *fields) {
+    MarkValue(field.second);
+  }
+}
+
+void CollectGarbage() {
+  HeapMarker marker;
+  // The roots are the globals and, for each frame, its variables and the
+  // values its actions hold.
+  marker.MarkGlobals();
+  for (Frame* frame : state->stack) {
+    for (Address a : frame->slots) {
+      marker.MarkAddress(a);
+    }
+    for (Scope* scope : frame->scopes) {
+      marker.MarkEnv(scope->env);
+      for (Address a : scope->locals) {
+        marker.MarkAddress(a);
+      }
+    }
+    for (Action* act : frame->todo) {
+      marker.MarkAction(act);
+    }
+  }
+  marker.Trace();
+  SweepHeap(marker);
+}
+
+auto GarbageCollectionDue() -> bool {
+  return static_cast<int>(state->values.size() + state->actions.size()) >=
+         state->next_collection;
+}
+
+void SweepHeap(const HeapMarker& marker) {
+  // Sweep the addresses first, as freeing a value makes its address dangle.
+  for (Address a = 0; a != state->heap.size(); ++a) {
+    if (state->heap[a] && !marker.IsAddressMarked(a)) {
+      state->heap[a] = nullptr;
+      state->free_addresses.push_back(a);
+      ++state->stats.addresses_freed;
+    }
+  }
+  auto live_end = std::partition(
+      state->values.begin(), state->values.end(),
+      [](Value* v) { return v->gc_epoch == state->gc_epoch; });
+  for (auto i = live_end; i != state->values.end(); ++i) {
+    FreeValue(*i);
+    ++state->stats.values_freed;
+  }
+  state->values.erase(live_end, state->values.end());
+  auto live_actions_end = std::partition(
+      state->actions.begin(), state->actions.end(),
+      [](Action* act) { return act->gc_epoch == state->gc_epoch; });
+  for (auto i = live_actions_end; i != state->actions.end(); ++i) {
+    FreeAction(*i);
+    ++state->stats.actions_freed;
+  }
+  state->actions.erase(live_actions_end, state->actions.end());
+  ++state->stats.collections;
+  // Collect again once the live values and actions have doubled, so that
+  // the time spent collecting stays proportional to the ones made.
+  state->next_collection = std::max(
+      4096, 2 * static_cast<int>(state->values.size() + state->actions.size()));
+}
+
+void PrintHeapStats(std::ostream& out) {
+  out << "heap: " << state->heap.size() << " addresses, "
+      << state->free_addresses.size() << " free, " << state->values.size()
+      << " values" << std::endl;
+  out << "gc: " << state->stats.collections << " collections freed "
+      << state->stats.addresses_freed << " addresses, "
+      << state->stats.values_freed << " values and "
+      << state->stats.actions_freed << " actions" << std::endl;
+}
+
 /***** Auxiliary Functions *****/
 
 auto ValToInt(Value* v, int line_num) -> int {
@@ -191,9 +519,9 @@ auto ValToInt(Value* v, int line_num) -> int {
     case ValKind::IntV:
       return v->u.integer;
     default:
-      std::cerr << line_num << ": runtime error: expected an integer"
-                << std::endl;
-      exit(-1);
+      ErrorStream() << line_num << ": runtime error: expected an integer"
+                    << std::endl;
+      ExitWithError();
   }
 }
 
@@ -203,8 +531,8 @@ auto ValToBool(Value* v, int line_num) -> int {
     case ValKind::BoolV:
       return v->u.boolean;
     default:
-      std::cerr << "runtime type error: expected a Boolean" << std::endl;
-      exit(-1);
+      ErrorStream() << "runtime type error: expected a Boolean" << std::endl;
+      ExitWithError();
   }
 }
 
@@ -214,14 +542,14 @@ auto ValToPtr(Value* v, int line_num) -> Address {
     case ValKind::PtrV:
       return v->u.ptr;
     default:
-      std::cerr << "runtime type error: expected a pointer, not ";
-      PrintValue(v, std::cerr);
-      std::cerr << std::endl;
-      exit(-1);
+      ErrorStream() << "runtime type error: expected a pointer, not ";
+      PrintValue(v, ErrorStream());
+      ErrorStream() << std::endl;
+      ExitWithError();
   }
 }
 
-auto EvalPrim(Operator op, const std::vector<Value*>& args, int line_num)
+auto EvalPrim(Operator op, llvm::ArrayRef<Value*> args, int line_num)
     -> Value* {
   switch (op) {
     case Operator::Neg:
@@ -245,10 +573,9 @@ auto EvalPrim(Operator op, const std::vector<Value*>& args, int line_num)
   }
 }
 
-Env* globals;
-
 void InitGlobals(std::list<Declaration*>* fs) {
   globals = nullptr;
+  global_addresses.clear();
   for (auto& iter : *fs) {
     switch (iter->tag) {
       case DeclarationKind::ChoiceDeclaration: {
@@ -260,9 +587,10 @@ void InitGlobals(std::list<Declaration*>* fs) {
               ToType(d->u.choice_def.line_num, InterpExp(nullptr, i->second));
           alts->push_back(make_pair(i->first, t));
         }
-        auto ct = MakeChoiceTypeVal(d->u.choice_def.name, alts);
+        auto ct = MakeChoiceTypeVal(InternName(*d->u.choice_def.name), alts);
         auto a = AllocateValue(ct);
         globals = new Env(*d->u.choice_def.name, a, globals);
+        global_addresses.push_back(a);
         break;
       }
       case DeclarationKind::StructDeclaration: {
@@ -280,18 +608,21 @@ void InitGlobals(std::list<Declaration*>* fs) {
             }
           }
         }
-        auto st = MakeStructTypeVal(*d->u.struct_def->name, fields, methods);
+        auto st = MakeStructTypeVal(InternName(*d->u.struct_def->name), fields,
+                                     methods);
         auto a = AllocateValue(st);
         globals = new Env(*d->u.struct_def->name, a, globals);
+        global_addresses.push_back(a);
         break;
       }
       case DeclarationKind::FunctionDeclaration: {
         struct FunctionDefinition* fun = iter->u.fun_def;
         Env* env = nullptr;
         auto pt = InterpExp(env, fun->param_pattern);
-        auto f = MakeFunVal(fun->name, pt, fun->body);
+        auto f = MakeFunVal(InternName(fun->name), pt, fun->body);
         Address a = AllocateValue(f);
         globals = new Env(fun->name, a, globals);
+        global_addresses.push_back(a);
         break;
       }
     }
@@ -302,74 +633,91 @@ void InitGlobals(std::list<Declaration*>* fs) {
 // where C is the body of the function,
 //       E is the environment (functions + parameters + locals)
 //       F is the function
-void CallFunction(int line_num, std::vector<Value*> operas, State* state) {
+void CallFunction(int line_num, llvm::ArrayRef<Value*> operas,
+                  State* state) {
   CheckAlive(operas[0], line_num);
   switch (operas[0]->tag) {
     case ValKind::FunV: {
-      // Bind arguments to parameters
-      std::list<std::string> params;
-      Env* env = PatternMatch(operas[0]->u.fun.param, operas[1], globals,
-                              &params, line_num);
-      if (!env) {
-        std::cerr << "internal error in call_function, pattern match failed"
-                  << std::endl;
-        exit(-1);
+      // Create the new frame and bind arguments to parameters
+      auto* scope = scope_pool.New(globals, std::vector<Address>());
+      auto* frame =
+          frame_pool.New(operas[0]->u.fun.name, Stack(scope),
+                         Stack(MakeStmtAct(operas[0]->u.fun.body)));
+      if (!PatternMatch(operas[0]->u.fun.param, operas[1], &frame->slots,
+                        &scope->locals, line_num)) {
+        ErrorStream() << "internal error in call_function, pattern match failed"
+                      << std::endl;
+        ExitWithError();
+      }
+      // Push the new frame on the stack
+      state->stack.Push(frame);
+      if (profiler) {
+        profiler->Enter(operas[0]->u.fun.name);
       }
-      // Create the new frame and push it on the stack
-      auto* scope = new Scope(env, params);
-      auto* frame = new Frame(*operas[0]->u.fun.name, MakeCons(scope),
-                              MakeCons(MakeStmtAct(operas[0]->u.fun.body)));
-      state->stack = MakeCons(frame, state->stack);
       break;
     }
     case ValKind::StructTV: {
-      Value* arg = CopyVal(operas[1], line_num);
-      Value* sv = MakeStructVal(operas[0], arg);
-      Frame* frame = state->stack->curr;
-      frame->todo = MakeCons(MakeValAct(sv), frame->todo);
+      Value* sv = InitStruct(operas[0], operas[1], line_num);
+      Frame* frame = state->stack.Top();
+      frame->todo.Push(MakeValAct(sv));
       break;
     }
     case ValKind::AltConsV: {
       Value* arg = CopyVal(operas[1], line_num);
-      Value* av = MakeAltVal(*operas[0]->u.alt_cons.alt_name,
-                             *operas[0]->u.alt_cons.choice_name, arg);
-      Frame* frame = state->stack->curr;
-      frame->todo = MakeCons(MakeValAct(av), frame->todo);
+      Value* av = MakeAltVal(operas[0]->u.alt_cons.alt_name,
+                             operas[0]->u.alt_cons.choice_name, arg);
+      Frame* frame = state->stack.Top();
+      frame->todo.Push(MakeValAct(av));
       break;
     }
     default:
-      std::cerr << line_num << ": in call, expected a function, not ";
-      PrintValue(operas[0], std::cerr);
-      std::cerr << std::endl;
-      exit(-1);
+      ErrorStream() << line_num << ": in call, expected a function, not ";
+      PrintValue(operas[0], ErrorStream());
+      ErrorStream() << std::endl;
+      ExitWithError();
   }
 }
 
-void KillScope(int line_num, Scope* scope) {
-  for (const auto& l : scope->locals) {
-    Address a = Lookup(line_num, scope->env, l, PrintErrorString);
-    KillValue(state->heap[a]);
+void KillScope(Scope* scope) {
+  for (Address a : scope->locals) {
+    KillAddress(a);
   }
 }
 
-void KillLocals(int line_num, Frame* frame) {
-  Cons<Scope*>* scopes = frame->scopes;
-  for (Scope* scope = scopes->curr; scopes; scopes = scopes->next) {
-    KillScope(line_num, scope);
+void KillLocals(Frame* frame) {
+  for (Scope* scope : frame->scopes) {
+    KillScope(scope);
   }
 }
 
+// Ends the innermost scope of `frame`, killing its variables.
+void PopScope(Frame* frame) {
+  Scope* scope = frame->scopes.Pop();
+  KillScope(scope);
+  scope_pool.Delete(scope);
+}
+
+// Frees `frame`, which has been popped, and its scopes. Its actions are left
+// to the garbage collector.
+void FreeFrame(Frame* frame) {
+  for (Scope* scope : frame->scopes) {
+    scope_pool.Delete(scope);
+  }
+  frame_pool.Delete(frame);
+}
+
 void CreateTuple(Frame* frame, Action* act, Expression* /*exp*/) {
   //    { { (v1,...,vn) :: C, E, F} :: S, H}
   // -> { { `(v1,...,vn) :: C, E, F} :: S, H}
-  auto elts = new std::vector<std::pair<std::string, Address>>();
+  auto elts = new TupleElements();
   auto f = act->u.exp->u.tuple.fields->begin();
   for (auto i = act->results.begin(); i != act->results.end(); ++i, ++f) {
     Address a = AllocateValue(*i);  // copy?
     elts->push_back(make_pair(f->first, a));
   }
   Value* tv = MakeTupleVal(elts);
-  frame->todo = MakeCons(MakeValAct(tv), frame->todo->next);
+  frame->todo.Pop();
+  frame->todo.Push(MakeValAct(tv));
 }
 
 auto ToValue(Expression* value) -> Value* {
@@ -387,90 +735,102 @@ auto ToValue(Expression* value) -> Value* {
     case ExpressionKind::FunctionT:
       // Instead add to patterns?
     default:
-      std::cerr << "internal error in to_value, didn't expect ";
+      ErrorStream() << "internal error in to_value, didn't expect ";
       PrintExp(value);
-      std::cerr << std::endl;
-      exit(-1);
+      ErrorStream() << std::endl;
+      ExitWithError();
   }
 }
 
-// Returns 0 if the value doesn't match the pattern.
-auto PatternMatch(Value* p, Value* v, Env* env, std::list<std::string>* vars,
-                  int line_num) -> Env* {
-  std::cout << "pattern_match(";
-  PrintValue(p, std::cout);
-  std::cout << ", ";
-  PrintValue(v, std::cout);
-  std::cout << ")" << std::endl;
+auto PatternMatch(Value* p, Value* v, std::vector<Address>* slots,
+                  std::vector<Address>* vars, int line_num) -> bool {
+  if (tracing_output) {
+    std::cout << "pattern_match(";
+    PrintValue(p, std::cout);
+    std::cout << ", ";
+    PrintValue(v, std::cout);
+    std::cout << ")" << std::endl;
+  }
   switch (p->tag) {
     case ValKind::VarPatV: {
+      int slot = p->u.var_pat.slot;
+      if (slot < 0) {
+        ErrorStream() << line_num << ": internal error, pattern variable `"
+                      << *p->u.var_pat.name << "` was not resolved"
+                      << std::endl;
+        ExitWithError();
+      }
       Address a = AllocateValue(CopyVal(v, line_num));
-      vars->push_back(*p->u.var_pat.name);
-      return new Env(*p->u.var_pat.name, a, env);
+      if (slot >= static_cast<int>(slots->size())) {
+        slots->resize(slot + 1);
+      }
+      (*slots)[slot] = a;
+      vars->push_back(a);
+      return true;
     }
     case ValKind::TupleV:
       switch (v->tag) {
         case ValKind::TupleV: {
           if (p->u.tuple.elts->size() != v->u.tuple.elts->size()) {
-            std::cerr << "runtime error: arity mismatch in tuple pattern match"
-                      << std::endl;
-            exit(-1);
+            ErrorStream()
+                << "runtime error: arity mismatch in tuple pattern match"
+                << std::endl;
+            ExitWithError();
           }
+          int position = 0;
           for (auto& elt : *p->u.tuple.elts) {
-            auto a = FindField(elt.first, *v->u.tuple.elts);
+            auto a = FindElement(elt.first, position++, *v->u.tuple.elts);
             if (a == std::nullopt) {
-              std::cerr << "runtime error: field " << elt.first << "not in ";
-              PrintValue(v, std::cerr);
-              std::cerr << std::endl;
-              exit(-1);
+              ErrorStream() << "runtime error: field " << elt.first
+                            << "not in ";
+              PrintValue(v, ErrorStream());
+              ErrorStream() << std::endl;
+              ExitWithError();
+            }
+            if (!PatternMatch(state->heap[elt.second], state->heap[*a], slots,
+                              vars, line_num)) {
+              return false;
             }
-            env = PatternMatch(state->heap[elt.second], state->heap[*a], env,
-                               vars, line_num);
           }
-          return env;
+          return true;
         }
         default:
-          std::cerr
+          ErrorStream()
               << "internal error, expected a tuple value in pattern, not ";
-          PrintValue(v, std::cerr);
-          std::cerr << std::endl;
-          exit(-1);
+          PrintValue(v, ErrorStream());
+          ErrorStream() << std::endl;
+          ExitWithError();
       }
     case ValKind::AltV:
       switch (v->tag) {
         case ValKind::AltV: {
-          if (*p->u.alt.choice_name != *v->u.alt.choice_name ||
-              *p->u.alt.alt_name != *v->u.alt.alt_name) {
-            return nullptr;
+          if (p->u.alt.choice_name != v->u.alt.choice_name ||
+              p->u.alt.alt_name != v->u.alt.alt_name) {
+            return false;
           }
-          env = PatternMatch(p->u.alt.arg, v->u.alt.arg, env, vars, line_num);
-          return env;
+          return PatternMatch(p->u.alt.arg, v->u.alt.arg, slots, vars,
+                              line_num);
         }
         default:
-          std::cerr
+          ErrorStream()
               << "internal error, expected a choice alternative in pattern, "
                  "not ";
-          PrintValue(v, std::cerr);
-          std::cerr << std::endl;
-          exit(-1);
+          PrintValue(v, ErrorStream());
+          ErrorStream() << std::endl;
+          ExitWithError();
       }
     case ValKind::FunctionTV:
       switch (v->tag) {
         case ValKind::FunctionTV:
-          env = PatternMatch(p->u.fun_type.param, v->u.fun_type.param, env,
-                             vars, line_num);
-          env = PatternMatch(p->u.fun_type.ret, v->u.fun_type.ret, env, vars,
-                             line_num);
-          return env;
+          return PatternMatch(p->u.fun_type.param, v->u.fun_type.param,
+                              slots, vars, line_num) &&
+                 PatternMatch(p->u.fun_type.ret, v->u.fun_type.ret, slots,
+                              vars, line_num);
         default:
-          return nullptr;
+          return false;
       }
     default:
-      if (ValueEqual(p, v, line_num)) {
-        return env;
-      } else {
-        return nullptr;
-      }
+      return ValueEqual(p, v, line_num);
   }
 }
 
@@ -483,17 +843,20 @@ void PatternAssignment(Value* pat, Value* val, int line_num) {
       switch (val->tag) {
         case ValKind::TupleV: {
           if (pat->u.tuple.elts->size() != val->u.tuple.elts->size()) {
-            std::cerr << "runtime error: arity mismatch in tuple pattern match"
-                      << std::endl;
-            exit(-1);
+            ErrorStream()
+                << "runtime error: arity mismatch in tuple pattern match"
+                << std::endl;
+            ExitWithError();
           }
+          int position = 0;
           for (auto& elt : *pat->u.tuple.elts) {
-            auto a = FindField(elt.first, *val->u.tuple.elts);
+            auto a = FindElement(elt.first, position++, *val->u.tuple.elts);
             if (a == std::nullopt) {
-              std::cerr << "runtime error: field " << elt.first << "not in ";
-              PrintValue(val, std::cerr);
-              std::cerr << std::endl;
-              exit(-1);
+              ErrorStream() << "runtime error: field " << elt.first
+                            << "not in ";
+              PrintValue(val, ErrorStream());
+              ErrorStream() << std::endl;
+              ExitWithError();
             }
             PatternAssignment(state->heap[elt.second], state->heap[*a],
                               line_num);
@@ -501,76 +864,100 @@ void PatternAssignment(Value* pat, Value* val, int line_num) {
           break;
         }
         default:
-          std::cerr
+          ErrorStream()
               << "internal error, expected a tuple value on right-hand-side, "
                  "not ";
-          PrintValue(val, std::cerr);
-          std::cerr << std::endl;
-          exit(-1);
+          PrintValue(val, ErrorStream());
+          ErrorStream() << std::endl;
+          ExitWithError();
       }
       break;
     }
     case ValKind::AltV: {
       switch (val->tag) {
         case ValKind::AltV: {
-          if (*pat->u.alt.choice_name != *val->u.alt.choice_name ||
-              *pat->u.alt.alt_name != *val->u.alt.alt_name) {
-            std::cerr << "internal error in pattern assignment" << std::endl;
-            exit(-1);
+          if (pat->u.alt.choice_name != val->u.alt.choice_name ||
+              pat->u.alt.alt_name != val->u.alt.alt_name) {
+            ErrorStream() << "internal error in pattern assignment"
+                          << std::endl;
+            ExitWithError();
           }
           PatternAssignment(pat->u.alt.arg, val->u.alt.arg, line_num);
           break;
         }
         default:
-          std::cerr
+          ErrorStream()
               << "internal error, expected an alternative in left-hand-side, "
                  "not ";
-          PrintValue(val, std::cerr);
-          std::cerr << std::endl;
-          exit(-1);
+          PrintValue(val, ErrorStream());
+          ErrorStream() << std::endl;
+          ExitWithError();
       }
       break;
     }
     default:
       if (!ValueEqual(pat, val, line_num)) {
-        std::cerr << "internal error in pattern assignment" << std::endl;
-        exit(-1);
+        ErrorStream() << "internal error in pattern assignment" << std::endl;
+        ExitWithError();
       }
   }
 }
 
+// Returns the address of the variable that `exp` names, by its slot if it was
+// resolved and otherwise by its name.
+auto GetVariableAddress(Expression* exp) -> Address {
+  int slot = exp->u.variable.slot;
+  switch (exp->u.variable.depth) {
+    case 0:
+      return state->stack.Top()->slots[slot];
+    case 1:
+      // Globals are evaluated in order, so those declared later aren't there
+      // yet while earlier ones are.
+      if (slot < static_cast<int>(global_addresses.size())) {
+        return global_addresses[slot];
+      }
+      ErrorStream() << exp->line_num << ": could not find `"
+                    << *exp->u.variable.name << "`" << std::endl;
+      ExitWithError();
+    default:
+      return Lookup(exp->line_num, CurrentEnv(state), *exp->u.variable.name,
+                    PrintErrorString);
+  }
+}
+
 /***** state transitions for lvalues *****/
 
 void StepLvalue() {
-  Frame* frame = state->stack->curr;
-  Action* act = frame->todo->curr;
+  Frame* frame = state->stack.Top();
+  Action* act = frame->todo.Top();
   Expression* exp = act->u.exp;
-  std::cout << "--- step lvalue ";
-  PrintExp(exp);
-  std::cout << " --->" << std::endl;
+  if (tracing_output) {
+    std::cout << "--- step lvalue ";
+    PrintExp(exp);
+    std::cout << " --->" << std::endl;
+  }
   switch (exp->tag) {
     case ExpressionKind::Variable: {
       //    { {x :: C, E, F} :: S, H}
       // -> { {E(x) :: C, E, F} :: S, H}
-      Address a = Lookup(exp->line_num, CurrentEnv(state),
-                         *(exp->u.variable.name), PrintErrorString);
+      Address a = GetVariableAddress(exp);
       Value* v = MakePtrVal(a);
       CheckAlive(v, exp->line_num);
-      frame->todo = MakeCons(MakeValAct(v), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(v));
       break;
     }
     case ExpressionKind::GetField: {
       //    { {e.f :: C, E, F} :: S, H}
       // -> { e :: [].f :: C, E, F} :: S, H}
-      frame->todo =
-          MakeCons(MakeLvalAct(exp->u.get_field.aggregate), frame->todo);
+      frame->todo.Push(MakeLvalAct(exp->u.get_field.aggregate));
       act->pos++;
       break;
     }
     case ExpressionKind::Index: {
       //    { {e[i] :: C, E, F} :: S, H}
       // -> { e :: [][i] :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(exp->u.index.aggregate), frame->todo);
+      frame->todo.Push(MakeExpAct(exp->u.index.aggregate));
       act->pos++;
       break;
     }
@@ -578,7 +965,7 @@ void StepLvalue() {
       //    { {(f1=e1,...) :: C, E, F} :: S, H}
       // -> { {e1 :: (f1=[],...) :: C, E, F} :: S, H}
       Expression* e1 = (*exp->u.tuple.fields)[0].second;
-      frame->todo = MakeCons(MakeLvalAct(e1), frame->todo);
+      frame->todo.Push(MakeLvalAct(e1));
       act->pos++;
       break;
     }
@@ -592,8 +979,9 @@ void StepLvalue() {
     case ExpressionKind::FunctionT:
     case ExpressionKind::AutoT:
     case ExpressionKind::PatternVariable: {
-      frame->todo = MakeCons(MakeExpAct(exp),
-                             MakeCons(MakeExpToLvalAct(), frame->todo->next));
+      frame->todo.Pop();
+      frame->todo.Push(MakeExpToLvalAct());
+      frame->todo.Push(MakeExpAct(exp));
     }
   }
 }
@@ -601,23 +989,24 @@ void StepLvalue() {
 /***** state transitions for expressions *****/
 
 void StepExp() {
-  Frame* frame = state->stack->curr;
-  Action* act = frame->todo->curr;
+  Frame* frame = state->stack.Top();
+  Action* act = frame->todo.Top();
   Expression* exp = act->u.exp;
-  std::cout << "--- step exp ";
-  PrintExp(exp);
-  std::cout << " --->" << std::endl;
+  if (tracing_output) {
+    std::cout << "--- step exp ";
+    PrintExp(exp);
+    std::cout << " --->" << std::endl;
+  }
   switch (exp->tag) {
     case ExpressionKind::PatternVariable: {
-      frame->todo =
-          MakeCons(MakeExpAct(exp->u.pattern_variable.type), frame->todo);
+      frame->todo.Push(MakeExpAct(exp->u.pattern_variable.type));
       act->pos++;
       break;
     }
     case ExpressionKind::Index: {
       //    { { e[i] :: C, E, F} :: S, H}
       // -> { { e :: [][i] :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(exp->u.index.aggregate), frame->todo);
+      frame->todo.Push(MakeExpAct(exp->u.index.aggregate));
       act->pos++;
       break;
     }
@@ -626,7 +1015,7 @@ void StepExp() {
         //    { {(f1=e1,...) :: C, E, F} :: S, H}
         // -> { {e1 :: (f1=[],...) :: C, E, F} :: S, H}
         Expression* e1 = (*exp->u.tuple.fields)[0].second;
-        frame->todo = MakeCons(MakeExpAct(e1), frame->todo);
+        frame->todo.Push(MakeExpAct(e1));
         act->pos++;
       } else {
         CreateTuple(frame, act, exp);
@@ -636,73 +1025,75 @@ void StepExp() {
     case ExpressionKind::GetField: {
       //    { { e.f :: C, E, F} :: S, H}
       // -> { { e :: [].f :: C, E, F} :: S, H}
-      frame->todo =
-          MakeCons(MakeLvalAct(exp->u.get_field.aggregate), frame->todo);
+      frame->todo.Push(MakeLvalAct(exp->u.get_field.aggregate));
       act->pos++;
       break;
     }
     case ExpressionKind::Variable: {
       // { {x :: C, E, F} :: S, H} -> { {H(E(x)) :: C, E, F} :: S, H}
-      Address a = Lookup(exp->line_num, CurrentEnv(state),
-                         *(exp->u.variable.name), PrintErrorString);
+      Address a = GetVariableAddress(exp);
       Value* v = state->heap[a];
-      frame->todo = MakeCons(MakeValAct(v), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(v));
       break;
     }
     case ExpressionKind::Integer:
       // { {n :: C, E, F} :: S, H} -> { {n' :: C, E, F} :: S, H}
-      frame->todo =
-          MakeCons(MakeValAct(MakeIntVal(exp->u.integer)), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(MakeIntVal(exp->u.integer)));
       break;
     case ExpressionKind::Boolean:
       // { {n :: C, E, F} :: S, H} -> { {n' :: C, E, F} :: S, H}
-      frame->todo =
-          MakeCons(MakeValAct(MakeBoolVal(exp->u.boolean)), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(MakeBoolVal(exp->u.boolean)));
       break;
     case ExpressionKind::PrimitiveOp:
       if (exp->u.primitive_op.arguments->size() > 0) {
         //    { {op(e :: es) :: C, E, F} :: S, H}
         // -> { e :: op([] :: es) :: C, E, F} :: S, H}
-        frame->todo = MakeCons(
-            MakeExpAct(exp->u.primitive_op.arguments->front()), frame->todo);
+        frame->todo.Push(MakeExpAct(exp->u.primitive_op.arguments->front()));
         act->pos++;
       } else {
         //    { {v :: op(]) :: C, E, F} :: S, H}
         // -> { {eval_prim(op, ()) :: C, E, F} :: S, H}
         Value* v =
             EvalPrim(exp->u.primitive_op.op, act->results, exp->line_num);
-        frame->todo = MakeCons(MakeValAct(v), frame->todo->next->next);
+        frame->todo.Pop(2);
+        frame->todo.Push(MakeValAct(v));
       }
       break;
     case ExpressionKind::Call:
       //    { {e1(e2) :: C, E, F} :: S, H}
       // -> { {e1 :: [](e2) :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(exp->u.call.function), frame->todo);
+      frame->todo.Push(MakeExpAct(exp->u.call.function));
       act->pos++;
       break;
     case ExpressionKind::IntT: {
       Value* v = MakeIntTypeVal();
-      frame->todo = MakeCons(MakeValAct(v), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(v));
       break;
     }
     case ExpressionKind::BoolT: {
       Value* v = MakeBoolTypeVal();
-      frame->todo = MakeCons(MakeValAct(v), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(v));
       break;
     }
     case ExpressionKind::AutoT: {
       Value* v = MakeAutoTypeVal();
-      frame->todo = MakeCons(MakeValAct(v), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(v));
       break;
     }
     case ExpressionKind::TypeT: {
       Value* v = MakeTypeTypeVal();
-      frame->todo = MakeCons(MakeValAct(v), frame->todo->next);
+      frame->todo.Pop();
+      frame->todo.Push(MakeValAct(v));
       break;
     }
     case ExpressionKind::FunctionT: {
-      frame->todo =
-          MakeCons(MakeExpAct(exp->u.function_type.parameter), frame->todo);
+      frame->todo.Push(MakeExpAct(exp->u.function_type.parameter));
       act->pos++;
       break;
     }
@@ -739,195 +1130,220 @@ auto IsBlockAct(Action* act) -> bool {
   }
 }
 
+// Starts `body`, the body of the clause of the `match` statement `stmt` that
+// matched, in a scope of the variables its pattern bound.
+static void StartClauseBody(Frame* frame, Statement* stmt, Statement* body,
+                            std::vector<Address> vars) {
+  auto* new_scope = scope_pool.New(CurrentEnv(state), std::move(vars));
+  frame->scopes.Push(new_scope);
+  Statement* body_block = MakeBlock(stmt->line_num, body);
+  Action* body_act = MakeStmtAct(body_block);
+  body_act->pos = 0;
+  frame->todo.Pop();
+  frame->todo.Push(body_act);
+  frame->todo.Push(MakeStmtAct(body));
+}
+
 void StepStmt() {
-  Frame* frame = state->stack->curr;
-  Action* act = frame->todo->curr;
+  Frame* frame = state->stack.Top();
+  Action* act = frame->todo.Top();
   Statement* stmt = act->u.stmt;
-  std::cout << "--- step stmt ";
-  PrintStatement(stmt, 1);
-  std::cout << " --->" << std::endl;
+  if (tracing_output) {
+    std::cout << "--- step stmt ";
+    PrintStatement(stmt, 1);
+    std::cout << " --->" << std::endl;
+  }
   switch (stmt->tag) {
     case StatementKind::Match:
       //    { { (match (e) ...) :: C, E, F} :: S, H}
       // -> { { e :: (match ([]) ...) :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(stmt->u.match_stmt.exp), frame->todo);
+      frame->todo.Push(MakeExpAct(stmt->u.match_stmt.exp));
       act->pos++;
       break;
     case StatementKind::While:
       //    { { (while (e) s) :: C, E, F} :: S, H}
       // -> { { e :: (while ([]) s) :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(stmt->u.while_stmt.cond), frame->todo);
+      frame->todo.Push(MakeExpAct(stmt->u.while_stmt.cond));
       act->pos++;
       break;
     case StatementKind::Break:
       //    { { break; :: ... :: (while (e) s) :: C, E, F} :: S, H}
       // -> { { C, E', F} :: S, H}
-      frame->todo = frame->todo->next;
-      while (frame->todo && !IsWhileAct(frame->todo->curr)) {
-        if (IsBlockAct(frame->todo->curr)) {
-          KillScope(stmt->line_num, frame->scopes->curr);
-          frame->scopes = frame->scopes->next;
+      frame->todo.Pop();
+      while (!frame->todo.IsEmpty() && !IsWhileAct(frame->todo.Top())) {
+        if (IsBlockAct(frame->todo.Top())) {
+          PopScope(frame);
         }
-        frame->todo = frame->todo->next;
+        frame->todo.Pop();
       }
-      frame->todo = frame->todo->next;
+      frame->todo.Pop();
       break;
     case StatementKind::Continue:
       //    { { continue; :: ... :: (while (e) s) :: C, E, F} :: S, H}
       // -> { { (while (e) s) :: C, E', F} :: S, H}
-      frame->todo = frame->todo->next;
-      while (frame->todo && !IsWhileAct(frame->todo->curr)) {
-        if (IsBlockAct(frame->todo->curr)) {
-          KillScope(stmt->line_num, frame->scopes->curr);
-          frame->scopes = frame->scopes->next;
+      frame->todo.Pop();
+      while (!frame->todo.IsEmpty() && !IsWhileAct(frame->todo.Top())) {
+        if (IsBlockAct(frame->todo.Top())) {
+          PopScope(frame);
         }
-        frame->todo = frame->todo->next;
+        frame->todo.Pop();
       }
       break;
     case StatementKind::Block: {
       if (act->pos == -1) {
-        auto* scope = new Scope(CurrentEnv(state), std::list<std::string>());
-        frame->scopes = MakeCons(scope, frame->scopes);
-        frame->todo = MakeCons(MakeStmtAct(stmt->u.block.stmt), frame->todo);
+        auto* scope = scope_pool.New(CurrentEnv(state), std::vector<Address>());
+        frame->scopes.Push(scope);
+        frame->todo.Push(MakeStmtAct(stmt->u.block.stmt));
         act->pos++;
       } else {
-        Scope* scope = frame->scopes->curr;
-        KillScope(stmt->line_num, scope);
-        frame->scopes = frame->scopes->next;
-        frame->todo = frame->todo->next;
+        PopScope(frame);
+        frame->todo.Pop();
       }
       break;
     }
     case StatementKind::VariableDefinition:
       //    { {(var x = e) :: C, E, F} :: S, H}
       // -> { {e :: (var x = []) :: C, E, F} :: S, H}
-      frame->todo =
-          MakeCons(MakeExpAct(stmt->u.variable_definition.init), frame->todo);
+      frame->todo.Push(MakeExpAct(stmt->u.variable_definition.init));
       act->pos++;
       break;
     case StatementKind::ExpressionStatement:
       //    { {e :: C, E, F} :: S, H}
       // -> { {e :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(stmt->u.exp), frame->todo);
+      frame->todo.Push(MakeExpAct(stmt->u.exp));
       break;
     case StatementKind::Assign:
       //    { {(lv = e) :: C, E, F} :: S, H}
       // -> { {lv :: ([] = e) :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeLvalAct(stmt->u.assign.lhs), frame->todo);
+      frame->todo.Push(MakeLvalAct(stmt->u.assign.lhs));
       act->pos++;
       break;
     case StatementKind::If:
       //    { {(if (e) then_stmt else else_stmt) :: C, E, F} :: S, H}
       // -> { { e :: (if ([]) then_stmt else else_stmt) :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(stmt->u.if_stmt.cond), frame->todo);
+      frame->todo.Push(MakeExpAct(stmt->u.if_stmt.cond));
       act->pos++;
       break;
     case StatementKind::Return:
       //    { {return e :: C, E, F} :: S, H}
       // -> { {e :: return [] :: C, E, F} :: S, H}
-      frame->todo = MakeCons(MakeExpAct(stmt->u.return_stmt), frame->todo);
+      frame->todo.Push(MakeExpAct(stmt->u.return_stmt));
       act->pos++;
       break;
     case StatementKind::Sequence:
       //    { { (s1,s2) :: C, E, F} :: S, H}
       // -> { { s1 :: s2 :: C, E, F} :: S, H}
-      Cons<Action*>* todo = frame->todo->next;
+      frame->todo.Pop();
       if (stmt->u.sequence.next) {
-        todo = MakeCons(MakeStmtAct(stmt->u.sequence.next), todo);
+        frame->todo.Push(MakeStmtAct(stmt->u.sequence.next));
       }
-      frame->todo = MakeCons(MakeStmtAct(stmt->u.sequence.stmt), todo);
+      frame->todo.Push(MakeStmtAct(stmt->u.sequence.stmt));
       break;
   }
 }
 
-auto GetMember(Address a, const std::string& f) -> Address {
+auto GetMember(Address a, const std::string& f, int position) -> Address {
   Value* v = state->heap[a];
   switch (v->tag) {
     case ValKind::StructV: {
-      auto a = FindField(f, *v->u.struct_val.inits->u.tuple.elts);
+      // `InitStruct` keeps the fields of a struct in the order of its type.
+      auto& elts = *v->u.struct_val.inits->u.tuple.elts;
+      if (position >= 0 && position < static_cast<int>(elts.size())) {
+        return elts[position].second;
+      }
+      auto a = FindField(f, elts);
       if (a == std::nullopt) {
-        std::cerr << "runtime error, member " << f << " not in ";
-        PrintValue(v, std::cerr);
-        std::cerr << std::endl;
-        exit(-1);
+        ErrorStream() << "runtime error, member " << f << " not in ";
+        PrintValue(v, ErrorStream());
+        ErrorStream() << std::endl;
+        ExitWithError();
       }
       return *a;
     }
     case ValKind::TupleV: {
-      auto a = FindField(f, *v->u.tuple.elts);
+      auto a = FindElement(f, position, *v->u.tuple.elts);
       if (a == std::nullopt) {
-        std::cerr << "field " << f << " not in ";
-        PrintValue(v, std::cerr);
-        std::cerr << std::endl;
-        exit(-1);
+        ErrorStream() << "field " << f << " not in ";
+        PrintValue(v, ErrorStream());
+        ErrorStream() << std::endl;
+        ExitWithError();
       }
       return *a;
     }
     case ValKind::ChoiceTV: {
       if (FindInVarValues(f, v->u.choice_type.alternatives) == nullptr) {
-        std::cerr << "alternative " << f << " not in ";
-        PrintValue(v, std::cerr);
-        std::cerr << std::endl;
-        exit(-1);
+        ErrorStream() << "alternative " << f << " not in ";
+        PrintValue(v, ErrorStream());
+        ErrorStream() << std::endl;
+        ExitWithError();
       }
-      auto ac = MakeAltCons(f, *v->u.choice_type.name);
+      auto ac = MakeAltCons(InternName(f), v->u.choice_type.name);
       return AllocateValue(ac);
     }
     default:
-      std::cerr << "field access not allowed for value ";
-      PrintValue(v, std::cerr);
-      std::cerr << std::endl;
-      exit(-1);
+      ErrorStream() << "field access not allowed for value ";
+      PrintValue(v, ErrorStream());
+      ErrorStream() << std::endl;
+      ExitWithError();
   }
 }
 
-auto InsertDelete(Action* del, Cons<Action*>* todo) -> Cons<Action*>* {
-  if (todo) {
-    switch (todo->curr->tag) {
+void InsertDelete(Action* del, Stack<Action*>& todo) {
+  if (!todo.IsEmpty()) {
+    switch (todo.Top()->tag) {
       case ActionKind::StatementAction: {
         // This places the delete before the enclosing statement.
         // Not sure if that is OK. Conceptually it should go after
         // but that is tricky for some statements, like 'return'. -Jeremy
-        return MakeCons(del, todo);
+        todo.Push(del);
+        break;
       }
       case ActionKind::LValAction:
       case ActionKind::ExpressionAction:
       case ActionKind::ValAction:
       case ActionKind::ExpToLValAction:
-      case ActionKind::DeleteTmpAction:
-        return MakeCons(todo->curr, InsertDelete(del, todo->next));
+      case ActionKind::DeleteTmpAction: {
+        Action* top = todo.Pop();
+        InsertDelete(del, todo);
+        todo.Push(top);
+        break;
+      }
     }
   } else {
-    return MakeCons(del, todo);
+    todo.Push(del);
   }
 }
 
 /***** State transition for handling a value *****/
 
 void HandleValue() {
-  Frame* frame = state->stack->curr;
-  Action* val_act = frame->todo->curr;
-  Action* act = frame->todo->next->curr;
+  Frame* frame = state->stack.Top();
+  Action* val_act = frame->todo.Pop();
+  Action* act = frame->todo.Top();
   act->results.push_back(val_act->u.val);
   act->pos++;
 
-  std::cout << "--- handle value ";
-  PrintValue(val_act->u.val, std::cout);
-  std::cout << " with ";
-  PrintAct(act, std::cout);
-  std::cout << " --->" << std::endl;
+  if (tracing_output) {
+    std::cout << "--- handle value ";
+    PrintValue(val_act->u.val, std::cout);
+    std::cout << " with ";
+    PrintAct(act, std::cout);
+    std::cout << " --->" << std::endl;
+  }
 
   switch (act->tag) {
     case ActionKind::DeleteTmpAction: {
-      KillValue(state->heap[act->u.delete_tmp]);
-      frame->todo = MakeCons(val_act, frame->todo->next->next);
+      KillAddress(act->u.delete_tmp);
+      frame->todo.Pop();
+      frame->todo.Push(val_act);
       break;
     }
     case ActionKind::ExpToLValAction: {
       Address a = AllocateValue(act->results[0]);
       auto del = MakeDeleteAct(a);
-      frame->todo = MakeCons(MakeValAct(MakePtrVal(a)),
-                             InsertDelete(del, frame->todo->next->next));
+      frame->todo.Pop();
+      InsertDelete(del, frame->todo);
+      frame->todo.Push(MakeValAct(MakePtrVal(a)));
       break;
     }
     case ActionKind::LValAction: {
@@ -937,30 +1353,33 @@ void HandleValue() {
           //    { v :: [].f :: C, E, F} :: S, H}
           // -> { { &v.f :: C, E, F} :: S, H }
           Value* str = act->results[0];
-          Address a =
-              GetMember(ValToPtr(str, exp->line_num), *exp->u.get_field.field);
-          frame->todo =
-              MakeCons(MakeValAct(MakePtrVal(a)), frame->todo->next->next);
+          Address ptr = ValToPtr(str, exp->line_num);
+          OwnElements(state->heap[ptr], exp->line_num);
+          Address a = GetMember(ptr, *exp->u.get_field.field,
+                                exp->u.get_field.position);
+          frame->todo.Pop();
+          frame->todo.Push(MakeValAct(MakePtrVal(a)));
           break;
         }
         case ExpressionKind::Index: {
           if (act->pos == 1) {
-            frame->todo =
-                MakeCons(MakeExpAct(exp->u.index.offset), frame->todo->next);
+            frame->todo.Push(MakeExpAct(exp->u.index.offset));
           } else if (act->pos == 2) {
             //    { v :: [][i] :: C, E, F} :: S, H}
             // -> { { &v[i] :: C, E, F} :: S, H }
             Value* tuple = act->results[0];
+            OwnElements(tuple, exp->line_num);
             std::string f = std::to_string(ToInteger(act->results[1]));
-            auto a = FindField(f, *tuple->u.tuple.elts);
+            auto a = FindElement(f, exp->u.index.position,
+                                 *tuple->u.tuple.elts);
             if (a == std::nullopt) {
-              std::cerr << "runtime error: field " << f << "not in ";
-              PrintValue(tuple, std::cerr);
-              std::cerr << std::endl;
-              exit(-1);
+              ErrorStream() << "runtime error: field " << f << "not in ";
+              PrintValue(tuple, ErrorStream());
+              ErrorStream() << std::endl;
+              ExitWithError();
             }
-            frame->todo =
-                MakeCons(MakeValAct(MakePtrVal(*a)), frame->todo->next->next);
+            frame->todo.Pop();
+            frame->todo.Push(MakeValAct(MakePtrVal(*a)));
           }
           break;
         }
@@ -971,17 +1390,16 @@ void HandleValue() {
             // -> { { ek+1 :: (f1=v1,..., fk=vk, fk+1=[],...) :: C, E, F} :: S,
             // H}
             Expression* elt = (*exp->u.tuple.fields)[act->pos].second;
-            frame->todo = MakeCons(MakeLvalAct(elt), frame->todo->next);
+            frame->todo.Push(MakeLvalAct(elt));
           } else {
-            frame->todo = frame->todo->next;
             CreateTuple(frame, act, exp);
           }
           break;
         }
         default:
-          std::cerr << "internal error in handle_value, LValAction"
-                    << std::endl;
-          exit(-1);
+          ErrorStream() << "internal error in handle_value, LValAction"
+                        << std::endl;
+          ExitWithError();
       }
       break;
     }
@@ -989,9 +1407,10 @@ void HandleValue() {
       Expression* exp = act->u.exp;
       switch (exp->tag) {
         case ExpressionKind::PatternVariable: {
-          auto v =
-              MakeVarPatVal(*exp->u.pattern_variable.name, act->results[0]);
-          frame->todo = MakeCons(MakeValAct(v), frame->todo->next->next);
+          auto v = MakeVarPatVal(InternName(*exp->u.pattern_variable.name),
+                                 act->results[0], exp->u.pattern_variable.slot);
+          frame->todo.Pop();
+          frame->todo.Push(MakeValAct(v));
           break;
         }
         case ExpressionKind::Tuple: {
@@ -1001,17 +1420,15 @@ void HandleValue() {
             // -> { { ek+1 :: (f1=v1,..., fk=vk, fk+1=[],...) :: C, E, F} :: S,
             // H}
             Expression* elt = (*exp->u.tuple.fields)[act->pos].second;
-            frame->todo = MakeCons(MakeExpAct(elt), frame->todo->next);
+            frame->todo.Push(MakeExpAct(elt));
           } else {
-            frame->todo = frame->todo->next;
             CreateTuple(frame, act, exp);
           }
           break;
         }
         case ExpressionKind::Index: {
           if (act->pos == 1) {
-            frame->todo =
-                MakeCons(MakeExpAct(exp->u.index.offset), frame->todo->next);
+            frame->todo.Push(MakeExpAct(exp->u.index.offset));
           } else if (act->pos == 2) {
             auto tuple = act->results[0];
             switch (tuple->tag) {
@@ -1019,23 +1436,24 @@ void HandleValue() {
                 //    { { v :: [][i] :: C, E, F} :: S, H}
                 // -> { { v_i :: C, E, F} : S, H}
                 std::string f = std::to_string(ToInteger(act->results[1]));
-                auto a = FindField(f, *tuple->u.tuple.elts);
+                auto a = FindElement(f, exp->u.index.position,
+                                     *tuple->u.tuple.elts);
                 if (a == std::nullopt) {
-                  std::cerr << "runtime error, field " << f << " not in ";
-                  PrintValue(tuple, std::cerr);
-                  std::cerr << std::endl;
-                  exit(-1);
+                  ErrorStream() << "runtime error, field " << f << " not in ";
+                  PrintValue(tuple, ErrorStream());
+                  ErrorStream() << std::endl;
+                  ExitWithError();
                 }
-                frame->todo = MakeCons(MakeValAct(state->heap[*a]),
-                                       frame->todo->next->next);
+                frame->todo.Pop();
+                frame->todo.Push(MakeValAct(state->heap[*a]));
                 break;
               }
               default:
-                std::cerr
+                ErrorStream()
                     << "runtime type error, expected a tuple in field access, "
                        "not ";
-                PrintValue(tuple, std::cerr);
-                exit(-1);
+                PrintValue(tuple, ErrorStream());
+                ExitWithError();
             }
           }
           break;
@@ -1044,9 +1462,10 @@ void HandleValue() {
           //    { { v :: [].f :: C, E, F} :: S, H}
           // -> { { v_f :: C, E, F} : S, H}
           auto a = GetMember(ValToPtr(act->results[0], exp->line_num),
-                             *exp->u.get_field.field);
-          frame->todo =
-              MakeCons(MakeValAct(state->heap[a]), frame->todo->next->next);
+                             *exp->u.get_field.field,
+                             exp->u.get_field.position);
+          frame->todo.Pop();
+          frame->todo.Push(MakeValAct(state->heap[a]));
           break;
         }
         case ExpressionKind::PrimitiveOp: {
@@ -1055,13 +1474,14 @@ void HandleValue() {
             //    { {v :: op(vs,[],e,es) :: C, E, F} :: S, H}
             // -> { {e :: op(vs,v,[],es) :: C, E, F} :: S, H}
             Expression* arg = (*exp->u.primitive_op.arguments)[act->pos];
-            frame->todo = MakeCons(MakeExpAct(arg), frame->todo->next);
+            frame->todo.Push(MakeExpAct(arg));
           } else {
             //    { {v :: op(vs,[]) :: C, E, F} :: S, H}
             // -> { {eval_prim(op, (vs,v)) :: C, E, F} :: S, H}
-            Value* v =
-                EvalPrim(exp->u.primitive_op.op, act->results, exp->line_num);
-            frame->todo = MakeCons(MakeValAct(v), frame->todo->next->next);
+            Value* v = EvalPrim(exp->u.primitive_op.op, act->results,
+                                exp->line_num);
+            frame->todo.Pop();
+            frame->todo.Push(MakeValAct(v));
           }
           break;
         }
@@ -1069,17 +1489,16 @@ void HandleValue() {
           if (act->pos == 1) {
             //    { { v :: [](e) :: C, E, F} :: S, H}
             // -> { { e :: v([]) :: C, E, F} :: S, H}
-            frame->todo =
-                MakeCons(MakeExpAct(exp->u.call.argument), frame->todo->next);
+            frame->todo.Push(MakeExpAct(exp->u.call.argument));
           } else if (act->pos == 2) {
             //    { { v2 :: v1([]) :: C, E, F} :: S, H}
             // -> { {C',E',F'} :: {C, E, F} :: S, H}
-            frame->todo = frame->todo->next->next;
+            frame->todo.Pop();
             CallFunction(exp->line_num, act->results, state);
           } else {
-            std::cerr << "internal error in handle_value with Call"
-                      << std::endl;
-            exit(-1);
+            ErrorStream() << "internal error in handle_value with Call"
+                          << std::endl;
+            ExitWithError();
           }
           break;
         }
@@ -1088,12 +1507,12 @@ void HandleValue() {
             //    { { rt :: fn pt -> [] :: C, E, F} :: S, H}
             // -> { fn pt -> rt :: {C, E, F} :: S, H}
             Value* v = MakeFunTypeVal(act->results[0], act->results[1]);
-            frame->todo = MakeCons(MakeValAct(v), frame->todo->next->next);
+            frame->todo.Pop();
+            frame->todo.Push(MakeValAct(v));
           } else {
             //    { { pt :: fn [] -> e :: C, E, F} :: S, H}
             // -> { { e :: fn pt -> []) :: C, E, F} :: S, H}
-            frame->todo = MakeCons(MakeExpAct(exp->u.function_type.return_type),
-                                   frame->todo->next);
+            frame->todo.Push(MakeExpAct(exp->u.function_type.return_type));
           }
           break;
         }
@@ -1104,9 +1523,10 @@ void HandleValue() {
         case ExpressionKind::BoolT:
         case ExpressionKind::TypeT:
         case ExpressionKind::AutoT:
-          std::cerr << "internal error, bad expression context in handle_value"
-                    << std::endl;
-          exit(-1);
+          ErrorStream()
+              << "internal error, bad expression context in handle_value"
+              << std::endl;
+          ExitWithError();
       }
       break;
     }
@@ -1114,29 +1534,27 @@ void HandleValue() {
       Statement* stmt = act->u.stmt;
       switch (stmt->tag) {
         case StatementKind::ExpressionStatement:
-          frame->todo = frame->todo->next->next;
+          frame->todo.Pop();
           break;
         case StatementKind::VariableDefinition: {
           if (act->pos == 1) {
-            frame->todo = MakeCons(MakeExpAct(stmt->u.variable_definition.pat),
-                                   frame->todo->next);
+            frame->todo.Push(MakeExpAct(stmt->u.variable_definition.pat));
           } else if (act->pos == 2) {
             //    { { v :: (x = []) :: C, E, F} :: S, H}
             // -> { { C, E(x := a), F} :: S, H(a := copy(v))}
             Value* v = act->results[0];
             Value* p = act->results[1];
             // Address a = AllocateValue(CopyVal(v));
-            frame->scopes->curr->env =
-                PatternMatch(p, v, frame->scopes->curr->env,
-                             &frame->scopes->curr->locals, stmt->line_num);
-            if (!frame->scopes->curr->env) {
-              std::cerr
+            Scope* scope = frame->scopes.Top();
+            if (!PatternMatch(p, v, &frame->slots, &scope->locals,
+                              stmt->line_num)) {
+              ErrorStream()
                   << stmt->line_num
                   << ": internal error in variable definition, match failed"
                   << std::endl;
-              exit(-1);
+              ExitWithError();
             }
-            frame->todo = frame->todo->next->next;
+            frame->todo.Pop();
           }
           break;
         }
@@ -1144,15 +1562,14 @@ void HandleValue() {
           if (act->pos == 1) {
             //    { { a :: ([] = e) :: C, E, F} :: S, H}
             // -> { { e :: (a = []) :: C, E, F} :: S, H}
-            frame->todo =
-                MakeCons(MakeExpAct(stmt->u.assign.rhs), frame->todo->next);
+            frame->todo.Push(MakeExpAct(stmt->u.assign.rhs));
           } else if (act->pos == 2) {
             //    { { v :: (a = []) :: C, E, F} :: S, H}
             // -> { { C, E, F} :: S, H(a := v)}
             auto pat = act->results[0];
             auto val = act->results[1];
             PatternAssignment(pat, val, stmt->line_num);
-            frame->todo = frame->todo->next->next;
+            frame->todo.Pop();
           }
           break;
         case StatementKind::If:
@@ -1160,30 +1577,31 @@ void HandleValue() {
             //    { {true :: if ([]) then_stmt else else_stmt :: C, E, F} ::
             //      S, H}
             // -> { { then_stmt :: C, E, F } :: S, H}
-            frame->todo = MakeCons(MakeStmtAct(stmt->u.if_stmt.then_stmt),
-                                   frame->todo->next->next);
+            frame->todo.Pop();
+            frame->todo.Push(MakeStmtAct(stmt->u.if_stmt.then_stmt));
           } else {
             //    { {false :: if ([]) then_stmt else else_stmt :: C, E, F} ::
             //      S, H}
             // -> { { else_stmt :: C, E, F } :: S, H}
-            frame->todo = MakeCons(MakeStmtAct(stmt->u.if_stmt.else_stmt),
-                                   frame->todo->next->next);
+            frame->todo.Pop();
+            if (stmt->u.if_stmt.else_stmt) {
+              frame->todo.Push(MakeStmtAct(stmt->u.if_stmt.else_stmt));
+            }
           }
           break;
         case StatementKind::While:
           if (ValToBool(act->results[0], stmt->line_num)) {
             //    { {true :: (while ([]) s) :: C, E, F} :: S, H}
             // -> { { s :: (while (e) s) :: C, E, F } :: S, H}
-            frame->todo->next->curr->pos = -1;
-            frame->todo->next->curr->results.clear();
-            frame->todo = MakeCons(MakeStmtAct(stmt->u.while_stmt.body),
-                                   frame->todo->next);
+            act->pos = -1;
+            act->results.clear();
+            frame->todo.Push(MakeStmtAct(stmt->u.while_stmt.body));
           } else {
             //    { {false :: (while ([]) s) :: C, E, F} :: S, H}
             // -> { { C, E, F } :: S, H}
-            frame->todo->next->curr->pos = -1;
-            frame->todo->next->curr->results.clear();
-            frame->todo = frame->todo->next->next;
+            act->pos = -1;
+            act->results.clear();
+            frame->todo.Pop();
           }
           break;
         case StatementKind::Match: {
@@ -1196,10 +1614,23 @@ void HandleValue() {
           // * 1: the pattern for clause 0
           // * 2: the pattern for clause 1
           // * ...
+          if (MatchTree* tree = stmt->u.match_stmt.tree) {
+            // The clauses were compiled to a tree, which finds the one that
+            // matches without evaluating their patterns.
+            std::vector<Address> vars;
+            int clause = RunMatchTree(*tree, act->results[0], &frame->slots,
+                                      &vars, stmt->line_num);
+            if (clause < 0) {
+              frame->todo.Pop();
+            } else {
+              StartClauseBody(frame, stmt, tree->bodies[clause], vars);
+            }
+            break;
+          }
           auto clause_num = (act->pos - 1) / 2;
           if (clause_num >=
               static_cast<int>(stmt->u.match_stmt.clauses->size())) {
-            frame->todo = frame->todo->next->next;
+            frame->todo.Pop();
             break;
           }
           auto c = stmt->u.match_stmt.clauses->begin();
@@ -1209,22 +1640,13 @@ void HandleValue() {
             // start interpreting the pattern of the clause
             //    { {v :: (match ([]) ...) :: C, E, F} :: S, H}
             // -> { {pi :: (match ([]) ...) :: C, E, F} :: S, H}
-            frame->todo = MakeCons(MakeExpAct(c->first), frame->todo->next);
+            frame->todo.Push(MakeExpAct(c->first));
           } else {  // try to match
             auto v = act->results[0];
             auto pat = act->results[clause_num + 1];
-            auto env = CurrentEnv(state);
-            std::list<std::string> vars;
-            Env* new_env = PatternMatch(pat, v, env, &vars, stmt->line_num);
-            if (new_env) {  // we have a match, start the body
-              auto* new_scope = new Scope(new_env, vars);
-              frame->scopes = MakeCons(new_scope, frame->scopes);
-              Statement* body_block = MakeBlock(stmt->line_num, c->second);
-              Action* body_act = MakeStmtAct(body_block);
-              body_act->pos = 0;
-              frame->todo =
-                  MakeCons(MakeStmtAct(c->second),
-                           MakeCons(body_act, frame->todo->next->next));
+            std::vector<Address> vars;
+            if (PatternMatch(pat, v, &frame->slots, &vars, stmt->line_num)) {
+              StartClauseBody(frame, stmt, c->second, vars);
             } else {
               act->pos++;
               clause_num = (act->pos - 1) / 2;
@@ -1233,9 +1655,9 @@ void HandleValue() {
                 // move on to the next clause
                 c = stmt->u.match_stmt.clauses->begin();
                 std::advance(c, clause_num);
-                frame->todo = MakeCons(MakeExpAct(c->first), frame->todo->next);
+                frame->todo.Push(MakeExpAct(c->first));
               } else {  // No more clauses in match
-                frame->todo = frame->todo->next->next;
+                frame->todo.Pop();
               }
             }
           }
@@ -1245,47 +1667,66 @@ void HandleValue() {
           //    { {v :: return [] :: C, E, F} :: {C', E', F'} :: S, H}
           // -> { {v :: C', E', F'} :: S, H}
           Value* ret_val = CopyVal(val_act->u.val, stmt->line_num);
-          KillLocals(stmt->line_num, frame);
-          state->stack = state->stack->next;
-          frame = state->stack->curr;
-          frame->todo = MakeCons(MakeValAct(ret_val), frame->todo);
+          KillLocals(frame);
+          state->stack.Pop();
+          FreeFrame(frame);
+          if (profiler) {
+            profiler->Leave();
+          }
+          frame = state->stack.Top();
+          frame->todo.Push(MakeValAct(ret_val));
           break;
         }
         case StatementKind::Block:
         case StatementKind::Sequence:
         case StatementKind::Break:
         case StatementKind::Continue:
-          std::cerr << "internal error in handle_value, unhandled statement ";
+          ErrorStream()
+              << "internal error in handle_value, unhandled statement ";
           PrintStatement(stmt, 1);
-          std::cerr << std::endl;
-          exit(-1);
+          ErrorStream() << std::endl;
+          ExitWithError();
       }  // switch stmt
       break;
     }
     case ActionKind::ValAction:
-      std::cerr << "internal error, ValAction in handle_value" << std::endl;
-      exit(-1);
+      ErrorStream() << "internal error, ValAction in handle_value" << std::endl;
+      ExitWithError();
   }  // switch act
 }
 
 // State transition.
 void Step() {
-  Frame* frame = state->stack->curr;
-  if (!frame->todo) {
-    std::cerr << "runtime error: fell off end of function " << frame->name
-              << " without `return`" << std::endl;
-    exit(-1);
+  Frame* frame = state->stack.Top();
+  if (frame->todo.IsEmpty()) {
+    ErrorStream() << "runtime error: fell off end of function " << *frame->name
+                  << " without `return`" << std::endl;
+    ExitWithError();
   }
 
-  Action* act = frame->todo->curr;
+  Action* act = frame->todo.Top();
+  if (profiler) {
+    switch (act->tag) {
+      case ActionKind::LValAction:
+      case ActionKind::ExpressionAction:
+        profiler->Step(act->u.exp->line_num);
+        break;
+      case ActionKind::StatementAction:
+        profiler->Step(act->u.stmt->line_num);
+        break;
+      default:
+        profiler->Step();
+        break;
+    }
+  }
   switch (act->tag) {
     case ActionKind::DeleteTmpAction:
-      std::cerr << "internal error in step, did not expect DeleteTmpAction"
-                << std::endl;
+      ErrorStream() << "internal error in step, did not expect DeleteTmpAction"
+                    << std::endl;
       break;
     case ActionKind::ExpToLValAction:
-      std::cerr << "internal error in step, did not expect ExpToLValAction"
-                << std::endl;
+      ErrorStream() << "internal error in step, did not expect ExpToLValAction"
+                    << std::endl;
       break;
     case ActionKind::ValAction:
       HandleValue();
@@ -1305,41 +1746,117 @@ void Step() {
 // Interpret the whole porogram.
 auto InterpProgram(std::list<Declaration*>* fs) -> int {
   state = new State();  // Runtime state.
-  std::cout << "********** initializing globals **********" << std::endl;
+  if (tracing_output) {
+    std::cout << "********** initializing globals **********" << std::endl;
+  }
   InitGlobals(fs);
 
   Expression* arg =
       MakeTuple(0, new std::vector<std::pair<std::string, Expression*>>());
   Expression* call_main = MakeCall(0, MakeVar(0, "main"), arg);
-  Cons<Action*>* todo = MakeCons(MakeExpAct(call_main));
-  auto* scope = new Scope(globals, std::list<std::string>());
-  auto* frame = new Frame("top", MakeCons(scope), todo);
-  state->stack = MakeCons(frame);
+  auto* scope = scope_pool.New(globals, std::vector<Address>());
+  auto* frame = frame_pool.New(InternName("top"), Stack(scope),
+                               Stack(MakeExpAct(call_main)));
+  state->stack = Stack(frame);
 
-  std::cout << "********** calling main function **********" << std::endl;
-  PrintState(std::cout);
+  if (tracing_output) {
+    std::cout << "********** calling main function **********" << std::endl;
+    PrintState(std::cout);
+  }
 
-  while (Length(state->stack) > 1 || Length(state->stack->curr->todo) > 1 ||
-         state->stack->curr->todo->curr->tag != ActionKind::ValAction) {
+  while (state->stack.Count() > 1 || state->stack.Top()->todo.Count() > 1 ||
+         state->stack.Top()->todo.Top()->tag != ActionKind::ValAction) {
     Step();
-    PrintState(std::cout);
+    if (tracing_output) {
+      PrintState(std::cout);
+    }
+    if (GarbageCollectionDue()) {
+      CollectGarbage();
+    }
+  }
+  if (tracing_output) {
+    PrintHeapStats(std::cout);
   }
-  Value* v = state->stack->curr->todo->curr->u.val;
+  Value* v = state->stack.Top()->todo.Top()->u.val;
   return ValToInt(v, 0);
 }
 
+// Evaluates `e` in `env` directly, if it's a type or integer made only of
+// literals and variables other than locals, which are most of the types
+// written in programs. Returns null for anything else.
+static auto EvalSimpleExp(Env* env, Expression* e) -> Value* {
+  switch (e->tag) {
+    case ExpressionKind::IntT:
+      return MakeIntTypeVal();
+    case ExpressionKind::BoolT:
+      return MakeBoolTypeVal();
+    case ExpressionKind::TypeT:
+      return MakeTypeTypeVal();
+    case ExpressionKind::AutoT:
+      return MakeAutoTypeVal();
+    case ExpressionKind::Integer:
+      return MakeIntVal(e->u.integer);
+    case ExpressionKind::Variable: {
+      int depth = e->u.variable.depth;
+      int slot = e->u.variable.slot;
+      if (depth == 0) {
+        return nullptr;
+      }
+      if (depth == 1 && slot < static_cast<int>(global_addresses.size())) {
+        return state->heap[global_addresses[slot]];
+      }
+      return state->heap[Lookup(e->line_num, env, *e->u.variable.name,
+                                PrintErrorString)];
+    }
+    case ExpressionKind::FunctionT: {
+      Value* param = EvalSimpleExp(env, e->u.function_type.parameter);
+      Value* ret = param ? EvalSimpleExp(env, e->u.function_type.return_type)
+                         : nullptr;
+      return ret ? MakeFunTypeVal(param, ret) : nullptr;
+    }
+    case ExpressionKind::Tuple: {
+      std::vector<Value*> fields;
+      for (auto& field : *e->u.tuple.fields) {
+        Value* v = EvalSimpleExp(env, field.second);
+        if (!v) {
+          return nullptr;
+        }
+        fields.push_back(v);
+      }
+      auto elts = new TupleElements();
+      for (size_t i = 0; i != fields.size(); ++i) {
+        elts->push_back(make_pair((*e->u.tuple.fields)[i].first,
+                                  AllocateValue(fields[i])));
+      }
+      return MakeTupleVal(elts);
+    }
+    default:
+      return nullptr;
+  }
+}
+
 // Interpret an expression at compile-time.
 auto InterpExp(Env* env, Expression* e) -> Value* {
-  Cons<Action*>* todo = MakeCons(MakeExpAct(e));
-  auto* scope = new Scope(env, std::list<std::string>());
-  auto* frame = new Frame("InterpExp", MakeCons(scope), todo);
-  state->stack = MakeCons(frame);
+  auto key = std::make_pair(e, env);
+  auto memo = state->compile_time_values.find(key);
+  if (memo != state->compile_time_values.end()) {
+    return memo->second;
+  }
+  if (Value* v = EvalSimpleExp(env, e)) {
+    state->compile_time_values[key] = v;
+    return v;
+  }
+  auto* scope = scope_pool.New(env, std::vector<Address>());
+  auto* frame = frame_pool.New(InternName("InterpExp"), Stack(scope),
+                               Stack(MakeExpAct(e)));
+  state->stack = Stack(frame);
 
-  while (Length(state->stack) > 1 || Length(state->stack->curr->todo) > 1 ||
-         state->stack->curr->todo->curr->tag != ActionKind::ValAction) {
+  while (state->stack.Count() > 1 || state->stack.Top()->todo.Count() > 1 ||
+         state->stack.Top()->todo.Top()->tag != ActionKind::ValAction) {
     Step();
   }
-  Value* v = state->stack->curr->todo->curr->u.val;
+  Value* v = state->stack.Top()->todo.Top()->u.val;
+  state->compile_time_values[key] = v;
   return v;
 }
 
@@ -2,14 +2,18 @@
 #define COCKTAIL_EXPERIMENTAL_INTERPRETER_INTERPRETER_H
 
 #include <list>
+#include <map>
+#include <optional>
+#include <ostream>
 #include <utility>
 #include <vector>
 
 #include "experimental/AST/Declaration.h"
 #include "experimental/Interpreter/Action.h"
 #include "experimental/Interpreter/AssocList.h"
-#include "experimental/Interpreter/ConsList.h"
+#include "experimental/Interpreter/Stack.h"
 #include "experimental/Interpreter/Value.h"
+#include "llvm/ADT/ArrayRef.h"
 
 namespace Cocktail {
 
@@ -18,36 +22,179 @@ using Env = AssocList<std::string, Address>;
 /***** Scopes *****/
 
 struct Scope {
-  Scope(Env* e, std::list<std::string> l) : env(e), locals(std::move(l)) {}
+  Scope(Env* e, std::vector<Address> l) : env(e), locals(std::move(l)) {}
+  // The variables looked up by name, which are those of types evaluated as
+  // the program is checked, and of variables that weren't resolved.
   Env* env;
-  std::list<std::string> locals;
+  // The addresses of the variables bound in the scope.
+  std::vector<Address> locals;
 };
 
 /***** Frames and State *****/
 
 struct Frame {
-  std::string name;
-  Cons<Scope*>* scopes;
-  Cons<Action*>* todo;
+  // The name of the function, as interned by `InternName`.
+  const std::string* name;
+  Stack<Scope*> scopes;
+  Stack<Action*> todo;
+  // The addresses of the function's parameters and locals, by the slots
+  // that `ResolveProgram` gave them.
+  std::vector<Address> slots;
+
+  Frame(const std::string* n, Stack<Scope*> s, Stack<Action*> c)
+      : name(n), scopes(std::move(s)), todo(std::move(c)) {}
+};
 
-  Frame(std::string n, Cons<Scope*>* s, Cons<Action*>* c)
-      : name(std::move(std::move(n))), scopes(s), todo(c) {}
+// Counts of the work the garbage collector has done.
+struct HeapStats {
+  int collections = 0;
+  int addresses_freed = 0;
+  int values_freed = 0;
+  int actions_freed = 0;
 };
 
 struct State {
-  Cons<Frame*>* stack;
+  Stack<Frame*> stack;
   std::vector<Value*> heap;
+  // The addresses whose values were collected, which are reused before the
+  // heap grows.
+  std::vector<Address> free_addresses;
+  // Every value and action made while this is the state and not yet
+  // collected.
+  std::vector<Value*> values;
+  std::vector<Action*> actions;
+  // The number of values and actions at which the next collection happens.
+  int next_collection = 4096;
+  // Incremented by each collection, which marks the values and actions it
+  // finds live with it.
+  unsigned int gc_epoch = 0;
+  HeapStats stats;
+  // The value of each expression evaluated by `InterpExp`, by the expression
+  // and the environment it was evaluated in, as type checking evaluates the
+  // same type annotations again and again.
+  std::map<std::pair<Expression*, Env*>, Value*> compile_time_values;
+  // The type that `ToType` made of each tuple.
+  std::map<Value*, Value*> tuple_types;
 };
 
-extern State* state;
+// The state of the program being run. This, like the rest of the
+// interpreter's state, is per thread, so that each thread can check and run
+// a program of its own.
+extern thread_local State* state;
+
+// Whether the interpreter prints each step it takes and the state after it,
+// along with the program before and after type checking. Off by default, as
+// tracing dominates the running time of all but the smallest programs.
+extern thread_local bool tracing_output;
+
+// Whether programs run on the small-step machine, one action at a time,
+// rather than being compiled to bytecode. The steps are what `--trace`
+// shows, so it turns this on too.
+extern thread_local bool step_mode;
+
+// The stream that errors in the program are reported to on this thread, or
+// null for `std::cerr`. Threads type checking declarations in parallel each
+// report to a buffer of their own, so that only the error of the first
+// declaration to have one is reported, as it would be checking them in order.
+extern thread_local std::ostream* error_stream;
+
+// What `ExitWithError` throws on a thread with an `error_stream`, to stop
+// checking the declarations the thread was given.
+struct ProgramError {};
+
+// Returns the stream to report an error in the program to.
+auto ErrorStream() -> std::ostream&;
+
+// Ends the program once an error in it has been reported to `ErrorStream`,
+// or on a thread with an `error_stream`, throws a `ProgramError`.
+[[noreturn]] void ExitWithError();
+
+// The globals, by name and by their position among the declarations.
+extern thread_local Env* globals;
+extern thread_local std::vector<Address> global_addresses;
 
 void PrintEnv(Env* env);
 auto AllocateValue(Value* v) -> Address;
+// Kills the value at `a`, so that it's an error to use it from then on.
+void KillAddress(Address a);
+
+/***** Garbage Collection *****/
+
+// Marks the values, actions and heap addresses reachable from the roots
+// given to it, without recursion, as chains of pointers through the heap
+// can be long. Each marker starts a new collection.
+class HeapMarker {
+ public:
+  HeapMarker();
+
+  void MarkValue(Value* v);
+  void MarkAddress(Address a);
+  void MarkEnv(Env* env);
+  void MarkAction(Action* act);
+  // Marks the globals and the values kept by `InterpExp` and `ToType`.
+  void MarkGlobals();
+  // Marks everything reachable from what's been marked so far.
+  void Trace();
+
+  auto IsAddressMarked(Address a) const -> bool { return address_marks_[a]; }
+
+ private:
+  void MarkFields(VarValues* fields);
+
+  std::vector<bool> address_marks_;
+  std::vector<Value*> worklist_;
+};
+
+// Whether enough values and actions have been made since the last
+// collection for another to be worthwhile.
+auto GarbageCollectionDue() -> bool;
+// Frees the heap addresses, values and actions that `marker` didn't reach.
+void SweepHeap(const HeapMarker& marker);
+// Frees the heap addresses, values and actions that can't be reached from the
+// stack or the globals. Only safe between steps, as a step's values aren't
+// known until it's done.
+void CollectGarbage();
+void PrintHeapStats(std::ostream& out);
+
+/***** Operations on Values *****/
+
+// Returns a copy of `val`. Tuples, and so structs and alternatives, share
+// their elements with their copies until `OwnElements` is called on one.
 auto CopyVal(Value* val, int line_num) -> Value*;
+// Makes a struct of `type` from a copy of the tuple `args`, with its fields
+// in the order they're declared in, which is where field accesses look.
+auto InitStruct(Value* type, Value* args, int line_num) -> Value*;
+// Gives the tuple or struct `v` elements of its own, if it shares them with
+// its copies, so that an element's address can be taken to change it
+// without changing the copies.
+void OwnElements(Value* v, int line_num);
+// Returns the address of the element `f` of a tuple, looking first at
+// `position`, where type checking found it in the tuple's type.
+auto FindElement(const std::string& f, int position,
+                 const std::vector<std::pair<std::string, Address>>& elts)
+    -> std::optional<Address>;
 auto ToInteger(Value* v) -> int;
+auto ValToInt(Value* v, int line_num) -> int;
+auto ValToBool(Value* v, int line_num) -> int;
+auto ValToPtr(Value* v, int line_num) -> Address;
+// Applies `op` to `args`, which hold as many values as it takes.
+auto EvalPrim(Operator op, llvm::ArrayRef<Value*> args, int line_num)
+    -> Value*;
+// Returns the address of the field or alternative `f` of the value at `a`,
+// where `position` is the field's position as found by type checking.
+auto GetMember(Address a, const std::string& f, int position) -> Address;
+// Binds the variables of the pattern `p` to copies of the parts of `v` they
+// match, in `slots`, and adds their addresses to `vars`. Returns false if the
+// value doesn't match the pattern.
+auto PatternMatch(Value* p, Value* v, std::vector<Address>* slots,
+                  std::vector<Address>* vars, int line_num) -> bool;
+// Assigns the parts of `val` through the pointers in the pattern `pat`.
+void PatternAssignment(Value* pat, Value* val, int line_num);
 
 /***** Interpreters *****/
 
+// Allocates and initializes the globals declared by `fs`.
+void InitGlobals(std::list<Declaration*>* fs);
 auto InterpProgram(std::list<Declaration*>* fs) -> int;
 auto InterpExp(Env* env, Expression* e) -> Value*;
 
@@ -0,0 +1,301 @@
+#include "experimental/Interpreter/MatchTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+#include "experimental/AST/Arena.h"
+
+namespace Cocktail {
+
+namespace {
+
+// A test of an occurrence made by a pattern.
+struct Test {
+  int occurrence;
+  // The alternative tested for, as interned by `InternName`, or null if the
+  // occurrence is compared with `literal`.
+  const std::string* alternative;
+  int literal;
+};
+
+// What's left of a clause's pattern as the tree is compiled: the tests not
+// yet made, and the variables it binds.
+struct Row {
+  std::vector<Test> tests;
+  std::vector<std::pair<int, Expression*>> bindings;
+  int clause;
+};
+
+auto SameCase(const Test& t1, const Test& t2) -> bool {
+  return t1.alternative == t2.alternative &&
+         (t1.alternative != nullptr || t1.literal == t2.literal);
+}
+
+auto FindTest(const Row& row, int occurrence)
+    -> std::vector<Test>::const_iterator {
+  return std::find_if(row.tests.begin(), row.tests.end(),
+                      [&](const Test& test) {
+                        return test.occurrence == occurrence;
+                      });
+}
+
+class MatchCompiler {
+ public:
+  MatchCompiler(MatchTree* tree, TypeEnv* env, Env* ct_env)
+      : tree_(tree), env_(env), ct_env_(ct_env) {}
+
+  // Adds the tests and bindings of matching `pat` against `occurrence` to
+  // `row`, each test before those of the parts it tests. Returns false if
+  // the pattern can't be compiled.
+  auto AddPattern(Row* row, int occurrence, Expression* pat) -> bool;
+
+  // Compiles the rows that are left at a node, the first of which matches
+  // once its tests pass.
+  auto Compile(const std::vector<Row>& rows) -> MatchNode*;
+
+ private:
+  // Returns the occurrence of `field` of `parent`, making it if need be.
+  auto Child(int parent, const std::string& field, int position) -> int;
+
+  // Returns the alternative that `pat` is a pattern for, or null if it isn't
+  // a call of an alternative.
+  auto AlternativeName(Expression* pat) -> const std::string*;
+
+  MatchTree* tree_;
+  TypeEnv* env_;
+  Env* ct_env_;
+  std::map<std::pair<int, std::string>, int> children_;
+};
+
+auto MatchCompiler::Child(int parent, const std::string& field, int position)
+    -> int {
+  int occurrence = tree_->occurrences.size();
+  auto [it, inserted] = children_.insert({{parent, field}, occurrence});
+  if (inserted) {
+    tree_->occurrences.push_back({parent, field, position});
+  }
+  return it->second;
+}
+
+auto MatchCompiler::AlternativeName(Expression* pat) -> const std::string* {
+  if (pat->tag != ExpressionKind::Call ||
+      pat->u.call.function->tag != ExpressionKind::GetField) {
+    return nullptr;
+  }
+  Expression* choice = pat->u.call.function->u.get_field.aggregate;
+  auto res =
+      TypeCheckExp(choice, env_, ct_env_, nullptr, TCContext::ValueContext);
+  if (res.type->tag != ValKind::ChoiceTV) {
+    return nullptr;
+  }
+  return InternName(*pat->u.call.function->u.get_field.field);
+}
+
+auto MatchCompiler::AddPattern(Row* row, int occurrence, Expression* pat)
+    -> bool {
+  switch (pat->tag) {
+    case ExpressionKind::PatternVariable:
+      row->bindings.emplace_back(occurrence, pat);
+      return true;
+    case ExpressionKind::Tuple: {
+      int position = 0;
+      for (auto& field : *pat->u.tuple.fields) {
+        int child = Child(occurrence, field.first, position++);
+        if (!AddPattern(row, child, field.second)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case ExpressionKind::Integer:
+      row->tests.push_back({occurrence, nullptr, pat->u.integer});
+      return true;
+    case ExpressionKind::Boolean:
+      row->tests.push_back({occurrence, nullptr, pat->u.boolean ? 1 : 0});
+      return true;
+    case ExpressionKind::Call: {
+      const std::string* alternative = AlternativeName(pat);
+      if (!alternative) {
+        return false;
+      }
+      row->tests.push_back({occurrence, alternative, 0});
+      // The argument is an empty field name, which no tuple field has.
+      return AddPattern(row, Child(occurrence, "", 0), pat->u.call.argument);
+    }
+    default:
+      return false;
+  }
+}
+
+auto MatchCompiler::Compile(const std::vector<Row>& rows) -> MatchNode* {
+  auto* node = NewSyntax<MatchNode>();
+  if (rows.empty()) {
+    node->kind = MatchNode::Kind::Fail;
+    return node;
+  }
+  const Row& first = rows.front();
+  if (first.tests.empty()) {
+    node->kind = MatchNode::Kind::Leaf;
+    node->clause = first.clause;
+    node->bindings = first.bindings;
+    return node;
+  }
+  // The first row's first test is of an occurrence whose parts it tests
+  // after it, so that the occurrence is known to be an alternative before
+  // its argument is tested.
+  int occurrence = first.tests.front().occurrence;
+  node->kind = MatchNode::Kind::Switch;
+  node->occurrence = occurrence;
+
+  // The cases tested for, in the order the rows test for them, and the rows
+  // that don't test the occurrence, which are left in every case.
+  std::vector<Test> cases;
+  std::vector<Row> otherwise;
+  for (const Row& row : rows) {
+    auto test = FindTest(row, occurrence);
+    if (test == row.tests.end()) {
+      otherwise.push_back(row);
+    } else if (std::none_of(cases.begin(), cases.end(), [&](const Test& c) {
+                 return SameCase(c, *test);
+               })) {
+      cases.push_back(*test);
+    }
+  }
+  for (const Test& c : cases) {
+    std::vector<Row> case_rows;
+    for (const Row& row : rows) {
+      auto test = FindTest(row, occurrence);
+      if (test == row.tests.end()) {
+        case_rows.push_back(row);
+      } else if (SameCase(c, *test)) {
+        Row& case_row = case_rows.emplace_back(row);
+        case_row.tests.erase(case_row.tests.begin() +
+                             (test - row.tests.begin()));
+      }
+    }
+    MatchNode* child = Compile(case_rows);
+    if (c.alternative) {
+      node->alternatives[c.alternative] = child;
+    } else {
+      node->literals[c.literal] = child;
+    }
+  }
+  node->otherwise = Compile(otherwise);
+  return node;
+}
+
+// Returns the value of `occurrence`, finding it from its parent's if it
+// hasn't been yet.
+auto OccurrenceValue(const MatchTree& tree, std::vector<Value*>* values,
+                     int occurrence, int line_num) -> Value* {
+  Value*& value = (*values)[occurrence];
+  if (value) {
+    return value;
+  }
+  const Occurrence& occ = tree.occurrences[occurrence];
+  Value* parent = OccurrenceValue(tree, values, occ.parent, line_num);
+  if (occ.field.empty() && parent->tag == ValKind::AltV) {
+    value = parent->u.alt.arg;
+  } else if (!occ.field.empty() && parent->tag == ValKind::TupleV) {
+    auto a = FindElement(occ.field, occ.position, *parent->u.tuple.elts);
+    if (a == std::nullopt) {
+      ErrorStream() << "runtime error: field " << occ.field << " not in ";
+      PrintValue(parent, ErrorStream());
+      ErrorStream() << std::endl;
+      ExitWithError();
+    }
+    value = state->heap[*a];
+  } else {
+    ErrorStream() << line_num << ": internal error in match, didn't expect ";
+    PrintValue(parent, ErrorStream());
+    ErrorStream() << std::endl;
+    ExitWithError();
+  }
+  return value;
+}
+
+}  // namespace
+
+auto CompileMatchTree(
+    const std::list<std::pair<Expression*, Statement*>>& clauses,
+    TypeEnv* env, Env* ct_env) -> MatchTree* {
+  auto* tree = NewSyntax<MatchTree>();
+  tree->occurrences.push_back({-1, "", 0});
+  MatchCompiler compiler(tree, env, ct_env);
+  std::vector<Row> rows;
+  for (auto& clause : clauses) {
+    Row& row = rows.emplace_back();
+    row.clause = static_cast<int>(tree->bodies.size());
+    if (!compiler.AddPattern(&row, 0, clause.first)) {
+      return nullptr;
+    }
+    tree->bodies.push_back(clause.second);
+  }
+  tree->root = compiler.Compile(rows);
+  return tree;
+}
+
+auto RunMatchTree(const MatchTree& tree, Value* v, std::vector<Address>* slots,
+                  std::vector<Address>* vars, int line_num) -> int {
+  std::vector<Value*> values(tree.occurrences.size());
+  values[0] = v;
+  const MatchNode* node = tree.root;
+  while (node->kind == MatchNode::Kind::Switch) {
+    Value* value = OccurrenceValue(tree, &values, node->occurrence, line_num);
+    const MatchNode* next = node->otherwise;
+    switch (value->tag) {
+      case ValKind::AltV: {
+        auto it = node->alternatives.find(value->u.alt.alt_name);
+        if (it != node->alternatives.end()) {
+          next = it->second;
+        }
+        break;
+      }
+      case ValKind::IntV:
+      case ValKind::BoolV: {
+        int literal = value->tag == ValKind::IntV ? value->u.integer
+                                                  : value->u.boolean ? 1 : 0;
+        auto it = node->literals.find(literal);
+        if (it != node->literals.end()) {
+          next = it->second;
+        }
+        break;
+      }
+      default:
+        ErrorStream() << line_num
+                      << ": internal error in match, didn't expect ";
+        PrintValue(value, ErrorStream());
+        ErrorStream() << std::endl;
+        ExitWithError();
+    }
+    node = next;
+  }
+  if (tracing_output) {
+    std::cout << "match_tree(";
+    PrintValue(v, std::cout);
+    std::cout << ") -> clause " << node->clause << std::endl;
+  }
+  if (node->kind == MatchNode::Kind::Fail) {
+    return -1;
+  }
+  for (auto& [occurrence, var] : node->bindings) {
+    int slot = var->u.pattern_variable.slot;
+    if (slot < 0) {
+      ErrorStream() << line_num << ": internal error, pattern variable `"
+                    << *var->u.pattern_variable.name << "` was not resolved"
+                    << std::endl;
+      ExitWithError();
+    }
+    Value* value = OccurrenceValue(tree, &values, occurrence, line_num);
+    Address a = AllocateValue(CopyVal(value, line_num));
+    if (slot >= static_cast<int>(slots->size())) {
+      slots->resize(slot + 1);
+    }
+    (*slots)[slot] = a;
+    vars->push_back(a);
+  }
+  return node->clause;
+}
+
+}  // namespace Cocktail
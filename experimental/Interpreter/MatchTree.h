@@ -0,0 +1,71 @@
+#ifndef COCKTAIL_EXPERIMENTAL_INTERPRETER_MATCH_TREE_H
+#define COCKTAIL_EXPERIMENTAL_INTERPRETER_MATCH_TREE_H
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "experimental/AST/Statement.h"
+#include "experimental/Interpreter/TypeCheck.h"
+
+namespace Cocktail {
+
+// A part of the value matched: the value itself, or the argument of the
+// alternative or a field of the tuple that another part is.
+struct Occurrence {
+  // The occurrence this is part of, or -1 for the value matched.
+  int parent;
+  // The field of the tuple, or empty for the argument of an alternative.
+  std::string field;
+  // Where type checking found the field among the tuple's.
+  int position;
+};
+
+// A node of a decision tree, which tests one occurrence at a time.
+struct MatchNode {
+  enum class Kind { Switch, Leaf, Fail };
+
+  Kind kind;
+  // A switch's occurrence, which is an alternative or a literal.
+  int occurrence = -1;
+  // The node for each alternative, by its name as interned by `InternName`,
+  // or for each integer or boolean.
+  std::unordered_map<const std::string*, MatchNode*> alternatives;
+  std::unordered_map<int, MatchNode*> literals;
+  // The node for the values that none of the above are.
+  MatchNode* otherwise = nullptr;
+  // A leaf's clause, and the pattern variables it binds with the occurrence
+  // each is bound to.
+  int clause = -1;
+  std::vector<std::pair<int, Expression*>> bindings;
+};
+
+// The clauses of a `match`, compiled to switch on the alternatives and
+// literals of the value matched, so that finding the clause that matches
+// costs the depth of its pattern rather than a try of every clause before it.
+struct MatchTree {
+  MatchNode* root;
+  std::vector<Occurrence> occurrences;
+  // The body of each clause, by its index.
+  std::vector<Statement*> bodies;
+};
+
+// Compiles the clauses of a `match`, whose patterns have been type checked
+// in `env` and `ct_env`. Returns null if a pattern isn't made only of
+// alternatives, tuples, literals and variables, in which case each clause's
+// pattern is tried in turn.
+auto CompileMatchTree(
+    const std::list<std::pair<Expression*, Statement*>>& clauses,
+    TypeEnv* env, Env* ct_env) -> MatchTree*;
+
+// Returns the index of the first clause of `tree` that `v` matches, binding
+// the variables of its pattern to copies of the parts of `v` they match, in
+// `slots`, and adding their addresses to `vars`. Returns -1 if none matches.
+auto RunMatchTree(const MatchTree& tree, Value* v, std::vector<Address>* slots,
+                  std::vector<Address>* vars, int line_num) -> int;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_INTERPRETER_MATCH_TREE_H
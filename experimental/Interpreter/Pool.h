@@ -0,0 +1,67 @@
+#ifndef COCKTAIL_EXPERIMENTAL_INTERPRETER_POOL_H
+#define COCKTAIL_EXPERIMENTAL_INTERPRETER_POOL_H
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Cocktail {
+
+// Makes `T`s in blocks of them and reuses the ones that are deleted, so that
+// once the pool has grown to what a program needs, making a `T` doesn't go
+// to the system allocator, and the `T`s made together sit together. The
+// memory of the pool lives as long as it does, so a `T` still in use when
+// the pool is destroyed isn't destroyed itself.
+template <class T>
+class Pool {
+ public:
+  Pool() = default;
+  Pool(const Pool&) = delete;
+  auto operator=(const Pool&) -> Pool& = delete;
+
+  // Returns a new `T` made from `args`.
+  template <class... Args>
+  auto New(Args&&... args) -> T* {
+    if (!free_) {
+      Grow();
+    }
+    Slot* slot = free_;
+    free_ = slot->next;
+    return new (slot->storage) T(std::forward<Args>(args)...);
+  }
+
+  // Destroys `x`, which came from `New`, and keeps its memory for reuse.
+  void Delete(T* x) {
+    x->~T();
+    auto* slot = reinterpret_cast<Slot*>(x);
+    slot->next = free_;
+    free_ = slot;
+  }
+
+ private:
+  union Slot {
+    Slot* next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  static constexpr int BlockSize = 256;
+
+  void Grow() {
+    blocks_.push_back(std::make_unique<Slot[]>(BlockSize));
+    Slot* block = blocks_.back().get();
+    // Thread the free list from the start of the block, so that the slots
+    // are handed out in order.
+    for (int i = BlockSize - 1; i >= 0; --i) {
+      block[i].next = free_;
+      free_ = &block[i];
+    }
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> blocks_;
+  Slot* free_ = nullptr;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_INTERPRETER_POOL_H
@@ -0,0 +1,171 @@
+#include "experimental/Interpreter/Profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <utility>
+
+namespace Cocktail {
+
+thread_local Profiler* profiler = nullptr;
+
+Profiler::Profiler()
+    : root_{nullptr, nullptr, &top_},
+      lines_(1),
+      calls_{&root_},
+      current_(&root_),
+      last_(Clock::now()) {}
+
+void Profiler::Charge(Clock::time_point now) {
+  Clock::duration elapsed = now - last_;
+  current_->function->counts.self_time += elapsed;
+  lines_[line_num_].self_time += elapsed;
+  last_ = now;
+}
+
+void Profiler::Enter(const std::string* name) {
+  Clock::time_point now = Clock::now();
+  Charge(now);
+  Node* node = current_;
+  if (name != current_->name) {
+    auto it = std::find_if(
+        current_->children.begin(), current_->children.end(),
+        [name](const std::unique_ptr<Node>& child) {
+          return child->name == name;
+        });
+    if (it != current_->children.end()) {
+      node = it->get();
+    } else {
+      current_->children.push_back(std::make_unique<Node>(
+          Node{name, current_, &functions_[name]}));
+      node = current_->children.back().get();
+    }
+  }
+  Function* function = node->function;
+  ++function->calls;
+  if (function->active_calls++ == 0) {
+    function->entered = now;
+  }
+  calls_.push_back(node);
+  current_ = node;
+}
+
+void Profiler::Leave() {
+  Clock::time_point now = Clock::now();
+  Charge(now);
+  Function* function = current_->function;
+  if (--function->active_calls == 0) {
+    function->total_time += now - function->entered;
+  }
+  calls_.pop_back();
+  current_ = calls_.back();
+}
+
+void Profiler::Step(int line_num) {
+  Charge(Clock::now());
+  line_num_ = line_num;
+  if (line_num >= static_cast<int>(lines_.size())) {
+    lines_.resize(line_num + 1);
+  }
+  ++lines_[line_num].steps;
+  ++current_->function->counts.steps;
+  ++current_->steps;
+}
+
+void Profiler::Step() {
+  Charge(Clock::now());
+  ++lines_[line_num_].steps;
+  ++current_->function->counts.steps;
+  ++current_->steps;
+}
+
+void Profiler::Allocate() {
+  ++lines_[line_num_].allocations;
+  ++current_->function->counts.allocations;
+}
+
+auto Profiler::TotalSteps() const -> long {
+  long steps = top_.counts.steps;
+  for (const auto& [name, function] : functions_) {
+    steps += function.counts.steps;
+  }
+  return steps;
+}
+
+static auto Milliseconds(std::chrono::steady_clock::duration d) -> double {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+void Profiler::PrintFlatProfile(std::ostream& out) {
+  std::vector<std::pair<const std::string*, Function*>> functions;
+  for (auto& [name, function] : functions_) {
+    functions.push_back({name, &function});
+  }
+  std::sort(functions.begin(), functions.end(),
+            [](const auto& a, const auto& b) {
+              return a.second->counts.self_time > b.second->counts.self_time;
+            });
+  out << "********** profile **********" << std::endl;
+  out << std::fixed << std::setprecision(3);
+  out << std::setw(10) << "calls" << std::setw(12) << "steps"
+      << std::setw(12) << "allocations" << std::setw(11) << "self ms"
+      << std::setw(11) << "total ms"
+      << "  function" << std::endl;
+  for (const auto& [name, function] : functions) {
+    out << std::setw(10) << function->calls << std::setw(12)
+        << function->counts.steps << std::setw(12)
+        << function->counts.allocations << std::setw(11)
+        << Milliseconds(function->counts.self_time) << std::setw(11)
+        << Milliseconds(function->total_time) << "  " << *name << std::endl;
+  }
+
+  // Line 0 is where the work outside of the program's own lines, such as
+  // initializing the globals, is counted.
+  std::vector<int> lines;
+  for (int i = 1; i < static_cast<int>(lines_.size()); ++i) {
+    if (lines_[i].steps > 0) {
+      lines.push_back(i);
+    }
+  }
+  std::sort(lines.begin(), lines.end(), [this](int a, int b) {
+    return lines_[a].self_time > lines_[b].self_time;
+  });
+  out << std::endl;
+  out << std::setw(22) << "steps" << std::setw(12) << "allocations"
+      << std::setw(11) << "self ms"
+      << "  line" << std::endl;
+  for (int i : lines) {
+    out << std::setw(22) << lines_[i].steps << std::setw(12)
+        << lines_[i].allocations << std::setw(11)
+        << Milliseconds(lines_[i].self_time) << "  " << i << std::endl;
+  }
+  out << std::defaultfloat;
+}
+
+void Profiler::PrintStacks(std::ostream& out) {
+  // Walks the tree of calls without recursion, as mutual recursion can make
+  // it deep.
+  std::vector<Node*> worklist;
+  for (auto& child : root_.children) {
+    worklist.push_back(child.get());
+  }
+  while (!worklist.empty()) {
+    Node* node = worklist.back();
+    worklist.pop_back();
+    for (auto& child : node->children) {
+      worklist.push_back(child.get());
+    }
+    if (node->steps == 0) {
+      continue;
+    }
+    std::vector<const std::string*> names;
+    for (Node* n = node; n != &root_; n = n->parent) {
+      names.push_back(n->name);
+    }
+    for (auto it = names.rbegin(); it != names.rend(); ++it) {
+      out << (it == names.rbegin() ? "" : ";") << **it;
+    }
+    out << " " << node->steps << std::endl;
+  }
+}
+
+}  // namespace Cocktail
@@ -0,0 +1,96 @@
+#ifndef COCKTAIL_EXPERIMENTAL_INTERPRETER_PROFILE_H
+#define COCKTAIL_EXPERIMENTAL_INTERPRETER_PROFILE_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Cocktail {
+
+// Counts the steps taken, values allocated and wall time spent by a running
+// program in each function and at each line, and the steps taken in each
+// chain of calls. A step is an action of the small-step machine or an
+// instruction of the bytecode machine, so the counts of the two differ.
+class Profiler {
+ public:
+  Profiler();
+  Profiler(const Profiler&) = delete;
+  auto operator=(const Profiler&) -> Profiler& = delete;
+
+  // Called as a call of the function `name` starts, and as the innermost
+  // call in progress ends.
+  void Enter(const std::string* name);
+  void Leave();
+  // Called as a step is taken at `line_num`, or at the line of the step
+  // before for a step without a line of its own.
+  void Step(int line_num);
+  void Step();
+  // Called as a value is allocated on the heap.
+  void Allocate();
+
+  // The number of steps counted in all.
+  auto TotalSteps() const -> long;
+
+  // Prints the counts of each function and line, costliest first.
+  void PrintFlatProfile(std::ostream& out);
+  // Prints the steps taken in each chain of calls in the collapsed-stack
+  // format that flame graph tools read: the names of the functions from the
+  // outermost in, separated by semicolons, then a space and the count.
+  void PrintStacks(std::ostream& out);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Counts {
+    long steps = 0;
+    long allocations = 0;
+    // The time spent in the function or at the line itself.
+    Clock::duration self_time{};
+  };
+
+  struct Function {
+    Counts counts;
+    long calls = 0;
+    // The time spent in the function and what it calls, and when its
+    // outermost call in progress, if any, started.
+    Clock::duration total_time{};
+    int active_calls = 0;
+    Clock::time_point entered;
+  };
+
+  // A function as called by way of the chain of calls to its parent. A
+  // function calling itself directly stays in its node, so that deep
+  // recursion doesn't make a chain as deep.
+  struct Node {
+    const std::string* name;
+    Node* parent;
+    Function* function;
+    long steps = 0;
+    std::vector<std::unique_ptr<Node>> children;
+  };
+
+  // Adds the time since the last event to the current function and line.
+  void Charge(Clock::time_point now);
+
+  Node root_;
+  Function top_;
+  std::map<const std::string*, Function> functions_;
+  // The counts of each line, by its number.
+  std::vector<Counts> lines_;
+  // The node of each call in progress, the innermost last.
+  std::vector<Node*> calls_;
+  Node* current_;
+  int line_num_ = 0;
+  Clock::time_point last_;
+};
+
+// The profiler counting the work of the program being run on this thread,
+// if it's being profiled.
+extern thread_local Profiler* profiler;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_INTERPRETER_PROFILE_H
@@ -0,0 +1,156 @@
+#include "experimental/Interpreter/Resolve.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "experimental/Interpreter/TypeCheck.h"
+
+namespace Cocktail {
+
+// The variables in scope at a point in a function.
+struct ResolveScope {
+  // The index of each global, by name.
+  std::map<std::string, int> globals;
+  // The function's parameters and locals in scope, each with its slot, the
+  // innermost last.
+  std::vector<std::pair<std::string, int>> locals;
+  // The number of slots given out in the function so far.
+  int num_slots = 0;
+};
+
+void ResolveExp(Expression* e, ResolveScope* scope) {
+  switch (e->tag) {
+    case ExpressionKind::Variable: {
+      for (auto i = scope->locals.rbegin(); i != scope->locals.rend(); ++i) {
+        if (i->first == *e->u.variable.name) {
+          e->u.variable.depth = 0;
+          e->u.variable.slot = i->second;
+          return;
+        }
+      }
+      auto global = scope->globals.find(*e->u.variable.name);
+      if (global != scope->globals.end()) {
+        e->u.variable.depth = 1;
+        e->u.variable.slot = global->second;
+      }
+      break;
+    }
+    case ExpressionKind::PatternVariable:
+      // The type is evaluated before the variable is bound.
+      ResolveExp(e->u.pattern_variable.type, scope);
+      e->u.pattern_variable.slot = scope->num_slots++;
+      scope->locals.emplace_back(*e->u.pattern_variable.name,
+                                 e->u.pattern_variable.slot);
+      break;
+    case ExpressionKind::GetField:
+      ResolveExp(e->u.get_field.aggregate, scope);
+      break;
+    case ExpressionKind::Index:
+      ResolveExp(e->u.index.aggregate, scope);
+      ResolveExp(e->u.index.offset, scope);
+      break;
+    case ExpressionKind::Tuple:
+      for (auto& field : *e->u.tuple.fields) {
+        ResolveExp(field.second, scope);
+      }
+      break;
+    case ExpressionKind::PrimitiveOp:
+      for (Expression* arg : *e->u.primitive_op.arguments) {
+        ResolveExp(arg, scope);
+      }
+      break;
+    case ExpressionKind::Call:
+      ResolveExp(e->u.call.function, scope);
+      ResolveExp(e->u.call.argument, scope);
+      break;
+    case ExpressionKind::FunctionT:
+      ResolveExp(e->u.function_type.parameter, scope);
+      ResolveExp(e->u.function_type.return_type, scope);
+      break;
+    case ExpressionKind::Integer:
+    case ExpressionKind::Boolean:
+    case ExpressionKind::IntT:
+    case ExpressionKind::BoolT:
+    case ExpressionKind::TypeT:
+    case ExpressionKind::AutoT:
+      break;
+  }
+}
+
+void ResolveStmt(Statement* s, ResolveScope* scope) {
+  if (!s) {
+    return;
+  }
+  switch (s->tag) {
+    case StatementKind::Match:
+      ResolveExp(s->u.match_stmt.exp, scope);
+      for (auto& clause : *s->u.match_stmt.clauses) {
+        // The variables of each clause's pattern are in scope only in its
+        // body.
+        auto num_locals = scope->locals.size();
+        ResolveExp(clause.first, scope);
+        ResolveStmt(clause.second, scope);
+        scope->locals.resize(num_locals);
+      }
+      break;
+    case StatementKind::While:
+      ResolveExp(s->u.while_stmt.cond, scope);
+      ResolveStmt(s->u.while_stmt.body, scope);
+      break;
+    case StatementKind::Block: {
+      auto num_locals = scope->locals.size();
+      ResolveStmt(s->u.block.stmt, scope);
+      scope->locals.resize(num_locals);
+      break;
+    }
+    case StatementKind::VariableDefinition:
+      // The initializer is evaluated before the variables are bound, and they
+      // stay in scope until the end of the enclosing block.
+      ResolveExp(s->u.variable_definition.init, scope);
+      ResolveExp(s->u.variable_definition.pat, scope);
+      break;
+    case StatementKind::ExpressionStatement:
+      ResolveExp(s->u.exp, scope);
+      break;
+    case StatementKind::Assign:
+      ResolveExp(s->u.assign.lhs, scope);
+      ResolveExp(s->u.assign.rhs, scope);
+      break;
+    case StatementKind::If:
+      ResolveExp(s->u.if_stmt.cond, scope);
+      ResolveStmt(s->u.if_stmt.then_stmt, scope);
+      ResolveStmt(s->u.if_stmt.else_stmt, scope);
+      break;
+    case StatementKind::Return:
+      ResolveExp(s->u.return_stmt, scope);
+      break;
+    case StatementKind::Sequence:
+      ResolveStmt(s->u.sequence.stmt, scope);
+      ResolveStmt(s->u.sequence.next, scope);
+      break;
+    case StatementKind::Break:
+    case StatementKind::Continue:
+      break;
+  }
+}
+
+void ResolveProgram(std::list<Declaration*>* fs) {
+  ResolveScope scope;
+  int index = 0;
+  for (auto d : *fs) {
+    // A later global of the same name hides an earlier one.
+    scope.globals[NameOfDecl(d)] = index++;
+  }
+  for (auto d : *fs) {
+    if (d->tag == DeclarationKind::FunctionDeclaration) {
+      scope.locals.clear();
+      scope.num_slots = 0;
+      ResolveExp(d->u.fun_def->param_pattern, &scope);
+      ResolveStmt(d->u.fun_def->body, &scope);
+    }
+  }
+}
+
+}  // namespace Cocktail
@@ -0,0 +1,20 @@
+#ifndef COCKTAIL_EXPERIMENTAL_INTERPRETER_RESOLVE_H
+#define COCKTAIL_EXPERIMENTAL_INTERPRETER_RESOLVE_H
+
+#include <list>
+
+#include "experimental/AST/Declaration.h"
+
+namespace Cocktail {
+
+// Resolves the variables in the parameters and bodies of the functions of
+// the type-checked program `fs`, so that they're found at run-time by index
+// rather than by name. Each pattern variable of a function is given a slot
+// of its frame, and each use of a variable the slot of the innermost
+// variable of that name in scope, or else the index of the global declared
+// with it, which is its position in `fs`.
+void ResolveProgram(std::list<Declaration*>* fs);
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_INTERPRETER_RESOLVE_H
@@ -0,0 +1,58 @@
+#ifndef COCKTAIL_EXPERIMENTAL_INTERPRETER_STACK_H
+#define COCKTAIL_EXPERIMENTAL_INTERPRETER_STACK_H
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+namespace Cocktail {
+
+// A stack of `T`s, kept in a vector with the top element last, so that
+// pushing, popping and counting elements take constant time. Iteration runs
+// from the top of the stack to the bottom.
+template <class T>
+struct Stack {
+  using const_iterator = typename std::vector<T>::const_reverse_iterator;
+
+  Stack() = default;
+
+  // Creates a stack holding only `x`.
+  explicit Stack(T x) { Push(std::move(x)); }
+
+  // Pushes `x` on top of the stack.
+  void Push(T x) { elements_.push_back(std::move(x)); }
+
+  // Removes and returns the top element of the stack.
+  auto Pop() -> T {
+    assert(!IsEmpty() && "Can't pop from an empty stack.");
+    T x = std::move(elements_.back());
+    elements_.pop_back();
+    return x;
+  }
+
+  // Removes the top `n` elements of the stack.
+  void Pop(int n) {
+    assert(n <= Count() && "Can only pop as many elements as stack has.");
+    elements_.resize(elements_.size() - n);
+  }
+
+  // Returns the top element of the stack.
+  auto Top() const -> const T& {
+    assert(!IsEmpty() && "Empty stack has no top.");
+    return elements_.back();
+  }
+
+  auto IsEmpty() const -> bool { return elements_.empty(); }
+
+  auto Count() const -> int { return elements_.size(); }
+
+  auto begin() const -> const_iterator { return elements_.rbegin(); }
+  auto end() const -> const_iterator { return elements_.rend(); }
+
+ private:
+  std::vector<T> elements_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_INTERPRETER_STACK_H
@@ -1,43 +1,67 @@
 #include "experimental/Interpreter/TypeCheck.h"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <set>
+#include <sstream>
+#include <unordered_map>
 #include <vector>
 
+#include "Cocktail/Common/TaskScheduler.h"
+#include "experimental/AST/Arena.h"
 #include "experimental/AST/FunctionDefinition.h"
-#include "experimental/Interpreter/ConsList.h"
 #include "experimental/Interpreter/Interpreter.h"
+#include "experimental/Interpreter/MatchTree.h"
 
 namespace Cocktail {
 
-auto Find(const std::string& s, Cons<std::string>* ls, int n) -> int {
-  if (ls) {
-    if (ls->curr == s) {
-      return n;
-    } else {
-      return Find(s, ls->next, n + 1);
-    }
-  } else {
-    std::cerr << "could not find " << s << std::endl;
-    exit(-1);
-  }
-}
-
 void ExpectType(int line_num, const std::string& context, Value* expected,
                 Value* actual) {
   if (!TypeEqual(expected, actual)) {
-    std::cerr << line_num << ": type error in " << context << std::endl;
-    std::cerr << "expected: ";
-    PrintValue(expected, std::cerr);
-    std::cerr << std::endl << "actual: ";
-    PrintValue(actual, std::cerr);
-    std::cerr << std::endl;
-    exit(-1);
+    ErrorStream() << line_num << ": type error in " << context << std::endl;
+    ErrorStream() << "expected: ";
+    PrintValue(expected, ErrorStream());
+    ErrorStream() << std::endl << "actual: ";
+    PrintValue(actual, ErrorStream());
+    ErrorStream() << std::endl;
+    ExitWithError();
   }
 }
 
-void PrintErrorString(const std::string& s) { std::cerr << s; }
+void PrintErrorString(const std::string& s) { ErrorStream() << s; }
+
+// The environment of the globals, which every other environment ends with,
+// and its bindings by name, so that looking up a global doesn't walk past
+// all the globals declared after it.
+static thread_local TypeEnv* indexed_top = nullptr;
+static thread_local std::unordered_map<std::string, Value*> top_index;
+
+static void IndexTopLevel(TypeEnv* top) {
+  indexed_top = top;
+  top_index.clear();
+  for (TypeEnv* env = top; env; env = env->next) {
+    // The first binding of a name is the one that's found.
+    top_index.emplace(env->key, env->value);
+  }
+}
+
+static auto LookupType(int line_num, TypeEnv* env, const std::string& name)
+    -> Value* {
+  for (; env && env != indexed_top; env = env->next) {
+    if (env->key == name) {
+      return env->value;
+    }
+  }
+  if (env) {
+    auto it = top_index.find(name);
+    if (it != top_index.end()) {
+      return it->second;
+    }
+  }
+  ErrorStream() << line_num << ": could not find `" << name << "`" << std::endl;
+  ExitWithError();
+}
 
 void PrintTypeEnv(TypeEnv* env, std::ostream& out) {
   if (env) {
@@ -52,14 +76,23 @@ void PrintTypeEnv(TypeEnv* env, std::ostream& out) {
 auto ToType(int line_num, Value* val) -> Value* {
   switch (val->tag) {
     case ValKind::TupleV: {
-      auto fields = new VarValues();
-      for (auto& elt : *val->u.tuple.elts) {
-        Value* ty = ToType(line_num, state->heap[elt.second]);
-        fields->push_back(std::make_pair(elt.first, ty));
+      // The tuples are mostly those of type expressions, which `InterpExp`
+      // evaluates once each.
+      Value*& type = state->tuple_types[val];
+      if (!type) {
+        auto fields = new VarValues();
+        for (auto& elt : *val->u.tuple.elts) {
+          Value* ty = ToType(line_num, state->heap[elt.second]);
+          fields->push_back(std::make_pair(elt.first, ty));
+        }
+        type = MakeTupleTypeVal(fields);
       }
-      return MakeTupleTypeVal(fields);
+      return type;
     }
     case ValKind::TupleTV: {
+      if (IsShared(val)) {
+        return val;
+      }
       auto fields = new VarValues();
       for (auto& field : *val->u.tuple_type.fields) {
         Value* ty = ToType(line_num, field.second);
@@ -68,15 +101,22 @@ auto ToType(int line_num, Value* val) -> Value* {
       return MakeTupleTypeVal(fields);
     }
     case ValKind::PointerTV: {
+      if (IsShared(val)) {
+        return val;
+      }
       return MakePtrTypeVal(ToType(line_num, val->u.ptr_type.type));
     }
     case ValKind::FunctionTV: {
+      if (IsShared(val)) {
+        return val;
+      }
       return MakeFunTypeVal(ToType(line_num, val->u.fun_type.param),
                             ToType(line_num, val->u.fun_type.ret));
     }
     case ValKind::VarPatV: {
-      return MakeVarPatVal(*val->u.var_pat.name,
-                           ToType(line_num, val->u.var_pat.type));
+      return MakeVarPatVal(val->u.var_pat.name,
+                           ToType(line_num, val->u.var_pat.type),
+                           val->u.var_pat.slot);
     }
     case ValKind::ChoiceTV:
     case ValKind::StructTV:
@@ -87,10 +127,10 @@ auto ToType(int line_num, Value* val) -> Value* {
     case ValKind::AutoTV:
       return val;
     default:
-      std::cerr << line_num << ": in ToType, expected a type, not ";
-      PrintValue(val, std::cerr);
-      std::cerr << std::endl;
-      exit(-1);
+      ErrorStream() << line_num << ": in ToType, expected a type, not ";
+      PrintValue(val, ErrorStream());
+      ErrorStream() << std::endl;
+      ExitWithError();
   }
 }
 
@@ -121,10 +161,10 @@ auto ReifyType(Value* t, int line_num) -> Expression* {
     case ValKind::ChoiceTV:
       return MakeVar(0, *t->u.choice_type.name);
     default:
-      std::cerr << line_num << ": expected a type, not ";
-      PrintValue(t, std::cerr);
-      std::cerr << std::endl;
-      exit(-1);
+      ErrorStream() << line_num << ": expected a type, not ";
+      PrintValue(t, ErrorStream());
+      ErrorStream() << std::endl;
+      ExitWithError();
   }
 }
 
@@ -151,7 +191,7 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
   switch (e->tag) {
     case ExpressionKind::PatternVariable: {
       if (context != TCContext::PatternContext) {
-        std::cerr
+        ErrorStream()
             << e->line_num
             << ": compilation error, pattern variables are only allowed in "
                "pattern context"
@@ -161,10 +201,10 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
           ToType(e->line_num, InterpExp(ct_env, e->u.pattern_variable.type));
       if (t->tag == ValKind::AutoTV) {
         if (expected == nullptr) {
-          std::cerr << e->line_num
-                    << ": compilation error, auto not allowed here"
-                    << std::endl;
-          exit(-1);
+          ErrorStream() << e->line_num
+                        << ": compilation error, auto not allowed here"
+                        << std::endl;
+          ExitWithError();
         } else {
           t = expected;
         }
@@ -182,21 +222,26 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
         case ValKind::TupleTV: {
           auto i = ToInteger(InterpExp(ct_env, e->u.index.offset));
           std::string f = std::to_string(i);
-          auto field_t = FindInVarValues(f, t->u.tuple_type.fields);
-          if (field_t == nullptr) {
-            std::cerr << e->line_num << ": compilation error, field " << f
-                      << " is not in the tuple ";
-            PrintValue(t, std::cerr);
-            std::cerr << std::endl;
-            exit(-1);
+          int position = 0;
+          for (auto& field : *t->u.tuple_type.fields) {
+            if (field.first == f) {
+              auto new_e =
+                  MakeIndex(e->line_num, res.exp, MakeInt(e->line_num, i));
+              new_e->u.index.position = position;
+              return TCResult(new_e, field.second, res.env);
+            }
+            ++position;
           }
-          auto new_e = MakeIndex(e->line_num, res.exp, MakeInt(e->line_num, i));
-          return TCResult(new_e, field_t, res.env);
+          ErrorStream() << e->line_num << ": compilation error, field " << f
+                        << " is not in the tuple ";
+          PrintValue(t, ErrorStream());
+          ErrorStream() << std::endl;
+          ExitWithError();
         }
         default:
-          std::cerr << e->line_num << ": compilation error, expected a tuple"
-                    << std::endl;
-          exit(-1);
+          ErrorStream() << e->line_num
+                        << ": compilation error, expected a tuple" << std::endl;
+          ExitWithError();
       }
     }
     case ExpressionKind::Tuple: {
@@ -211,9 +256,10 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
           arg_expected =
               FindInVarValues(arg->first, expected->u.tuple_type.fields);
           if (arg_expected == nullptr) {
-            std::cerr << e->line_num << ": compilation error, missing field "
-                      << arg->first << std::endl;
-            exit(-1);
+            ErrorStream() << e->line_num
+                          << ": compilation error, missing field " << arg->first
+                          << std::endl;
+            ExitWithError();
           }
         }
         auto arg_res =
@@ -231,14 +277,17 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
                               TCContext::ValueContext);
       auto t = res.type;
       switch (t->tag) {
-        case ValKind::StructTV:
+        case ValKind::StructTV: {
           // Search for a field
+          int position = 0;
           for (auto& field : *t->u.struct_type.fields) {
             if (*e->u.get_field.field == field.first) {
               Expression* new_e =
                   MakeGetField(e->line_num, res.exp, *e->u.get_field.field);
+              new_e->u.get_field.position = position;
               return TCResult(new_e, field.second, res.env);
             }
+            ++position;
           }
           // Search for a method
           for (auto& method : *t->u.struct_type.methods) {
@@ -248,22 +297,29 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
               return TCResult(new_e, method.second, res.env);
             }
           }
-          std::cerr << e->line_num << ": compilation error, struct "
-                    << *t->u.struct_type.name << " does not have a field named "
-                    << *e->u.get_field.field << std::endl;
-          exit(-1);
-        case ValKind::TupleTV:
+          ErrorStream() << e->line_num << ": compilation error, struct "
+                        << *t->u.struct_type.name
+                        << " does not have a field named "
+                        << *e->u.get_field.field << std::endl;
+          ExitWithError();
+        }
+        case ValKind::TupleTV: {
+          int position = 0;
           for (auto& field : *t->u.tuple_type.fields) {
             if (*e->u.get_field.field == field.first) {
               auto new_e =
                   MakeGetField(e->line_num, res.exp, *e->u.get_field.field);
+              new_e->u.get_field.position = position;
               return TCResult(new_e, field.second, res.env);
             }
+            ++position;
           }
-          std::cerr << e->line_num << ": compilation error, struct "
-                    << *t->u.struct_type.name << " does not have a field named "
-                    << *e->u.get_field.field << std::endl;
-          exit(-1);
+          ErrorStream() << e->line_num << ": compilation error, struct "
+                        << *t->u.struct_type.name
+                        << " does not have a field named "
+                        << *e->u.get_field.field << std::endl;
+          ExitWithError();
+        }
         case ValKind::ChoiceTV:
           for (auto vt = t->u.choice_type.alternatives->begin();
                vt != t->u.choice_type.alternatives->end(); ++vt) {
@@ -274,23 +330,24 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
               return TCResult(new_e, fun_ty, res.env);
             }
           }
-          std::cerr << e->line_num << ": compilation error, struct "
-                    << *t->u.struct_type.name << " does not have a field named "
-                    << *e->u.get_field.field << std::endl;
-          exit(-1);
+          ErrorStream() << e->line_num << ": compilation error, struct "
+                        << *t->u.struct_type.name
+                        << " does not have a field named "
+                        << *e->u.get_field.field << std::endl;
+          ExitWithError();
 
         default:
-          std::cerr << e->line_num
-                    << ": compilation error in field access, expected a struct"
-                    << std::endl;
+          ErrorStream()
+              << e->line_num
+              << ": compilation error in field access, expected a struct"
+              << std::endl;
           PrintExp(e);
-          std::cerr << std::endl;
-          exit(-1);
+          ErrorStream() << std::endl;
+          ExitWithError();
       }
     }
     case ExpressionKind::Variable: {
-      auto t =
-          Lookup(e->line_num, env, *(e->u.variable.name), PrintErrorString);
+      auto t = LookupType(e->line_num, env, *(e->u.variable.name));
       return TCResult(e, t, env);
     }
     case ExpressionKind::Integer:
@@ -351,12 +408,12 @@ auto TypeCheckExp(Expression* e, TypeEnv* env, Env* ct_env, Value* expected,
           return TCResult(new_e, fun_t->u.fun_type.ret, arg_res.env);
         }
         default: {
-          std::cerr << e->line_num
-                    << ": compilation error in call, expected a function"
-                    << std::endl;
+          ErrorStream() << e->line_num
+                        << ": compilation error in call, expected a function"
+                        << std::endl;
           PrintExp(e);
-          std::cerr << std::endl;
-          exit(-1);
+          ErrorStream() << std::endl;
+          ExitWithError();
         }
       }
       break;
@@ -425,6 +482,7 @@ auto TypeCheckStmt(Statement* s, TypeEnv* env, Env* ct_env, Value* ret_type)
             res_type, clause.first, clause.second, env, ct_env, ret_type));
       }
       Statement* new_s = MakeMatch(s->line_num, res.exp, new_clauses);
+      new_s->u.match_stmt.tree = CompileMatchTree(*new_clauses, env, ct_env);
       return TCStatement(new_s, env);
     }
     case StatementKind::While: {
@@ -514,10 +572,10 @@ auto CheckOrEnsureReturn(Statement* stmt, bool void_return, int line_num)
       auto args = new std::vector<std::pair<std::string, Expression*>>();
       return MakeReturn(line_num, MakeTuple(line_num, args));
     } else {
-      std::cerr
+      ErrorStream()
           << "control-flow reaches end of non-void function without a return"
           << std::endl;
-      exit(-1);
+      ExitWithError();
     }
   }
   switch (stmt->tag) {
@@ -528,7 +586,18 @@ auto CheckOrEnsureReturn(Statement* stmt, bool void_return, int line_num)
         auto s = CheckOrEnsureReturn(i->second, void_return, stmt->line_num);
         new_clauses->push_back(std::make_pair(i->first, s));
       }
-      return MakeMatch(stmt->line_num, stmt->u.match_stmt.exp, new_clauses);
+      Statement* new_s =
+          MakeMatch(stmt->line_num, stmt->u.match_stmt.exp, new_clauses);
+      if (MatchTree* tree = stmt->u.match_stmt.tree) {
+        // The tree is shared, but for the bodies it leads to.
+        tree = NewSyntax<MatchTree>(*tree);
+        tree->bodies.clear();
+        for (auto& clause : *new_clauses) {
+          tree->bodies.push_back(clause.second);
+        }
+        new_s->u.match_stmt.tree = tree;
+      }
+      return new_s;
     }
     case StatementKind::Block:
       return MakeBlock(
@@ -563,12 +632,12 @@ auto CheckOrEnsureReturn(Statement* stmt, bool void_return, int line_num)
             stmt->line_num, stmt,
             MakeReturn(stmt->line_num, MakeTuple(stmt->line_num, args)));
       } else {
-        std::cerr
+        ErrorStream()
             << stmt->line_num
             << ": control-flow reaches end of non-void function without a "
                "return"
             << std::endl;
-        exit(-1);
+        ExitWithError();
       }
   }
 }
@@ -613,7 +682,7 @@ auto TypeOfStructDef(struct StructDefinition* sd, TypeEnv* /*env*/, Env* ct_top)
       fields->push_back(std::make_pair(*(*m)->u.field.name, t));
     }
   }
-  return MakeStructTypeVal(*sd->name, fields, methods);
+  return MakeStructTypeVal(InternName(*sd->name), fields, methods);
 }
 
 auto NameOfDecl(Declaration* d) -> std::string {
@@ -681,7 +750,7 @@ auto TopLevel(std::list<Declaration*>* fs) -> std::pair<TypeEnv*, Env*> {
               ToType(d->u.choice_def.line_num, InterpExp(ct_top, i->second));
           alts->push_back(std::make_pair(i->first, t));
         }
-        auto ct = MakeChoiceTypeVal(d->u.choice_def.name, alts);
+        auto ct = MakeChoiceTypeVal(InternName(*d->u.choice_def.name), alts);
         Address a = AllocateValue(ct);
         ct_top = new Env(NameOfDecl(d), a, ct_top);  // Is this obsolete?
         top = new TypeEnv(NameOfDecl(d), ct, top);
@@ -690,11 +759,97 @@ auto TopLevel(std::list<Declaration*>* fs) -> std::pair<TypeEnv*, Env*> {
     }  // switch (d->tag)
   }    // for
   if (found_main == false) {
-    std::cerr << "error, program must contain a function named `main`"
-              << std::endl;
-    exit(-1);
+    ErrorStream() << "error, program must contain a function named `main`"
+                  << std::endl;
+    ExitWithError();
   }
+  IndexTopLevel(top);
   return make_pair(top, ct_top);
 }
 
-}  // namespace Cocktail
\ No newline at end of file
+// A run of consecutive declarations, checked on a thread of its own.
+struct CheckRun {
+  std::vector<Declaration*> decls;
+  std::vector<Declaration*> checked;
+  // The syntax made checking the run, if the program's syntax is in an arena.
+  Arena arena;
+  // The error that ended the run, if one did.
+  std::ostringstream errors;
+  bool failed = false;
+};
+
+// Checks the declarations of `run`, stopping at the first with an error, with
+// this thread's interpreter state set aside for the duration. The thread may
+// be the one checking `fs`, which goes on with its state after.
+static void CheckDeclarations(std::list<Declaration*>* fs, CheckRun& run,
+                              bool in_arena) {
+  State* saved_state = state;
+  Arena* saved_arena = syntax_arena;
+  std::ostream* saved_error_stream = error_stream;
+  TypeEnv* saved_indexed_top = indexed_top;
+  std::unordered_map<std::string, Value*> saved_index;
+  saved_index.swap(top_index);
+
+  State run_state;
+  state = &run_state;
+  syntax_arena = in_arena ? &run.arena : nullptr;
+  error_stream = &run.errors;
+  try {
+    auto [top, ct_top] = TopLevel(fs);
+    for (Declaration* d : run.decls) {
+      run.checked.push_back(TypeCheckDecl(d, top, ct_top));
+    }
+  } catch (const ProgramError&) {
+    run.failed = true;
+  }
+
+  state = saved_state;
+  syntax_arena = saved_arena;
+  error_stream = saved_error_stream;
+  indexed_top = saved_indexed_top;
+  top_index.swap(saved_index);
+}
+
+auto TypeCheckProgram(std::list<Declaration*>* fs, int jobs)
+    -> std::list<Declaration*> {
+  // Errors at the top level are reported before any in a declaration.
+  auto [top, ct_top] = TopLevel(fs);
+  int num_decls = fs->size();
+  int num_runs = std::min(jobs, num_decls);
+  std::list<Declaration*> checked;
+  // Tracing prints the steps of evaluating types as they're taken.
+  if (num_runs <= 1 || tracing_output) {
+    for (Declaration* d : *fs) {
+      checked.push_back(TypeCheckDecl(d, top, ct_top));
+    }
+    return checked;
+  }
+
+  std::vector<CheckRun> runs(num_runs);
+  int position = 0;
+  for (Declaration* d : *fs) {
+    runs[position++ * num_runs / num_decls].decls.push_back(d);
+  }
+  bool in_arena = syntax_arena != nullptr;
+  {
+    TaskScheduler scheduler(num_runs - 1);
+    ParallelFor(scheduler, num_runs, [&](int index) {
+      CheckDeclarations(fs, runs[index], in_arena);
+    });
+  }
+  // Each run stops at its first error, so the first error of the first run
+  // with one is the first of the program.
+  for (CheckRun& run : runs) {
+    if (run.failed) {
+      std::cerr << run.errors.str();
+      exit(-1);
+    }
+    if (in_arena) {
+      syntax_arena->Adopt(run.arena);
+    }
+    checked.insert(checked.end(), run.checked.begin(), run.checked.end());
+  }
+  return checked;
+}
+
+}  // namespace Cocktail
@@ -43,8 +43,18 @@ auto TypeCheckFunDef(struct FunctionDefinition*, TypeEnv*)
 
 auto TypeCheckDecl(Declaration* d, TypeEnv* env, Env* ct_env) -> Declaration*;
 
+auto NameOfDecl(Declaration* d) -> std::string;
+
 auto TopLevel(std::list<Declaration*>* fs) -> std::pair<TypeEnv*, Env*>;
 
+// Type checks the program `fs`, returning its declarations as `TypeCheckDecl`
+// checks them against the environments of `TopLevel`. With `jobs` above 1,
+// the declarations are split into that many runs, which are checked on as
+// many threads, each against a top level of its own. Errors are reported as
+// they would be checking the declarations in order.
+auto TypeCheckProgram(std::list<Declaration*>* fs, int jobs)
+    -> std::list<Declaration*>;
+
 void PrintErrorString(const std::string& s);
 
 }  // namespace Cocktail
@@ -0,0 +1,504 @@
+#include "experimental/Interpreter/VM.h"
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "experimental/Interpreter/Bytecode.h"
+#include "experimental/Interpreter/Interpreter.h"
+#include "experimental/Interpreter/MatchTree.h"
+#include "experimental/Interpreter/Profile.h"
+#include "experimental/Interpreter/TypeCheck.h"
+
+namespace Cocktail {
+
+// A call in progress on the bytecode machine.
+struct MachineFrame {
+  // The name of the function, as interned by `InternName`.
+  const std::string* name;
+  const Code* code;
+  // The index of the next instruction to run.
+  int pc;
+  // The addresses of the function's parameters and locals, by the slots
+  // that `ResolveProgram` gave them.
+  std::vector<Address> slots;
+  // The addresses of the variables bound in the blocks not yet left, in the
+  // order they were bound.
+  std::vector<Address> locals;
+  // The number of `locals` as each block not yet left was entered.
+  std::vector<int> block_starts;
+  // The addresses of the temporaries of the current statement.
+  std::vector<Address> temporaries;
+};
+
+class Machine {
+ public:
+  // Calls `fun` with `arg`. A function is entered, to be run by `Run`, while
+  // the value of a struct or alternative is pushed right away.
+  void Call(Value* fun, Value* arg, int line_num);
+  // Calls `fun` with `arg` from the top frame, as its last act. A function
+  // takes over that frame, so that a program recursing by tail calls runs in
+  // as many frames as it would by looping.
+  void TailCall(Value* fun, Value* arg, int line_num);
+  // Runs until the calls in progress have returned, leaving the result of
+  // the outermost one on the stack.
+  void Run();
+  auto Result() -> Value* { return operands_.back(); }
+
+ private:
+  void Push(Value* v) { operands_.push_back(v); }
+  auto Pop() -> Value* {
+    Value* v = operands_.back();
+    operands_.pop_back();
+    return v;
+  }
+  void Drop(int n) { operands_.resize(operands_.size() - n); }
+
+  auto GetCode(Statement* body) -> const Code*;
+  auto GlobalAddress(const Instruction& in) -> Address;
+  auto NameAddress(const Instruction& in) -> Address;
+  auto ElementAddress(Value* tuple, Value* offset, const Instruction& in)
+      -> Address;
+  void LeaveBlock(MachineFrame* frame);
+  // Returns a copy of the value on top of the stack from the top frame, and
+  // whether there is a frame left to run.
+  auto Return(int line_num) -> bool;
+  // Collects garbage, with the operands and frames of the machine as roots
+  // along with the globals.
+  void Collect();
+
+  // The frames from `depth_` on have returned, and are kept to be reused so
+  // that a call doesn't allocate their vectors anew.
+  std::vector<MachineFrame> frames_;
+  int depth_ = 0;
+  std::vector<Value*> operands_;
+  // Where a tail call binds its parameters before the frame's variables die,
+  // kept so that binding them doesn't allocate.
+  std::vector<Address> tail_slots_;
+  std::vector<Address> tail_locals_;
+  // The code of each function body called so far.
+  std::unordered_map<Statement*, Code> code_;
+};
+
+auto Machine::GetCode(Statement* body) -> const Code* {
+  auto it = code_.find(body);
+  if (it == code_.end()) {
+    it = code_.emplace(body, CompileFunctionBody(body)).first;
+  }
+  return &it->second;
+}
+
+void Machine::Call(Value* fun, Value* arg, int line_num) {
+  CheckAlive(fun, line_num);
+  switch (fun->tag) {
+    case ValKind::FunV: {
+      if (depth_ == static_cast<int>(frames_.size())) {
+        frames_.emplace_back();
+      }
+      MachineFrame& frame = frames_[depth_++];
+      frame.name = fun->u.fun.name;
+      frame.code = GetCode(fun->u.fun.body);
+      frame.pc = 0;
+      frame.slots.clear();
+      frame.locals.clear();
+      frame.block_starts.clear();
+      frame.temporaries.clear();
+      if (!PatternMatch(fun->u.fun.param, arg, &frame.slots, &frame.locals,
+                        line_num)) {
+        std::cerr << "internal error in call_function, pattern match failed"
+                  << std::endl;
+        exit(-1);
+      }
+      if (profiler) {
+        profiler->Enter(frame.name);
+      }
+      break;
+    }
+    case ValKind::StructTV:
+      Push(InitStruct(fun, arg, line_num));
+      break;
+    case ValKind::AltConsV:
+      Push(MakeAltVal(fun->u.alt_cons.alt_name, fun->u.alt_cons.choice_name,
+                      CopyVal(arg, line_num)));
+      break;
+    default:
+      std::cerr << line_num << ": in call, expected a function, not ";
+      PrintValue(fun, std::cerr);
+      std::cerr << std::endl;
+      exit(-1);
+  }
+}
+
+void Machine::TailCall(Value* fun, Value* arg, int line_num) {
+  CheckAlive(fun, line_num);
+  if (fun->tag != ValKind::FunV) {
+    Call(fun, arg, line_num);
+    return;
+  }
+  // The argument may be made of the caller's variables, so the parameters
+  // are bound to copies of it before those die.
+  MachineFrame& frame = frames_[depth_ - 1];
+  tail_slots_.clear();
+  tail_locals_.clear();
+  if (!PatternMatch(fun->u.fun.param, arg, &tail_slots_, &tail_locals_,
+                    line_num)) {
+    std::cerr << "internal error in call_function, pattern match failed"
+              << std::endl;
+    exit(-1);
+  }
+  for (Address a : frame.locals) {
+    KillAddress(a);
+  }
+  for (Address a : frame.temporaries) {
+    KillAddress(a);
+  }
+  frame.name = fun->u.fun.name;
+  frame.code = GetCode(fun->u.fun.body);
+  frame.pc = 0;
+  frame.slots.swap(tail_slots_);
+  frame.locals.swap(tail_locals_);
+  frame.block_starts.clear();
+  frame.temporaries.clear();
+  if (profiler) {
+    profiler->Leave();
+    profiler->Enter(frame.name);
+  }
+}
+
+auto Machine::GlobalAddress(const Instruction& in) -> Address {
+  if (in.arg < static_cast<int>(global_addresses.size())) {
+    return global_addresses[in.arg];
+  }
+  std::cerr << in.line_num << ": could not find `"
+            << *in.exp->u.variable.name << "`" << std::endl;
+  exit(-1);
+}
+
+auto Machine::NameAddress(const Instruction& in) -> Address {
+  return Lookup(in.line_num, globals, *in.exp->u.variable.name,
+                PrintErrorString);
+}
+
+auto Machine::ElementAddress(Value* tuple, Value* offset,
+                             const Instruction& in) -> Address {
+  if (tuple->tag != ValKind::TupleV) {
+    std::cerr << "runtime type error, expected a tuple in field access, not ";
+    PrintValue(tuple, std::cerr);
+    exit(-1);
+  }
+  std::string f = std::to_string(ToInteger(offset));
+  auto a = FindElement(f, in.exp->u.index.position, *tuple->u.tuple.elts);
+  if (a) {
+    return *a;
+  }
+  std::cerr << "runtime error, field " << f << " not in ";
+  PrintValue(tuple, std::cerr);
+  std::cerr << std::endl;
+  exit(-1);
+}
+
+void Machine::LeaveBlock(MachineFrame* frame) {
+  int start = frame->block_starts.back();
+  frame->block_starts.pop_back();
+  for (int i = start; i != static_cast<int>(frame->locals.size()); ++i) {
+    KillAddress(frame->locals[i]);
+  }
+  frame->locals.resize(start);
+}
+
+auto Machine::Return(int line_num) -> bool {
+  MachineFrame& frame = frames_[depth_ - 1];
+  Value* ret_val = CopyVal(Pop(), line_num);
+  for (Address a : frame.locals) {
+    KillAddress(a);
+  }
+  for (Address a : frame.temporaries) {
+    KillAddress(a);
+  }
+  frame.temporaries.clear();
+  --depth_;
+  if (profiler) {
+    profiler->Leave();
+  }
+  Push(ret_val);
+  return depth_ != 0;
+}
+
+void Machine::Collect() {
+  HeapMarker marker;
+  marker.MarkGlobals();
+  for (Value* v : operands_) {
+    marker.MarkValue(v);
+  }
+  for (int i = 0; i != depth_; ++i) {
+    for (Address a : frames_[i].slots) {
+      marker.MarkAddress(a);
+    }
+    for (Address a : frames_[i].locals) {
+      marker.MarkAddress(a);
+    }
+    for (Address a : frames_[i].temporaries) {
+      marker.MarkAddress(a);
+    }
+  }
+  marker.Trace();
+  SweepHeap(marker);
+}
+
+void Machine::Run() {
+  if (depth_ == 0) {
+    return;
+  }
+  MachineFrame* frame = &frames_[depth_ - 1];
+  const Instruction* code = frame->code->instructions.data();
+  Profiler* prof = profiler;
+  while (true) {
+    const Instruction& in = code[frame->pc++];
+    if (prof) {
+      prof->Step(in.line_num);
+    }
+    switch (in.op) {
+      case Opcode::PushInt:
+        Push(MakeIntVal(in.arg));
+        break;
+      case Opcode::PushBool:
+        Push(MakeBoolVal(in.arg));
+        break;
+      case Opcode::PushIntType:
+        Push(MakeIntTypeVal());
+        break;
+      case Opcode::PushBoolType:
+        Push(MakeBoolTypeVal());
+        break;
+      case Opcode::PushTypeType:
+        Push(MakeTypeTypeVal());
+        break;
+      case Opcode::PushAutoType:
+        Push(MakeAutoTypeVal());
+        break;
+      case Opcode::LoadLocal:
+        Push(state->heap[frame->slots[in.arg]]);
+        break;
+      case Opcode::LoadGlobal:
+        Push(state->heap[GlobalAddress(in)]);
+        break;
+      case Opcode::LoadName:
+        Push(state->heap[NameAddress(in)]);
+        break;
+      case Opcode::AddressOfLocal:
+        Push(MakePtrVal(frame->slots[in.arg]));
+        break;
+      case Opcode::AddressOfGlobal:
+        Push(MakePtrVal(GlobalAddress(in)));
+        break;
+      case Opcode::AddressOfName:
+        Push(MakePtrVal(NameAddress(in)));
+        break;
+      case Opcode::StoreLocal:
+        state->heap[frame->slots[in.arg]] = Pop();
+        break;
+      case Opcode::StoreGlobal:
+        state->heap[GlobalAddress(in)] = Pop();
+        break;
+      case Opcode::Tuple: {
+        auto& fields = *in.exp->u.tuple.fields;
+        auto elts = new TupleElements();
+        elts->reserve(in.arg);
+        Value** args = operands_.data() + operands_.size() - in.arg;
+        for (int i = 0; i != in.arg; ++i) {
+          elts->push_back(make_pair(fields[i].first, AllocateValue(args[i])));
+        }
+        Drop(in.arg);
+        Push(MakeTupleVal(elts));
+        break;
+      }
+      case Opcode::Index: {
+        Value* offset = Pop();
+        Value* tuple = Pop();
+        Push(state->heap[ElementAddress(tuple, offset, in)]);
+        break;
+      }
+      case Opcode::IndexAddress: {
+        Value* offset = Pop();
+        Value* tuple = Pop();
+        OwnElements(tuple, in.line_num);
+        Push(MakePtrVal(ElementAddress(tuple, offset, in)));
+        break;
+      }
+      case Opcode::Field: {
+        Address a = GetMember(ValToPtr(Pop(), in.line_num),
+                              *in.exp->u.get_field.field,
+                              in.exp->u.get_field.position);
+        Push(state->heap[a]);
+        break;
+      }
+      case Opcode::FieldAddress: {
+        Address ptr = ValToPtr(Pop(), in.line_num);
+        OwnElements(state->heap[ptr], in.line_num);
+        Address a = GetMember(ptr, *in.exp->u.get_field.field,
+                              in.exp->u.get_field.position);
+        Push(MakePtrVal(a));
+        break;
+      }
+      case Opcode::Temporary: {
+        Address a = AllocateValue(Pop());
+        frame->temporaries.push_back(a);
+        Push(MakePtrVal(a));
+        break;
+      }
+      case Opcode::KillTemporaries:
+        for (Address a : frame->temporaries) {
+          KillAddress(a);
+        }
+        frame->temporaries.clear();
+        break;
+      case Opcode::PrimitiveOp: {
+        Value* v = EvalPrim(in.exp->u.primitive_op.op,
+                            llvm::makeArrayRef(operands_).take_back(in.arg),
+                            in.line_num);
+        Drop(in.arg);
+        Push(v);
+        break;
+      }
+      case Opcode::Call: {
+        // Calls are where recursion allocates, so they're where garbage is
+        // collected, while the function and argument are still roots.
+        if (GarbageCollectionDue()) {
+          Collect();
+        }
+        Value* arg = Pop();
+        Value* fun = Pop();
+        Call(fun, arg, in.line_num);
+        frame = &frames_[depth_ - 1];
+        code = frame->code->instructions.data();
+        break;
+      }
+      case Opcode::TailCall: {
+        if (GarbageCollectionDue()) {
+          Collect();
+        }
+        Value* arg = Pop();
+        Value* fun = Pop();
+        TailCall(fun, arg, in.line_num);
+        // A struct or alternative is made in place of a call, and returned.
+        if (fun->tag != ValKind::FunV && !Return(in.line_num)) {
+          return;
+        }
+        frame = &frames_[depth_ - 1];
+        code = frame->code->instructions.data();
+        break;
+      }
+      case Opcode::MakeVarPattern:
+        Push(MakeVarPatVal(in.name, Pop(), in.arg));
+        break;
+      case Opcode::MakeFunctionType: {
+        Value* ret = Pop();
+        Value* param = Pop();
+        Push(MakeFunTypeVal(param, ret));
+        break;
+      }
+      case Opcode::Pop:
+        Pop();
+        break;
+      case Opcode::Bind: {
+        Value* p = Pop();
+        Value* v = Pop();
+        if (!PatternMatch(p, v, &frame->slots, &frame->locals, in.line_num)) {
+          std::cerr << in.line_num
+                    << ": internal error in variable definition, match failed"
+                    << std::endl;
+          exit(-1);
+        }
+        break;
+      }
+      case Opcode::BindLocal: {
+        Address a = AllocateValue(CopyVal(Pop(), in.line_num));
+        if (in.arg >= static_cast<int>(frame->slots.size())) {
+          frame->slots.resize(in.arg + 1);
+        }
+        frame->slots[in.arg] = a;
+        frame->locals.push_back(a);
+        break;
+      }
+      case Opcode::Assign: {
+        Value* val = Pop();
+        Value* pat = Pop();
+        PatternAssignment(pat, val, in.line_num);
+        break;
+      }
+      case Opcode::Jump:
+        // A loop goes round by jumping back, which makes that the place to
+        // collect garbage in code without calls.
+        if (in.arg < frame->pc && GarbageCollectionDue()) {
+          Collect();
+        }
+        frame->pc = in.arg;
+        break;
+      case Opcode::JumpIfFalse:
+        if (!ValToBool(Pop(), in.line_num)) {
+          frame->pc = in.arg;
+        }
+        break;
+      case Opcode::EnterBlock:
+        frame->block_starts.push_back(frame->locals.size());
+        break;
+      case Opcode::LeaveBlock:
+        LeaveBlock(frame);
+        break;
+      case Opcode::MatchClause: {
+        Value* pat = Pop();
+        int start = frame->locals.size();
+        if (PatternMatch(pat, operands_.back(), &frame->slots, &frame->locals,
+                         in.line_num)) {
+          Pop();
+          frame->block_starts.push_back(start);
+        } else {
+          // The variables bound before the match failed are dropped, as
+          // they are by the step machine.
+          frame->locals.resize(start);
+          frame->pc = in.arg;
+        }
+        break;
+      }
+      case Opcode::MatchTree: {
+        int start = frame->locals.size();
+        int clause = RunMatchTree(*in.tree, Pop(), &frame->slots,
+                                  &frame->locals, in.line_num);
+        if (clause < 0) {
+          frame->pc = in.arg;
+        } else {
+          frame->block_starts.push_back(start);
+          frame->pc += clause;
+        }
+        break;
+      }
+      case Opcode::Return:
+        if (!Return(in.line_num)) {
+          return;
+        }
+        frame = &frames_[depth_ - 1];
+        code = frame->code->instructions.data();
+        break;
+      case Opcode::FallOff:
+        std::cerr << "runtime error: fell off end of function " << *frame->name
+                  << " without `return`" << std::endl;
+        exit(-1);
+    }
+  }
+}
+
+auto RunCompiledProgram(std::list<Declaration*>* fs) -> int {
+  state = new State();  // Runtime state.
+  InitGlobals(fs);
+  Address main = Lookup(0, globals, std::string("main"), PrintErrorString);
+  Machine machine;
+  machine.Call(state->heap[main],
+               MakeTupleVal(new TupleElements()),
+               0);
+  machine.Run();
+  return ValToInt(machine.Result(), 0);
+}
+
+}  // namespace Cocktail
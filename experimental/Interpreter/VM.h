@@ -0,0 +1,17 @@
+#ifndef COCKTAIL_EXPERIMENTAL_INTERPRETER_VM_H
+#define COCKTAIL_EXPERIMENTAL_INTERPRETER_VM_H
+
+#include <list>
+
+#include "experimental/AST/Declaration.h"
+
+namespace Cocktail {
+
+// Runs the type-checked and resolved program `fs` on the bytecode machine,
+// compiling each function the first time it's called, and returns the
+// result of `main`. It behaves as `InterpProgram` does, only faster.
+auto RunCompiledProgram(std::list<Declaration*>* fs) -> int;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_EXPERIMENTAL_INTERPRETER_VM_H
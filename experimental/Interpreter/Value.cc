@@ -1,11 +1,36 @@
 #include "experimental/Interpreter/Value.h"
 
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "experimental/Interpreter/Interpreter.h"
+#include "experimental/Interpreter/Pool.h"
 
 namespace Cocktail {
 
+static thread_local Pool<Value> value_pool;
+
+auto InternName(const std::string& name) -> const std::string* {
+  // Names are interned once for all threads, as the syntax that one thread
+  // type checks may be run by another. Each thread keeps the names it has
+  // interned, so that only a name new to it takes the lock. The elements of
+  // an unordered set stay put as it grows.
+  static thread_local std::unordered_map<std::string, const std::string*> seen;
+  const std::string*& interned = seen[name];
+  if (!interned) {
+    static std::mutex mutex;
+    static std::unordered_set<std::string> names;
+    std::lock_guard<std::mutex> lock(mutex);
+    interned = &*names.insert(name).first;
+  }
+  return interned;
+}
+
 auto FindInVarValues(const std::string& field, VarValues* inits) -> Value* {
   for (auto& i : *inits) {
     if (i.first == field) {
@@ -32,8 +57,78 @@ auto FieldsEqual(VarValues* ts1, VarValues* ts2) -> bool {
   }
 }
 
+// Returns a new value, which is collected once it's unreachable.
+static auto NewValue() -> Value* {
+  auto* v = value_pool.New();
+  if (state) {
+    state->values.push_back(v);
+  }
+  return v;
+}
+
+// Returns a new shared value, which isn't collected.
+static auto NewSharedValue(ValKind tag) -> Value* {
+  auto* v = value_pool.New();
+  v->alive = true;
+  v->shared = true;
+  v->tag = tag;
+  return v;
+}
+
+// The integers from `MinImmediateInt` to `MaxImmediateInt`, the booleans and
+// the types without parts are each made once, up front, and shared by all
+// the values of them, in every thread. This is sound because values are
+// never changed once made, except when killed, and `Unshare` deals with
+// that.
+constexpr int MinImmediateInt = -1024;
+constexpr int MaxImmediateInt = 1023;
+constexpr int NumImmediateInts = MaxImmediateInt - MinImmediateInt + 1;
+// After the integers come false and true, then these types.
+constexpr ValKind ImmediateTypes[] = {ValKind::IntTV, ValKind::BoolTV,
+                                      ValKind::TypeTV, ValKind::AutoTV};
+constexpr int NumImmediates = NumImmediateInts + 2 + 4;
+
+static auto MakeImmediates() -> Value* {
+  auto* vs = new Value[NumImmediates]();
+  for (int i = 0; i != NumImmediates; ++i) {
+    vs[i].alive = true;
+    vs[i].shared = true;
+  }
+  for (int i = 0; i != NumImmediateInts; ++i) {
+    vs[i].tag = ValKind::IntV;
+    vs[i].u.integer = MinImmediateInt + i;
+  }
+  for (int b = 0; b != 2; ++b) {
+    vs[NumImmediateInts + b].tag = ValKind::BoolV;
+    vs[NumImmediateInts + b].u.boolean = b;
+  }
+  for (int t = 0; t != 4; ++t) {
+    vs[NumImmediateInts + 2 + t].tag = ImmediateTypes[t];
+  }
+  return vs;
+}
+
+static Value* const immediates = MakeImmediates();
+
+static auto ImmediateType(int t) -> Value* {
+  return &immediates[NumImmediateInts + 2 + t];
+}
+
+auto IsShared(Value* v) -> bool { return v->shared; }
+
+auto Unshare(Value* v) -> Value* {
+  auto* box = NewValue();
+  box->alive = v->alive;
+  box->tag = v->tag;
+  box->u = v->u;
+  return box;
+}
+
 auto MakeIntVal(int i) -> Value* {
-  auto* v = new Value();
+  if (MinImmediateInt <= i && i <= MaxImmediateInt) {
+    return &immediates[i - MinImmediateInt];
+  }
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::IntV;
   v->u.integer = i;
@@ -41,25 +136,22 @@ auto MakeIntVal(int i) -> Value* {
 }
 
 auto MakeBoolVal(bool b) -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::BoolV;
-  v->u.boolean = b;
-  return v;
+  return &immediates[NumImmediateInts + (b ? 1 : 0)];
 }
 
-auto MakeFunVal(std::string name, Value* param, Statement* body) -> Value* {
-  auto* v = new Value();
+auto MakeFunVal(const std::string* name, Value* param, Statement* body)
+    -> Value* {
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::FunV;
-  v->u.fun.name = new std::string(std::move(name));
+  v->u.fun.name = name;
   v->u.fun.param = param;
   v->u.fun.body = body;
   return v;
 }
 
 auto MakePtrVal(Address addr) -> Value* {
-  auto* v = new Value();
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::PtrV;
   v->u.ptr = addr;
@@ -67,7 +159,7 @@ auto MakePtrVal(Address addr) -> Value* {
 }
 
 auto MakeStructVal(Value* type, Value* inits) -> Value* {
-  auto* v = new Value();
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::StructV;
   v->u.struct_val.type = type;
@@ -75,82 +167,82 @@ auto MakeStructVal(Value* type, Value* inits) -> Value* {
   return v;
 }
 
-auto MakeTupleVal(std::vector<std::pair<std::string, Address>>* elts)
-    -> Value* {
-  auto* v = new Value();
+auto MakeTupleVal(TupleElements* elts) -> Value* {
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::TupleV;
   v->u.tuple.elts = elts;
   return v;
 }
 
-auto MakeAltVal(std::string alt_name, std::string choice_name, Value* arg)
-    -> Value* {
-  auto* v = new Value();
+auto MakeAltVal(const std::string* alt_name, const std::string* choice_name,
+                Value* arg) -> Value* {
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::AltV;
-  v->u.alt.alt_name = new std::string(std::move(alt_name));
-  v->u.alt.choice_name = new std::string(std::move(choice_name));
+  v->u.alt.alt_name = alt_name;
+  v->u.alt.choice_name = choice_name;
   v->u.alt.arg = arg;
   return v;
 }
 
-auto MakeAltCons(std::string alt_name, std::string choice_name) -> Value* {
-  auto* v = new Value();
+auto MakeAltCons(const std::string* alt_name, const std::string* choice_name)
+    -> Value* {
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::AltConsV;
-  v->u.alt.alt_name = new std::string(std::move(alt_name));
-  v->u.alt.choice_name = new std::string(std::move(choice_name));
+  v->u.alt.alt_name = alt_name;
+  v->u.alt.choice_name = choice_name;
   return v;
 }
 
-auto MakeVarPatVal(std::string name, Value* type) -> Value* {
-  auto* v = new Value();
+auto MakeVarPatVal(const std::string* name, Value* type, int slot) -> Value* {
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::VarPatV;
-  v->u.var_pat.name = new std::string(std::move(name));
+  v->u.var_pat.name = name;
   v->u.var_pat.type = type;
+  v->u.var_pat.slot = slot;
   return v;
 }
 
-auto MakeVarTypeVal(std::string name) -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::VarTV;
-  v->u.var_type = new std::string(std::move(name));
+// The types made of shared types, each made once so that types equal part
+// for part are the same value.
+static thread_local std::map<const std::string*, Value*> var_types;
+static thread_local std::map<std::pair<Value*, Value*>, Value*> function_types;
+static thread_local std::map<Value*, Value*> pointer_types;
+static thread_local std::map<
+    std::vector<std::pair<const std::string*, Value*>>, Value*>
+    tuple_types;
+
+auto MakeVarTypeVal(const std::string* name) -> Value* {
+  Value*& v = var_types[name];
+  if (!v) {
+    v = NewSharedValue(ValKind::VarTV);
+    v->u.var_type = name;
+  }
   return v;
 }
 
-auto MakeIntTypeVal() -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::IntTV;
-  return v;
-}
+auto MakeIntTypeVal() -> Value* { return ImmediateType(0); }
 
-auto MakeBoolTypeVal() -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::BoolTV;
-  return v;
-}
+auto MakeBoolTypeVal() -> Value* { return ImmediateType(1); }
 
-auto MakeTypeTypeVal() -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::TypeTV;
-  return v;
-}
+auto MakeTypeTypeVal() -> Value* { return ImmediateType(2); }
 
-auto MakeAutoTypeVal() -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::AutoTV;
-  return v;
-}
+auto MakeAutoTypeVal() -> Value* { return ImmediateType(3); }
 
 auto MakeFunTypeVal(Value* param, Value* ret) -> Value* {
-  auto* v = new Value();
+  if (param->shared && ret->shared) {
+    Value*& v = function_types[std::make_pair(param, ret)];
+    if (!v) {
+      v = NewSharedValue(ValKind::FunctionTV);
+      v->u.fun_type.param = param;
+      v->u.fun_type.ret = ret;
+    }
+    return v;
+  }
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::FunctionTV;
   v->u.fun_type.param = param;
@@ -159,51 +251,80 @@ auto MakeFunTypeVal(Value* param, Value* ret) -> Value* {
 }
 
 auto MakePtrTypeVal(Value* type) -> Value* {
-  auto* v = new Value();
+  if (type->shared) {
+    Value*& v = pointer_types[type];
+    if (!v) {
+      v = NewSharedValue(ValKind::PointerTV);
+      v->u.ptr_type.type = type;
+    }
+    return v;
+  }
+  auto* v = NewValue();
   v->alive = true;
   v->tag = ValKind::PointerTV;
   v->u.ptr_type.type = type;
   return v;
 }
 
-auto MakeStructTypeVal(std::string name, VarValues* fields, VarValues* methods)
-    -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::StructTV;
-  v->u.struct_type.name = new std::string(std::move(name));
+auto MakeStructTypeVal(const std::string* name, VarValues* fields,
+                       VarValues* methods) -> Value* {
+  auto* v = NewSharedValue(ValKind::StructTV);
+  v->u.struct_type.name = name;
   v->u.struct_type.fields = fields;
   v->u.struct_type.methods = methods;
   return v;
 }
 
 auto MakeTupleTypeVal(VarValues* fields) -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::TupleTV;
-  v->u.tuple_type.fields = fields;
+  std::vector<std::pair<const std::string*, Value*>> key;
+  for (auto& field : *fields) {
+    if (!field.second->shared) {
+      auto* v = NewValue();
+      v->alive = true;
+      v->tag = ValKind::TupleTV;
+      v->u.tuple_type.fields = fields;
+      return v;
+    }
+    key.push_back(std::make_pair(InternName(field.first), field.second));
+  }
+  Value*& v = tuple_types[key];
+  if (!v) {
+    v = NewSharedValue(ValKind::TupleTV);
+    v->u.tuple_type.fields = fields;
+  }
   return v;
 }
 
 auto MakeVoidTypeVal() -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::TupleTV;
-  v->u.tuple_type.fields = new VarValues();
-  return v;
+  static thread_local Value* const void_type =
+      MakeTupleTypeVal(new VarValues());
+  return void_type;
 }
 
-auto MakeChoiceTypeVal(std::string* name,
+auto MakeChoiceTypeVal(const std::string* name,
                        std::list<std::pair<std::string, Value*>>* alts)
     -> Value* {
-  auto* v = new Value();
-  v->alive = true;
-  v->tag = ValKind::ChoiceTV;
+  auto* v = NewSharedValue(ValKind::ChoiceTV);
   v->u.choice_type.name = name;
   v->u.choice_type.alternatives = alts;
   return v;
 }
 
+void FreeValue(Value* v) {
+  // Tuple types share their fields, and struct and choice types their
+  // fields, methods and alternatives, with the types made from them.
+  if (v->tag == ValKind::TupleV) {
+    TupleElements* elts = v->u.tuple.elts;
+    if (v->alive) {
+      --elts->live;
+    }
+    if (--elts->refs == 0) {
+      delete elts;
+    }
+  }
+  value_pool.Delete(v);
+}
+
 void PrintValue(Value* val, std::ostream& out) {
   if (!val->alive) {
     out << "!!";
@@ -310,21 +431,27 @@ void PrintValue(Value* val, std::ostream& out) {
 }
 
 auto TypeEqual(Value* t1, Value* t2) -> bool {
+  // Equal types are usually the same shared value, but they needn't be: a
+  // type may have parts that aren't shared, and tuple types are equal
+  // whatever the order of their fields.
+  if (t1 == t2) {
+    return true;
+  }
   if (t1->tag != t2->tag) {
     return false;
   }
   switch (t1->tag) {
     case ValKind::VarTV:
-      return *t1->u.var_type == *t2->u.var_type;
+      return t1->u.var_type == t2->u.var_type;
     case ValKind::PointerTV:
       return TypeEqual(t1->u.ptr_type.type, t2->u.ptr_type.type);
     case ValKind::FunctionTV:
       return TypeEqual(t1->u.fun_type.param, t2->u.fun_type.param) &&
              TypeEqual(t1->u.fun_type.ret, t2->u.fun_type.ret);
     case ValKind::StructTV:
-      return *t1->u.struct_type.name == *t2->u.struct_type.name;
+      return t1->u.struct_type.name == t2->u.struct_type.name;
     case ValKind::ChoiceTV:
-      return *t1->u.choice_type.name == *t2->u.choice_type.name;
+      return t1->u.choice_type.name == t2->u.choice_type.name;
     case ValKind::TupleTV:
       return FieldsEqual(t1->u.tuple_type.fields, t2->u.tuple_type.fields);
     case ValKind::IntTV:
@@ -380,18 +507,18 @@ auto ToInteger(Value* v) -> int {
     case ValKind::IntV:
       return v->u.integer;
     default:
-      std::cerr << "expected an integer, not ";
-      PrintValue(v, std::cerr);
-      exit(-1);
+      ErrorStream() << "expected an integer, not ";
+      PrintValue(v, ErrorStream());
+      ExitWithError();
   }
 }
 
 void CheckAlive(Value* v, int line_num) {
   if (!v->alive) {
-    std::cerr << line_num << ": undefined behavior: access to dead value ";
-    PrintValue(v, std::cerr);
-    std::cerr << std::endl;
-    exit(-1);
+    ErrorStream() << line_num << ": undefined behavior: access to dead value ";
+    PrintValue(v, ErrorStream());
+    ErrorStream() << std::endl;
+    ExitWithError();
   }
 }
 
@@ -2,6 +2,8 @@
 #define COCKTAIL_EXPERIMENTAL_INTERPRETER_VALUE_H
 
 #include <list>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "experimental/AST/Statement.h"
@@ -12,6 +14,19 @@ struct Value;
 using Address = unsigned int;
 using VarValues = std::list<std::pair<std::string, Value*>>;
 
+// The elements of a tuple, each with the address of its value. Copies of a
+// tuple share its elements, so that copying it is cheap, until the address
+// of an element is taken, which could change it.
+struct TupleElements : std::vector<std::pair<std::string, Address>> {
+  // The number of tuples sharing the elements, and of those still alive.
+  // The elements die with the last tuple alive.
+  int refs = 1;
+  int live = 1;
+  // Whether the address of an element has been taken, after which copies of
+  // the tuple copy the elements rather than share them.
+  bool exposed = false;
+};
+
 auto FindInVarValues(const std::string& field, VarValues* inits) -> Value*;
 auto FieldsEqual(VarValues* ts1, VarValues* ts2) -> bool;
 
@@ -40,11 +55,15 @@ enum class ValKind {
 struct Value {
   ValKind tag;
   bool alive;
+  // Whether the value is shared by all the values equal to it.
+  bool shared;
+  // The epoch of the last garbage collection that found the value live.
+  unsigned int gc_epoch;
   union {
     int integer;
     bool boolean;
     struct {
-      std::string* name;
+      const std::string* name;
       Value* param;
       Statement* body;
     } fun;
@@ -53,22 +72,24 @@ struct Value {
       Value* inits;
     } struct_val;
     struct {
-      std::string* alt_name;
-      std::string* choice_name;
+      const std::string* alt_name;
+      const std::string* choice_name;
     } alt_cons;
     struct {
-      std::string* alt_name;
-      std::string* choice_name;
+      const std::string* alt_name;
+      const std::string* choice_name;
       Value* arg;
     } alt;
     struct {
-      std::vector<std::pair<std::string, Address>>* elts;
+      TupleElements* elts;
     } tuple;
     Address ptr;
-    std::string* var_type;
+    const std::string* var_type;
     struct {
-      std::string* name;
+      const std::string* name;
       Value* type;
+      // The frame slot that a match binds the variable to.
+      int slot;
     } var_pat;
     struct {
       Value* param;
@@ -78,16 +99,16 @@ struct Value {
       Value* type;
     } ptr_type;
     struct {
-      std::string* name;
+      const std::string* name;
       VarValues* fields;
       VarValues* methods;
     } struct_type;
     struct {
-      std::string* name;
+      const std::string* name;
       VarValues* fields;
     } tuple_type;
     struct {
-      std::string* name;
+      const std::string* name;
       VarValues* alternatives;
     } choice_type;
     struct {
@@ -97,30 +118,51 @@ struct Value {
   } u;
 };
 
+// Returns the copy of `name` shared by all the values that use it, which
+// lives as long as the thread that interned it. The names in values are all
+// made by this, so they can be compared by address.
+auto InternName(const std::string& name) -> const std::string*;
+
+// Small integers, booleans and types are shared rather than made anew, so
+// that arithmetic on them doesn't allocate and types can be compared by
+// address. Shared values aren't collected, and mustn't be killed.
 auto MakeIntVal(int i) -> Value*;
 auto MakeBoolVal(bool b) -> Value*;
-auto MakeFunVal(std::string name, Value* param, Statement* body) -> Value*;
+auto IsShared(Value* v) -> bool;
+// Returns a copy of the shared value `v` that isn't shared, and so can be
+// killed.
+auto Unshare(Value* v) -> Value*;
+auto MakeFunVal(const std::string* name, Value* param, Statement* body)
+    -> Value*;
 auto MakePtrVal(Address addr) -> Value*;
 auto MakeStructVal(Value* type, Value* inits) -> Value*;
-auto MakeTupleVal(std::vector<std::pair<std::string, Address>>* elts) -> Value*;
-auto MakeAltVal(std::string alt_name, std::string choice_name, Value* arg)
+auto MakeTupleVal(TupleElements* elts) -> Value*;
+auto MakeAltVal(const std::string* alt_name, const std::string* choice_name,
+                Value* arg) -> Value*;
+auto MakeAltCons(const std::string* alt_name, const std::string* choice_name)
     -> Value*;
-auto MakeAltCons(std::string alt_name, std::string choice_name) -> Value*;
 
-auto MakeVarPatVal(std::string name, Value* type) -> Value*;
+auto MakeVarPatVal(const std::string* name, Value* type, int slot) -> Value*;
 
-auto MakeVarTypeVal(std::string name) -> Value*;
+// Types are shared when their parts are, and struct and choice types always
+// are, so that there's one of each per declaration.
+auto MakeVarTypeVal(const std::string* name) -> Value*;
 auto MakeIntTypeVal() -> Value*;
 auto MakeAutoTypeVal() -> Value*;
 auto MakeBoolTypeVal() -> Value*;
 auto MakeTypeTypeVal() -> Value*;
 auto MakeFunTypeVal(Value* param, Value* ret) -> Value*;
 auto MakePtrTypeVal(Value* type) -> Value*;
-auto MakeStructTypeVal(std::string name, VarValues* fields, VarValues* methods)
-    -> Value*;
+auto MakeStructTypeVal(const std::string* name, VarValues* fields,
+                       VarValues* methods) -> Value*;
 auto MakeTupleTypeVal(VarValues* fields) -> Value*;
 auto MakeVoidTypeVal() -> Value*;
-auto MakeChoiceTypeVal(std::string* name, VarValues* alts) -> Value*;
+auto MakeChoiceTypeVal(const std::string* name, VarValues* alts) -> Value*;
+
+// Frees `v`, which the garbage collector found unreachable, along with the
+// parts of it that no other value shares, keeping its memory for the values
+// made after it.
+void FreeValue(Value* v);
 
 void PrintValue(Value* val, std::ostream& out);
 
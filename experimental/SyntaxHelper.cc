@@ -3,38 +3,42 @@
 #include <iostream>
 
 #include "experimental/Interpreter/Interpreter.h"
+#include "experimental/Interpreter/Resolve.h"
 #include "experimental/Interpreter/TypeCheck.h"
+#include "experimental/Interpreter/VM.h"
 
 namespace Cocktail {
 
-char* input_filename = nullptr;
-
-void PrintSyntaxError(char* error, int line_num) {
+void PrintSyntaxError(const char* input_filename, const char* error,
+                      int line_num) {
   std::cerr << input_filename << ":" << line_num << ": " << error << std::endl;
   exit(-1);
 }
 
-void ExecProgram(std::list<Declaration*>* fs) {
-  std::cout << "********** source program **********" << std::endl;
-  for (const auto& decl : *fs) {
-    PrintDecl(decl);
+void ExecProgram(std::list<Declaration*>* fs, Profiler* prof, int jobs) {
+  if (tracing_output) {
+    std::cout << "********** source program **********" << std::endl;
+    for (const auto& decl : *fs) {
+      PrintDecl(decl);
+    }
+    std::cout << "********** type checking **********" << std::endl;
   }
-  std::cout << "********** type checking **********" << std::endl;
   state = new State();  // Compile-time state.
-  std::pair<TypeEnv*, Env*> p = TopLevel(fs);
-  TypeEnv* top = p.first;
-  Env* ct_top = p.second;
-  std::list<Declaration*> new_decls;
-  for (const auto& i : *fs) {
-    new_decls.push_back(TypeCheckDecl(i, top, ct_top));
-  }
-  std::cout << std::endl;
-  std::cout << "********** type checking complete **********" << std::endl;
-  for (const auto& decl : new_decls) {
-    PrintDecl(decl);
+  std::list<Declaration*> new_decls = TypeCheckProgram(fs, jobs);
+  ResolveProgram(&new_decls);
+  if (tracing_output) {
+    std::cout << std::endl;
+    std::cout << "********** type checking complete **********" << std::endl;
+    for (const auto& decl : new_decls) {
+      PrintDecl(decl);
+    }
+    std::cout << "********** starting execution **********" << std::endl;
   }
-  std::cout << "********** starting execution **********" << std::endl;
-  int result = InterpProgram(&new_decls);
+  // Only the program's run is profiled, not the evaluation of its types.
+  profiler = prof;
+  int result = step_mode ? InterpProgram(&new_decls)
+                         : RunCompiledProgram(&new_decls);
+  profiler = nullptr;
   std::cout << "result: " << result << std::endl;
 }
 
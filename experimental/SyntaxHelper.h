@@ -4,14 +4,17 @@
 #include <list>
 
 #include "experimental/AST/Declaration.h"
+#include "experimental/Interpreter/Profile.h"
 
 namespace Cocktail {
 
-extern char* input_filename;
+// Reports a syntax error at `line_num` of the file `input_filename`.
+void PrintSyntaxError(const char* input_filename, const char* error,
+                      int line_num);
 
-void PrintSyntaxError(char* error, int line_num);
-
-void ExecProgram(std::list<Declaration*>* fs);
+// Checks and runs the program `fs`, counting its work in `prof` if it's not
+// null. Its declarations are type checked on `jobs` threads.
+void ExecProgram(std::list<Declaration*>* fs, Profiler* prof, int jobs);
 
 }  // namespace Cocktail
 
@@ -1,23 +1,113 @@
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <list>
 
+#include "experimental/AST/Arena.h"
+#include "experimental/FromParseTree.h"
+#include "experimental/Interpreter/Interpreter.h"
 #include "experimental/SyntaxHelper.h"
 
-extern FILE* yyin;
-extern auto yyparse() -> int;  // NOLINT(readability-identifier-naming)
+// The reentrant scanner and parser made by flex and bison.
+using yyscan_t = void*;
+extern auto yylex_init(yyscan_t* scanner) -> int;
+extern void yyset_in(FILE* in, yyscan_t scanner);
+extern auto yylex_destroy(yyscan_t scanner) -> int;
+// NOLINTNEXTLINE(readability-identifier-naming)
+extern auto yyparse(yyscan_t scanner, const char* input_filename,
+                    std::list<Cocktail::Declaration*>** program) -> int;
 
 int main(int argc, char* argv[]) {
   // yydebug = 1;
 
-  if (argc > 1) {
-    Cocktail::input_filename = argv[1];
-    yyin = fopen(argv[1], "r");
-    if (yyin == nullptr) {
-      std::cerr << "Error opening '" << argv[1] << "': " << strerror(errno)
+  // With `--trace`, each step of the program's execution is printed, and
+  // otherwise only its result. `--step` runs the program on the small-step
+  // machine, which `--trace` implies, rather than compiling it to bytecode.
+  // `--profile` prints the steps, allocations and time of each function and
+  // line after the result, and `--profile-stacks=<file>` writes the steps of
+  // each chain of calls to the file, for flame graphs. `--parse-tree` reads
+  // the file in the toolchain's syntax, with the toolchain's parser.
+  // `--jobs=<n>` type checks the declarations on `n` threads.
+  bool profiling = false;
+  bool parse_tree = false;
+  const char* stacks_filename = nullptr;
+  int jobs = 1;
+  int arg = 1;
+  for (; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--trace") == 0) {
+      Cocktail::tracing_output = true;
+      Cocktail::step_mode = true;
+    } else if (strcmp(argv[arg], "--step") == 0) {
+      Cocktail::step_mode = true;
+    } else if (strcmp(argv[arg], "--profile") == 0) {
+      profiling = true;
+    } else if (strncmp(argv[arg], "--profile-stacks=", 17) == 0) {
+      stacks_filename = argv[arg] + 17;
+    } else if (strncmp(argv[arg], "--jobs=", 7) == 0) {
+      jobs = atoi(argv[arg] + 7);
+      if (jobs < 1) {
+        std::cerr << "--jobs needs a positive number of threads" << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[arg], "--parse-tree") == 0) {
+      parse_tree = true;
+    } else {
+      break;
+    }
+  }
+  if (parse_tree && arg == argc) {
+    std::cerr << "--parse-tree needs a file to read" << std::endl;
+    return 1;
+  }
+  FILE* input = stdin;
+  const char* input_filename = "<stdin>";
+  if (arg < argc && !parse_tree) {
+    input_filename = argv[arg];
+    input = fopen(argv[arg], "r");
+    if (input == nullptr) {
+      std::cerr << "Error opening '" << argv[arg] << "': " << strerror(errno)
                 << std::endl;
       return 1;
     }
   }
-  return yyparse();
+  std::ofstream stacks;
+  if (stacks_filename) {
+    stacks.open(stacks_filename);
+    if (!stacks) {
+      std::cerr << "Error opening '" << stacks_filename
+                << "': " << strerror(errno) << std::endl;
+      return 1;
+    }
+  }
+  // The program's syntax lives in `arena` until the program is done.
+  Cocktail::Arena arena;
+  Cocktail::syntax_arena = &arena;
+  std::list<Cocktail::Declaration*>* program = nullptr;
+  if (parse_tree) {
+    program = Cocktail::ParseWithToolchain(argv[arg]);
+    if (!program) {
+      return 1;
+    }
+  } else {
+    yyscan_t scanner;
+    yylex_init(&scanner);
+    yyset_in(input, scanner);
+    int status = yyparse(scanner, input_filename, &program);
+    yylex_destroy(scanner);
+    if (status != 0) {
+      return status;
+    }
+  }
+  Cocktail::Profiler profiler;
+  bool profiled = profiling || stacks_filename;
+  Cocktail::ExecProgram(program, profiled ? &profiler : nullptr, jobs);
+  if (profiling) {
+    profiler.PrintFlatProfile(std::cerr);
+  }
+  if (stacks_filename) {
+    profiler.PrintStacks(stacks);
+  }
+  return 0;
 }
\ No newline at end of file
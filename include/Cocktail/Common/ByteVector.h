@@ -0,0 +1,140 @@
+#ifndef COCKTAIL_COMMON_BYTE_VECTOR_H
+#define COCKTAIL_COMMON_BYTE_VECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MathExtras.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define COCKTAIL_BYTE_VECTORS 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COCKTAIL_BYTE_VECTORS 1
+#endif
+
+namespace Cocktail {
+
+// The handful of byte-vector operations the scanning kernels are built from,
+// so each kernel is written once for every target with vectors. A byte of a
+// comparison result is all ones where the comparison holds and zero otherwise.
+#if defined(__SSE2__)
+using ByteVector = __m128i;
+
+inline auto LoadByteVector(const char* bytes) -> ByteVector {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+}
+
+inline auto SplatByte(char c) -> ByteVector { return _mm_set1_epi8(c); }
+
+inline auto BytesEqual(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return _mm_cmpeq_epi8(lhs, rhs);
+}
+
+// SSE2 has no unsigned byte comparison, but `lhs < rhs` is the same as
+// `min(lhs, rhs - 1) == lhs`.
+inline auto BytesLessUnsigned(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return _mm_cmpeq_epi8(
+      _mm_min_epu8(lhs, _mm_sub_epi8(rhs, _mm_set1_epi8(1))), lhs);
+}
+
+inline auto BytesOr(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return _mm_or_si128(lhs, rhs);
+}
+
+inline auto BytesSub(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return _mm_sub_epi8(lhs, rhs);
+}
+
+// Returns whether any byte of `bytes` has its high bit set.
+inline auto AnyHighBit(ByteVector bytes) -> bool {
+  return _mm_movemask_epi8(bytes) != 0;
+}
+
+// Returns the number of leading bytes of `matches` that are all ones.
+inline auto CountLeadingMatches(ByteVector matches) -> int {
+  // One bit per byte that did *not* match.
+  unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matches)) ^ 0xFFFFU;
+  return mask == 0 ? 16 : llvm::countTrailingZeros(mask);
+}
+#elif defined(__ARM_NEON)
+using ByteVector = uint8x16_t;
+
+inline auto LoadByteVector(const char* bytes) -> ByteVector {
+  return vld1q_u8(reinterpret_cast<const uint8_t*>(bytes));
+}
+
+inline auto SplatByte(char c) -> ByteVector {
+  return vdupq_n_u8(static_cast<uint8_t>(c));
+}
+
+inline auto BytesEqual(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return vceqq_u8(lhs, rhs);
+}
+
+inline auto BytesLessUnsigned(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return vcltq_u8(lhs, rhs);
+}
+
+inline auto BytesOr(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return vorrq_u8(lhs, rhs);
+}
+
+inline auto BytesSub(ByteVector lhs, ByteVector rhs) -> ByteVector {
+  return vsubq_u8(lhs, rhs);
+}
+
+// Returns whether any byte of `bytes` has its high bit set.
+inline auto AnyHighBit(ByteVector bytes) -> bool {
+  uint64x2_t halves = vreinterpretq_u64_u8(bytes);
+  return ((vgetq_lane_u64(halves, 0) | vgetq_lane_u64(halves, 1)) &
+          0x8080808080808080) != 0;
+}
+
+// Returns the number of leading bytes of `matches` that are all ones.
+inline auto CountLeadingMatches(ByteVector matches) -> int {
+  // Narrow each byte to a nibble so the whole result fits in a scalar, with
+  // four bits per byte that did *not* match.
+  uint64_t mask = ~vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+  return mask == 0 ? 16 : llvm::countTrailingZeros(mask) / 4;
+}
+#endif
+
+#if COCKTAIL_BYTE_VECTORS
+// Flips every byte of a comparison result.
+inline auto BytesNot(ByteVector matches) -> ByteVector {
+  return BytesEqual(matches, SplatByte(0));
+}
+#endif
+
+// Returns the number of leading bytes of `text` accepted by `MatcherT`, which
+// provides a `Match` for single bytes and, where available, for whole
+// `ByteVector`s. Long runs are scanned a vector at a time, and anything
+// shorter than a vector is scanned byte by byte.
+template <typename MatcherT>
+auto ScanWhile(llvm::StringRef text) -> size_t {
+  const char* const begin = text.begin();
+  const char* const end = text.end();
+  const char* position = begin;
+#if COCKTAIL_BYTE_VECTORS
+  constexpr int VectorSize = sizeof(ByteVector);
+  for (; end - position >= VectorSize; position += VectorSize) {
+    int matched =
+        CountLeadingMatches(MatcherT::Match(LoadByteVector(position)));
+    if (matched != VectorSize) {
+      return (position - begin) + matched;
+    }
+  }
+#endif
+  while (position != end && MatcherT::Match(*position)) {
+    ++position;
+  }
+  return position - begin;
+}
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_COMMON_BYTE_VECTOR_H
@@ -0,0 +1,52 @@
+#ifndef COCKTAIL_COMMON_CANCELLATION_H
+#define COCKTAIL_COMMON_CANCELLATION_H
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+
+namespace Cocktail {
+
+// Asks work that has become obsolete to stop, such as lexing, parsing and
+// checking a document that has been edited again since. The work polls
+// `cancelled` every so often, and once it is, returns what it has done so far
+// marked as cancelled, which the caller throws away.
+//
+// A token is cancelled once any thread calls `Cancel`, or once its deadline,
+// if it has one, has passed.
+class CancellationToken {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  CancellationToken() = default;
+  explicit CancellationToken(Clock::time_point deadline)
+      : deadline_(deadline) {}
+
+  CancellationToken(const CancellationToken&) = delete;
+  auto operator=(const CancellationToken&) -> CancellationToken& = delete;
+
+  auto Cancel() -> void { cancelled_.store(true, std::memory_order_relaxed); }
+
+  // Returns whether the work should stop. This reads the clock when there is
+  // a deadline, so hot loops only call it every so many iterations.
+  auto cancelled() const -> bool {
+    if (cancelled_.load(std::memory_order_relaxed)) {
+      return true;
+    }
+    if (deadline_ && Clock::now() >= *deadline_) {
+      // Once passed, the deadline stays passed, so the clock needn't be read
+      // again.
+      cancelled_.store(true, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  mutable std::atomic<bool> cancelled_ = false;
+  std::optional<Clock::time_point> deadline_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_COMMON_CANCELLATION_H
@@ -1,19 +1,74 @@
 #ifndef COCKTAIL_COMMON_CHARACTER_SET_H
 #define COCKTAIL_COMMON_CHARACTER_SET_H
 
+#include <climits>
+#include <cstdint>
+
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 
 namespace Cocktail {
 
+namespace Internal {
+
+// The character classes a byte can belong to, as bits.
+enum CharacterClass : uint8_t {
+  Alpha = 1 << 0,
+  DecimalDigit = 1 << 1,
+  Underscore = 1 << 2,
+};
+
+// A precomputed table of the `CharacterClass` bits of every byte, so that
+// classifying a byte is a single load rather than a chain of range checks.
+struct CharacterClassTable {
+  constexpr CharacterClassTable() : classes() {
+    for (char c = 'a'; c <= 'z'; ++c) {
+      Add(c, Alpha);
+      Add(c - 'a' + 'A', Alpha);
+    }
+    for (char c = '0'; c <= '9'; ++c) {
+      Add(c, DecimalDigit);
+    }
+    Add('_', Underscore);
+  }
+
+  constexpr void Add(char c, CharacterClass character_class) {
+    classes[static_cast<unsigned char>(c)] |= character_class;
+  }
+
+  [[nodiscard]] constexpr auto Has(char c, uint8_t character_classes) const
+      -> bool {
+    return (classes[static_cast<unsigned char>(c)] & character_classes) != 0;
+  }
+
+  uint8_t classes[UCHAR_MAX + 1];
+};
+
+inline constexpr CharacterClassTable CharacterClasses;
+
+}  // namespace Internal
+
 // [a-zA-Z]
-inline auto IsAlpha(char c) -> bool { return llvm::isAlpha(c); }
+inline auto IsAlpha(char c) -> bool {
+  return Internal::CharacterClasses.Has(c, Internal::Alpha);
+}
 
 // [0-9]
-inline auto IsDecimalDigit(char c) -> bool { return llvm::isDigit(c); }
+inline auto IsDecimalDigit(char c) -> bool {
+  return Internal::CharacterClasses.Has(c, Internal::DecimalDigit);
+}
 
 // [a-zA-Z0-9]
-inline auto IsAlnum(char c) -> bool { return llvm::isAlnum(c); }
+inline auto IsAlnum(char c) -> bool {
+  return Internal::CharacterClasses.Has(
+      c, Internal::Alpha | Internal::DecimalDigit);
+}
+
+// [a-zA-Z0-9_]
+inline auto IsIdentifierChar(char c) -> bool {
+  return Internal::CharacterClasses.Has(
+      c, Internal::Alpha | Internal::DecimalDigit | Internal::Underscore);
+}
 
 // Note that lowercase 'a'..'f' are currently not considered hexadecimal digits
 // in any context.
@@ -14,8 +14,22 @@ namespace Cocktail {
                       << ": " #__VA_ARGS__                                  \
                       << Cocktail::Internal::ExitingStream::AddSeparator()
 
-// DCHECK calls CHECK in debug mode, and does nothing otherwise.
+// Whether DCHECKs are evaluated. By default they are in debug builds only, but
+// the build can turn them on or off explicitly, for example to measure what
+// they cost in an optimized build.
+#ifndef COCKTAIL_ENABLE_DCHECK
 #ifndef NDEBUG
+#define COCKTAIL_ENABLE_DCHECK 1
+#else
+#define COCKTAIL_ENABLE_DCHECK 0
+#endif
+#endif
+
+// DCHECK is for checks in hot paths, such as the lexer's and parser's loops
+// and the parse tree's accessors. It calls CHECK when DCHECKs are enabled.
+// Otherwise the condition and message are still compiled, so they don't rot,
+// but are never evaluated, and the whole check folds away.
+#if COCKTAIL_ENABLE_DCHECK
 #define COCKTAIL_DCHECK(...) COCKTAIL_CHECK(__VA_ARGS__)
 #else
 #define COCKTAIL_DCHECK(...) COCKTAIL_CHECK(true || (__VA_ARGS__))
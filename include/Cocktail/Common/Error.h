@@ -1,129 +1,245 @@
 #ifndef COCKTAIL_COMMON_ERROR_H
 #define COCKTAIL_COMMON_ERROR_H
 
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <new>
 #include <string>
-#include <variant>
+#include <type_traits>
+#include <utility>
 
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Common/Ostream.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/Support/Compiler.h"
 
 namespace Cocktail {
 
 struct Success {};
 
+/// 错误消息的静态描述，其地址即为消息ID。`format`中的`{0}`、`{1}`等占位符在
+/// 打印时才由错误的参数替换。
+struct ErrorMessage {
+  llvm::StringLiteral format;
+};
+
+// 定义一个错误消息，例如：
+//   COCKTAIL_ERROR_MESSAGE(WrongIndent, "Wrong indent: {0}, expected {1}");
+//   return Error(WrongIndent, line, indent);
+#define COCKTAIL_ERROR_MESSAGE(Name, Format) \
+  static constexpr ::Cocktail::ErrorMessage Name { Format }
+
+class ErrorBuilder;
+
+namespace Internal {
+
+// 一个错误参数的文本：整数转换到内部的缓冲区中，字符串直接引用。不可复制，
+// 因为`text_`可能指向自身的缓冲区。
+class ErrorArgText {
+ public:
+  template <typename T,
+            std::enable_if_t<std::is_integral_v<T> &&
+                             !std::is_same_v<T, bool>>* = nullptr>
+  ErrorArgText(T value) {
+    auto [end, ec] = std::to_chars(buffer_, buffer_ + sizeof(buffer_), value);
+    text_ = llvm::StringRef(buffer_, end - buffer_);
+  }
+
+  template <typename T, std::enable_if_t<std::is_convertible_v<
+                            const T&, llvm::StringRef>>* = nullptr>
+  ErrorArgText(const T& text) : text_(text) {}
+
+  ErrorArgText(const ErrorArgText&) = delete;
+  auto operator=(const ErrorArgText&) -> ErrorArgText& = delete;
+
+  auto text() const -> llvm::StringRef { return text_; }
+
+ private:
+  char buffer_[24];
+  llvm::StringRef text_;
+};
+
+}  // namespace Internal
+
 class [[nodiscard]] Error : public Printable<Error> {
  public:
+  // 内联存储参数文本的字节数，以及参数的最大个数。
+  static constexpr int InlineArgsSize = 40;
+  static constexpr int MaxArgs = 4;
+
   /// 生成错误状态。
-  explicit Error(llvm::Twine location, llvm::Twine message)
-      : location_(location.str()), message_(message.str()) {
-    COCKTAIL_CHECK(!message_.empty()) << "Errors must have a message.";
-  }
+  explicit Error(llvm::Twine location, llvm::Twine message);
 
   /// 生成不关联错误位置的错误状态。
   explicit Error(llvm::Twine message) : Error("", message) {}
 
-  Error(Error&& other) noexcept
-      : location_(std::move(other.location_)),
-        message_(std::move(other.message_)) {}
-
-  auto operator=(Error&& other) noexcept -> Error& {
-    location_ = std::move(other.location_);
-    message_ = std::move(other.message_);
-    return *this;
+  /// 由静态消息生成错误状态。参数是整数或字符串，其文本复制到内联缓冲区中，
+  /// 放得下时不分配内存，消息到打印时才格式化。
+  template <typename... Args>
+  explicit Error(const ErrorMessage& message, const Args&... args)
+      : Error(message, llvm::ArrayRef<Internal::ErrorArgText>(
+                           std::array<Internal::ErrorArgText, sizeof...(Args)>{
+                               args...})) {
+    static_assert(sizeof...(Args) <= MaxArgs, "Too many error arguments");
   }
 
-  auto Print(llvm::raw_ostream& out) const -> void {
-    if (!location().empty()) {
-      out << location() << ": ";
-    }
-    out << message();
-  }
+  Error(Error&& other) noexcept = default;
+  auto operator=(Error&& other) noexcept -> Error& = default;
+
+  auto Print(llvm::raw_ostream& out) const -> void;
 
   /// 返回错误位置，错误位置的描述类似于"file.cc:123"。
-  auto location() const -> const std::string& { return location_; }
+  auto location() const -> llvm::StringRef {
+    return llvm::StringRef(text_).take_front(location_size_);
+  }
+
+  /// 返回格式化后的错误信息。
+  auto message() const -> std::string;
 
-  auto message() const -> const std::string& { return message_; }
+  /// 返回静态消息，错误由文本生成时返回null。
+  auto static_message() const -> const ErrorMessage* { return static_; }
 
  private:
-  // error出现的位置。
-  std::string location_;
-  // 错误信息。
-  std::string message_;
+  friend class ErrorBuilder;
+
+  Error(const ErrorMessage& message,
+        llvm::ArrayRef<Internal::ErrorArgText> args);
+
+  // 由`location`加上消息组成的`text`生成错误状态。
+  Error(std::string text, int location_size);
+
+  // 静态消息，错误由文本生成或参数放不下时为null。
+  const ErrorMessage* static_ = nullptr;
+  // 各参数文本的结束位置和参数个数。
+  uint8_t arg_ends_[MaxArgs] = {};
+  uint8_t num_args_ = 0;
+  // 参数的文本，依次存放。
+  char args_[InlineArgsSize];
+  // 由文本生成的错误，位置在前、消息在后；`location_size_`为位置的长度。
+  std::string text_;
+  int location_size_ = 0;
 };
 
 template <typename T>
 class [[nodiscard]] ErrorOr {
  public:
-  ErrorOr(Error err) : value_(std::move(err)) {}
+  ErrorOr(Error err) : ok_(false), error_(std::move(err)) {}
+
+  ErrorOr(T value) : ok_(true), value_(std::move(value)) {}
+
+  // 成功时只移动值，错误的一侧不在热路径上。
+  ErrorOr(ErrorOr&& other) noexcept(
+      std::is_nothrow_move_constructible_v<T>)
+      : ok_(other.ok_) {
+    if (LLVM_LIKELY(ok_)) {
+      new (&value_) T(std::move(other.value_));
+    } else {
+      new (&error_) Error(std::move(other.error_));
+    }
+  }
+
+  auto operator=(ErrorOr&& other) noexcept(
+      std::is_nothrow_move_constructible_v<T>) -> ErrorOr& {
+    if (this != &other) {
+      Destroy();
+      new (this) ErrorOr(std::move(other));
+    }
+    return *this;
+  }
 
-  ErrorOr(T value) : value_(std::move(value)) {}
+  ~ErrorOr() { Destroy(); }
 
-  auto ok() const -> bool { return std::holds_alternative<T>(value_); }
+  auto ok() const -> bool { return ok_; }
 
   auto error() const& -> const Error& {
     COCKTAIL_CHECK(!ok());
-    return std::get<Error>(value_);
+    return error_;
   }
 
   auto error() && -> Error {
     COCKTAIL_CHECK(!ok());
-    return std::get<Error>(std::move(value_));
+    return std::move(error_);
   }
 
   auto operator*() -> T& {
     COCKTAIL_CHECK(ok());
-    return std::get<T>(value_);
+    return value_;
   }
 
   auto operator*() const -> const T& {
     COCKTAIL_CHECK(ok());
-    return std::get<T>(value_);
+    return value_;
   }
 
   auto operator->() -> T* {
     COCKTAIL_CHECK(ok());
-    return &std::get<T>(value_);
+    return &value_;
   }
 
   auto operator->() const -> const T* {
     COCKTAIL_CHECK(ok());
-    return &std::get<T>(value_);
+    return &value_;
   }
 
  private:
-  std::variant<Error, T> value_;
+  auto Destroy() -> void {
+    if (LLVM_LIKELY(ok_)) {
+      value_.~T();
+    } else {
+      error_.~Error();
+    }
+  }
+
+  // 为true时`value_`有效，否则`error_`有效。
+  bool ok_;
+  union {
+    T value_;
+    Error error_;
+  };
 };
 
 class ErrorBuilder {
  public:
+  // 位置和消息写入同一个字符串，转换为Error时直接移交，不再复制。
   explicit ErrorBuilder(std::string location = "")
-      : location_(std::move(location)),
-        out_(std::make_unique<llvm::raw_string_ostream>(message_)) {}
+      : text_(std::move(location)), location_size_(text_.size()) {}
 
   template <typename T>
   [[nodiscard]] auto operator<<(const T& message) && -> ErrorBuilder&& {
-    *out_ << message;
+    Append(message);
     return std::move(*this);
   }
 
   template <typename T>
   auto operator<<(const T& message) & -> ErrorBuilder& {
-    *out_ << message;
+    Append(message);
     return *this;
   }
 
-  operator Error() { return Error(location_, message_); }
+  operator Error() { return Error(std::move(text_), location_size_); }
 
   template <typename T>
   operator ErrorOr<T>() {
-    return Error(location_, message_);
+    return Error(std::move(text_), location_size_);
   }
 
  private:
-  std::string location_;
-  std::string message_;
-  std::unique_ptr<llvm::raw_string_ostream> out_;
+  template <typename T>
+  auto Append(const T& message) -> void {
+    if constexpr (std::is_convertible_v<const T&, llvm::StringRef>) {
+      text_ += llvm::StringRef(message);
+    } else {
+      // raw_string_ostream不带缓冲，直接追加到`text_`。
+      llvm::raw_string_ostream out(text_);
+      out << message;
+    }
+  }
+
+  std::string text_;
+  int location_size_;
 };
 
 }  // namespace Cocktail
@@ -160,4 +276,4 @@ class ErrorBuilder {
       COCKTAIL_MAKE_UNIQUE_NAME(_llvm_expected_line, __LINE__, __COUNTER__), \
       COCKTAIL_PROTECT_COMMAS(var), COCKTAIL_PROTECT_COMMAS(expr))
 
-#endif  // COCKTAIL_COMMON_ERROR_H
\ No newline at end of file
+#endif  // COCKTAIL_COMMON_ERROR_H
@@ -1,10 +1,14 @@
 #ifndef COCKTAIL_COMMON_INDIRECT_VALUE_H
 #define COCKTAIL_COMMON_INDIRECT_VALUE_H
 
+#include <cstddef>
 #include <memory>
+#include <new>
 #include <type_traits>
 #include <utility>
 
+#include "llvm/Support/AllocatorBase.h"
+
 namespace Cocktail {
 
 /// IndirectValue 主要用途之一是定义递归类型，防止无限嵌套。
@@ -60,6 +64,105 @@ auto CreateIndirectValue(Callable callable)
   return IndirectValue<T>(std::unique_ptr<T>(new T(callable())));
 }
 
+/// IndirectValue的只可移动版本：足够小的T存放在内联缓冲区中，否则从
+/// `AllocatorT`分配，例如传入一个llvm::BumpPtrAllocator，递归结构的每个节点
+/// 就不再各自调用malloc。移动堆上的值只转移指针，被移动后的对象为空。
+///
+/// 缓冲区大小是模板参数而不依赖sizeof(T)，因此T在声明成员时可以是不完整的
+/// 类型；递归类型包含自身的缓冲区，总是放不下，会分配在堆上。
+template <typename T, typename AllocatorT = llvm::MallocAllocator,
+          size_t InlineSize = 4 * sizeof(void*)>
+class SmallIndirectValue {
+ public:
+  /// 使用无状态的分配器（例如默认的MallocAllocator）。
+  SmallIndirectValue() : SmallIndirectValue(T()) {}
+
+  SmallIndirectValue(T value)
+      : SmallIndirectValue(StatelessAllocator(), std::move(value)) {}
+
+  /// 在`allocator`中分配，`allocator`必须比该对象活得久。
+  SmallIndirectValue(AllocatorT& allocator, T value) : allocator_(&allocator) {
+    value_ = new (Allocate()) T(std::move(value));
+  }
+
+  SmallIndirectValue(const SmallIndirectValue&) = delete;
+  auto operator=(const SmallIndirectValue&) -> SmallIndirectValue& = delete;
+
+  SmallIndirectValue(SmallIndirectValue&& other) noexcept
+      : allocator_(other.allocator_) {
+    if constexpr (FitsInline()) {
+      value_ = new (storage_) T(std::move(*other.value_));
+    } else {
+      value_ = std::exchange(other.value_, nullptr);
+    }
+  }
+
+  auto operator=(SmallIndirectValue&& other) noexcept -> SmallIndirectValue& {
+    if (this != &other) {
+      Destroy();
+      new (this) SmallIndirectValue(std::move(other));
+    }
+    return *this;
+  }
+
+  ~SmallIndirectValue() { Destroy(); }
+
+  auto operator*() -> T& { return *value_; }
+  auto operator*() const -> const T& { return *value_; }
+
+  auto operator->() -> T* { return value_; }
+  auto operator->() const -> const T* { return value_; }
+
+  auto GetPointer() -> T* { return value_; }
+  auto GetPointer() const -> const T* { return value_; }
+
+  /// 值是否存放在内联缓冲区中。
+  auto is_inline() const -> bool {
+    return value_ == reinterpret_cast<const T*>(storage_);
+  }
+
+ private:
+  static_assert(std::is_object_v<T>, "T must be an object type");
+
+  // 只在成员函数中使用，这时T已经是完整的类型。内联的值在移动时逐个移动，
+  // 因此要求其移动构造不抛出异常。
+  static constexpr auto FitsInline() -> bool {
+    return sizeof(T) <= InlineSize && alignof(T) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible_v<T>;
+  }
+
+  static auto StatelessAllocator() -> AllocatorT& {
+    static_assert(std::is_empty_v<AllocatorT>,
+                  "Allocators with state must be passed explicitly");
+    static AllocatorT allocator;
+    return allocator;
+  }
+
+  auto Allocate() -> void* {
+    if constexpr (FitsInline()) {
+      return storage_;
+    } else {
+      return allocator_->Allocate(sizeof(T), alignof(T));
+    }
+  }
+
+  auto Destroy() -> void {
+    if (value_ == nullptr) {
+      return;
+    }
+    bool was_inline = is_inline();
+    value_->~T();
+    if (!was_inline) {
+      allocator_->Deallocate(value_, sizeof(T), alignof(T));
+    }
+    value_ = nullptr;
+  }
+
+  AllocatorT* allocator_;
+  T* value_ = nullptr;
+  alignas(std::max_align_t) char storage_[InlineSize];
+};
+
 }  // namespace Cocktail
 
 #endif  // COCKTAIL_COMMON_INDIRECT_VALUE_H
\ No newline at end of file
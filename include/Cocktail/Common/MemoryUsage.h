@@ -0,0 +1,66 @@
+#ifndef COCKTAIL_COMMON_MEMORY_USAGE_H
+#define COCKTAIL_COMMON_MEMORY_USAGE_H
+
+#include <cstdint>
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+
+// The bytes each container of a data structure holds, for planning memory.
+// `used` is what the elements take and `allocated` what was allocated for
+// them, so the difference is capacity that isn't in use.
+struct MemoryUsage {
+  struct Entry {
+    llvm::StringLiteral name;
+    int64_t used = 0;
+    int64_t allocated = 0;
+  };
+
+  auto Add(llvm::StringLiteral name, int64_t used, int64_t allocated)
+      -> void {
+    entries.push_back({.name = name, .used = used, .allocated = allocated});
+  }
+
+  template <typename T, unsigned N>
+  auto Add(llvm::StringLiteral name, const llvm::SmallVector<T, N>& vector)
+      -> void {
+    Add(name, vector.size() * sizeof(T), vector.capacity() * sizeof(T));
+  }
+
+  auto Add(llvm::StringLiteral name, const llvm::BitVector& bits) -> void {
+    Add(name, (bits.size() + 7) / 8, bits.getMemorySize());
+  }
+
+  template <typename K, typename V>
+  auto Add(llvm::StringLiteral name, const llvm::DenseMap<K, V>& map)
+      -> void {
+    Add(name, map.size() * sizeof(typename llvm::DenseMap<K, V>::value_type),
+        map.getMemorySize());
+  }
+
+  [[nodiscard]] auto used_bytes() const -> int64_t {
+    int64_t bytes = 0;
+    for (const Entry& entry : entries) {
+      bytes += entry.used;
+    }
+    return bytes;
+  }
+
+  [[nodiscard]] auto allocated_bytes() const -> int64_t {
+    int64_t bytes = 0;
+    for (const Entry& entry : entries) {
+      bytes += entry.allocated;
+    }
+    return bytes;
+  }
+
+  llvm::SmallVector<Entry> entries;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_COMMON_MEMORY_USAGE_H
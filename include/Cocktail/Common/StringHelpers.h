@@ -1,10 +1,13 @@
 #ifndef COCKTAIL_COMMON_STRING_HELPERS_H
 #define COCKTAIL_COMMON_STRING_HELPERS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <string>
 
 #include "Cocktail/Common/Error.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 
 namespace Cocktail {
@@ -21,6 +24,26 @@ auto UnescapeStringLiteral(llvm::StringRef source, int hashtag_num = 0,
 auto ParseBlockStringLiteral(llvm::StringRef source, int hashtag_num = 0)
     -> ErrorOr<std::string>;
 
+/// 用于表示`ValidateUtf8`的结果。
+struct Utf8Validation {
+  // 第一个无效序列的起始偏移量，文本全部有效时为空。
+  std::optional<size_t> invalid_offset;
+  // 文本是否全部是ASCII。
+  bool is_ascii;
+};
+
+/// 检查文本是否是有效的UTF-8编码，拒绝过长编码、代理项以及超出U+10FFFF的码点。
+/// ASCII的部分会被一次检查一个向量。
+auto ValidateUtf8(llvm::StringRef text) -> Utf8Validation;
+
+/// 将`text`作为JSON字符串追加到`out`。不是有效UTF-8的文本（如含有转义字节的
+/// 字符串字面量值）会把每个非ASCII字节转义为相同值的码点。
+auto AppendJsonString(llvm::SmallVectorImpl<char>& out, llvm::StringRef text)
+    -> void;
+
+/// 将`value`的十进制表示追加到`out`。
+auto AppendInt(llvm::SmallVectorImpl<char>& out, int64_t value) -> void;
+
 /// 检查给定的指针是否在给定的`StringRef`范围内，包括与`ref.end()`相等的情况。
 auto StringRefContainsPointer(llvm::StringRef ref, const char* ptr) -> bool;
 
@@ -0,0 +1,128 @@
+#ifndef COCKTAIL_COMMON_TASK_SCHEDULER_H
+#define COCKTAIL_COMMON_TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+
+namespace Cocktail {
+
+// Runs the tasks of every concurrent stage of the compiler, from lexing and
+// parsing chunks of a file to whole files of a batch, on one set of worker
+// threads.
+//
+// Each worker has a queue of its own. Tasks spawned by a worker go on the back
+// of its queue and are run from the back, so that a task's subtasks run while
+// what they touch is still in cache. A worker whose queue is empty steals from
+// the front of another's, which is where the oldest and so usually largest
+// tasks are. Tasks spawned by other threads are queued for any worker.
+//
+// Nothing ever blocks waiting for a task: a thread that waits, whether a
+// worker or not, runs queued tasks until what it waits for is done. Tasks can
+// therefore wait for tasks of their own without tying up a worker, and a
+// stage can nest in another without either needing threads of its own.
+class TaskScheduler {
+ public:
+  // Starts `num_threads` workers, or one per hardware thread if 0.
+  explicit TaskScheduler(int num_threads = 0);
+
+  // Runs any tasks still queued, then stops the workers.
+  ~TaskScheduler();
+
+  TaskScheduler(const TaskScheduler&) = delete;
+  auto operator=(const TaskScheduler&) -> TaskScheduler& = delete;
+
+  // Queues `task` to run on some thread.
+  auto Spawn(std::function<void()> task) -> void;
+
+  // Runs queued tasks on the calling thread for as long as `busy` returns
+  // true, sleeping when there are none. `busy` is called with the scheduler's
+  // lock held, so whatever makes it return false must call `WakeWaiters`
+  // afterwards.
+  auto HelpWhile(llvm::function_ref<bool()> busy) -> void;
+
+  // Wakes the threads in `HelpWhile` to check whether they are still busy.
+  auto WakeWaiters() -> void;
+
+  auto num_threads() const -> int { return threads_.size(); }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  auto RunWorker(int index) -> void;
+
+  // Runs one queued task, preferring those of `queue_index`, returning false
+  // if there were none.
+  auto RunOne(int queue_index) -> bool;
+
+  // Returns the queue for tasks spawned on the calling thread.
+  auto CurrentQueueIndex() const -> int;
+
+  // One queue per worker, then the queue for other threads.
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // Guards sleeping and waking. `queued_` is only increased with it held, so
+  // that a thread that finds nothing queued can't miss a task being spawned.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::atomic<int> queued_ = 0;
+  bool stopping_ = false;
+};
+
+// A set of tasks spawned on a scheduler that can be waited for and cancelled
+// together, for fork/join. Once cancelled, tasks that haven't started are
+// skipped, so that a stage can give up on the rest of its work, for example
+// once the error limit is reached. Waits for its tasks when destroyed.
+class TaskGroup {
+ public:
+  explicit TaskGroup(TaskScheduler& scheduler) : scheduler_(&scheduler) {}
+  ~TaskGroup() { Wait(); }
+
+  TaskGroup(const TaskGroup&) = delete;
+  auto operator=(const TaskGroup&) -> TaskGroup& = delete;
+
+  // Spawns `task` in the group. Threads in `HelpWhile` are woken whenever one
+  // of the group's tasks finishes, so a waiter can check results of its own.
+  auto Run(std::function<void()> task) -> void;
+
+  // Runs queued tasks until every task in the group has finished or been
+  // skipped.
+  auto Wait() -> void;
+
+  // Skips the group's tasks that haven't started yet, including any run
+  // later. Tasks already running finish, but can check `cancelled` to stop
+  // early.
+  auto Cancel() -> void;
+
+  auto cancelled() const -> bool {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+  auto scheduler() const -> TaskScheduler& { return *scheduler_; }
+
+ private:
+  TaskScheduler* scheduler_;
+  std::atomic<int> pending_ = 0;
+  std::atomic<bool> cancelled_ = false;
+};
+
+// Calls `body` for each index in [0, `count`) on `scheduler`, returning once
+// every call has. The calling thread runs tasks as well, so this can be
+// called from a task.
+auto ParallelFor(TaskScheduler& scheduler, int count,
+                 llvm::function_ref<void(int index)> body) -> void;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_COMMON_TASK_SCHEDULER_H
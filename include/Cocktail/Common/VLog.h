@@ -5,11 +5,23 @@
 
 namespace Cocktail {
 
+// Whether VLOG can write anything. When it can't, `COCKTAIL_VLOG()` statements
+// are still compiled, so they don't rot, but fold away instead of testing
+// `vlog_stream_` each time.
+#ifndef COCKTAIL_ENABLE_VLOG
+#define COCKTAIL_ENABLE_VLOG 1
+#endif
+
 // For example:
 //   COCKTAIL_VLOG() << "Verbose message";
+#if COCKTAIL_ENABLE_VLOG
 #define COCKTAIL_VLOG()               \
   (vlog_stream_ == nullptr) ? (void)0 \
                             : COCKTAIL_VLOG_INTERNAL_STREAM(vlog_stream_)
+#else
+#define COCKTAIL_VLOG() \
+  true ? (void)0 : COCKTAIL_VLOG_INTERNAL_STREAM(vlog_stream_)
+#endif
 
 }  // namespace Cocktail
 
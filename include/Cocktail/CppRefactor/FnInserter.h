@@ -8,11 +8,15 @@ namespace Cocktail {
 class FnInserter : public Matcher {
  public:
   using Matcher::Matcher;
+
+ protected:
   void Run() override;
 };
 
 class FnInserterFactory : public MatcherFactoryBase<FnInserter> {
  public:
+  auto name() const -> llvm::StringRef override { return "FnInserter"; }
+
   void AddMatcher(
       clang::ast_matchers::MatchFinder* finder,
       clang::ast_matchers::MatchFinder::MatchCallback* callback) override;
@@ -8,14 +8,15 @@ namespace Cocktail {
 class ForRange : public Matcher {
  public:
   using Matcher::Matcher;
-  void Run() override;
 
- private:
-  auto GetTypeStr(const clang::VarDecl& decl) -> std::string;
+ protected:
+  void Run() override;
 };
 
 class ForRangeFactory : public MatcherFactoryBase<ForRange> {
  public:
+  auto name() const -> llvm::StringRef override { return "ForRange"; }
+
   void AddMatcher(
       clang::ast_matchers::MatchFinder* finder,
       clang::ast_matchers::MatchFinder::MatchCallback* callback) override;
@@ -7,18 +7,27 @@
 
 namespace Cocktail {
 
+// Rewrites a kind of match. A matcher is made once per translation unit and
+// run on each of the unit's matches in turn.
 class Matcher {
  public:
   using ReplacementMap = std::map<std::string, clang::tooling::Replacements>;
 
-  Matcher(const clang::ast_matchers::MatchFinder::MatchResult* in_match_result,
-          ReplacementMap* in_replacements)
-      : match_result(in_match_result), replacements(in_replacements) {}
+  explicit Matcher(ReplacementMap* in_replacements)
+      : replacements(in_replacements) {}
   virtual ~Matcher() = default;
 
-  virtual void Run() = 0;
+  // Runs the matcher on `in_match_result`, which is only valid for the call.
+  void RunOn(const clang::ast_matchers::MatchFinder::MatchResult&
+                 in_match_result) {
+    match_result = &in_match_result;
+    Run();
+    match_result = nullptr;
+  }
 
  protected:
+  virtual void Run() = 0;
+
   void AddReplacement(clang::CharSourceRange range,
                       llvm::StringRef replacement_text);
 
@@ -45,17 +54,25 @@ class Matcher {
   }
 
  private:
-  const clang::ast_matchers::MatchFinder::MatchResult* const match_result;
+  const clang::ast_matchers::MatchFinder::MatchResult* match_result = nullptr;
   ReplacementMap* const replacements;
 };
 
+// Adds the replacements of `from` to `into`. A header migrated along with the
+// files that include it gets the same replacements from each, which are only
+// added once.
+void MergeReplacements(const Matcher::ReplacementMap& from,
+                       Matcher::ReplacementMap& into);
+
 class MatcherFactory {
  public:
   virtual ~MatcherFactory() = default;
 
-  virtual auto CreateMatcher(
-      const clang::ast_matchers::MatchFinder::MatchResult* match_result,
-      Matcher::ReplacementMap* replacements) -> std::unique_ptr<Matcher> = 0;
+  // The name of the matchers made, for reporting.
+  virtual auto name() const -> llvm::StringRef = 0;
+
+  virtual auto CreateMatcher(Matcher::ReplacementMap* replacements)
+      -> std::unique_ptr<Matcher> = 0;
 
   virtual void AddMatcher(
       clang::ast_matchers::MatchFinder* finder,
@@ -65,11 +82,9 @@ class MatcherFactory {
 template <typename MatcherType>
 class MatcherFactoryBase : public MatcherFactory {
  public:
-  auto CreateMatcher(
-      const clang::ast_matchers::MatchFinder::MatchResult* match_result,
-      Matcher::ReplacementMap* replacements)
+  auto CreateMatcher(Matcher::ReplacementMap* replacements)
       -> std::unique_ptr<Matcher> override {
-    return std::make_unique<MatcherType>(match_result, replacements);
+    return std::make_unique<MatcherType>(replacements);
   }
 };
 
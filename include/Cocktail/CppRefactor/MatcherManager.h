@@ -1,12 +1,25 @@
 #ifndef COCKTAIL_CPP_REFACTOR_MATCHER_MANAGER_H
 #define COCKTAIL_CPP_REFACTOR_MATCHER_MANAGER_H
 
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "Cocktail/CppRefactor/Matcher.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Tooling/Core/Replacement.h"
 
 namespace Cocktail {
 
+// How often a registered matcher matched, and how long it took to rewrite its
+// matches.
+struct MatcherStats {
+  std::string name;
+  int64_t matches = 0;
+  std::chrono::steady_clock::duration time{};
+};
+
 // Manages registration of AST matchers.
 class MatcherManager {
  public:
@@ -21,6 +34,15 @@ class MatcherManager {
 
   auto GetFinder() -> clang::ast_matchers::MatchFinder* { return &finder; }
 
+  // Returns the stats of each matcher, in the order they were registered.
+  auto GetStats() const -> std::vector<MatcherStats> {
+    std::vector<MatcherStats> stats;
+    for (const auto& matcher : matchers) {
+      stats.push_back(matcher->stats());
+    }
+    return stats;
+  }
+
  private:
   // Adapts Matcher for use with MatchCallback.
   class MatchCallbackWrapper
@@ -31,16 +53,35 @@ class MatcherManager {
                                   Matcher::ReplacementMap* in_replacements)
         : factory(std::move(in_factory)), replacements(in_replacements) {
       factory->AddMatcher(finder, this);
+      match_stats.name = factory->name().str();
+    }
+
+    void onStartOfTranslationUnit() override {
+      matcher = factory->CreateMatcher(replacements);
     }
 
+    void onEndOfTranslationUnit() override { matcher.reset(); }
+
     void run(const clang::ast_matchers::MatchFinder::MatchResult& match_result)
         override {
-      factory->CreateMatcher(&match_result, replacements)->Run();
+      // Matches found outside of `matchAST` come without the start of a unit.
+      if (!matcher) {
+        matcher = factory->CreateMatcher(replacements);
+      }
+      auto start = std::chrono::steady_clock::now();
+      matcher->RunOn(match_result);
+      match_stats.time += std::chrono::steady_clock::now() - start;
+      ++match_stats.matches;
     }
 
+    auto stats() const -> const MatcherStats& { return match_stats; }
+
    private:
     std::unique_ptr<MatcherFactory> factory;
     Matcher::ReplacementMap* const replacements;
+    // The matcher for the current translation unit.
+    std::unique_ptr<Matcher> matcher;
+    MatcherStats match_stats;
   };
 
   Matcher::ReplacementMap* const replacements;
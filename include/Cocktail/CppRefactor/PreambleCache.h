@@ -0,0 +1,67 @@
+#ifndef COCKTAIL_CPP_REFACTOR_PREAMBLE_CACHE_H
+#define COCKTAIL_CPP_REFACTOR_PREAMBLE_CACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "clang/Frontend/PrecompiledPreamble.h"
+#include "clang/Tooling/Tooling.h"
+
+namespace Cocktail {
+
+// Precompiled preambles, the `#include`s and such at the top of a file, shared
+// by the files that start the same way and are compiled the same way. Each
+// preamble is built from the first file that needs it and kept in memory. It
+// can be shared by tools on several threads.
+class PreambleCache {
+ public:
+  // Returns the preamble for the main file of `invocation`, whose contents
+  // are `buffer`, building it if there's none yet. Returns null if the file
+  // has no preamble or it failed to build.
+  auto GetOrBuild(const clang::CompilerInvocation& invocation,
+                  const llvm::MemoryBuffer& buffer,
+                  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> vfs,
+                  std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+                  clang::DiagnosticConsumer* diag_consumer)
+      -> std::shared_ptr<const clang::PrecompiledPreamble>;
+
+  // How often a preamble was reused, and how many were built.
+  auto hits() const -> int { return hits_; }
+  auto misses() const -> int { return misses_; }
+
+ private:
+  std::mutex mutex_;
+  // Keyed by the compile command, without the main file, and the text of the
+  // preamble.
+  std::map<std::string, std::shared_ptr<const clang::PrecompiledPreamble>>
+      preambles_;
+  int hits_ = 0;
+  int misses_ = 0;
+};
+
+// Runs the actions made by a factory on each file with the file's preamble
+// from a `PreambleCache`, so that the headers it starts with are only parsed
+// once for all the files that share them.
+class PreambleReusingAction : public clang::tooling::ToolAction {
+ public:
+  PreambleReusingAction(
+      std::unique_ptr<clang::tooling::FrontendActionFactory> factory,
+      PreambleCache* cache)
+      : factory_(std::move(factory)), cache_(cache) {}
+
+  auto runInvocation(
+      std::shared_ptr<clang::CompilerInvocation> invocation,
+      clang::FileManager* files,
+      std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+      clang::DiagnosticConsumer* diag_consumer) -> bool override;
+
+ private:
+  std::unique_ptr<clang::tooling::FrontendActionFactory> factory_;
+  PreambleCache* cache_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_CPP_REFACTOR_PREAMBLE_CACHE_H
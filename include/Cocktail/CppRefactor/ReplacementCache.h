@@ -0,0 +1,56 @@
+#ifndef COCKTAIL_CPP_REFACTOR_REPLACEMENT_CACHE_H
+#define COCKTAIL_CPP_REFACTOR_REPLACEMENT_CACHE_H
+
+#include <string>
+
+#include "Cocktail/CppRefactor/Matcher.h"
+#include "Cocktail/Driver/ArtifactCache.h"
+#include "clang/Tooling/Tooling.h"
+
+namespace Cocktail {
+
+// Runs another action only on the files whose replacements aren't in an
+// `ArtifactCache` from an earlier run, and stores those it finds. The key of
+// a file's replacements is a hash of its compile command, the matchers run,
+// and the contents of every file that preprocessing it reads, so a file is
+// only matched again when it or a header it includes has changed.
+class ReplacementCachingAction : public clang::tooling::ToolAction {
+ public:
+  // Runs `action`, whose matchers add their replacements to `scratch`, on
+  // the files that miss, and adds each file's replacements, whether cached or
+  // found, to `replacements`. `scratch` must have an entry for each file that
+  // can be migrated, as the replacements map of a run does. `matcher_set`
+  // names the matchers that `action` runs.
+  ReplacementCachingAction(clang::tooling::ToolAction* action,
+                           Matcher::ReplacementMap* scratch,
+                           Matcher::ReplacementMap* replacements,
+                           ArtifactCache* cache, std::string matcher_set)
+      : action_(action),
+        scratch_(scratch),
+        replacements_(replacements),
+        cache_(cache),
+        matcher_set_(std::move(matcher_set)) {}
+
+  auto runInvocation(
+      std::shared_ptr<clang::CompilerInvocation> invocation,
+      clang::FileManager* files,
+      std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+      clang::DiagnosticConsumer* diag_consumer) -> bool override;
+
+  // How many files were skipped, and how many were matched.
+  auto hits() const -> int { return hits_; }
+  auto misses() const -> int { return misses_; }
+
+ private:
+  clang::tooling::ToolAction* action_;
+  Matcher::ReplacementMap* scratch_;
+  Matcher::ReplacementMap* replacements_;
+  ArtifactCache* cache_;
+  std::string matcher_set_;
+  int hits_ = 0;
+  int misses_ = 0;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_CPP_REFACTOR_REPLACEMENT_CACHE_H
@@ -0,0 +1,80 @@
+#ifndef COCKTAIL_CPP_REFACTOR_REPLACEMENT_WRITER_H
+#define COCKTAIL_CPP_REFACTOR_REPLACEMENT_WRITER_H
+
+#include <mutex>
+#include <string>
+
+#include "Cocktail/CppRefactor/Matcher.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// Where the replacements of a file go.
+enum class ReplacementOutput {
+  // The file is rewritten in place.
+  InPlace,
+  // A unified diff of the file's changes is printed.
+  Diff,
+  // The replacements are printed as a YAML document, as
+  // `clang-apply-replacements` reads them.
+  Yaml,
+};
+
+// Returns a unified diff, with three lines of context, of the changes that
+// `replacements` make to `code`, the contents of `path`. Returns an empty
+// string if there are none.
+auto MakeUnifiedDiff(llvm::StringRef path, llvm::StringRef code,
+                     const clang::tooling::Replacements& replacements)
+    -> std::string;
+
+// Writes the replacements of each file, once, to an output. It can be shared
+// by tools on several threads.
+class ReplacementWriter {
+ public:
+  ReplacementWriter(ReplacementOutput output, llvm::raw_ostream& out)
+      : output_(output), out_(out) {}
+
+  // Writes `replacements`, those of `path`, unless the replacements of
+  // `path` were written already. `files` reads the file. Returns false on
+  // error, which has been reported.
+  auto Write(llvm::StringRef path,
+             const clang::tooling::Replacements& replacements,
+             clang::FileManager& files) -> bool;
+
+ private:
+  ReplacementOutput output_;
+  std::mutex mutex_;
+  llvm::raw_ostream& out_;
+  llvm::StringSet<> written_;
+};
+
+// Runs another action on each file, then writes the replacements found for
+// the file and drops them, so that the replacements of every file aren't held
+// until all have been matched. Any replacements of a file found while
+// matching the files after it are dropped, as it has been written already.
+class ReplacementStreamingAction : public clang::tooling::ToolAction {
+ public:
+  // Runs `action`, which adds its replacements to `replacements`, and writes
+  // those of each main file with `writer`.
+  ReplacementStreamingAction(clang::tooling::ToolAction* action,
+                             Matcher::ReplacementMap* replacements,
+                             ReplacementWriter* writer)
+      : action_(action), replacements_(replacements), writer_(writer) {}
+
+  auto runInvocation(
+      std::shared_ptr<clang::CompilerInvocation> invocation,
+      clang::FileManager* files,
+      std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+      clang::DiagnosticConsumer* diag_consumer) -> bool override;
+
+ private:
+  clang::tooling::ToolAction* action_;
+  Matcher::ReplacementMap* replacements_;
+  ReplacementWriter* writer_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_CPP_REFACTOR_REPLACEMENT_WRITER_H
@@ -0,0 +1,21 @@
+#ifndef COCKTAIL_CPP_REFACTOR_TYPE_SPELLING_H
+#define COCKTAIL_CPP_REFACTOR_TYPE_SPELLING_H
+
+#include <string>
+
+#include "clang/AST/TypeLoc.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+
+namespace Cocktail {
+
+// Returns how the type at `type_loc` is spelled once the declarator around
+// its name is taken apart, such as `const int*` for `const int* p`, from the
+// source text of each of its parts. The spelling is written into one buffer
+// sized up front, which matters for deeply nested types.
+auto SpellType(clang::TypeLoc type_loc, const clang::SourceManager& sources,
+               const clang::LangOptions& lang_opts) -> std::string;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_CPP_REFACTOR_TYPE_SPELLING_H
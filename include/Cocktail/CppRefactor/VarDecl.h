@@ -9,14 +9,15 @@ namespace Cocktail {
 class VarDecl : public Matcher {
  public:
   using Matcher::Matcher;
-  void Run() override;
 
- private:
-  auto GetTypeStr(const clang::VarDecl& decl) -> std::string;
+ protected:
+  void Run() override;
 };
 
 class VarDeclFactory : public MatcherFactoryBase<VarDecl> {
  public:
+  auto name() const -> llvm::StringRef override { return "VarDecl"; }
+
   void AddMatcher(
       clang::ast_matchers::MatchFinder* finder,
       clang::ast_matchers::MatchFinder::MatchCallback* callback) override;
@@ -0,0 +1,127 @@
+#ifndef COCKTAIL_DIAGNOSTICS_CONCURRENT_DIAGNOSTIC_CONSUMER_H
+#define COCKTAIL_DIAGNOSTICS_CONCURRENT_DIAGNOSTIC_CONSUMER_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace Cocktail {
+
+/// 可以被多个线程同时调用的诊断消费者。
+/// 每个线程第一次调用时获得一个只属于自己的缓冲区，之后的 HandleDiagnostic
+/// 只写入该缓冲区，不需要加锁。Flush 必须在所有线程都不再报告诊断之后调用，
+/// 它把所有缓冲区中的诊断按文件名、行号和列号排序后传递给下一个消费者；位置
+/// 相同的诊断再按消息文本排序，因此输出的顺序与线程的调度无关。
+///
+/// 并发阶段只会调用下一个消费者的 ShouldStop，它必须可以被多个线程同时调用。
+class ConcurrentDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  explicit ConcurrentDiagnosticConsumer(DiagnosticConsumer& next_consumer)
+      : next_consumer_(&next_consumer) {}
+
+  ConcurrentDiagnosticConsumer(const ConcurrentDiagnosticConsumer&) = delete;
+  auto operator=(const ConcurrentDiagnosticConsumer&)
+      -> ConcurrentDiagnosticConsumer& = delete;
+
+  ~ConcurrentDiagnosticConsumer() override {
+    ThreadBuffer* buffer = buffers_.load(std::memory_order_acquire);
+    while (buffer != nullptr) {
+      COCKTAIL_CHECK(buffer->diagnostics.empty())
+          << "Must flush diagnostics consumer before destroying it";
+      delete std::exchange(buffer, buffer->next);
+    }
+  }
+
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    diagnostic.ResolveLocations();
+    GetThreadBuffer().diagnostics.push_back(std::move(diagnostic));
+  }
+
+  auto Flush() -> void override {
+    llvm::SmallVector<Diagnostic, 0> diagnostics;
+    for (ThreadBuffer* buffer = buffers_.load(std::memory_order_acquire);
+         buffer != nullptr; buffer = buffer->next) {
+      for (Diagnostic& diagnostic : buffer->diagnostics) {
+        diagnostics.push_back(std::move(diagnostic));
+      }
+      buffer->diagnostics.clear();
+    }
+    llvm::stable_sort(diagnostics, Less);
+    for (Diagnostic& diagnostic : diagnostics) {
+      next_consumer_->HandleDiagnostic(std::move(diagnostic));
+    }
+    next_consumer_->Flush();
+  }
+
+  auto ShouldStop() -> bool override { return next_consumer_->ShouldStop(); }
+
+ private:
+  // 一个线程的缓冲区。只有所属的线程会写入它，缓冲区在消费者销毁前不会被
+  // 释放，所以链表可以不加锁地遍历。
+  struct ThreadBuffer {
+    std::thread::id thread;
+    llvm::SmallVector<Diagnostic, 0> diagnostics;
+    ThreadBuffer* next = nullptr;
+  };
+
+  static auto Less(const Diagnostic& lhs, const Diagnostic& rhs) -> bool {
+    const DiagnosticLocation& lhs_location = lhs.message.location();
+    const DiagnosticLocation& rhs_location = rhs.message.location();
+    auto lhs_key = std::tie(lhs_location.file_name, lhs_location.line_number,
+                            lhs_location.column_number);
+    auto rhs_key = std::tie(rhs_location.file_name, rhs_location.line_number,
+                            rhs_location.column_number);
+    if (lhs_key != rhs_key) {
+      return lhs_key < rhs_key;
+    }
+    return lhs.message.format_fn(lhs.message) <
+           rhs.message.format_fn(rhs.message);
+  }
+
+  auto GetThreadBuffer() -> ThreadBuffer& {
+    // 记住当前线程最近一次使用的消费者和缓冲区。消费者用一个不会重复的编号
+    // 标识，以免一个新的消费者恰好分配在旧消费者的地址上。
+    thread_local uint64_t cached_id = 0;
+    thread_local ThreadBuffer* cached_buffer = nullptr;
+    if (cached_id == id_) {
+      return *cached_buffer;
+    }
+
+    std::thread::id thread = std::this_thread::get_id();
+    ThreadBuffer* head = buffers_.load(std::memory_order_acquire);
+    ThreadBuffer* buffer = head;
+    while (buffer != nullptr && buffer->thread != thread) {
+      buffer = buffer->next;
+    }
+    if (buffer == nullptr) {
+      buffer = new ThreadBuffer{.thread = thread, .next = head};
+      while (!buffers_.compare_exchange_weak(buffer->next, buffer,
+                                             std::memory_order_release,
+                                             std::memory_order_acquire)) {
+      }
+    }
+    cached_id = id_;
+    cached_buffer = buffer;
+    return *buffer;
+  }
+
+  static auto NextId() -> uint64_t {
+    static std::atomic<uint64_t> next_id = 1;
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  DiagnosticConsumer* next_consumer_;
+  const uint64_t id_ = NextId();
+  std::atomic<ThreadBuffer*> buffers_ = nullptr;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DIAGNOSTICS_CONCURRENT_DIAGNOSTIC_CONSUMER_H
@@ -0,0 +1,68 @@
+#ifndef COCKTAIL_DIAGNOSTICS_DEDUPLICATING_DIAGNOSTIC_CONSUMER_H
+#define COCKTAIL_DIAGNOSTICS_DEDUPLICATING_DIAGNOSTIC_CONSUMER_H
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+/// 丢弃与之前传递过的诊断完全相同的诊断：等级、类型、位置、消息文本以及所有
+/// 注释都相同。例如同一个文件在一次运行中被处理多次时，它的诊断只报告一次。
+///
+/// 最多记住`max_remembered`个不同的诊断，之后新的诊断直接传递而不再记住，
+/// 这样内存不会随诊断总数无限增长。
+class DeduplicatingDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  static constexpr int DefaultMaxRemembered = 1 << 16;
+
+  explicit DeduplicatingDiagnosticConsumer(
+      DiagnosticConsumer& next_consumer,
+      int max_remembered = DefaultMaxRemembered)
+      : next_consumer_(&next_consumer), max_remembered_(max_remembered) {}
+
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    llvm::SmallString<128> key;
+    key.push_back(static_cast<char>(diagnostic.level));
+    AppendKey(key, diagnostic.message);
+    for (const DiagnosticMessage& note : diagnostic.notes) {
+      AppendKey(key, note);
+    }
+    if (seen_.contains(key)) {
+      ++duplicates_;
+      return;
+    }
+    if (static_cast<int>(seen_.size()) < max_remembered_) {
+      seen_.insert(key);
+    }
+    next_consumer_->HandleDiagnostic(std::move(diagnostic));
+  }
+
+  auto Flush() -> void override { next_consumer_->Flush(); }
+
+  auto ShouldStop() -> bool override { return next_consumer_->ShouldStop(); }
+
+  // 返回被丢弃的诊断数量。
+  auto duplicates() const -> int { return duplicates_; }
+
+ private:
+  // 将消息中区分诊断的部分追加到`key`，各部分以空字符分隔。
+  static auto AppendKey(llvm::SmallVectorImpl<char>& key,
+                        const DiagnosticMessage& message) -> void {
+    const DiagnosticLocation& location = message.location();
+    llvm::raw_svector_ostream out(key);
+    out << message.kind.name() << '\0' << location.file_name << '\0'
+        << location.line_number << ':' << location.column_number << '\0'
+        << message.format_fn(message) << '\0';
+  }
+
+  DiagnosticConsumer* next_consumer_;
+  int max_remembered_;
+  llvm::StringSet<> seen_;
+  int duplicates_ = 0;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DIAGNOSTICS_DEDUPLICATING_DIAGNOSTIC_CONSUMER_H
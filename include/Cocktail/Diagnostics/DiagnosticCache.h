@@ -0,0 +1,134 @@
+#ifndef COCKTAIL_DIAGNOSTICS_DIAGNOSTIC_CACHE_H
+#define COCKTAIL_DIAGNOSTICS_DIAGNOSTIC_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Diagnostics/DiagnosticKind.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+/// 在多次编译之间保存编译流程中各个阶段的诊断和输出，使内容没有变化的文件
+/// 不必重新运行这些阶段。条目以阶段、文件名和源文本的哈希值为键，其中保存
+/// 阶段发出的诊断，以及阶段的序列化输出（例如`TokenizedBuffer::Serialize`
+/// 写出的数据）。可以被多个线程同时使用。
+class DiagnosticCache {
+ public:
+  // 编译流程中可以缓存的阶段。
+  enum class Stage : int8_t {
+    Lex,
+    Parse,
+    // 检查文件的语义，输出是文件的接口。
+    Semantics,
+  };
+
+  // 一个阶段的结果。条目是只读的，被替换之后也仍然有效。条目总是由
+  // `std::shared_ptr`持有。
+  class Entry : public std::enable_shared_from_this<Entry> {
+   public:
+    // 按原来的顺序将保存的诊断传递给`consumer`。重放的诊断引用条目中的文本，
+    // 并持有条目，因此保留诊断的消费者（例如排序）在条目被并发的`Insert`
+    // 替换后仍可以使用它们。
+    auto Replay(DiagnosticConsumer& consumer) const -> void;
+
+    // 阶段的序列化输出。
+    auto data() const -> llvm::StringRef { return data_; }
+
+    // `Serialize`写出的格式的版本。格式改变时必须增加它。
+    static constexpr uint32_t SerializationVersion = 1;
+
+    // 将条目写成可以保存在磁盘上的形式，由`Deserialize`读回。诊断种类以名字
+    // 保存，因此种类的增减不会使已有的数据被错误地读回。
+    auto Serialize(llvm::raw_ostream& out) const -> void;
+
+    // 读回`Serialize`写出的条目。数据不完整或包含未知的诊断种类时返回空指针。
+    // 读回的消息没有格式字符串，只有格式化后的文本。
+    static auto Deserialize(llvm::StringRef data)
+        -> std::shared_ptr<const Entry>;
+
+   private:
+    friend class DiagnosticCache;
+
+    // 保存的诊断消息。位置和格式化后的文本都被复制，不再引用源缓冲区或诊断
+    // 参数。
+    struct Message {
+      DiagnosticKind kind;
+      llvm::StringLiteral format;
+      std::string file_name;
+      std::string line;
+      int32_t line_number;
+      int32_t column_number;
+      std::string text;
+    };
+
+    struct StoredDiagnostic {
+      DiagnosticLevel level;
+      Message message;
+      llvm::SmallVector<Message, 0> notes;
+    };
+
+    llvm::SmallVector<StoredDiagnostic, 0> diagnostics_;
+    std::string data_;
+  };
+
+  // 在传递诊断的同时记录它们，以便之后作为条目保存。
+  class Recorder : public DiagnosticConsumer {
+   public:
+    explicit Recorder(DiagnosticConsumer& next_consumer)
+        : next_consumer_(&next_consumer) {}
+
+    auto HandleDiagnostic(Diagnostic diagnostic) -> void override;
+
+    auto Flush() -> void override { next_consumer_->Flush(); }
+
+    auto ShouldStop() -> bool override {
+      stopped_ = stopped_ || next_consumer_->ShouldStop();
+      return stopped_;
+    }
+
+    // 返回记录的诊断和`data`组成的条目。阶段因为`ShouldStop`而提前停止时，
+    // 它的输出并不完整，此时返回空指针。
+    auto Take(std::string data) -> std::shared_ptr<const Entry>;
+
+   private:
+    DiagnosticConsumer* next_consumer_;
+    Entry entry_;
+    bool stopped_ = false;
+  };
+
+  // 返回缓存的条目，没有时返回空指针。
+  auto Lookup(Stage stage, llvm::StringRef filename, uint64_t content_hash)
+      -> std::shared_ptr<const Entry>;
+
+  // 保存条目，替换同一阶段和文件已有的条目，无论其哈希值是什么：文件改变后，
+  // 旧内容的条目很少再被用到，因此长时间运行的服务不会为见过的每个版本都保留
+  // 一个条目。`entry`为空时不做任何事。
+  auto Insert(Stage stage, llvm::StringRef filename, uint64_t content_hash,
+              std::shared_ptr<const Entry> entry) -> void;
+
+  // 丢弃所有缓存的条目。
+  auto Clear() -> void;
+
+ private:
+  // 一个阶段和文件最近保存的条目，以及它的源文本的哈希值。
+  struct CachedEntry {
+    uint64_t content_hash;
+    std::shared_ptr<const Entry> entry;
+  };
+
+  static auto MakeKey(Stage stage, llvm::StringRef filename) -> std::string;
+
+  std::mutex mutex_;
+  llvm::StringMap<CachedEntry> entries_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DIAGNOSTICS_DIAGNOSTIC_CACHE_H
@@ -1,13 +1,17 @@
 #ifndef COCKTAIL_DIAGNOSTICS_DIAGNOSTIC_EMITTER_H
 #define COCKTAIL_DIAGNOSTICS_DIAGNOSTIC_EMITTER_H
 
-#include <functional>
+#include <cassert>
+#include <cstddef>
+#include <new>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Diagnostics/DiagnosticKind.h"
-#include "llvm/ADT/Any.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
@@ -41,28 +45,200 @@ struct DiagnosticLocation {
   int32_t column_number;
 };
 
+/// 可以将某个位置的某种表示形式转换为诊断位置的接口。
+template <typename LocationT>
+class DiagnosticLocationTranslator {
+ public:
+  virtual ~DiagnosticLocationTranslator() = default;
+
+  [[nodiscard]] virtual auto GetLocation(LocationT loc)
+      -> DiagnosticLocation = 0;
+
+  // 一次转换多个位置，`locations[i]` 是 `locs[i]` 的转换结果。需要转换大量位置的
+  // 调用者应该使用这个接口，实现可以借此避免对每个位置单独查找。
+  virtual auto GetLocations(llvm::ArrayRef<LocationT> locs,
+                            llvm::MutableArrayRef<DiagnosticLocation> locations)
+      -> void {
+    COCKTAIL_CHECK(locs.size() == locations.size())
+        << "mismatched number of locations";
+    for (auto [loc, location] : llvm::zip(locs, locations)) {
+      location = GetLocation(loc);
+    }
+  }
+};
+
+/// 诊断的格式化参数。参数以其类型的元组内联存储，
+/// 因此构造诊断时无需为参数分配堆内存。
+class DiagnosticFormatArgs {
+ public:
+  // 内联存储的字节数，足以容纳三个`llvm::StringRef`参数。
+  static constexpr std::size_t InlineSize = 48;
+
+  // 类型为`Args`的参数能否内联存储。
+  template <typename... Args>
+  static constexpr bool Fits =
+      sizeof(std::tuple<Args...>) <= InlineSize &&
+      alignof(std::tuple<Args...>) <= alignof(std::max_align_t);
+
+  template <typename... Args>
+  static auto Make(Args... args) -> DiagnosticFormatArgs {
+    static_assert(Fits<Args...>, "Diagnostic arguments are too large");
+    DiagnosticFormatArgs result;
+    new (result.storage_) std::tuple<Args...>(std::move(args)...);
+    result.ops_ = &OpsFor<Args...>;
+    return result;
+  }
+
+  DiagnosticFormatArgs(const DiagnosticFormatArgs& other) : ops_(other.ops_) {
+    ops_->copy(storage_, other.storage_);
+  }
+  DiagnosticFormatArgs(DiagnosticFormatArgs&& other) noexcept
+      : ops_(other.ops_) {
+    ops_->move(storage_, other.storage_);
+  }
+  auto operator=(const DiagnosticFormatArgs& other) -> DiagnosticFormatArgs& {
+    if (this != &other) {
+      ops_->destroy(storage_);
+      ops_ = other.ops_;
+      ops_->copy(storage_, other.storage_);
+    }
+    return *this;
+  }
+  auto operator=(DiagnosticFormatArgs&& other) noexcept
+      -> DiagnosticFormatArgs& {
+    if (this != &other) {
+      ops_->destroy(storage_);
+      ops_ = other.ops_;
+      ops_->move(storage_, other.storage_);
+    }
+    return *this;
+  }
+  ~DiagnosticFormatArgs() { ops_->destroy(storage_); }
+
+  // 返回参数。`Args`必须是构造时的参数类型。
+  template <typename... Args>
+  auto Get() const -> const std::tuple<Args...>& {
+    assert(ops_ == &OpsFor<Args...> && "Mismatched diagnostic argument types");
+    return *std::launder(
+        reinterpret_cast<const std::tuple<Args...>*>(storage_));
+  }
+
+ private:
+  // 对存储中的参数元组进行复制、移动和销毁的操作。
+  struct Ops {
+    void (*copy)(void* to, const void* from);
+    void (*move)(void* to, void* from);
+    void (*destroy)(void* storage);
+  };
+
+  template <typename... Args>
+  static constexpr Ops OpsFor = {
+      .copy =
+          [](void* to, const void* from) {
+            using Tuple = std::tuple<Args...>;
+            new (to) Tuple(*static_cast<const Tuple*>(from));
+          },
+      .move =
+          [](void* to, void* from) {
+            using Tuple = std::tuple<Args...>;
+            new (to) Tuple(std::move(*static_cast<Tuple*>(from)));
+          },
+      .destroy =
+          [](void* storage) {
+            using Tuple = std::tuple<Args...>;
+            static_cast<Tuple*>(storage)->~Tuple();
+          },
+  };
+
+  DiagnosticFormatArgs() : ops_(&OpsFor<>) { new (storage_) std::tuple<>(); }
+
+  alignas(std::max_align_t) char storage_[InlineSize];
+  const Ops* ops_;
+};
+
 /// 用于表示一个诊断消息。
 struct DiagnosticMessage {
+  // 返回格式化字符串的函数。
+  using FormatFnType = auto (*)(const DiagnosticMessage& message)
+      -> std::string;
+
+  explicit DiagnosticMessage(DiagnosticKind kind, DiagnosticLocation location,
+                             llvm::StringLiteral format,
+                             DiagnosticFormatArgs format_args,
+                             FormatFnType format_fn)
+      : kind(kind),
+        format(format),
+        format_args(std::move(format_args)),
+        format_fn(format_fn),
+        location_(location) {}
+
+  // 保留发出诊断时的位置`location`，直到第一次请求时才用`translator`转换。
+  // 无法内联存储的位置类型则立即转换。
+  template <typename LocationT>
   explicit DiagnosticMessage(
-      DiagnosticKind kind, DiagnosticLocation location,
-      llvm::StringLiteral format, llvm::SmallVector<llvm::Any> format_args,
-      std::function<std::string(const DiagnosticMessage&)> format_fn)
+      DiagnosticKind kind, DiagnosticLocationTranslator<LocationT>& translator,
+      LocationT location, llvm::StringLiteral format,
+      DiagnosticFormatArgs format_args, FormatFnType format_fn)
       : kind(kind),
-        location(location),
         format(format),
         format_args(std::move(format_args)),
-        format_fn(std::move(format_fn)) {}
+        format_fn(format_fn),
+        location_({}) {
+    if constexpr (std::is_trivially_copyable_v<LocationT> &&
+                  sizeof(LocationT) <= sizeof(unresolved_location_) &&
+                  alignof(LocationT) <= alignof(void*)) {
+      resolve_fn_ = &ResolveFn<LocationT>;
+      translator_ = &translator;
+      new (unresolved_location_) LocationT(location);
+    } else {
+      location_ = translator.GetLocation(location);
+    }
+  }
+
+  // 返回诊断位置。位置在第一次请求时才转换，因此只统计或丢弃诊断的消费者
+  // 不必付出转换的代价。
+  auto location() const -> const DiagnosticLocation& {
+    if (resolve_fn_ != nullptr) {
+      location_ = resolve_fn_(translator_, unresolved_location_);
+      resolve_fn_ = nullptr;
+    }
+    return location_;
+  }
+
+  // 转换诊断位置并返回以供修改。转换器只在`HandleDiagnostic`期间有效，
+  // 因此在其返回后仍保留诊断的消费者必须先调用此函数。
+  auto ResolveLocation() -> DiagnosticLocation& {
+    location();
+    return location_;
+  }
 
   // 诊断类型。
   DiagnosticKind kind;
-  // 诊断位置。
-  DiagnosticLocation location;
   // 诊断的格式字符串。这将与format_args一起传递给format_fn。
   llvm::StringLiteral format;
-  // 格式化参数列表。
-  llvm::SmallVector<llvm::Any> format_args;
+  // 格式化参数。
+  DiagnosticFormatArgs format_args;
   // 返回格式化字符串。默认情况下使用llvm::formatv。
-  std::function<std::string(const DiagnosticMessage&)> format_fn;
+  FormatFnType format_fn;
+
+ private:
+  // 用转换器转换尚未转换的位置。
+  using ResolveFnType = auto (*)(void* translator, const void* location)
+      -> DiagnosticLocation;
+
+  template <typename LocationT>
+  static auto ResolveFn(void* translator, const void* location)
+      -> DiagnosticLocation {
+    return static_cast<DiagnosticLocationTranslator<LocationT>*>(translator)
+        ->GetLocation(*std::launder(static_cast<const LocationT*>(location)));
+  }
+
+  // 诊断位置，在`resolve_fn_`非空时尚未转换。
+  mutable DiagnosticLocation location_;
+  mutable ResolveFnType resolve_fn_ = nullptr;
+  void* translator_ = nullptr;
+  // 尚未转换的位置，足以容纳一个`llvm::StringRef`。
+  alignas(void*) char unresolved_location_[2 * sizeof(void*)] = {};
 };
 
 /// 用于表示一个完整的诊断，包括级别、主消息和附加注释。
@@ -73,6 +249,15 @@ struct Diagnostic {
   DiagnosticMessage message;
   // 向诊断添加上下文或补充信息的说明。
   llvm::SmallVector<DiagnosticMessage> notes;
+
+  // 转换主消息和所有注释的位置。在`HandleDiagnostic`返回后仍保留诊断的消费者
+  // 必须先调用此函数。
+  auto ResolveLocations() -> void {
+    message.ResolveLocation();
+    for (DiagnosticMessage& note : notes) {
+      note.ResolveLocation();
+    }
+  }
 };
 
 /// 接收发出的诊断信息。
@@ -83,36 +268,38 @@ class DiagnosticConsumer {
   // 用于处理一个诊断（错误、警告或注释）。
   //
   // 诊断对象目前是在栈上分配的，因此它们的生命周期是`HandleDiagnostic`函数的生命周期。
+  // 诊断的位置也只能在此期间转换，需要保留诊断的消费者应先调用`ResolveLocations`。
   // `SortingDiagnosticConsumer`类需要更长的诊断对象生命周期，直到所有诊断信息已生成。
   // 目前没有持久地存储诊断，因为在集成开发环境（IDE）中，通常是立即打印并丢弃诊断。
   virtual auto HandleDiagnostic(Diagnostic diagnostic) -> void = 0;
 
   // 用于刷新任何缓冲的输入。
   virtual auto Flush() -> void {}
-};
-
-/// 可以将某个位置的某种表示形式转换为诊断位置的接口。
-template <typename LocationT>
-class DiagnosticLocationTranslator {
- public:
-  virtual ~DiagnosticLocationTranslator() = default;
 
-  [[nodiscard]] virtual auto GetLocation(LocationT loc)
-      -> DiagnosticLocation = 0;
+  // 返回是否应尽早停止产生诊断的工作，例如已经超出了错误预算。
+  // 词法分析器和解析器在发出诊断后检查它，并跳过其余的输入。
+  virtual auto ShouldStop() -> bool { return false; }
 };
 
 namespace Internal {
 
 template <typename... Args>
 struct DiagnosticBase {
+  static_assert(DiagnosticFormatArgs::Fits<Args...>,
+                "Diagnostic arguments are too large to store inline");
+
   explicit constexpr DiagnosticBase(DiagnosticKind kind, DiagnosticLevel level,
                                     llvm::StringLiteral format)
       : Kind(kind), Level(level), Format(format) {}
 
   // 使用诊断参数调用formatv。
-  auto FormatFn(const DiagnosticMessage& message) const -> std::string {
-    return FormatFnImpl(message, std::make_index_sequence<sizeof...(Args)>());
-  };
+  static auto FormatFn(const DiagnosticMessage& message) -> std::string {
+    return std::apply(
+        [&](const Args&... args) -> std::string {
+          return llvm::formatv(message.format.data(), args...);
+        },
+        message.format_args.Get<Args...>());
+  }
 
   // 诊断类型。
   DiagnosticKind Kind;
@@ -120,17 +307,6 @@ struct DiagnosticBase {
   DiagnosticLevel Level;
   // llvm::formatv的诊断格式。
   llvm::StringLiteral Format;
-
- private:
-  // 处理llvm::Any转换为formatv的Args类型。
-  template <std::size_t... N>
-  inline auto FormatFnImpl(const DiagnosticMessage& message,
-                           std::index_sequence<N...> /*indices*/) const
-      -> std::string {
-    assert(message.format_args.size() == sizeof...(Args));
-    return llvm::formatv(message.format.data(),
-                         llvm::any_cast<Args>(message.format_args[N])...);
-  }
 };
 
 // 禁用基于' args '的类型推导。
@@ -163,8 +339,9 @@ class DiagnosticEmitter {
               Internal::NoTypeDeduction<Args>... args) -> DiagnosticBuilder& {
       COCKTAIL_CHECK(diagnostic_base.Level == DiagnosticLevel::Note)
           << static_cast<int>(diagnostic_base.Level);
-      diagnostic_.notes.push_back(MakeMessage(
-          emitter_, location, diagnostic_base, {llvm::Any(args)...}));
+      diagnostic_.notes.push_back(
+          MakeMessage(emitter_, location, diagnostic_base,
+                      DiagnosticFormatArgs::Make<Args...>(args...)));
       return *this;
     }
 
@@ -184,7 +361,7 @@ class DiagnosticEmitter {
     explicit DiagnosticBuilder(
         DiagnosticEmitter<LocationT>* emitter, LocationT location,
         const Internal::DiagnosticBase<Args...>& diagnostic_base,
-        llvm::SmallVector<llvm::Any> args)
+        DiagnosticFormatArgs args)
         : emitter_(emitter),
           diagnostic_(
               {.level = diagnostic_base.Level,
@@ -197,13 +374,11 @@ class DiagnosticEmitter {
     static auto MakeMessage(
         DiagnosticEmitter<LocationT>* emitter, LocationT location,
         const Internal::DiagnosticBase<Args...>& diagnostic_base,
-        llvm::SmallVector<llvm::Any> args) -> DiagnosticMessage {
+        DiagnosticFormatArgs args) -> DiagnosticMessage {
       return DiagnosticMessage(
-          diagnostic_base.Kind, emitter->translator_->GetLocation(location),
+          diagnostic_base.Kind, *emitter->translator_, location,
           diagnostic_base.Format, std::move(args),
-          [&diagnostic_base](const DiagnosticMessage& message) -> std::string {
-            return diagnostic_base.FormatFn(message);
-          });
+          &Internal::DiagnosticBase<Args...>::FormatFn);
     }
 
     DiagnosticEmitter<LocationT>* emitter_;
@@ -221,7 +396,8 @@ class DiagnosticEmitter {
   auto Emit(LocationT location,
             const Internal::DiagnosticBase<Args...>& diagnostic_base,
             Internal::NoTypeDeduction<Args>... args) -> void {
-    DiagnosticBuilder(this, location, diagnostic_base, {llvm::Any(args)...})
+    DiagnosticBuilder(this, location, diagnostic_base,
+                      DiagnosticFormatArgs::Make<Args...>(args...))
         .Emit();
   }
 
@@ -231,9 +407,12 @@ class DiagnosticEmitter {
              const Internal::DiagnosticBase<Args...>& diagnostic_base,
              Internal::NoTypeDeduction<Args>... args) -> DiagnosticBuilder {
     return DiagnosticBuilder(this, location, diagnostic_base,
-                             {llvm::Any(args)...});
+                             DiagnosticFormatArgs::Make<Args...>(args...));
   }
 
+  // 返回诊断消费者是否要求尽早停止。
+  auto ShouldStop() -> bool { return consumer_->ShouldStop(); }
+
  private:
   // 在其中执行诊断注释的作用域的基类，例如添加带有上下文信息的注释。
   class DiagnosticAnnotationScopeBase {
@@ -281,17 +460,18 @@ class StreamDiagnosticConsumer : public DiagnosticConsumer {
     }
   }
   auto Print(const DiagnosticMessage& message) -> void {
-    *stream_ << message.location.file_name;
-    if (message.location.line_number > 0) {
-      *stream_ << ":" << message.location.line_number;
-      if (message.location.column_number > 0) {
-        *stream_ << ":" << message.location.column_number;
+    const DiagnosticLocation& location = message.location();
+    *stream_ << location.file_name;
+    if (location.line_number > 0) {
+      *stream_ << ":" << location.line_number;
+      if (location.column_number > 0) {
+        *stream_ << ":" << location.column_number;
       }
     }
     *stream_ << ": " << message.format_fn(message) << "\n";
-    if (message.location.column_number > 0) {
-      *stream_ << message.location.line << "\n";
-      stream_->indent(message.location.column_number - 1);
+    if (location.column_number > 0) {
+      *stream_ << location.line << "\n";
+      stream_->indent(location.column_number - 1);
       *stream_ << "^\n";
     }
   }
@@ -315,17 +495,28 @@ class ErrorTrackingDiagnosticConsumer : public DiagnosticConsumer {
   auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
     seen_error_ |= diagnostic.level == DiagnosticLevel::Error;
     next_consumer_->HandleDiagnostic(std::move(diagnostic));
+    stop_requested_ = stop_requested_ || next_consumer_->ShouldStop();
   }
 
+  auto ShouldStop() -> bool override { return next_consumer_->ShouldStop(); }
+
   // 重置错误跟踪状态。
-  auto Reset() -> void { seen_error_ = false; }
+  auto Reset() -> void {
+    seen_error_ = false;
+    stop_requested_ = false;
+  }
 
   // 返回自上次重置以来是否看到了错误。
   auto seen_error() const -> bool { return seen_error_; }
 
+  // 返回自上次重置以来，下一个消费者是否在处理某个诊断后要求停止。
+  // 这只在处理诊断时询问，因此热循环可以每次迭代都检查它。
+  auto stop_requested() const -> bool { return stop_requested_; }
+
  private:
   DiagnosticConsumer* next_consumer_;
   bool seen_error_ = false;
+  bool stop_requested_ = false;
 };
 
 /// 这是一个 RAII对象，用于标记在其作用范围内应以某种方式注释任何生成的诊断。
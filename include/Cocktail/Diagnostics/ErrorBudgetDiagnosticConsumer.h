@@ -0,0 +1,105 @@
+#ifndef COCKTAIL_DIAGNOSTICS_ERROR_BUDGET_DIAGNOSTIC_CONSUMER_H
+#define COCKTAIL_DIAGNOSTICS_ERROR_BUDGET_DIAGNOSTIC_CONSUMER_H
+
+#include <array>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Diagnostics/DiagnosticKind.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+
+/// 限制传递给下一个消费者的诊断数量。
+/// 错误总数和每种诊断类型的数量都可以设置上限，超出上限的诊断会被丢弃，
+/// 而不会被格式化或缓冲。错误总数达到上限后，`ShouldStop`会要求词法分析器
+/// 和解析器跳过其余的输入，这样一个损坏的文件不会无限制地耗费时间和内存。
+/// 被丢弃的诊断数量在`Flush`时以一条诊断报告。
+class ErrorBudgetDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  // 表示没有上限。
+  static constexpr int Unlimited = -1;
+
+  explicit ErrorBudgetDiagnosticConsumer(DiagnosticConsumer& next_consumer,
+                                         int max_errors = Unlimited)
+      : next_consumer_(&next_consumer), max_errors_(max_errors) {
+    kind_limits_.fill(Unlimited);
+    kind_counts_.fill(0);
+  }
+
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    int kind_index = KindIndex(diagnostic.message.kind);
+    int kind_limit = kind_limits_[kind_index];
+    if (ShouldStop() ||
+        (kind_limit != Unlimited && kind_counts_[kind_index] >= kind_limit)) {
+      if (suppressed_ == 0) {
+        suppressed_file_name_ = diagnostic.message.location().file_name;
+      }
+      ++suppressed_;
+      return;
+    }
+    ++kind_counts_[kind_index];
+    if (diagnostic.level == DiagnosticLevel::Error) {
+      ++errors_;
+    }
+    next_consumer_->HandleDiagnostic(std::move(diagnostic));
+  }
+
+  // 刷新下一个消费者，然后报告被丢弃的诊断数量，使其出现在所有诊断之后。
+  auto Flush() -> void override {
+    next_consumer_->Flush();
+    if (suppressed_ == 0) {
+      return;
+    }
+    COCKTAIL_DIAGNOSTIC(DiagnosticsSuppressed, Note,
+                        "{0} more diagnostic(s) suppressed by error limits.",
+                        int);
+    next_consumer_->HandleDiagnostic(
+        {.level = DiagnosticsSuppressed.Level,
+         .message = DiagnosticMessage(
+             DiagnosticsSuppressed.Kind,
+             {.file_name = suppressed_file_name_,
+              .line_number = 0,
+              .column_number = 0},
+             DiagnosticsSuppressed.Format,
+             DiagnosticFormatArgs::Make<int>(suppressed_),
+             &decltype(DiagnosticsSuppressed)::FormatFn)});
+    suppressed_ = 0;
+    next_consumer_->Flush();
+  }
+
+  // 返回错误总数是否已达到上限。
+  auto ShouldStop() -> bool override {
+    return max_errors_ != Unlimited && errors_ >= max_errors_;
+  }
+
+  // 设置传递给下一个消费者的`kind`类型诊断数量的上限。
+  auto SetKindLimit(DiagnosticKind kind, int limit) -> void {
+    kind_limits_[KindIndex(kind)] = limit;
+  }
+
+  // 返回被丢弃的、尚未在`Flush`时报告的诊断数量。
+  auto suppressed() const -> int { return suppressed_; }
+
+ private:
+  static auto KindIndex(DiagnosticKind kind) -> int {
+    return static_cast<int>(static_cast<DiagnosticKind::RawEnumType>(kind));
+  }
+
+  static constexpr int NumKinds = 0
+#define COCKTAIL_DIAGNOSTIC_KIND(Name) +1
+#include "Cocktail/Diagnostics/DiagnosticKind.def"
+      ;
+
+  DiagnosticConsumer* next_consumer_;
+  int max_errors_;
+  int errors_ = 0;
+  int suppressed_ = 0;
+  // 第一个被丢弃的诊断所在的文件，用于报告丢弃的数量。
+  llvm::StringRef suppressed_file_name_;
+  std::array<int, NumKinds> kind_limits_;
+  std::array<int, NumKinds> kind_counts_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DIAGNOSTICS_ERROR_BUDGET_DIAGNOSTIC_CONSUMER_H
@@ -1,9 +1,13 @@
 #ifndef COCKTAIL_DIAGNOSTICS_SORTING_DIAGNOSTIC_CONSUMER_H
 #define COCKTAIL_DIAGNOSTICS_SORTING_DIAGNOSTIC_CONSUMER_H
 
+#include <algorithm>
+#include <tuple>
+
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
 
 namespace Cocktail {
 
@@ -11,6 +15,11 @@ namespace Cocktail {
 /// 它在接收诊断信息时将其缓冲起来，然后在调用 Flush 函数时对诊断信息
 /// 进行排序并传递给下一个消费者。这样可以确保诊断信息按位置信息排序，
 /// 以便更容易理解和定位问题。
+///
+/// 诊断信息通常几乎按顺序到达，因此缓冲区被记录为若干个已排序的段（run），
+/// 排序时只需稳定地归并这些段。若调用者知道之后不会再有某一行之前的诊断
+/// 信息，可以调用 FlushBefore 提前输出该行之前的诊断信息，使缓冲区只保留
+/// 水位线之后的部分。
 class SortingDiagnosticConsumer : public DiagnosticConsumer {
  public:
   explicit SortingDiagnosticConsumer(DiagnosticConsumer& next_consumer)
@@ -22,31 +31,87 @@ class SortingDiagnosticConsumer : public DiagnosticConsumer {
   }
 
   auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    diagnostic.ResolveLocations();
+    // 已经输出过的行不会再排序，直接传递给下一个消费者。
+    if (diagnostic.message.location().line_number < watermark_) {
+      next_consumer_->HandleDiagnostic(std::move(diagnostic));
+      return;
+    }
+    // 与上一条诊断信息逆序时开始一个新的段。
+    if (!diagnostics_.empty() && Less(diagnostic, diagnostics_.back())) {
+      run_begins_.push_back(diagnostics_.size());
+    }
     diagnostics_.push_back(std::move(diagnostic));
   }
 
   // Flush负责对缓冲的诊断信息进行排序和输出。
   void Flush() override {
-    // 依据诊断信息中的位置信息（行号和列号）排序。
-    llvm::stable_sort(diagnostics_,
-                      [](const Diagnostic& lhs, const Diagnostic& rhs) {
-                        return std::tie(lhs.message.location.line_number,
-                                        lhs.message.location.column_number) <
-                               std::tie(rhs.message.location.line_number,
-                                        rhs.message.location.column_number);
-                      });
+    MergeRuns();
     // 责任链机制，确定了下一个处理者是谁。
     for (auto& diag : diagnostics_) {
       next_consumer_->HandleDiagnostic(std::move(diag));
     }
     diagnostics_.clear();
+    watermark_ = 0;
+    next_consumer_->Flush();
+  }
+
+  // 输出 line_number 行之前的全部诊断信息。调用者保证之后不会再有该行之前的
+  // 诊断信息；若仍有，则不经排序直接传递。
+  auto FlushBefore(int line_number) -> void {
+    watermark_ = std::max(watermark_, line_number);
+    MergeRuns();
+    auto* end = std::partition_point(
+        diagnostics_.begin(), diagnostics_.end(), [&](const Diagnostic& diag) {
+          return diag.message.location().line_number < watermark_;
+        });
+    for (auto* it = diagnostics_.begin(); it != end; ++it) {
+      next_consumer_->HandleDiagnostic(std::move(*it));
+    }
+    diagnostics_.erase(diagnostics_.begin(), end);
   }
 
+  auto ShouldStop() -> bool override { return next_consumer_->ShouldStop(); }
+
  private:
+  // 依据诊断信息中的位置信息（行号和列号）比较。
+  static auto Less(const Diagnostic& lhs, const Diagnostic& rhs) -> bool {
+    return std::tie(lhs.message.location().line_number,
+                    lhs.message.location().column_number) <
+           std::tie(rhs.message.location().line_number,
+                    rhs.message.location().column_number);
+  }
+
+  // 两两归并相邻的段，直到只剩一个。归并是稳定的，位置相同的诊断信息保持
+  // 到达的顺序。
+  auto MergeRuns() -> void {
+    while (!run_begins_.empty()) {
+      llvm::SmallVector<size_t, 16> merged;
+      size_t begin = 0;
+      for (size_t i = 0; i < run_begins_.size(); i += 2) {
+        size_t middle = run_begins_[i];
+        size_t end = i + 1 < run_begins_.size() ? run_begins_[i + 1]
+                                                : diagnostics_.size();
+        std::inplace_merge(diagnostics_.begin() + begin,
+                           diagnostics_.begin() + middle,
+                           diagnostics_.begin() + end, Less);
+        if (end != diagnostics_.size()) {
+          merged.push_back(end);
+        }
+        begin = end;
+      }
+      run_begins_ = std::move(merged);
+    }
+  }
+
   llvm::SmallVector<Diagnostic, 0> diagnostics_;
+  // 除第一个段外，每个已排序段在 diagnostics_ 中的起始下标。
+  llvm::SmallVector<size_t, 16> run_begins_;
+  // FlushBefore 已经输出到的行。
+  int watermark_ = 0;
   DiagnosticConsumer* next_consumer_;
 };
 
 }  // namespace Cocktail
 
-#endif  // COCKTAIL_DIAGNOSTICS_SORTING_DIAGNOSTIC_CONSUMER_H
\ No newline at end of file
+#endif  // COCKTAIL_DIAGNOSTICS_SORTING_DIAGNOSTIC_CONSUMER_H
@@ -0,0 +1,68 @@
+#ifndef COCKTAIL_DIAGNOSTICS_STRUCTURED_DIAGNOSTIC_CONSUMER_H
+#define COCKTAIL_DIAGNOSTICS_STRUCTURED_DIAGNOSTIC_CONSUMER_H
+
+#include <cstdint>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+/// 将诊断信息以便于程序读取的形式输出到一个流中，供构建系统和日志收集使用。
+/// 与`StreamDiagnosticConsumer`不同，它不输出源代码行和插入符，并且把输出
+/// 累积在缓冲区中，在`Flush`或缓冲区足够大时才写入流。
+///
+/// `Json`格式每个诊断一行，是一个JSON对象：
+///
+///   {"kind":"UnknownBaseSpecifier","file":"a.cocktail","line":1,"column":3,
+///    "message":"...","level":"error","notes":[{"kind":...}]}
+///
+/// 没有位置的字段（行号或列号为0）会被省略，没有注释时也省略`notes`。
+///
+/// `Binary`格式以一个头部开始，之后每个诊断一条记录，整数都是小端序：
+///
+///   头部：魔数"CKDIAGS\0"，u32 版本，u32 诊断类型数，每个类型的名称。
+///   记录：u8 等级，u32 注释数，然后是主消息和每条注释。
+///   消息：u16 诊断类型在头部中的下标，u32 行号，u32 列号，文件名，消息文本。
+///
+/// 其中的字符串都以u32长度开头。
+class StructuredDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  enum class Format : int8_t {
+    Json,
+    Binary,
+  };
+
+  // 二进制格式开头的魔数，共8个字节，包括末尾的NUL。
+  static constexpr char BinaryMagic[8] = {'C', 'K', 'D', 'I',
+                                          'A', 'G', 'S', '\0'};
+
+  // 二进制格式的版本，格式改变时递增。
+  static constexpr uint32_t BinaryVersion = 1;
+
+  StructuredDiagnosticConsumer(llvm::raw_ostream& stream, Format format)
+      : stream_(&stream), format_(format) {}
+
+  ~StructuredDiagnosticConsumer() override { Flush(); }
+
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override;
+
+  auto Flush() -> void override;
+
+ private:
+  auto AppendJson(const Diagnostic& diagnostic) -> void;
+  auto AppendJson(const DiagnosticMessage& message) -> void;
+  auto AppendBinary(const Diagnostic& diagnostic) -> void;
+  auto AppendBinary(const DiagnosticMessage& message) -> void;
+
+  llvm::raw_ostream* stream_;
+  Format format_;
+  // 二进制格式的头部是否已经输出。
+  bool wrote_header_ = false;
+  llvm::SmallString<0> buffer_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DIAGNOSTICS_STRUCTURED_DIAGNOSTIC_CONSUMER_H
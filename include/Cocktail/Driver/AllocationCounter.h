@@ -0,0 +1,23 @@
+#ifndef COCKTAIL_DRIVER_ALLOCATION_COUNTER_H
+#define COCKTAIL_DRIVER_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+namespace Cocktail {
+
+// The allocations that `operator new` has made on one thread.
+struct AllocationCount {
+  int64_t allocations = 0;
+  int64_t bytes = 0;
+};
+
+// Returns the allocations made on the calling thread since it started. The
+// driver replaces the global `operator new` to count them, which costs two
+// increments of thread-local counters per allocation, so `bench` can report
+// how many allocations each run of a stage makes. Allocations made with
+// `malloc` directly aren't counted.
+auto GetThreadAllocationCount() -> AllocationCount;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_ALLOCATION_COUNTER_H
@@ -0,0 +1,115 @@
+#ifndef COCKTAIL_DRIVER_ARTIFACT_CACHE_H
+#define COCKTAIL_DRIVER_ARTIFACT_CACHE_H
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Driver/RemoteCache.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace Cocktail {
+
+// An on-disk cache of driver artifacts, such as the tokens and tree of a
+// source file along with their diagnostics, shared by every process pointed
+// at the same directory with `--cache-dir`. Each artifact is a file named by
+// its key, which is a hash of everything the artifact depends on.
+//
+// Artifacts are written to a temporary file and renamed into place, so that
+// readers only ever see whole artifacts, and each one is checked against a
+// hash of its contents when read. Reading an artifact marks it as used, and
+// the least recently used artifacts are removed once the directory grows
+// past its size limit. Can be used by several threads at once.
+//
+// With a remote cache, artifacts missing here are fetched from it and kept
+// here once checked, and those inserted are stored there too. Remote stores,
+// and fetches started by `Prefetch`, run on threads of the cache's own, so
+// that they overlap the work of the threads using it.
+class ArtifactCache {
+ public:
+  static constexpr uint64_t DefaultMaxSize = uint64_t{512} << 20;
+
+  // An artifact read back from the cache. Large artifacts are mapped rather
+  // than read.
+  class Artifact {
+   public:
+    auto data() const -> llvm::StringRef { return data_; }
+
+   private:
+    friend class ArtifactCache;
+
+    std::unique_ptr<llvm::MemoryBuffer> buffer_;
+    llvm::StringRef data_;
+  };
+
+  explicit ArtifactCache(llvm::StringRef directory,
+                         uint64_t max_size = DefaultMaxSize)
+      : directory_(directory), max_size_(max_size) {}
+
+  // Returns the key for an artifact that depends on `parts`, which can be any
+  // bytes at all.
+  static auto MakeKey(llvm::ArrayRef<llvm::StringRef> parts) -> std::string;
+
+  // Fetches artifacts from `remote` and stores them there, on `threads`
+  // threads. Set before the cache is used.
+  auto SetRemote(std::unique_ptr<RemoteCacheBackend> remote, int threads = 4)
+      -> void;
+
+  // Returns the artifact stored for `key`, if there is a whole one, fetching
+  // it from the remote cache if it isn't here.
+  auto Lookup(llvm::StringRef key) -> std::optional<Artifact>;
+
+  // Starts fetching the artifact for `key` from the remote cache, if there
+  // is one and the artifact isn't here, so that a later `Lookup` of it only
+  // waits for what's left of the fetch.
+  auto Prefetch(llvm::StringRef key) -> void;
+
+  // Stores `data` as the artifact for `key`, replacing any there is. Returns
+  // false if it couldn't be written here, which leaves the cache as it was.
+  // The remote store is made in the background, and may fail on its own.
+  auto Insert(llvm::StringRef key, llvm::StringRef data) -> bool;
+
+  // Removes the least recently used artifacts until the cache is well under
+  // its size limit, along with temporary files left behind by writers that
+  // didn't finish.
+  auto Prune() -> void;
+
+ private:
+  auto GetPath(llvm::StringRef key) const -> llvm::SmallString<256>;
+
+  auto LookupLocal(llvm::StringRef key) -> std::optional<Artifact>;
+  auto InsertLocal(llvm::StringRef key, llvm::StringRef data) -> bool;
+
+  // Returns the data of the artifact the remote cache has for `key`, if it
+  // has a whole one.
+  auto FetchRemote(llvm::StringRef key) -> std::optional<std::string>;
+
+  std::string directory_;
+  uint64_t max_size_;
+
+  // Guards when to prune next. Every process prunes after its first insert,
+  // then again once it has written an eighth of the size limit.
+  std::mutex mutex_;
+  bool pruned_ = false;
+  uint64_t bytes_since_prune_ = 0;
+
+  std::unique_ptr<RemoteCacheBackend> remote_;
+  // Guards the fetches started by `Prefetch` that no lookup has waited for.
+  std::mutex fetches_mutex_;
+  llvm::StringMap<std::future<std::optional<std::string>>> fetches_;
+  // Destroyed first, which finishes the fetches and stores still queued
+  // while what they use is still alive.
+  std::optional<TaskScheduler> remote_tasks_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_ARTIFACT_CACHE_H
@@ -0,0 +1,80 @@
+#ifndef COCKTAIL_DRIVER_BUILD_GRAPH_H
+#define COCKTAIL_DRIVER_BUILD_GRAPH_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// The files of a build and the files whose interfaces each one imports, read
+// from a manifest, along with a stamp of what each file was last built from,
+// which is kept between builds.
+//
+// A manifest has a line for each file, naming it and then, after a colon,
+// the files it imports, separated by whitespace, as in
+// `main.ck: math.ck io.ck`. A file that imports nothing needs no colon.
+// Blank lines and lines starting with `#` are skipped.
+//
+// The files are ordered so that each comes after those it imports, and
+// otherwise as in the manifest.
+class BuildGraph {
+ public:
+  // The version of the format that `WriteStamps` writes. Bump it whenever
+  // the format changes.
+  static constexpr uint32_t StampsVersion = 2;
+
+  // What a file was last built from, and the interface that was built.
+  struct Stamp {
+    uint64_t source_hash = 0;
+    // The hash of the options that change the objects built, such as the
+    // optimization level and how code generation is split.
+    uint64_t options_hash = 0;
+    // The hashes of the interfaces imported, in the order they were.
+    llvm::SmallVector<uint64_t> import_hashes;
+    uint64_t interface_hash = 0;
+  };
+
+  struct File {
+    std::string name;
+    // The indices of the files it imports, in the order of the manifest.
+    llvm::SmallVector<int> imports;
+    // The indices of the files that import it.
+    llvm::SmallVector<int> dependents;
+    // Set once the file has been built, and until it changes.
+    std::optional<Stamp> stamp;
+  };
+
+  // Returns the graph of `manifest`, or reports to `errors` why there is
+  // none: an unnamed file, a file listed twice, an import that isn't listed
+  // or a file that imports itself, however indirectly.
+  static auto Parse(llvm::StringRef manifest, llvm::raw_ostream& errors)
+      -> std::optional<BuildGraph>;
+
+  // Sets the stamps of the files from `data`, which `WriteStamps` wrote.
+  // Files that aren't in the graph are skipped, and with malformed data, or
+  // data from another version of the format, none are set, so that every
+  // file is built again.
+  auto ReadStamps(llvm::StringRef data) -> void;
+
+  // Writes the stamps of the files that have one, one line for each.
+  auto WriteStamps(llvm::raw_ostream& output) const -> void;
+
+  auto files() -> llvm::MutableArrayRef<File> { return files_; }
+  auto files() const -> llvm::ArrayRef<File> { return files_; }
+  auto size() const -> int { return files_.size(); }
+
+ private:
+  BuildGraph() = default;
+
+  llvm::SmallVector<File, 0> files_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_BUILD_GRAPH_H
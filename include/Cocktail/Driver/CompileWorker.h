@@ -0,0 +1,87 @@
+#ifndef COCKTAIL_DRIVER_COMPILE_WORKER_H
+#define COCKTAIL_DRIVER_COMPILE_WORKER_H
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "Cocktail/Lowering/OptimizeLLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+
+// A file for a driver server to compile to objects, sent with `--workers`.
+// It carries the file's serialized tokens and tree and the interfaces it
+// imports, so that the server reads no files and neither lexes nor parses:
+// it runs semantics, lowering and codegen, as `compile` would with the flags
+// given here. The text is only sent because the tokens refer into it.
+struct CompileJob {
+  // The objects are for this target, which must be the server's own.
+  llvm::StringRef target_triple;
+  llvm::StringRef file_name;
+  llvm::StringRef source_text;
+  // What `TokenizedBuffer::Serialize` and `ParseTree::Serialize` wrote.
+  llvm::StringRef tokens;
+  llvm::StringRef parse_tree;
+  // The serialized interfaces imported, in order.
+  llvm::SmallVector<llvm::StringRef> interfaces;
+  llvm::SmallVector<llvm::StringRef> entry_points;
+  OptimizationLevel optimization_level = OptimizationLevel::O0;
+  int32_t codegen_shards = 1;
+  int32_t codegen_threads = 1;
+};
+
+struct CompileJobResult {
+  bool success = false;
+  // The objects, in the order `compile` numbers them.
+  llvm::SmallVector<std::string, 1> objects;
+  // The errors, diagnostics included, as the server printed them.
+  std::string errors;
+};
+
+// Returns `job` as bytes, which `DecodeCompileJob` reads back.
+auto EncodeCompileJob(const CompileJob& job) -> std::string;
+
+// Reads the job that `EncodeCompileJob` wrote to `data`, which it refers
+// into, returning false if it is malformed.
+auto DecodeCompileJob(llvm::StringRef data, CompileJob& job) -> bool;
+
+auto EncodeCompileJobResult(const CompileJobResult& result) -> std::string;
+auto DecodeCompileJobResult(llvm::StringRef data)
+    -> std::optional<CompileJobResult>;
+
+// The driver servers that `--workers=SOCKET,...` offloads compiling to. Each
+// job goes to the server with the least work outstanding, counted as the
+// bytes of source of the jobs sent to it that haven't come back, as a server
+// runs its jobs one at a time. Can be used by several threads at once.
+class CompileWorkerPool {
+ public:
+  explicit CompileWorkerPool(llvm::ArrayRef<llvm::StringRef> socket_paths);
+
+  // Runs `job` on the least loaded server, trying the others in turn while
+  // one can't be reached. Returns nothing if none could, so that the job is
+  // compiled locally instead. Servers that couldn't be reached aren't tried
+  // again.
+  auto Run(const CompileJob& job) -> std::optional<CompileJobResult>;
+
+ private:
+  struct Worker {
+    std::string socket_path;
+    uint64_t outstanding_bytes = 0;
+    bool unreachable = false;
+  };
+
+  // Picks the least loaded server that isn't unreachable, adding `bytes` to
+  // its load, or returns -1 if there is none.
+  auto Acquire(uint64_t bytes) -> int;
+
+  std::mutex mutex_;
+  llvm::SmallVector<Worker, 0> workers_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_COMPILE_WORKER_H
@@ -1,22 +1,58 @@
 #ifndef COCKTAIL_DRIVER_DRIVER_H
 #define COCKTAIL_DRIVER_DRIVER_H
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
 
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Diagnostics/DiagnosticCache.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Driver/ArtifactCache.h"
+#include "Cocktail/Driver/CompileWorker.h"
+#include "Cocktail/Driver/DriverStats.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Lowering/OptimizeLLVM.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Semantics/SemanticsInterface.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "Cocktail/Source/SourceBufferCache.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/raw_ostream.h"
 
+namespace llvm {
+class Module;
+class TargetMachine;
+namespace orc {
+class ThreadSafeModule;
+}  // namespace orc
+}  // namespace llvm
+
 namespace Cocktail {
 
 class Driver {
  public:
   Driver() : output_stream_(llvm::outs()), error_stream_(llvm::errs()) {}
 
-  Driver(llvm::raw_ostream& output_stream, llvm::raw_ostream& error_stream)
-      : output_stream_(output_stream), error_stream_(error_stream) {}
+  // Source files are read through `source_cache`, so that running several
+  // subcommands in one process reads each file once. With a `diagnostic_cache`,
+  // files whose text hasn't changed aren't lexed or parsed again: the stored
+  // tokens and tree are read back and their diagnostics replayed.
+  Driver(llvm::raw_ostream& output_stream, llvm::raw_ostream& error_stream,
+         SourceBufferCache& source_cache = SourceBufferCache::Global(),
+         DiagnosticCache* diagnostic_cache = nullptr)
+      : output_stream_(output_stream),
+        error_stream_(error_stream),
+        source_cache_(&source_cache),
+        diagnostic_cache_(diagnostic_cache) {}
 
   auto RunFullCommand(llvm::ArrayRef<llvm::StringRef> args) -> bool;
 
@@ -29,12 +65,297 @@ class Driver {
   auto RunDumpParseTreeSubcommand(DiagnosticConsumer& consumer,
                                   llvm::ArrayRef<llvm::StringRef> args) -> bool;
 
+  auto RunDumpSemanticsIRSubcommand(DiagnosticConsumer& consumer,
+                                    llvm::ArrayRef<llvm::StringRef> args)
+      -> bool;
+
+  auto RunEmitLLVMSubcommand(DiagnosticConsumer& consumer,
+                             llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunEmitInterfaceSubcommand(DiagnosticConsumer& consumer,
+                                  llvm::ArrayRef<llvm::StringRef> args)
+      -> bool;
+
+  auto RunCompileSubcommand(DiagnosticConsumer& consumer,
+                            llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunBuildSubcommand(DiagnosticConsumer& consumer,
+                          llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunRunSubcommand(DiagnosticConsumer& consumer,
+                        llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunServeSubcommand(DiagnosticConsumer& consumer,
+                          llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunLspSubcommand(DiagnosticConsumer& consumer,
+                        llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunFormatSubcommand(DiagnosticConsumer& consumer,
+                           llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunIndexSubcommand(DiagnosticConsumer& consumer,
+                          llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunLookupSubcommand(DiagnosticConsumer& consumer,
+                           llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  auto RunBenchSubcommand(DiagnosticConsumer& consumer,
+                          llvm::ArrayRef<llvm::StringRef> args) -> bool;
+
+  // Compiles `job`, which another driver sent with `--workers`, to objects
+  // as `compile` would, without reading any files.
+  auto RunCompileJob(const CompileJob& job) -> CompileJobResult;
+
+  // Sets where diagnostics are printed for people to read, which is the
+  // console by default.
+  auto set_console_consumer(DiagnosticConsumer& consumer) -> void {
+    console_consumer_ = &consumer;
+  }
+
  private:
   auto ReportExtraArgs(llvm::StringRef subcommand_text,
                        llvm::ArrayRef<llvm::StringRef> args) -> void;
 
+  // Runs a subcommand on one input file, writing to `output` and `errors`
+  // rather than the driver's streams.
+  using RunFileFn = llvm::function_ref<bool(
+      llvm::StringRef input_file, DiagnosticConsumer& consumer,
+      llvm::raw_ostream& output, llvm::raw_ostream& errors)>;
+
+  // Appends the input files in `args` to `files`, reading the names listed in
+  // each `@file` response file, which are whitespace-separated. Reports an
+  // error if a response file can't be read or there are no files.
+  auto ExpandInputFiles(llvm::ArrayRef<llvm::StringRef> args,
+                        llvm::StringSaver& saver,
+                        llvm::SmallVectorImpl<llvm::StringRef>& files) -> bool;
+
+  // Runs `run_file` on each input file, on `jobs_` threads. Each file's
+  // diagnostics, errors and output are written together, in the order of the
+  // files. Once `consumer` asks to stop, the remaining files are skipped.
+  // Returns whether every file succeeded.
+  auto RunOnFiles(llvm::ArrayRef<llvm::StringRef> input_files,
+                  DiagnosticConsumer& consumer, RunFileFn run_file) -> bool;
+
+  // Parses and prints one lexed file for the lex-parse pipeline, writing to
+  // `output` rather than the driver's stream.
+  using ParseFileFn = llvm::function_ref<bool(
+      SourceBuffer& source, TokenizedBuffer& tokens,
+      DiagnosticConsumer& consumer, llvm::raw_ostream& output)>;
+
+  // Returns whether to lex and parse `input_files` in a pipeline rather than
+  // each file on its own thread.
+  auto UseLexParsePipeline(llvm::ArrayRef<llvm::StringRef> input_files)
+      -> bool;
+
+  // Reads and lexes the input files on `lex_jobs_` threads while the files
+  // already lexed are passed to `parse_file` on `parse_jobs_` others, so that
+  // large files and small ones keep every thread busy. While too many files
+  // are waiting to be parsed, the lexing threads parse them too. Writes the
+  // results as `RunOnFiles` does.
+  auto RunLexParsePipeline(llvm::ArrayRef<llvm::StringRef> input_files,
+                           DiagnosticConsumer& consumer,
+                           ParseFileFn parse_file) -> bool;
+
+  // A file's results from a worker thread. The diagnostics are copied, as
+  // the file's buffers may be gone by the time they're written.
+  struct FileResult {
+    std::string output;
+    std::string errors;
+    std::shared_ptr<const DiagnosticCache::Entry> diagnostics;
+    bool success = false;
+    // Set once the rest is.
+    std::atomic<bool> done = false;
+  };
+
+  // Writes each file's diagnostics, errors and output once it is `done`, in
+  // the order of the files, so that only this thread uses `consumer`. Runs
+  // `group`'s tasks while it waits, and cancels them once `consumer` asks to
+  // stop. Returns whether every file succeeded.
+  auto WriteFileResults(TaskGroup& group,
+                        llvm::MutableArrayRef<FileResult> results,
+                        DiagnosticConsumer& consumer) -> bool;
+
+  // With `--low-memory`, frees the values of `tokens`' literals, recording the
+  // bytes freed in the stats.
+  auto ReleaseLiteralValues(TokenizedBuffer& tokens) -> void;
+
+  // Reads `filename` through the source cache, recording the time and size in
+  // the stats.
+  auto ReadSource(llvm::StringRef filename, DiagnosticConsumer& consumer)
+      -> std::shared_ptr<SourceBuffer>;
+
+  // Lexes `source`, or reads back the tokens cached for its text, recording
+  // the time and counts in the stats. With a `context`, the source is lexed
+  // as a stage of its compilation.
+  auto Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+           CompilationContext* context = nullptr) -> TokenizedBuffer;
+  auto LexOrReadCached(SourceBuffer& source, DiagnosticConsumer& consumer,
+                       CompilationContext* context) -> TokenizedBuffer;
+
+  // Parses `tokens`, or reads back the tree cached for the text of `source`,
+  // recording the time and counts in the stats.
+  auto Parse(SourceBuffer& source, TokenizedBuffer& tokens,
+             DiagnosticConsumer& consumer) -> ParseTree;
+  auto ParseOrReadCached(SourceBuffer& source, TokenizedBuffer& tokens,
+                      DiagnosticConsumer& consumer) -> ParseTree;
+
+  // Returns the result of `stage` cached for the text of `source`, along
+  // with the interfaces whose key is `imports_key` for semantics, from the
+  // diagnostic cache or else from the artifact cache.
+  auto LookupCached(DiagnosticCache::Stage stage, SourceBuffer& source,
+                    llvm::StringRef imports_key = "")
+      -> std::shared_ptr<const DiagnosticCache::Entry>;
+
+  // The stage that a subcommand running the whole pipeline stops after.
+  enum class PipelineStage {
+    SemanticsIR,
+    Interface,
+    LLVM,
+    Object,
+    Run,
+  };
+
+  // The interfaces that a file is checked against, and their key, which
+  // results that depend on them are cached by.
+  struct Imports {
+    llvm::ArrayRef<SemanticsInterface> interfaces;
+    llvm::StringRef key;
+  };
+
+  // Runs `input_file` through every stage up to `last_stage`, timing each in
+  // the stats, then prints the last stage's result to `output`, or for an
+  // interface or object, writes it to `output_file`, or for `Run`, runs it.
+  // The file is checked against `imports`, and with an `interface_file`, its
+  // interface is written there too once it's checked. Each stage's result
+  // refers into the one before, so the driver keeps them all until the file
+  // is done, or with `--low-memory` until no later stage needs them, and
+  // then releases them last to first. The strings they keep are allocated
+  // in a `CompilationContext` of the file's own, which is freed at once when
+  // the file is done. With a `scheduler`, stages that can split a file do so
+  // on its threads.
+  auto CompileFile(llvm::StringRef input_file, PipelineStage last_stage,
+                   llvm::StringRef output_file, const Imports& imports,
+                   DiagnosticConsumer& file_consumer,
+                   llvm::raw_ostream& output, llvm::raw_ostream& errors,
+                   TaskScheduler* scheduler,
+                   llvm::StringRef interface_file = "") -> bool;
+
+  // With `--workers`, compiles the file of `source`, which lexed and parsed
+  // cleanly into `tokens` and `parse_tree`, to objects on a worker, and
+  // writes them as `CompileFile` would. Objects the artifact cache has are
+  // written from it instead. Returns nothing if neither has the objects, so
+  // that the file is compiled here.
+  auto CompileOnWorker(SourceBuffer& source, TokenizedBuffer& tokens,
+                       ParseTree& parse_tree, const Imports& imports,
+                       llvm::StringRef output_file, llvm::raw_ostream& errors)
+      -> std::optional<bool>;
+
+  // Returns the name of the `index`th of `count` objects compiled to
+  // `output_file`. With more than one, the index goes before the extension.
+  static auto GetObjectFileName(llvm::StringRef output_file, int index,
+                                int count) -> llvm::SmallString<256>;
+
+  // Runs the `main` function of `program` in this process with a JIT. Each
+  // function is compiled the first time it's called, into an object stored
+  // in the artifact cache if there is one. Reports failures to `errors`.
+  auto RunProgram(llvm::orc::ThreadSafeModule program,
+                  llvm::raw_ostream& errors) -> bool;
+
+  // Runs the pass pipeline of `optimization_level_` on `module`, tuned for
+  // `target_machine` if there is one, timing each pass in the stats.
+  auto OptimizeModule(llvm::Module& module,
+                      llvm::TargetMachine* target_machine) -> void;
+
+  // Returns a target machine for the host that generates code at `level`,
+  // or reports to `errors` that there is none.
+  static auto CreateTargetMachine(OptimizationLevel level,
+                                  llvm::raw_ostream& errors)
+      -> std::unique_ptr<llvm::TargetMachine>;
+
+  // Compiles `module`, whose target and data layout are `target_machine`'s,
+  // into one object for each of `objects`. With more than one, the module is
+  // split up, and each part compiled on a thread of its own. Reports
+  // failures to `errors`. Modules in different contexts can be compiled at
+  // the same time, each with a target machine of its own.
+  static auto EmitObjects(llvm::Module& module,
+                          llvm::TargetMachine& target_machine,
+                          llvm::MutableArrayRef<llvm::SmallVector<char, 0>>
+                              objects,
+                          llvm::raw_ostream& errors) -> bool;
+
+  // Writes `object` to `object_file`, reporting failures to `errors`.
+  static auto WriteObjectFile(llvm::StringRef object_file,
+                              llvm::ArrayRef<char> object,
+                              llvm::raw_ostream& errors) -> bool;
+
+  // Replaces the contents of `file` with `contents`, keeping its
+  // permissions. The contents are written to a file of their own and renamed
+  // over it, so that a reader, or a mapping of the old contents, never sees
+  // part of either. Reports failures to `errors`.
+  static auto ReplaceFile(llvm::StringRef file, llvm::StringRef contents,
+                          llvm::raw_ostream& errors) -> bool;
+
+  // Writes `interface` to `interface_file` like `WriteObjectFile`, unless
+  // the file already holds it.
+  auto WriteInterfaceFile(llvm::StringRef interface_file,
+                          llvm::StringRef interface, llvm::raw_ostream& errors)
+      -> bool;
+
+  // Runs each input file in `args` through every stage up to `last_stage`
+  // with `CompileFile`. An interface or object is written to `output_file` if
+  // given, which is only allowed for one input file, and otherwise next to
+  // its input.
+  auto RunPipelineSubcommand(DiagnosticConsumer& consumer,
+                             llvm::ArrayRef<llvm::StringRef> args,
+                             PipelineStage last_stage,
+                             llvm::StringRef output_file = "") -> bool;
+
+  // Returns the hash that the diagnostic cache keys the result of `stage` for
+  // `source` by: that of the text, along with `imports_key` for semantics.
+  static auto GetContentHash(DiagnosticCache::Stage stage,
+                             SourceBuffer& source,
+                             llvm::StringRef imports_key) -> uint64_t;
+
+  // Stores the result of `stage` for the text of `source` in both caches, as
+  // `LookupCached` finds it.
+  auto StoreCached(DiagnosticCache::Stage stage, SourceBuffer& source,
+                   std::shared_ptr<const DiagnosticCache::Entry> entry,
+                   llvm::StringRef imports_key = "") -> void;
+
   llvm::raw_ostream& output_stream_;
   llvm::raw_ostream& error_stream_;
+  SourceBufferCache* source_cache_ = &SourceBufferCache::Global();
+  DiagnosticCache* diagnostic_cache_ = nullptr;
+  DiagnosticConsumer* console_consumer_ = &ConsoleDiagnosticConsumer();
+  // The on-disk cache of the command being run, with `--cache-dir`.
+  ArtifactCache* artifact_cache_ = nullptr;
+  // The servers that objects are compiled on, from `--workers`.
+  CompileWorkerPool* workers_ = nullptr;
+  // The stats of the command being run, with `--stats`.
+  DriverStats* stats_ = nullptr;
+  // The number of threads to process input files on, from `-j`.
+  int jobs_ = 1;
+  // The threads for each stage of the lex-parse pipeline, from `--lex-jobs`
+  // and `--parse-jobs`, or 0 to split `jobs_`.
+  int lex_jobs_ = 0;
+  int parse_jobs_ = 0;
+  // Whether to free stage data as soon as it's dead, from `--low-memory`.
+  bool low_memory_ = false;
+  // The number of shards to split each file's functions into for lowering
+  // and codegen, from `--codegen-shards`.
+  int codegen_shards_ = 1;
+  // The number of threads to split the codegen of each module across, from
+  // `--codegen-threads`.
+  int codegen_threads_ = 1;
+  // How much lowered code is optimized, from `-O`.
+  OptimizationLevel optimization_level_ = OptimizationLevel::O0;
+  // The interfaces declared in every file, from `--import`, and their key.
+  llvm::ArrayRef<SemanticsInterface> imports_;
+  std::string imports_key_;
+  // The functions that lowering keeps, along with `main` and what they call,
+  // from `--entry-point`.
+  llvm::ArrayRef<llvm::StringRef> entry_points_;
 };
 
 }  // namespace Cocktail
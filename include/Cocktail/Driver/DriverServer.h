@@ -0,0 +1,77 @@
+#ifndef COCKTAIL_DRIVER_DRIVER_SERVER_H
+#define COCKTAIL_DRIVER_DRIVER_SERVER_H
+
+#include <optional>
+
+#include "Cocktail/Diagnostics/DiagnosticCache.h"
+#include "Cocktail/Driver/CompileWorker.h"
+#include "Cocktail/Source/SourceBufferCache.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// Runs driver commands for clients connecting over a Unix socket, for
+// `cocktail serve`. The process stays up between commands, so that each one
+// only pays for what changed since the last: sources are read through the
+// same cache, and files whose text is unchanged have their tokens and tree
+// read back from the diagnostic cache rather than lexed and parsed again.
+//
+// A request is the client's working directory and the arguments to run, and
+// its response is the command's result, output and errors, diagnostics
+// included. Requests are served one at a time, each in the working directory
+// of its client.
+//
+// A server is also a worker for other drivers' `--workers`, compiling the
+// jobs they send without reading any files of theirs.
+class DriverServer {
+ public:
+  DriverServer(SourceBufferCache& source_cache,
+               DiagnosticCache& diagnostic_cache,
+               llvm::raw_ostream& error_stream)
+      : source_cache_(&source_cache),
+        diagnostic_cache_(&diagnostic_cache),
+        error_stream_(&error_stream) {}
+
+  // Listens on `socket_path` and serves requests until a client asks the
+  // server to stop. Returns false if the socket can't be listened on.
+  auto Serve(llvm::StringRef socket_path) -> bool;
+
+  // Runs one command on the server's caches, writing its output and errors,
+  // diagnostics included, to `output` and `errors`.
+  auto Run(llvm::ArrayRef<llvm::StringRef> args, llvm::raw_ostream& output,
+           llvm::raw_ostream& errors) -> bool;
+
+  // Compiles a job that another driver sent.
+  auto Compile(const CompileJob& job) -> CompileJobResult;
+
+ private:
+  SourceBufferCache* source_cache_;
+  DiagnosticCache* diagnostic_cache_;
+  llvm::raw_ostream* error_stream_;
+};
+
+// Runs the command `args` on the server listening on `socket_path`, writing
+// its output and errors to `output` and `errors`. Returns the command's
+// result, or nothing if no server could be reached, in which case nothing is
+// written.
+auto RunOnDriverServer(llvm::StringRef socket_path,
+                       llvm::ArrayRef<llvm::StringRef> args,
+                       llvm::raw_ostream& output, llvm::raw_ostream& errors)
+    -> std::optional<bool>;
+
+// Compiles the job that `EncodeCompileJob` wrote to `job` on the server
+// listening on `socket_path`. Returns nothing if no server could be reached
+// or its response was malformed.
+auto RunCompileJobOnDriverServer(llvm::StringRef socket_path,
+                                 llvm::StringRef job)
+    -> std::optional<CompileJobResult>;
+
+// Asks the server listening on `socket_path` to stop, returning whether one
+// was reached.
+auto StopDriverServer(llvm::StringRef socket_path) -> bool;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_DRIVER_SERVER_H
@@ -0,0 +1,140 @@
+#ifndef COCKTAIL_DRIVER_DRIVER_STATS_H
+#define COCKTAIL_DRIVER_DRIVER_STATS_H
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "Cocktail/Common/MemoryUsage.h"
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// The wall and CPU time that each phase of a driver command took, and counts
+// of what it processed, for `--stats`. Phases that run more than once add up,
+// including those run on several threads at once by `-j`.
+class DriverStats {
+ public:
+  // Times a phase for as long as it is alive. The phase is also added to the
+  // time trace when one is being recorded, as an `llvm::TimeTraceScope`, so
+  // the same scopes show up in `--time-trace` output. With no stats, only the
+  // trace is recorded, which costs nothing when there is no trace either.
+  class PhaseScope {
+   public:
+    PhaseScope(DriverStats* stats, llvm::StringLiteral name)
+        : stats_(stats), name_(name), trace_scope_(name) {
+      if (stats_ != nullptr) {
+        start_ = llvm::TimeRecord::getCurrentTime(/*Start=*/true);
+      }
+    }
+
+    PhaseScope(const PhaseScope&) = delete;
+    auto operator=(const PhaseScope&) -> PhaseScope& = delete;
+
+    ~PhaseScope() {
+      if (stats_ != nullptr) {
+        llvm::TimeRecord elapsed =
+            llvm::TimeRecord::getCurrentTime(/*Start=*/false);
+        elapsed -= start_;
+        stats_->AddPhase(name_, elapsed);
+      }
+    }
+
+   private:
+    DriverStats* stats_;
+    llvm::StringLiteral name_;
+    llvm::TimeRecord start_;
+    llvm::TimeTraceScope trace_scope_;
+  };
+
+  // Counts the diagnostics and errors passed to the next consumer.
+  class DiagnosticCounter : public DiagnosticConsumer {
+   public:
+    DiagnosticCounter(DriverStats& stats, DiagnosticConsumer& next_consumer)
+        : stats_(&stats), next_consumer_(&next_consumer) {}
+
+    auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+      stats_->AddCount("diagnostics", 1);
+      if (diagnostic.level == DiagnosticLevel::Error) {
+        stats_->AddCount("errors", 1);
+      }
+      next_consumer_->HandleDiagnostic(std::move(diagnostic));
+    }
+
+    auto Flush() -> void override { next_consumer_->Flush(); }
+
+    auto ShouldStop() -> bool override { return next_consumer_->ShouldStop(); }
+
+   private:
+    DriverStats* stats_;
+    DiagnosticConsumer* next_consumer_;
+  };
+
+  // Adds `value` to the count called `name`.
+  auto AddCount(llvm::StringLiteral name, int64_t value) -> void;
+
+  // Adds `elapsed` to the time of the phase called `name`.
+  auto AddPhase(llvm::StringLiteral name, const llvm::TimeRecord& elapsed)
+      -> void;
+
+  // Adds `elapsed` to the time of the LLVM pass called `name`, which doesn't
+  // include the passes it runs itself.
+  auto AddPass(llvm::StringRef name, const llvm::TimeRecord& elapsed) -> void;
+
+  // Adds the bytes of each container in `usage` to those of `owner`'s
+  // container of the same name.
+  auto AddMemoryUsage(llvm::StringLiteral owner, const MemoryUsage& usage)
+      -> void;
+
+  // Prints each phase's times and each count, in the order they were first
+  // recorded, followed by the peak resident set size of the process when it
+  // is known. The bytes of each container and the times of LLVM passes follow
+  // in tables of their own.
+  auto Print(llvm::raw_ostream& out) const -> void;
+
+  // Returns the peak resident set size of the process in bytes, if the host
+  // reports it.
+  static auto GetPeakResidentSetSize() -> std::optional<int64_t>;
+
+ private:
+  struct Phase {
+    llvm::StringLiteral name;
+    llvm::TimeRecord time;
+  };
+
+  struct Count {
+    llvm::StringLiteral name;
+    int64_t value;
+  };
+
+  // Pass names aren't literals, and may not outlive the pipeline that ran
+  // them, so they're copied.
+  struct Pass {
+    std::string name;
+    llvm::TimeRecord time;
+  };
+
+  struct Memory {
+    llvm::StringLiteral owner;
+    llvm::StringLiteral name;
+    int64_t used;
+    int64_t allocated;
+  };
+
+  // Guards the phases and counts, which worker threads add to.
+  std::mutex mutex_;
+  llvm::SmallVector<Phase> phases_;
+  llvm::SmallVector<Count> counts_;
+  llvm::SmallVector<Memory> memory_;
+  llvm::SmallVector<Pass> passes_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_DRIVER_STATS_H
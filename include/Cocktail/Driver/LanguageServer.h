@@ -0,0 +1,87 @@
+#ifndef COCKTAIL_DRIVER_LANGUAGE_SERVER_H
+#define COCKTAIL_DRIVER_LANGUAGE_SERVER_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// Serves the Language Server Protocol for `cocktail lsp`, reading messages
+// from a file descriptor and writing them to a stream, each framed by a
+// `Content-Length` header.
+//
+// Each open document keeps its source, tokens and parse tree. An edit relexes
+// only the lines it touched and reparses only the code block or declarations
+// enclosing it, so that the semantic tokens and symbols asked for after it
+// are read from indexes that are already up to date. Diagnostics are
+// published once edits to a document pause for the diagnostics delay, rather
+// than after every keystroke.
+class LanguageServer {
+ public:
+  // How long a document's edits must pause before its diagnostics are
+  // published, by default.
+  static constexpr std::chrono::milliseconds DefaultDiagnosticsDelay{50};
+
+  LanguageServer(
+      llvm::raw_ostream& output, llvm::raw_ostream& error_stream,
+      std::chrono::milliseconds diagnostics_delay = DefaultDiagnosticsDelay);
+  ~LanguageServer();
+
+  // Handles the messages read from `input_fd` until the client sends `exit`
+  // or closes it, publishing diagnostics while no message is waiting. Returns
+  // whether the client asked the server to shut down before it exited.
+  auto Serve(int input_fd) -> bool;
+
+  // Handles one message, writing its response, if it is a request, along
+  // with any notifications. Returns false once the message is `exit`.
+  auto HandleMessage(const llvm::json::Value& message) -> bool;
+
+  // Publishes the diagnostics of the documents whose edits have paused for
+  // the diagnostics delay, or with `all`, of every document with diagnostics
+  // waiting. Returns the time until the next document's are due, or a
+  // negative duration if none are waiting.
+  auto PublishDiagnostics(bool all = false) -> std::chrono::milliseconds;
+
+ private:
+  struct Snapshot;
+  struct Document;
+
+  // Writes `message` to the output with its header.
+  auto Send(llvm::json::Value message) -> void;
+  auto Reply(const llvm::json::Value& id, llvm::json::Value result) -> void;
+  auto ReplyError(const llvm::json::Value& id, int code,
+                  llvm::StringRef message) -> void;
+
+  // Handles the request or notification `method` with `params`, returning
+  // the result to reply with, if any.
+  auto Initialize(const llvm::json::Object& params) -> llvm::json::Value;
+  auto DidOpen(const llvm::json::Object& params) -> void;
+  auto DidChange(const llvm::json::Object& params) -> void;
+  auto DidClose(const llvm::json::Object& params) -> void;
+  auto SemanticTokens(const Document& document) -> llvm::json::Value;
+  auto DocumentSymbols(const Document& document) -> llvm::json::Value;
+
+  // Returns the document that `params` names, or null if it isn't open.
+  auto FindDocument(const llvm::json::Object& params) -> Document*;
+
+  llvm::raw_ostream* output_;
+  llvm::raw_ostream* error_stream_;
+  std::chrono::milliseconds diagnostics_delay_;
+  // Whether positions count UTF-8 bytes, if the client supports it, rather
+  // than UTF-16 code units.
+  bool utf8_positions_ = false;
+  // Whether the client sent `shutdown`.
+  bool shut_down_ = false;
+  // The open documents, by URI.
+  llvm::StringMap<std::unique_ptr<Document>> documents_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_LANGUAGE_SERVER_H
@@ -0,0 +1,58 @@
+#ifndef COCKTAIL_DRIVER_REMOTE_CACHE_H
+#define COCKTAIL_DRIVER_REMOTE_CACHE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+
+// Where an `ArtifactCache` fetches artifacts it doesn't have and stores those
+// it writes, so that they are shared by every machine pointed at the same
+// place. Each artifact is stored as a blob that `EncodeRemoteArtifact` made,
+// under the artifact's key.
+//
+// A backend only moves blobs; the blobs are compressed and checked by the
+// artifact cache, so a backend can store them anywhere at all. Fetches and
+// stores are made from several threads at once.
+class RemoteCacheBackend {
+ public:
+  virtual ~RemoteCacheBackend() = default;
+
+  // Returns the blob stored for `key`, if there is one.
+  virtual auto Fetch(llvm::StringRef key) -> std::optional<std::string> = 0;
+
+  // Stores `blob` for `key`, replacing any there is. Returns false if it
+  // couldn't be stored.
+  virtual auto Store(llvm::StringRef key, llvm::StringRef blob) -> bool = 0;
+};
+
+// A backend keeping each blob in a file of a shared directory, such as a
+// network mount, given with `--remote-cache=DIR`. Blobs are written to a
+// temporary file and renamed into place, like the artifacts of a local cache,
+// and nothing is ever removed: the directory is managed by whoever owns it.
+class DirectoryRemoteCache : public RemoteCacheBackend {
+ public:
+  explicit DirectoryRemoteCache(llvm::StringRef directory)
+      : directory_(directory) {}
+
+  auto Fetch(llvm::StringRef key) -> std::optional<std::string> override;
+  auto Store(llvm::StringRef key, llvm::StringRef blob) -> bool override;
+
+ private:
+  std::string directory_;
+};
+
+// Returns the blob that stores `data` remotely: a header with the size and a
+// hash of `data`, then `data` compressed when that makes it smaller.
+auto EncodeRemoteArtifact(llvm::StringRef data) -> std::string;
+
+// Returns the data stored in `blob`, or nothing if it isn't a whole blob
+// that `EncodeRemoteArtifact` made.
+auto DecodeRemoteArtifact(llvm::StringRef blob) -> std::optional<std::string>;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_REMOTE_CACHE_H
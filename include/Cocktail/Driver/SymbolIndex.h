@@ -0,0 +1,129 @@
+#ifndef COCKTAIL_DRIVER_SYMBOL_INDEX_H
+#define COCKTAIL_DRIVER_SYMBOL_INDEX_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "Cocktail/Lexer/IdentifierTable.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// Where each identifier occurs across a set of files, written by the `index`
+// subcommand and read back by `lookup` without lexing anything again.
+//
+// The index is made of fixed-width little-endian tables: the files, with the
+// hash of the text each was indexed from, then the identifiers sorted by
+// their text, each with the range of its occurrences, then the occurrences
+// themselves, then the text of the names. A lookup is a binary search of the
+// identifiers, so only the pages it touches of a memory-mapped index are
+// read. For the same reason, entries are only checked as they are read, and
+// opening an index only checks that its tables fit.
+class SymbolIndex {
+ public:
+  // The version of the format that `Builder::Write` writes. Bump it whenever
+  // the format changes.
+  static constexpr uint32_t SerializationVersion = 1;
+
+  struct Occurrence {
+    int32_t file;
+    int32_t token;
+    int32_t line;
+    int32_t column;
+  };
+
+  // Collects the occurrences of each file, interning identifiers into a table
+  // shared by every file, then writes the index.
+  class Builder {
+   public:
+    // Adds a file named `name` without any occurrences, returning its index.
+    // Files are added before any has its occurrences set.
+    auto AddFile(llvm::StringRef name) -> int32_t;
+
+    // Sets the occurrences of `file` to the identifiers of `tokens`, which
+    // were lexed from text whose hash is `source_hash`. Different files can
+    // be set on different threads at once.
+    auto SetFile(int32_t file, uint64_t source_hash, TokenizedBuffer& tokens)
+        -> void;
+
+    // Sets the occurrences of `file` to those of `old_file` in `index`,
+    // which must stay alive until the index is written. Every file copied
+    // is copied from the same index.
+    auto CopyFile(int32_t file, const SymbolIndex& index, int32_t old_file)
+        -> void;
+
+    auto Write(llvm::raw_ostream& output) -> void;
+
+   private:
+    struct File {
+      std::string name;
+      uint64_t source_hash = 0;
+      // The file of `copied_index_` this one is copied from, if any.
+      int32_t copied_from = -1;
+      llvm::SmallVector<std::pair<IdentifierTable::Id, Occurrence>, 0>
+          occurrences;
+    };
+
+    IdentifierTable identifiers_;
+    llvm::SmallVector<File, 0> files_;
+    const SymbolIndex* copied_index_ = nullptr;
+  };
+
+  // Reads the index that `Builder::Write` wrote to `data`, which must
+  // outlive it. Returns nothing if the tables don't fit in `data` or it was
+  // written with a different version of the format.
+  static auto Open(llvm::StringRef data) -> std::optional<SymbolIndex>;
+
+  // Returns the occurrences of `identifier`, ordered by file and then token.
+  auto Lookup(llvm::StringRef identifier) const
+      -> llvm::SmallVector<Occurrence>;
+
+  // Calls `callback` with each identifier and each of its occurrences.
+  auto ForEachOccurrence(
+      llvm::function_ref<auto(llvm::StringRef, Occurrence)->void> callback)
+      const -> void;
+
+  // Returns the file named `name`, if there is one.
+  auto FindFile(llvm::StringRef name) const -> std::optional<int32_t>;
+
+  auto file_name(int32_t file) const -> llvm::StringRef;
+  auto source_hash(int32_t file) const -> uint64_t;
+  auto file_count() const -> int32_t { return file_count_; }
+  auto identifier_count() const -> int32_t { return identifier_count_; }
+
+ private:
+  SymbolIndex() = default;
+
+  // Returns the text of the string table in `[offset, offset + size)`, or
+  // nothing if that's out of bounds.
+  auto GetString(uint64_t offset, uint64_t size) const -> llvm::StringRef;
+
+  // Returns the text of the `identifier`th identifier.
+  auto GetIdentifier(int32_t identifier) const -> llvm::StringRef;
+
+  // Returns the range of the `identifier`th identifier's occurrences, cut
+  // short where it goes out of bounds.
+  auto GetOccurrences(int32_t identifier) const
+      -> std::pair<uint64_t, uint64_t>;
+
+  auto GetOccurrence(uint64_t occurrence) const -> Occurrence;
+
+  int32_t file_count_ = 0;
+  int32_t identifier_count_ = 0;
+  uint64_t occurrence_count_ = 0;
+  const char* files_ = nullptr;
+  const char* identifiers_ = nullptr;
+  const char* occurrences_ = nullptr;
+  llvm::StringRef strings_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_DRIVER_SYMBOL_INDEX_H
@@ -0,0 +1,43 @@
+#ifndef COCKTAIL_LEXER_COMPILATION_CONTEXT_H
+#define COCKTAIL_LEXER_COMPILATION_CONTEXT_H
+
+#include <cstdint>
+
+#include "Cocktail/Lexer/IdentifierTable.h"
+#include "llvm/Support/Allocator.h"
+
+namespace Cocktail {
+
+// What the stages of one compilation share: an arena that the strings kept by
+// its tokens and IR are allocated in, and a table that its identifiers are
+// interned into. The strings of every stage are laid out next to each other,
+// and are all freed at once, slab by slab, when the context is destroyed,
+// rather than by each buffer and IR as it goes away.
+//
+// The context must outlive everything built with it. Its arena isn't locked,
+// so the stages must allocate in it from one thread at a time, as they do
+// when they're run in order: a stage that runs on several threads allocates
+// from the thread it was started on.
+class CompilationContext {
+ public:
+  CompilationContext() = default;
+  CompilationContext(const CompilationContext&) = delete;
+  auto operator=(const CompilationContext&) -> CompilationContext& = delete;
+
+  auto arena() -> llvm::BumpPtrAllocator& { return arena_; }
+
+  auto identifiers() -> IdentifierTable& { return identifiers_; }
+
+  // Returns the number of bytes allocated in the arena.
+  [[nodiscard]] auto arena_bytes() const -> int64_t {
+    return arena_.getBytesAllocated();
+  }
+
+ private:
+  llvm::BumpPtrAllocator arena_;
+  IdentifierTable identifiers_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_LEXER_COMPILATION_CONTEXT_H
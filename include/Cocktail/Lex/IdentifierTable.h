@@ -0,0 +1,156 @@
+#ifndef COCKTAIL_LEXER_IDENTIFIER_TABLE_H
+#define COCKTAIL_LEXER_IDENTIFIER_TABLE_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+namespace Cocktail {
+
+// An identifier's text along with its hash, which is computed once and then
+// reused by every table it is looked up in.
+struct HashedIdentifier {
+  HashedIdentifier() = default;
+
+  explicit HashedIdentifier(llvm::StringRef text)
+      : text(text), hash(llvm::hash_value(text)) {}
+
+  HashedIdentifier(llvm::StringRef text, size_t hash)
+      : text(text), hash(hash) {}
+
+  llvm::StringRef text;
+
+  size_t hash = 0;
+};
+
+// Interns identifiers from any number of files, handing out IDs that are the
+// same for the same text no matter which file or thread it came from. Later
+// phases can then compare and hash identifiers as integers. The table keeps
+// its own copy of the text, so its IDs outlive the source buffers. It can be
+// used from several threads at once: identifiers are split into shards by
+// their hash, and each shard has its own lock.
+class IdentifierTable {
+ public:
+  class Id {
+   public:
+    Id() = default;
+
+    friend auto operator==(const Id& lhs, const Id& rhs) -> bool {
+      return lhs.index_ == rhs.index_;
+    }
+    friend auto operator!=(const Id& lhs, const Id& rhs) -> bool {
+      return lhs.index_ != rhs.index_;
+    }
+    friend auto operator<(const Id& lhs, const Id& rhs) -> bool {
+      return lhs.index_ < rhs.index_;
+    }
+
+   private:
+    friend class IdentifierTable;
+    friend struct llvm::DenseMapInfo<Id>;
+
+    explicit Id(int32_t index) : index_(index) {}
+
+    int32_t index_ = -1;
+  };
+
+  IdentifierTable() = default;
+  IdentifierTable(const IdentifierTable&) = delete;
+  auto operator=(const IdentifierTable&) -> IdentifierTable& = delete;
+
+  // Returns the ID of `identifier`, adding it if it is new.
+  auto Intern(HashedIdentifier identifier) -> Id;
+
+  // Interns each of `identifiers` and stores its ID at the same index of
+  // `ids`. Each shard is locked once for the whole batch, so this is how a
+  // lexer should hand over all the identifiers of a file.
+  auto Intern(llvm::ArrayRef<HashedIdentifier> identifiers,
+              llvm::MutableArrayRef<Id> ids) -> void;
+
+  // Returns the text of an identifier.
+  [[nodiscard]] auto GetText(Id id) const -> llvm::StringRef;
+
+  // Returns the number of distinct identifiers interned so far.
+  [[nodiscard]] auto size() const -> int;
+
+ private:
+  // A power of two, so the shard and the index within it pack into an ID.
+  static constexpr int NumShards = 16;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    llvm::DenseMap<HashedIdentifier, int32_t> map;
+    llvm::SmallVector<llvm::StringRef, 0> texts;
+    llvm::BumpPtrAllocator allocator;
+  };
+
+  static auto GetShardIndex(size_t hash) -> int {
+    // The map buckets use the low bits, so the shard uses the high ones.
+    return (static_cast<uint64_t>(hash) >> 32) % NumShards;
+  }
+
+  // Interns into `shard`, which must be locked.
+  static auto InternLocked(Shard& shard, int shard_index,
+                           HashedIdentifier identifier) -> Id;
+
+  std::array<Shard, NumShards> shards_;
+};
+
+}  // namespace Cocktail
+
+namespace llvm {
+
+template <>
+struct DenseMapInfo<Cocktail::HashedIdentifier> {
+  static auto getEmptyKey() -> Cocktail::HashedIdentifier {
+    return Cocktail::HashedIdentifier(DenseMapInfo<StringRef>::getEmptyKey(),
+                                      0);
+  }
+  static auto getTombstoneKey() -> Cocktail::HashedIdentifier {
+    return Cocktail::HashedIdentifier(
+        DenseMapInfo<StringRef>::getTombstoneKey(), 0);
+  }
+  static auto getHashValue(const Cocktail::HashedIdentifier& identifier)
+      -> unsigned {
+    return identifier.hash;
+  }
+  static auto isEqual(const Cocktail::HashedIdentifier& lhs,
+                      const Cocktail::HashedIdentifier& rhs) -> bool {
+    // The empty and tombstone keys compare by address, like `StringRef` keys.
+    if (rhs.text.data() == getEmptyKey().text.data() ||
+        rhs.text.data() == getTombstoneKey().text.data()) {
+      return lhs.text.data() == rhs.text.data();
+    }
+    return lhs.hash == rhs.hash && lhs.text == rhs.text;
+  }
+};
+
+template <>
+struct DenseMapInfo<Cocktail::IdentifierTable::Id> {
+  static auto getEmptyKey() -> Cocktail::IdentifierTable::Id {
+    return Cocktail::IdentifierTable::Id(-1);
+  }
+  static auto getTombstoneKey() -> Cocktail::IdentifierTable::Id {
+    return Cocktail::IdentifierTable::Id(-2);
+  }
+  static auto getHashValue(const Cocktail::IdentifierTable::Id& id)
+      -> unsigned {
+    return DenseMapInfo<int32_t>::getHashValue(id.index_);
+  }
+  static auto isEqual(const Cocktail::IdentifierTable::Id& lhs,
+                      const Cocktail::IdentifierTable::Id& rhs) -> bool {
+    return lhs == rhs;
+  }
+};
+
+}  // namespace llvm
+
+#endif  // COCKTAIL_LEXER_IDENTIFIER_TABLE_H
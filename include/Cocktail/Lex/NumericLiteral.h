@@ -36,6 +36,12 @@ class LexedNumericLiteral {
 
   [[nodiscard]] auto text() const -> llvm::StringRef { return text_; }
 
+  // Returns whether the literal has no radix point, and so is an integer if it
+  // is valid.
+  [[nodiscard]] auto is_integer() const -> bool {
+    return radix_point_ == static_cast<int>(text_.size());
+  }
+
  private:
   LexedNumericLiteral() = default;
 
@@ -0,0 +1,28 @@
+#ifndef COCKTAIL_LEXER_REAL_LITERAL_CONVERSION_H
+#define COCKTAIL_LEXER_REAL_LITERAL_CONVERSION_H
+
+#include "llvm/ADT/APInt.h"
+
+namespace Cocktail {
+
+// Returns the real literal `mantissa * 10^exponent`, or `mantissa *
+// 2^exponent` if it isn't decimal, rounded to the nearest `double`, with ties
+// to even; values too large for a `double` are infinity. The `mantissa` is
+// unsigned and the `exponent` signed, as `LexedNumericLiteral::RealValue`
+// and `TokenizedBuffer::RealLiteralValue` hold them.
+//
+// Decimal literals are converted with the Eisel-Lemire algorithm, falling
+// back to `llvm::APFloat` in the rare cases it can't decide the rounding,
+// and other literals by assembling the bits directly, so that converting
+// costs about as much as a few multiplications.
+auto RealLiteralToDouble(const llvm::APInt& mantissa,
+                         const llvm::APInt& exponent, bool is_decimal)
+    -> double;
+
+// As `RealLiteralToDouble`, but rounded to the nearest `float`.
+auto RealLiteralToFloat(const llvm::APInt& mantissa,
+                        const llvm::APInt& exponent, bool is_decimal) -> float;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_LEXER_REAL_LITERAL_CONVERSION_H
@@ -6,6 +6,7 @@
 
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
 
 namespace Cocktail::Lex {
 
@@ -18,6 +19,12 @@ struct StringLiteral {
   auto ComputeValue(DiagnosticEmitter<const char*>& emitter) const
       -> std::string;
 
+  // 与上面相同，但值存放在`allocator`中。不含转义序列的单行字符串字面量的值
+  // 就是其内容本身，此时直接返回对源文本的引用而不进行复制。
+  auto ComputeValue(llvm::BumpPtrAllocator& allocator,
+                    DiagnosticEmitter<const char*>& emitter) const
+      -> llvm::StringRef;
+
   // 返回字符串字面量的完整文本。
   [[nodiscard]] auto text() const -> llvm::StringRef { return text_; }
 
@@ -26,11 +26,13 @@ class TokenKind : public COCKTAIL_ENUM_BASE(TokenKind) {
 
   /// 检查此标记是否为简单的符号序列（如标点符号）。
   /// 这些符号可以直接出现在源代码中，并且可以使用starts_with进行词法分析。
-  [[nodiscard]] auto is_symbol() const -> bool { return IsSymbol[AsInt()]; }
+  [[nodiscard]] auto is_symbol() const -> bool {
+    return HasProperty(SymbolProperty);
+  }
 
   /// 检查此标记是否为分组符号（如括号、大括号等），这些符号在标记流中必须匹配。
   [[nodiscard]] auto is_grouping_symbol() const -> bool {
-    return IsGroupingSymbol[AsInt()];
+    return HasProperty(GroupingSymbolProperty);
   }
 
   /// 对于结束符号，返回其对应的开头符号。
@@ -42,7 +44,7 @@ class TokenKind : public COCKTAIL_ENUM_BASE(TokenKind) {
 
   /// 检查此标记是否为分组的开头符号。
   [[nodiscard]] auto is_opening_symbol() const -> bool {
-    return IsOpeningSymbol[AsInt()];
+    return HasProperty(OpeningSymbolProperty);
   }
 
   /// 对于开头符号，返回其对应的结束符号。
@@ -54,22 +56,22 @@ class TokenKind : public COCKTAIL_ENUM_BASE(TokenKind) {
 
   /// 检查此标记是否为分组的结束符号。
   [[nodiscard]] auto is_closing_symbol() const -> bool {
-    return IsClosingSymbol[AsInt()];
+    return HasProperty(ClosingSymbolProperty);
   }
 
   /// 检查此标记是否为单字符符号，且此字符不是其他符号的一部分。
   [[nodiscard]] auto is_one_char_symbol() const -> bool {
-    return IsOneCharSymbol[AsInt()];
+    return HasProperty(OneCharSymbolProperty);
   };
 
   /// 检查此标记是否为关键字。
-  [[nodiscard]] auto is_keyword() const -> bool { return IsKeyword[AsInt()]; };
+  [[nodiscard]] auto is_keyword() const -> bool {
+    return HasProperty(KeywordProperty);
+  };
 
   /// 检查此标记是否为带有大小的类型字面量（如整数、浮点数类型字面量）。
   [[nodiscard]] auto is_sized_type_literal() const -> bool {
-    return *this == TokenKind::IntegerTypeLiteral ||
-           *this == TokenKind::UnsignedIntegerTypeLiteral ||
-           *this == TokenKind::FloatingPointTypeLiteral;
+    return HasProperty(SizedTypeLiteralProperty);
   };
 
   /// 如果此标记在源代码中有固定的拼写，则返回它。否则返回空字符串。
@@ -77,6 +79,12 @@ class TokenKind : public COCKTAIL_ENUM_BASE(TokenKind) {
     return FixedSpelling[AsInt()];
   };
 
+  /// 固定拼写的长度，没有固定拼写时为0。词法分析器只需要长度时，
+  /// 这比`fixed_spelling().size()`少一次加载。
+  [[nodiscard]] auto fixed_spelling_size() const -> int {
+    return FixedSpellingSize[AsInt()];
+  }
+
   /// 获取此标记所对应的解析树节点的预期数量。
   [[nodiscard]] auto expected_parse_tree_size() const -> int {
     return ExpectedParseTreeSize[AsInt()];
@@ -94,17 +102,39 @@ class TokenKind : public COCKTAIL_ENUM_BASE(TokenKind) {
   }
 
  private:
+  /// 每种标记的属性位。所有布尔属性合在一张按种类索引的表里，
+  /// 因此每个查询只是一次索引加载和一次掩码。
+  enum Property : uint8_t {
+    SymbolProperty = 1 << 0,
+    GroupingSymbolProperty = 1 << 1,
+    OpeningSymbolProperty = 1 << 2,
+    ClosingSymbolProperty = 1 << 3,
+    OneCharSymbolProperty = 1 << 4,
+    KeywordProperty = 1 << 5,
+    SizedTypeLiteralProperty = 1 << 6,
+  };
+
+  [[nodiscard]] auto HasProperty(Property property) const -> bool {
+    return (Properties[AsInt()] & property) != 0;
+  }
+
+  /// 带大小的类型字面量在TokenKind.def中没有自己的宏，因此按名称标记。
+  static constexpr auto SizedTypeLiteralProperties(RawEnumType kind)
+      -> uint8_t {
+    return kind == RawEnumType::IntegerTypeLiteral ||
+                   kind == RawEnumType::UnsignedIntegerTypeLiteral ||
+                   kind == RawEnumType::FloatingPointTypeLiteral
+               ? SizedTypeLiteralProperty
+               : 0;
+  }
+
   static const TokenKind KeywordTokensStorage[];
 
-  static const bool IsSymbol[];
-  static const bool IsGroupingSymbol[];
-  static const bool IsOpeningSymbol[];
-  static const bool IsClosingSymbol[];
+  static const uint8_t Properties[];
   static const TokenKind OpeningSymbol[];
   static const TokenKind ClosingSymbol[];
-  static const bool IsOneCharSymbol[];
-  static const bool IsKeyword[];
   static const llvm::StringLiteral FixedSpelling[];
+  static const uint8_t FixedSpellingSize[];
   static const int8_t ExpectedParseTreeSize[];
 };
 
@@ -120,6 +150,61 @@ constexpr TokenKind TokenKind::KeywordTokensStorage[] = {
 constexpr llvm::ArrayRef<TokenKind> TokenKind::KeywordTokens =
     KeywordTokensStorage;
 
+// The tables below are defined here rather than in TokenKind.cc, so that the
+// queries inline to a load from them, or fold away for a constant kind.
+
+constexpr uint8_t TokenKind::Properties[] = {
+#define COCKTAIL_TOKEN(TokenName) \
+  SizedTypeLiteralProperties(RawEnumType::TokenName),
+#define COCKTAIL_SYMBOL_TOKEN(TokenName, Spelling) SymbolProperty,
+#define COCKTAIL_ONE_CHAR_SYMBOL_TOKEN(TokenName, Spelling) \
+  SymbolProperty | OneCharSymbolProperty,
+#define COCKTAIL_OPENING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, ClosingName) \
+  SymbolProperty | OneCharSymbolProperty | GroupingSymbolProperty |         \
+      OpeningSymbolProperty,
+#define COCKTAIL_CLOSING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, OpeningName) \
+  SymbolProperty | OneCharSymbolProperty | GroupingSymbolProperty |         \
+      ClosingSymbolProperty,
+#define COCKTAIL_KEYWORD_TOKEN(TokenName, Spelling) KeywordProperty,
+#include "Cocktail/Lex/TokenKind.def"
+};
+
+constexpr TokenKind TokenKind::OpeningSymbol[] = {
+#define COCKTAIL_TOKEN(TokenName) Error,
+#define COCKTAIL_CLOSING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, OpeningName) \
+  OpeningName,
+#include "Cocktail/Lex/TokenKind.def"
+};
+
+constexpr TokenKind TokenKind::ClosingSymbol[] = {
+#define COCKTAIL_TOKEN(TokenName) Error,
+#define COCKTAIL_OPENING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, ClosingName) \
+  ClosingName,
+#include "Cocktail/Lex/TokenKind.def"
+};
+
+constexpr llvm::StringLiteral TokenKind::FixedSpelling[] = {
+#define COCKTAIL_TOKEN(TokenName) "",
+#define COCKTAIL_SYMBOL_TOKEN(TokenName, Spelling) Spelling,
+#define COCKTAIL_KEYWORD_TOKEN(TokenName, Spelling) Spelling,
+#include "Cocktail/Lex/TokenKind.def"
+};
+
+constexpr uint8_t TokenKind::FixedSpellingSize[] = {
+#define COCKTAIL_TOKEN(TokenName) 0,
+#define COCKTAIL_SYMBOL_TOKEN(TokenName, Spelling) \
+  llvm::StringLiteral(Spelling).size(),
+#define COCKTAIL_KEYWORD_TOKEN(TokenName, Spelling) \
+  llvm::StringLiteral(Spelling).size(),
+#include "Cocktail/Lex/TokenKind.def"
+};
+
+constexpr int8_t TokenKind::ExpectedParseTreeSize[] = {
+#define COCKTAIL_TOKEN(Name) 1,
+#define COCKTAIL_TOKEN_WITH_VIRTUAL_NODE(Size) 2,
+#include "Cocktail/Lex/TokenKind.def"
+};
+
 }  // namespace Cocktail::Lex
 
 namespace llvm {
@@ -0,0 +1,103 @@
+#ifndef COCKTAIL_LEXER_TOKEN_KIND_SET_H
+#define COCKTAIL_LEXER_TOKEN_KIND_SET_H
+
+#include <cstdint>
+#include <initializer_list>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Lexer/TokenKind.h"
+#include "llvm/Support/MathExtras.h"
+
+namespace Cocktail {
+
+// Token kinds are numbered by their position in the registry, so that tables
+// indexed by kind don't depend on how `TokenKind` represents them.
+enum class TokenKindIndex : uint8_t {
+#define COCKTAIL_TOKEN(Name) Name,
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+constexpr int NumTokenKinds = 0
+#define COCKTAIL_TOKEN(Name) +1
+#include "Cocktail/Lexer/TokenRegistry.def"
+    ;
+
+// The registry order is also the order of `TokenKind`'s enumerators, so this
+// compiles down to the token kind's value.
+constexpr auto GetTokenKindIndex(TokenKind kind) -> int {
+  switch (kind) {
+#define COCKTAIL_TOKEN(Name) \
+  case TokenKind::Name():    \
+    return static_cast<int>(TokenKindIndex::Name);
+#include "Cocktail/Lexer/TokenRegistry.def"
+  }
+  COCKTAIL_FATAL() << "Unknown token kind!";
+}
+
+// Every token kind, indexed by `GetTokenKindIndex`.
+constexpr TokenKind AllTokenKinds[] = {
+#define COCKTAIL_TOKEN(Name) TokenKind::Name(),
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+// A set of token kinds, stored as one bit per kind so that a membership test
+// is a single load and mask however many kinds the set holds.
+class TokenKindSet {
+ public:
+  constexpr TokenKindSet() = default;
+
+  constexpr TokenKindSet(std::initializer_list<TokenKind> kinds) {
+    for (TokenKind kind : kinds) {
+      Add(kind);
+    }
+  }
+
+  constexpr auto Add(TokenKind kind) -> TokenKindSet& {
+    int index = GetTokenKindIndex(kind);
+    words_[index / BitsPerWord] |= uint64_t{1} << (index % BitsPerWord);
+    return *this;
+  }
+
+  [[nodiscard]] constexpr auto Contains(TokenKind kind) const -> bool {
+    int index = GetTokenKindIndex(kind);
+    return (words_[index / BitsPerWord] >> (index % BitsPerWord)) & 1;
+  }
+
+  [[nodiscard]] auto size() const -> int {
+    int size = 0;
+    for (uint64_t word : words_) {
+      size += llvm::countPopulation(word);
+    }
+    return size;
+  }
+
+  // Calls `callback` with each kind in the set, in registry order.
+  template <typename CallbackT>
+  auto ForEach(CallbackT callback) const -> void {
+    for (int word_index = 0; word_index != NumWords; ++word_index) {
+      for (uint64_t word = words_[word_index]; word != 0; word &= word - 1) {
+        callback(AllTokenKinds[word_index * BitsPerWord +
+                               llvm::countTrailingZeros(word)]);
+      }
+    }
+  }
+
+  friend constexpr auto operator|(TokenKindSet lhs, TokenKindSet rhs)
+      -> TokenKindSet {
+    for (int i = 0; i != NumWords; ++i) {
+      lhs.words_[i] |= rhs.words_[i];
+    }
+    return lhs;
+  }
+
+ private:
+  static constexpr int BitsPerWord = 64;
+  static constexpr int NumWords =
+      (NumTokenKinds + BitsPerWord - 1) / BitsPerWord;
+
+  uint64_t words_[NumWords] = {};
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_LEXER_TOKEN_KIND_SET_H
@@ -1,20 +1,33 @@
 #ifndef COCKTAIL_LEXER_TOKENIZED_BUFFER_H
 #define COCKTAIL_LEXER_TOKENIZED_BUFFER_H
 
+#include <atomic>
 #include <cstdint>
 #include <iterator>
 
+#include "Cocktail/Common/Cancellation.h"
+#include "Cocktail/Common/MemoryUsage.h"
 #include "Cocktail/Common/Ostream.h"
+#include "Cocktail/Common/TaskScheduler.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Lexer/CompilationContext.h"
+#include "Cocktail/Lexer/IdentifierTable.h"
 #include "Cocktail/Lexer/TokenKind.h"
+#include "Cocktail/Lexer/TokenKindSet.h"
 #include "Cocktail/Source/SourceBuffer.h"
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/CachedHashString.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/iterator.h"
 #include "llvm/ADT/iterator_range.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Compiler.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace Cocktail {
@@ -108,6 +121,7 @@ class TokenizedBuffer {
 
    private:
     friend class TokenizedBuffer;
+    friend struct llvm::DenseMapInfo<Identifier>;
 
     explicit Identifier(int index) : index_(index) {}
 
@@ -158,16 +172,17 @@ class TokenizedBuffer {
 
   class RealLiteralValue {
    public:
-    [[nodiscard]] auto Mantissa() const -> const llvm::APInt& {
-      return buffer_->literal_int_storage_[literal_index_];
-    }
+    [[nodiscard]] auto Mantissa() const -> llvm::APInt;
 
-    [[nodiscard]] auto Exponent() const -> const llvm::APInt& {
-      return buffer_->literal_int_storage_[literal_index_ + 1];
-    }
+    [[nodiscard]] auto Exponent() const -> llvm::APInt;
 
     [[nodiscard]] auto IsDecimal() const -> bool { return is_decimal_; }
 
+    // Returns the value rounded to the nearest `double` or `float`, as
+    // `RealLiteralToDouble` does, without going through `llvm::APFloat`.
+    [[nodiscard]] auto ToDouble() const -> double;
+    [[nodiscard]] auto ToFloat() const -> float;
+
     auto Print(llvm::raw_ostream& output_stream) const -> void {
       output_stream << Mantissa() << "*" << (is_decimal_ ? "10" : "2") << "^"
                     << Exponent();
@@ -202,10 +217,117 @@ class TokenizedBuffer {
     int* last_line_lexed_to_column_;
   };
 
-  static auto Lex(SourceBuffer& source, DiagnosticConsumer& consumer)
+  // Counts of how often the lexer outgrew the capacity it reserved up front
+  // from the size of the source.
+  struct LexStats {
+    int token_reallocations = 0;
+    int line_reallocations = 0;
+    int identifier_reallocations = 0;
+  };
+
+  // When the values of numeric and string literals are computed.
+  enum class LiteralValues {
+    // While lexing, so invalid literals are diagnosed as they are lexed.
+    Eager,
+    // The first time each value is asked for, for clients that rarely or never
+    // read them. Lexing only records where each literal is, and invalid
+    // literals are neither diagnosed nor turned into error tokens until
+    // `ValidateLiterals` is called. Until then, an invalid literal's value is
+    // zero.
+    Lazy,
+  };
+
+  // The default size above which `Lex` splits a source into chunks to lex
+  // them concurrently.
+  static constexpr int64_t DefaultParallelLexChunkSize = 1 << 20;
+
+  static auto Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                  LiteralValues literal_values = LiteralValues::Eager)
+      -> TokenizedBuffer;
+
+  // Lexes `source` like the `Lex` above, as a stage of the compilation of
+  // `context`. The string literal values that aren't in the source are
+  // allocated in its arena, where `ReleaseLiteralValues` leaves them, and the
+  // identifiers are interned into its table.
+  static auto Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                  CompilationContext& context,
+                  LiteralValues literal_values = LiteralValues::Eager)
+      -> TokenizedBuffer;
+
+  // Lexes `source` like the `Lex` above, but stops early once `cancellation`
+  // is cancelled, which is polled every few hundred tokens. The tokens lexed
+  // by then are kept, the groups left open are closed without being
+  // diagnosed, and the buffer is marked as `cancelled`.
+  static auto Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                  const CancellationToken& cancellation,
+                  LiteralValues literal_values = LiteralValues::Eager)
+      -> TokenizedBuffer;
+
+  // Lexes `source` like the serial `Lex`, but splits it at line boundaries into
+  // chunks of about `chunk_size` bytes and lexes those concurrently on
+  // `scheduler`. The chunks are stitched back together so that the tokens,
+  // lines, identifiers and the diagnostics, including their order, are the
+  // same as lexing serially. If a split turns out to fall inside a multi-line
+  // string literal, this falls back to lexing serially.
+  static auto Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                  TaskScheduler& scheduler,
+                  int64_t chunk_size = DefaultParallelLexChunkSize,
+                  LiteralValues literal_values = LiteralValues::Eager)
+      -> TokenizedBuffer;
+
+  // Called by `LexStream` with the buffer lexed so far and the tokens that were
+  // just added to it.
+  using StreamedTokensHandler =
+      llvm::function_ref<auto(const TokenizedBuffer& buffer,
+                              llvm::iterator_range<TokenIterator> tokens)
+                             ->void>;
+
+  // Lexes a streaming `source` while it is read, so that the tokens of its
+  // first lines are available before the rest of it has been written. Each
+  // time more complete lines have been read, they are lexed and handed to
+  // `on_tokens`, and their diagnostics are emitted. The last call has the
+  // tokens of the last line, along with the recovery tokens closing any groups
+  // left open and the end of file token. Until then, a group that is still
+  // open has no matched closing token. Lines that a multi-line string literal
+  // reaches are held back until it ends. Once the stream has ended, the result
+  // is the same as lexing its text with `Lex`.
+  static auto LexStream(SourceBuffer& source, DiagnosticConsumer& consumer,
+                        StreamedTokensHandler on_tokens,
+                        LiteralValues literal_values = LiteralValues::Eager)
+      -> TokenizedBuffer;
+
+  // An edit of a source, replacing `removed_length` bytes at `offset` with
+  // `inserted_text`.
+  struct TextEdit {
+    int64_t offset;
+    int64_t removed_length;
+    llvm::StringRef inserted_text;
+  };
+
+  // Lexes `source`, which must be the source of `previous` after `edit`, by
+  // reusing the tokens of `previous` for the text the edit left alone. Only
+  // the text from the start of the line the edit begins on, or of a multi-line
+  // string literal reaching that line, up to the first line after the edit
+  // where lexing lines up with `previous` again is lexed anew, and only its
+  // diagnostics are emitted, along with those of matching the groups after it
+  // again. The result is the same as lexing `source` with `Lex`, and with the
+  // same literal values mode as `previous`, except that `has_errors` stays set
+  // if `previous` had errors.
+  static auto Relex(const TokenizedBuffer& previous, SourceBuffer& source,
+                    const TextEdit& edit, DiagnosticConsumer& consumer)
       -> TokenizedBuffer;
 
-  [[nodiscard]] auto GetKind(Token token) const -> TokenKind;
+  // Computes the value of every literal of a buffer lexed with
+  // `LiteralValues::Lazy`, emitting the diagnostics that lexing eagerly would
+  // have to `consumer`, after any emitted while lexing. Invalid numeric
+  // literals become error tokens, and `has_errors` accounts for all of them.
+  // Afterwards the buffer is the same as one lexed eagerly. Does nothing for a
+  // buffer lexed eagerly.
+  auto ValidateLiterals(DiagnosticConsumer& consumer) -> void;
+
+  [[nodiscard]] auto GetKind(Token token) const -> TokenKind {
+    return token_kinds_[token.index_];
+  }
   [[nodiscard]] auto GetLine(Token token) const -> Line;
 
   [[nodiscard]] auto GetLineNumber(Token token) const -> int;
@@ -219,19 +341,37 @@ class TokenizedBuffer {
 
   [[nodiscard]] auto GetIdentifier(Token token) const -> Identifier;
 
-  [[nodiscard]] auto GetIntegerLiteral(Token token) const -> const llvm::APInt&;
+  [[nodiscard]] auto GetIntegerLiteral(Token token) const -> llvm::APInt;
 
   [[nodiscard]] auto GetRealLiteral(Token token) const -> RealLiteralValue;
 
   [[nodiscard]] auto GetStringLiteral(Token token) const -> llvm::StringRef;
 
-  [[nodiscard]] auto GetTypeLiteralSize(Token token) const
-      -> const llvm::APInt&;
+  // Returns the value of a string literal with its hash, which was computed
+  // when it was lexed, so that values can be interned without hashing them
+  // again.
+  [[nodiscard]] auto GetHashedStringLiteral(Token token) const
+      -> llvm::CachedHashStringRef;
+
+  [[nodiscard]] auto GetTypeLiteralSize(Token token) const -> llvm::APInt;
 
   [[nodiscard]] auto GetMatchedClosingToken(Token opening_token) const -> Token;
 
   [[nodiscard]] auto GetMatchedOpeningToken(Token closing_token) const -> Token;
 
+  // Returns the first token at or after `token` whose kind is in `kinds`, or
+  // the end of the tokens if there is none. Runs of other tokens are scanned
+  // many kinds at a time.
+  [[nodiscard]] auto FindNextKindIn(Token token,
+                                    const TokenKindSet& kinds) const
+      -> TokenIterator;
+
+  // Returns the token whose text includes the byte at `offset` in the source,
+  // or llvm::None if that byte is outside of any token, such as whitespace or
+  // a comment.
+  [[nodiscard]] auto FindTokenAtOffset(int64_t offset) const
+      -> llvm::Optional<Token>;
+
   // Returns whether the given token has leading whitespace.
   [[nodiscard]] auto HasLeadingWhitespace(Token token) const -> bool;
   // Returns whether the given token has trailing whitespace.
@@ -245,18 +385,89 @@ class TokenizedBuffer {
   // Returns the text for an identifier.
   [[nodiscard]] auto GetIdentifierText(Identifier id) const -> llvm::StringRef;
 
-  auto Print(llvm::raw_ostream& output_stream) const -> void;
+  // Returns the identifier spelled `text`, or llvm::None if no token of the
+  // buffer spells it.
+  [[nodiscard]] auto FindIdentifier(llvm::StringRef text) const
+      -> llvm::Optional<Identifier>;
+
+  // Interns every identifier of the buffer into `table`, which may be shared
+  // with buffers being interned on other threads, so that the same identifier
+  // in different files has the same ID. The hash of each identifier computed
+  // while lexing is reused. A buffer made by `Relex` has to be interned again.
+  auto InternIdentifiers(IdentifierTable& table) -> void;
+
+  // Returns the ID of an identifier in the table the buffer was interned into.
+  [[nodiscard]] auto GetInternedIdentifier(Identifier id) const
+      -> IdentifierTable::Id;
+
+  // The formats that `Print` can write the tokens in.
+  enum class PrintFormat {
+    // YAML-like, with each token's fields aligned in columns.
+    Yaml,
+    // Newline-delimited JSON, with one object per token. This is written in a
+    // single pass over the tokens, so it is the cheaper format to produce for
+    // large buffers, and the easier one for tools to read.
+    Ndjson,
+  };
+
+  auto Print(llvm::raw_ostream& output_stream,
+             PrintFormat format = PrintFormat::Yaml) const -> void;
 
   auto PrintToken(llvm::raw_ostream& output_stream, Token token) const -> void;
 
+  // The version of the format that `Serialize` writes. Bump it whenever the
+  // format, or the meaning of anything it stores, changes.
+  static constexpr uint32_t SerializationVersion = 1;
+
+  // Writes the tokens, lines, identifiers and literal values in a compact
+  // binary format, which `Deserialize` reads back without lexing again. The
+  // source itself isn't written, only its size and a hash of its text. The
+  // format is made of fixed-width little-endian tables aligned to 8 bytes, so
+  // it can be read straight out of a memory-mapped file.
+  auto Serialize(llvm::raw_ostream& output_stream) const -> void;
+
+  // Reconstructs the buffer that `Serialize` wrote to `data`, for `source`.
+  // Returns nothing if `data` is malformed, was written with a different
+  // version of the format or token kinds, or was written for a source with
+  // different text, in which case the caller should lex `source` instead. The
+  // result doesn't refer to `data`.
+  static auto Deserialize(SourceBuffer& source, llvm::StringRef data)
+      -> llvm::Optional<TokenizedBuffer>;
+
   [[nodiscard]] auto has_errors() const -> bool { return has_errors_; }
 
+  // Whether lexing was cancelled before the end of the source, in which case
+  // the buffer only has the tokens of its start.
+  [[nodiscard]] auto cancelled() const -> bool { return cancelled_; }
+
+  [[nodiscard]] auto lex_stats() const -> const LexStats& { return lex_stats_; }
+
   [[nodiscard]] auto tokens() const -> llvm::iterator_range<TokenIterator> {
     return llvm::make_range(TokenIterator(Token(0)),
-                            TokenIterator(Token(token_infos_.size())));
+                            TokenIterator(Token(token_kinds_.size())));
   }
 
-  [[nodiscard]] auto size() const -> int { return token_infos_.size(); }
+  [[nodiscard]] auto size() const -> int { return token_kinds_.size(); }
+
+  // The number of distinct identifiers in the buffer.
+  [[nodiscard]] auto identifier_count() const -> int {
+    return identifier_infos_.size();
+  }
+
+  // Returns the number of bytes allocated to store the buffer, not counting
+  // its source.
+  [[nodiscard]] auto memory_bytes() const -> int64_t;
+
+  // Returns the bytes used and allocated by each of the buffer's containers,
+  // which add up to `memory_bytes`. The token columns are counted together
+  // as `token_infos`.
+  [[nodiscard]] auto GetMemoryUsage() const -> MemoryUsage;
+
+  // Frees the values of the buffer's literals, for once nothing will ask for
+  // them again, returning the number of bytes freed. Afterwards asking for a
+  // literal's value, printing or serializing the buffer, or relexing from it
+  // is an error; everything else, including parsing, still works.
+  auto ReleaseLiteralValues() -> int64_t;
 
  private:
   class Lexer;
@@ -272,14 +483,26 @@ class TokenizedBuffer {
 
     auto GetLocation(const char* loc) -> DiagnosticLocation override;
 
+    // Resolves the locations in order of offset, so that each line search
+    // only needs to look past the line of the previous location.
+    auto GetLocations(llvm::ArrayRef<const char*> locs,
+                      llvm::MutableArrayRef<DiagnosticLocation> locations)
+        -> void override;
+
    private:
+    // Returns the index of the line containing `offset`, searching forward
+    // from the line `first`.
+    auto FindLine(int64_t offset, int first) const -> int;
+
+    // Computes the location of `offset` given the line containing it.
+    auto MakeLocation(int64_t offset, int line_index) const
+        -> DiagnosticLocation;
+
     TokenizedBuffer* buffer_;
     int* last_line_lexed_to_column_;
   };
 
   struct PrintWidths {
-    auto Widen(const PrintWidths& widths) -> void;
-
     int index;
     int kind;
     int column;
@@ -287,6 +510,28 @@ class TokenizedBuffer {
     int indent;
   };
 
+  union TokenPayload {
+    static_assert(
+        sizeof(Token) <= sizeof(int32_t),
+        "Unable to pack token and identifier index into the same space!");
+
+    Identifier id;
+    // The literal's index in the literal storage, or for a small numeric
+    // literal its value, and the length of its source text so that it need not
+    // be lexed again to find its spelling.
+    struct {
+      int32_t index;
+      int32_t length;
+    } literal;
+    Token closing_token;
+    Token opening_token;
+    int32_t error_length;
+  };
+
+  // A single token's data, gathered from the columns below. This is only used
+  // to add tokens and to read several fields of one token at once. Only the
+  // token's offset is stored, so its line and column are found again when it
+  // is read.
   struct TokenInfo {
     TokenKind kind;
 
@@ -298,17 +543,7 @@ class TokenizedBuffer {
 
     int32_t column;
 
-    union {
-      static_assert(
-          sizeof(Token) <= sizeof(int32_t),
-          "Unable to pack token and identifier index into the same space!");
-
-      Identifier id;
-      int32_t literal_index;
-      Token closing_token;
-      Token opening_token;
-      int32_t error_length;
-    };
+    TokenPayload payload;
   };
 
   struct LineInfo {
@@ -321,35 +556,167 @@ class TokenizedBuffer {
 
   struct IdentifierInfo {
     llvm::StringRef text;
+
+    // The hash of `text`, as used by `identifier_map_` and `IdentifierTable`.
+    size_t hash;
   };
 
   explicit TokenizedBuffer(SourceBuffer& source) : source_(&source) {}
 
+  // Lexes all of `source` on the calling thread, or its start if
+  // `cancellation` is cancelled first, allocating string literal values in
+  // the arena of `context` if there is one.
+  static auto LexSerially(SourceBuffer& source, DiagnosticConsumer& consumer,
+                          CompilationContext* context,
+                          LiteralValues literal_values,
+                          const CancellationToken* cancellation = nullptr)
+      -> TokenizedBuffer;
+
+  // Returns the allocator of the string literal values that don't refer into
+  // the source.
+  [[nodiscard]] auto string_storage() const -> llvm::BumpPtrAllocator& {
+    return context_ != nullptr ? context_->arena()
+                               : string_storage_allocator_;
+  }
+
   auto GetLineInfo(Line line) -> LineInfo&;
   [[nodiscard]] auto GetLineInfo(Line line) const -> const LineInfo&;
+  auto ReserveFor(llvm::StringRef text) -> void;
+  // Stores a numeric literal value and returns the index for its payload.
+  // These are const so that lazily computed values can be stored from the
+  // const accessors.
+  auto AddIntegerValue(llvm::APInt value) const -> int32_t;
+  auto AddRealValue(llvm::APInt mantissa, llvm::APInt exponent) const
+      -> int32_t;
+  [[nodiscard]] auto GetIntegerValue(int32_t index) const -> llvm::APInt;
+  // Returns the payload literal index of a numeric or string literal token,
+  // computing its value first if it is lazy and has not been asked for yet.
+  [[nodiscard]] auto GetLiteralIndex(Token token) const -> int32_t;
+  // Computes and stores the value of a numeric or string literal token,
+  // returning its payload literal index, or nothing if the literal is invalid
+  // beyond recovery.
+  auto ComputeLiteralValue(Token token,
+                           DiagnosticEmitter<const char*>& emitter) const
+      -> llvm::Optional<int32_t>;
   auto AddLine(LineInfo info) -> Line;
-  auto GetTokenInfo(Token token) -> TokenInfo&;
-  [[nodiscard]] auto GetTokenInfo(Token token) const -> const TokenInfo&;
+  [[nodiscard]] auto GetTokenInfo(Token token) const -> TokenInfo;
+  auto GetTokenPayload(Token token) -> TokenPayload&;
+  [[nodiscard]] auto GetTokenPayload(Token token) const -> const TokenPayload&;
   auto AddToken(TokenInfo info) -> Token;
+  // Appends the offset of the next token, which mustn't be before that of the
+  // token before it.
+  auto AddTokenOffset(int64_t offset) -> void;
+  // Returns the offset in the source that `token` starts at.
+  [[nodiscard]] auto GetTokenStart(Token token) const -> int64_t {
+    int64_t offset = token_offsets_[token.index_];
+    if (LLVM_UNLIKELY(!token_offset_segments_.empty())) {
+      offset += static_cast<int64_t>(
+                    llvm::upper_bound(token_offset_segments_, token.index_) -
+                    token_offset_segments_.begin())
+                << 32;
+    }
+    return offset;
+  }
+  // Returns the line that the text at `offset` is on.
+  [[nodiscard]] auto FindLine(int64_t offset) const -> Line;
   [[nodiscard]] auto GetTokenPrintWidths(Token token) const -> PrintWidths;
+  // Prints a token with its fields padded to `widths`, which must be at least
+  // the token's own widths.
   auto PrintToken(llvm::raw_ostream& output_stream, Token token,
                   PrintWidths widths) const -> void;
+  auto PrintNdjson(llvm::raw_ostream& output_stream) const -> void;
 
   SourceBuffer* source_;
 
-  llvm::SmallVector<TokenInfo, 16> token_infos_;
+  // Tokens are stored as parallel columns indexed by `Token`. The parser
+  // mostly scans token kinds, so keeping them dense means each cache line it
+  // touches holds many kinds rather than one or two whole tokens.
+  llvm::SmallVector<TokenKind, 16> token_kinds_;
+
+  llvm::BitVector token_has_trailing_space_;
+
+  llvm::BitVector token_is_recovery_;
+
+  // The offset in the source that each token starts at, which is all that
+  // its text needs. Its line and column are found in `line_infos_` when they
+  // are asked for. Only the low 32 bits are kept: tokens start in order, so
+  // the rest are the number of entries of `token_offset_segments_`, the first
+  // token past each 4GiB of the source, at or before the token.
+  llvm::SmallVector<uint32_t, 16> token_offsets_;
+
+  llvm::SmallVector<int32_t, 0> token_offset_segments_;
+
+  // The line that `FindLine` found last, which it tries first, along with the
+  // line after it, as tokens are mostly looked at in order. It is only a
+  // hint, so threads reading the buffer at once may overwrite each other's.
+  class LineCursor {
+   public:
+    LineCursor() = default;
+    LineCursor(const LineCursor& other) : line_(other.get()) {}
+    auto operator=(const LineCursor& other) -> LineCursor& {
+      set(other.get());
+      return *this;
+    }
+
+    [[nodiscard]] auto get() const -> int32_t {
+      return line_.load(std::memory_order_relaxed);
+    }
+    auto set(int32_t line) -> void {
+      line_.store(line, std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<int32_t> line_ = 0;
+  };
+  mutable LineCursor line_cursor_;
+
+  llvm::SmallVector<TokenPayload, 16> token_payloads_;
 
   llvm::SmallVector<LineInfo, 16> line_infos_;
 
   llvm::SmallVector<IdentifierInfo, 16> identifier_infos_;
 
-  llvm::SmallVector<llvm::APInt, 16> literal_int_storage_;
+  // The literal storage is mutable so that lazily computed values can be
+  // added to it. A buffer with lazy literal values therefore must not be read
+  // from several threads at once.
+  mutable llvm::SmallVector<llvm::APInt, 16> literal_int_storage_;
+
+  // String literal values, in token order once any lazy values are validated.
+  // A value that needs no unescaping refers directly into the source; the rest
+  // are allocated in `string_storage_allocator_`. Each is hashed as it is
+  // added, which costs no space over a `StringRef`.
+  mutable llvm::SmallVector<llvm::CachedHashStringRef, 16>
+      literal_string_storage_;
+
+  mutable llvm::BumpPtrAllocator string_storage_allocator_;
+
+  // The compilation the buffer was lexed in, if any, whose arena is used
+  // instead of `string_storage_allocator_`.
+  CompilationContext* context_ = nullptr;
+
+  // Whether the buffer was lexed with `LiteralValues::Lazy` and has not been
+  // validated since. The payload literal index of its numeric and string
+  // literal tokens is unused.
+  bool lazy_literal_values_ = false;
+
+  // For lazy literal values, the payload literal index of each literal whose
+  // value has been computed, keyed by token index.
+  mutable llvm::DenseMap<int32_t, int32_t> lazy_literal_indices_;
+
+  // Whether `ReleaseLiteralValues` has freed the literal storage.
+  bool literal_values_released_ = false;
 
-  llvm::SmallVector<std::string, 16> literal_string_storage_;
+  llvm::DenseMap<HashedIdentifier, Identifier> identifier_map_;
 
-  llvm::DenseMap<llvm::StringRef, Identifier> identifier_map_;
+  // The ID of each identifier once it has been interned, indexed by
+  // `Identifier`.
+  llvm::SmallVector<IdentifierTable::Id, 0> interned_identifiers_;
 
   bool has_errors_ = false;
+
+  bool cancelled_ = false;
+
+  LexStats lex_stats_;
 };
 
 using LexerDiagnosticEmitter = DiagnosticEmitter<const char*>;
@@ -358,4 +725,22 @@ using TokenDiagnosticEmitter = DiagnosticEmitter<TokenizedBuffer::Token>;
 
 }  // namespace Cocktail
 
+namespace llvm {
+
+template <>
+struct DenseMapInfo<Cocktail::TokenizedBuffer::Identifier> {
+  using Identifier = Cocktail::TokenizedBuffer::Identifier;
+
+  static auto getEmptyKey() -> Identifier { return Identifier(-1); }
+  static auto getTombstoneKey() -> Identifier { return Identifier(-2); }
+  static auto getHashValue(const Identifier& id) -> unsigned {
+    return DenseMapInfo<int32_t>::getHashValue(id.index_);
+  }
+  static auto isEqual(const Identifier& lhs, const Identifier& rhs) -> bool {
+    return lhs == rhs;
+  }
+};
+
+}  // namespace llvm
+
 #endif  // COCKTAIL_LEXER_TOKENIZED_BUFFER_H
@@ -0,0 +1,25 @@
+#ifndef COCKTAIL_LEXER_UNICODE_IDENTIFIER_H
+#define COCKTAIL_LEXER_UNICODE_IDENTIFIER_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+
+// Returns whether `code_point` has the Unicode XID_Start property, and so may
+// start an identifier along with `_`.
+auto IsXidStart(char32_t code_point) -> bool;
+
+// Returns whether `code_point` has the Unicode XID_Continue property, and so
+// may follow the start of an identifier.
+auto IsXidContinue(char32_t code_point) -> bool;
+
+// Returns the length of the UTF-8 code point at the start of `text` if it is
+// XID_Start, or XID_Continue when not `at_start`, and 0 if it isn't or `text`
+// doesn't start with valid UTF-8. Identifiers are mostly ASCII, which the
+// lexer matches on its own, so this is only used past a byte with its high
+// bit set.
+auto MatchUnicodeIdentifierChar(llvm::StringRef text, bool at_start) -> int;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_LEXER_UNICODE_IDENTIFIER_H
@@ -1,16 +1,46 @@
 #ifndef COCKTAIL_LOWERING_LOWER_TO_LLVM_H
 #define COCKTAIL_LOWERING_LOWER_TO_LLVM_H
 
+#include <memory>
+
 #include "Cocktail/Semantics/SemanticsIR.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 
 namespace Cocktail {
 
+// Lowers `semantics_ir` to a module of `llvm_context`, with a definition of
+// each function that has a body and a declaration of each that doesn't. With
+// `reachable`, from `SemanticsIR::FindReachableFunctions`, the functions it
+// doesn't set are left out entirely, so that nothing optimizes or codegens
+// them.
 auto LowerToLLVM(llvm::LLVMContext& llvm_context, llvm::StringRef module_name,
-                 const SemanticsIR& semantics_ir)
+                 const SemanticsIR& semantics_ir,
+                 const llvm::BitVector* reachable = nullptr)
+    -> std::unique_ptr<llvm::Module>;
+
+// Lowers `semantics_ir` like `LowerToLLVM`, except that only the functions of
+// `shard`, the `shard`th of `num_shards` runs of consecutive functions, are
+// defined, and the others are declared. Each function is defined in exactly
+// one shard, so with a context for each, the shards can be lowered and
+// codegenned on threads of their own.
+auto LowerToLLVMShard(llvm::LLVMContext& llvm_context,
+                      llvm::StringRef module_name,
+                      const SemanticsIR& semantics_ir, int shard,
+                      int num_shards,
+                      const llvm::BitVector* reachable = nullptr)
+    -> std::unique_ptr<llvm::Module>;
+
+// Links `shards`, which may each be in a context of its own, into one module
+// of `llvm_context`, as if `LowerToLLVM` had lowered the whole IR there. The
+// shards are consumed.
+auto LinkLLVMShards(llvm::LLVMContext& llvm_context,
+                    llvm::StringRef module_name,
+                    llvm::MutableArrayRef<std::unique_ptr<llvm::Module>> shards)
     -> std::unique_ptr<llvm::Module>;
 
 }  // namespace Cocktail
 
-#endif  // COCKTAIL_LOWERING_LOWER_TO_LLVM_H
\ No newline at end of file
+#endif  // COCKTAIL_LOWERING_LOWER_TO_LLVM_H
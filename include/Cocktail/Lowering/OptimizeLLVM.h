@@ -0,0 +1,49 @@
+#ifndef COCKTAIL_LOWERING_OPTIMIZE_LLVM_H
+#define COCKTAIL_LOWERING_OPTIMIZE_LLVM_H
+
+#include <cstdint>
+#include <optional>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace Cocktail {
+
+// How much lowered modules are optimized, both by the pass pipeline and by
+// codegen.
+enum class OptimizationLevel : int8_t {
+  // Only what is needed for correct code, for the fastest compiles.
+  O0,
+  O1,
+  O2,
+  O3,
+  // A few cheap cleanups, such as promoting locals to registers, with the
+  // backend still at `O0`. For compiles nearly as fast as `O0` that don't
+  // produce code quite as slow.
+  FastCompile,
+};
+
+// Returns the level spelled `text` on the command line, which is `0` to `3`
+// or `fast-compile`, as in `-O2` or `-Ofast-compile`.
+auto GetOptimizationLevel(llvm::StringRef text)
+    -> std::optional<OptimizationLevel>;
+
+// Returns the level that codegen runs at for `level`.
+auto GetCodeGenOptLevel(OptimizationLevel level) -> llvm::CodeGenOpt::Level;
+
+// Runs LLVM's pass pipeline for `level` on `module`. With a `target_machine`,
+// the passes are tuned for its target, and otherwise for none in particular.
+// Every pass run calls the `instrumentation` callbacks, if there are any.
+// Only `module`'s context is used, so modules in different contexts can be
+// optimized at the same time.
+auto OptimizeLLVM(llvm::Module& module, OptimizationLevel level,
+                  llvm::TargetMachine* target_machine = nullptr,
+                  llvm::PassInstrumentationCallbacks* instrumentation = nullptr)
+    -> void;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_LOWERING_OPTIMIZE_LLVM_H
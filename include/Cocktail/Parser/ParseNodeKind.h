@@ -35,6 +35,21 @@ class ParseNodeKind {
 
   constexpr operator KindEnum() const { return kind_; }
 
+  // The number of parse node kinds.
+  static constexpr int NumKinds = 0
+#define COCKTAIL_PARSE_NODE_KIND(Name) +1
+#include "Cocktail/Parser/ParseNodeKind.def"
+      ;
+
+  // Converts the kind to and from a small integer below `NumKinds`, for
+  // packing into other data.
+  [[nodiscard]] constexpr auto AsInt() const -> uint8_t {
+    return static_cast<uint8_t>(kind_);
+  }
+  static constexpr auto FromInt(uint8_t value) -> ParseNodeKind {
+    return ParseNodeKind(static_cast<KindEnum>(value));
+  }
+
  private:
   constexpr explicit ParseNodeKind(KindEnum k) : kind_(k) {}
 
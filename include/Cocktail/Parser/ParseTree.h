@@ -1,11 +1,18 @@
 #ifndef COCKTAIL_PARSER_PARSE_TREE_H
 #define COCKTAIL_PARSER_PARSE_TREE_H
 
+#include <cstdint>
 #include <iterator>
+#include <memory>
 
+#include "Cocktail/Common/Cancellation.h"
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Common/MemoryUsage.h"
+#include "Cocktail/Common/TaskScheduler.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
 #include "Cocktail/Parser/ParseNodeKind.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/iterator.h"
@@ -13,21 +20,197 @@
 
 namespace Cocktail {
 
+class ParseTreeQuery;
+
 class ParseTree {
  public:
   class Node;
   class PostorderIterator;
   class SiblingIterator;
 
-  static constexpr int StackDepthLimit = 200;
+  // How the storage for the tree's nodes is sized once parsing is done.
+  enum class NodeStorage {
+    // Keep the storage reserved up front, which has room for a node per token.
+    Reserved,
+    // Reallocate the storage to fit the nodes exactly, for trees that are kept
+    // around for a long time.
+    ShrinkToFit,
+  };
+
+  // What the parser does with the bodies of function definitions.
+  enum class FunctionBodies {
+    // Parse every body into its statements.
+    Parsed,
+    // Record each body as a single `SkippedCodeBlock` node for its `{`,
+    // without parsing or diagnosing anything in it. This is enough for tools
+    // that only need declarations and signatures, and costs little more than
+    // lexing. A body can be parsed later by `ParseSkippedCodeBlock`.
+    Skipped,
+  };
+
+  // Whether the commas separating the elements of parameter lists, tuple,
+  // struct and call expressions, and the closing brackets ending them, have
+  // nodes of their own.
+  enum class Separators {
+    // Each comma and closing bracket is a leaf node, such as a
+    // `CallExpressionComma` or a `CallExpressionEnd`, as tools that work on
+    // the text, like the formatter, need.
+    Kept,
+    // The lists only have their elements as children, which in generated code
+    // heavy with arguments leaves far fewer nodes to store and walk. Nothing
+    // is lost: a list's closing bracket is the token matching its own, its
+    // commas are between its elements, and whether one follows the last
+    // element is `node_has_trailing_separator`. Code that skips over the
+    // separator kinds to get at the elements works on either tree.
+    Elided,
+  };
 
-  static auto Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer)
+  // How much storage the parser allocated for the tree's nodes.
+  struct ParseStats {
+    // How often the nodes outgrew the storage reserved up front from the
+    // number of tokens.
+    int node_reallocations = 0;
+    // The bytes of node storage allocated by the end of parsing, which is the
+    // most it grows to.
+    int64_t peak_node_storage_bytes = 0;
+    // The bytes of node storage the finished tree keeps.
+    int64_t final_node_storage_bytes = 0;
+  };
+
+  // The storage that parsing only needs while it runs, kept from one parse to
+  // the next so that a long-running process parsing file after file stops
+  // allocating once the storage has grown to fit its largest file. This holds
+  // the parser's state stack and the stack for checking the finished tree, as
+  // well as storage for the next tree's nodes, which is taken from the trees
+  // given to `Recycle` and left over from shrinking trees to fit. A scratch
+  // space can only be used by one parse at a time.
+  class ScratchSpace {
+   public:
+    ScratchSpace();
+    ~ScratchSpace();
+    ScratchSpace(ScratchSpace&&) noexcept;
+    auto operator=(ScratchSpace&&) noexcept -> ScratchSpace&;
+
+    // Keeps the node storage of `tree`, which is no longer needed, for the
+    // next parse to build its tree in.
+    auto Recycle(ParseTree tree) -> void;
+
+   private:
+    friend ParseTree;
+
+    // The parser's scratch storage, defined along with the parser.
+    struct Storage;
+
+    std::unique_ptr<Storage> storage_;
+  };
+
+  static auto Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                    NodeStorage node_storage = NodeStorage::Reserved,
+                    FunctionBodies function_bodies = FunctionBodies::Parsed,
+                    Separators separators = Separators::Kept) -> ParseTree;
+
+  // Parses `tokens` like the `Parse` above, but with the storage of `scratch`.
+  static auto Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                    ScratchSpace& scratch,
+                    NodeStorage node_storage = NodeStorage::Reserved,
+                    FunctionBodies function_bodies = FunctionBodies::Parsed,
+                    Separators separators = Separators::Kept) -> ParseTree;
+
+  // Parses `tokens` like the first `Parse`, but checks `cancellation` before
+  // each top-level declaration, and once it is cancelled, skips the rest of
+  // them without diagnosing them and marks the tree as `cancelled`.
+  static auto Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                    const CancellationToken& cancellation,
+                    NodeStorage node_storage = NodeStorage::Reserved,
+                    FunctionBodies function_bodies = FunctionBodies::Parsed,
+                    Separators separators = Separators::Kept) -> ParseTree;
+
+  // The default number of tokens per chunk that a parallel `Parse` splits the
+  // top-level declarations into.
+  static constexpr int DefaultParallelParseChunkSize = 1 << 16;
+
+  // Parses `tokens` like the serial `Parse`, but splits the top-level
+  // declarations into chunks of about `chunk_size` tokens and parses those
+  // concurrently on `scheduler`. Each chunk after the first starts at a
+  // top-level `fn` or `var`, found by skipping over bracketed groups. The
+  // chunks are concatenated in order, so the nodes and the diagnostics,
+  // including their order, are the same as parsing serially. If a chunk's
+  // last declaration turns out to run past the start of the next chunk, as
+  // error recovery can, the declarations up to the chunk after that are
+  // parsed serially instead.
+  static auto Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                    TaskScheduler& scheduler,
+                    int chunk_size = DefaultParallelParseChunkSize,
+                    NodeStorage node_storage = NodeStorage::Reserved,
+                    FunctionBodies function_bodies = FunctionBodies::Parsed,
+                    Separators separators = Separators::Kept) -> ParseTree;
+
+  // The tokens that an edit of the source changed: the `removed_count` tokens
+  // of the previous buffer from its `first_token`-th token on were replaced by
+  // the `inserted_count` tokens of the new buffer from the same position. The
+  // tokens before and after those, up to the end of file token, must be the
+  // same in both buffers, and so must the lines they are on. That is so when
+  // the changed tokens are all those on the lines the edit touched, as
+  // `TokenizedBuffer::Relex` lexes again.
+  struct TokenEdit {
+    int first_token;
+    int removed_count;
+    int inserted_count;
+  };
+
+  // Parses `tokens`, which must be the tokens of `previous` after `edit`, by
+  // reusing the nodes of `previous` for the tokens the edit left alone. Only
+  // the innermost code block enclosing the edit, if its braces still match, is
+  // parsed again. Failing that, the top-level declarations from the last one
+  // starting before the edit up to the first one after it where parsing lines
+  // up with `previous` again are. Only the diagnostics of what is parsed again
+  // are emitted. The result is the same as parsing `tokens` with `Parse` in
+  // the same function bodies mode as `previous`, except that `has_errors` stays
+  // set if `previous` had errors.
+  static auto Reparse(const ParseTree& previous, TokenizedBuffer& tokens,
+                      const TokenEdit& edit, DiagnosticConsumer& consumer)
       -> ParseTree;
 
+  // Returns the edit of the tokens on the lines that `edit` of
+  // `previous_text`, the text `previous` was lexed from, touched, where
+  // `tokens` were lexed from the text after it, for `Reparse`. Returns
+  // llvm::None if the end of file token is on a line the edit touched, in
+  // which case the whole file must be parsed again.
+  static auto ComputeTokenEdit(const TokenizedBuffer& previous,
+                               const TokenizedBuffer& tokens,
+                               llvm::StringRef previous_text,
+                               const TokenizedBuffer::TextEdit& edit)
+      -> llvm::Optional<TokenEdit>;
+
   [[nodiscard]] auto has_errors() const -> bool { return has_errors_; }
 
+  // Whether parsing was cancelled before the end of the tokens, in which case
+  // the tree only has the declarations at their start.
+  [[nodiscard]] auto cancelled() const -> bool { return cancelled_; }
+
   [[nodiscard]] auto size() const -> int { return node_impls_.size(); }
 
+  // Returns the number of bytes allocated to store the tree's nodes.
+  [[nodiscard]] auto node_storage_bytes() const -> int64_t {
+    return node_impls_.capacity() * sizeof(NodeImpl);
+  }
+
+  // Returns the bytes used and allocated by the tree's nodes, and by the
+  // indices of each node's parent and each token's node and the subtree
+  // hashes once they're built.
+  [[nodiscard]] auto GetMemoryUsage() const -> MemoryUsage {
+    MemoryUsage usage;
+    usage.Add("node_impls", node_impls_);
+    usage.Add("parent_indices", parent_indices_);
+    usage.Add("token_node_indices", token_node_indices_);
+    usage.Add("subtree_hashes", subtree_hashes_);
+    return usage;
+  }
+
+  [[nodiscard]] auto parse_stats() const -> const ParseStats& {
+    return parse_stats_;
+  }
+
   [[nodiscard]] auto postorder() const
       -> llvm::iterator_range<PostorderIterator>;
 
@@ -39,37 +222,205 @@ class ParseTree {
 
   [[nodiscard]] auto roots() const -> llvm::iterator_range<SiblingIterator>;
 
+  // Returns the node that `n` is a child of, or llvm::None if `n` is a root.
+  // The first call indexes the parent of every node, which takes four bytes a
+  // node for as long as the tree lives, so trees that are never walked upwards
+  // don't pay for it. Call `BuildParentIndex` first to share the tree between
+  // threads that look up parents.
+  [[nodiscard]] auto parent(Node n) const -> llvm::Optional<Node>;
+
+  // Builds the index that `parent` uses, if it isn't built yet.
+  auto BuildParentIndex() const -> void;
+
+  // Returns the innermost node that covers `token`, or llvm::None if no node
+  // does, as for tokens skipped over between declarations. A node covers its
+  // own token, the tokens of its subtree, and any tokens between those, with a
+  // node for an opening bracket covering up to the matching closing bracket.
+  // Like `parent`, the first call builds an index, which takes four bytes a
+  // token; call `BuildTokenIndex` first to share the tree between threads.
+  [[nodiscard]] auto FindInnermostNode(TokenizedBuffer::Token token) const
+      -> llvm::Optional<Node>;
+
+  // Returns the innermost node that covers the token at `offset` in the
+  // source, or llvm::None if the offset isn't in a token or no node covers it.
+  [[nodiscard]] auto FindNodeAtOffset(int64_t offset) const
+      -> llvm::Optional<Node>;
+
+  // Builds the index that `FindInnermostNode` uses, if it isn't built yet.
+  auto BuildTokenIndex() const -> void;
+
+  // Returns a hash of the subtree of `n`: the kind, flags and token text of
+  // each of its nodes, and how they nest. It doesn't depend on where the
+  // subtree is, so a cache of work on one declaration can key on it and keep
+  // its entry when another is edited, though work that reads other
+  // declarations must key on theirs too. Like `parent`, the first call hashes
+  // every subtree in one pass, which takes eight bytes a node; call
+  // `BuildSubtreeHashes` first to share the tree between threads.
+  [[nodiscard]] auto subtree_hash(Node n) const -> uint64_t;
+
+  // Builds the hashes that `subtree_hash` returns, if they aren't built yet.
+  auto BuildSubtreeHashes() const -> void;
+
   [[nodiscard]] auto node_has_error(Node n) const -> bool;
 
+  // Whether the list `n` ends with a comma after its last element, in a tree
+  // with `Separators::Elided`. With the separators kept, the comma is a node
+  // of its own, and this is always false.
+  [[nodiscard]] auto node_has_trailing_separator(Node n) const -> bool;
+
+  [[nodiscard]] auto separators() const -> Separators { return separators_; }
+
   [[nodiscard]] auto node_kind(Node n) const -> ParseNodeKind;
 
   [[nodiscard]] auto node_token(Node n) const -> TokenizedBuffer::Token;
 
   [[nodiscard]] auto GetNodeText(Node n) const -> llvm::StringRef;
 
-  auto Print(llvm::raw_ostream& output) const -> void;
+  // Parses the function body that `n`, a `SkippedCodeBlock` node, stands for.
+  // The result is a tree of its own whose only root is the body's `CodeBlock`,
+  // and the diagnostics are those that parsing the body along with the rest of
+  // the file would have emitted.
+  [[nodiscard]] auto ParseSkippedCodeBlock(Node n,
+                                           DiagnosticConsumer& consumer) const
+      -> ParseTree;
+
+  // The formats that `Print` can write the tree in.
+  enum class PrintFormat {
+    // YAML-like, with each node's children nested inside it.
+    Yaml,
+    // Newline-delimited JSON, with one object per node in postorder, which
+    // tools can nest again from the subtree sizes. This is written in a single
+    // pass over the nodes, so it is the cheaper format to produce for large
+    // trees.
+    Ndjson,
+  };
 
+  auto Print(llvm::raw_ostream& output,
+             PrintFormat format = PrintFormat::Yaml) const -> void;
+
+  // The version of the format that `Serialize` writes. Bump it whenever the
+  // format, or the meaning of anything it stores, changes.
+  static constexpr uint32_t SerializationVersion = 2;
+
+  // Writes the nodes in a compact binary format, which `Deserialize` reads
+  // back without parsing again. The tokens aren't written, only a fingerprint
+  // of what the parser reads of them, so the tree is stored alongside the
+  // tokens' own `TokenizedBuffer::Serialize` data. Like that format, this one
+  // is a fixed header and a table of fixed-width little-endian fields aligned
+  // to 8 bytes, so it can be read straight out of a memory-mapped file.
+  auto Serialize(llvm::raw_ostream& output_stream) const -> void;
+
+  // Reconstructs the tree that `Serialize` wrote to `data`, for `tokens`.
+  // Returns nothing if `data` is malformed, was written with a different
+  // version of the format or node kinds, or was written for tokens that parse
+  // differently, in which case the caller should parse `tokens` instead. The
+  // result doesn't refer to `data`.
+  static auto Deserialize(TokenizedBuffer& tokens, llvm::StringRef data)
+      -> llvm::Optional<ParseTree>;
+
+  // Checks that the nodes form a well-formed tree, printing what is wrong to
+  // `llvm::errs()` if they don't.
   [[nodiscard]] auto Verify() const -> bool;
 
+  // Like `Verify`, but checks the subtrees of the roots, which don't depend on
+  // each other, concurrently on `scheduler`. Problems are printed in the
+  // order of the subtrees they were found in.
+  [[nodiscard]] auto Verify(TaskScheduler& scheduler) const -> bool;
+
+  // Like `Verify`, but only checks about `sampling_rate`, between 0 and 1, of
+  // the subtrees of the roots, for keeping the checks on where checking every
+  // tree in full costs too much. The subtrees are chosen by their position, so
+  // the same tree always has the same ones checked. That the roots' subtrees
+  // cover the whole tree is always checked.
+  [[nodiscard]] auto Verify(double sampling_rate) const -> bool;
+
  private:
   class Parser;
   friend Parser;
+  friend ParseTreeQuery;
 
-  struct NodeImpl {
-    explicit NodeImpl(ParseNodeKind k, TokenizedBuffer::Token t,
-                      int subtree_size_arg)
-        : kind(k), token(t), subtree_size(subtree_size_arg) {}
+  auto PrintNdjson(llvm::raw_ostream& output) const -> void;
 
-    ParseNodeKind kind;
+  // Finds the first node of each root's subtree, in order, or prints what is
+  // wrong and returns false if their subtree sizes don't cover the tree.
+  auto FindRootBegins(llvm::SmallVectorImpl<int>& root_begins) const -> bool;
 
-    bool has_error = false;
+  // Checks the nodes from `begin` up to `end`, which must be whole subtrees
+  // of roots, printing what is wrong to `errors`.
+  auto VerifyNodes(int begin, int end, llvm::raw_ostream& errors) const
+      -> bool;
 
-    TokenizedBuffer::Token token;
+  // Like the above, but with `ancestors` as the storage for the stack of
+  // ancestors of the node being checked.
+  auto VerifyNodes(int begin, int end, llvm::raw_ostream& errors,
+                   llvm::SmallVectorImpl<Node>& ancestors) const -> bool;
 
-    int32_t subtree_size;
+  // A node, packed into 8 bytes so that traversals get more nodes per cache
+  // line: the kind and the flags share a word with the subtree size.
+  // `Serialize` writes the two words as they are, so changing the packing
+  // means bumping `SerializationVersion`.
+  class NodeImpl {
+   public:
+    // Subtree sizes are limited to what fits beside the kind and flags.
+    static constexpr int MaxSubtreeSize = (1 << 24) - 1;
+
+    explicit NodeImpl(ParseNodeKind k, TokenizedBuffer::Token t,
+                      int subtree_size_arg)
+        : bits_(static_cast<uint32_t>(k.AsInt()) << KindShift),
+          token_(t) {
+      set_subtree_size(subtree_size_arg);
+    }
+
+    [[nodiscard]] auto kind() const -> ParseNodeKind {
+      return ParseNodeKind::FromInt(bits_ >> KindShift);
+    }
+
+    [[nodiscard]] auto has_error() const -> bool {
+      return (bits_ & ErrorBit) != 0;
+    }
+    auto set_has_error() -> void { bits_ |= ErrorBit; }
+
+    [[nodiscard]] auto has_trailing_separator() const -> bool {
+      return (bits_ & TrailingSeparatorBit) != 0;
+    }
+    auto set_has_trailing_separator() -> void {
+      bits_ |= TrailingSeparatorBit;
+    }
+
+    [[nodiscard]] auto token() const -> TokenizedBuffer::Token {
+      return token_;
+    }
+    auto set_token(TokenizedBuffer::Token t) -> void { token_ = t; }
+
+    [[nodiscard]] auto subtree_size() const -> int32_t {
+      return bits_ & SubtreeSizeMask;
+    }
+    auto set_subtree_size(int subtree_size_arg) -> void {
+      COCKTAIL_CHECK(subtree_size_arg >= 0 &&
+                     subtree_size_arg <= MaxSubtreeSize)
+          << "Subtree of " << subtree_size_arg << " nodes is too large!";
+      bits_ = (bits_ & ~SubtreeSizeMask) | subtree_size_arg;
+    }
+
+   private:
+    friend ParseTree;
+
+    static constexpr int KindShift = 26;
+    static constexpr uint32_t ErrorBit = 1U << 25;
+    static constexpr uint32_t TrailingSeparatorBit = 1U << 24;
+    static constexpr uint32_t SubtreeSizeMask = TrailingSeparatorBit - 1;
+
+    static_assert(ParseNodeKind::NumKinds <= (1 << (32 - KindShift)),
+                  "Too many parse node kinds to pack into a node!");
+
+    // The kind in the top 6 bits, then the error flag, the trailing separator
+    // flag, and the subtree size.
+    uint32_t bits_;
+
+    TokenizedBuffer::Token token_;
   };
 
-  static_assert(sizeof(NodeImpl) == 12,
+  static_assert(sizeof(NodeImpl) == 8,
                 "Unexpected size of node implementation!");
 
   explicit ParseTree(TokenizedBuffer& tokens_arg) : tokens_(&tokens_arg) {}
@@ -79,6 +430,28 @@ class ParseTree {
   TokenizedBuffer* tokens_;
 
   bool has_errors_ = false;
+
+  bool cancelled_ = false;
+
+  // How function bodies were parsed, which reparsing keeps to.
+  FunctionBodies function_bodies_ = FunctionBodies::Parsed;
+
+  // Whether separators have nodes, which reparsing also keeps to.
+  Separators separators_ = Separators::Kept;
+
+  ParseStats parse_stats_;
+
+  // The index of each node's parent, or -1 for a root. Empty until built by
+  // `BuildParentIndex`.
+  mutable llvm::SmallVector<int32_t, 0> parent_indices_;
+
+  // The index of the innermost node covering each token, or -1 for a token no
+  // node covers. Empty until built by `BuildTokenIndex`.
+  mutable llvm::SmallVector<int32_t, 0> token_node_indices_;
+
+  // The hash of each node's subtree. Empty until built by
+  // `BuildSubtreeHashes`.
+  mutable llvm::SmallVector<uint64_t, 0> subtree_hashes_;
 };
 
 class ParseTree::Node {
@@ -113,6 +486,7 @@ class ParseTree::Node {
  private:
   friend ParseTree;
   friend Parser;
+  friend ParseTreeQuery;
   friend PostorderIterator;
   friend SiblingIterator;
 
@@ -177,7 +551,7 @@ class ParseTree::SiblingIterator
 
   using iterator_facade_base::operator++;
   auto operator++() -> SiblingIterator& {
-    node_.index_ -= std::abs(tree_->node_impls_[node_.index_].subtree_size);
+    node_.index_ -= std::abs(tree_->node_impls_[node_.index_].subtree_size());
     return *this;
   }
 
@@ -0,0 +1,96 @@
+#ifndef COCKTAIL_PARSER_PARSE_TREE_QUERY_H
+#define COCKTAIL_PARSER_PARSE_TREE_QUERY_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "Cocktail/Common/Error.h"
+#include "Cocktail/Parser/ParseNodeKind.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+
+// Patterns over the shapes of parse trees, compiled once and then matched
+// against any number of trees. A pattern is written as
+//
+//   (Kind "text" child... .. descendant...)
+//
+// where `Kind` is the name of a parse node kind, or `_` for any kind, and the
+// optional string is the text the node's token must have. Each child is a
+// pattern that a distinct child of the node must match, the children matched
+// being in the same order as the patterns. A child preceded by `.` must match
+// the node's first child, or the child right after the one the pattern before
+// it matched. A pattern preceded by `..` must match a node anywhere in the
+// node's subtree instead. For example, `(CallExpression . (NameReference
+// "foo"))` matches calls to `foo`, and `(WhileStatement .. (BreakStatement))`
+// matches loops with a `break` in them.
+class ParseTreeQuery {
+ public:
+  struct Match {
+    // The index of the pattern that matched, among those compiled.
+    int pattern;
+    // The node that the pattern matched.
+    ParseTree::Node node;
+  };
+
+  // Compiles `patterns` to be matched together. Returns an error located at
+  // the pattern and column of the first mistake if one is malformed.
+  static auto Compile(llvm::ArrayRef<llvm::StringRef> patterns)
+      -> ErrorOr<ParseTreeQuery>;
+
+  // Calls `on_match` for each node of `tree` that a pattern matches, in
+  // postorder, and for the patterns matching a node, in their order. The
+  // patterns are all matched in one pass over the nodes, which only looks
+  // past the kind of a node that some pattern's kind is.
+  auto Run(const ParseTree& tree,
+           llvm::function_ref<auto(Match)->void> on_match) const -> void;
+
+  // Returns the matches that `Run` finds, in the same order.
+  auto FindMatches(const ParseTree& tree) const -> llvm::SmallVector<Match>;
+
+ private:
+  // A pattern, or a part of one, in `steps_`.
+  struct Step {
+    // The kind to match, or none for any kind.
+    std::optional<ParseNodeKind> kind;
+    // The token text to match, if any.
+    std::optional<std::string> text;
+    // The patterns for children, each with whether it is anchored by a `.`.
+    llvm::SmallVector<std::pair<int, bool>, 2> children;
+    // The patterns for descendants.
+    llvm::SmallVector<int, 1> descendants;
+  };
+
+  class Compiler;
+
+  ParseTreeQuery() = default;
+
+  // Returns whether the node at `index` matches `step`.
+  auto MatchStep(const ParseTree& tree, int step, int32_t index) const
+      -> bool;
+
+  // Returns whether the children of `step` from `item` on match distinct
+  // nodes of `children` in order, from `first` on.
+  auto MatchChildren(const ParseTree& tree, const Step& step, int item,
+                     llvm::ArrayRef<int32_t> children, int first) const
+      -> bool;
+
+  llvm::SmallVector<Step, 0> steps_;
+  // The root step of each pattern.
+  llvm::SmallVector<int, 0> patterns_;
+  // The patterns whose root can match each kind, in order, by the kind's
+  // `AsInt`, and whether there are any.
+  std::array<llvm::SmallVector<int, 1>, ParseNodeKind::NumKinds>
+      patterns_by_kind_;
+  std::array<uint8_t, ParseNodeKind::NumKinds> is_root_kind_ = {};
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_PARSER_PARSE_TREE_QUERY_H
@@ -3,25 +3,82 @@
 
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
 #include "Cocktail/Lexer/TokenKind.h"
+#include "Cocktail/Lexer/TokenKindSet.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
 #include "Cocktail/Parser/ParseNodeKind.h"
 #include "Cocktail/Parser/ParseTree.h"
 #include "Cocktail/Parser/Precedence.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
 
 namespace Cocktail {
 
 class ParseTree::Parser {
  public:
-  static auto Parse(TokenizedBuffer& tokens, TokenDiagnosticEmitter& emitter)
+  // The storage that a parse only needs while it runs, which a `ScratchSpace`
+  // keeps from one parse to the next.
+  struct Scratch;
+
+  static auto Parse(TokenizedBuffer& tokens, TokenDiagnosticEmitter& emitter,
+                    NodeStorage node_storage = NodeStorage::Reserved,
+                    FunctionBodies function_bodies = FunctionBodies::Parsed,
+                    Separators separators = Separators::Kept,
+                    Scratch* scratch = nullptr,
+                    const CancellationToken* cancellation = nullptr)
       -> ParseTree;
 
+  static auto Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                    TaskScheduler& scheduler, int chunk_size,
+                    NodeStorage node_storage, FunctionBodies function_bodies,
+                    Separators separators) -> ParseTree;
+
+  static auto Reparse(const ParseTree& previous, TokenizedBuffer& tokens,
+                      const TokenEdit& edit, TokenDiagnosticEmitter& emitter)
+      -> ParseTree;
+
+  // Parses the code block starting at `open_curly` into a tree of its own.
+  static auto ParseCodeBlock(TokenizedBuffer& tokens,
+                             TokenDiagnosticEmitter& emitter,
+                             TokenizedBuffer::Token open_curly,
+                             Separators separators) -> ParseTree;
+
  private:
-  class ScopedStackStep;
-  struct SubtreeStart;
+  // A marker for the start of a node's subtree.
+  //
+  // This is used to track the size of the node's subtree. It can be used
+  // repeatedly if multiple subtrees start at the same position.
+  struct SubtreeStart {
+    int tree_size;
+  };
+
+  // Parses with the storage of `scratch` if given, and with storage of its
+  // own otherwise.
+  explicit Parser(ParseTree& tree_arg, TokenizedBuffer& tokens_arg,
+                  TokenDiagnosticEmitter& emitter, Scratch* scratch = nullptr);
 
+  // Starts parsing at `begin`, reserving storage for `reserved_nodes` nodes.
   explicit Parser(ParseTree& tree_arg, TokenizedBuffer& tokens_arg,
-                  TokenDiagnosticEmitter& emitter);
+                  TokenDiagnosticEmitter& emitter,
+                  TokenizedBuffer::TokenIterator begin, int reserved_nodes,
+                  Scratch* scratch = nullptr);
+
+  ~Parser();
+
+  // Parses top-level declarations until reaching `stop` or the end of the
+  // file.
+  auto ParseDeclarations(TokenizedBuffer::TokenIterator stop) -> void;
+
+  // Sizes the node storage once every node has been added, and checks the
+  // tree, on `scheduler` if given.
+  auto FinishTree(NodeStorage node_storage,
+                  TaskScheduler* scheduler = nullptr) -> void;
+
+  // Appends `nodes` of a previous tree over the same tokens, except that those
+  // from `shift_from` on are `token_delta` tokens further on.
+  auto AppendPreviousNodes(llvm::ArrayRef<NodeImpl> nodes,
+                           TokenizedBuffer::Token shift_from, int token_delta)
+      -> void;
 
   auto AtEndOfFile() -> bool {
     return tokens_.GetKind(*position_) == TokenKind::EndOfFile();
@@ -35,15 +92,22 @@ class ParseTree::Parser {
     return NextTokenKind() == kind;
   }
 
-  [[nodiscard]] auto NextTokenIsOneOf(
-      std::initializer_list<TokenKind> kinds) const -> bool {
-    return NextTokenKind().IsOneOf(kinds);
+  [[nodiscard]] auto NextTokenIsOneOf(const TokenKindSet& kinds) const
+      -> bool {
+    return kinds.Contains(NextTokenKind());
   }
 
   auto Consume(TokenKind kind) -> TokenizedBuffer::Token;
 
   auto ConsumeIf(TokenKind kind) -> llvm::Optional<TokenizedBuffer::Token>;
 
+  // Counts a reallocation of the node storage if adding a node needs one.
+  auto CountNodeReallocation() -> void {
+    if (tree_.node_impls_.size() == tree_.node_impls_.capacity()) {
+      ++tree_.parse_stats_.node_reallocations;
+    }
+  }
+
   auto AddLeafNode(ParseNodeKind kind, TokenizedBuffer::Token token) -> Node;
 
   auto ConsumeAndAddLeafNodeIf(TokenKind t_kind, ParseNodeKind n_kind)
@@ -60,7 +124,9 @@ class ParseTree::Parser {
 
   auto SkipTo(TokenizedBuffer::Token t) -> void;
 
-  auto FindNextOf(std::initializer_list<TokenKind> desired_kinds)
+  // Finds the next token of one of the desired kinds at the current bracketing
+  // level, skipping over any nested groups.
+  auto FindNextOf(const TokenKindSet& desired_kinds)
       -> llvm::Optional<TokenizedBuffer::Token>;
 
   using SemiHandler = llvm::function_ref<
@@ -72,51 +138,18 @@ class ParseTree::Parser {
   auto ParseCloseParen(TokenizedBuffer::Token open_paren, ParseNodeKind kind)
       -> llvm::Optional<Node>;
 
-  template <typename ListElementParser, typename ListCompletionHandler>
-  auto ParseList(TokenKind open, TokenKind close,
-                 ListElementParser list_element_parser,
-                 ParseNodeKind comma_kind, ListCompletionHandler list_handler,
-                 bool allow_trailing_comma = false) -> llvm::Optional<Node>;
-
-  template <typename ListElementParser, typename ListCompletionHandler>
-  auto ParseParenList(ListElementParser list_element_parser,
-                      ParseNodeKind comma_kind,
-                      ListCompletionHandler list_handler,
-                      bool allow_trailing_comma = false)
-      -> llvm::Optional<Node> {
-    return ParseList(TokenKind::OpenParen(), TokenKind::CloseParen(),
-                     list_element_parser, comma_kind, list_handler,
-                     allow_trailing_comma);
-  }
-
-  auto ParseFunctionParameter() -> llvm::Optional<Node>;
-
   auto ParseFunctionSignature() -> bool;
 
-  auto ParseCodeBlock() -> llvm::Optional<Node>;
-
   auto ParseFunctionDeclaration() -> Node;
 
-  auto ParseVariableDeclaration() -> Node;
-
   auto ParseEmptyDeclaration() -> Node;
 
-  auto ParseDeclaration() -> llvm::Optional<Node>;
-
-  auto ParseParenExpression() -> llvm::Optional<Node>;
-
-  auto ParseBraceExpression() -> llvm::Optional<Node>;
-
-  auto ParsePrimaryExpression() -> llvm::Optional<Node>;
+  // Returns whether a declaration node was produced.
+  auto ParseDeclaration() -> bool;
 
   auto ParseDesignatorExpression(SubtreeStart start, ParseNodeKind kind,
                                  bool has_errors) -> llvm::Optional<Node>;
 
-  auto ParseCallExpression(SubtreeStart start, bool has_errors)
-      -> llvm::Optional<Node>;
-
-  auto ParsePostfixExpression() -> llvm::Optional<Node>;
-
   enum class OperatorFixity { Prefix, Infix, Postfix };
 
   auto IsLexicallyValidInfixOperator() -> bool;
@@ -125,39 +158,193 @@ class ParseTree::Parser {
 
   auto IsTrailingOperatorInfix() -> bool;
 
-  auto ParseOperatorExpression(PrecedenceGroup precedence)
-      -> llvm::Optional<Node>;
-
-  auto ParseExpression() -> llvm::Optional<Node>;
+  // The nested parts of the grammar -- statements, code blocks, patterns and
+  // expressions -- are parsed by a loop over an explicit stack of states
+  // rather than by recursion, so how deeply they nest is limited only by
+  // memory. A state that needs a child construct parsed leaves the state to
+  // resume in on the stack and pushes the child's state above it. When the
+  // child is done it pops itself and sets `state_result_` to whether it
+  // produced a valid node. Handlers update the entry on top of the stack in
+  // place, so resuming a state doesn't copy it.
+  enum class State : int8_t {
+    CodeBlock,
+    CodeBlockAfterStatement,
+    Statement,
+    VariableDeclaration,
+    VariableDeclarationAfterPattern,
+    VariableDeclarationFinish,
+    VariableInitializerFinish,
+    IfStatement,
+    IfStatementAfterCondition,
+    IfStatementAfterThen,
+    IfStatementAfterElse,
+    WhileStatement,
+    WhileStatementAfterCondition,
+    WhileStatementAfterBody,
+    KeywordStatement,
+    KeywordStatementAfterArgument,
+    ExpressionStatement,
+    ExpressionStatementAfterExpression,
+    ParenConditionAfterExpression,
+    Pattern,
+    PatternAfterType,
+    OperatorExpression,
+    OperatorExpressionAfterPrefix,
+    OperatorExpressionAfterInfix,
+    PostfixExpressionAfterPrimary,
+    PostfixExpressionAfterCall,
+    List,
+    ListAfterElement,
+    StructFieldFinish,
+  };
 
-  auto ParseType() -> llvm::Optional<Node>;
+  enum class PatternKind : int8_t {
+    Parameter,
+    Variable,
+  };
 
-  auto ParseExpressionStatement() -> llvm::Optional<Node>;
+  // The bracketed, comma-separated lists, which share one set of states.
+  enum class ListKind : int8_t {
+    ParameterList,
+    ParenExpression,
+    CallExpression,
+    StructLiteral,
+  };
 
-  auto ParseParenCondition(TokenKind introducer) -> llvm::Optional<Node>;
+  // What a struct literal has turned out to be from the fields seen so far.
+  enum class StructKind : int8_t { Unknown, Value, Type };
+
+  struct StateStackEntry {
+    State state;
+    // Whether an error has been found in the construct so far. For a
+    // condition, whether its `(` is missing, which means it gets no node.
+    bool has_error = false;
+    // For lists, whether an element and whether a comma have been parsed.
+    bool has_element = false;
+    bool has_comma = false;
+    bool has_trailing_comma = false;
+    // Which variant of the state's construct is being parsed.
+    PatternKind pattern_kind = PatternKind::Parameter;
+    ListKind list_kind = ListKind::ParameterList;
+    StructKind struct_kind = StructKind::Unknown;
+    // For operator expressions, the precedence of the enclosing context and of
+    // the operand parsed so far.
+    PrecedenceGroup ambient_precedence =
+        PrecedenceGroup::ForTopLevelExpression();
+    PrecedenceGroup lhs_precedence = PrecedenceGroup::ForPostfixExpression();
+    // The token the construct's node is for, such as its introducer or
+    // opening bracket. While an operator expression's first operand is parsed
+    // as a postfix expression, the position after the last postfix step,
+    // which is used to detect stalling.
+    TokenizedBuffer::Token token;
+    SubtreeStart subtree_start;
+  };
 
-  auto ParseIfStatement() -> llvm::Optional<Node>;
+ public:
+  struct Scratch {
+    llvm::SmallVector<StateStackEntry, 16> state_stack;
+    // The ancestors of the node being checked by `Verify`.
+    llvm::SmallVector<Node, 16> verify_ancestors;
+    // Storage for the nodes of the next tree, which has room for as many nodes
+    // as the tree it was taken from had.
+    llvm::SmallVector<NodeImpl, 0> node_storage;
+  };
 
-  auto ParseWhileStatement() -> llvm::Optional<Node>;
+ private:
+  // Parses the construct of `entry` and everything nested in it, returning
+  // whether it produced a valid node.
+  auto RunStates(StateStackEntry entry) -> bool;
 
-  enum class KeywordStatementArgument {
-    None,
-    Optional,
-    Mandatory,
-  };
+  auto PushState(StateStackEntry entry) -> void {
+    state_stack_.push_back(entry);
+  }
 
-  auto ParseKeywordStatement(ParseNodeKind kind,
-                             KeywordStatementArgument argument)
-      -> llvm::Optional<Node>;
+  auto PushState(State state) -> void {
+    PushState({.state = state, .subtree_start = GetSubtreeStartPosition()});
+  }
 
-  auto ParseStatement() -> llvm::Optional<Node>;
+  auto PushExpressionState(PrecedenceGroup ambient_precedence) -> void {
+    PushState({.state = State::OperatorExpression,
+               .ambient_precedence = ambient_precedence,
+               .subtree_start = GetSubtreeStartPosition()});
+  }
 
-  enum class PatternKind {
-    Parameter,
-    Variable,
-  };
+  // Finishes the state on top of the stack, with `result` as its result.
+  auto ReturnState(bool result) -> void {
+    state_stack_.pop_back();
+    state_result_ = result;
+  }
 
-  auto ParsePattern(PatternKind kind) -> llvm::Optional<Node>;
+  auto HandleCodeBlockState() -> void;
+  auto HandleCodeBlockAfterStatementState() -> void;
+  auto HandleStatementState() -> void;
+  auto HandleVariableDeclarationState() -> void;
+  auto HandleVariableDeclarationAfterPatternState() -> void;
+  auto HandleVariableDeclarationFinishState() -> void;
+  auto HandleVariableInitializerFinishState() -> void;
+  auto HandleIfStatementState() -> void;
+  auto HandleIfStatementAfterConditionState() -> void;
+  auto HandleIfStatementAfterThenState() -> void;
+  auto HandleIfStatementAfterElseState() -> void;
+  auto HandleWhileStatementState() -> void;
+  auto HandleWhileStatementAfterConditionState() -> void;
+  auto HandleWhileStatementAfterBodyState() -> void;
+  auto HandleKeywordStatementState() -> void;
+  auto HandleKeywordStatementAfterArgumentState() -> void;
+  auto HandleExpressionStatementState() -> void;
+  auto HandleExpressionStatementAfterExpressionState() -> void;
+  auto HandleParenConditionAfterExpressionState() -> void;
+  auto HandlePatternState() -> void;
+  auto HandlePatternAfterTypeState() -> void;
+  auto HandleOperatorExpressionState() -> void;
+  auto HandleOperatorExpressionAfterPrefixState() -> void;
+  auto HandleOperatorExpressionAfterInfixState() -> void;
+  auto HandlePostfixExpressionAfterPrimaryState() -> void;
+  auto HandlePostfixExpressionAfterCallState() -> void;
+  auto HandleListState() -> void;
+  auto HandleListAfterElementState() -> void;
+  auto HandleStructFieldFinishState() -> void;
+
+  // The helpers below continue the state on top of the stack. Like the
+  // handlers, they either push a child state above it, change its state to
+  // the one to resume in, or finish it.
+
+  // Parses statements until the end of the code block.
+  auto ContinueCodeBlock() -> void;
+
+  // Parses a condition up to its expression, diagnosing a missing `(` after
+  // `introducer`.
+  auto StartParenCondition(TokenKind introducer) -> void;
+
+  auto FinishIfStatement() -> void;
+
+  auto FinishKeywordStatement() -> void;
+
+  // Parses infix and postfix operators following the operand parsed so far.
+  auto ContinueOperatorExpression() -> void;
+
+  // Parses the postfix expression that is the first operand of the operator
+  // expression. This shares the operator expression's state, and a primary
+  // expression that is a single token is parsed without pushing any state at
+  // all.
+  auto StartPostfixExpression() -> void;
+
+  // Parses the designators and calls following a postfix expression's
+  // primary expression, where `expression` says whether the postfix
+  // expression so far is valid.
+  auto ContinuePostfixExpression(bool expression) -> void;
+
+  // Goes on to the operators following the postfix expression.
+  auto FinishPostfixExpression(bool expression) -> void;
+
+  // Parses the next element of the list.
+  auto StartListElement() -> void;
+
+  // Parses a struct literal field up to its type or value, updating the kind
+  // of the struct literal.
+  auto StartStructField() -> void;
+
+  auto FinishList() -> void;
 
   ParseTree& tree_;
   TokenizedBuffer& tokens_;
@@ -166,9 +353,24 @@ class ParseTree::Parser {
   TokenizedBuffer::TokenIterator position_;
   TokenizedBuffer::TokenIterator end_;
 
-  int stack_depth_ = 0;
+  FunctionBodies function_bodies_ = FunctionBodies::Parsed;
+
+  Separators separators_ = Separators::Kept;
+
+  // The scratch storage to parse with, whose parts the parser takes over while
+  // it runs and gives back when it is done, or null to allocate its own.
+  Scratch* scratch_;
+
+  // Checked before each top-level declaration, if set, to stop once the tree
+  // is no longer wanted.
+  const CancellationToken* cancellation_ = nullptr;
+
+  llvm::SmallVector<StateStackEntry, 16> state_stack_;
+  bool state_result_ = false;
 };
 
+struct ParseTree::ScratchSpace::Storage : ParseTree::Parser::Scratch {};
+
 }  // namespace Cocktail
 
 #endif  // COCKTAIL_PARSER_PARSE_IMPL_H
\ No newline at end of file
@@ -57,6 +57,10 @@ class PrecedenceGroup {
   static auto ForTrailing(TokenKind kind, bool infix)
       -> llvm::Optional<Trailing>;
 
+  // Returns whether the given token is both an infix and a postfix operator,
+  // so that the `infix` argument to ForTrailing matters for it.
+  static auto HasInfixAndPostfixForms(TokenKind kind) -> bool;
+
   friend auto operator==(PrecedenceGroup lhs, PrecedenceGroup rhs) -> bool {
     return lhs.level_ == rhs.level_;
   }
@@ -0,0 +1,37 @@
+#ifndef COCKTAIL_PARSER_SOURCE_FORMATTER_H
+#define COCKTAIL_PARSER_SOURCE_FORMATTER_H
+
+#include <cstdint>
+
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// Writes the source of `tokens` reformatted to `output`, in one pass over the
+// tokens after one over `tree`'s nodes, without building anything more.
+//
+// Each statement and declaration goes on a line of its own, indented by two
+// spaces for each code block it's in. Operators get a space on each side, and
+// commas one after. Otherwise, tokens are spaced as they were, with runs of
+// whitespace cut to one space, and a line the source broke inside a statement
+// is broken there too, indented by four more spaces. Comments, which have
+// lines of their own, are kept where they were and reindented, and runs of
+// blank lines are cut to one. Whitespace is never taken out between tokens
+// that could lex as one.
+//
+// The tokens and tree must have been built from `source` without errors, and
+// the tree with its separators kept, since the commas are spaced by their
+// nodes.
+auto FormatSource(const SourceBuffer& source, const TokenizedBuffer& tokens,
+                  const ParseTree& tree, llvm::raw_ostream& output) -> void;
+
+// The version of what `FormatSource` writes. Bump it whenever the format
+// changes, so that files remembered as formatted are formatted again.
+constexpr uint32_t SourceFormatVersion = 1;
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_PARSER_SOURCE_FORMATTER_H
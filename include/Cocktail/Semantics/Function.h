@@ -1,23 +1,76 @@
 #ifndef COCKTAIL_SEMANTICS_FUNCTION_H
 #define COCKTAIL_SEMANTICS_FUNCTION_H
 
+#include <cstdint>
+
+#include "Cocktail/Common/Check.h"
 #include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Semantics/TypeTable.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/Sequence.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+class SemanticsIRFactory;
+}  // namespace Cocktail
 
 namespace Cocktail::Semantics {
 
 class Function {
  public:
-  Function(ParseTree::Node decl_node, ParseTree::Node name_node)
-      : decl_node_(decl_node), name_node_(name_node) {}
+  Function(ParseTree::Node decl_node, ParseTree::Node name_node,
+           llvm::StringRef name)
+      : decl_node_(decl_node), name_node_(name_node), name_(name) {}
+
+  // A function imported from another file's interface, which has no nodes in
+  // this file's tree.
+  Function(llvm::StringRef name, TypeId type)
+      : name_(name), type_(type), is_imported_(true) {}
+
+  auto decl_node() const -> ParseTree::Node {
+    COCKTAIL_DCHECK(!is_imported_) << "Imported functions have no nodes!";
+    return decl_node_;
+  }
+  auto name_node() const -> ParseTree::Node {
+    COCKTAIL_DCHECK(!is_imported_) << "Imported functions have no nodes!";
+    return name_node_;
+  }
+
+  auto name() const -> llvm::StringRef { return name_; }
 
-  auto decl_node() const -> ParseTree::Node { return decl_node_; }
-  auto name_node() const -> ParseTree::Node { return name_node_; }
+  // Whether the function is declared in another file, whose interface was
+  // imported.
+  auto is_imported() const -> bool { return is_imported_; }
+
+  // The function's `CodeBlock`, or none for a function declared without a
+  // body.
+  auto body_node() const -> llvm::Optional<ParseTree::Node> {
+    return body_node_;
+  }
+
+  // The function's type, in `SemanticsIR::types`, from its parameter and
+  // return types.
+  auto type() const -> TypeId { return type_; }
+
+  // The body's instructions, as a range of indices into `SemanticsIR::insts`,
+  // which is empty for a function without a body.
+  auto body() const -> llvm::iota_range<int32_t> {
+    return llvm::seq(body_begin_, body_end_);
+  }
 
  private:
+  friend class Cocktail::SemanticsIRFactory;
+
   ParseTree::Node decl_node_;
   ParseTree::Node name_node_;
+  llvm::StringRef name_;
+  llvm::Optional<ParseTree::Node> body_node_;
+  TypeId type_ = TypeId::Error;
+  int32_t body_begin_ = 0;
+  int32_t body_end_ = 0;
+  bool is_imported_ = false;
 };
 
 }  // namespace Cocktail::Semantics
 
-#endif  // COCKTAIL_SEMANTICS_FUNCTION_H
\ No newline at end of file
+#endif  // COCKTAIL_SEMANTICS_FUNCTION_H
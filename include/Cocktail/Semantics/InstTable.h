@@ -0,0 +1,94 @@
+#ifndef COCKTAIL_SEMANTICS_INST_TABLE_H
+#define COCKTAIL_SEMANTICS_INST_TABLE_H
+
+#include <cstdint>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Semantics/TypeTable.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail::Semantics {
+
+enum class InstKind : int8_t {
+  // Calls a function. The first operand is the callee's index in
+  // `SemanticsIR::functions`, and the others are the arguments: each is the
+  // offset in the body of the instruction whose value it is, or -1 if the
+  // argument isn't analyzed yet.
+  Call,
+  // A constant that was folded from literals. The only operand is the
+  // value's index in `SemanticsIR::integer_constants`.
+  IntegerConstant,
+  // A string literal. The only operand is the value's index in
+  // `SemanticsIR::string_constants`.
+  StringConstant,
+  // A tuple literal. Each operand is an element, in order, as the offset in
+  // the body of the instruction whose value it is.
+  TupleValue,
+  // A struct literal, whose operands are its fields' values like those of a
+  // `TupleValue`, in the order of the fields of its type.
+  StructValue,
+};
+
+auto GetInstKindName(InstKind kind) -> llvm::StringRef;
+
+// Instructions, by their index in the table. The table is a struct of arrays,
+// so a pass that only looks at kinds or types touches nothing else, and each
+// instruction's operands are a range of a pool shared by the whole table
+// rather than an allocation of their own. What an operand refers to depends
+// on the instruction's kind.
+class InstTable {
+ public:
+  auto size() const -> int { return kinds_.size(); }
+
+  // Adds an instruction, returning its index.
+  auto Add(InstKind kind, TypeId type, ParseTree::Node node,
+           llvm::ArrayRef<int32_t> operands) -> int32_t {
+    int32_t index = kinds_.size();
+    kinds_.push_back(kind);
+    types_.push_back(type);
+    nodes_.push_back(node);
+    operands_.append(operands.begin(), operands.end());
+    operand_ends_.push_back(operands_.size());
+    return index;
+  }
+
+  auto kind(int32_t inst) const -> InstKind { return kinds_[inst]; }
+  auto type(int32_t inst) const -> TypeId { return types_[inst]; }
+
+  // The parse node the instruction was made from.
+  auto node(int32_t inst) const -> ParseTree::Node { return nodes_[inst]; }
+
+  auto operands(int32_t inst) const -> llvm::ArrayRef<int32_t> {
+    COCKTAIL_DCHECK(inst >= 0 && inst < size()) << "Invalid instruction!";
+    int32_t begin = inst == 0 ? 0 : operand_ends_[inst - 1];
+    return llvm::makeArrayRef(operands_).slice(begin,
+                                               operand_ends_[inst] - begin);
+  }
+
+  // The number of operands of all the instructions.
+  auto operand_count() const -> int { return operands_.size(); }
+
+  // Returns the number of bytes allocated to store the table.
+  auto memory_bytes() const -> int64_t {
+    return kinds_.capacity() * sizeof(InstKind) +
+           types_.capacity() * sizeof(TypeId) +
+           nodes_.capacity() * sizeof(ParseTree::Node) +
+           (operand_ends_.capacity() + operands_.capacity()) * sizeof(int32_t);
+  }
+
+ private:
+  llvm::SmallVector<InstKind, 0> kinds_;
+  llvm::SmallVector<TypeId, 0> types_;
+  llvm::SmallVector<ParseTree::Node, 0> nodes_;
+  // Where each instruction's operands end in `operands_`. They start where
+  // the previous instruction's end.
+  llvm::SmallVector<int32_t, 0> operand_ends_;
+  llvm::SmallVector<int32_t, 0> operands_;
+};
+
+}  // namespace Cocktail::Semantics
+
+#endif  // COCKTAIL_SEMANTICS_INST_TABLE_H
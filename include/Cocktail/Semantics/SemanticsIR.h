@@ -1,10 +1,22 @@
 #ifndef COCKTAIL_SEMANTICS_SEMANTICS_IR_H
 #define COCKTAIL_SEMANTICS_SEMANTICS_IR_H
 
+#include <optional>
+
+#include "Cocktail/Lexer/CompilationContext.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
 #include "Cocktail/Parser/ParseTree.h"
 #include "Cocktail/Semantics/Function.h"
+#include "Cocktail/Semantics/InstTable.h"
+#include "Cocktail/Semantics/TypeTable.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/CachedHashString.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
-#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/raw_ostream.h"
 
 namespace Cocktail {
 
@@ -28,27 +40,157 @@ class SemanticsIR {
     int32_t index_;
   };
 
-  struct Block {
+  // The entities declared in a scope, in declaration order, and looked up by
+  // the identifier they're declared with. Identifiers are compared by ID
+  // rather than by text, so no names are copied.
+  class Block {
    public:
-    void Add(llvm::StringRef name, Node named_entity);
+    // Adds `named_entity` as `name`, unless an entity was already declared
+    // with that name, in which case that entity is returned and nothing is
+    // added.
+    auto Add(TokenizedBuffer::Identifier name, Node named_entity)
+        -> std::optional<Node>;
+
+    // Returns the entity declared as `name`, if any.
+    auto Lookup(TokenizedBuffer::Identifier name) const -> std::optional<Node>;
+
+    auto size() const -> int { return ordering_.size(); }
+
+    // Returns the number of bytes allocated to store the block.
+    auto memory_bytes() const -> int64_t;
 
    private:
+    struct Entry {
+      TokenizedBuffer::Identifier name;
+      Node named_entity;
+    };
+
+    // Returns the slot for `name`: the entry declared as it, or else the empty
+    // slot it would go in.
+    auto FindSlot(TokenizedBuffer::Identifier name) const -> int;
+
+    // Doubles the size of the table, keeping the load factor at most a half.
+    auto Grow() -> void;
+
     llvm::SmallVector<Node> ordering_;
-    llvm::StringMap<Node> name_lookup_;
+    // An open-addressing table with linear probing, whose size is a power of
+    // two. Entries are stored inline, so a lookup usually touches a single
+    // cache line, and empty slots have the empty identifier as their name.
+    llvm::SmallVector<Entry, 0> lookup_;
   };
 
+  // Prints the functions, in the order they are declared, with the
+  // instructions of their bodies.
+  auto Print(llvm::raw_ostream& output) const -> void;
+
+  auto functions() const -> llvm::ArrayRef<Semantics::Function> {
+    return functions_;
+  }
+
+  // The instructions of every function body, each body's after the one
+  // declared before it.
+  auto insts() const -> const Semantics::InstTable& { return insts_; }
+
+  // The values of integer constants, which each occur once however many
+  // instructions they are the value of.
+  auto integer_constants() const -> llvm::ArrayRef<llvm::APInt> {
+    return integer_constants_;
+  }
+
+  // The values of string literals, each interned once for the whole file
+  // however many literals spell it, so that lowering emits one global for
+  // each.
+  auto string_constants() const -> llvm::ArrayRef<llvm::StringRef> {
+    return string_constants_;
+  }
+
+  // The types of the functions and instructions, each interned once for the
+  // whole file.
+  auto types() const -> const Semantics::TypeTable& { return types_; }
+
+  // Returns whether each function, by index, is one of those declared as an
+  // `entry_points` name or is called, directly or not, from one of them.
+  // Lowering can skip the others, which nothing can run.
+  auto FindReachableFunctions(llvm::ArrayRef<llvm::StringRef> entry_points)
+      const -> llvm::BitVector;
+
+  // Returns the number of bytes allocated to store the IR.
+  auto memory_bytes() const -> int64_t;
+
+  auto parse_tree() const -> const ParseTree& { return *parse_tree_; }
+
+  auto tokens() const -> const TokenizedBuffer& { return *tokens_; }
+
+  // The declarations at file scope.
+  auto root_block() const -> const Block& { return root_block_; }
+
+  // Whether building the IR diagnosed any errors.
+  auto has_errors() const -> bool { return has_errors_; }
+
+  // Whether building the IR was cancelled, in which case some function bodies
+  // weren't processed and are empty.
+  auto cancelled() const -> bool { return cancelled_; }
+
  private:
   friend class SemanticsIRFactory;
+  friend class SemanticsQueries;
 
-  explicit SemanticsIR(const ParseTree& parse_tree)
-      : parse_tree_(&parse_tree) {}
+  SemanticsIR(const TokenizedBuffer& tokens, const ParseTree& parse_tree)
+      : tokens_(&tokens), parse_tree_(&parse_tree) {}
 
+  // Adds a function declared as `name` to `block`, unless the name is
+  // already declared there, in which case the name node of the earlier
+  // declaration is returned.
   auto AddFunction(Block& block, ParseTree::Node decl_node,
-                   ParseTree::Node name_node) -> Semantics::Function&;
+                   ParseTree::Node name_node, TokenizedBuffer::Identifier name)
+      -> std::optional<ParseTree::Node>;
+
+  // Adds a function of `type` imported as `name`, spelled `text`, to the root
+  // block, unless the name is already declared there. Returns whether it was
+  // added. The text is copied, so the interface it's from needn't outlive the
+  // IR.
+  auto AddImportedFunction(TokenizedBuffer::Identifier name,
+                           llvm::StringRef text, Semantics::TypeId type)
+      -> bool;
+
+  // Returns the index of `value` in `integer_constants_`, adding it if it
+  // isn't there yet.
+  auto AddIntegerConstant(const llvm::APInt& value) -> int32_t;
+
+  // Returns the index of `value` in `string_constants_`, adding a copy of it
+  // if it isn't there yet. The value is hashed already, by the lexer.
+  auto AddStringConstant(llvm::CachedHashStringRef value) -> int32_t;
+
+  // Returns the allocator of the strings that the IR keeps.
+  auto string_storage() -> llvm::BumpPtrAllocator& {
+    return context_ != nullptr ? context_->arena() : strings_;
+  }
+
+  // Returns the node that `entity` was declared with the name of.
+  auto GetNameNode(Node entity) const -> ParseTree::Node;
+
+  // Returns the index in `functions_` of `entity`, if it is a function.
+  auto GetFunctionIndex(Node entity) const -> std::optional<int32_t>;
 
   llvm::SmallVector<Semantics::Function, 0> functions_;
+  Semantics::InstTable insts_;
+  Semantics::TypeTable types_;
+  llvm::SmallVector<llvm::APInt, 0> integer_constants_;
+  llvm::DenseMap<llvm::APInt, int32_t> integer_constant_indices_;
+  // The values are copied from the tokens' literal storage, which may be
+  // released before the IR is lowered.
+  llvm::SmallVector<llvm::StringRef, 0> string_constants_;
+  llvm::DenseMap<llvm::CachedHashStringRef, int32_t> string_constant_indices_;
   Block root_block_;
+  // The names of imported functions and the values of string constants,
+  // unless the IR was built in a compilation, whose arena they're allocated in
+  // instead.
+  llvm::BumpPtrAllocator strings_;
+  CompilationContext* context_ = nullptr;
+  const TokenizedBuffer* tokens_;
   const ParseTree* parse_tree_;
+  bool has_errors_ = false;
+  bool cancelled_ = false;
 };
 
 }  // namespace Cocktail
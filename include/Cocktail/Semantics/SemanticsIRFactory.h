@@ -2,28 +2,166 @@
 #define COCKTAIL_SEMANTICS_SEMANTICS_IR_FACTORY_H
 
 #include <optional>
+#include <string>
 
+#include "Cocktail/Common/Cancellation.h"
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
 #include "Cocktail/Parser/ParseTree.h"
 #include "Cocktail/Semantics/SemanticsIR.h"
-#include "llvm/ADT/StringMap.h"
+#include "Cocktail/Semantics/SemanticsInterface.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 
 namespace Cocktail {
 
 class SemanticsIRFactory {
  public:
-  static auto Build(const ParseTree& parse_tree) -> SemanticsIR;
+  // Builds the IR for `parse_tree`, which was parsed from `tokens`, and
+  // diagnoses what is wrong with it to `consumer`. Declarations are processed
+  // in one pass over the file first, after which each function body only
+  // depends on them, so with a `scheduler` the bodies are processed on its
+  // threads. The functions of the `imports`, which are other files'
+  // interfaces, are declared at file scope after this file's own, unless
+  // this file declares the same name. With a `context`, the strings that the
+  // IR keeps are allocated in its arena. With a `cancellation`, it is checked
+  // before each function body, which is where the time goes, and once it is
+  // cancelled, the bodies not yet processed are left empty and the IR is
+  // marked as `cancelled`.
+  static auto Build(TokenizedBuffer& tokens, const ParseTree& parse_tree,
+                    DiagnosticConsumer& consumer,
+                    TaskScheduler* scheduler = nullptr,
+                    llvm::ArrayRef<SemanticsInterface> imports = {},
+                    CompilationContext* context = nullptr,
+                    const CancellationToken* cancellation = nullptr)
+      -> SemanticsIR;
 
  private:
-  explicit SemanticsIRFactory(const ParseTree& parse_tree)
-      : semantics_(parse_tree) {}
+  friend class SemanticsQueries;
 
+  SemanticsIRFactory(TokenizedBuffer& tokens, const ParseTree& parse_tree,
+                     DiagnosticConsumer& consumer)
+      : tokens_(&tokens),
+        consumer_(&consumer),
+        translator_(tokens, /*last_line_lexed_to_column=*/nullptr),
+        emitter_(translator_, consumer),
+        semantics_(tokens, parse_tree),
+        integer_type_(semantics_.types_.GetSizedType(
+            Semantics::TypeKind::Int, IntegerBitWidth)) {}
+
+  // The results of processing a batch of function bodies, which are added to
+  // the IR once every batch is done.
+  struct Batch;
+
+  // The values of the constant expressions whose parents are still to be
+  // processed, by node index. An expression whose folding was diagnosed maps
+  // to no value, so that the expressions using it aren't diagnosed again.
+  using FoldedValues = llvm::DenseMap<int32_t, std::optional<llvm::APInt>>;
+
+  // The width that integer literals and the constants folded from them have,
+  // until literals convert to the type they are used as.
+  static constexpr int IntegerBitWidth = 32;
+
+  // A name that a function body calls, and the function it names at file
+  // scope, if any.
+  struct Callee {
+    TokenizedBuffer::Identifier name;
+    std::optional<int32_t> function;
+  };
+
+  // Declares the functions at file scope, without their types.
   void ProcessRoots();
 
   void ProcessFuntionNode(SemanticsIR::Block& block, ParseTree::Node decl_node);
 
+  // Builds the type of a function that `ProcessRoots` declared.
+  void ProcessSignature(Semantics::Function& function);
+
+  // Declares the functions of `interface` in the root block.
+  void ProcessImport(const SemanticsInterface& interface);
+
+  // Returns the type that the interface's `type` is in this file, given
+  // `types`, those of the interface's types before it, or none if it names a
+  // struct field that no token of this file spells.
+  auto ImportType(const SemanticsInterface& interface, int32_t type,
+                  llvm::ArrayRef<std::optional<Semantics::TypeId>> types)
+      -> std::optional<Semantics::TypeId>;
+
+  // Returns the type of the function declared by `decl_node`, from its
+  // parameter and return types.
+  auto BuildFunctionType(ParseTree::Node decl_node) -> Semantics::TypeId;
+
+  // Returns the type that the expression `node` spells, or the error type if
+  // it isn't one that is recognized yet.
+  auto BuildType(ParseTree::Node node) -> Semantics::TypeId;
+
+  void ProcessFunctionBodies(TaskScheduler* scheduler);
+
+  // Adds the instructions for the body of `function`, if it has one, to
+  // `batch`, and diagnoses to `emitter`. Only reads the tree, the root block
+  // and the types, which are all built by the declaration pass, so bodies can
+  // be processed at the same time into batches of their own.
+  void ProcessFunctionBody(const Semantics::Function& function, Batch& batch,
+                           TokenDiagnosticEmitter& emitter) const;
+
+  // Adds the value of the tuple or struct literal `node` to `batch`, given
+  // the instruction whose value each expression of the body is in `values`,
+  // and returns it. Returns none if an element has no value, or if no
+  // declaration spells the literal's type, as types can't be interned while
+  // bodies are processed in parallel, and a value of a type no parameter has
+  // can't be passed anywhere yet.
+  auto BuildAggregate(ParseTree::Node node,
+                      const llvm::DenseMap<int32_t, int32_t>& values,
+                      int32_t body_begin, Batch& batch) const
+      -> std::optional<int32_t>;
+
+  // Builds the instructions for the body of `function` on their own, as
+  // `ProcessFunctionBody` would in a batch of one, into `insts`,
+  // `integer_constants` and `string_constants`, with the diagnostics resolved
+  // into `diagnostics`.
+  void BuildFunctionBody(
+      const Semantics::Function& function, Semantics::InstTable& insts,
+      llvm::SmallVectorImpl<llvm::APInt>& integer_constants,
+      llvm::SmallVectorImpl<llvm::StringRef>& string_constants,
+      llvm::SmallVectorImpl<Diagnostic>& diagnostics);
+
+  // Returns the names that the body of `function` calls, in the order its
+  // calls end. The body only depends on these functions' types.
+  auto FindCallees(const Semantics::Function& function) const
+      -> llvm::SmallVector<Callee>;
+
+  // Returns the function declared at file scope as `name`, if any.
+  auto LookupFunction(TokenizedBuffer::Identifier name) const
+      -> std::optional<int32_t>;
+
+  // Folds `node` if it is an integer literal, or an arithmetic operator or
+  // parentheses whose operands were all folded, in which case the operands'
+  // values in `folded` are replaced by the node's. Returns whether `node` was
+  // folded.
+  auto FoldExpression(ParseTree::Node node, FoldedValues& folded,
+                      TokenDiagnosticEmitter& emitter) const -> bool;
+
+  // Returns the `index`-th parameter's `PatternBinding` in the declaration of
+  // `function`.
+  auto GetParameterNode(const Semantics::Function& function, int index) const
+      -> ParseTree::Node;
+
+  // Returns `type` as it is spelled, for diagnostics.
+  auto GetTypeName(Semantics::TypeId type) const -> std::string;
+
+  TokenizedBuffer* tokens_;
+  DiagnosticConsumer* consumer_;
+  TokenizedBuffer::TokenLocationTranslator translator_;
+  TokenDiagnosticEmitter emitter_;
   SemanticsIR semantics_;
+  // The type of integer constants, interned before the bodies are processed.
+  Semantics::TypeId integer_type_;
+  const CancellationToken* cancellation_ = nullptr;
 };
 
 }  // namespace Cocktail
 
-#endif  // COCKTAIL_SEMANTICS_SEMANTICS_IR_FACTORY_H
\ No newline at end of file
+#endif  // COCKTAIL_SEMANTICS_SEMANTICS_IR_FACTORY_H
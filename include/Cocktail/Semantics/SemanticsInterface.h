@@ -0,0 +1,93 @@
+#ifndef COCKTAIL_SEMANTICS_SEMANTICS_INTERFACE_H
+#define COCKTAIL_SEMANTICS_SEMANTICS_INTERFACE_H
+
+#include <cstdint>
+
+#include "Cocktail/Semantics/SemanticsIR.h"
+#include "Cocktail/Semantics/TypeTable.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// What other files can use of a file's IR: the name and type of each function
+// it declares, without their bodies. Other files are checked against the
+// interface rather than the file's source, so they can be checked without
+// lexing, parsing or checking the file again, and only need rechecking when
+// the interface changes, which a change to a function's body never does.
+//
+// The interface is read in place from the serialized data, which is usually
+// a mapped file, so that importing it costs little more than checking it. Its
+// types are numbered on their own, each after those it is made of, and refer
+// to struct fields by their names' text rather than by identifier.
+class SemanticsInterface {
+ public:
+  // The version of the format that `Serialize` writes. Bump it whenever the
+  // format changes.
+  static constexpr uint32_t SerializationVersion = 1;
+
+  // Writes the interface of `semantics_ir`, which only has the functions
+  // declared in its own file, in a compact binary format. The same interface
+  // is always written the same way, so data that is unchanged means that the
+  // interface is.
+  static auto Serialize(const SemanticsIR& semantics_ir,
+                        llvm::raw_ostream& output_stream) -> void;
+
+  // Returns the interface that `Serialize` wrote to `data`, which it refers
+  // into, or llvm::None if the data is malformed, corrupted or from another
+  // version of the format.
+  static auto Deserialize(llvm::StringRef data)
+      -> llvm::Optional<SemanticsInterface>;
+
+  auto function_count() const -> int { return function_count_; }
+  auto function_name(int index) const -> llvm::StringRef;
+  // The index of the function's type among the interface's types.
+  auto function_type(int index) const -> int32_t;
+
+  auto type_count() const -> int { return type_count_; }
+  auto type_kind(int32_t type) const -> Semantics::TypeKind;
+  // The bit width of a sized type.
+  auto bit_width(int32_t type) const -> int32_t;
+  // The return type of a function type.
+  auto return_type(int32_t type) const -> int32_t;
+  // The pointee of a pointer type.
+  auto pointee(int32_t type) const -> int32_t;
+  // The number of types that a type is made of, as for
+  // `TypeTable::elements`, and the index of each.
+  auto element_count(int32_t type) const -> int;
+  auto element(int32_t type, int index) const -> int32_t;
+  // The name of a struct's field, in the order of its elements.
+  auto field_name(int32_t type, int index) const -> llvm::StringRef;
+
+  // A hash of the whole interface, which changes whenever it does.
+  auto hash() const -> uint64_t { return hash_; }
+
+  // The data the interface is read from.
+  auto data() const -> llvm::StringRef { return data_; }
+
+ private:
+  explicit SemanticsInterface(llvm::StringRef data) : data_(data) {}
+
+  // Returns the `index`th string of the string table.
+  auto GetString(uint32_t index) const -> llvm::StringRef;
+
+  // Returns where the elements of `type` start in the element table.
+  auto GetElementsBegin(int32_t type) const -> uint32_t;
+
+  llvm::StringRef data_;
+  uint64_t hash_ = 0;
+  int function_count_ = 0;
+  int type_count_ = 0;
+  int string_count_ = 0;
+  // Where each table starts in `data_`.
+  uint32_t strings_offset_ = 0;
+  uint32_t types_offset_ = 0;
+  uint32_t elements_offset_ = 0;
+  uint32_t functions_offset_ = 0;
+  uint32_t string_data_offset_ = 0;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_SEMANTICS_SEMANTICS_INTERFACE_H
@@ -0,0 +1,115 @@
+#ifndef COCKTAIL_SEMANTICS_SEMANTICS_QUERIES_H
+#define COCKTAIL_SEMANTICS_SEMANTICS_QUERIES_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Lex/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Semantics/Function.h"
+#include "Cocktail/Semantics/InstTable.h"
+#include "Cocktail/Semantics/TypeTable.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace Cocktail {
+
+class SemanticsIRFactory;
+
+// Answers questions about the semantics of a file on demand, such as the type
+// of one expression, by analyzing only what the answer depends on rather than
+// building the IR of the whole file as `SemanticsIRFactory::Build` does.
+//
+// Each answer is memoized. A function body's also records the functions its
+// calls named, so that `Update` can keep it after an edit that left the body
+// and those functions alone. Imported interfaces aren't queried yet.
+class SemanticsQueries {
+ public:
+  // The instructions of a function's body, numbered from the start of the
+  // body. The operand of an `IntegerConstant` indexes `integer_constants`,
+  // and that of a `StringConstant` `string_constants`.
+  struct FunctionBody {
+    Semantics::InstTable insts;
+    llvm::SmallVector<llvm::APInt, 0> integer_constants;
+    llvm::SmallVector<llvm::StringRef, 0> string_constants;
+    // The diagnostics of the body, with their locations resolved.
+    llvm::SmallVector<Diagnostic, 0> diagnostics;
+  };
+
+  // How many times each kind of query was computed rather than memoized.
+  struct Stats {
+    int declarations = 0;
+    int signatures = 0;
+    int bodies = 0;
+  };
+
+  // Queries `parse_tree`, which was parsed from `tokens`. The diagnostics of
+  // declarations and signatures go to `consumer` as they are computed.
+  SemanticsQueries(TokenizedBuffer& tokens, const ParseTree& parse_tree,
+                   DiagnosticConsumer& consumer);
+  ~SemanticsQueries();
+
+  // Queries `tokens` and `parse_tree` instead, which were made from the
+  // previous ones by `edit`. The bodies of the functions that end before the
+  // edit are kept, unless one of the functions they call doesn't, or a name
+  // they call no longer names the same function.
+  auto Update(TokenizedBuffer& tokens, const ParseTree& parse_tree,
+              const ParseTree::TokenEdit& edit) -> void;
+
+  // The functions declared at file scope, by index, without their types.
+  auto functions() -> llvm::ArrayRef<Semantics::Function>;
+
+  // Returns the function declared at file scope as `name`, if any.
+  auto LookupFunction(TokenizedBuffer::Identifier name)
+      -> std::optional<int32_t>;
+
+  // Returns the function whose declaration `node` is part of, if any.
+  auto FindFunction(ParseTree::Node node) -> std::optional<int32_t>;
+
+  // Returns the type of `function`, from its parameter and return types.
+  auto FunctionType(int32_t function) -> Semantics::TypeId;
+
+  // Returns the instructions of the body of `function`, which are empty for
+  // a function without one.
+  auto Body(int32_t function) -> const FunctionBody&;
+
+  // Returns the type of the expression `node`, if the body it is in has an
+  // instruction for its value.
+  auto ExpressionType(ParseTree::Node node) -> std::optional<Semantics::TypeId>;
+
+  auto types() const -> const Semantics::TypeTable&;
+  auto stats() const -> const Stats& { return stats_; }
+
+ private:
+  // A memoized body, with what it was computed from.
+  struct BodyEntry {
+    FunctionBody body;
+    llvm::SmallVector<std::pair<TokenizedBuffer::Identifier,
+                                std::optional<int32_t>>,
+                      4>
+        callees;
+    // The instruction of each node that has one, by node index.
+    llvm::DenseMap<int32_t, int32_t> insts_by_node;
+  };
+
+  // Declares the functions at file scope, if they aren't yet.
+  auto Declare() -> void;
+
+  TokenizedBuffer* tokens_;
+  const ParseTree* parse_tree_;
+  DiagnosticConsumer* consumer_;
+  std::unique_ptr<SemanticsIRFactory> factory_;
+  bool declared_ = false;
+  // The first token after each function's declaration, by index.
+  llvm::SmallVector<int32_t, 0> function_ends_;
+  llvm::SmallVector<bool, 0> has_type_;
+  llvm::SmallVector<std::unique_ptr<BodyEntry>, 0> bodies_;
+  Stats stats_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_SEMANTICS_SEMANTICS_QUERIES_H
@@ -0,0 +1,166 @@
+#ifndef COCKTAIL_SEMANTICS_TYPE_TABLE_H
+#define COCKTAIL_SEMANTICS_TYPE_TABLE_H
+
+#include <cstdint>
+#include <optional>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail::Semantics {
+
+// A type, by its index in a `TypeTable`. Each distinct type is interned
+// once, so two types are the same exactly when their IDs are, and comparing
+// them never looks at their structure. The builtin types have fixed IDs,
+// which every table starts with.
+enum class TypeId : int32_t {
+  // The type of an expression that was diagnosed, or that isn't analyzed
+  // yet, so that what uses it isn't diagnosed again.
+  Error,
+  Bool,
+  // The type of types.
+  Type,
+  String,
+  // The type of `()`, which is also what functions without a return type
+  // return.
+  EmptyTuple,
+};
+
+enum class TypeKind : int8_t {
+  Error,
+  Bool,
+  Type,
+  String,
+  // A sized type literal, such as `i32`, `u8` or `f64`.
+  Int,
+  UnsignedInt,
+  Float,
+  Tuple,
+  Struct,
+  Function,
+  Pointer,
+};
+
+// The types of an IR, by their ID. Like `InstTable`, the table is a struct of
+// arrays: each type has a kind and a payload, whose meaning depends on the
+// kind, and the types it is made of are a range of a pool shared by the whole
+// table.
+class TypeTable {
+ public:
+  // Creates a table with only the builtin types.
+  TypeTable();
+
+  auto size() const -> int { return kinds_.size(); }
+
+  // Each of these returns the ID of the type, interning it if it is new.
+  auto GetSizedType(TypeKind kind, int32_t bit_width) -> TypeId;
+  auto GetTupleType(llvm::ArrayRef<TypeId> elements) -> TypeId;
+  // The fields are given in declaration order, which is part of the type.
+  auto GetStructType(llvm::ArrayRef<TokenizedBuffer::Identifier> field_names,
+                     llvm::ArrayRef<TypeId> field_types) -> TypeId;
+  auto GetFunctionType(llvm::ArrayRef<TypeId> params, TypeId return_type)
+      -> TypeId;
+  auto GetPointerType(TypeId pointee) -> TypeId;
+
+  // Each of these returns the ID of the type if it is interned already, and
+  // otherwise none. The table isn't changed, so these can be called from
+  // several threads at once.
+  auto FindTupleType(llvm::ArrayRef<TypeId> elements) const
+      -> std::optional<TypeId>;
+  auto FindStructType(llvm::ArrayRef<TokenizedBuffer::Identifier> field_names,
+                      llvm::ArrayRef<TypeId> field_types) const
+      -> std::optional<TypeId>;
+
+  auto kind(TypeId type) const -> TypeKind { return kinds_[Index(type)]; }
+
+  // The bit width of a sized type.
+  auto bit_width(TypeId type) const -> int32_t {
+    COCKTAIL_DCHECK(IsSized(kind(type))) << "Type isn't sized!";
+    return payloads_[Index(type)];
+  }
+
+  // The types that a type is made of: a tuple's elements, a struct's field
+  // types or a function's parameter types. Empty for other types.
+  auto elements(TypeId type) const -> llvm::ArrayRef<TypeId>;
+
+  // The names of a struct's fields, in the order of its `elements`.
+  auto field_names(TypeId type) const
+      -> llvm::ArrayRef<TokenizedBuffer::Identifier>;
+
+  auto return_type(TypeId type) const -> TypeId {
+    COCKTAIL_DCHECK(kind(type) == TypeKind::Function)
+        << "Type isn't a function!";
+    return static_cast<TypeId>(payloads_[Index(type)]);
+  }
+
+  auto pointee(TypeId type) const -> TypeId {
+    COCKTAIL_DCHECK(kind(type) == TypeKind::Pointer) << "Type isn't a pointer!";
+    return static_cast<TypeId>(payloads_[Index(type)]);
+  }
+
+  // Prints `type` the way it is spelled in source. Struct field names are
+  // identifiers of `tokens`.
+  auto Print(llvm::raw_ostream& output, TypeId type,
+             const TokenizedBuffer& tokens) const -> void;
+
+  // Returns the number of bytes allocated to store the table.
+  auto memory_bytes() const -> int64_t;
+
+ private:
+  // A type as it is looked up, before it has an ID.
+  struct Key {
+    TypeKind kind;
+    int32_t payload = 0;
+    llvm::ArrayRef<TypeId> elements = {};
+    llvm::ArrayRef<TokenizedBuffer::Identifier> field_names = {};
+  };
+
+  static auto Index(TypeId type) -> int32_t {
+    return static_cast<int32_t>(type);
+  }
+
+  static auto IsSized(TypeKind kind) -> bool {
+    return kind == TypeKind::Int || kind == TypeKind::UnsignedInt ||
+           kind == TypeKind::Float;
+  }
+
+  static auto HashKey(const Key& key) -> unsigned;
+
+  // Returns the key that `type` was interned with.
+  auto GetKey(TypeId type) const -> Key;
+
+  // Returns the ID of the type `key` describes, adding it if it is new.
+  auto Intern(const Key& key) -> TypeId;
+
+  // Returns the ID of the type `key` describes, if it has one.
+  auto Find(const Key& key) const -> std::optional<TypeId>;
+
+  // Returns the slot for `key`: the type it describes, or else the empty slot
+  // that type would go in.
+  auto FindSlot(const Key& key) const -> int;
+
+  // Doubles the size of the lookup table, keeping the load factor at most a
+  // half.
+  auto Grow() -> void;
+
+  llvm::SmallVector<TypeKind, 0> kinds_;
+  // The bit width of a sized type, the return type of a function, the
+  // pointee of a pointer, or the start of a struct's fields in
+  // `field_names_`.
+  llvm::SmallVector<int32_t, 0> payloads_;
+  // Where each type's elements end in `elements_`. They start where the
+  // previous type's end.
+  llvm::SmallVector<int32_t, 0> element_ends_;
+  llvm::SmallVector<TypeId, 0> elements_;
+  llvm::SmallVector<TokenizedBuffer::Identifier, 0> field_names_;
+  // An open-addressing table with linear probing, like `SemanticsIR::Block`,
+  // of the index of each type. Empty slots are -1.
+  llvm::SmallVector<int32_t, 0> lookup_;
+};
+
+}  // namespace Cocktail::Semantics
+
+#endif  // COCKTAIL_SEMANTICS_TYPE_TABLE_H
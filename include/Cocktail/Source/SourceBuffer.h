@@ -1,11 +1,15 @@
 #ifndef COCKTAIL_SOURCE_SOURCE_BUFFER_H
 #define COCKTAIL_SOURCE_SOURCE_BUFFER_H
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
 
+#include "Cocktail/Common/TaskScheduler.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/VirtualFileSystem.h"
@@ -20,24 +24,73 @@ class SourceBuffer {
                              DiagnosticConsumer& consumer)
       -> std::optional<SourceBuffer>;
 
+  // 在 `scheduler` 上同时打开并读取多个文件，每读完一个文件就在调用线程上用它在
+  // `filenames` 中的下标和它的源缓冲区调用一次 `on_loaded`，无法读取时缓冲区为空。
+  // 调用的顺序是读取完成的顺序，所以处理先读完的文件时，其余文件的读取仍在进行。
+  // 读取时的诊断会在对应的 `on_loaded` 之前在调用线程上发送给 `consumer`。`fs`
+  // 必须可以被多个线程同时使用。
+  static auto CreateFromFiles(
+      llvm::vfs::FileSystem& fs, llvm::ArrayRef<llvm::StringRef> filenames,
+      TaskScheduler& scheduler, DiagnosticConsumer& consumer,
+      llvm::function_ref<auto(int index, std::optional<SourceBuffer> buffer)
+                             ->void>
+          on_loaded) -> void;
+
+  // 将真实文件系统中的文件映射到内存中，而不是读入。词法分析器会直接从页缓存中
+  // 读取文件的页面，并且内核会被告知文件将从头到尾顺序读取一次。
+  static auto CreateFromMappedFile(llvm::StringRef filename,
+                                   DiagnosticConsumer& consumer)
+      -> std::optional<SourceBuffer>;
+
+  // 流式源缓冲区默认最多可以容纳的字节数。
+  static constexpr int64_t DefaultMaxStreamSize = int64_t{1} << 30;
+
+  // 从标准输入（文件名为 "-"）或命名管道这样的流中创建一个源缓冲区。创建时还没有读取
+  // 任何文本，文本会在每次调用 `ReadMore` 时追加到末尾。为此会预留 `max_size` 字节的
+  // 地址空间，所以已经读取的文本的地址不会改变，超出的部分会被诊断并丢弃。
+  static auto CreateFromStream(llvm::StringRef filename,
+                               DiagnosticConsumer& consumer,
+                               int64_t max_size = DefaultMaxStreamSize)
+      -> std::optional<SourceBuffer>;
+
   // 用上面的工厂函数来创建一个源缓冲区。
   SourceBuffer() = delete;
 
   // 返回源文件的名称。
   [[nodiscard]] auto filename() const -> llvm::StringRef { return filename_; }
 
-  // 返回源代码文本的引用。
+  // 返回源代码文本的引用。文件开头的 UTF-8 字节顺序标记不属于文本。
   [[nodiscard]] auto text() const -> llvm::StringRef {
-    return text_->getBuffer();
+    return text_->getBuffer().drop_front(bom_size_);
   }
 
+  // 返回文本是否全部是 ASCII，此时每个字节都是一个字符。从文件创建的源缓冲区在创建
+  // 时就检查过是有效的 UTF-8；流式的源缓冲区不做检查，总是返回 false。
+  [[nodiscard]] auto is_ascii() const -> bool { return is_ascii_; }
+
+  // 返回这是否是一个还没有读到末尾的流式源缓冲区。
+  [[nodiscard]] auto is_streaming() const -> bool { return stream_ != nullptr; }
+
+  // 从流中读取下一段可用的文本并将其追加到 `text()` 之后，必要时会等待。返回之后是否
+  // 还可能有更多的文本；读到流的末尾或者出错时，源缓冲区就不再是流式的了。
+  auto ReadMore(DiagnosticConsumer& consumer) -> bool;
+
  private:
+  class StreamedText;
+
   explicit SourceBuffer(std::string filename,
                         std::unique_ptr<llvm::MemoryBuffer> text)
       : filename_(std::move(filename)), text_(std::move(text)) {}
 
+  // 跳过文本开头的字节顺序标记，并检查文本是否有效的 UTF-8，无效时诊断第一个
+  // 无效的位置。
+  auto ValidateText(DiagnosticConsumer& consumer) -> bool;
+
   std::string filename_;                      // 存储源文件的名称。
   std::unique_ptr<llvm::MemoryBuffer> text_;  // 存储源代码文本。
+  StreamedText* stream_ = nullptr;  // 流式读取时指向 `text_`，否则为空。
+  int bom_size_ = 0;                // 文本开头被跳过的字节顺序标记的长度。
+  bool is_ascii_ = false;           // 文本是否全部是 ASCII。
 };
 
 }  // namespace Cocktail
@@ -0,0 +1,64 @@
+#ifndef COCKTAIL_SOURCE_SOURCE_BUFFER_CACHE_H
+#define COCKTAIL_SOURCE_SOURCE_BUFFER_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace Cocktail {
+
+// 在多次请求之间共享已经读取的源缓冲区，使得同一个会话中的每个文件只需要读取一次。
+// 缓冲区以文件的绝对路径为键，并在每次请求时通过文件的修改时间和大小来判断其是否
+// 仍然有效。可以被多个线程同时使用。
+class SourceBufferCache {
+ public:
+  // 如何处理修改时间或大小发生了变化的文件。
+  enum class Validation {
+    // 重新读取文件并替换缓存的缓冲区。
+    Stat,
+    // 重新读取文件并计算其内容的哈希值。内容没有变化时继续使用缓存的缓冲区，
+    // 这样基于缓冲区的下游缓存也不会失效。
+    ContentHash,
+  };
+
+  explicit SourceBufferCache(llvm::vfs::FileSystem& fs,
+                             Validation validation = Validation::Stat)
+      : fs_(&fs), validation_(validation) {}
+
+  // 返回进程范围内使用真实文件系统的缓存。
+  static auto Global() -> SourceBufferCache&;
+
+  // 返回文件的源缓冲区，必要时读取文件。文件无法读取时会诊断并返回空指针。
+  // 返回的缓冲区是只读的，缓存替换它之后也仍然有效。它的文件名是第一次读取它时
+  // 所用的文件名。
+  auto Get(llvm::StringRef filename, DiagnosticConsumer& consumer)
+      -> std::shared_ptr<SourceBuffer>;
+
+  // 丢弃所有缓存的缓冲区。
+  auto Clear() -> void;
+
+ private:
+  struct Entry {
+    llvm::sys::TimePoint<> modification_time;
+    uint64_t size;
+    // 只在 `Validation::ContentHash` 时计算。
+    uint64_t content_hash;
+    std::shared_ptr<SourceBuffer> buffer;
+  };
+
+  llvm::vfs::FileSystem* fs_;
+  Validation validation_;
+  std::mutex mutex_;
+  llvm::StringMap<Entry> entries_;
+};
+
+}  // namespace Cocktail
+
+#endif  // COCKTAIL_SOURCE_SOURCE_BUFFER_CACHE_H
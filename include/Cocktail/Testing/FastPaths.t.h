@@ -0,0 +1,254 @@
+#ifndef COCKTAIL_TESTING_FAST_PATHS_T_H
+#define COCKTAIL_TESTING_FAST_PATHS_T_H
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Testing/Fuzzer.t.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail::Testing {
+
+// How the fast paths are run by `CompareFastPaths`.
+struct FastPathOptions {
+  // The sizes of the chunks that the parallel lexer and parser split the
+  // input into. Small chunks split it in many places.
+  int64_t lex_chunk_size = 64;
+  int parse_chunk_size = 16;
+  // The bytes of the input that `Relex` and `Reparse` insert into the input
+  // without them. Clamped to the input.
+  int64_t edit_offset = 0;
+  int64_t edit_length = 0;
+};
+
+// A fast path that came out differently from the serial reference.
+struct FastPathDifference {
+  std::string fast_path;
+  // The first line that differs in a printout of what each made.
+  std::string difference;
+};
+
+// Returns the first line that differs between `expected` and `actual`, or an
+// empty string if they're the same.
+inline auto FirstDifference(llvm::StringRef expected, llvm::StringRef actual)
+    -> std::string {
+  if (expected == actual) {
+    return "";
+  }
+  for (int line = 1;; ++line) {
+    auto [expected_line, expected_rest] = expected.split('\n');
+    auto [actual_line, actual_rest] = actual.split('\n');
+    if (expected.empty() || actual.empty() || expected_line != actual_line) {
+      return llvm::formatv("line {0}:\n  expected: {1}\n  actual:   {2}",
+                           line, expected.empty() ? "(none)" : expected_line,
+                           actual.empty() ? "(none)" : actual_line)
+          .str();
+    }
+    expected = expected_rest;
+    actual = actual_rest;
+  }
+}
+
+// Prints every token, with its line, identifier and value, one a line.
+inline auto PrintTokens(const TokenizedBuffer& tokens) -> std::string {
+  std::string printed;
+  llvm::raw_string_ostream out(printed);
+  tokens.Print(out, TokenizedBuffer::PrintFormat::Ndjson);
+  return out.str();
+}
+
+// Prints every node, one a line.
+inline auto PrintTree(const ParseTree& tree) -> std::string {
+  std::string printed;
+  llvm::raw_string_ostream out(printed);
+  tree.Print(out, ParseTree::PrintFormat::Ndjson);
+  return out.str();
+}
+
+// Prints the nodes of the subtree of `root` in postorder, with the position
+// of each node's token and its number of children, which together give the
+// shape of the subtree. Subtrees of different trees print the same if they
+// are the same.
+inline auto PrintSubtree(const ParseTree& tree, const TokenizedBuffer& tokens,
+                         ParseTree::Node root) -> std::string {
+  std::string printed;
+  llvm::raw_string_ostream out(printed);
+  for (ParseTree::Node n : tree.postorder(root)) {
+    auto children = tree.children(n);
+    TokenizedBuffer::Token token = tree.node_token(n);
+    out << tree.node_kind(n).name() << " " << tokens.GetLineNumber(token)
+        << ":" << tokens.GetColumnNumber(token) << " children: "
+        << std::distance(children.begin(), children.end())
+        << (tree.node_has_error(n) ? " error" : "") << "\n";
+  }
+  return out.str();
+}
+
+// Lexes and parses `text` serially with `TokenizedBuffer::Lex` and
+// `ParseTree::Parse`, then with each fast path, and returns how each fast path
+// that made different tokens or nodes differed. The fast paths are parallel
+// lexing and parsing on `scheduler`, lazy literal values, relexing and
+// reparsing an edit, serializing and deserializing, and parsing skipped
+// function bodies. Returns nothing if `text` isn't valid UTF-8.
+inline auto CompareFastPaths(llvm::StringRef text, TaskScheduler& scheduler,
+                             const FastPathOptions& options = {})
+    -> std::vector<FastPathDifference> {
+  std::vector<FastPathDifference> differences;
+  std::optional<SourceBuffer> source = CreateSourceFromText(text);
+  if (!source) {
+    return differences;
+  }
+  auto compare = [&](llvm::StringRef fast_path, llvm::StringRef expected,
+                     llvm::StringRef actual) {
+    std::string difference = FirstDifference(expected, actual);
+    if (!difference.empty()) {
+      differences.push_back({fast_path.str(), std::move(difference)});
+    }
+  };
+  auto compare_errors = [&](llvm::StringRef fast_path, bool expected,
+                            bool actual) {
+    if (expected != actual) {
+      differences.push_back(
+          {fast_path.str(),
+           llvm::formatv("has_errors: expected {0}, actual {1}", expected,
+                         actual)
+               .str()});
+    }
+  };
+
+  TokenizedBuffer tokens =
+      TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
+  std::string printed_tokens = PrintTokens(tokens);
+  ParseTree tree = ParseTree::Parse(tokens, NullDiagnosticConsumer());
+  std::string printed_tree = PrintTree(tree);
+
+  // Lexing.
+  TokenizedBuffer parallel_tokens =
+      TokenizedBuffer::Lex(*source, NullDiagnosticConsumer(), scheduler,
+                           std::max<int64_t>(1, options.lex_chunk_size));
+  compare("parallel Lex", printed_tokens, PrintTokens(parallel_tokens));
+  compare_errors("parallel Lex", tokens.has_errors(),
+                 parallel_tokens.has_errors());
+
+  TokenizedBuffer lazy_tokens = TokenizedBuffer::Lex(
+      *source, NullDiagnosticConsumer(),
+      TokenizedBuffer::LiteralValues::Lazy);
+  lazy_tokens.ValidateLiterals(NullDiagnosticConsumer());
+  compare("lazy literal values", printed_tokens, PrintTokens(lazy_tokens));
+  compare_errors("lazy literal values", tokens.has_errors(),
+                 lazy_tokens.has_errors());
+
+  std::string serialized_tokens;
+  llvm::raw_string_ostream serialized_tokens_out(serialized_tokens);
+  tokens.Serialize(serialized_tokens_out);
+  llvm::Optional<TokenizedBuffer> deserialized_tokens =
+      TokenizedBuffer::Deserialize(*source, serialized_tokens_out.str());
+  if (!deserialized_tokens) {
+    differences.push_back({"TokenizedBuffer::Deserialize", "no buffer"});
+  } else {
+    compare("TokenizedBuffer::Deserialize", printed_tokens,
+            PrintTokens(*deserialized_tokens));
+  }
+
+  // Parsing.
+  ParseTree parallel_tree =
+      ParseTree::Parse(tokens, NullDiagnosticConsumer(), scheduler,
+                       std::max(1, options.parse_chunk_size));
+  compare("parallel Parse", printed_tree, PrintTree(parallel_tree));
+  compare_errors("parallel Parse", tree.has_errors(),
+                 parallel_tree.has_errors());
+
+  std::string serialized_tree;
+  llvm::raw_string_ostream serialized_tree_out(serialized_tree);
+  tree.Serialize(serialized_tree_out);
+  llvm::Optional<ParseTree> deserialized_tree =
+      ParseTree::Deserialize(tokens, serialized_tree_out.str());
+  if (!deserialized_tree) {
+    differences.push_back({"ParseTree::Deserialize", "no tree"});
+  } else {
+    compare("ParseTree::Deserialize", printed_tree,
+            PrintTree(*deserialized_tree));
+  }
+
+  // Each skipped body parses to the same nodes as the body in `tree`.
+  ParseTree skipped_tree = ParseTree::Parse(
+      tokens, NullDiagnosticConsumer(), ParseTree::NodeStorage::Reserved,
+      ParseTree::FunctionBodies::Skipped);
+  for (ParseTree::Node skipped : skipped_tree.postorder()) {
+    if (skipped_tree.node_kind(skipped) !=
+        ParseNodeKind::SkippedCodeBlock()) {
+      continue;
+    }
+    ParseTree body =
+        skipped_tree.ParseSkippedCodeBlock(skipped, NullDiagnosticConsumer());
+    ParseTree::Node body_root = *body.roots().begin();
+    std::string printed_body = PrintSubtree(body, tokens, body_root);
+    std::string printed_full_body = "(none)";
+    for (ParseTree::Node n : tree.postorder()) {
+      if (tree.node_kind(n) == body.node_kind(body_root) &&
+          tree.node_token(n) == body.node_token(body_root)) {
+        printed_full_body = PrintSubtree(tree, tokens, n);
+        break;
+      }
+    }
+    compare("ParseSkippedCodeBlock", printed_full_body, printed_body);
+  }
+
+  // Relexing and reparsing the input from the input without the edit.
+  int64_t edit_offset =
+      std::clamp<int64_t>(options.edit_offset, 0, text.size());
+  int64_t edit_length =
+      std::clamp<int64_t>(options.edit_length, 0, text.size() - edit_offset);
+  std::string previous_text = (text.take_front(edit_offset) +
+                               text.drop_front(edit_offset + edit_length))
+                                  .str();
+  std::optional<SourceBuffer> previous_source =
+      CreateSourceFromText(previous_text);
+  if (!previous_source) {
+    return differences;
+  }
+  TokenizedBuffer previous_tokens =
+      TokenizedBuffer::Lex(*previous_source, NullDiagnosticConsumer());
+  TokenizedBuffer relexed_tokens = TokenizedBuffer::Relex(
+      previous_tokens, *source,
+      {.offset = edit_offset,
+       .removed_length = 0,
+       .inserted_text = source->text().substr(edit_offset, edit_length)},
+      NullDiagnosticConsumer());
+  compare("Relex", printed_tokens, PrintTokens(relexed_tokens));
+  if (!previous_tokens.has_errors()) {
+    compare_errors("Relex", tokens.has_errors(), relexed_tokens.has_errors());
+  }
+
+  llvm::Optional<ParseTree::TokenEdit> token_edit =
+      ParseTree::ComputeTokenEdit(
+          previous_tokens, tokens, previous_text,
+          {.offset = edit_offset,
+           .removed_length = 0,
+           .inserted_text = source->text().substr(edit_offset, edit_length)});
+  if (!token_edit) {
+    return differences;
+  }
+  ParseTree previous_tree =
+      ParseTree::Parse(previous_tokens, NullDiagnosticConsumer());
+  ParseTree reparsed_tree = ParseTree::Reparse(
+      previous_tree, tokens, *token_edit, NullDiagnosticConsumer());
+  compare("Reparse", printed_tree, PrintTree(reparsed_tree));
+  if (!previous_tree.has_errors()) {
+    compare_errors("Reparse", tree.has_errors(), reparsed_tree.has_errors());
+  }
+  return differences;
+}
+
+}  // namespace Cocktail::Testing
+
+#endif  // COCKTAIL_TESTING_FAST_PATHS_T_H
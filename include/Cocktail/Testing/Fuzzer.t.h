@@ -0,0 +1,53 @@
+#ifndef COCKTAIL_TESTING_FUZZER_T_H
+#define COCKTAIL_TESTING_FUZZER_T_H
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace Cocktail::Testing {
+
+// Returns a source buffer of `text`, which it refers to, or nothing if `text`
+// isn't valid UTF-8.
+inline auto CreateSourceFromText(llvm::StringRef text)
+    -> std::optional<SourceBuffer> {
+  constexpr llvm::StringLiteral Filename = "fuzzer_input.cocktail";
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(Filename, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer(
+                 text, Filename, /*RequiresNullTerminator=*/false));
+  return SourceBuffer::CreateFromFile(fs, Filename, NullDiagnosticConsumer());
+}
+
+// Returns the source of a fuzzer input, which is the length of a filename as
+// two bytes, then the filename, then the text. Returns nothing if the input
+// is too short or the text isn't valid UTF-8. The filename is only there for
+// the corpus's sake; the source always has the same one.
+inline auto CreateFuzzerSource(const unsigned char* data, std::size_t size)
+    -> std::optional<SourceBuffer> {
+  if (size < 2) {
+    return std::nullopt;
+  }
+  uint16_t raw_filename_length;
+  std::memcpy(&raw_filename_length, data, 2);
+  data += 2;
+  size -= 2;
+  size_t filename_length = raw_filename_length;
+  if (size < filename_length) {
+    return std::nullopt;
+  }
+  data += filename_length;
+  size -= filename_length;
+  return CreateSourceFromText(
+      llvm::StringRef(reinterpret_cast<const char*>(data), size));
+}
+
+}  // namespace Cocktail::Testing
+
+#endif  // COCKTAIL_TESTING_FUZZER_T_H
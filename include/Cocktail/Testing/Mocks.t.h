@@ -27,7 +27,7 @@ inline auto IsDiagnostic(testing::Matcher<DiagnosticKind> kind,
   return testing::AllOf(
       testing::Field("kind", &Diagnostic::kind, kind),
       testing::Field("level", &Diagnostic::level, level),
-      testing::Field(
+      testing::Property(
           &Diagnostic::location,
           testing::AllOf(
               testing::Field("line_number", &DiagnosticLocation::line_number,
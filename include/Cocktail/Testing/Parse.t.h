@@ -19,6 +19,12 @@
 namespace Cocktail {
 
 inline void PrintTo(const ParseTree& tree, std::ostream* output) {
+  // Printing a generated tree of a million nodes would bury the failure.
+  constexpr int MaxPrintedNodes = 10000;
+  if (tree.size() > MaxPrintedNodes) {
+    *output << "a parse tree of " << tree.size() << " nodes";
+    return;
+  }
   std::string text;
   llvm::raw_string_ostream text_stream(text);
   tree.Print(text_stream);
@@ -281,6 +287,116 @@ auto MatchFunctionWithBody(Args... args) -> ExpectedNode {
       MatchCodeBlock(std::move(args)..., MatchCodeBlockEnd()));
 }
 
+// An expected node in a flat array of them, in postorder as the tree stores
+// its nodes. Unlike a tree of `ExpectedNode`s, such an array takes no
+// recursion to build, match or destroy, so it can describe trees of any size
+// and depth.
+struct ExpectedPostorderNode {
+  ParseNodeKind kind = ParseNodeKind::EmptyDeclaration();
+  // The number of nodes in the subtree of this one, including it.
+  int subtree_size = 1;
+  bool has_error = false;
+};
+
+// Builds an array of `ExpectedPostorderNode`s: `Begin` starts a node, then its
+// children are added, then `End` finishes it.
+class PostorderBuilder {
+ public:
+  auto Begin() -> void { starts_.push_back(nodes_.size()); }
+
+  auto End(ParseNodeKind kind, bool has_error = false) -> void {
+    COCKTAIL_CHECK(!starts_.empty()) << "`End` without a `Begin`!";
+    int start = starts_.pop_back_val();
+    nodes_.push_back(
+        {kind, static_cast<int>(nodes_.size()) - start + 1, has_error});
+  }
+
+  auto Leaf(ParseNodeKind kind, bool has_error = false) -> void {
+    nodes_.push_back({kind, 1, has_error});
+  }
+
+  auto Build() && -> std::vector<ExpectedPostorderNode> {
+    COCKTAIL_CHECK(starts_.empty()) << "`Begin` without an `End`!";
+    return std::move(nodes_);
+  }
+
+ private:
+  std::vector<ExpectedPostorderNode> nodes_;
+  llvm::SmallVector<int, 16> starts_;
+};
+
+class ExpectedPostorderMatcher
+    : public ::testing::MatcherInterface<const ParseTree&> {
+ public:
+  explicit ExpectedPostorderMatcher(
+      std::vector<ExpectedPostorderNode> expected_nodes)
+      : expected_nodes_(std::move(expected_nodes)) {}
+
+  auto MatchAndExplain(const ParseTree& tree,
+                       ::testing::MatchResultListener* output_ptr) const
+      -> bool override {
+    auto& output = *output_ptr;
+    // Only the first few mismatches are explained, as one misparse shifts
+    // every node after it.
+    constexpr int MaxExplained = 10;
+    int mismatches = 0;
+    auto explain = [&](int index) -> ::testing::MatchResultListener& {
+      ++mismatches;
+      return output << "\nParse node (postorder index #" << index << ") ";
+    };
+    if (tree.size() != static_cast<int>(expected_nodes_.size())) {
+      output << "\nParse tree has " << tree.size() << " nodes, expected "
+             << expected_nodes_.size() << ".";
+      ++mismatches;
+    }
+    for (ParseTree::Node n : tree.postorder()) {
+      int index = n.index();
+      if (index >= static_cast<int>(expected_nodes_.size()) ||
+          mismatches >= MaxExplained) {
+        break;
+      }
+      const ExpectedPostorderNode& expected = expected_nodes_[index];
+      if (tree.node_kind(n) != expected.kind) {
+        explain(index) << "is a " << tree.node_kind(n).name().str()
+                       << ", expected a " << expected.kind.name().str()
+                       << ".";
+      }
+      int subtree_size = std::distance(tree.postorder(n).begin(),
+                                       tree.postorder(n).end());
+      if (subtree_size != expected.subtree_size) {
+        explain(index) << "has a subtree of " << subtree_size
+                       << " nodes, expected " << expected.subtree_size
+                       << ".";
+      }
+      if (tree.node_has_error(n) != expected.has_error) {
+        explain(index) << (expected.has_error ? "does not have an error"
+                                              : "has an error")
+                       << ", expected that it "
+                       << (expected.has_error ? "has one" : "does not")
+                       << ".";
+      }
+    }
+    return mismatches == 0;
+  }
+
+  auto DescribeTo(std::ostream* output_ptr) const -> void override {
+    *output_ptr << "Matches " << expected_nodes_.size()
+                << " expected nodes in postorder";
+  }
+
+ private:
+  std::vector<ExpectedPostorderNode> expected_nodes_;
+};
+
+// Matches a tree's nodes, compared one by one in postorder, against
+// `expected_nodes`. For trees too large to spell out as `ExpectedNode`s.
+inline auto MatchParseTreePostorder(
+    std::vector<ExpectedPostorderNode> expected_nodes)
+    -> ::testing::Matcher<const ParseTree&> {
+  return ::testing::MakeMatcher(
+      new ExpectedPostorderMatcher(std::move(expected_nodes)));
+}
+
 }  // namespace Testing
 
 }  // namespace Cocktail
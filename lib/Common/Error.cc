@@ -0,0 +1,104 @@
+#include "Cocktail/Common/Error.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// 将`format`中的`{N}`替换为第N个参数后输出，其余文本原样输出。
+static auto PrintFormatted(llvm::raw_ostream& out, llvm::StringRef format,
+                           llvm::ArrayRef<llvm::StringRef> args) -> void {
+  while (!format.empty()) {
+    size_t open = format.find('{');
+    out << format.take_front(open);
+    if (open == llvm::StringRef::npos) {
+      return;
+    }
+    format = format.drop_front(open);
+    size_t close = format.find('}');
+    unsigned index;
+    if (close != llvm::StringRef::npos &&
+        !format.slice(1, close).getAsInteger(10, index) &&
+        index < args.size()) {
+      out << args[index];
+      format = format.drop_front(close + 1);
+    } else {
+      out << '{';
+      format = format.drop_front(1);
+    }
+  }
+}
+
+Error::Error(llvm::Twine location, llvm::Twine message)
+    : text_(location.str()), location_size_(text_.size()) {
+  llvm::raw_string_ostream out(text_);
+  out << message;
+  COCKTAIL_CHECK(text_.size() > static_cast<size_t>(location_size_))
+      << "Errors must have a message.";
+}
+
+Error::Error(std::string text, int location_size)
+    : text_(std::move(text)), location_size_(location_size) {
+  COCKTAIL_CHECK(text_.size() > static_cast<size_t>(location_size_))
+      << "Errors must have a message.";
+}
+
+Error::Error(const ErrorMessage& message,
+             llvm::ArrayRef<Internal::ErrorArgText> args) {
+  COCKTAIL_CHECK(!message.format.empty()) << "Errors must have a message.";
+  size_t size = 0;
+  for (const auto& arg : args) {
+    size += arg.text().size();
+  }
+  if (size <= InlineArgsSize) {
+    static_ = &message;
+    size_t end = 0;
+    for (const auto& arg : args) {
+      std::copy(arg.text().begin(), arg.text().end(), args_ + end);
+      end += arg.text().size();
+      arg_ends_[num_args_++] = end;
+    }
+    return;
+  }
+
+  // 参数放不下时，立即格式化到`text_`中。
+  llvm::SmallVector<llvm::StringRef, MaxArgs> texts;
+  for (const auto& arg : args) {
+    texts.push_back(arg.text());
+  }
+  llvm::raw_string_ostream out(text_);
+  PrintFormatted(out, message.format, texts);
+}
+
+auto Error::Print(llvm::raw_ostream& out) const -> void {
+  if (!location().empty()) {
+    out << location() << ": ";
+  }
+  if (static_ == nullptr) {
+    out << llvm::StringRef(text_).drop_front(location_size_);
+    return;
+  }
+  llvm::StringRef texts[MaxArgs];
+  int begin = 0;
+  for (int i = 0; i < num_args_; ++i) {
+    texts[i] = llvm::StringRef(args_ + begin, arg_ends_[i] - begin);
+    begin = arg_ends_[i];
+  }
+  PrintFormatted(out, static_->format,
+                 llvm::ArrayRef<llvm::StringRef>(texts, num_args_));
+}
+
+auto Error::message() const -> std::string {
+  if (static_ == nullptr) {
+    return text_.substr(location_size_);
+  }
+  std::string result;
+  llvm::raw_string_ostream out(result);
+  // 位置为空，Print只输出消息。
+  Print(out);
+  return result;
+}
+
+}  // namespace Cocktail
@@ -1,8 +1,11 @@
 #include "Cocktail/Common/StringHelpers.h"
 
 #include <algorithm>
+#include <charconv>
+#include <iterator>
 #include <optional>
 
+#include "Cocktail/Common/ByteVector.h"
 #include "Cocktail/Common/Check.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
@@ -13,6 +16,17 @@ namespace Cocktail {
 static constexpr llvm::StringRef TripleQuotes = "'''";
 static constexpr llvm::StringRef HorizontalWhitespaceChars = " \t";
 
+COCKTAIL_ERROR_MESSAGE(TooFewLines, "Too few lines");
+COCKTAIL_ERROR_MESSAGE(NoLeadingTripleQuotes,
+                       "Should start with triple quotes: {0}");
+COCKTAIL_ERROR_MESSAGE(InvalidFileTypeIndicator,
+                       "Invalid characters in file type indicator: {0}");
+COCKTAIL_ERROR_MESSAGE(NoEndingTripleQuotes,
+                       "Should end with triple quotes: {0}");
+COCKTAIL_ERROR_MESSAGE(WrongIndent,
+                       "Wrong indent for line: {0}, expected {1}");
+COCKTAIL_ERROR_MESSAGE(InvalidEscaping, "Invalid escaping in {0}");
+
 /// 只使用大写的十六进制。
 static auto FromHex(char c) -> std::optional<char> {
   if (c >= '0' && c <= '9') {
@@ -24,20 +38,49 @@ static auto FromHex(char c) -> std::optional<char> {
   return std::nullopt;
 }
 
-auto UnescapeStringLiteral(llvm::StringRef source, const int hashtag_num,
-                           bool is_block_string) -> std::optional<std::string> {
-  std::string ret;
-  ret.reserve(source.size());
+namespace {
+// Matches characters that `UnescapeStringLiteral` copies unchanged, which is
+// everything except `\\` and `\t`.
+struct PlainCharMatcher {
+#if COCKTAIL_BYTE_VECTORS
+  static auto Match(ByteVector bytes) -> ByteVector {
+    return BytesNot(BytesOr(BytesEqual(bytes, SplatByte('\\')),
+                            BytesEqual(bytes, SplatByte('\t'))));
+  }
+#endif
+  static auto Match(char c) -> bool { return c != '\\' && c != '\t'; }
+};
+}  // namespace
+
+// Unescapes `source` onto the end of `ret`, returning false if it contains an
+// invalid escape. When `escaped_end` is given, an escape at the very end of
+// `source` is treated as escaping a newline that follows it, and `escaped_end`
+// reports whether that happened.
+static auto UnescapeStringLiteralInto(llvm::StringRef source,
+                                      const int hashtag_num,
+                                      bool is_block_string, std::string& ret,
+                                      bool* escaped_end = nullptr) -> bool {
   std::string escape = "\\";
   escape.resize(hashtag_num + 1, '#');
   size_t i = 0;
   while (i < source.size()) {
+    // Copy the run of plain characters up to the next escape or tab at once.
+    size_t plain = ScanWhile<PlainCharMatcher>(source.substr(i));
+    ret.append(source.data() + i, plain);
+    i += plain;
+    if (i == source.size()) {
+      break;
+    }
     char c = source[i];
     if (i + hashtag_num < source.size() &&
         source.slice(i, i + hashtag_num + 1).equals(escape)) {
       i += hashtag_num + 1;
       if (i == source.size()) {
-        return std::nullopt;
+        if (escaped_end == nullptr) {
+          return false;
+        }
+        *escaped_end = true;
+        return true;
       }
       switch (source[i]) {
         case 'n':
@@ -52,7 +95,7 @@ auto UnescapeStringLiteral(llvm::StringRef source, const int hashtag_num,
         case '0':
           if (i + 1 < source.size() && llvm::isDigit(source[i + 1])) {
             // \0[0-9] is reserved.
-            return std::nullopt;
+            return false;
           }
           ret.push_back('\0');
           break;
@@ -68,12 +111,12 @@ auto UnescapeStringLiteral(llvm::StringRef source, const int hashtag_num,
         case 'x': {
           i += 2;
           if (i >= source.size()) {
-            return std::nullopt;
+            return false;
           }
           std::optional<char> c1 = FromHex(source[i - 1]);
           std::optional<char> c2 = FromHex(source[i]);
           if (c1 == std::nullopt || c2 == std::nullopt) {
-            return std::nullopt;
+            return false;
           }
           ret.push_back(16 * *c1 + *c2);
           break;
@@ -81,7 +124,7 @@ auto UnescapeStringLiteral(llvm::StringRef source, const int hashtag_num,
         case 'u': {
           ++i;
           if (i >= source.size() || source[i] != '{') {
-            return std::nullopt;
+            return false;
           }
           unsigned int unicode_int = 0;
           ++i;
@@ -89,77 +132,92 @@ auto UnescapeStringLiteral(llvm::StringRef source, const int hashtag_num,
           while (i < source.size() && source[i] != '}') {
             std::optional<char> hex_val = FromHex(source[i]);
             if (hex_val == std::nullopt) {
-              return std::nullopt;
+              return false;
             }
             unicode_int = unicode_int << 4;
             unicode_int += hex_val.value();
             ++i;
             if (i - original_i > 8) {
-              return std::nullopt;
+              return false;
             }
           }
           if (i >= source.size()) {
-            return std::nullopt;
+            return false;
           }
           if (i - original_i == 0) {
-            return std::nullopt;
+            return false;
           }
           char utf8_buf[4];
           char* utf8_end = &utf8_buf[0];
           if (!llvm::ConvertCodePointToUTF8(unicode_int, utf8_end)) {
-            return std::nullopt;
+            return false;
           }
           ret.append(utf8_buf, utf8_end - utf8_buf);
           break;
         }
         case '\n':
           if (!is_block_string) {
-            return std::nullopt;
+            return false;
           }
           break;
         default:
-          return std::nullopt;
+          return false;
       }
     } else if (c == '\t') {
-      return std::nullopt;
+      return false;
     } else {
       ret.push_back(c);
     }
     ++i;
   }
+  return true;
+}
+
+auto UnescapeStringLiteral(llvm::StringRef source, const int hashtag_num,
+                           bool is_block_string) -> std::optional<std::string> {
+  std::string ret;
+  ret.reserve(source.size());
+  if (!UnescapeStringLiteralInto(source, hashtag_num, is_block_string, ret)) {
+    return std::nullopt;
+  }
   return ret;
 }
 
 auto ParseBlockStringLiteral(llvm::StringRef source, const int hashtag_num)
     -> ErrorOr<std::string> {
-  llvm::SmallVector<llvm::StringRef> lines;
-  source.split(lines, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/true);
-  if (lines.size() < 2) {
-    return Error("Too few lines");
+  // Walk the lines in place rather than splitting them out, and unescape each
+  // one straight into the result.
+  const size_t first_end = source.find('\n');
+  if (first_end == llvm::StringRef::npos) {
+    return Error(TooFewLines);
   }
+  const size_t last_start = source.rfind('\n') + 1;
 
-  llvm::StringRef first = lines[0];
+  llvm::StringRef first = source.take_front(first_end);
   if (!first.consume_front(TripleQuotes)) {
-    return Error("Should start with triple quotes: " + first);
+    return Error(NoLeadingTripleQuotes, first);
   }
   first = first.rtrim(HorizontalWhitespaceChars);
   // Remaining chars, if any, are a file type indicator.
   if (first.find_first_of("\"#") != llvm::StringRef::npos ||
       first.find_first_of(HorizontalWhitespaceChars) != llvm::StringRef::npos) {
-    return Error("Invalid characters in file type indicator: " + first);
+    return Error(InvalidFileTypeIndicator, first);
   }
 
-  llvm::StringRef last = lines[lines.size() - 1];
+  llvm::StringRef last = source.substr(last_start);
   const size_t last_length = last.size();
   last = last.ltrim(HorizontalWhitespaceChars);
   const size_t indent = last_length - last.size();
   if (last != TripleQuotes) {
-    return Error("Should end with triple quotes: " + last);
+    return Error(NoEndingTripleQuotes, last);
   }
 
   std::string parsed;
-  for (size_t i = 1; i < lines.size() - 1; ++i) {
-    llvm::StringRef line = lines[i];
+  parsed.reserve(last_start - first_end);
+  llvm::StringRef body = source.slice(first_end + 1, last_start);
+  while (!body.empty()) {
+    auto [line, rest] = body.split('\n');
+    body = rest;
     const size_t first_non_ws =
         line.find_first_not_of(HorizontalWhitespaceChars);
     if (first_non_ws == llvm::StringRef::npos) {
@@ -167,27 +225,157 @@ auto ParseBlockStringLiteral(llvm::StringRef source, const int hashtag_num)
       line = "";
     } else {
       if (first_non_ws < indent) {
-        return Error("Wrong indent for line: " + line + ", expected " +
-                     llvm::Twine(indent));
+        return Error(WrongIndent, line, indent);
       }
       line = line.drop_front(indent).rtrim(HorizontalWhitespaceChars);
     }
-    // Unescaping with \n appended to handle things like \\<newline>.
-    llvm::SmallVector<char> buffer;
-    std::optional<std::string> unescaped =
-        UnescapeStringLiteral((line + "\n").toStringRef(buffer), hashtag_num,
-                              /*is_block_string=*/true);
-    if (!unescaped.has_value()) {
-      return Error("Invalid escaping in " + line);
+    // The line is unescaped as if it still ended in its newline, so that a
+    // trailing \<newline> collapses into nothing.
+    bool escaped_newline = false;
+    if (!UnescapeStringLiteralInto(line, hashtag_num, /*is_block_string=*/true,
+                                   parsed, &escaped_newline)) {
+      return Error(InvalidEscaping, line);
     }
-    // A \<newline> string collapses into nothing.
-    if (!unescaped->empty()) {
-      parsed.append(*unescaped);
+    if (!escaped_newline) {
+      parsed += '\n';
     }
   }
   return parsed;
 }
 
+// Checks the UTF-8 sequences starting before `stop`, the last of which may end
+// after it, advancing `position` past them and clearing `is_ascii` if any is
+// longer than a byte. Returns false, leaving `position` at the start of the
+// sequence, if one is invalid.
+static auto ValidateUtf8Sequences(const char*& position, const char* stop,
+                                  const char* end, bool& is_ascii) -> bool {
+  while (position < stop) {
+    auto lead = static_cast<unsigned char>(*position);
+    if (lead < 0x80) {
+      ++position;
+      continue;
+    }
+    is_ascii = false;
+
+    // The range of the second byte also excludes overlong encodings,
+    // surrogates and code points past U+10FFFF.
+    int length;
+    unsigned char second_min = 0x80;
+    unsigned char second_max = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+      length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+      length = 3;
+      if (lead == 0xE0) {
+        second_min = 0xA0;
+      } else if (lead == 0xED) {
+        second_max = 0x9F;
+      }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+      length = 4;
+      if (lead == 0xF0) {
+        second_min = 0x90;
+      } else if (lead == 0xF4) {
+        second_max = 0x8F;
+      }
+    } else {
+      return false;
+    }
+
+    if (end - position < length) {
+      return false;
+    }
+    auto second = static_cast<unsigned char>(position[1]);
+    if (second < second_min || second > second_max) {
+      return false;
+    }
+    for (int i = 2; i < length; ++i) {
+      if ((static_cast<unsigned char>(position[i]) & 0xC0) != 0x80) {
+        return false;
+      }
+    }
+    position += length;
+  }
+  return true;
+}
+
+auto ValidateUtf8(llvm::StringRef text) -> Utf8Validation {
+  const char* const begin = text.begin();
+  const char* const end = text.end();
+  const char* position = begin;
+  bool is_ascii = true;
+#if COCKTAIL_BYTE_VECTORS
+  // Source is almost all ASCII, so blocks of four vectors are checked for any
+  // high bit at once, and only blocks that have one are decoded.
+  constexpr int BlockSize = 4 * sizeof(ByteVector);
+  while (end - position >= BlockSize) {
+    ByteVector bytes = BytesOr(
+        BytesOr(LoadByteVector(position),
+                LoadByteVector(position + sizeof(ByteVector))),
+        BytesOr(LoadByteVector(position + 2 * sizeof(ByteVector)),
+                LoadByteVector(position + 3 * sizeof(ByteVector))));
+    if (!AnyHighBit(bytes)) {
+      position += BlockSize;
+      continue;
+    }
+    if (!ValidateUtf8Sequences(position, position + BlockSize, end,
+                               is_ascii)) {
+      return {.invalid_offset = position - begin, .is_ascii = false};
+    }
+  }
+#endif
+  if (!ValidateUtf8Sequences(position, end, end, is_ascii)) {
+    return {.invalid_offset = position - begin, .is_ascii = false};
+  }
+  return {.invalid_offset = std::nullopt, .is_ascii = is_ascii};
+}
+
+auto AppendJsonString(llvm::SmallVectorImpl<char>& out, llvm::StringRef text)
+    -> void {
+  bool escape_non_ascii = ValidateUtf8(text).invalid_offset.has_value();
+  out.push_back('"');
+  const char* run_start = text.begin();
+  for (const char* it = text.begin(); it != text.end(); ++it) {
+    unsigned char c = *it;
+    bool needs_escape =
+        c < 0x20 || c == '"' || c == '\\' || (c >= 0x80 && escape_non_ascii);
+    if (!needs_escape) {
+      continue;
+    }
+    out.append(run_start, it);
+    run_start = it + 1;
+    switch (c) {
+      case '"':
+        out.append({'\\', '"'});
+        break;
+      case '\\':
+        out.append({'\\', '\\'});
+        break;
+      case '\n':
+        out.append({'\\', 'n'});
+        break;
+      case '\t':
+        out.append({'\\', 't'});
+        break;
+      case '\r':
+        out.append({'\\', 'r'});
+        break;
+      default:
+        out.append({'\\', 'u', '0', '0', llvm::hexdigit(c >> 4, true),
+                    llvm::hexdigit(c & 0xF, true)});
+        break;
+    }
+  }
+  out.append(run_start, text.end());
+  out.push_back('"');
+}
+
+auto AppendInt(llvm::SmallVectorImpl<char>& out, int64_t value) -> void {
+  char digits[24];
+  char* end = std::to_chars(std::begin(digits), std::end(digits), value).ptr;
+  out.append(digits, end);
+}
+
 auto StringRefContainsPointer(llvm::StringRef ref, const char* ptr) -> bool {
   auto le = std::less_equal<>();
   return le(ref.begin(), ptr) && le(ptr, ref.end());
@@ -0,0 +1,162 @@
+#include "Cocktail/Common/TaskScheduler.h"
+
+#include <utility>
+
+#include "Cocktail/Common/Check.h"
+#include "llvm/Support/Threading.h"
+
+namespace Cocktail {
+
+namespace {
+
+// The scheduler whose worker is running on this thread, if any, and which of
+// its workers it is.
+thread_local const TaskScheduler* current_scheduler = nullptr;
+thread_local int current_worker = 0;
+
+}  // namespace
+
+TaskScheduler::TaskScheduler(int num_threads) {
+  COCKTAIL_CHECK(num_threads >= 0) << "Invalid number of threads!";
+  int count = llvm::hardware_concurrency(num_threads).compute_thread_count();
+  for (int i = 0; i != count + 1; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  threads_.reserve(count);
+  for (int i = 0; i != count; ++i) {
+    threads_.emplace_back([this, i] { RunWorker(i); });
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+auto TaskScheduler::CurrentQueueIndex() const -> int {
+  return current_scheduler == this ? current_worker : threads_.size();
+}
+
+auto TaskScheduler::Spawn(std::function<void()> task) -> void {
+  Queue& queue = *queues_[CurrentQueueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_.fetch_add(1, std::memory_order_relaxed);
+  }
+  wake_.notify_one();
+}
+
+auto TaskScheduler::RunOne(int queue_index) -> bool {
+  int num_queues = queues_.size();
+  std::function<void()> task;
+  for (int offset = 0; offset != num_queues && !task; ++offset) {
+    Queue& queue = *queues_[(queue_index + offset) % num_queues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    // A worker runs its own newest task, and otherwise the oldest task of
+    // whichever queue it finds one in. Tasks from other threads run in the
+    // order they were spawned.
+    if (offset == 0 && queue_index != num_queues - 1) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  queued_.fetch_sub(1, std::memory_order_relaxed);
+  task();
+  return true;
+}
+
+auto TaskScheduler::RunWorker(int index) -> void {
+  current_scheduler = this;
+  current_worker = index;
+  while (true) {
+    if (RunOne(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Tasks queued before stopping still run, so only stop once there are
+    // none.
+    wake_.wait(lock, [&] { return stopping_ || queued_ > 0; });
+    if (stopping_ && queued_ <= 0) {
+      return;
+    }
+  }
+}
+
+auto TaskScheduler::HelpWhile(llvm::function_ref<bool()> busy) -> void {
+  int queue_index = CurrentQueueIndex();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (busy()) {
+    if (queued_ > 0) {
+      lock.unlock();
+      RunOne(queue_index);
+      lock.lock();
+    } else {
+      wake_.wait(lock);
+    }
+  }
+}
+
+auto TaskScheduler::WakeWaiters() -> void {
+  // Taking the lock orders this after any waiter's check of whether it is
+  // still busy, so that the waiter is either woken or sees the change.
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  wake_.notify_all();
+}
+
+auto TaskGroup::Run(std::function<void()> task) -> void {
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  scheduler_->Spawn([this, task = std::move(task)] {
+    if (!cancelled()) {
+      task();
+    }
+    // The group may be destroyed as soon as its last task finishes.
+    TaskScheduler* scheduler = scheduler_;
+    pending_.fetch_sub(1, std::memory_order_acq_rel);
+    scheduler->WakeWaiters();
+  });
+}
+
+auto TaskGroup::Wait() -> void {
+  scheduler_->HelpWhile(
+      [&] { return pending_.load(std::memory_order_acquire) != 0; });
+}
+
+auto TaskGroup::Cancel() -> void {
+  cancelled_.store(true, std::memory_order_relaxed);
+  scheduler_->WakeWaiters();
+}
+
+auto ParallelFor(TaskScheduler& scheduler, int count,
+                 llvm::function_ref<void(int index)> body) -> void {
+  if (count <= 0) {
+    return;
+  }
+  TaskGroup group(scheduler);
+  for (int i = 1; i < count; ++i) {
+    group.Run([body, i] { body(i); });
+  }
+  // The calling thread takes the first index rather than waiting idle.
+  body(0);
+  group.Wait();
+}
+
+}  // namespace Cocktail
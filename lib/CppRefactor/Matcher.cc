@@ -1,5 +1,7 @@
 #include "Cocktail/CppRefactor/Matcher.h"
 
+#include <algorithm>
+
 #include "clang/Basic/SourceManager.h"
 
 namespace Cocktail {
@@ -34,4 +36,22 @@ void Matcher::AddReplacement(clang::CharSourceRange range,
   }
 }
 
+void MergeReplacements(const Matcher::ReplacementMap& from,
+                       Matcher::ReplacementMap& into) {
+  for (const auto& [path, replacements] : from) {
+    clang::tooling::Replacements& file_into = into[path];
+    for (const clang::tooling::Replacement& rep : replacements) {
+      // `Replacements` are kept sorted.
+      if (std::binary_search(file_into.begin(), file_into.end(), rep)) {
+        continue;
+      }
+      llvm::Error err = file_into.add(rep);
+      if (err) {
+        llvm::errs() << "Error with replacement `" << rep.toString()
+                     << "`: " << llvm::toString(std::move(err)) << "\n";
+      }
+    }
+  }
+}
+
 }  // namespace Cocktail
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "Cocktail/CppRefactor/PreambleCache.h"
+
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "llvm/Support/StringSaver.h"
+
+namespace Cocktail {
+
+// Returns the compile command of `invocation` without its main file, so that
+// files compiled the same way have the same key.
+static auto GetCommandKey(const clang::CompilerInvocation& invocation)
+    -> std::string {
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<const char*> args;
+  invocation.generateCC1CommandLine(
+      args, [&](const llvm::Twine& arg) { return saver.save(arg).data(); });
+  llvm::StringRef main_file =
+      invocation.getFrontendOpts().Inputs[0].getFile();
+  std::string key;
+  for (size_t i = 0; i < args.size(); ++i) {
+    llvm::StringRef arg = args[i];
+    if (arg == "-main-file-name") {
+      ++i;
+      continue;
+    }
+    if (arg == main_file) {
+      continue;
+    }
+    key += arg;
+    key += '\0';
+  }
+  return key;
+}
+
+auto PreambleCache::GetOrBuild(
+    const clang::CompilerInvocation& invocation,
+    const llvm::MemoryBuffer& buffer,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> vfs,
+    std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+    clang::DiagnosticConsumer* diag_consumer)
+    -> std::shared_ptr<const clang::PrecompiledPreamble> {
+  clang::PreambleBounds bounds = clang::ComputePreambleBounds(
+      *invocation.getLangOpts(), buffer.getMemBufferRef(), /*MaxLines=*/0);
+  if (bounds.Size == 0) {
+    return nullptr;
+  }
+  std::string key = GetCommandKey(invocation);
+  key += buffer.getBuffer().take_front(bounds.Size);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = preambles_.find(key);
+    if (it != preambles_.end()) {
+      ++hits_;
+      return it->second;
+    }
+  }
+
+  // Built without the lock, so that other threads can use the preambles
+  // already built meanwhile. If two threads build the same preamble, the
+  // first one kept is used.
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine> diagnostics =
+      clang::CompilerInstance::createDiagnostics(
+          &invocation.getDiagnosticOpts(), diag_consumer,
+          /*ShouldOwnClient=*/false);
+  clang::PreambleCallbacks callbacks;
+  llvm::ErrorOr<clang::PrecompiledPreamble> preamble =
+      clang::PrecompiledPreamble::Build(
+          invocation, &buffer, bounds, *diagnostics, vfs, std::move(pch_ops),
+          /*StoreInMemory=*/true, callbacks);
+  if (!preamble) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++misses_;
+  auto it = preambles_.insert(
+      {std::move(key), std::make_shared<const clang::PrecompiledPreamble>(
+                           std::move(*preamble))}).first;
+  return it->second;
+}
+
+auto PreambleReusingAction::runInvocation(
+    std::shared_ptr<clang::CompilerInvocation> invocation,
+    clang::FileManager* files,
+    std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+    clang::DiagnosticConsumer* diag_consumer) -> bool {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> vfs =
+      files->getVirtualFileSystemPtr();
+  const clang::FrontendOptions& frontend_opts = invocation->getFrontendOpts();
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  if (frontend_opts.Inputs.size() == 1 && frontend_opts.Inputs[0].isFile()) {
+    llvm::StringRef path = frontend_opts.Inputs[0].getFile();
+    if (auto file = files->getBufferForFile(path)) {
+      buffer = std::move(*file);
+    }
+  }
+  std::shared_ptr<const clang::PrecompiledPreamble> preamble;
+  if (buffer) {
+    preamble =
+        cache_->GetOrBuild(*invocation, *buffer, vfs, pch_ops, diag_consumer);
+  }
+
+  // As `FrontendActionFactory::runInvocation` does, but with the preamble's
+  // PCH, which is in memory, on top of the files.
+  clang::CompilerInstance compiler(std::move(pch_ops));
+  llvm::IntrusiveRefCntPtr<clang::FileManager> preamble_files;
+  if (preamble) {
+    preamble->AddImplicitPreamble(*invocation, vfs, buffer.get());
+    preamble_files = new clang::FileManager(files->getFileSystemOpts(), vfs);
+  }
+  clang::FileManager* compiler_files =
+      preamble_files ? preamble_files.get() : files;
+  compiler.setInvocation(std::move(invocation));
+  compiler.setFileManager(compiler_files);
+  // The action can depend on the compiler, so it's destroyed first.
+  std::unique_ptr<clang::FrontendAction> action = factory_->create();
+  compiler.createDiagnostics(diag_consumer, /*ShouldOwnClient=*/false);
+  if (!compiler.hasDiagnostics()) {
+    return false;
+  }
+  compiler.createSourceManager(*compiler_files);
+  bool success = compiler.ExecuteAction(*action);
+  files->clearStatCache();
+  return success;
+}
+
+}  // namespace Cocktail
@@ -0,0 +1,142 @@
+#include "Cocktail/CppRefactor/ReplacementCache.h"
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/YAMLTraits.h"
+
+namespace Cocktail {
+
+// Bumped whenever the way replacements are found or stored changes.
+static constexpr llvm::StringLiteral KeyVersion =
+    "cpp_refactor-replacements-1";
+
+namespace {
+
+// Preprocesses a file, then makes the key of its replacements from the
+// contents of every file that was read, by name.
+class KeyingAction : public clang::PreprocessOnlyAction {
+ public:
+  explicit KeyingAction(llvm::ArrayRef<llvm::StringRef> key_parts)
+      : key_parts_(key_parts.begin(), key_parts.end()) {}
+
+  auto key() const -> const std::string& { return key_; }
+
+ protected:
+  void ExecuteAction() override {
+    clang::PreprocessOnlyAction::ExecuteAction();
+    clang::SourceManager& sources = getCompilerInstance().getSourceManager();
+    // The files are ordered by name, so that the key doesn't depend on the
+    // order of the source manager's table.
+    std::vector<std::pair<llvm::StringRef, llvm::StringRef>> files;
+    for (auto it = sources.fileinfo_begin(); it != sources.fileinfo_end();
+         ++it) {
+      if (llvm::Optional<llvm::MemoryBufferRef> buffer =
+              it->second->getBufferIfLoaded()) {
+        files.push_back({it->first->getName(), buffer->getBuffer()});
+      }
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto& [name, contents] : files) {
+      key_parts_.push_back(name);
+      key_parts_.push_back(contents);
+    }
+    key_ = ArtifactCache::MakeKey(key_parts_);
+  }
+
+ private:
+  std::vector<llvm::StringRef> key_parts_;
+  std::string key_;
+};
+
+}  // namespace
+
+// Returns the key of the replacements of the main file of `invocation`, or
+// nothing if it couldn't be preprocessed.
+static auto GetKey(const clang::CompilerInvocation& invocation,
+                   llvm::StringRef matcher_set, clang::FileManager* files,
+                   std::shared_ptr<clang::PCHContainerOperations> pch_ops)
+    -> std::optional<std::string> {
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<const char*> args;
+  invocation.generateCC1CommandLine(
+      args, [&](const llvm::Twine& arg) { return saver.save(arg).data(); });
+  std::vector<llvm::StringRef> key_parts = {KeyVersion, matcher_set};
+  key_parts.insert(key_parts.end(), args.begin(), args.end());
+
+  clang::CompilerInstance compiler(std::move(pch_ops));
+  compiler.setInvocation(
+      std::make_shared<clang::CompilerInvocation>(invocation));
+  compiler.setFileManager(files);
+  // Errors are reported when the file is matched, not twice.
+  compiler.createDiagnostics(new clang::IgnoringDiagConsumer(),
+                             /*ShouldOwnClient=*/true);
+  compiler.createSourceManager(*files);
+  KeyingAction action(key_parts);
+  if (!compiler.ExecuteAction(action) ||
+      compiler.getDiagnostics().hasErrorOccurred()) {
+    return std::nullopt;
+  }
+  return action.key();
+}
+
+auto ReplacementCachingAction::runInvocation(
+    std::shared_ptr<clang::CompilerInvocation> invocation,
+    clang::FileManager* files,
+    std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+    clang::DiagnosticConsumer* diag_consumer) -> bool {
+  std::optional<std::string> key =
+      GetKey(*invocation, matcher_set_, files, pch_ops);
+  if (key) {
+    if (std::optional<ArtifactCache::Artifact> artifact =
+            cache_->Lookup(*key)) {
+      clang::tooling::TranslationUnitReplacements cached;
+      llvm::yaml::Input yaml(artifact->data());
+      yaml >> cached;
+      if (!yaml.error()) {
+        Matcher::ReplacementMap found;
+        for (const clang::tooling::Replacement& rep : cached.Replacements) {
+          llvm::consumeError(found[rep.getFilePath().str()].add(rep));
+        }
+        MergeReplacements(found, *replacements_);
+        ++hits_;
+        return true;
+      }
+    }
+  }
+
+  ++misses_;
+  for (auto& [path, replacements] : *scratch_) {
+    replacements = clang::tooling::Replacements();
+  }
+  if (!action_->runInvocation(std::move(invocation), files, pch_ops,
+                              diag_consumer)) {
+    return false;
+  }
+  MergeReplacements(*scratch_, *replacements_);
+  if (key) {
+    clang::tooling::TranslationUnitReplacements found;
+    for (const auto& [path, replacements] : *scratch_) {
+      found.Replacements.insert(found.Replacements.end(),
+                                replacements.begin(), replacements.end());
+    }
+    std::string data;
+    llvm::raw_string_ostream out(data);
+    llvm::yaml::Output yaml(out);
+    yaml << found;
+    out.flush();
+    cache_->Insert(*key, data);
+  }
+  return true;
+}
+
+}  // namespace Cocktail
@@ -0,0 +1,265 @@
+#include "Cocktail/CppRefactor/ReplacementWriter.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/Support/YAMLTraits.h"
+
+namespace Cocktail {
+
+// Lines of unchanged context around each change in a diff.
+static constexpr int DiffContext = 3;
+
+namespace {
+
+// The lines of a file, by where each starts.
+class Lines {
+ public:
+  explicit Lines(llvm::StringRef code) : code_(code) {
+    for (size_t start = 0; start < code.size();
+         start = code.find('\n', start) + 1) {
+      starts_.push_back(start);
+      if (code.find('\n', start) == llvm::StringRef::npos) {
+        break;
+      }
+    }
+  }
+
+  auto size() const -> int { return starts_.size(); }
+
+  // Returns the line at `offset`. An offset at the end of a file that ends in
+  // a newline is on the empty line past the last.
+  auto LineOf(size_t offset) const -> int {
+    if (offset == code_.size() && (code_.empty() || code_.back() == '\n')) {
+      return size();
+    }
+    return std::upper_bound(starts_.begin(), starts_.end(), offset) -
+           starts_.begin() - 1;
+  }
+
+  // Returns the offset at which `line` starts.
+  auto Start(int line) const -> size_t {
+    return line < size() ? starts_[line] : code_.size();
+  }
+
+  // Returns the text of lines [`begin`, `end`).
+  auto Text(int begin, int end) const -> llvm::StringRef {
+    return code_.slice(Start(begin), Start(end));
+  }
+
+ private:
+  llvm::StringRef code_;
+  std::vector<size_t> starts_;
+};
+
+// Lines [`begin`, `end`) of a file, and what the replacements within them
+// change them to.
+struct Change {
+  int begin;
+  int end;
+  std::string text;
+};
+
+}  // namespace
+
+// Returns the number of lines in `text`, counting a last one without a
+// newline.
+static auto CountLines(llvm::StringRef text) -> int {
+  return text.count('\n') + (!text.empty() && text.back() != '\n');
+}
+
+// Prints each line of `text` after `prefix`.
+static void PrintLines(llvm::StringRef text, char prefix,
+                       llvm::raw_ostream& out) {
+  while (!text.empty()) {
+    auto [line, rest] = text.split('\n');
+    out << prefix << line << "\n";
+    if (rest.empty() && text.back() != '\n') {
+      out << "\\ No newline at end of file\n";
+    }
+    text = rest;
+  }
+}
+
+// Returns how a hunk header spells a range of `count` lines from `begin`.
+static auto HunkRange(int begin, int count) -> std::string {
+  // An empty range is spelled by the line before it.
+  return std::to_string(count == 0 ? begin : begin + 1) + "," +
+         std::to_string(count);
+}
+
+auto MakeUnifiedDiff(llvm::StringRef path, llvm::StringRef code,
+                     const clang::tooling::Replacements& replacements)
+    -> std::string {
+  Lines lines(code);
+
+  // The lines each replacement is on, with replacements that share a line
+  // applied together. `Replacements` are sorted and don't overlap.
+  std::vector<Change> changes;
+  size_t applied_end = 0;
+  for (const clang::tooling::Replacement& rep : replacements) {
+    size_t rep_end = rep.getOffset() + rep.getLength();
+    int begin = lines.LineOf(rep.getOffset());
+    int last = lines.LineOf(rep_end - (rep.getLength() > 0));
+    // Only an insertion at the end of a file is on the line past the last.
+    int end = last < lines.size() ? last + 1 : last;
+    if (!changes.empty() && begin < changes.back().end) {
+      Change& change = changes.back();
+      change.text += code.slice(applied_end, rep.getOffset());
+      change.end = std::max(change.end, end);
+    } else {
+      if (!changes.empty()) {
+        changes.back().text += code.slice(applied_end,
+                                          lines.Start(changes.back().end));
+      }
+      changes.push_back({begin, end, ""});
+      changes.back().text += code.slice(lines.Start(begin), rep.getOffset());
+    }
+    changes.back().text += rep.getReplacementText();
+    applied_end = rep_end;
+  }
+  if (!changes.empty()) {
+    changes.back().text +=
+        code.slice(applied_end, lines.Start(changes.back().end));
+  }
+  changes.erase(std::remove_if(changes.begin(), changes.end(),
+                               [&](const Change& change) {
+                                 return change.text ==
+                                        lines.Text(change.begin, change.end);
+                               }),
+                changes.end());
+  if (changes.empty()) {
+    return "";
+  }
+
+  std::string diff;
+  llvm::raw_string_ostream out(diff);
+  out << "--- " << path << "\n+++ " << path << "\n";
+  // How many more lines the changes so far have made.
+  int added = 0;
+  for (auto hunk = changes.begin(); hunk != changes.end();) {
+    // Changes whose context would touch are in the same hunk.
+    auto hunk_end = hunk + 1;
+    while (hunk_end != changes.end() &&
+           hunk_end->begin - (hunk_end - 1)->end <= 2 * DiffContext) {
+      ++hunk_end;
+    }
+    int begin = std::max(0, hunk->begin - DiffContext);
+    int end = std::min(lines.size(), (hunk_end - 1)->end + DiffContext);
+    int old_count = end - begin;
+    int new_count = old_count;
+    for (auto change = hunk; change != hunk_end; ++change) {
+      new_count += CountLines(change->text) - (change->end - change->begin);
+    }
+    out << "@@ -" << HunkRange(begin, old_count) << " +"
+        << HunkRange(begin + added, new_count) << " @@\n";
+    int line = begin;
+    for (auto change = hunk; change != hunk_end; ++change) {
+      PrintLines(lines.Text(line, change->begin), ' ', out);
+      PrintLines(lines.Text(change->begin, change->end), '-', out);
+      PrintLines(change->text, '+', out);
+      line = change->end;
+    }
+    PrintLines(lines.Text(line, end), ' ', out);
+    added += new_count - old_count;
+    hunk = hunk_end;
+  }
+  out.flush();
+  return diff;
+}
+
+auto ReplacementWriter::Write(llvm::StringRef path,
+                              const clang::tooling::Replacements& replacements,
+                              clang::FileManager& files) -> bool {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!written_.insert(path).second) {
+      return true;
+    }
+  }
+  if (replacements.empty()) {
+    return true;
+  }
+
+  std::string text;
+  if (output_ == ReplacementOutput::Yaml) {
+    clang::tooling::TranslationUnitReplacements found;
+    found.MainSourceFile = path.str();
+    found.Replacements.assign(replacements.begin(), replacements.end());
+    llvm::raw_string_ostream yaml_out(text);
+    llvm::yaml::Output yaml(yaml_out);
+    yaml << found;
+    yaml_out.flush();
+  } else {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        files.getBufferForFile(path);
+    if (!buffer) {
+      llvm::errs() << "Error reading `" << path
+                   << "`: " << buffer.getError().message() << "\n";
+      return false;
+    }
+    llvm::StringRef code = (*buffer)->getBuffer();
+    if (output_ == ReplacementOutput::Diff) {
+      text = MakeUnifiedDiff(path, code, replacements);
+    } else {
+      llvm::Expected<std::string> new_code =
+          clang::tooling::applyAllReplacements(code, replacements);
+      if (!new_code) {
+        llvm::errs() << "Error applying replacements to `" << path
+                     << "`: " << llvm::toString(new_code.takeError())
+                     << "\n";
+        return false;
+      }
+      // The file may be mapped into memory, so it's let go before it's
+      // written.
+      buffer->reset();
+      std::error_code err;
+      llvm::raw_fd_ostream file(path, err);
+      if (!err) {
+        file << *new_code;
+        file.close();
+        err = file.error();
+      }
+      if (err) {
+        llvm::errs() << "Error writing `" << path << "`: " << err.message()
+                     << "\n";
+        return false;
+      }
+      return true;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  out_ << text;
+  return true;
+}
+
+auto ReplacementStreamingAction::runInvocation(
+    std::shared_ptr<clang::CompilerInvocation> invocation,
+    clang::FileManager* files,
+    std::shared_ptr<clang::PCHContainerOperations> pch_ops,
+    clang::DiagnosticConsumer* diag_consumer) -> bool {
+  // Read before `invocation` is given away.
+  std::string main_file =
+      invocation->getFrontendOpts().Inputs.front().getFile().str();
+  if (!action_->runInvocation(std::move(invocation), files, pch_ops,
+                              diag_consumer)) {
+    return false;
+  }
+  llvm::ErrorOr<const clang::FileEntry*> file = files->getFile(main_file);
+  if (!file) {
+    return true;
+  }
+  auto entry = replacements_->find(files->getCanonicalName(*file).str());
+  if (entry == replacements_->end()) {
+    return true;
+  }
+  bool written = writer_->Write(entry->first, entry->second, *files);
+  // Later files' replacements for this one are no longer kept.
+  replacements_->erase(entry);
+  return written;
+}
+
+}  // namespace Cocktail
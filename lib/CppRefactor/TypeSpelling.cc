@@ -0,0 +1,104 @@
+#include "Cocktail/CppRefactor/TypeSpelling.h"
+
+#include "clang/AST/PrettyPrinter.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+namespace {
+
+// A part of a type: its local qualifiers, such as `const`, and the source
+// text of its own tokens, such as `int`.
+struct Segment {
+  clang::TypeLoc::TypeLocClass type_loc_class;
+  clang::Qualifiers qualifiers;
+  llvm::StringRef text;
+  // Whether the segment goes before the spelling of the parts inside it
+  // rather than after, and if so, whether a space separates them.
+  bool before = false;
+  bool space_after = false;
+};
+
+}  // namespace
+
+auto SpellType(clang::TypeLoc type_loc, const clang::SourceManager& sources,
+               const clang::LangOptions& lang_opts) -> std::string {
+  // The parts, outermost first, such as `*` then `const int` for
+  // `const int*`. Their text points into the source.
+  llvm::SmallVector<Segment, 8> segments;
+  size_t size = 0;
+  for (; !type_loc.isNull(); type_loc = type_loc.getNextTypeLoc()) {
+    auto range =
+        clang::CharSourceRange::getTokenRange(type_loc.getLocalSourceRange());
+    Segment segment = {type_loc.getTypeLocClass(),
+                       type_loc.getType().getLocalQualifiers(),
+                       clang::Lexer::getSourceText(range, sources, lang_opts)};
+    // Qualifiers are at most a few words.
+    size += segment.text.size() + 32;
+    segments.push_back(segment);
+  }
+
+  // Working from the innermost part out, an elaborated type, and qualifiers
+  // other than those of a pointer, go before what's inside them; everything
+  // else goes after.
+  bool inside_empty = true;
+  auto prev_class = clang::TypeLoc::Auto;  // Placeholder class.
+  for (Segment& segment : llvm::reverse(segments)) {
+    bool empty = segment.qualifiers.empty() && segment.text.empty();
+    switch (segment.type_loc_class) {
+      case clang::TypeLoc::Elaborated:
+        segment.before = true;
+        break;
+      case clang::TypeLoc::Qualified:
+        if (prev_class == clang::TypeLoc::Pointer) {
+          // Spelled after a space.
+          empty = false;
+        } else {
+          segment.before = true;
+          segment.space_after = !inside_empty;
+          empty = empty && !segment.space_after;
+        }
+        break;
+      default:
+        break;
+    }
+    inside_empty = inside_empty && empty;
+    prev_class = segment.type_loc_class;
+  }
+
+  // The spelling is the parts that go before, outermost first, then those
+  // that go after, innermost first.
+  std::string type_str;
+  type_str.reserve(size);
+  llvm::raw_string_ostream out(type_str);
+  clang::PrintingPolicy policy{clang::LangOptions()};
+  auto print = [&](const Segment& segment) {
+    segment.qualifiers.print(out, policy);
+    if (!segment.qualifiers.empty() && !segment.text.empty()) {
+      out << ' ';
+    }
+    out << segment.text;
+  };
+  for (const Segment& segment : segments) {
+    if (segment.before) {
+      print(segment);
+      if (segment.space_after) {
+        out << ' ';
+      }
+    }
+  }
+  for (const Segment& segment : llvm::reverse(segments)) {
+    if (!segment.before) {
+      if (segment.type_loc_class == clang::TypeLoc::Qualified) {
+        out << ' ';
+      }
+      print(segment);
+    }
+  }
+  out.flush();
+  return type_str;
+}
+
+}  // namespace Cocktail
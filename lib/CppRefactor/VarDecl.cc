@@ -1,5 +1,6 @@
 #include "Cocktail/CppRefactor/VarDecl.h"
 
+#include "Cocktail/CppRefactor/TypeSpelling.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
 
 namespace cam = ::clang::ast_matchers;
@@ -24,67 +25,6 @@ static auto TypeLocClassToString(clang::TypeLoc::TypeLocClass c)
   }
 }
 
-// Returns a string for the type.
-auto VarDecl::GetTypeStr(const clang::VarDecl& decl) -> std::string {
-  // Built a vector of class information, because we'll be traversing reverse
-  // order to construct the final type.
-  auto type_loc = decl.getTypeSourceInfo()->getTypeLoc();
-  std::vector<std::pair<clang::TypeLoc::TypeLocClass, std::string>> segments;
-  while (!type_loc.isNull()) {
-    std::string text;
-    auto qualifiers = type_loc.getType().getLocalQualifiers();
-    std::string qual_str;
-    if (!qualifiers.empty()) {
-      qual_str = qualifiers.getAsString();
-    }
-    auto range =
-        clang::CharSourceRange::getTokenRange(type_loc.getLocalSourceRange());
-    std::string range_str = GetSourceText(range).str();
-
-    // Make a list of segments with their TypeLocClass for reconstruction of the
-    // string. Locally, we will have a qualifier (such as `const`) and a type
-    // string (such as `int`) which is also used.
-    auto type_loc_class = type_loc.getTypeLocClass();
-    if (qual_str.empty()) {
-      segments.push_back({type_loc_class, range_str});
-    } else if (range_str.empty()) {
-      segments.push_back({type_loc_class, qual_str});
-    } else {
-      segments.push_back({type_loc_class, qual_str + " " + range_str});
-    }
-
-    type_loc = type_loc.getNextTypeLoc();
-  }
-
-  // Construct the final type based on the class of each step. This reverses to
-  // start from the "inside" of the type and go "out" when constructing
-  // type_str.
-  std::string type_str;
-  auto prev_class = clang::TypeLoc::Auto;  // Placeholder class, used in loop.
-  for (const auto& [type_loc_class, text] : llvm::reverse(segments)) {
-    switch (type_loc_class) {
-      case clang::TypeLoc::Elaborated:
-        type_str.insert(0, text);
-        break;
-      case clang::TypeLoc::Qualified:
-        if (prev_class == clang::TypeLoc::Pointer) {
-          type_str += " " + text;
-        } else {
-          if (!type_str.empty()) {
-            type_str.insert(0, " ");
-          }
-          type_str.insert(0, text);
-        }
-        break;
-      default:
-        type_str += text;
-        break;
-    }
-    prev_class = type_loc_class;
-  }
-  return type_str;
-}
-
 void VarDecl::Run() {
   const auto& decl = GetNodeAsOrDie<clang::VarDecl>(Label);
   if (decl.getTypeSourceInfo() == nullptr) {
@@ -101,7 +41,9 @@ void VarDecl::Run() {
     after = "var ";
   }
   // Add "identifier: type" to the replacement.
-  after += decl.getNameAsString() + ": " + GetTypeStr(decl);
+  after += decl.getNameAsString() + ": " +
+           SpellType(decl.getTypeSourceInfo()->getTypeLoc(),
+                     GetSourceManager(), GetLangOpts());
 
   // This decides the range to replace. Normally the entire decl is replaced,
   // but for code like `int i, j` we need to detect the comma between the
@@ -0,0 +1,236 @@
+#include "Cocktail/Diagnostics/DiagnosticCache.h"
+
+#include <optional>
+#include <tuple>
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/Endian.h"
+
+namespace Cocktail {
+
+namespace {
+
+// 重放的消息以保存的文本和持有它的条目作为参数，并原样返回文本。
+auto FormatStoredText(const DiagnosticMessage& message) -> std::string {
+  return std::get<0>(
+             message.format_args
+                 .Get<llvm::StringRef,
+                      std::shared_ptr<const DiagnosticCache::Entry>>())
+      .str();
+}
+
+template <typename T>
+auto WriteLittleEndian(llvm::raw_ostream& out, T value) -> void {
+  char bytes[sizeof(T)];
+  llvm::support::endian::write<T, llvm::support::little>(bytes, value);
+  out.write(bytes, sizeof(T));
+}
+
+auto WriteString(llvm::raw_ostream& out, llvm::StringRef text) -> void {
+  WriteLittleEndian<uint32_t>(out, text.size());
+  out << text;
+}
+
+template <typename T>
+auto ReadLittleEndian(llvm::StringRef& in, T& value) -> bool {
+  if (in.size() < sizeof(T)) {
+    return false;
+  }
+  value = llvm::support::endian::read<T, llvm::support::little,
+                                      llvm::support::unaligned>(in.data());
+  in = in.drop_front(sizeof(T));
+  return true;
+}
+
+auto ReadString(llvm::StringRef& in, std::string& text) -> bool {
+  uint32_t size = 0;
+  if (!ReadLittleEndian(in, size) || in.size() < size) {
+    return false;
+  }
+  text = in.take_front(size).str();
+  in = in.drop_front(size);
+  return true;
+}
+
+auto GetDiagnosticKind(llvm::StringRef name) -> std::optional<DiagnosticKind> {
+  return llvm::StringSwitch<std::optional<DiagnosticKind>>(name)
+#define COCKTAIL_DIAGNOSTIC_KIND(Name) .Case(#Name, DiagnosticKind::Name)
+#include "Cocktail/Diagnostics/DiagnosticKind.def"
+      .Default(std::nullopt);
+}
+
+}  // namespace
+
+auto DiagnosticCache::Entry::Replay(DiagnosticConsumer& consumer) const
+    -> void {
+  // 消息的位置和文本引用条目，因此每条消息都持有条目。
+  std::shared_ptr<const Entry> self = shared_from_this();
+  auto make_message = [&](const Message& message) {
+    return DiagnosticMessage(
+        message.kind,
+        {.file_name = message.file_name,
+         .line = message.line,
+         .line_number = message.line_number,
+         .column_number = message.column_number},
+        message.format,
+        DiagnosticFormatArgs::Make<llvm::StringRef,
+                                   std::shared_ptr<const Entry>>(
+            message.text, self),
+        &FormatStoredText);
+  };
+  for (const StoredDiagnostic& stored : diagnostics_) {
+    Diagnostic diagnostic = {.level = stored.level,
+                             .message = make_message(stored.message)};
+    for (const Message& note : stored.notes) {
+      diagnostic.notes.push_back(make_message(note));
+    }
+    consumer.HandleDiagnostic(std::move(diagnostic));
+  }
+}
+
+// 数据依次是诊断的数量、每个诊断、阶段的输出。每个诊断是它的级别、消息、注释
+// 的数量和每个注释；每条消息是种类的名字、位置和文本。整数都是小端序的，字符串
+// 是32位的长度和内容。
+auto DiagnosticCache::Entry::Serialize(llvm::raw_ostream& out) const -> void {
+  auto write_message = [&](const Message& message) {
+    WriteString(out, message.kind.name());
+    WriteString(out, message.file_name);
+    WriteString(out, message.line);
+    WriteLittleEndian<int32_t>(out, message.line_number);
+    WriteLittleEndian<int32_t>(out, message.column_number);
+    WriteString(out, message.text);
+  };
+  WriteLittleEndian<uint32_t>(out, diagnostics_.size());
+  for (const StoredDiagnostic& stored : diagnostics_) {
+    WriteLittleEndian<int8_t>(out, static_cast<int8_t>(stored.level));
+    write_message(stored.message);
+    WriteLittleEndian<uint32_t>(out, stored.notes.size());
+    for (const Message& note : stored.notes) {
+      write_message(note);
+    }
+  }
+  WriteString(out, data_);
+}
+
+auto DiagnosticCache::Entry::Deserialize(llvm::StringRef data)
+    -> std::shared_ptr<const Entry> {
+  auto read_message = [&]() -> std::optional<Message> {
+    std::string kind_name;
+    if (!ReadString(data, kind_name)) {
+      return std::nullopt;
+    }
+    std::optional<DiagnosticKind> kind = GetDiagnosticKind(kind_name);
+    if (!kind) {
+      return std::nullopt;
+    }
+    Message message = {.kind = *kind, .format = ""};
+    if (!ReadString(data, message.file_name) ||
+        !ReadString(data, message.line) ||
+        !ReadLittleEndian(data, message.line_number) ||
+        !ReadLittleEndian(data, message.column_number) ||
+        !ReadString(data, message.text)) {
+      return std::nullopt;
+    }
+    return message;
+  };
+
+  auto entry = std::make_shared<Entry>();
+  uint32_t num_diagnostics = 0;
+  if (!ReadLittleEndian(data, num_diagnostics)) {
+    return nullptr;
+  }
+  for (uint32_t i = 0; i != num_diagnostics; ++i) {
+    int8_t level = 0;
+    if (!ReadLittleEndian(data, level) || level < 0 ||
+        level > static_cast<int8_t>(DiagnosticLevel::Error)) {
+      return nullptr;
+    }
+    std::optional<Message> message = read_message();
+    uint32_t num_notes = 0;
+    if (!message || !ReadLittleEndian(data, num_notes)) {
+      return nullptr;
+    }
+    StoredDiagnostic& stored = entry->diagnostics_.emplace_back(
+        StoredDiagnostic{.level = static_cast<DiagnosticLevel>(level),
+                         .message = std::move(*message)});
+    for (uint32_t j = 0; j != num_notes; ++j) {
+      std::optional<Message> note = read_message();
+      if (!note) {
+        return nullptr;
+      }
+      stored.notes.push_back(std::move(*note));
+    }
+  }
+  if (!ReadString(data, entry->data_) || !data.empty()) {
+    return nullptr;
+  }
+  return entry;
+}
+
+auto DiagnosticCache::Recorder::HandleDiagnostic(Diagnostic diagnostic)
+    -> void {
+  auto store_message = [](const DiagnosticMessage& message) {
+    const DiagnosticLocation& location = message.location();
+    return Entry::Message{.kind = message.kind,
+                          .format = message.format,
+                          .file_name = location.file_name.str(),
+                          .line = location.line.str(),
+                          .line_number = location.line_number,
+                          .column_number = location.column_number,
+                          .text = message.format_fn(message)};
+  };
+  Entry::StoredDiagnostic& stored = entry_.diagnostics_.emplace_back(
+      Entry::StoredDiagnostic{.level = diagnostic.level,
+                              .message = store_message(diagnostic.message)});
+  for (const DiagnosticMessage& note : diagnostic.notes) {
+    stored.notes.push_back(store_message(note));
+  }
+  next_consumer_->HandleDiagnostic(std::move(diagnostic));
+}
+
+auto DiagnosticCache::Recorder::Take(std::string data)
+    -> std::shared_ptr<const Entry> {
+  if (stopped_) {
+    return nullptr;
+  }
+  entry_.data_ = std::move(data);
+  return std::make_shared<const Entry>(std::move(entry_));
+}
+
+auto DiagnosticCache::MakeKey(Stage stage, llvm::StringRef filename)
+    -> std::string {
+  std::string key;
+  key.push_back(static_cast<char>(stage));
+  key.append(filename.begin(), filename.end());
+  return key;
+}
+
+auto DiagnosticCache::Lookup(Stage stage, llvm::StringRef filename,
+                             uint64_t content_hash)
+    -> std::shared_ptr<const Entry> {
+  std::string key = MakeKey(stage, filename);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end() || it->second.content_hash != content_hash) {
+    return nullptr;
+  }
+  return it->second.entry;
+}
+
+auto DiagnosticCache::Insert(Stage stage, llvm::StringRef filename,
+                             uint64_t content_hash,
+                             std::shared_ptr<const Entry> entry) -> void {
+  if (!entry) {
+    return;
+  }
+  std::string key = MakeKey(stage, filename);
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_[key] = {.content_hash = content_hash, .entry = std::move(entry)};
+}
+
+auto DiagnosticCache::Clear() -> void {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+
+}  // namespace Cocktail
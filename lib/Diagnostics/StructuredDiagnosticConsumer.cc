@@ -0,0 +1,140 @@
+#include "Cocktail/Diagnostics/StructuredDiagnosticConsumer.h"
+
+#include <iterator>
+
+#include "Cocktail/Common/StringHelpers.h"
+#include "Cocktail/Diagnostics/DiagnosticKind.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+
+namespace Cocktail {
+
+namespace {
+
+// 缓冲区超过这个大小时写入流。
+constexpr size_t FlushSize = 1 << 16;
+
+auto GetLevelName(DiagnosticLevel level) -> llvm::StringLiteral {
+  switch (level) {
+    case DiagnosticLevel::Note:
+      return "note";
+    case DiagnosticLevel::Warning:
+      return "warning";
+    case DiagnosticLevel::Error:
+      return "error";
+  }
+  return "unknown";
+}
+
+auto GetKindIndex(DiagnosticKind kind) -> uint16_t {
+  return static_cast<uint16_t>(static_cast<DiagnosticKind::RawEnumType>(kind));
+}
+
+template <typename T>
+auto AppendLittleEndian(llvm::SmallVectorImpl<char>& out, T value) -> void {
+  char bytes[sizeof(T)];
+  llvm::support::endian::write<T, llvm::support::little>(bytes, value);
+  out.append(bytes, bytes + sizeof(T));
+}
+
+auto AppendBinaryString(llvm::SmallVectorImpl<char>& out,
+                        llvm::StringRef text) -> void {
+  AppendLittleEndian<uint32_t>(out, text.size());
+  out.append(text.begin(), text.end());
+}
+
+}  // namespace
+
+auto StructuredDiagnosticConsumer::HandleDiagnostic(Diagnostic diagnostic)
+    -> void {
+  if (format_ == Format::Json) {
+    AppendJson(diagnostic);
+  } else {
+    AppendBinary(diagnostic);
+  }
+  if (buffer_.size() >= FlushSize) {
+    *stream_ << buffer_;
+    buffer_.clear();
+  }
+}
+
+auto StructuredDiagnosticConsumer::Flush() -> void {
+  *stream_ << buffer_;
+  buffer_.clear();
+  stream_->flush();
+}
+
+auto StructuredDiagnosticConsumer::AppendJson(const Diagnostic& diagnostic)
+    -> void {
+  AppendJson(diagnostic.message);
+  // 主消息的对象还没有结束，在它之后加上等级和注释。
+  buffer_.append(R"(,"level":")");
+  buffer_.append(GetLevelName(diagnostic.level));
+  buffer_.push_back('"');
+  if (!diagnostic.notes.empty()) {
+    buffer_.append(R"(,"notes":[)");
+    for (const DiagnosticMessage& note : diagnostic.notes) {
+      if (&note != &diagnostic.notes.front()) {
+        buffer_.push_back(',');
+      }
+      AppendJson(note);
+      buffer_.push_back('}');
+    }
+    buffer_.push_back(']');
+  }
+  buffer_.append("}\n");
+}
+
+auto StructuredDiagnosticConsumer::AppendJson(const DiagnosticMessage& message)
+    -> void {
+  const DiagnosticLocation& location = message.location();
+  buffer_.append(R"({"kind":")");
+  buffer_.append(message.kind.name());
+  buffer_.append(R"(","file":)");
+  AppendJsonString(buffer_, location.file_name);
+  if (location.line_number > 0) {
+    buffer_.append(R"(,"line":)");
+    AppendInt(buffer_, location.line_number);
+    if (location.column_number > 0) {
+      buffer_.append(R"(,"column":)");
+      AppendInt(buffer_, location.column_number);
+    }
+  }
+  buffer_.append(R"(,"message":)");
+  AppendJsonString(buffer_, message.format_fn(message));
+}
+
+auto StructuredDiagnosticConsumer::AppendBinary(const Diagnostic& diagnostic)
+    -> void {
+  if (!wrote_header_) {
+    wrote_header_ = true;
+    buffer_.append(llvm::StringRef(BinaryMagic, sizeof(BinaryMagic)));
+    AppendLittleEndian<uint32_t>(buffer_, BinaryVersion);
+    constexpr llvm::StringLiteral KindNames[] = {
+#define COCKTAIL_DIAGNOSTIC_KIND(Name) #Name,
+#include "Cocktail/Diagnostics/DiagnosticKind.def"
+    };
+    AppendLittleEndian<uint32_t>(buffer_, std::size(KindNames));
+    for (llvm::StringRef name : KindNames) {
+      AppendBinaryString(buffer_, name);
+    }
+  }
+  buffer_.push_back(static_cast<char>(diagnostic.level));
+  AppendLittleEndian<uint32_t>(buffer_, diagnostic.notes.size());
+  AppendBinary(diagnostic.message);
+  for (const DiagnosticMessage& note : diagnostic.notes) {
+    AppendBinary(note);
+  }
+}
+
+auto StructuredDiagnosticConsumer::AppendBinary(
+    const DiagnosticMessage& message) -> void {
+  const DiagnosticLocation& location = message.location();
+  AppendLittleEndian<uint16_t>(buffer_, GetKindIndex(message.kind));
+  AppendLittleEndian<uint32_t>(buffer_, location.line_number);
+  AppendLittleEndian<uint32_t>(buffer_, location.column_number);
+  AppendBinaryString(buffer_, location.file_name);
+  AppendBinaryString(buffer_, message.format_fn(message));
+}
+
+}  // namespace Cocktail
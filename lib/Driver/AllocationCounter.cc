@@ -0,0 +1,44 @@
+#include "Cocktail/Driver/AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#include "llvm/Support/MemAlloc.h"
+
+namespace Cocktail {
+
+// Constant-initialized, so that counting needs no guard on each access.
+static thread_local AllocationCount thread_allocations;
+
+auto GetThreadAllocationCount() -> AllocationCount {
+  return thread_allocations;
+}
+
+}  // namespace Cocktail
+
+// The array and nothrow forms of `new`, and the sized and array forms of
+// `delete`, call these by default, so replacing these counts them all.
+auto operator new(std::size_t size) -> void* {
+  ++Cocktail::thread_allocations.allocations;
+  Cocktail::thread_allocations.bytes += size;
+  return llvm::safe_malloc(size == 0 ? 1 : size);
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment) -> void* {
+  ++Cocktail::thread_allocations.allocations;
+  Cocktail::thread_allocations.bytes += size;
+  auto align = static_cast<std::size_t>(alignment);
+  // `aligned_alloc` needs a multiple of the alignment.
+  void* result = std::aligned_alloc(align, (size + align - 1) & ~(align - 1));
+  if (result == nullptr) {
+    llvm::report_bad_alloc_error("Allocation failed");
+  }
+  return result;
+}
+
+auto operator delete(void* pointer) noexcept -> void { std::free(pointer); }
+
+auto operator delete(void* pointer, std::align_val_t /*alignment*/) noexcept
+    -> void {
+  std::free(pointer);
+}
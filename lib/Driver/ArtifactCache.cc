@@ -0,0 +1,284 @@
+#include "Cocktail/Driver/ArtifactCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+namespace Cocktail {
+
+// Each artifact file is a fixed header followed by the artifact's data. The
+// header is the magic, the version of the format, a reserved field and a hash
+// of the data; the integers are little-endian.
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "CKARTIFC";
+constexpr uint32_t FormatVersion = 1;
+constexpr uint64_t HeaderSize = 24;
+
+constexpr llvm::StringLiteral ArtifactSuffix = ".artifact";
+constexpr llvm::StringLiteral TemporarySuffix = ".tmp";
+
+// Temporary files older than this were left behind by writers that died.
+constexpr std::chrono::hours TemporaryFileLifetime(1);
+
+}  // namespace
+
+auto ArtifactCache::MakeKey(llvm::ArrayRef<llvm::StringRef> parts)
+    -> std::string {
+  llvm::SHA256 hasher;
+  for (llvm::StringRef part : parts) {
+    // Each part is prefixed by its size, so that moving bytes from one part
+    // to the next changes the key.
+    char size[sizeof(uint64_t)];
+    llvm::support::endian::write64le(size, part.size());
+    hasher.update(llvm::StringRef(size, sizeof(size)));
+    hasher.update(part);
+  }
+  return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+auto ArtifactCache::GetPath(llvm::StringRef key) const
+    -> llvm::SmallString<256> {
+  llvm::SmallString<256> path(directory_);
+  llvm::sys::path::append(path, key + ArtifactSuffix);
+  return path;
+}
+
+auto ArtifactCache::SetRemote(std::unique_ptr<RemoteCacheBackend> remote,
+                              int threads) -> void {
+  remote_ = std::move(remote);
+  remote_tasks_.emplace(threads);
+}
+
+auto ArtifactCache::Lookup(llvm::StringRef key) -> std::optional<Artifact> {
+  if (auto artifact = LookupLocal(key)) {
+    return artifact;
+  }
+  if (remote_ == nullptr) {
+    return std::nullopt;
+  }
+  std::future<std::optional<std::string>> fetch;
+  {
+    std::lock_guard<std::mutex> lock(fetches_mutex_);
+    auto it = fetches_.find(key);
+    if (it != fetches_.end()) {
+      fetch = std::move(it->second);
+      fetches_.erase(it);
+    }
+  }
+  std::optional<std::string> data =
+      fetch.valid() ? fetch.get() : FetchRemote(key);
+  if (!data) {
+    return std::nullopt;
+  }
+  // Kept here, so that later lookups don't fetch it again, but not stored
+  // back to the remote cache, which has it.
+  InsertLocal(key, *data);
+  Artifact artifact;
+  artifact.buffer_ = llvm::MemoryBuffer::getMemBufferCopy(*data);
+  artifact.data_ = artifact.buffer_->getBuffer();
+  return artifact;
+}
+
+auto ArtifactCache::Prefetch(llvm::StringRef key) -> void {
+  if (remote_ == nullptr || llvm::sys::fs::exists(GetPath(key))) {
+    return;
+  }
+  // The task is shared, as a `std::function` has to be copyable.
+  auto task =
+      std::make_shared<std::packaged_task<std::optional<std::string>()>>(
+          [this, key = key.str()] { return FetchRemote(key); });
+  {
+    std::lock_guard<std::mutex> lock(fetches_mutex_);
+    auto [it, inserted] = fetches_.try_emplace(key);
+    if (!inserted) {
+      return;
+    }
+    it->second = task->get_future();
+  }
+  remote_tasks_->Spawn([task] { (*task)(); });
+}
+
+auto ArtifactCache::FetchRemote(llvm::StringRef key)
+    -> std::optional<std::string> {
+  std::optional<std::string> blob = remote_->Fetch(key);
+  if (!blob) {
+    return std::nullopt;
+  }
+  return DecodeRemoteArtifact(*blob);
+}
+
+auto ArtifactCache::LookupLocal(llvm::StringRef key)
+    -> std::optional<Artifact> {
+  llvm::SmallString<256> path = GetPath(key);
+  int fd = -1;
+  if (llvm::sys::fs::openFileForRead(path, fd)) {
+    return std::nullopt;
+  }
+  auto buffer = llvm::MemoryBuffer::getOpenFile(
+      llvm::sys::fs::convertFDToNativeFile(fd), path, /*FileSize=*/-1,
+      /*RequiresNullTerminator=*/false);
+  // Marks the artifact as recently used. This is best effort: a cache that
+  // can be read but not written still serves hits.
+  if (buffer) {
+    llvm::sys::TimePoint<> now = std::chrono::system_clock::now();
+    llvm::sys::fs::setLastAccessAndModificationTime(fd, now, now);
+  }
+  llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  if (!buffer) {
+    return std::nullopt;
+  }
+
+  llvm::StringRef contents = (*buffer)->getBuffer();
+  if (contents.size() < HeaderSize || !contents.startswith(Magic)) {
+    return std::nullopt;
+  }
+  const char* header = contents.data() + Magic.size();
+  uint32_t version = llvm::support::endian::read32le(header);
+  uint64_t hash = llvm::support::endian::read64le(header + 8);
+  llvm::StringRef data = contents.drop_front(HeaderSize);
+  if (version != FormatVersion || hash != llvm::xxHash64(data)) {
+    return std::nullopt;
+  }
+
+  Artifact artifact;
+  artifact.buffer_ = std::move(*buffer);
+  artifact.data_ = data;
+  return artifact;
+}
+
+auto ArtifactCache::Insert(llvm::StringRef key, llvm::StringRef data)
+    -> bool {
+  if (remote_ != nullptr) {
+    // Compressing is left to the background as well.
+    remote_tasks_->Spawn([this, key = key.str(), data = data.str()] {
+      remote_->Store(key, EncodeRemoteArtifact(data));
+    });
+  }
+  return InsertLocal(key, data);
+}
+
+auto ArtifactCache::InsertLocal(llvm::StringRef key, llvm::StringRef data)
+    -> bool {
+  if (llvm::sys::fs::create_directories(directory_)) {
+    return false;
+  }
+
+  // The artifact is written to a file of its own and renamed over the old
+  // one, so that a concurrent reader sees either the old artifact or the new
+  // one, never part of either.
+  llvm::SmallString<256> temporary_model(directory_);
+  llvm::sys::path::append(temporary_model,
+                          key + "-%%%%%%%%" + TemporarySuffix);
+  llvm::SmallString<256> temporary_path;
+  int fd = -1;
+  if (llvm::sys::fs::createUniqueFile(temporary_model, fd, temporary_path)) {
+    return false;
+  }
+  {
+    char header[HeaderSize] = {};
+    std::memcpy(header, Magic.data(), Magic.size());
+    llvm::support::endian::write32le(header + Magic.size(), FormatVersion);
+    llvm::support::endian::write64le(header + Magic.size() + 8,
+                                     llvm::xxHash64(data));
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out.write(header, sizeof(header));
+    out << data;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(temporary_path);
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(temporary_path, GetPath(key))) {
+    llvm::sys::fs::remove(temporary_path);
+    return false;
+  }
+
+  bool prune = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes_since_prune_ += HeaderSize + data.size();
+    if (!pruned_ || bytes_since_prune_ >= max_size_ / 8) {
+      pruned_ = true;
+      bytes_since_prune_ = 0;
+      prune = true;
+    }
+  }
+  if (prune) {
+    Prune();
+  }
+  return true;
+}
+
+auto ArtifactCache::Prune() -> void {
+  struct File {
+    std::string path;
+    uint64_t size;
+    llvm::sys::TimePoint<> last_used;
+  };
+  llvm::SmallVector<File, 0> artifacts;
+  uint64_t total_size = 0;
+  llvm::sys::TimePoint<> now = std::chrono::system_clock::now();
+
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(directory_, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    llvm::StringRef path = it->path();
+    bool is_artifact = path.endswith(ArtifactSuffix);
+    if (!is_artifact && !path.endswith(TemporarySuffix)) {
+      continue;
+    }
+    llvm::ErrorOr<llvm::sys::fs::basic_file_status> status = it->status();
+    if (!status ||
+        status->type() != llvm::sys::fs::file_type::regular_file) {
+      continue;
+    }
+    if (!is_artifact) {
+      if (now - status->getLastModificationTime() > TemporaryFileLifetime) {
+        llvm::sys::fs::remove(path);
+      }
+      continue;
+    }
+    artifacts.push_back({.path = path.str(),
+                         .size = status->getSize(),
+                         .last_used = status->getLastModificationTime()});
+    total_size += status->getSize();
+  }
+  if (total_size <= max_size_) {
+    return;
+  }
+
+  // Pruning down to three quarters of the limit, rather than to the limit
+  // itself, leaves room for the next artifacts without pruning again.
+  std::sort(artifacts.begin(), artifacts.end(),
+            [](const File& lhs, const File& rhs) {
+              return lhs.last_used < rhs.last_used;
+            });
+  uint64_t target_size = max_size_ / 4 * 3;
+  for (const File& artifact : artifacts) {
+    if (total_size <= target_size) {
+      break;
+    }
+    // Another process may have removed it first. Either way it's gone, and
+    // readers that already have it mapped keep their copy.
+    llvm::sys::fs::remove(artifact.path);
+    total_size -= artifact.size;
+  }
+}
+
+}  // namespace Cocktail
@@ -0,0 +1,184 @@
+#include "Cocktail/Driver/BuildGraph.h"
+
+#include <tuple>
+#include <utility>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FormatVariadic.h"
+
+namespace Cocktail {
+
+// The stamps are text, with a header line naming the format and its version,
+// then a line for each file: the hash of its source, of its interface, the
+// number of interfaces it imported and the hash of each, in hexadecimal, and
+// last its name, which runs to the end of the line.
+
+namespace {
+
+constexpr llvm::StringLiteral StampsMagic = "cocktail-build-stamps";
+
+// Removes the first space-separated field of `text` and parses it as a
+// hexadecimal integer.
+auto ConsumeHex(llvm::StringRef& text, uint64_t& value) -> bool {
+  llvm::StringRef field;
+  std::tie(field, text) = text.split(' ');
+  return !field.empty() && !field.getAsInteger(16, value);
+}
+
+}  // namespace
+
+auto BuildGraph::Parse(llvm::StringRef manifest, llvm::raw_ostream& errors)
+    -> std::optional<BuildGraph> {
+  // The files and their imports' names, in the order of the manifest.
+  struct Entry {
+    llvm::StringRef name;
+    llvm::SmallVector<llvm::StringRef> import_names;
+  };
+  llvm::SmallVector<Entry, 0> entries;
+  llvm::StringMap<int> indices;
+  llvm::SmallVector<llvm::StringRef, 0> lines;
+  manifest.split(lines, '\n');
+  for (int line_number = 0; line_number != static_cast<int>(lines.size());
+       ++line_number) {
+    llvm::StringRef line = lines[line_number].trim();
+    if (line.empty() || line.startswith("#")) {
+      continue;
+    }
+    auto [name, imports_text] = line.split(':');
+    name = name.trim();
+    if (name.empty()) {
+      errors << "ERROR: Build manifest line " << line_number + 1
+             << " names no file.\n";
+      return std::nullopt;
+    }
+    if (!indices.try_emplace(name, entries.size()).second) {
+      errors << "ERROR: File listed twice in build manifest: " << name
+             << "\n";
+      return std::nullopt;
+    }
+    Entry& entry = entries.emplace_back();
+    entry.name = name;
+    llvm::SplitString(imports_text, entry.import_names);
+  }
+
+  llvm::SmallVector<llvm::SmallVector<int>, 0> imports(entries.size());
+  for (int i = 0; i != static_cast<int>(entries.size()); ++i) {
+    for (llvm::StringRef import_name : entries[i].import_names) {
+      auto it = indices.find(import_name);
+      if (it == indices.end()) {
+        errors << "ERROR: " << entries[i].name << " imports " << import_name
+               << ", which isn't in the build manifest.\n";
+        return std::nullopt;
+      }
+      imports[i].push_back(it->second);
+    }
+  }
+
+  // Orders the files by a depth-first walk of their imports, each after
+  // those it imports, finding any cycle along the way.
+  enum class State : int8_t { Unvisited, Visiting, Visited };
+  llvm::SmallVector<State, 0> states(entries.size(), State::Unvisited);
+  llvm::SmallVector<int, 0> order;
+  llvm::SmallVector<int, 0> new_indices(entries.size());
+  // Each file on the walk, and how many of its imports have been walked.
+  llvm::SmallVector<std::pair<int, int>> stack;
+  for (int root = 0; root != static_cast<int>(entries.size()); ++root) {
+    if (states[root] != State::Unvisited) {
+      continue;
+    }
+    states[root] = State::Visiting;
+    stack.push_back({root, 0});
+    while (!stack.empty()) {
+      auto& [file, next_import] = stack.back();
+      if (next_import == static_cast<int>(imports[file].size())) {
+        states[file] = State::Visited;
+        new_indices[file] = order.size();
+        order.push_back(file);
+        stack.pop_back();
+        continue;
+      }
+      int import = imports[file][next_import++];
+      if (states[import] == State::Visiting) {
+        errors << "ERROR: Import cycle through " << entries[import].name
+               << " in build manifest.\n";
+        return std::nullopt;
+      }
+      if (states[import] == State::Unvisited) {
+        states[import] = State::Visiting;
+        stack.push_back({import, 0});
+      }
+    }
+  }
+
+  BuildGraph graph;
+  graph.files_.resize(entries.size());
+  for (int i = 0; i != static_cast<int>(order.size()); ++i) {
+    File& file = graph.files_[i];
+    file.name = entries[order[i]].name.str();
+    for (int import : imports[order[i]]) {
+      file.imports.push_back(new_indices[import]);
+      graph.files_[new_indices[import]].dependents.push_back(i);
+    }
+  }
+  return graph;
+}
+
+auto BuildGraph::ReadStamps(llvm::StringRef data) -> void {
+  llvm::StringMap<int> indices;
+  for (int i = 0; i != size(); ++i) {
+    indices.try_emplace(files_[i].name, i);
+  }
+
+  llvm::SmallVector<std::pair<int, Stamp>, 0> stamps;
+  auto [header, rest] = data.split('\n');
+  if (header != llvm::formatv("{0} {1}", StampsMagic, StampsVersion).str()) {
+    return;
+  }
+  llvm::SmallVector<llvm::StringRef, 0> lines;
+  rest.split(lines, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (llvm::StringRef line : lines) {
+    Stamp stamp;
+    uint64_t import_count = 0;
+    if (!ConsumeHex(line, stamp.source_hash) ||
+        !ConsumeHex(line, stamp.options_hash) ||
+        !ConsumeHex(line, stamp.interface_hash) ||
+        !ConsumeHex(line, import_count) || import_count > line.size()) {
+      return;
+    }
+    for (uint64_t i = 0; i != import_count; ++i) {
+      if (!ConsumeHex(line, stamp.import_hashes.emplace_back())) {
+        return;
+      }
+    }
+    if (line.empty()) {
+      return;
+    }
+    auto it = indices.find(line);
+    if (it != indices.end()) {
+      stamps.push_back({it->second, std::move(stamp)});
+    }
+  }
+  for (auto& [index, stamp] : stamps) {
+    files_[index].stamp = std::move(stamp);
+  }
+}
+
+auto BuildGraph::WriteStamps(llvm::raw_ostream& output) const -> void {
+  output << StampsMagic << " " << StampsVersion << "\n";
+  for (const File& file : files_) {
+    if (!file.stamp) {
+      continue;
+    }
+    output << llvm::formatv("{0:x-} {1:x-} {2:x-} {3:x-}",
+                            file.stamp->source_hash, file.stamp->options_hash,
+                            file.stamp->interface_hash,
+                            file.stamp->import_hashes.size());
+    for (uint64_t import_hash : file.stamp->import_hashes) {
+      output << llvm::formatv(" {0:x-}", import_hash);
+    }
+    output << " " << file.name << "\n";
+  }
+}
+
+}  // namespace Cocktail
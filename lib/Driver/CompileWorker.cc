@@ -0,0 +1,184 @@
+#include "Cocktail/Driver/CompileWorker.h"
+
+#include "Cocktail/Driver/DriverServer.h"
+#include "llvm/Support/Endian.h"
+
+namespace Cocktail {
+
+// A job is its flags as little-endian 32-bit integers, then its strings, each
+// a 32-bit size and the bytes, with each list of strings after its size. A
+// result is whether it succeeded, the errors, then the objects as a list.
+
+namespace {
+
+constexpr uint32_t JobVersion = 1;
+
+auto AppendU32(std::string& out, uint32_t value) -> void {
+  char bytes[sizeof(value)];
+  llvm::support::endian::write32le(bytes, value);
+  out.append(bytes, sizeof(bytes));
+}
+
+auto AppendString(std::string& out, llvm::StringRef text) -> void {
+  AppendU32(out, text.size());
+  out += text;
+}
+
+template <typename StringsT>
+auto AppendStrings(std::string& out, const StringsT& strings) -> void {
+  AppendU32(out, strings.size());
+  for (llvm::StringRef text : strings) {
+    AppendString(out, text);
+  }
+}
+
+auto ConsumeU32(llvm::StringRef& in, uint32_t& value) -> bool {
+  if (in.size() < sizeof(value)) {
+    return false;
+  }
+  value = llvm::support::endian::read32le(in.data());
+  in = in.drop_front(sizeof(value));
+  return true;
+}
+
+auto ConsumeString(llvm::StringRef& in, llvm::StringRef& text) -> bool {
+  uint32_t size = 0;
+  if (!ConsumeU32(in, size) || in.size() < size) {
+    return false;
+  }
+  text = in.take_front(size);
+  in = in.drop_front(size);
+  return true;
+}
+
+auto ConsumeStrings(llvm::StringRef& in,
+                    llvm::SmallVectorImpl<llvm::StringRef>& strings) -> bool {
+  uint32_t count = 0;
+  // Each string takes at least its size, which bounds a corrupt count.
+  if (!ConsumeU32(in, count) || count > in.size() / sizeof(uint32_t)) {
+    return false;
+  }
+  strings.resize(count);
+  for (llvm::StringRef& text : strings) {
+    if (!ConsumeString(in, text)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+auto EncodeCompileJob(const CompileJob& job) -> std::string {
+  std::string out;
+  AppendU32(out, JobVersion);
+  AppendU32(out, static_cast<uint32_t>(job.optimization_level));
+  AppendU32(out, job.codegen_shards);
+  AppendU32(out, job.codegen_threads);
+  AppendString(out, job.target_triple);
+  AppendString(out, job.file_name);
+  AppendString(out, job.source_text);
+  AppendString(out, job.tokens);
+  AppendString(out, job.parse_tree);
+  AppendStrings(out, job.interfaces);
+  AppendStrings(out, job.entry_points);
+  return out;
+}
+
+auto DecodeCompileJob(llvm::StringRef data, CompileJob& job) -> bool {
+  uint32_t version = 0;
+  uint32_t level = 0;
+  uint32_t shards = 0;
+  uint32_t threads = 0;
+  if (!ConsumeU32(data, version) || version != JobVersion ||
+      !ConsumeU32(data, level) ||
+      level > static_cast<uint32_t>(OptimizationLevel::FastCompile) ||
+      !ConsumeU32(data, shards) || shards < 1 || shards > INT32_MAX ||
+      !ConsumeU32(data, threads) || threads < 1 || threads > INT32_MAX ||
+      !ConsumeString(data, job.target_triple) ||
+      !ConsumeString(data, job.file_name) ||
+      !ConsumeString(data, job.source_text) ||
+      !ConsumeString(data, job.tokens) ||
+      !ConsumeString(data, job.parse_tree) ||
+      !ConsumeStrings(data, job.interfaces) ||
+      !ConsumeStrings(data, job.entry_points)) {
+    return false;
+  }
+  job.optimization_level = static_cast<OptimizationLevel>(level);
+  job.codegen_shards = shards;
+  job.codegen_threads = threads;
+  return data.empty();
+}
+
+auto EncodeCompileJobResult(const CompileJobResult& result) -> std::string {
+  std::string out;
+  out.push_back(result.success);
+  AppendString(out, result.errors);
+  AppendStrings(out, result.objects);
+  return out;
+}
+
+auto DecodeCompileJobResult(llvm::StringRef data)
+    -> std::optional<CompileJobResult> {
+  if (data.empty()) {
+    return std::nullopt;
+  }
+  CompileJobResult result;
+  result.success = data.front() != 0;
+  data = data.drop_front();
+  llvm::StringRef errors;
+  llvm::SmallVector<llvm::StringRef> objects;
+  if (!ConsumeString(data, errors) || !ConsumeStrings(data, objects) ||
+      !data.empty()) {
+    return std::nullopt;
+  }
+  result.errors = errors.str();
+  for (llvm::StringRef object : objects) {
+    result.objects.push_back(object.str());
+  }
+  return result;
+}
+
+CompileWorkerPool::CompileWorkerPool(
+    llvm::ArrayRef<llvm::StringRef> socket_paths) {
+  for (llvm::StringRef socket_path : socket_paths) {
+    workers_.push_back({.socket_path = socket_path.str()});
+  }
+}
+
+auto CompileWorkerPool::Acquire(uint64_t bytes) -> int {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int best = -1;
+  for (int i = 0; i != static_cast<int>(workers_.size()); ++i) {
+    if (!workers_[i].unreachable &&
+        (best < 0 ||
+         workers_[i].outstanding_bytes < workers_[best].outstanding_bytes)) {
+      best = i;
+    }
+  }
+  if (best >= 0) {
+    workers_[best].outstanding_bytes += bytes;
+  }
+  return best;
+}
+
+auto CompileWorkerPool::Run(const CompileJob& job)
+    -> std::optional<CompileJobResult> {
+  // Sources aren't read on the servers, but their size is still the best
+  // guess of how long a job takes.
+  uint64_t bytes = job.source_text.size();
+  std::string request = EncodeCompileJob(job);
+  for (int worker = Acquire(bytes); worker >= 0; worker = Acquire(bytes)) {
+    std::optional<CompileJobResult> result =
+        RunCompileJobOnDriverServer(workers_[worker].socket_path, request);
+    std::lock_guard<std::mutex> lock(mutex_);
+    workers_[worker].outstanding_bytes -= bytes;
+    if (result) {
+      return result;
+    }
+    workers_[worker].unreachable = true;
+  }
+  return std::nullopt;
+}
+
+}  // namespace Cocktail
@@ -1,17 +1,84 @@
 #include "Cocktail/Driver/Driver.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Diagnostics/DeduplicatingDiagnosticConsumer.h"
+#include "Cocktail/Diagnostics/DiagnosticCache.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Diagnostics/DiagnosticKind.h"
+#include "Cocktail/Diagnostics/ErrorBudgetDiagnosticConsumer.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
 #include "Cocktail/Diagnostics/SortingDiagnosticConsumer.h"
+#include "Cocktail/Diagnostics/StructuredDiagnosticConsumer.h"
+#include "Cocktail/Driver/AllocationCounter.h"
+#include "Cocktail/Driver/ArtifactCache.h"
+#include "Cocktail/Driver/BuildGraph.h"
+#include "Cocktail/Driver/DriverServer.h"
+#include "Cocktail/Driver/DriverStats.h"
+#include "Cocktail/Driver/LanguageServer.h"
+#include "Cocktail/Driver/RemoteCache.h"
+#include "Cocktail/Driver/SymbolIndex.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Lowering/LowerToLLVM.h"
+#include "Cocktail/Lowering/OptimizeLLVM.h"
 #include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Parser/SourceFormatter.h"
+#include "Cocktail/Semantics/SemanticsIR.h"
+#include "Cocktail/Semantics/SemanticsIRFactory.h"
+#include "Cocktail/Semantics/SemanticsInterface.h"
 #include "Cocktail/Source/SourceBuffer.h"
+#include "Cocktail/Source/SourceBufferCache.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSwitch.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/MC/TargetRegistry.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+// The version of the driver, which artifacts on disk are only read back by.
+#ifndef COCKTAIL_VERSION
+#define COCKTAIL_VERSION "unknown"
+#endif
 
 namespace Cocktail {
 
@@ -23,12 +90,228 @@ enum class Subcommand {
   Unknown,
 };
 
-auto GetSubcommand(llvm::StringRef name) -> Subcommand {
-  return llvm::StringSwitch<Subcommand>(name)
-#define COCKTAIL_SUBCOMMAND(Name, Spelling, ...) \
-  .Case(Spelling, Subcommand::Name)
+struct SubcommandInfo {
+  Subcommand subcommand;
+  llvm::StringLiteral spelling;
+  llvm::StringLiteral help_text;
+};
+
+// Built at compile time, so that neither looking up a subcommand nor printing
+// help builds anything at startup.
+constexpr SubcommandInfo Subcommands[] = {
+#define COCKTAIL_SUBCOMMAND(Name, Spelling, HelpText) \
+  {Subcommand::Name, Spelling, HelpText},
 #include "Cocktail/Driver/Flags.def"
-      .Default(Subcommand::Unknown);
+};
+
+// The width of the longest subcommand spelling, to align help text to.
+constexpr size_t MaxSubcommandWidth = [] {
+  size_t width = 0;
+  for (const SubcommandInfo& info : Subcommands) {
+    width = std::max(width, info.spelling.size());
+  }
+  return width;
+}();
+
+auto GetSubcommand(llvm::StringRef name) -> Subcommand {
+  for (const SubcommandInfo& info : Subcommands) {
+    if (info.spelling == name) {
+      return info.subcommand;
+    }
+  }
+  return Subcommand::Unknown;
+}
+
+// Registers the host target with LLVM, the first time an object is emitted,
+// so that subcommands which don't emit code don't pay for it.
+auto InitializeNativeTarget() -> void {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+}
+
+// Times each LLVM pass run under its callbacks into the stats. A pass's time
+// doesn't include the passes it runs itself, so that no time is counted
+// twice. Pass managers and adaptors only run other passes, so as for LLVM's
+// `-time-passes`, they aren't timed at all.
+class PassTimer {
+ public:
+  explicit PassTimer(DriverStats& stats) : stats_(&stats) {
+    callbacks_.registerBeforeNonSkippedPassCallback(
+        [this](llvm::StringRef pass, llvm::Any /*ir*/) {
+          if (!IsPassRunner(pass)) {
+            Start(pass);
+          }
+        });
+    callbacks_.registerAfterPassCallback(
+        [this](llvm::StringRef pass, llvm::Any /*ir*/,
+               const llvm::PreservedAnalyses& /*preserved*/) {
+          if (!IsPassRunner(pass)) {
+            Stop();
+          }
+        });
+    callbacks_.registerAfterPassInvalidatedCallback(
+        [this](llvm::StringRef pass,
+               const llvm::PreservedAnalyses& /*preserved*/) {
+          if (!IsPassRunner(pass)) {
+            Stop();
+          }
+        });
+  }
+
+  auto callbacks() -> llvm::PassInstrumentationCallbacks& {
+    return callbacks_;
+  }
+
+ private:
+  struct RunningPass {
+    llvm::StringRef name;
+    llvm::TimeRecord start;
+  };
+
+  static auto IsPassRunner(llvm::StringRef pass) -> bool {
+    return llvm::isSpecialPass(
+        pass, {"PassManager", "PassAdaptor", "AnalysisManagerProxy"});
+  }
+
+  // Pauses the pass that is running, if any, and starts `pass`.
+  auto Start(llvm::StringRef pass) -> void {
+    llvm::TimeRecord now = llvm::TimeRecord::getCurrentTime(/*Start=*/true);
+    if (!running_.empty()) {
+      Record(running_.back(), now);
+    }
+    running_.push_back({.name = pass, .start = now});
+  }
+
+  // Stops the innermost pass, and resumes the one that ran it, if any.
+  auto Stop() -> void {
+    llvm::TimeRecord now = llvm::TimeRecord::getCurrentTime(/*Start=*/false);
+    Record(running_.back(), now);
+    running_.pop_back();
+    if (!running_.empty()) {
+      running_.back().start = now;
+    }
+  }
+
+  auto Record(const RunningPass& pass, llvm::TimeRecord now) -> void {
+    now -= pass.start;
+    stats_->AddPass(pass.name, now);
+  }
+
+  DriverStats* stats_;
+  llvm::PassInstrumentationCallbacks callbacks_;
+  // The passes running, outermost first.
+  llvm::SmallVector<RunningPass> running_;
+};
+
+// Keeps the objects that the JIT compiles in the artifact cache, if there is
+// one, keyed by a hash of the bitcode of the module each was compiled from.
+// Each function is compiled from a module of its own, so running a program
+// again only compiles the functions that changed. Counts the objects compiled
+// and read back in the stats.
+class JITObjectCache : public llvm::ObjectCache {
+ public:
+  JITObjectCache(ArtifactCache* artifact_cache, DriverStats* stats,
+                 OptimizationLevel level)
+      : artifact_cache_(artifact_cache), stats_(stats), level_(level) {}
+
+  auto notifyObjectCompiled(const llvm::Module* module,
+                            llvm::MemoryBufferRef object) -> void override {
+    if (stats_ != nullptr) {
+      stats_->AddCount("jit_objects", 1);
+    }
+    if (artifact_cache_ != nullptr) {
+      artifact_cache_->Insert(GetKey(*module), object.getBuffer());
+    }
+  }
+
+  auto getObject(const llvm::Module* module)
+      -> std::unique_ptr<llvm::MemoryBuffer> override {
+    if (artifact_cache_ == nullptr) {
+      return nullptr;
+    }
+    std::optional<ArtifactCache::Artifact> artifact =
+        artifact_cache_->Lookup(GetKey(*module));
+    if (!artifact) {
+      return nullptr;
+    }
+    if (stats_ != nullptr) {
+      stats_->AddCount("jit_cache_hits", 1);
+    }
+    return llvm::MemoryBuffer::getMemBufferCopy(artifact->data(),
+                                                module->getName());
+  }
+
+ private:
+  auto GetKey(const llvm::Module& module) -> std::string {
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream bitcode_stream(bitcode);
+    llvm::WriteBitcodeToFile(module, bitcode_stream);
+    // The target and the level of codegen change the object too.
+    return ArtifactCache::MakeKey(
+        {COCKTAIL_VERSION, "jit", module.getTargetTriple(),
+         llvm::Twine(static_cast<int>(level_)).str(),
+         llvm::StringRef(bitcode.data(), bitcode.size())});
+  }
+
+  ArtifactCache* artifact_cache_;
+  DriverStats* stats_;
+  OptimizationLevel level_;
+};
+
+// Called in place of a function that the JIT was unable to compile.
+[[noreturn]] auto ReportLazyCompileFailure() -> void {
+  COCKTAIL_FATAL() << "Unable to compile a function called by the program!";
+}
+
+auto GetDiagnosticKind(llvm::StringRef name) -> std::optional<DiagnosticKind> {
+  return llvm::StringSwitch<std::optional<DiagnosticKind>>(name)
+#define COCKTAIL_DIAGNOSTIC_KIND(Name) .Case(#Name, DiagnosticKind::Name)
+#include "Cocktail/Diagnostics/DiagnosticKind.def"
+      .Default(std::nullopt);
+}
+
+// Returns the key of the artifact that `stage` produces for `source`. Besides
+// the source, an artifact depends on the version of the driver and of each
+// format it is stored in. The file name is part of the key too, as the
+// stored diagnostics carry it. Semantics also depends on the `imports`, the
+// hashes of the interfaces imported. No driver flags change what lexing or
+// parsing produces; any that do must be added here.
+auto MakeArtifactKey(DiagnosticCache::Stage stage, SourceBuffer& source,
+                     llvm::StringRef imports) -> std::string {
+  std::string versions = llvm::formatv(
+      "{0}.{1}.{2}.{3}", TokenizedBuffer::SerializationVersion,
+      ParseTree::SerializationVersion,
+      DiagnosticCache::Entry::SerializationVersion,
+      SemanticsInterface::SerializationVersion);
+  llvm::StringRef stage_name;
+  switch (stage) {
+    case DiagnosticCache::Stage::Lex:
+      stage_name = "lex";
+      break;
+    case DiagnosticCache::Stage::Parse:
+      stage_name = "parse";
+      break;
+    case DiagnosticCache::Stage::Semantics:
+      stage_name = "semantics";
+      break;
+  }
+  return ArtifactCache::MakeKey(
+      {COCKTAIL_VERSION, versions, stage_name, source.filename(),
+       source.text(),
+       stage == DiagnosticCache::Stage::Semantics ? imports : ""});
+}
+
+// Returns the key of `interfaces`, which is made of their hashes, in order.
+auto MakeImportsKey(llvm::ArrayRef<SemanticsInterface> interfaces)
+    -> std::string {
+  std::string key;
+  for (const SemanticsInterface& interface : interfaces) {
+    key += llvm::formatv("{0:x};", interface.hash());
+  }
+  return key;
 }
 
 }  // namespace
@@ -43,28 +326,352 @@ auto Driver::RunFullCommand(llvm::ArrayRef<llvm::StringRef> args) -> bool {
   llvm::SmallVector<llvm::StringRef, 16> subcommand_args(
       std::next(args.begin()), args.end());
 
-  DiagnosticConsumer* consumer = &ConsoleDiagnosticConsumer();
-  std::unique_ptr<SortingDiagnosticConsumer> sorting_consumer;
   // TODO: Figure out command-line support (llvm::cl?), this is temporary.
-  if (!subcommand_args.empty() &&
-      subcommand_args[0] == "--print-errors=streamed") {
+  bool sort_errors = true;
+  // `--print-errors=json` and `--print-errors=binary` write diagnostics for
+  // tools to read, rather than for people, to the error stream.
+  std::optional<StructuredDiagnosticConsumer::Format> structured_format;
+  // `--stats` prints how long each phase took and how much it processed to
+  // the error stream, and `--time-trace=FILE` writes the phases to `FILE` as
+  // a Chrome trace, in the format of `llvm::TimeTraceScope`.
+  bool print_stats = false;
+  constexpr llvm::StringLiteral TimeTraceFlag = "--time-trace=";
+  llvm::StringRef time_trace_file;
+  // `-j N` processes the input files on `N` threads. For `dump-parse-tree`,
+  // files are lexed and parsed in a pipeline, each stage on some of the
+  // threads, unless `--lex-jobs=N` and `--parse-jobs=N` say how many.
+  int jobs = 1;
+  constexpr llvm::StringLiteral LexJobsFlag = "--lex-jobs=";
+  constexpr llvm::StringLiteral ParseJobsFlag = "--parse-jobs=";
+  int lex_jobs = 0;
+  int parse_jobs = 0;
+  // `--cache-dir=DIR` keeps lex, parse and interface results in `DIR`, to be
+  // shared by every command using it, and `--cache-max-size=BYTES` bounds its
+  // size.
+  constexpr llvm::StringLiteral CacheDirFlag = "--cache-dir=";
+  constexpr llvm::StringLiteral CacheMaxSizeFlag = "--cache-max-size=";
+  llvm::StringRef cache_dir;
+  // `--remote-cache=DIR` shares the cache's artifacts through `DIR`, such as
+  // a directory every machine mounts, fetching those missing from the cache
+  // and storing those written to it.
+  constexpr llvm::StringLiteral RemoteCacheFlag = "--remote-cache=";
+  llvm::StringRef remote_cache_dir;
+  // `--workers=SOCKET,...` compiles objects on the driver servers listening
+  // on those sockets, sending each file's tokens and tree rather than its
+  // source. Files are still lexed and parsed here, and compiled here if no
+  // server can be reached.
+  constexpr llvm::StringLiteral WorkersFlag = "--workers=";
+  llvm::SmallVector<llvm::StringRef> worker_sockets;
+  uint64_t cache_max_size = ArtifactCache::DefaultMaxSize;
+  // `--max-errors=N` limits the number of errors, and `--max-errors=Kind:N`
+  // the number of diagnostics of one kind. As for other compilers, a limit of
+  // 0 means there is none.
+  constexpr llvm::StringLiteral MaxErrorsFlag = "--max-errors=";
+  std::optional<int> max_errors;
+  llvm::SmallVector<std::pair<DiagnosticKind, int>> kind_limits;
+  // `--low-memory` frees each stage's data as soon as no later stage needs
+  // it, and holds fewer files at once, for when memory is scarcer than time.
+  bool low_memory = false;
+  // `--codegen-shards=N` splits each file's functions into `N` shards that
+  // are lowered, and compiled to objects of their own, on threads of their
+  // own. `emit-llvm` links them back into one module.
+  constexpr llvm::StringLiteral CodegenShardsFlag = "--codegen-shards=";
+  int codegen_shards = 1;
+  // `--codegen-threads=N` splits the backend's work on each module across
+  // `N` threads, each writing an object of its own. Unlike shards, the
+  // module is optimized as a whole first.
+  constexpr llvm::StringLiteral CodegenThreadsFlag = "--codegen-threads=";
+  int codegen_threads = 1;
+  // `-O0` to `-O3` set how much lowered code is optimized, and
+  // `-Ofast-compile` runs only cheap cleanups. The default is `-O0`, which
+  // compiles fastest.
+  OptimizationLevel optimization_level = OptimizationLevel::O0;
+  // `--import=FILE` declares the functions of the interface that
+  // `emit-interface` wrote to `FILE` in every input file, and may be given
+  // more than once. Names imported first take precedence.
+  constexpr llvm::StringLiteral ImportFlag = "--import=";
+  llvm::SmallVector<llvm::StringRef> import_files;
+  // `--entry-point=NAME`, which may be given more than once, lowers only the
+  // functions that `main` or a function named `NAME` can call, leaving the
+  // rest out of each module. `run` only ever lowers those `main` can.
+  constexpr llvm::StringLiteral EntryPointFlag = "--entry-point=";
+  llvm::SmallVector<llvm::StringRef> entry_points;
+  while (!subcommand_args.empty()) {
+    llvm::StringRef arg = subcommand_args[0];
+    if (arg == "--print-errors=streamed") {
+      sort_errors = false;
+    } else if (arg == "--print-errors=json") {
+      structured_format = StructuredDiagnosticConsumer::Format::Json;
+    } else if (arg == "--print-errors=binary") {
+      structured_format = StructuredDiagnosticConsumer::Format::Binary;
+    } else if (arg == "--stats") {
+      print_stats = true;
+    } else if (arg == "--low-memory") {
+      low_memory = true;
+    } else if (arg == "-j") {
+      if (subcommand_args.size() < 2 ||
+          subcommand_args[1].getAsInteger(10, jobs) || jobs < 1) {
+        error_stream_ << "ERROR: Invalid number of jobs.\n";
+        return false;
+      }
+      subcommand_args.erase(subcommand_args.begin());
+    } else if (arg.consume_front(LexJobsFlag) ||
+               arg.consume_front(ParseJobsFlag)) {
+      int& stage_jobs =
+          subcommand_args[0].startswith(LexJobsFlag) ? lex_jobs : parse_jobs;
+      if (arg.getAsInteger(10, stage_jobs) || stage_jobs < 1) {
+        error_stream_ << "ERROR: Invalid number of jobs '" << arg << "'.\n";
+        return false;
+      }
+    } else if (arg.consume_front(CodegenShardsFlag)) {
+      if (arg.getAsInteger(10, codegen_shards) || codegen_shards < 1) {
+        error_stream_ << "ERROR: Invalid number of shards '" << arg << "'.\n";
+        return false;
+      }
+    } else if (arg.consume_front(CodegenThreadsFlag)) {
+      if (arg.getAsInteger(10, codegen_threads) || codegen_threads < 1) {
+        error_stream_ << "ERROR: Invalid number of threads '" << arg
+                      << "'.\n";
+        return false;
+      }
+    } else if (arg.consume_front("-O")) {
+      std::optional<OptimizationLevel> level = GetOptimizationLevel(arg);
+      if (!level) {
+        error_stream_ << "ERROR: Unknown optimization level '" << arg
+                      << "'.\n";
+        return false;
+      }
+      optimization_level = *level;
+    } else if (arg.consume_front(ImportFlag)) {
+      if (arg.empty()) {
+        error_stream_ << "ERROR: No interface file specified.\n";
+        return false;
+      }
+      import_files.push_back(arg);
+    } else if (arg.consume_front(EntryPointFlag)) {
+      if (arg.empty()) {
+        error_stream_ << "ERROR: No entry point specified.\n";
+        return false;
+      }
+      entry_points.push_back(arg);
+    } else if (arg.consume_front(CacheDirFlag)) {
+      if (arg.empty()) {
+        error_stream_ << "ERROR: No cache directory specified.\n";
+        return false;
+      }
+      cache_dir = arg;
+    } else if (arg.consume_front(WorkersFlag)) {
+      arg.split(worker_sockets, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+      if (worker_sockets.empty()) {
+        error_stream_ << "ERROR: No workers specified.\n";
+        return false;
+      }
+    } else if (arg.consume_front(RemoteCacheFlag)) {
+      if (arg.empty()) {
+        error_stream_ << "ERROR: No remote cache directory specified.\n";
+        return false;
+      }
+      remote_cache_dir = arg;
+    } else if (arg.consume_front(CacheMaxSizeFlag)) {
+      if (arg.getAsInteger(10, cache_max_size)) {
+        error_stream_ << "ERROR: Invalid cache size '" << arg << "'.\n";
+        return false;
+      }
+    } else if (arg.consume_front(TimeTraceFlag)) {
+      if (arg.empty()) {
+        error_stream_ << "ERROR: No time trace file specified.\n";
+        return false;
+      }
+      time_trace_file = arg;
+    } else if (arg.consume_front(MaxErrorsFlag)) {
+      std::optional<DiagnosticKind> kind;
+      llvm::StringRef limit_text = arg;
+      if (arg.contains(':')) {
+        llvm::StringRef kind_name;
+        std::tie(kind_name, limit_text) = arg.split(':');
+        kind = GetDiagnosticKind(kind_name);
+        if (!kind) {
+          error_stream_ << "ERROR: Unknown diagnostic kind '" << kind_name
+                        << "'.\n";
+          return false;
+        }
+      }
+      int limit = 0;
+      if (limit_text.getAsInteger(10, limit) || limit < 0) {
+        error_stream_ << "ERROR: Invalid error limit '" << limit_text
+                      << "'.\n";
+        return false;
+      }
+      if (limit == 0) {
+        limit = ErrorBudgetDiagnosticConsumer::Unlimited;
+      }
+      if (kind) {
+        kind_limits.push_back({*kind, limit});
+      } else {
+        max_errors = limit;
+      }
+    } else {
+      break;
+    }
     subcommand_args.erase(subcommand_args.begin());
-  } else {
+  }
+
+  DiagnosticConsumer* consumer = console_consumer_;
+  std::unique_ptr<StructuredDiagnosticConsumer> structured_consumer;
+  if (structured_format) {
+    structured_consumer = std::make_unique<StructuredDiagnosticConsumer>(
+        error_stream_, *structured_format);
+    consumer = structured_consumer.get();
+  }
+  std::unique_ptr<SortingDiagnosticConsumer> sorting_consumer;
+  if (sort_errors) {
     sorting_consumer = std::make_unique<SortingDiagnosticConsumer>(*consumer);
     consumer = sorting_consumer.get();
   }
-  switch (GetSubcommand(subcommand_text)) {
-    case Subcommand::Unknown:
-      error_stream_ << "ERROR: Unknown subcommand '" << subcommand_text
-                    << "'.\n";
+  // The budget goes in front of the sorting, so that what it drops is never
+  // buffered.
+  std::unique_ptr<ErrorBudgetDiagnosticConsumer> error_budget;
+  if (max_errors || !kind_limits.empty()) {
+    error_budget = std::make_unique<ErrorBudgetDiagnosticConsumer>(
+        *consumer,
+        max_errors.value_or(ErrorBudgetDiagnosticConsumer::Unlimited));
+    for (auto [kind, limit] : kind_limits) {
+      error_budget->SetKindLimit(kind, limit);
+    }
+    consumer = error_budget.get();
+  }
+  // Duplicates are dropped before they count against the budget. Only so
+  // many diagnostics are remembered, so a low budget still bounds memory.
+  DeduplicatingDiagnosticConsumer deduplicating_consumer(*consumer);
+  consumer = &deduplicating_consumer;
+
+  Subcommand subcommand = GetSubcommand(subcommand_text);
+  if (subcommand == Subcommand::Unknown) {
+    error_stream_ << "ERROR: Unknown subcommand '" << subcommand_text
+                  << "'.\n";
+    return false;
+  }
+
+  // The interfaces are read where they're mapped, so the files stay mapped
+  // until the command is done.
+  llvm::SmallVector<std::unique_ptr<llvm::MemoryBuffer>> import_buffers;
+  llvm::SmallVector<SemanticsInterface> imports;
+  for (llvm::StringRef import_file : import_files) {
+    auto buffer =
+        llvm::MemoryBuffer::getFile(import_file, /*IsText=*/false,
+                                    /*RequiresNullTerminator=*/false);
+    if (!buffer) {
+      error_stream_ << "ERROR: Unable to read interface file: " << import_file
+                    << "\n";
       return false;
+    }
+    llvm::Optional<SemanticsInterface> interface =
+        SemanticsInterface::Deserialize((*buffer)->getBuffer());
+    if (!interface) {
+      error_stream_ << "ERROR: Invalid interface file: " << import_file
+                    << "\n";
+      return false;
+    }
+    imports.push_back(*interface);
+    import_buffers.push_back(std::move(*buffer));
+  }
 
-#define COCKTAIL_SUBCOMMAND(Name, ...) \
-  case Subcommand::Name:               \
-    return Run##Name##Subcommand(*consumer, subcommand_args);
+  if (!remote_cache_dir.empty() && cache_dir.empty()) {
+    error_stream_ << "ERROR: A remote cache needs a cache directory.\n";
+    return false;
+  }
+
+  std::optional<DriverStats> stats;
+  std::optional<DriverStats::DiagnosticCounter> diagnostic_counter;
+  if (print_stats) {
+    stats.emplace();
+    diagnostic_counter.emplace(*stats, *consumer);
+    consumer = &*diagnostic_counter;
+  }
+  stats_ = stats ? &*stats : nullptr;
+  jobs_ = jobs;
+  lex_jobs_ = lex_jobs;
+  parse_jobs_ = parse_jobs;
+  low_memory_ = low_memory;
+  codegen_shards_ = codegen_shards;
+  codegen_threads_ = codegen_threads;
+  optimization_level_ = optimization_level;
+  imports_ = imports;
+  imports_key_ = MakeImportsKey(imports);
+  entry_points_ = entry_points;
+  std::optional<ArtifactCache> artifact_cache;
+  // Diagnostics replayed from the artifact cache refer to the entries they
+  // were read into, which are kept in a diagnostic cache until the command is
+  // done with them.
+  DiagnosticCache* caller_diagnostic_cache = diagnostic_cache_;
+  std::optional<DiagnosticCache> command_diagnostic_cache;
+  if (!cache_dir.empty()) {
+    artifact_cache.emplace(cache_dir, cache_max_size);
+    if (!remote_cache_dir.empty()) {
+      artifact_cache->SetRemote(
+          std::make_unique<DirectoryRemoteCache>(remote_cache_dir));
+    }
+    if (diagnostic_cache_ == nullptr) {
+      diagnostic_cache_ = &command_diagnostic_cache.emplace();
+    }
+  }
+  artifact_cache_ = artifact_cache ? &*artifact_cache : nullptr;
+  std::optional<CompileWorkerPool> workers;
+  if (!worker_sockets.empty()) {
+    workers.emplace(worker_sockets);
+  }
+  workers_ = workers ? &*workers : nullptr;
+  bool trace = !time_trace_file.empty() && !llvm::timeTraceProfilerEnabled();
+  if (trace) {
+    llvm::timeTraceProfilerInitialize(/*TimeTraceGranularity=*/0, "cocktail");
+  }
+
+  bool result = false;
+  {
+    DriverStats::PhaseScope scope(stats_, "total");
+    switch (subcommand) {
+      case Subcommand::Unknown:
+        llvm_unreachable("Unknown subcommand handled above!");
+
+#define COCKTAIL_SUBCOMMAND(Name, ...)                            \
+  case Subcommand::Name:                                          \
+    result = Run##Name##Subcommand(*consumer, subcommand_args); \
+    break;
 #include "Cocktail/Driver/Flags.def"
+    }
+  }
+  stats_ = nullptr;
+  jobs_ = 1;
+  lex_jobs_ = 0;
+  parse_jobs_ = 0;
+  low_memory_ = false;
+  codegen_shards_ = 1;
+  codegen_threads_ = 1;
+  optimization_level_ = OptimizationLevel::O0;
+  imports_ = {};
+  imports_key_.clear();
+  entry_points_ = {};
+  artifact_cache_ = nullptr;
+  workers_ = nullptr;
+  diagnostic_cache_ = caller_diagnostic_cache;
+
+  if (trace) {
+    std::error_code ec;
+    llvm::raw_fd_ostream trace_stream(time_trace_file, ec,
+                                      llvm::sys::fs::OF_Text);
+    if (ec) {
+      error_stream_ << "ERROR: Unable to write time trace file: "
+                    << time_trace_file << "\n";
+      result = false;
+    } else {
+      llvm::timeTraceProfilerWrite(trace_stream);
+    }
+    llvm::timeTraceProfilerCleanup();
+  }
+  if (stats) {
+    stats->Print(error_stream_);
   }
-  llvm_unreachable("All subcommands handled!");
+  return result;
 }
 
 auto Driver::RunHelpSubcommand(DiagnosticConsumer& /*consumer*/,
@@ -75,24 +682,10 @@ auto Driver::RunHelpSubcommand(DiagnosticConsumer& /*consumer*/,
   }
 
   output_stream_ << "List of subcommands:\n\n";
-
-  constexpr llvm::StringLiteral SubcommandsAndHelp[][2] = {
-#define COCKTAIL_SUBCOMMAND(Name, Spelling, HelpText) {Spelling, HelpText},
-#include "Cocktail/Driver/Flags.def"
-  };
-
-  int max_subcommand_width = 0;
-  for (const auto* subcommand_and_help : SubcommandsAndHelp) {
-    max_subcommand_width = std::max(
-        max_subcommand_width, static_cast<int>(subcommand_and_help[0].size()));
-  }
-
-  for (const auto* subcommand_and_help : SubcommandsAndHelp) {
-    llvm::StringRef subcommand_text = subcommand_and_help[0];
-    llvm::StringRef help_text = subcommand_and_help[1];
+  for (const SubcommandInfo& info : Subcommands) {
     output_stream_ << "  "
-                   << llvm::left_justify(subcommand_text, max_subcommand_width)
-                   << " - " << help_text << "\n";
+                   << llvm::left_justify(info.spelling, MaxSubcommandWidth)
+                   << " - " << info.help_text << "\n";
   }
 
   output_stream_ << "\n";
@@ -102,64 +695,867 @@ auto Driver::RunHelpSubcommand(DiagnosticConsumer& /*consumer*/,
 auto Driver::RunDumpTokensSubcommand(DiagnosticConsumer& consumer,
                                      llvm::ArrayRef<llvm::StringRef> args)
     -> bool {
+  constexpr llvm::StringLiteral FormatFlag = "--format=";
+  auto format = TokenizedBuffer::PrintFormat::Yaml;
+  if (!args.empty() && args.front().startswith(FormatFlag)) {
+    llvm::StringRef format_text = args.front().drop_front(FormatFlag.size());
+    std::optional<TokenizedBuffer::PrintFormat> parsed_format =
+        llvm::StringSwitch<std::optional<TokenizedBuffer::PrintFormat>>(
+            format_text)
+            .Case("yaml", TokenizedBuffer::PrintFormat::Yaml)
+            .Case("ndjson", TokenizedBuffer::PrintFormat::Ndjson)
+            .Default(std::nullopt);
+    if (!parsed_format) {
+      error_stream_ << "ERROR: Unknown token dump format '" << format_text
+                    << "'.\n";
+      return false;
+    }
+    format = *parsed_format;
+    args = args.drop_front();
+  }
+
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<llvm::StringRef> input_files;
+  if (!ExpandInputFiles(args, saver, input_files)) {
+    return false;
+  }
+
+  return RunOnFiles(
+      input_files, consumer,
+      [&](llvm::StringRef input_file_name, DiagnosticConsumer& file_consumer,
+          llvm::raw_ostream& output, llvm::raw_ostream& errors) {
+        auto source = ReadSource(input_file_name, file_consumer);
+        if (!source) {
+          file_consumer.Flush();
+          errors << "ERROR: Unable to open input source file: "
+                 << input_file_name << "\n";
+          return false;
+        }
+        auto tokenized_source = Lex(*source, file_consumer);
+        file_consumer.Flush();
+        {
+          DriverStats::PhaseScope scope(stats_, "print");
+          tokenized_source.Print(output, format);
+        }
+        return !tokenized_source.has_errors();
+      });
+}
+
+auto Driver::RunDumpParseTreeSubcommand(DiagnosticConsumer& consumer,
+                                        llvm::ArrayRef<llvm::StringRef> args)
+    -> bool {
+  constexpr llvm::StringLiteral FormatFlag = "--format=";
+  auto format = ParseTree::PrintFormat::Yaml;
+  if (!args.empty() && args.front().startswith(FormatFlag)) {
+    llvm::StringRef format_text = args.front().drop_front(FormatFlag.size());
+    std::optional<ParseTree::PrintFormat> parsed_format =
+        llvm::StringSwitch<std::optional<ParseTree::PrintFormat>>(format_text)
+            .Case("yaml", ParseTree::PrintFormat::Yaml)
+            .Case("ndjson", ParseTree::PrintFormat::Ndjson)
+            .Default(std::nullopt);
+    if (!parsed_format) {
+      error_stream_ << "ERROR: Unknown parse tree dump format '" << format_text
+                    << "'.\n";
+      return false;
+    }
+    format = *parsed_format;
+    args = args.drop_front();
+  }
+
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<llvm::StringRef> input_files;
+  if (!ExpandInputFiles(args, saver, input_files)) {
+    return false;
+  }
+
+  auto parse_file = [&](SourceBuffer& source, TokenizedBuffer& tokens,
+                        DiagnosticConsumer& file_consumer,
+                        llvm::raw_ostream& output) {
+    auto parse_tree = Parse(source, tokens, file_consumer);
+    file_consumer.Flush();
+    // The dump only shows the literals' text.
+    ReleaseLiteralValues(tokens);
+    {
+      DriverStats::PhaseScope scope(stats_, "print");
+      parse_tree.Print(output, format);
+    }
+    return !tokens.has_errors() && !parse_tree.has_errors();
+  };
+  if (UseLexParsePipeline(input_files)) {
+    return RunLexParsePipeline(input_files, consumer, parse_file);
+  }
+
+  return RunOnFiles(
+      input_files, consumer,
+      [&](llvm::StringRef input_file_name, DiagnosticConsumer& file_consumer,
+          llvm::raw_ostream& output, llvm::raw_ostream& errors) {
+        auto source = ReadSource(input_file_name, file_consumer);
+        if (!source) {
+          file_consumer.Flush();
+          errors << "ERROR: Unable to open input source file: "
+                 << input_file_name << "\n";
+          return false;
+        }
+        auto tokenized_source = Lex(*source, file_consumer);
+        return parse_file(*source, tokenized_source, file_consumer, output);
+      });
+}
+
+auto Driver::RunDumpSemanticsIRSubcommand(DiagnosticConsumer& consumer,
+                                          llvm::ArrayRef<llvm::StringRef> args)
+    -> bool {
+  return RunPipelineSubcommand(consumer, args, PipelineStage::SemanticsIR);
+}
+
+auto Driver::RunEmitLLVMSubcommand(DiagnosticConsumer& consumer,
+                                   llvm::ArrayRef<llvm::StringRef> args)
+    -> bool {
+  return RunPipelineSubcommand(consumer, args, PipelineStage::LLVM);
+}
+
+auto Driver::RunEmitInterfaceSubcommand(DiagnosticConsumer& consumer,
+                                        llvm::ArrayRef<llvm::StringRef> args)
+    -> bool {
+  return RunPipelineSubcommand(consumer, args, PipelineStage::Interface);
+}
+
+auto Driver::RunCompileSubcommand(DiagnosticConsumer& consumer,
+                                  llvm::ArrayRef<llvm::StringRef> args)
+    -> bool {
+  constexpr llvm::StringLiteral OutputFlag = "--output=";
+  llvm::StringRef object_file;
+  if (!args.empty() && args.front().startswith(OutputFlag)) {
+    object_file = args.front().drop_front(OutputFlag.size());
+    if (object_file.empty()) {
+      error_stream_ << "ERROR: No output file specified.\n";
+      return false;
+    }
+    args = args.drop_front();
+  }
+  return RunPipelineSubcommand(consumer, args, PipelineStage::Object,
+                               object_file);
+}
+
+auto Driver::RunRunSubcommand(DiagnosticConsumer& consumer,
+                              llvm::ArrayRef<llvm::StringRef> args) -> bool {
+  // The program runs in this process, so only one can run at a time.
+  if (args.size() > 1) {
+    ReportExtraArgs("run", args.drop_front());
+    return false;
+  }
+  return RunPipelineSubcommand(consumer, args, PipelineStage::Run);
+}
+
+auto Driver::RunBuildSubcommand(DiagnosticConsumer& consumer,
+                                llvm::ArrayRef<llvm::StringRef> args) -> bool {
   if (args.empty()) {
-    error_stream_ << "ERROR: No input file specified.\n";
+    error_stream_ << "ERROR: No build manifest specified.\n";
     return false;
   }
+  if (args.size() > 1) {
+    ReportExtraArgs("build", args.drop_front());
+    return false;
+  }
+  llvm::StringRef manifest_file = args.front();
+  auto manifest = llvm::MemoryBuffer::getFile(manifest_file, /*IsText=*/true);
+  if (!manifest) {
+    error_stream_ << "ERROR: Unable to read build manifest: " << manifest_file
+                  << "\n";
+    return false;
+  }
+  std::optional<BuildGraph> graph =
+      BuildGraph::Parse((*manifest)->getBuffer(), error_stream_);
+  if (!graph) {
+    return false;
+  }
+  std::string stamps_file = (manifest_file + ".stamps").str();
+  if (auto stamps = llvm::MemoryBuffer::getFile(stamps_file, /*IsText=*/true)) {
+    graph->ReadStamps((*stamps)->getBuffer());
+  }
 
-  llvm::StringRef input_file_name = args.front();
+  // What the build knows of each file. Once a file is built, or found to be
+  // up to date, its interface is mapped for the files that import it.
+  struct BuildFile {
+    std::unique_ptr<llvm::MemoryBuffer> interface_buffer;
+    std::optional<SemanticsInterface> interface;
+    // The number of the file's imports that aren't built yet.
+    std::atomic<int> pending_imports = 0;
+  };
+  std::vector<BuildFile> files(graph->size());
+  auto map_interface = [&](BuildFile& file, llvm::StringRef interface_file) {
+    auto buffer =
+        llvm::MemoryBuffer::getFile(interface_file, /*IsText=*/false,
+                                    /*RequiresNullTerminator=*/false);
+    if (!buffer) {
+      return false;
+    }
+    llvm::Optional<SemanticsInterface> interface =
+        SemanticsInterface::Deserialize((*buffer)->getBuffer());
+    if (!interface) {
+      return false;
+    }
+    file.interface = *interface;
+    file.interface_buffer = std::move(*buffer);
+    return true;
+  };
+
+  // The options that change the objects built, which a file's stamp records
+  // so that changing them builds it again.
+  std::string options = llvm::formatv(
+      "{0} {1} {2}", static_cast<int>(optimization_level_), codegen_shards_,
+      codegen_threads_);
+  for (llvm::StringRef entry_point : entry_points_) {
+    options += '\0';
+    options += entry_point;
+  }
+  uint64_t options_hash = llvm::xxHash64(options);
+  int num_objects = codegen_shards_ * codegen_threads_;
+
+  // Builds the `index`th file once its imports are built. Only the files
+  // whose stamps no longer match are compiled, so a file whose interface
+  // comes out as it was leaves the files importing it up to date.
+  auto build_file = [&](int index, DiagnosticConsumer& file_consumer,
+                        llvm::raw_ostream& output, llvm::raw_ostream& errors) {
+    BuildGraph::File& graph_file = graph->files()[index];
+    BuildFile& file = files[index];
+    // The interfaces from `--import` are imported first, as they are by
+    // every other subcommand.
+    llvm::SmallVector<SemanticsInterface> interfaces(imports_.begin(),
+                                                     imports_.end());
+    for (int import : graph_file.imports) {
+      if (!files[import].interface) {
+        errors << "ERROR: Not building " << graph_file.name << ", as "
+               << graph->files()[import].name << " failed to build.\n";
+        return false;
+      }
+      interfaces.push_back(*files[import].interface);
+    }
+    llvm::SmallString<256> interface_file(graph_file.name);
+    llvm::sys::path::replace_extension(interface_file, "api");
+    llvm::SmallString<256> object_file(graph_file.name);
+    llvm::sys::path::replace_extension(object_file, "o");
+
+    std::shared_ptr<SourceBuffer> source =
+        ReadSource(graph_file.name, file_consumer);
+    if (!source) {
+      file_consumer.Flush();
+      errors << "ERROR: Unable to open input source file: " << graph_file.name
+             << "\n";
+      return false;
+    }
+    BuildGraph::Stamp stamp = {.source_hash = llvm::xxHash64(source->text()),
+                               .options_hash = options_hash};
+    for (const SemanticsInterface& interface : interfaces) {
+      stamp.import_hashes.push_back(interface.hash());
+    }
+    // Code generation split into several parts writes an object for each.
+    auto objects_exist = [&] {
+      for (int i = 0; i != num_objects; ++i) {
+        if (!llvm::sys::fs::exists(
+                GetObjectFileName(object_file, i, num_objects))) {
+          return false;
+        }
+      }
+      return true;
+    };
+    // A file is up to date if it was last built from the same text,
+    // interfaces and options, and what was built is still there.
+    if (graph_file.stamp &&
+        graph_file.stamp->source_hash == stamp.source_hash &&
+        graph_file.stamp->options_hash == stamp.options_hash &&
+        graph_file.stamp->import_hashes == stamp.import_hashes &&
+        objects_exist() && map_interface(file, interface_file) &&
+        file.interface->hash() == graph_file.stamp->interface_hash) {
+      if (stats_ != nullptr) {
+        stats_->AddCount("files_skipped", 1);
+      }
+      return true;
+    }
+
+    // The old interface is unmapped before it's overwritten.
+    file.interface.reset();
+    file.interface_buffer.reset();
+    graph_file.stamp.reset();
+    if (stats_ != nullptr) {
+      stats_->AddCount("files_rebuilt", 1);
+    }
+    std::string imports_key = MakeImportsKey(interfaces);
+    if (!CompileFile(graph_file.name, PipelineStage::Object, object_file,
+                     {.interfaces = interfaces, .key = imports_key},
+                     file_consumer, output, errors, /*scheduler=*/nullptr,
+                     interface_file)) {
+      return false;
+    }
+    if (!map_interface(file, interface_file)) {
+      errors << "ERROR: Invalid interface file: " << interface_file << "\n";
+      return false;
+    }
+    stamp.interface_hash = file.interface->hash();
+    graph_file.stamp = std::move(stamp);
+    return true;
+  };
+
+  // The files are in an order where each comes after its imports, which is
+  // the order they're built in on one thread, and that their results are
+  // written in on several.
+  bool success = true;
+  if (jobs_ == 1) {
+    for (int i = 0; i != graph->size(); ++i) {
+      success &= build_file(i, consumer, output_stream_, error_stream_);
+      if (consumer.ShouldStop()) {
+        success = false;
+        break;
+      }
+    }
+  } else {
+    std::vector<FileResult> results(graph->size());
+    // This thread builds files as well while it waits, so it makes up the
+    // jobs.
+    TaskScheduler scheduler(jobs_ - 1);
+    TaskGroup group(scheduler);
+    // Each file is built by a task of its own, run by the task that built
+    // the last of its imports.
+    std::function<void(int)> run = [&](int i) {
+      group.Run([&, i] {
+        FileResult& result = results[i];
+        DiagnosticCache::Recorder recorder(NullDiagnosticConsumer());
+        llvm::raw_string_ostream output(result.output);
+        llvm::raw_string_ostream errors(result.errors);
+        result.success = build_file(i, recorder, output, errors);
+        output.flush();
+        errors.flush();
+        result.diagnostics = recorder.Take("");
+        for (int dependent : graph->files()[i].dependents) {
+          if (files[dependent].pending_imports.fetch_sub(
+                  1, std::memory_order_acq_rel) == 1) {
+            run(dependent);
+          }
+        }
+        result.done.store(true, std::memory_order_release);
+      });
+    };
+    for (int i = 0; i != graph->size(); ++i) {
+      files[i].pending_imports.store(graph->files()[i].imports.size(),
+                                     std::memory_order_relaxed);
+    }
+    for (int i = 0; i != graph->size(); ++i) {
+      if (graph->files()[i].imports.empty()) {
+        run(i);
+      }
+    }
+    success = WriteFileResults(group, results, consumer);
+    // The tasks use the state above, so they must finish before it's gone.
+    group.Wait();
+  }
+
+  // Files that failed have no stamp, so they're built again next time.
+  std::error_code ec;
+  llvm::raw_fd_ostream stamps_stream(stamps_file, ec, llvm::sys::fs::OF_Text);
+  if (!ec) {
+    graph->WriteStamps(stamps_stream);
+    stamps_stream.close();
+  }
+  if (ec || stamps_stream.has_error()) {
+    stamps_stream.clear_error();
+    error_stream_ << "ERROR: Unable to write build stamps: " << stamps_file
+                  << "\n";
+    return false;
+  }
+  return success;
+}
+
+auto Driver::RunPipelineSubcommand(DiagnosticConsumer& consumer,
+                                   llvm::ArrayRef<llvm::StringRef> args,
+                                   PipelineStage last_stage,
+                                   llvm::StringRef output_file) -> bool {
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<llvm::StringRef> input_files;
+  if (!ExpandInputFiles(args, saver, input_files)) {
+    return false;
+  }
+  if (!output_file.empty() && input_files.size() != 1) {
+    error_stream_ << "ERROR: An output file can only be specified for one "
+                     "input file.\n";
+    return false;
+  }
+
+  // Several files are compiled in parallel with each other, and a single file
+  // is split up instead.
+  std::optional<TaskScheduler> scheduler;
+  if (jobs_ > 1 && input_files.size() == 1) {
+    scheduler.emplace(jobs_ - 1);
+  }
+  return RunOnFiles(
+      input_files, consumer,
+      [&](llvm::StringRef input_file_name, DiagnosticConsumer& file_consumer,
+          llvm::raw_ostream& output, llvm::raw_ostream& errors) {
+        llvm::SmallString<256> file_output_file = output_file;
+        if (file_output_file.empty()) {
+          file_output_file = input_file_name;
+          llvm::sys::path::replace_extension(
+              file_output_file,
+              last_stage == PipelineStage::Interface ? "api" : "o");
+        }
+        return CompileFile(input_file_name, last_stage, file_output_file,
+                           {.interfaces = imports_, .key = imports_key_},
+                           file_consumer, output, errors,
+                           scheduler ? &*scheduler : nullptr);
+      });
+}
+
+auto Driver::RunServeSubcommand(DiagnosticConsumer& /*consumer*/,
+                                llvm::ArrayRef<llvm::StringRef> args) -> bool {
+  if (args.empty()) {
+    error_stream_ << "ERROR: No socket path specified.\n";
+    return false;
+  }
+  llvm::StringRef socket_path = args.front();
   args = args.drop_front();
   if (!args.empty()) {
-    ReportExtraArgs("dump-tokens", args);
+    ReportExtraArgs("serve", args);
     return false;
   }
 
-  auto source = SourceBuffer::CreateFromFile(input_file_name);
-  if (!source) {
-    error_stream_ << "ERROR: Unable to open input source file: ";
-    llvm::handleAllErrors(source.takeError(),
-                          [&](const llvm::ErrorInfoBase& ei) {
-                            ei.log(error_stream_);
-                            error_stream_ << "\n";
-                          });
+  // Without a diagnostic cache of the caller's, the server keeps its own for
+  // as long as it runs.
+  DiagnosticCache server_diagnostic_cache;
+  DriverServer server(
+      *source_cache_,
+      diagnostic_cache_ ? *diagnostic_cache_ : server_diagnostic_cache,
+      error_stream_);
+  return server.Serve(socket_path);
+}
+
+auto Driver::RunLspSubcommand(DiagnosticConsumer& /*consumer*/,
+                              llvm::ArrayRef<llvm::StringRef> args) -> bool {
+  constexpr llvm::StringLiteral DelayFlag = "--diagnostics-delay=";
+  std::chrono::milliseconds delay = LanguageServer::DefaultDiagnosticsDelay;
+  if (!args.empty() && args.front().startswith(DelayFlag)) {
+    llvm::StringRef delay_text = args.front().drop_front(DelayFlag.size());
+    unsigned delay_ms = 0;
+    if (delay_text.getAsInteger(10, delay_ms)) {
+      error_stream_ << "ERROR: Invalid diagnostics delay '" << delay_text
+                    << "'.\n";
+      return false;
+    }
+    delay = std::chrono::milliseconds(delay_ms);
+    args = args.drop_front();
+  }
+  if (!args.empty()) {
+    ReportExtraArgs("lsp", args);
     return false;
   }
-  auto tokenized_source = TokenizedBuffer::Lex(*source, consumer);
-  consumer.Flush();
-  tokenized_source.Print(output_stream_);
-  return !tokenized_source.has_errors();
+
+  // Messages are read from standard input and written to the output stream.
+  LanguageServer server(output_stream_, error_stream_, delay);
+  return server.Serve(fileno(stdin));
 }
 
-auto Driver::RunDumpParseTreeSubcommand(DiagnosticConsumer& consumer,
-                                        llvm::ArrayRef<llvm::StringRef> args)
+auto Driver::RunFormatSubcommand(DiagnosticConsumer& consumer,
+                                 llvm::ArrayRef<llvm::StringRef> args)
     -> bool {
+  bool check = false;
+  if (!args.empty() && args.front() == "--check") {
+    check = true;
+    args = args.drop_front();
+  }
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<llvm::StringRef> input_files;
+  if (!ExpandInputFiles(args, saver, input_files)) {
+    return false;
+  }
+
+  // The artifact cache remembers each text that formatting wrote, or found
+  // already formatted, by an empty artifact keyed by the text.
+  std::string format_version = std::to_string(SourceFormatVersion);
+  auto make_formatted_key = [&](llvm::StringRef text) {
+    return ArtifactCache::MakeKey(
+        {COCKTAIL_VERSION, "format", format_version, text});
+  };
+  return RunOnFiles(
+      input_files, consumer,
+      [&](llvm::StringRef input_file, DiagnosticConsumer& file_consumer,
+          llvm::raw_ostream& /*output*/, llvm::raw_ostream& errors) {
+        auto source = ReadSource(input_file, file_consumer);
+        if (!source) {
+          file_consumer.Flush();
+          errors << "ERROR: Unable to open input source file: " << input_file
+                 << "\n";
+          return false;
+        }
+        if (artifact_cache_ != nullptr &&
+            artifact_cache_->Lookup(make_formatted_key(source->text()))) {
+          if (stats_ != nullptr) {
+            stats_->AddCount("files_skipped", 1);
+          }
+          return true;
+        }
+
+        TokenizedBuffer tokens = Lex(*source, file_consumer);
+        std::optional<ParseTree> tree;
+        if (!tokens.has_errors()) {
+          tree.emplace(Parse(*source, tokens, file_consumer));
+        }
+        file_consumer.Flush();
+        if (!tree || tree->has_errors()) {
+          errors << "ERROR: Not formatting " << input_file
+                 << ", which has errors.\n";
+          return false;
+        }
+        std::string formatted;
+        {
+          DriverStats::PhaseScope scope(stats_, "format");
+          llvm::raw_string_ostream formatted_stream(formatted);
+          FormatSource(*source, tokens, *tree, formatted_stream);
+        }
+
+        if (formatted == source->text()) {
+          if (stats_ != nullptr) {
+            stats_->AddCount("files_unchanged", 1);
+          }
+        } else if (check) {
+          errors << "ERROR: " << input_file << " isn't formatted.\n";
+          return false;
+        } else {
+          DriverStats::PhaseScope scope(stats_, "write");
+          if (!ReplaceFile(input_file, formatted, errors)) {
+            return false;
+          }
+          if (stats_ != nullptr) {
+            stats_->AddCount("files_formatted", 1);
+          }
+        }
+        if (artifact_cache_ != nullptr) {
+          artifact_cache_->Insert(make_formatted_key(formatted), "");
+        }
+        return true;
+      });
+}
+
+auto Driver::RunIndexSubcommand(DiagnosticConsumer& consumer,
+                                llvm::ArrayRef<llvm::StringRef> args) -> bool {
   if (args.empty()) {
-    error_stream_ << "ERROR: No input file specified.\n";
+    error_stream_ << "ERROR: No index file specified.\n";
+    return false;
+  }
+  llvm::StringRef index_file = args.front();
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver(allocator);
+  llvm::SmallVector<llvm::StringRef> input_files;
+  if (!ExpandInputFiles(args.drop_front(), saver, input_files)) {
     return false;
   }
 
-  llvm::StringRef input_file_name = args.front();
-  args = args.drop_front();
-  if (!args.empty()) {
-    ReportExtraArgs("dump-parse-tree", args);
+  // The index as it was, which stays mapped until the new one is written, as
+  // the entries of unchanged files are copied from it. One that can't be
+  // read is written again from scratch.
+  std::unique_ptr<llvm::MemoryBuffer> previous_buffer;
+  std::optional<SymbolIndex> previous;
+  llvm::StringMap<int32_t> previous_files;
+  if (auto buffer =
+          llvm::MemoryBuffer::getFile(index_file, /*IsText=*/false,
+                                      /*RequiresNullTerminator=*/false)) {
+    previous_buffer = std::move(*buffer);
+    previous = SymbolIndex::Open(previous_buffer->getBuffer());
+  }
+  if (previous) {
+    for (int32_t i = 0; i != previous->file_count(); ++i) {
+      previous_files.insert({previous->file_name(i), i});
+    }
+  }
+
+  // Files listed twice are indexed once.
+  SymbolIndex::Builder builder;
+  llvm::StringMap<int32_t> files;
+  llvm::SmallVector<llvm::StringRef> unique_files;
+  for (llvm::StringRef input_file : input_files) {
+    if (files.insert({input_file, static_cast<int32_t>(unique_files.size())})
+            .second) {
+      builder.AddFile(input_file);
+      unique_files.push_back(input_file);
+    }
+  }
+  // The file of the previous index that each file keeps the entries of, if
+  // its text is the same, which are copied once every file is done.
+  llvm::SmallVector<int32_t> copied_from(unique_files.size(), -1);
+  bool success = RunOnFiles(
+      unique_files, consumer,
+      [&](llvm::StringRef input_file, DiagnosticConsumer& file_consumer,
+          llvm::raw_ostream& /*output*/, llvm::raw_ostream& errors) {
+        auto source = ReadSource(input_file, file_consumer);
+        if (!source) {
+          file_consumer.Flush();
+          errors << "ERROR: Unable to open input source file: " << input_file
+                 << "\n";
+          return false;
+        }
+        int32_t file = files.lookup(input_file);
+        uint64_t source_hash = llvm::xxHash64(source->text());
+        auto previous_file = previous_files.find(input_file);
+        if (previous_file != previous_files.end() &&
+            previous->source_hash(previous_file->second) == source_hash) {
+          copied_from[file] = previous_file->second;
+          if (stats_ != nullptr) {
+            stats_->AddCount("files_reused", 1);
+          }
+          return true;
+        }
+        // Lexing errors aren't reported, and the identifiers of a file with
+        // some are indexed all the same.
+        TokenizedBuffer tokens = Lex(*source, NullDiagnosticConsumer());
+        builder.SetFile(file, source_hash, tokens);
+        if (stats_ != nullptr) {
+          stats_->AddCount("files_indexed", 1);
+        }
+        return true;
+      });
+  for (int32_t file = 0; file != static_cast<int32_t>(copied_from.size());
+       ++file) {
+    if (copied_from[file] >= 0) {
+      builder.CopyFile(file, *previous, copied_from[file]);
+    }
+  }
+
+  // The index is written to a file of its own and renamed over the old one,
+  // which is still mapped while it's written. Files that couldn't be read
+  // have no entries, and are indexed again next time.
+  DriverStats::PhaseScope scope(stats_, "write");
+  llvm::SmallString<256> temporary_path;
+  int fd = -1;
+  if (llvm::sys::fs::createUniqueFile(index_file + "-%%%%%%%%.tmp", fd,
+                                      temporary_path)) {
+    error_stream_ << "ERROR: Unable to write index file: " << index_file
+                  << "\n";
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    builder.Write(out);
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(temporary_path);
+      error_stream_ << "ERROR: Unable to write index file: " << index_file
+                    << "\n";
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(temporary_path, index_file)) {
+    llvm::sys::fs::remove(temporary_path);
+    error_stream_ << "ERROR: Unable to write index file: " << index_file
+                  << "\n";
+    return false;
+  }
+  return success;
+}
+
+auto Driver::RunLookupSubcommand(DiagnosticConsumer& /*consumer*/,
+                                 llvm::ArrayRef<llvm::StringRef> args)
+    -> bool {
+  if (args.empty()) {
+    error_stream_ << "ERROR: No index file specified.\n";
+    return false;
+  }
+  if (args.size() == 1) {
+    error_stream_ << "ERROR: No identifier specified.\n";
+    return false;
+  }
+  llvm::StringRef index_file = args.front();
+  // The index is mapped, so only the pages a lookup touches are read.
+  auto buffer =
+      llvm::MemoryBuffer::getFile(index_file, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    error_stream_ << "ERROR: Unable to read index file: " << index_file
+                  << "\n";
+    return false;
+  }
+  std::optional<SymbolIndex> index = SymbolIndex::Open((*buffer)->getBuffer());
+  if (!index) {
+    error_stream_ << "ERROR: Invalid index file: " << index_file << "\n";
     return false;
   }
 
-  auto source = SourceBuffer::CreateFromFile(input_file_name);
+  DriverStats::PhaseScope scope(stats_, "lookup");
+  for (llvm::StringRef identifier : args.drop_front()) {
+    for (const SymbolIndex::Occurrence& occurrence :
+         index->Lookup(identifier)) {
+      output_stream_ << index->file_name(occurrence.file) << ":"
+                     << occurrence.line << ":" << occurrence.column << ": "
+                     << identifier << "\n";
+    }
+  }
+  return true;
+}
+
+auto Driver::RunBenchSubcommand(DiagnosticConsumer& consumer,
+                                llvm::ArrayRef<llvm::StringRef> args)
+    -> bool {
+  constexpr llvm::StringLiteral StageFlag = "--stage=";
+  constexpr llvm::StringLiteral RunsFlag = "--runs=";
+  constexpr llvm::StringLiteral WarmupFlag = "--warmup=";
+  llvm::StringRef stage_name = "lex";
+  int runs = 20;
+  int warmup = 3;
+  while (!args.empty()) {
+    llvm::StringRef arg = args.front();
+    if (arg.consume_front(StageFlag)) {
+      stage_name = arg;
+    } else if (arg.consume_front(RunsFlag)) {
+      if (arg.getAsInteger(10, runs) || runs < 1) {
+        error_stream_ << "ERROR: Invalid number of runs '" << arg << "'.\n";
+        return false;
+      }
+    } else if (arg.consume_front(WarmupFlag)) {
+      if (arg.getAsInteger(10, warmup) || warmup < 0) {
+        error_stream_ << "ERROR: Invalid number of warmup runs '" << arg
+                      << "'.\n";
+        return false;
+      }
+    } else {
+      break;
+    }
+    args = args.drop_front();
+  }
+  enum class BenchStage { Read, Lex, Parse, Verify, Semantics, Lower };
+  std::optional<BenchStage> stage =
+      llvm::StringSwitch<std::optional<BenchStage>>(stage_name)
+          .Case("read", BenchStage::Read)
+          .Case("lex", BenchStage::Lex)
+          .Case("parse", BenchStage::Parse)
+          .Case("verify", BenchStage::Verify)
+          .Case("semantics", BenchStage::Semantics)
+          .Case("lower", BenchStage::Lower)
+          .Default(std::nullopt);
+  if (!stage) {
+    error_stream_ << "ERROR: Unknown stage '" << stage_name << "'.\n";
+    return false;
+  }
+  if (args.empty()) {
+    error_stream_ << "ERROR: No input file specified.\n";
+    return false;
+  }
+  if (args.size() > 1) {
+    ReportExtraArgs("bench", args.drop_front());
+    return false;
+  }
+  llvm::StringRef input_file = args.front();
+
+  // The stages before the one measured run once, reporting their
+  // diagnostics, and the stages after it don't run at all.
+  std::shared_ptr<SourceBuffer> source = ReadSource(input_file, consumer);
   if (!source) {
-    error_stream_ << "ERROR: Unable to open input source file: ";
-    llvm::handleAllErrors(source.takeError(),
-                          [&](const llvm::ErrorInfoBase& ei) {
-                            ei.log(error_stream_);
-                            error_stream_ << "\n";
-                          });
+    consumer.Flush();
+    error_stream_ << "ERROR: Unable to open input source file: " << input_file
+                  << "\n";
     return false;
   }
-  auto tokenized_source = TokenizedBuffer::Lex(*source, consumer);
-  auto parse_tree = ParseTree::Parse(tokenized_source, consumer);
+  std::optional<TokenizedBuffer> tokens;
+  if (*stage > BenchStage::Lex) {
+    tokens.emplace(Lex(*source, consumer));
+  }
+  std::optional<ParseTree> parse_tree;
+  if (*stage > BenchStage::Parse) {
+    parse_tree.emplace(Parse(*source, *tokens, consumer));
+  }
+  std::optional<SemanticsIR> semantics_ir;
+  if (*stage > BenchStage::Semantics && !parse_tree->has_errors()) {
+    semantics_ir.emplace(SemanticsIRFactory::Build(
+        *tokens, *parse_tree, consumer, /*scheduler=*/nullptr, imports_));
+  }
   consumer.Flush();
-  parse_tree.Print(output_stream_);
-  return !tokenized_source.has_errors() && !parse_tree.has_errors();
+  // Semantics and lowering only run on what checked cleanly, as they do when
+  // compiling.
+  if ((*stage >= BenchStage::Semantics &&
+       (tokens->has_errors() || parse_tree->has_errors())) ||
+      (semantics_ir && semantics_ir->has_errors())) {
+    error_stream_ << "ERROR: Unable to benchmark " << stage_name << " on "
+                  << input_file << ", which has errors.\n";
+    return false;
+  }
+
+  // Each run's result is destroyed after its time and allocations are taken,
+  // so that only building it is measured. The runs' diagnostics are dropped.
+  llvm::SmallVector<double> run_ms;
+  AllocationCount allocated;
+  auto measure = [&](auto run) {
+    for (int i = 0; i != warmup + runs; ++i) {
+      AllocationCount before = GetThreadAllocationCount();
+      auto start = std::chrono::steady_clock::now();
+      [[maybe_unused]] auto result = run();
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      AllocationCount after = GetThreadAllocationCount();
+      if (i >= warmup) {
+        run_ms.push_back(elapsed.count());
+        allocated.allocations += after.allocations - before.allocations;
+        allocated.bytes += after.bytes - before.bytes;
+      }
+    }
+  };
+  DiagnosticConsumer& null_consumer = NullDiagnosticConsumer();
+  switch (*stage) {
+    case BenchStage::Read: {
+      auto fs = llvm::vfs::getRealFileSystem();
+      measure([&] {
+        return SourceBuffer::CreateFromFile(*fs, input_file, null_consumer);
+      });
+      break;
+    }
+    case BenchStage::Lex:
+      measure([&] { return TokenizedBuffer::Lex(*source, null_consumer); });
+      break;
+    case BenchStage::Parse:
+      measure([&] { return ParseTree::Parse(*tokens, null_consumer); });
+      break;
+    case BenchStage::Verify:
+      measure([&] { return parse_tree->Verify(); });
+      break;
+    case BenchStage::Semantics:
+      measure([&] {
+        return SemanticsIRFactory::Build(*tokens, *parse_tree, null_consumer,
+                                         /*scheduler=*/nullptr, imports_);
+      });
+      break;
+    case BenchStage::Lower:
+      // The module is destroyed before its context, as the pair's members
+      // are destroyed last to first.
+      measure([&] {
+        auto llvm_context = std::make_unique<llvm::LLVMContext>();
+        auto module = LowerToLLVM(*llvm_context, input_file, *semantics_ir);
+        return std::make_pair(std::move(llvm_context), std::move(module));
+      });
+      break;
+  }
+
+  llvm::sort(run_ms);
+  double median_ms = run_ms[run_ms.size() / 2];
+  // The smallest time that at least 99% of the runs took no longer than.
+  double p99_ms = run_ms[(run_ms.size() * 99 + 99) / 100 - 1];
+  constexpr int NameWidth = 14;
+  auto print = [&](llvm::StringRef name) -> llvm::raw_ostream& {
+    return output_stream_ << llvm::left_justify(name, NameWidth) << "  ";
+  };
+  print("file") << input_file << "\n";
+  print("stage") << stage_name << "\n";
+  print("runs") << runs << "\n";
+  print("warmup") << warmup << "\n";
+  print("median_ms") << llvm::format("%.3f", median_ms) << "\n";
+  print("p99_ms") << llvm::format("%.3f", p99_ms) << "\n";
+  print("mb_per_s") << llvm::format(
+                           "%.1f", source->text().size() / (median_ms * 1000))
+                    << "\n";
+  print("allocs_per_run") << allocated.allocations / runs << "\n";
+  print("bytes_per_run") << allocated.bytes / runs << "\n";
+  if (std::optional<int64_t> peak_rss =
+          DriverStats::GetPeakResidentSetSize()) {
+    print("peak_rss_bytes") << *peak_rss << "\n";
+  }
+  return true;
 }
 
 auto Driver::ReportExtraArgs(llvm::StringRef subcommand_text,
@@ -173,4 +1569,1055 @@ auto Driver::ReportExtraArgs(llvm::StringRef subcommand_text,
   error_stream_ << "\n";
 }
 
+auto Driver::ExpandInputFiles(llvm::ArrayRef<llvm::StringRef> args,
+                              llvm::StringSaver& saver,
+                              llvm::SmallVectorImpl<llvm::StringRef>& files)
+    -> bool {
+  for (llvm::StringRef arg : args) {
+    if (!arg.consume_front("@")) {
+      files.push_back(arg);
+      continue;
+    }
+    auto response_file = llvm::MemoryBuffer::getFile(arg);
+    if (!response_file) {
+      error_stream_ << "ERROR: Unable to read response file: " << arg << "\n";
+      return false;
+    }
+    llvm::SmallVector<llvm::StringRef> names;
+    llvm::SplitString((*response_file)->getBuffer(), names);
+    for (llvm::StringRef name : names) {
+      files.push_back(saver.save(name));
+    }
+  }
+  if (files.empty()) {
+    error_stream_ << "ERROR: No input file specified.\n";
+    return false;
+  }
+  return true;
+}
+
+auto Driver::RunOnFiles(llvm::ArrayRef<llvm::StringRef> input_files,
+                        DiagnosticConsumer& consumer, RunFileFn run_file)
+    -> bool {
+  bool success = true;
+  if (jobs_ == 1 || input_files.size() == 1) {
+    for (llvm::StringRef input_file : input_files) {
+      success &= run_file(input_file, consumer, output_stream_, error_stream_);
+      // Once the error limit is reached, the remaining files are skipped.
+      if (consumer.ShouldStop()) {
+        return false;
+      }
+    }
+    return success;
+  }
+
+  std::vector<FileResult> results(input_files.size());
+  // This thread runs files as well while it waits, so it makes up the jobs.
+  TaskScheduler scheduler(jobs_ - 1);
+  TaskGroup group(scheduler);
+  for (int i = 0; i != static_cast<int>(input_files.size()); ++i) {
+    group.Run([&, i] {
+      FileResult& result = results[i];
+      DiagnosticCache::Recorder recorder(NullDiagnosticConsumer());
+      llvm::raw_string_ostream output(result.output);
+      llvm::raw_string_ostream errors(result.errors);
+      result.success = run_file(input_files[i], recorder, output, errors);
+      output.flush();
+      errors.flush();
+      result.diagnostics = recorder.Take("");
+      result.done.store(true, std::memory_order_release);
+    });
+  }
+  return WriteFileResults(group, results, consumer);
+}
+
+auto Driver::UseLexParsePipeline(llvm::ArrayRef<llvm::StringRef> input_files)
+    -> bool {
+  return input_files.size() > 1 &&
+         (jobs_ > 1 || lex_jobs_ != 0 || parse_jobs_ != 0);
+}
+
+auto Driver::RunLexParsePipeline(llvm::ArrayRef<llvm::StringRef> input_files,
+                                 DiagnosticConsumer& consumer,
+                                 ParseFileFn parse_file) -> bool {
+  // Without stage counts of their own, the stages split the jobs between
+  // them, with at least one thread each.
+  int lex_jobs = lex_jobs_ != 0 ? lex_jobs_ : std::max(1, jobs_ / 2);
+  int parse_jobs =
+      parse_jobs_ != 0 ? parse_jobs_ : std::max(1, jobs_ - lex_jobs);
+  // Bounds the files that have been lexed but not yet parsed, and so the
+  // memory held by their tokens, while keeping every parse thread fed. With
+  // `--low-memory`, no more are held than can be parsed at once.
+  const int max_lexed_files = low_memory_ ? parse_jobs : 2 * parse_jobs;
+
+  struct PipelineFile {
+    std::unique_ptr<DiagnosticCache::Recorder> recorder;
+    std::shared_ptr<SourceBuffer> source;
+    std::optional<TokenizedBuffer> tokens;
+  };
+  std::vector<FileResult> results(input_files.size());
+  std::vector<PipelineFile> files(input_files.size());
+
+  // Both stages run on one scheduler: `lex_jobs` tasks each lex one file
+  // after another, and each lexed file is parsed by a task of its own. This
+  // thread runs tasks as well while it waits, so it makes up the jobs.
+  TaskScheduler scheduler(lex_jobs + parse_jobs - 1);
+  TaskGroup group(scheduler);
+  std::mutex mutex;
+  int lexed_files = 0;
+  std::atomic<int> next_file = 0;
+  auto finish = [&](int i) {
+    // The tokens and source are released as soon as the file is done with,
+    // rather than with the rest.
+    results[i].diagnostics = files[i].recorder->Take("");
+    files[i].tokens.reset();
+    files[i].source.reset();
+    files[i].recorder.reset();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --lexed_files;
+    }
+    results[i].done.store(true, std::memory_order_release);
+    scheduler.WakeWaiters();
+  };
+  auto parse = [&](int i) {
+    PipelineFile& file = files[i];
+    llvm::raw_string_ostream output(results[i].output);
+    results[i].success =
+        parse_file(*file.source, *file.tokens, *file.recorder, output);
+    output.flush();
+    finish(i);
+  };
+  auto lex = [&](int i) {
+    PipelineFile& file = files[i];
+    file.recorder =
+        std::make_unique<DiagnosticCache::Recorder>(NullDiagnosticConsumer());
+    file.source = ReadSource(input_files[i], *file.recorder);
+    if (!file.source) {
+      llvm::raw_string_ostream errors(results[i].errors);
+      errors << "ERROR: Unable to open input source file: " << input_files[i]
+             << "\n";
+      errors.flush();
+      results[i].success = false;
+      finish(i);
+      return;
+    }
+    file.tokens.emplace(Lex(*file.source, *file.recorder));
+    group.Run([&, i] { parse(i); });
+  };
+
+  for (int lexer = 0; lexer != lex_jobs; ++lexer) {
+    group.Run([&] {
+      while (!group.cancelled()) {
+        int i = next_file.fetch_add(1, std::memory_order_relaxed);
+        if (i >= static_cast<int>(input_files.size())) {
+          return;
+        }
+        // While the backlog is full, the lexer parses files instead.
+        while (true) {
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (lexed_files < max_lexed_files) {
+              ++lexed_files;
+              break;
+            }
+          }
+          scheduler.HelpWhile([&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            return lexed_files >= max_lexed_files && !group.cancelled();
+          });
+          if (group.cancelled()) {
+            return;
+          }
+        }
+        lex(i);
+      }
+    });
+  }
+  bool success = WriteFileResults(group, results, consumer);
+  // The tasks use the state above, so they must finish before it's gone.
+  group.Wait();
+  return success;
+}
+
+auto Driver::WriteFileResults(TaskGroup& group,
+                              llvm::MutableArrayRef<FileResult> results,
+                              DiagnosticConsumer& consumer) -> bool {
+  bool success = true;
+  for (FileResult& result : results) {
+    group.scheduler().HelpWhile(
+        [&] { return !result.done.load(std::memory_order_acquire); });
+    result.diagnostics->Replay(consumer);
+    consumer.Flush();
+    error_stream_ << result.errors;
+    output_stream_ << result.output;
+    success &= result.success;
+    // Once the error limit is reached, the files that haven't started are
+    // skipped, and those already done aren't written.
+    if (consumer.ShouldStop()) {
+      group.Cancel();
+      return false;
+    }
+  }
+  return success;
+}
+
+auto Driver::CompileFile(llvm::StringRef input_file, PipelineStage last_stage,
+                         llvm::StringRef output_file, const Imports& imports,
+                         DiagnosticConsumer& file_consumer,
+                         llvm::raw_ostream& output, llvm::raw_ostream& errors,
+                         TaskScheduler* scheduler,
+                         llvm::StringRef interface_file) -> bool {
+  // Each of these refers into those declared before it, and so is destroyed
+  // before them.
+  CompilationContext context;
+  std::shared_ptr<SourceBuffer> source = ReadSource(input_file, file_consumer);
+  if (!source) {
+    file_consumer.Flush();
+    errors << "ERROR: Unable to open input source file: " << input_file
+           << "\n";
+    return false;
+  }
+
+  // A file's interface only depends on its text and the interfaces it
+  // imports, so while neither changes, the interface cached for them is
+  // written, and the diagnostics of checking the file replayed, without
+  // checking it again. The diagnostics of every stage are recorded, and a
+  // file with errors caches no interface.
+  std::optional<DiagnosticCache::Recorder> interface_recorder;
+  if (last_stage == PipelineStage::Interface &&
+      (diagnostic_cache_ != nullptr || artifact_cache_ != nullptr)) {
+    if (auto entry = LookupCached(DiagnosticCache::Stage::Semantics, *source,
+                                  imports.key)) {
+      entry->Replay(file_consumer);
+      file_consumer.Flush();
+      if (stats_ != nullptr) {
+        stats_->AddCount("sem_cache_hits", 1);
+      }
+      return !entry->data().empty() &&
+             WriteInterfaceFile(output_file, entry->data(), errors);
+    }
+    interface_recorder.emplace(file_consumer);
+  }
+  DiagnosticConsumer& consumer =
+      interface_recorder ? *interface_recorder : file_consumer;
+  auto store_interface = [&](std::string interface) {
+    if (interface_recorder) {
+      StoreCached(DiagnosticCache::Stage::Semantics, *source,
+                  interface_recorder->Take(std::move(interface)), imports.key);
+    }
+  };
+
+  std::optional<TokenizedBuffer> tokens(Lex(*source, consumer, &context));
+  std::optional<ParseTree> parse_tree(Parse(*source, *tokens, consumer));
+  consumer.Flush();
+  // Semantics only runs on trees that parsed cleanly.
+  if (tokens->has_errors() || parse_tree->has_errors()) {
+    store_interface("");
+    return false;
+  }
+  // Without an interface to write, semantics is left to the worker too.
+  if (last_stage == PipelineStage::Object && interface_file.empty()) {
+    if (auto result = CompileOnWorker(*source, *tokens, *parse_tree, imports,
+                                      output_file, errors)) {
+      return *result;
+    }
+  }
+
+  std::optional<SemanticsIR> semantics_ir;
+  {
+    DriverStats::PhaseScope scope(stats_, "semantics");
+    semantics_ir.emplace(
+        SemanticsIRFactory::Build(*tokens, *parse_tree, consumer, scheduler,
+                                  imports.interfaces, &context));
+  }
+  consumer.Flush();
+  if (stats_ != nullptr) {
+    stats_->AddCount("functions", semantics_ir->functions().size());
+    stats_->AddCount("insts", semantics_ir->insts().size());
+    stats_->AddCount("types", semantics_ir->types().size());
+    stats_->AddCount("constants", semantics_ir->integer_constants().size());
+    stats_->AddCount("strings", semantics_ir->string_constants().size());
+    stats_->AddCount("ir_bytes", semantics_ir->memory_bytes());
+    stats_->AddCount("arena_bytes", context.arena_bytes());
+  }
+  if (semantics_ir->has_errors()) {
+    store_interface("");
+    return false;
+  }
+  if (last_stage == PipelineStage::Interface) {
+    interface_file = output_file;
+  }
+  if (!interface_file.empty()) {
+    std::string interface;
+    llvm::raw_string_ostream interface_stream(interface);
+    SemanticsInterface::Serialize(*semantics_ir, interface_stream);
+    interface_stream.flush();
+    store_interface(interface);
+    if (!WriteInterfaceFile(interface_file, interface, errors)) {
+      return false;
+    }
+    if (last_stage == PipelineStage::Interface) {
+      return true;
+    }
+    if (last_stage == PipelineStage::Object) {
+      if (auto result = CompileOnWorker(*source, *tokens, *parse_tree,
+                                        imports, output_file, errors)) {
+        return *result;
+      }
+    }
+  }
+  // Semantics is the last stage to read literal values. Lowering still reads
+  // the tree and the tokens' text.
+  ReleaseLiteralValues(*tokens);
+  if (last_stage == PipelineStage::SemanticsIR) {
+    DriverStats::PhaseScope scope(stats_, "print");
+    semantics_ir->Print(output);
+    return true;
+  }
+
+  // The functions that no entry point can call are left out of the modules.
+  std::optional<llvm::BitVector> reachable;
+  if (!entry_points_.empty() || last_stage == PipelineStage::Run) {
+    llvm::SmallVector<llvm::StringRef> roots(entry_points_.begin(),
+                                             entry_points_.end());
+    roots.push_back("main");
+    reachable = semantics_ir->FindReachableFunctions(roots);
+    if (stats_ != nullptr) {
+      stats_->AddCount("unreachable_functions",
+                       reachable->size() - reachable->count());
+    }
+  }
+  const llvm::BitVector* lowered = reachable ? &*reachable : nullptr;
+
+  // Runs `function` on each shard, on the scheduler's threads if there is
+  // one.
+  auto for_each_shard = [&](llvm::function_ref<void(int shard)> function) {
+    if (scheduler == nullptr) {
+      for (int i = 0; i != codegen_shards_; ++i) {
+        function(i);
+      }
+    } else {
+      ParallelFor(*scheduler, codegen_shards_, function);
+    }
+  };
+
+  // Each shard is lowered into a context of its own, so that shards can be
+  // optimized and codegenned at the same time. With one, there's no need to
+  // link it back into `llvm_context`, which is kept on the heap so that the
+  // JIT can take it over.
+  auto llvm_context = std::make_unique<llvm::LLVMContext>();
+  llvm::SmallVector<std::unique_ptr<llvm::LLVMContext>, 0> shard_contexts;
+  llvm::SmallVector<std::unique_ptr<llvm::Module>, 0> shards;
+  {
+    DriverStats::PhaseScope scope(stats_, "lower");
+    if (codegen_shards_ == 1) {
+      shards.push_back(
+          LowerToLLVM(*llvm_context, input_file, *semantics_ir, lowered));
+    } else {
+      shard_contexts.resize(codegen_shards_);
+      shards.resize(codegen_shards_);
+      for_each_shard([&](int shard) {
+        shard_contexts[shard] = std::make_unique<llvm::LLVMContext>();
+        shards[shard] =
+            LowerToLLVMShard(*shard_contexts[shard], input_file,
+                             *semantics_ir, shard, codegen_shards_, lowered);
+      });
+    }
+  }
+  // The modules have copies of everything they need from the earlier stages.
+  if (low_memory_) {
+    int64_t released = tokens->memory_bytes() +
+                       parse_tree->node_storage_bytes() +
+                       semantics_ir->memory_bytes();
+    semantics_ir.reset();
+    parse_tree.reset();
+    tokens.reset();
+    source.reset();
+    if (stats_ != nullptr) {
+      stats_->AddCount("released_bytes", released);
+    }
+  }
+  if (last_stage == PipelineStage::LLVM || last_stage == PipelineStage::Run) {
+    // Each shard is optimized before they're linked, as it would be before
+    // codegen, so functions are only inlined within their shard. The IR is
+    // for no target in particular.
+    for_each_shard([&](int shard) { OptimizeModule(*shards[shard], nullptr); });
+    std::unique_ptr<llvm::Module> module =
+        codegen_shards_ == 1
+            ? std::move(shards.front())
+            : LinkLLVMShards(*llvm_context, input_file, shards);
+    if (last_stage == PipelineStage::Run) {
+      return RunProgram(llvm::orc::ThreadSafeModule(std::move(module),
+                                                    std::move(llvm_context)),
+                        errors);
+    }
+    DriverStats::PhaseScope scope(stats_, "print");
+    module->print(output, /*AAW=*/nullptr);
+    return true;
+  }
+
+  InitializeNativeTarget();
+  // Each shard is split into `codegen_threads_` objects. With more than one
+  // object in all, each is named by inserting its index before the
+  // extension, as in `file.0.o`, counting the objects of each shard in turn.
+  // Errors are buffered, so that they're written in order.
+  int num_objects = codegen_shards_ * codegen_threads_;
+  llvm::SmallVector<std::string, 0> shard_errors(codegen_shards_);
+  llvm::SmallVector<char, 0> shard_succeeded(codegen_shards_);
+  for_each_shard([&](int shard) {
+    llvm::raw_string_ostream shard_errors_stream(shard_errors[shard]);
+    std::unique_ptr<llvm::TargetMachine> target_machine =
+        CreateTargetMachine(optimization_level_, shard_errors_stream);
+    if (!target_machine) {
+      shard_succeeded[shard] = false;
+      return;
+    }
+    llvm::Module& module = *shards[shard];
+    module.setTargetTriple(target_machine->getTargetTriple().str());
+    module.setDataLayout(target_machine->createDataLayout());
+    OptimizeModule(module, target_machine.get());
+    llvm::SmallVector<llvm::SmallVector<char, 0>, 1> objects(
+        codegen_threads_);
+    {
+      DriverStats::PhaseScope scope(stats_, "codegen");
+      if (!EmitObjects(module, *target_machine, objects,
+                       shard_errors_stream)) {
+        shard_succeeded[shard] = false;
+        return;
+      }
+    }
+    DriverStats::PhaseScope scope(stats_, "write");
+    bool written = true;
+    for (int i = 0; i != codegen_threads_; ++i) {
+      written &= WriteObjectFile(
+          GetObjectFileName(output_file, shard * codegen_threads_ + i,
+                            num_objects),
+          objects[i], shard_errors_stream);
+    }
+    shard_succeeded[shard] = written;
+  });
+  for (const std::string& shard_error : shard_errors) {
+    errors << shard_error;
+  }
+  return llvm::all_of(shard_succeeded, [](char success) { return success; });
+}
+
+auto Driver::GetObjectFileName(llvm::StringRef output_file, int index,
+                               int count) -> llvm::SmallString<256> {
+  llvm::SmallString<256> file = output_file;
+  if (count != 1) {
+    llvm::sys::path::replace_extension(
+        file, llvm::Twine(index) + llvm::sys::path::extension(output_file));
+  }
+  return file;
+}
+
+auto Driver::CompileOnWorker(SourceBuffer& source, TokenizedBuffer& tokens,
+                             ParseTree& parse_tree, const Imports& imports,
+                             llvm::StringRef output_file,
+                             llvm::raw_ostream& errors)
+    -> std::optional<bool> {
+  if (workers_ == nullptr) {
+    return std::nullopt;
+  }
+  std::string target_triple = llvm::sys::getDefaultTargetTriple();
+  std::string level = std::to_string(static_cast<int>(optimization_level_));
+  std::string shards = std::to_string(codegen_shards_);
+  std::string threads = std::to_string(codegen_threads_);
+  llvm::SmallVector<llvm::StringRef> key_parts = {
+      COCKTAIL_VERSION, "objects",   target_triple, source.filename(),
+      source.text(),    imports.key, level,         shards,
+      threads};
+  key_parts.append(entry_points_.begin(), entry_points_.end());
+  std::string key = ArtifactCache::MakeKey(key_parts);
+
+  // The objects only depend on what the job would carry, so they're looked
+  // up before anything is sent. Only successful results are cached, along
+  // with their warnings.
+  std::optional<CompileJobResult> result;
+  if (artifact_cache_ != nullptr) {
+    if (auto artifact = artifact_cache_->Lookup(key)) {
+      result = DecodeCompileJobResult(artifact->data());
+    }
+  }
+  if (result) {
+    if (stats_ != nullptr) {
+      stats_->AddCount("object_cache_hits", 1);
+    }
+  } else {
+    CompileJob job;
+    job.target_triple = target_triple;
+    job.file_name = source.filename();
+    job.source_text = source.text();
+    std::string tokens_data;
+    llvm::raw_string_ostream tokens_stream(tokens_data);
+    tokens.Serialize(tokens_stream);
+    tokens_stream.flush();
+    job.tokens = tokens_data;
+    std::string tree_data;
+    llvm::raw_string_ostream tree_stream(tree_data);
+    parse_tree.Serialize(tree_stream);
+    tree_stream.flush();
+    job.parse_tree = tree_data;
+    for (const SemanticsInterface& interface : imports.interfaces) {
+      job.interfaces.push_back(interface.data());
+    }
+    job.entry_points.assign(entry_points_.begin(), entry_points_.end());
+    job.optimization_level = optimization_level_;
+    job.codegen_shards = codegen_shards_;
+    job.codegen_threads = codegen_threads_;
+    {
+      DriverStats::PhaseScope scope(stats_, "remote");
+      result = workers_->Run(job);
+    }
+    if (!result) {
+      return std::nullopt;
+    }
+    if (stats_ != nullptr) {
+      stats_->AddCount("remote_jobs", 1);
+    }
+    if (result->success && artifact_cache_ != nullptr) {
+      artifact_cache_->Insert(key, EncodeCompileJobResult(*result));
+    }
+  }
+
+  errors << result->errors;
+  if (!result->success) {
+    return false;
+  }
+  int num_objects = codegen_shards_ * codegen_threads_;
+  if (static_cast<int>(result->objects.size()) != num_objects) {
+    errors << "ERROR: Expected " << num_objects << " objects for "
+           << source.filename() << " from a worker, got "
+           << result->objects.size() << ".\n";
+    return false;
+  }
+  DriverStats::PhaseScope scope(stats_, "write");
+  bool written = true;
+  for (int i = 0; i != num_objects; ++i) {
+    const std::string& object = result->objects[i];
+    written &= WriteObjectFile(GetObjectFileName(output_file, i, num_objects),
+                               llvm::ArrayRef<char>(object.data(),
+                                                    object.size()),
+                               errors);
+  }
+  return written;
+}
+
+auto Driver::RunCompileJob(const CompileJob& job) -> CompileJobResult {
+  std::string errors_text;
+  llvm::raw_string_ostream errors(errors_text);
+  llvm::SmallVector<std::string, 1> objects;
+  auto finish = [&](bool success) {
+    errors.flush();
+    return CompileJobResult{.success = success,
+                            .objects = std::move(objects),
+                            .errors = std::move(errors_text)};
+  };
+  std::string target_triple = llvm::sys::getDefaultTargetTriple();
+  if (job.target_triple != target_triple) {
+    errors << "ERROR: Unable to compile for " << job.target_triple
+           << " on a worker for " << target_triple << ".\n";
+    return finish(false);
+  }
+
+  // The file is read from memory, and its tokens and tree are found in a
+  // diagnostic cache of the job's own, as though they'd been cached here.
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(job.file_name, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer(
+                 job.source_text, job.file_name,
+                 /*RequiresNullTerminator=*/false));
+  SourceBufferCache source_cache(fs);
+  DiagnosticCache diagnostic_cache;
+  StreamDiagnosticConsumer consumer(errors);
+  std::shared_ptr<SourceBuffer> source =
+      source_cache.Get(job.file_name, consumer);
+  if (!source) {
+    return finish(false);
+  }
+  for (auto [stage, data] :
+       {std::pair{DiagnosticCache::Stage::Lex, job.tokens},
+        std::pair{DiagnosticCache::Stage::Parse, job.parse_tree}}) {
+    DiagnosticCache::Recorder recorder(NullDiagnosticConsumer());
+    diagnostic_cache.Insert(stage, source->filename(),
+                            GetContentHash(stage, *source, ""),
+                            recorder.Take(data.str()));
+  }
+  llvm::SmallVector<SemanticsInterface> interfaces;
+  for (llvm::StringRef data : job.interfaces) {
+    llvm::Optional<SemanticsInterface> interface =
+        SemanticsInterface::Deserialize(data);
+    if (!interface) {
+      errors << "ERROR: Invalid interface imported by " << job.file_name
+             << ".\n";
+      return finish(false);
+    }
+    interfaces.push_back(*interface);
+  }
+  std::string imports_key = MakeImportsKey(interfaces);
+
+  // The objects are written to a directory of the job's own, then read back.
+  llvm::SmallString<256> directory;
+  if (llvm::sys::fs::createUniqueDirectory("cocktail-job", directory)) {
+    errors << "ERROR: Unable to create a directory for the objects of "
+           << job.file_name << ".\n";
+    return finish(false);
+  }
+  llvm::SmallString<256> output_file = directory;
+  llvm::sys::path::append(output_file, "job.o");
+
+  SourceBufferCache* caller_source_cache = source_cache_;
+  DiagnosticCache* caller_diagnostic_cache = diagnostic_cache_;
+  source_cache_ = &source_cache;
+  diagnostic_cache_ = &diagnostic_cache;
+  optimization_level_ = job.optimization_level;
+  codegen_shards_ = job.codegen_shards;
+  codegen_threads_ = job.codegen_threads;
+  entry_points_ = job.entry_points;
+  std::optional<TaskScheduler> scheduler;
+  if (codegen_shards_ > 1) {
+    scheduler.emplace(codegen_shards_ - 1);
+  }
+  std::string output;
+  llvm::raw_string_ostream output_stream(output);
+  bool success =
+      CompileFile(job.file_name, PipelineStage::Object, output_file,
+                  {.interfaces = interfaces, .key = imports_key}, consumer,
+                  output_stream, errors, scheduler ? &*scheduler : nullptr);
+  int num_objects = codegen_shards_ * codegen_threads_;
+  source_cache_ = caller_source_cache;
+  diagnostic_cache_ = caller_diagnostic_cache;
+  optimization_level_ = OptimizationLevel::O0;
+  codegen_shards_ = 1;
+  codegen_threads_ = 1;
+  entry_points_ = {};
+
+  for (int i = 0; success && i != num_objects; ++i) {
+    auto buffer = llvm::MemoryBuffer::getFile(
+        GetObjectFileName(output_file, i, num_objects), /*IsText=*/false,
+        /*RequiresNullTerminator=*/false);
+    if (!buffer) {
+      errors << "ERROR: Unable to read back an object of " << job.file_name
+             << ".\n";
+      success = false;
+      break;
+    }
+    objects.push_back((*buffer)->getBuffer().str());
+  }
+  llvm::sys::fs::remove_directories(directory);
+  return finish(success);
+}
+
+auto Driver::RunProgram(llvm::orc::ThreadSafeModule program,
+                        llvm::raw_ostream& errors) -> bool {
+  // The JIT isn't running yet, so nothing else uses the module.
+  llvm::Module* module = program.getModuleUnlocked();
+  std::string source_file_name = module->getSourceFileName();
+  llvm::Function* main = module->getFunction("main");
+  if (main == nullptr || main->isDeclaration()) {
+    errors << "ERROR: No `main` function to run in " << source_file_name
+           << "\n";
+    return false;
+  }
+  // Return statements aren't analyzed yet, so only a `main` returning `()`
+  // returns at all.
+  if (!main->getReturnType()->isVoidTy() || main->arg_size() != 0) {
+    errors << "ERROR: `main` must take no parameters and return `()`.\n";
+    return false;
+  }
+  // Functions that are only declared are looked up in this process, which
+  // is checked before anything runs.
+  llvm::SmallVector<std::string> externals;
+  for (const llvm::Function& function : *module) {
+    if (function.isDeclaration()) {
+      externals.push_back(function.getName().str());
+    }
+  }
+
+  InitializeNativeTarget();
+  auto report_error = [&](llvm::Error error) {
+    errors << "ERROR: Unable to run " << source_file_name << ": "
+           << llvm::toString(std::move(error)) << "\n";
+    return false;
+  };
+  llvm::Expected<llvm::orc::JITTargetMachineBuilder> target_machine_builder =
+      llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!target_machine_builder) {
+    return report_error(target_machine_builder.takeError());
+  }
+  target_machine_builder->setCodeGenOptLevel(
+      GetCodeGenOptLevel(optimization_level_));
+  JITObjectCache object_cache(artifact_cache_, stats_, optimization_level_);
+  std::unique_ptr<llvm::orc::LLLazyJIT> jit;
+  {
+    DriverStats::PhaseScope scope(stats_, "jit");
+    // Each function is compiled the first time it's called, by the thread
+    // that calls it.
+    llvm::Expected<std::unique_ptr<llvm::orc::LLLazyJIT>> created_jit =
+        llvm::orc::LLLazyJITBuilder()
+            .setJITTargetMachineBuilder(*target_machine_builder)
+            .setCompileFunctionCreator(
+                [&](llvm::orc::JITTargetMachineBuilder builder)
+                    -> llvm::Expected<std::unique_ptr<
+                        llvm::orc::IRCompileLayer::IRCompiler>> {
+                  llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+                      target_machine = builder.createTargetMachine();
+                  if (!target_machine) {
+                    return target_machine.takeError();
+                  }
+                  return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(
+                      std::move(*target_machine), &object_cache);
+                })
+            .setLazyCompileFailureAddr(
+                llvm::pointerToJITTargetAddress(&ReportLazyCompileFailure))
+            .create();
+    if (!created_jit) {
+      return report_error(created_jit.takeError());
+    }
+    jit = std::move(*created_jit);
+    llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>>
+        process_symbols =
+            llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                jit->getDataLayout().getGlobalPrefix());
+    if (!process_symbols) {
+      return report_error(process_symbols.takeError());
+    }
+    jit->getMainJITDylib().addGenerator(std::move(*process_symbols));
+    module->setDataLayout(jit->getDataLayout());
+    if (llvm::Error error = jit->addLazyIRModule(std::move(program))) {
+      return report_error(std::move(error));
+    }
+    for (const std::string& external : externals) {
+      llvm::Expected<llvm::JITEvaluatedSymbol> symbol = jit->lookup(external);
+      if (!symbol) {
+        llvm::consumeError(symbol.takeError());
+        errors << "ERROR: Unable to find `" << external
+               << "`, which is declared without a body.\n";
+        return false;
+      }
+    }
+  }
+  llvm::Expected<llvm::JITEvaluatedSymbol> main_symbol = jit->lookup("main");
+  if (!main_symbol) {
+    errors << "ERROR: Unable to look up `main`: "
+           << llvm::toString(main_symbol.takeError()) << "\n";
+    return false;
+  }
+  auto* main_function = llvm::jitTargetAddressToFunction<void (*)()>(
+      main_symbol->getAddress());
+  DriverStats::PhaseScope scope(stats_, "run");
+  main_function();
+  return true;
+}
+
+auto Driver::OptimizeModule(llvm::Module& module,
+                            llvm::TargetMachine* target_machine) -> void {
+  DriverStats::PhaseScope scope(stats_, "optimize");
+  if (stats_ == nullptr) {
+    OptimizeLLVM(module, optimization_level_, target_machine);
+    return;
+  }
+  PassTimer pass_timer(*stats_);
+  OptimizeLLVM(module, optimization_level_, target_machine,
+               &pass_timer.callbacks());
+}
+
+auto Driver::CreateTargetMachine(OptimizationLevel level,
+                                 llvm::raw_ostream& errors)
+    -> std::unique_ptr<llvm::TargetMachine> {
+  std::string triple = llvm::sys::getDefaultTargetTriple();
+  std::string error;
+  const llvm::Target* target =
+      llvm::TargetRegistry::lookupTarget(triple, error);
+  if (target == nullptr) {
+    errors << "ERROR: Unable to find target for " << triple << ": " << error
+           << "\n";
+    return nullptr;
+  }
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple, /*CPU=*/"generic", /*Features=*/"", llvm::TargetOptions(),
+      llvm::Reloc::PIC_, /*CM=*/llvm::None, GetCodeGenOptLevel(level)));
+}
+
+auto Driver::EmitObjects(llvm::Module& module,
+                         llvm::TargetMachine& target_machine,
+                         llvm::MutableArrayRef<llvm::SmallVector<char, 0>>
+                             objects,
+                         llvm::raw_ostream& errors) -> bool {
+  // The objects are rendered in memory, where seeking back to patch them
+  // up costs nothing, and only written out once they're whole.
+  llvm::SmallVector<std::unique_ptr<llvm::raw_svector_ostream>, 1> streams;
+  for (llvm::SmallVector<char, 0>& object : objects) {
+    streams.push_back(std::make_unique<llvm::raw_svector_ostream>(object));
+  }
+  if (objects.size() == 1) {
+    llvm::legacy::PassManager pass_manager;
+    if (target_machine.addPassesToEmitFile(pass_manager, *streams.front(),
+                                           /*DwoOut=*/nullptr,
+                                           llvm::CGFT_ObjectFile)) {
+      errors << "ERROR: Unable to emit an object file for "
+             << module.getTargetTriple() << "\n";
+      return false;
+    }
+    pass_manager.run(module);
+    return true;
+  }
+  // The module is split into a partition for each object, each codegenned
+  // on a thread of its own with a target machine like `target_machine`.
+  llvm::SmallVector<llvm::raw_pwrite_stream*, 1> stream_pointers;
+  for (std::unique_ptr<llvm::raw_svector_ostream>& stream : streams) {
+    stream_pointers.push_back(stream.get());
+  }
+  llvm::CodeGenOpt::Level level = target_machine.getOptLevel();
+  llvm::splitCodeGen(module, stream_pointers, /*BCOSs=*/{}, [&] {
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(
+        target_machine.getTargetTriple().str(), error);
+    COCKTAIL_CHECK(target != nullptr) << "Target went away: " << error;
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        target_machine.getTargetTriple().str(),
+        target_machine.getTargetCPU(), target_machine.getTargetFeatureString(),
+        target_machine.Options, target_machine.getRelocationModel(),
+        target_machine.getCodeModel(), level));
+  });
+  return true;
+}
+
+auto Driver::WriteObjectFile(llvm::StringRef object_file,
+                             llvm::ArrayRef<char> object,
+                             llvm::raw_ostream& errors) -> bool {
+  std::error_code ec;
+  llvm::raw_fd_ostream object_stream(object_file, ec);
+  if (ec) {
+    errors << "ERROR: Unable to open output file: " << object_file << ": "
+           << ec.message() << "\n";
+    return false;
+  }
+  // The whole object is one write, straight from the buffer it was rendered
+  // into.
+  object_stream.SetUnbuffered();
+  object_stream.write(object.data(), object.size());
+  object_stream.close();
+  if (object_stream.has_error()) {
+    object_stream.clear_error();
+    errors << "ERROR: Unable to write output file: " << object_file << "\n";
+    return false;
+  }
+  return true;
+}
+
+auto Driver::ReplaceFile(llvm::StringRef file, llvm::StringRef contents,
+                         llvm::raw_ostream& errors) -> bool {
+  llvm::ErrorOr<llvm::sys::fs::perms> permissions =
+      llvm::sys::fs::getPermissions(file);
+  llvm::SmallString<256> temporary_path;
+  int fd = -1;
+  if (!permissions ||
+      llvm::sys::fs::createUniqueFile(file + "-%%%%%%%%.tmp", fd,
+                                      temporary_path, llvm::sys::fs::OF_None,
+                                      *permissions)) {
+    errors << "ERROR: Unable to open output file: " << file << "\n";
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out << contents;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(temporary_path);
+      errors << "ERROR: Unable to write output file: " << file << "\n";
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(temporary_path, file)) {
+    llvm::sys::fs::remove(temporary_path);
+    errors << "ERROR: Unable to write output file: " << file << "\n";
+    return false;
+  }
+  return true;
+}
+
+auto Driver::WriteInterfaceFile(llvm::StringRef interface_file,
+                                llvm::StringRef interface,
+                                llvm::raw_ostream& errors) -> bool {
+  DriverStats::PhaseScope scope(stats_, "write");
+  // An unchanged interface is left as it is, so that build systems that go
+  // by modification times don't recheck the files that import it.
+  auto existing =
+      llvm::MemoryBuffer::getFile(interface_file, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (existing && (*existing)->getBuffer() == interface) {
+    if (stats_ != nullptr) {
+      stats_->AddCount("api_unchanged", 1);
+    }
+    return true;
+  }
+  return WriteObjectFile(interface_file,
+                         llvm::ArrayRef<char>(interface.data(),
+                                              interface.size()),
+                         errors);
+}
+
+auto Driver::ReleaseLiteralValues(TokenizedBuffer& tokens) -> void {
+  if (!low_memory_) {
+    return;
+  }
+  int64_t released = tokens.ReleaseLiteralValues();
+  if (stats_ != nullptr) {
+    stats_->AddCount("released_bytes", released);
+  }
+}
+
+auto Driver::ReadSource(llvm::StringRef filename, DiagnosticConsumer& consumer)
+    -> std::shared_ptr<SourceBuffer> {
+  DriverStats::PhaseScope scope(stats_, "read");
+  auto source = source_cache_->Get(filename, consumer);
+  if (source && stats_ != nullptr) {
+    stats_->AddCount("bytes", source->text().size());
+  }
+  return source;
+}
+
+auto Driver::Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                 CompilationContext* context) -> TokenizedBuffer {
+  DriverStats::PhaseScope scope(stats_, "lex");
+  auto tokens = LexOrReadCached(source, consumer, context);
+  if (stats_ != nullptr) {
+    stats_->AddCount("tokens", tokens.size());
+    stats_->AddCount("identifiers", tokens.identifier_count());
+    stats_->AddCount("token_bytes", tokens.memory_bytes());
+    stats_->AddMemoryUsage("tokens", tokens.GetMemoryUsage());
+  }
+  return tokens;
+}
+
+auto Driver::LexOrReadCached(SourceBuffer& source, DiagnosticConsumer& consumer,
+                             CompilationContext* context) -> TokenizedBuffer {
+  auto lex = [&](DiagnosticConsumer& lex_consumer) {
+    return context != nullptr
+               ? TokenizedBuffer::Lex(source, lex_consumer, *context)
+               : TokenizedBuffer::Lex(source, lex_consumer);
+  };
+  if (diagnostic_cache_ == nullptr && artifact_cache_ == nullptr) {
+    return lex(consumer);
+  }
+  // The tree is fetched from the remote cache while the tokens are found.
+  if (artifact_cache_ != nullptr) {
+    artifact_cache_->Prefetch(
+        MakeArtifactKey(DiagnosticCache::Stage::Parse, source, ""));
+  }
+
+  if (auto entry = LookupCached(DiagnosticCache::Stage::Lex, source)) {
+    if (auto tokens = TokenizedBuffer::Deserialize(source, entry->data())) {
+      entry->Replay(consumer);
+      return std::move(*tokens);
+    }
+  }
+
+  DiagnosticCache::Recorder recorder(consumer);
+  auto tokens = lex(recorder);
+  std::string data;
+  llvm::raw_string_ostream data_stream(data);
+  tokens.Serialize(data_stream);
+  data_stream.flush();
+  StoreCached(DiagnosticCache::Stage::Lex, source,
+              recorder.Take(std::move(data)));
+  return tokens;
+}
+
+auto Driver::Parse(SourceBuffer& source, TokenizedBuffer& tokens,
+                   DiagnosticConsumer& consumer) -> ParseTree {
+  DriverStats::PhaseScope scope(stats_, "parse");
+  auto tree = ParseOrReadCached(source, tokens, consumer);
+  if (stats_ != nullptr) {
+    stats_->AddCount("nodes", tree.size());
+    stats_->AddCount("node_bytes", tree.node_storage_bytes());
+    stats_->AddMemoryUsage("tree", tree.GetMemoryUsage());
+  }
+  return tree;
+}
+
+auto Driver::ParseOrReadCached(SourceBuffer& source, TokenizedBuffer& tokens,
+                            DiagnosticConsumer& consumer) -> ParseTree {
+  if (diagnostic_cache_ == nullptr && artifact_cache_ == nullptr) {
+    return ParseTree::Parse(tokens, consumer);
+  }
+
+  if (auto entry = LookupCached(DiagnosticCache::Stage::Parse, source)) {
+    if (auto tree = ParseTree::Deserialize(tokens, entry->data())) {
+      entry->Replay(consumer);
+      return std::move(*tree);
+    }
+  }
+
+  DiagnosticCache::Recorder recorder(consumer);
+  auto tree = ParseTree::Parse(tokens, recorder);
+  std::string data;
+  llvm::raw_string_ostream data_stream(data);
+  tree.Serialize(data_stream);
+  data_stream.flush();
+  StoreCached(DiagnosticCache::Stage::Parse, source,
+              recorder.Take(std::move(data)));
+  return tree;
+}
+
+auto Driver::LookupCached(DiagnosticCache::Stage stage, SourceBuffer& source,
+                          llvm::StringRef imports_key)
+    -> std::shared_ptr<const DiagnosticCache::Entry> {
+  uint64_t content_hash = GetContentHash(stage, source, imports_key);
+  if (diagnostic_cache_ != nullptr) {
+    if (auto entry =
+            diagnostic_cache_->Lookup(stage, source.filename(), content_hash)) {
+      return entry;
+    }
+  }
+  if (artifact_cache_ == nullptr) {
+    return nullptr;
+  }
+  auto artifact =
+      artifact_cache_->Lookup(MakeArtifactKey(stage, source, imports_key));
+  if (!artifact) {
+    return nullptr;
+  }
+  auto entry = DiagnosticCache::Entry::Deserialize(artifact->data());
+  if (entry && diagnostic_cache_ != nullptr) {
+    diagnostic_cache_->Insert(stage, source.filename(), content_hash, entry);
+  }
+  return entry;
+}
+
+auto Driver::StoreCached(DiagnosticCache::Stage stage, SourceBuffer& source,
+                         std::shared_ptr<const DiagnosticCache::Entry> entry,
+                         llvm::StringRef imports_key) -> void {
+  if (!entry) {
+    return;
+  }
+  if (artifact_cache_ != nullptr) {
+    std::string data;
+    llvm::raw_string_ostream data_stream(data);
+    entry->Serialize(data_stream);
+    data_stream.flush();
+    artifact_cache_->Insert(MakeArtifactKey(stage, source, imports_key),
+                            data);
+  }
+  if (diagnostic_cache_ != nullptr) {
+    diagnostic_cache_->Insert(stage, source.filename(),
+                              GetContentHash(stage, source, imports_key),
+                              std::move(entry));
+  }
+}
+
+auto Driver::GetContentHash(DiagnosticCache::Stage stage,
+                            SourceBuffer& source, llvm::StringRef imports_key)
+    -> uint64_t {
+  uint64_t hash = llvm::xxHash64(source.text());
+  if (stage != DiagnosticCache::Stage::Semantics) {
+    return hash;
+  }
+  return llvm::xxHash64(llvm::formatv("{0:x}:{1}", hash, imports_key).str());
+}
+
 }  // namespace Cocktail
\ No newline at end of file
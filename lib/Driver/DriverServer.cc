@@ -0,0 +1,421 @@
+#include "Cocktail/Driver/DriverServer.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Driver/Driver.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define COCKTAIL_DRIVER_SERVER_SUPPORTED 1
+#else
+#define COCKTAIL_DRIVER_SERVER_SUPPORTED 0
+#endif
+
+namespace Cocktail {
+
+// Each message on the socket is a little-endian 32-bit size followed by that
+// many bytes. A request is a kind, then the client's working directory and
+// each argument as strings; a response is the command's result, then its
+// output and errors as strings. Strings are a 32-bit size and the bytes. A
+// compile request is its kind then the job, and its response the result, as
+// `EncodeCompileJob` and `EncodeCompileJobResult` write them.
+
+#if COCKTAIL_DRIVER_SERVER_SUPPORTED
+
+namespace {
+
+enum class RequestKind : uint8_t {
+  Run,
+  Stop,
+  Compile,
+};
+
+// Requests and responses are small; anything this large is not one of ours.
+constexpr uint32_t MaxMessageSize = 1 << 30;
+
+auto AppendU32(std::string& out, uint32_t value) -> void {
+  char bytes[sizeof(value)];
+  llvm::support::endian::write32le(bytes, value);
+  out.append(bytes, sizeof(bytes));
+}
+
+auto AppendString(std::string& out, llvm::StringRef text) -> void {
+  AppendU32(out, text.size());
+  out += text;
+}
+
+auto ConsumeU32(llvm::StringRef& in, uint32_t& value) -> bool {
+  if (in.size() < sizeof(value)) {
+    return false;
+  }
+  value = llvm::support::endian::read32le(in.data());
+  in = in.drop_front(sizeof(value));
+  return true;
+}
+
+auto ConsumeString(llvm::StringRef& in, llvm::StringRef& text) -> bool {
+  uint32_t size = 0;
+  if (!ConsumeU32(in, size) || in.size() < size) {
+    return false;
+  }
+  text = in.take_front(size);
+  in = in.drop_front(size);
+  return true;
+}
+
+auto MakeAddress(llvm::StringRef socket_path, sockaddr_un& address) -> bool {
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+  return true;
+}
+
+// Returns a socket connected to `socket_path`, or -1.
+auto Connect(llvm::StringRef socket_path) -> int {
+  sockaddr_un address;
+  if (!MakeAddress(socket_path, address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+auto WriteAll(int fd, llvm::StringRef data) -> bool {
+#ifdef MSG_NOSIGNAL
+  // A client that goes away mid-response mustn't take the server with it.
+  constexpr int Flags = MSG_NOSIGNAL;
+#else
+  constexpr int Flags = 0;
+#endif
+  while (!data.empty()) {
+    ssize_t written = send(fd, data.data(), data.size(), Flags);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data = data.drop_front(written);
+  }
+  return true;
+}
+
+auto ReadAll(int fd, char* data, size_t size) -> bool {
+  while (size != 0) {
+    ssize_t bytes_read = read(fd, data, size);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      return false;
+    }
+    data += bytes_read;
+    size -= bytes_read;
+  }
+  return true;
+}
+
+auto WriteMessage(int fd, llvm::StringRef payload) -> bool {
+  std::string message;
+  message.reserve(sizeof(uint32_t) + payload.size());
+  AppendString(message, payload);
+  return WriteAll(fd, message);
+}
+
+auto ReadMessage(int fd, std::string& payload) -> bool {
+  char size_bytes[sizeof(uint32_t)];
+  if (!ReadAll(fd, size_bytes, sizeof(size_bytes))) {
+    return false;
+  }
+  uint32_t size = llvm::support::endian::read32le(size_bytes);
+  if (size > MaxMessageSize) {
+    return false;
+  }
+  payload.resize(size);
+  return ReadAll(fd, payload.data(), size);
+}
+
+// Sends a request and reads back the response, returning false if either
+// fails.
+auto Exchange(llvm::StringRef socket_path, llvm::StringRef request,
+              std::string& response) -> bool {
+  int fd = Connect(socket_path);
+  if (fd < 0) {
+    return false;
+  }
+  bool exchanged = WriteMessage(fd, request) && ReadMessage(fd, response);
+  close(fd);
+  return exchanged;
+}
+
+struct Request {
+  RequestKind kind;
+  llvm::StringRef working_directory;
+  llvm::SmallVector<llvm::StringRef, 16> args;
+};
+
+auto ParseRequest(llvm::StringRef in, Request& request) -> bool {
+  if (in.empty()) {
+    return false;
+  }
+  request.kind = static_cast<RequestKind>(in.front());
+  in = in.drop_front();
+  if ((request.kind != RequestKind::Run && request.kind != RequestKind::Stop) ||
+      !ConsumeString(in, request.working_directory)) {
+    return false;
+  }
+  request.args.clear();
+  while (!in.empty()) {
+    llvm::StringRef arg;
+    if (!ConsumeString(in, arg)) {
+      return false;
+    }
+    request.args.push_back(arg);
+  }
+  return true;
+}
+
+auto MakeResponse(bool success, llvm::StringRef output,
+                  llvm::StringRef errors) -> std::string {
+  std::string response;
+  response.push_back(success);
+  AppendString(response, output);
+  AppendString(response, errors);
+  return response;
+}
+
+}  // namespace
+
+#endif  // COCKTAIL_DRIVER_SERVER_SUPPORTED
+
+auto DriverServer::Run(llvm::ArrayRef<llvm::StringRef> args,
+                       llvm::raw_ostream& output, llvm::raw_ostream& errors)
+    -> bool {
+  if (!args.empty() && (args.front() == "serve" || args.front() == "lsp")) {
+    errors << "ERROR: The server can't run another server.\n";
+    return false;
+  }
+  // Diagnostics go back to the client with the rest of the errors, rather
+  // than to the server's console.
+  StreamDiagnosticConsumer console_consumer(errors);
+  Driver driver(output, errors, *source_cache_, diagnostic_cache_);
+  driver.set_console_consumer(console_consumer);
+  return driver.RunFullCommand(args);
+}
+
+auto DriverServer::Compile(const CompileJob& job) -> CompileJobResult {
+  // Everything the job writes is in its result.
+  std::string output;
+  llvm::raw_string_ostream output_stream(output);
+  Driver driver(output_stream, output_stream, *source_cache_);
+  return driver.RunCompileJob(job);
+}
+
+#if COCKTAIL_DRIVER_SERVER_SUPPORTED
+
+auto DriverServer::Serve(llvm::StringRef socket_path) -> bool {
+  sockaddr_un address;
+  if (!MakeAddress(socket_path, address)) {
+    *error_stream_ << "ERROR: Invalid socket path: " << socket_path << "\n";
+    return false;
+  }
+  // A socket left behind by a server that didn't stop cleanly is replaced,
+  // but not one that a server is still listening on.
+  if (int fd = Connect(socket_path); fd >= 0) {
+    close(fd);
+    *error_stream_ << "ERROR: A server is already listening on: "
+                   << socket_path << "\n";
+    return false;
+  }
+  llvm::sys::fs::file_status status;
+  if (!llvm::sys::fs::status(socket_path, status)) {
+    if (status.type() != llvm::sys::fs::file_type::socket_file) {
+      *error_stream_ << "ERROR: Not a socket: " << socket_path << "\n";
+      return false;
+    }
+    // `llvm::sys::fs::remove` won't remove sockets.
+    unlink(std::string(socket_path).c_str());
+  }
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd, SOMAXCONN) != 0) {
+    *error_stream_ << "ERROR: Unable to listen on socket: " << socket_path
+                   << ": " << std::strerror(errno) << "\n";
+    if (listen_fd >= 0) {
+      close(listen_fd);
+    }
+    return false;
+  }
+
+  // Each request runs in its client's working directory, and the server's own
+  // is restored once it stops.
+  llvm::SmallString<256> server_working_directory;
+  llvm::sys::fs::current_path(server_working_directory);
+
+  bool stop = false;
+  std::string message;
+  Request request;
+  while (!stop) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *error_stream_ << "ERROR: Unable to accept a connection: "
+                     << std::strerror(errno) << "\n";
+      break;
+    }
+
+    // A malformed request is dropped, without a response.
+    if (!ReadMessage(fd, message)) {
+      close(fd);
+      continue;
+    }
+    if (!message.empty() &&
+        message.front() == static_cast<char>(RequestKind::Compile)) {
+      CompileJob job;
+      if (DecodeCompileJob(llvm::StringRef(message).drop_front(), job)) {
+        WriteMessage(fd, EncodeCompileJobResult(Compile(job)));
+      }
+      close(fd);
+      continue;
+    }
+    if (!ParseRequest(message, request)) {
+      close(fd);
+      continue;
+    }
+    if (request.kind == RequestKind::Stop) {
+      stop = true;
+      WriteMessage(fd, MakeResponse(true, "", ""));
+      close(fd);
+      continue;
+    }
+
+    bool success = false;
+    std::string output;
+    std::string errors;
+    llvm::raw_string_ostream output_stream(output);
+    llvm::raw_string_ostream errors_stream(errors);
+    // Relative paths in the arguments are the client's.
+    if (std::error_code ec =
+            llvm::sys::fs::set_current_path(request.working_directory)) {
+      errors_stream << "ERROR: Unable to change to the working directory: "
+                    << request.working_directory << "\n";
+    } else {
+      success = Run(request.args, output_stream, errors_stream);
+    }
+    output_stream.flush();
+    errors_stream.flush();
+    WriteMessage(fd, MakeResponse(success, output, errors));
+    close(fd);
+  }
+
+  close(listen_fd);
+  llvm::sys::fs::set_current_path(server_working_directory);
+  unlink(std::string(socket_path).c_str());
+  return stop;
+}
+
+auto RunOnDriverServer(llvm::StringRef socket_path,
+                       llvm::ArrayRef<llvm::StringRef> args,
+                       llvm::raw_ostream& output, llvm::raw_ostream& errors)
+    -> std::optional<bool> {
+  llvm::SmallString<256> working_directory;
+  if (llvm::sys::fs::current_path(working_directory)) {
+    return std::nullopt;
+  }
+  std::string request;
+  request.push_back(static_cast<char>(RequestKind::Run));
+  AppendString(request, working_directory);
+  for (llvm::StringRef arg : args) {
+    AppendString(request, arg);
+  }
+
+  std::string response;
+  if (!Exchange(socket_path, request, response) || response.empty()) {
+    return std::nullopt;
+  }
+  llvm::StringRef in = llvm::StringRef(response).drop_front();
+  llvm::StringRef command_output;
+  llvm::StringRef command_errors;
+  if (!ConsumeString(in, command_output) ||
+      !ConsumeString(in, command_errors) || !in.empty()) {
+    return std::nullopt;
+  }
+  output << command_output;
+  errors << command_errors;
+  return response.front() != 0;
+}
+
+auto RunCompileJobOnDriverServer(llvm::StringRef socket_path,
+                                 llvm::StringRef job)
+    -> std::optional<CompileJobResult> {
+  std::string request;
+  request.reserve(1 + job.size());
+  request.push_back(static_cast<char>(RequestKind::Compile));
+  request += job;
+  std::string response;
+  if (!Exchange(socket_path, request, response)) {
+    return std::nullopt;
+  }
+  return DecodeCompileJobResult(response);
+}
+
+auto StopDriverServer(llvm::StringRef socket_path) -> bool {
+  std::string request;
+  request.push_back(static_cast<char>(RequestKind::Stop));
+  AppendString(request, "");
+  std::string response;
+  return Exchange(socket_path, request, response);
+}
+
+#else  // COCKTAIL_DRIVER_SERVER_SUPPORTED
+
+auto DriverServer::Serve(llvm::StringRef /*socket_path*/) -> bool {
+  *error_stream_ << "ERROR: The server is not supported on this host.\n";
+  return false;
+}
+
+auto RunOnDriverServer(llvm::StringRef /*socket_path*/,
+                       llvm::ArrayRef<llvm::StringRef> /*args*/,
+                       llvm::raw_ostream& /*output*/,
+                       llvm::raw_ostream& /*errors*/) -> std::optional<bool> {
+  return std::nullopt;
+}
+
+auto RunCompileJobOnDriverServer(llvm::StringRef /*socket_path*/,
+                                 llvm::StringRef /*job*/)
+    -> std::optional<CompileJobResult> {
+  return std::nullopt;
+}
+
+auto StopDriverServer(llvm::StringRef /*socket_path*/) -> bool {
+  return false;
+}
+
+#endif  // COCKTAIL_DRIVER_SERVER_SUPPORTED
+
+}  // namespace Cocktail
@@ -0,0 +1,145 @@
+#include "Cocktail/Driver/DriverStats.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Format.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace Cocktail {
+
+auto DriverStats::AddCount(llvm::StringLiteral name, int64_t value) -> void {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Count& count : counts_) {
+    if (count.name == name) {
+      count.value += value;
+      return;
+    }
+  }
+  counts_.push_back({.name = name, .value = value});
+}
+
+auto DriverStats::AddPhase(llvm::StringLiteral name,
+                           const llvm::TimeRecord& elapsed) -> void {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Phase& phase : phases_) {
+    if (phase.name == name) {
+      phase.time += elapsed;
+      return;
+    }
+  }
+  phases_.push_back({.name = name, .time = elapsed});
+}
+
+auto DriverStats::AddMemoryUsage(llvm::StringLiteral owner,
+                                 const MemoryUsage& usage) -> void {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const MemoryUsage::Entry& entry : usage.entries) {
+    auto it = llvm::find_if(memory_, [&](const Memory& memory) {
+      return memory.owner == owner && memory.name == entry.name;
+    });
+    if (it != memory_.end()) {
+      it->used += entry.used;
+      it->allocated += entry.allocated;
+    } else {
+      memory_.push_back({.owner = owner,
+                         .name = entry.name,
+                         .used = entry.used,
+                         .allocated = entry.allocated});
+    }
+  }
+}
+
+auto DriverStats::AddPass(llvm::StringRef name,
+                          const llvm::TimeRecord& elapsed) -> void {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Pass& pass : passes_) {
+    if (pass.name == name) {
+      pass.time += elapsed;
+      return;
+    }
+  }
+  passes_.push_back({.name = name.str(), .time = elapsed});
+}
+
+auto DriverStats::Print(llvm::raw_ostream& out) const -> void {
+  size_t name_width = 0;
+  for (const Phase& phase : phases_) {
+    name_width = std::max(name_width, phase.name.size());
+  }
+  for (const Count& count : counts_) {
+    name_width = std::max(name_width, count.name.size());
+  }
+  constexpr llvm::StringLiteral PeakRss = "peak_rss_bytes";
+  name_width = std::max(name_width, PeakRss.size());
+
+  out << llvm::left_justify("phase", name_width) << "  wall_ms   cpu_ms\n";
+  for (const Phase& phase : phases_) {
+    out << llvm::left_justify(phase.name, name_width)
+        << llvm::format("  %7.3f  %7.3f\n", phase.time.getWallTime() * 1000,
+                        phase.time.getProcessTime() * 1000);
+  }
+  for (const Count& count : counts_) {
+    out << llvm::left_justify(count.name, name_width) << "  " << count.value
+        << "\n";
+  }
+  if (std::optional<int64_t> peak_rss = GetPeakResidentSetSize()) {
+    out << llvm::left_justify(PeakRss, name_width) << "  " << *peak_rss
+        << "\n";
+  }
+
+  if (!memory_.empty()) {
+    size_t memory_width = 0;
+    for (const Memory& memory : memory_) {
+      memory_width =
+          std::max(memory_width, memory.owner.size() + 1 + memory.name.size());
+    }
+    out << llvm::left_justify("memory", memory_width)
+        << "    used_bytes  allocated_bytes\n";
+    for (const Memory& memory : memory_) {
+      out << llvm::left_justify((memory.owner + "." + memory.name).str(),
+                                memory_width)
+          << llvm::format("  %12lld  %15lld\n",
+                          static_cast<long long>(memory.used),
+                          static_cast<long long>(memory.allocated));
+    }
+  }
+
+  if (passes_.empty()) {
+    return;
+  }
+  // Pass names are much longer than those above, so they don't widen the
+  // first table.
+  size_t pass_width = 0;
+  for (const Pass& pass : passes_) {
+    pass_width = std::max(pass_width, pass.name.size());
+  }
+  out << llvm::left_justify("pass", pass_width) << "  wall_ms   cpu_ms\n";
+  for (const Pass& pass : passes_) {
+    out << llvm::left_justify(pass.name, pass_width)
+        << llvm::format("  %7.3f  %7.3f\n", pass.time.getWallTime() * 1000,
+                        pass.time.getProcessTime() * 1000);
+  }
+}
+
+auto DriverStats::GetPeakResidentSetSize() -> std::optional<int64_t> {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return std::nullopt;
+  }
+#if defined(__APPLE__)
+  // macOS reports bytes, other hosts kilobytes.
+  return usage.ru_maxrss;
+#else
+  return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return std::nullopt;
+#endif
+}
+
+}  // namespace Cocktail
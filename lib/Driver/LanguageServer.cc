@@ -0,0 +1,877 @@
+#include "Cocktail/Driver/LanguageServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lexer/TokenKind.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseNodeKind.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <unistd.h>
+#define COCKTAIL_LANGUAGE_SERVER_SUPPORTED 1
+#else
+#define COCKTAIL_LANGUAGE_SERVER_SUPPORTED 0
+#endif
+
+namespace Cocktail {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// JSON-RPC error codes.
+constexpr int ParseError = -32700;
+constexpr int InvalidRequest = -32600;
+constexpr int MethodNotFound = -32601;
+constexpr int InvalidParams = -32602;
+
+// LSP symbol kinds.
+constexpr int FunctionSymbol = 12;
+constexpr int VariableSymbol = 13;
+
+// The semantic token types, in the order of the legend sent to the client.
+enum class SemanticTokenType : int8_t {
+  Keyword,
+  Function,
+  Variable,
+  Number,
+  String,
+  Operator,
+  Type,
+};
+
+constexpr llvm::StringLiteral SemanticTokenTypeNames[] = {
+    "keyword", "function", "variable", "number",
+    "string",  "operator", "type"};
+
+// The only semantic token modifier, marking the name a declaration declares.
+constexpr int DeclarationModifier = 1;
+
+// Returns the type of a token of `kind`, or nothing for one that isn't
+// highlighted, such as brackets and separators.
+auto GetSemanticTokenType(TokenKind kind) -> std::optional<SemanticTokenType> {
+  if (kind.is_keyword()) {
+    return SemanticTokenType::Keyword;
+  }
+  if (kind.is_sized_type_literal()) {
+    return SemanticTokenType::Type;
+  }
+  if (kind == TokenKind::Identifier()) {
+    return SemanticTokenType::Variable;
+  }
+  if (kind == TokenKind::IntegerLiteral() || kind == TokenKind::RealLiteral()) {
+    return SemanticTokenType::Number;
+  }
+  if (kind == TokenKind::StringLiteral()) {
+    return SemanticTokenType::String;
+  }
+  if (kind.is_symbol() && !kind.is_grouping_symbol() &&
+      !kind.IsOneOf({TokenKind::Semi(), TokenKind::Comma()})) {
+    return SemanticTokenType::Operator;
+  }
+  return std::nullopt;
+}
+
+// Returns the position units in `text`: its bytes with `utf8`, and otherwise
+// its UTF-16 code units.
+auto CountUnits(llvm::StringRef text, bool utf8) -> int64_t {
+  if (utf8) {
+    return text.size();
+  }
+  int64_t units = 0;
+  for (char c : text) {
+    auto byte = static_cast<unsigned char>(c);
+    // Continuation bytes add nothing, and a four-byte sequence is a surrogate
+    // pair.
+    if ((byte & 0xC0) != 0x80) {
+      units += byte >= 0xF0 ? 2 : 1;
+    }
+  }
+  return units;
+}
+
+// Returns the bytes at the start of `line` that `units` position units
+// cover, as counted by `CountUnits`, without splitting a character.
+auto CountBytes(llvm::StringRef line, int64_t units, bool utf8) -> int64_t {
+  if (utf8) {
+    return std::clamp<int64_t>(units, 0, line.size());
+  }
+  int64_t bytes = 0;
+  while (bytes < static_cast<int64_t>(line.size()) && units > 0) {
+    auto byte = static_cast<unsigned char>(line[bytes]);
+    int size = byte < 0x80 ? 1 : byte < 0xE0 ? 2 : byte < 0xF0 ? 3 : 4;
+    units -= size == 4 ? 2 : 1;
+    bytes += size;
+  }
+  return std::min<int64_t>(bytes, line.size());
+}
+
+auto MakePosition(int64_t line, int64_t character) -> llvm::json::Object {
+  return llvm::json::Object{{"line", line}, {"character", character}};
+}
+
+auto MakeRange(llvm::json::Object start, llvm::json::Object end)
+    -> llvm::json::Object {
+  return llvm::json::Object{{"start", std::move(start)},
+                            {"end", std::move(end)}};
+}
+
+// Returns the path of a `file://` URI, or the URI itself for other schemes.
+auto UriToPath(llvm::StringRef uri) -> std::string {
+  if (!uri.consume_front("file://")) {
+    return uri.str();
+  }
+  std::string path;
+  for (size_t i = 0; i < uri.size(); ++i) {
+    unsigned value = 0;
+    if (uri[i] == '%' && i + 2 < uri.size() &&
+        !uri.substr(i + 1, 2).getAsInteger(16, value)) {
+      path += static_cast<char>(value);
+      i += 2;
+      continue;
+    }
+    path += uri[i];
+  }
+  return path;
+}
+
+// Collects a document's diagnostics as LSP objects, publishing them on
+// `Flush` once they have changed, which the server only calls after the
+// document's edits have paused for the delay. Typing then doesn't flood the
+// client with diagnostics for text that is about to change again.
+class DebouncedDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  using PublishFn = std::function<auto(const llvm::json::Array& diagnostics)
+                                      ->void>;
+
+  DebouncedDiagnosticConsumer(std::string uri, bool utf8_positions,
+                              Clock::duration delay, PublishFn publish)
+      : uri_(std::move(uri)),
+        utf8_positions_(utf8_positions),
+        delay_(delay),
+        publish_(std::move(publish)) {}
+
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    llvm::json::Object object = ToJson(diagnostic.message);
+    object["severity"] = diagnostic.level == DiagnosticLevel::Error     ? 1
+                         : diagnostic.level == DiagnosticLevel::Warning ? 2
+                                                                        : 3;
+    object["source"] = "cocktail";
+    if (!diagnostic.notes.empty()) {
+      llvm::json::Array related;
+      for (const DiagnosticMessage& note : diagnostic.notes) {
+        llvm::json::Object note_object = ToJson(note);
+        related.push_back(llvm::json::Object{
+            {"location",
+             llvm::json::Object{{"uri", uri_},
+                                {"range", std::move(note_object["range"])}}},
+            {"message", std::move(note_object["message"])}});
+      }
+      object["relatedInformation"] = std::move(related);
+    }
+    diagnostics_.push_back(std::move(object));
+    Delay();
+  }
+
+  // Publishes the diagnostics if they've changed since they last were.
+  auto Flush() -> void override {
+    if (due_) {
+      due_.reset();
+      publish_(diagnostics_);
+    }
+  }
+
+  // Drops the diagnostics collected, for text that is checked from scratch.
+  auto Clear() -> void { diagnostics_.clear(); }
+
+  // Marks the diagnostics as changed, restarting the delay before they're
+  // due to be published.
+  auto Delay() -> void { due_ = Clock::now() + delay_; }
+
+  [[nodiscard]] auto empty() const -> bool { return diagnostics_.empty(); }
+
+  // Returns when the diagnostics are due to be published, if they've changed.
+  [[nodiscard]] auto due() const -> std::optional<Clock::time_point> {
+    return due_;
+  }
+
+ private:
+  auto ToJson(const DiagnosticMessage& message) -> llvm::json::Object {
+    const DiagnosticLocation& location = message.location();
+    int64_t line = std::max(location.line_number - 1, 0);
+    int64_t character = CountUnits(
+        location.line.take_front(std::max(location.column_number - 1, 0)),
+        utf8_positions_);
+    return llvm::json::Object{
+        {"range", MakeRange(MakePosition(line, character),
+                            MakePosition(line, character))},
+        {"code", message.kind.name().str()},
+        {"message", message.format_fn(message)}};
+  }
+
+  std::string uri_;
+  bool utf8_positions_;
+  Clock::duration delay_;
+  PublishFn publish_;
+  llvm::json::Array diagnostics_;
+  std::optional<Clock::time_point> due_;
+};
+
+}  // namespace
+
+// A document's text, and its source, tokens and parse tree, which refer to
+// it and to each other, so a snapshot is only ever used from the heap.
+struct LanguageServer::Snapshot {
+  // Returns the snapshot of `text`, lexed and parsed from scratch, or null
+  // if the text isn't valid UTF-8.
+  static auto Create(llvm::StringRef filename, std::string text,
+                     DiagnosticConsumer& consumer)
+      -> std::unique_ptr<Snapshot> {
+    auto snapshot = std::make_unique<Snapshot>();
+    if (!snapshot->Load(filename, std::move(text))) {
+      return nullptr;
+    }
+    snapshot->Check(consumer);
+    return snapshot;
+  }
+
+  // Returns the snapshot of this one's text after `edit`, relexing and
+  // reparsing only what it touched, or null if the text isn't valid UTF-8.
+  auto Edit(const TokenizedBuffer::TextEdit& edit,
+            DiagnosticConsumer& consumer) const -> std::unique_ptr<Snapshot> {
+    llvm::StringRef old_text = text;
+    auto next = std::make_unique<Snapshot>();
+    if (!next->Load(source->filename(),
+                    (old_text.take_front(edit.offset) + edit.inserted_text +
+                     old_text.drop_front(edit.offset + edit.removed_length))
+                        .str())) {
+      return nullptr;
+    }
+    next->tokens.emplace(
+        TokenizedBuffer::Relex(*tokens, *next->source, edit, consumer));
+    if (llvm::Optional<ParseTree::TokenEdit> token_edit =
+            ParseTree::ComputeTokenEdit(*tokens, *next->tokens, text, edit)) {
+      next->tree.emplace(
+          ParseTree::Reparse(*tree, *next->tokens, *token_edit, consumer));
+    } else {
+      next->tree.emplace(ParseTree::Parse(*next->tokens, consumer));
+    }
+    return next;
+  }
+
+  // Lexes and parses the text from scratch, emitting all its diagnostics.
+  auto Check(DiagnosticConsumer& consumer) -> void {
+    tree.reset();
+    tokens.emplace(TokenizedBuffer::Lex(*source, consumer));
+    tree.emplace(ParseTree::Parse(*tokens, consumer));
+  }
+
+  // Returns the text of the line at `line`, counting from 0, without its
+  // line ending.
+  [[nodiscard]] auto GetLine(int64_t line) const -> llvm::StringRef {
+    llvm::StringRef line_text = llvm::StringRef(text).substr(
+        line_starts[line],
+        line + 1 < static_cast<int64_t>(line_starts.size())
+            ? line_starts[line + 1] - 1 - line_starts[line]
+            : llvm::StringRef::npos);
+    line_text.consume_back("\r");
+    return line_text;
+  }
+
+  // Returns the offset in the text of an LSP position, or 0 without one.
+  [[nodiscard]] auto GetOffset(const llvm::json::Object* position,
+                               bool utf8) const -> int64_t {
+    if (!position) {
+      return 0;
+    }
+    int64_t line = position->getInteger("line").value_or(0);
+    if (line < 0) {
+      return 0;
+    }
+    if (line >= static_cast<int64_t>(line_starts.size())) {
+      return text.size();
+    }
+    return line_starts[line] +
+           CountBytes(GetLine(line),
+                      position->getInteger("character").value_or(0), utf8);
+  }
+
+  // Returns the LSP position of `offset` in the text.
+  [[nodiscard]] auto GetPosition(int64_t offset, bool utf8) const
+      -> llvm::json::Object {
+    int64_t line = llvm::upper_bound(line_starts, offset) -
+                   line_starts.begin() - 1;
+    return MakePosition(
+        line, CountUnits(llvm::StringRef(text).slice(line_starts[line],
+                                                     offset),
+                         utf8));
+  }
+
+  // Returns the offset in the text of the start of `token`.
+  [[nodiscard]] auto GetTokenOffset(TokenizedBuffer::Token token) const
+      -> int64_t {
+    return line_starts[tokens->GetLineNumber(token) - 1] +
+           tokens->GetColumnNumber(token) - 1;
+  }
+
+  // Returns the LSP range from the start of `first` to the end of `last`.
+  [[nodiscard]] auto GetRange(TokenizedBuffer::Token first,
+                              TokenizedBuffer::Token last, bool utf8) const
+      -> llvm::json::Object {
+    return MakeRange(
+        GetPosition(GetTokenOffset(first), utf8),
+        GetPosition(GetTokenOffset(last) + tokens->GetTokenText(last).size(),
+                    utf8));
+  }
+
+  std::string text;
+  // The offset in `text` of the start of each line.
+  std::vector<int64_t> line_starts;
+  std::optional<SourceBuffer> source;
+  std::optional<TokenizedBuffer> tokens;
+  std::optional<ParseTree> tree;
+
+ private:
+  // Takes `text` and creates the source of it, returning false if it isn't
+  // valid UTF-8.
+  auto Load(llvm::StringRef filename, std::string new_text) -> bool {
+    text = std::move(new_text);
+    llvm::StringRef text_ref = text;
+    line_starts.push_back(0);
+    for (size_t newline = text_ref.find('\n');
+         newline != llvm::StringRef::npos;
+         newline = text_ref.find('\n', newline + 1)) {
+      line_starts.push_back(newline + 1);
+    }
+    // The file system only refers to the text, which the source then does
+    // too, so it doesn't need to outlive the source.
+    llvm::vfs::InMemoryFileSystem fs;
+    fs.addFile(filename, /*ModificationTime=*/0,
+               llvm::MemoryBuffer::getMemBuffer(
+                   text, filename, /*RequiresNullTerminator=*/false));
+    source = SourceBuffer::CreateFromFile(fs, filename,
+                                          NullDiagnosticConsumer());
+    return source.has_value();
+  }
+};
+
+struct LanguageServer::Document {
+  Document(std::string uri, DebouncedDiagnosticConsumer::PublishFn publish,
+           bool utf8_positions, Clock::duration delay)
+      : uri(uri),
+        diagnostics(std::move(uri), utf8_positions, delay,
+                    std::move(publish)) {}
+
+  std::string uri;
+  int64_t version = 0;
+  // Null if the text couldn't be read as a source.
+  std::unique_ptr<Snapshot> snapshot;
+  DebouncedDiagnosticConsumer diagnostics;
+  // Whether `diagnostics` are stale, because an edit changed text that had
+  // diagnostics and only what it touched was checked again. The whole text
+  // is checked again before they're published.
+  bool diagnostics_stale = false;
+};
+
+LanguageServer::LanguageServer(llvm::raw_ostream& output,
+                               llvm::raw_ostream& error_stream,
+                               std::chrono::milliseconds diagnostics_delay)
+    : output_(&output),
+      error_stream_(&error_stream),
+      diagnostics_delay_(diagnostics_delay) {}
+
+LanguageServer::~LanguageServer() = default;
+
+auto LanguageServer::Send(llvm::json::Value message) -> void {
+  std::string body;
+  llvm::raw_string_ostream body_stream(body);
+  body_stream << message;
+  body_stream.flush();
+  *output_ << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+  output_->flush();
+}
+
+auto LanguageServer::Reply(const llvm::json::Value& id,
+                           llvm::json::Value result) -> void {
+  Send(llvm::json::Object{
+      {"jsonrpc", "2.0"}, {"id", id}, {"result", std::move(result)}});
+}
+
+auto LanguageServer::ReplyError(const llvm::json::Value& id, int code,
+                                llvm::StringRef message) -> void {
+  Send(llvm::json::Object{
+      {"jsonrpc", "2.0"},
+      {"id", id},
+      {"error",
+       llvm::json::Object{{"code", code}, {"message", message.str()}}}});
+}
+
+auto LanguageServer::HandleMessage(const llvm::json::Value& message) -> bool {
+  const llvm::json::Object* object = message.getAsObject();
+  if (!object) {
+    ReplyError(nullptr, InvalidRequest, "Message is not an object");
+    return true;
+  }
+  llvm::Optional<llvm::StringRef> method = object->getString("method");
+  const llvm::json::Value* id = object->get("id");
+  if (!method) {
+    // A response to a request of the server's, which it doesn't send.
+    return true;
+  }
+  llvm::json::Object no_params;
+  const llvm::json::Object* params = object->getObject("params");
+  if (!params) {
+    params = &no_params;
+  }
+
+  if (*method == "exit") {
+    return false;
+  }
+  if (shut_down_ && id) {
+    ReplyError(*id, InvalidRequest, "The server is shut down");
+    return true;
+  }
+  if (*method == "initialize" && id) {
+    Reply(*id, Initialize(*params));
+  } else if (*method == "shutdown" && id) {
+    shut_down_ = true;
+    Reply(*id, nullptr);
+  } else if (*method == "textDocument/didOpen") {
+    DidOpen(*params);
+  } else if (*method == "textDocument/didChange") {
+    DidChange(*params);
+  } else if (*method == "textDocument/didClose") {
+    DidClose(*params);
+  } else if ((*method == "textDocument/semanticTokens/full" ||
+              *method == "textDocument/documentSymbol") &&
+             id) {
+    Document* document = FindDocument(*params);
+    if (!document || !document->snapshot) {
+      ReplyError(*id, InvalidParams, "The document isn't open");
+    } else if (*method == "textDocument/documentSymbol") {
+      Reply(*id, DocumentSymbols(*document));
+    } else {
+      Reply(*id, SemanticTokens(*document));
+    }
+  } else if (id) {
+    ReplyError(*id, MethodNotFound, ("Unknown method: " + *method).str());
+  }
+  // Other notifications, such as `initialized`, need nothing done.
+  return true;
+}
+
+auto LanguageServer::Initialize(const llvm::json::Object& params)
+    -> llvm::json::Value {
+  // Positions count bytes when the client can take them, which saves
+  // converting every column.
+  const llvm::json::Object* capabilities = params.getObject("capabilities");
+  const llvm::json::Object* general =
+      capabilities ? capabilities->getObject("general") : nullptr;
+  if (const llvm::json::Array* encodings =
+          general ? general->getArray("positionEncodings") : nullptr) {
+    for (const llvm::json::Value& encoding : *encodings) {
+      if (encoding.getAsString().value_or("") == "utf-8") {
+        utf8_positions_ = true;
+      }
+    }
+  }
+
+  llvm::json::Array token_types;
+  for (llvm::StringRef name : SemanticTokenTypeNames) {
+    token_types.push_back(name.str());
+  }
+  return llvm::json::Object{
+      {"capabilities",
+       llvm::json::Object{
+           {"positionEncoding", utf8_positions_ ? "utf-8" : "utf-16"},
+           // Edits are sent as the ranges they change.
+           {"textDocumentSync",
+            llvm::json::Object{{"openClose", true}, {"change", 2}}},
+           {"semanticTokensProvider",
+            llvm::json::Object{
+                {"legend",
+                 llvm::json::Object{
+                     {"tokenTypes", std::move(token_types)},
+                     {"tokenModifiers", llvm::json::Array{"declaration"}}}},
+                {"full", true}}},
+           {"documentSymbolProvider", true}}},
+      {"serverInfo", llvm::json::Object{{"name", "cocktail"}}}};
+}
+
+auto LanguageServer::FindDocument(const llvm::json::Object& params)
+    -> Document* {
+  const llvm::json::Object* text_document = params.getObject("textDocument");
+  if (!text_document) {
+    return nullptr;
+  }
+  auto it = documents_.find(text_document->getString("uri").value_or(""));
+  return it == documents_.end() ? nullptr : it->second.get();
+}
+
+auto LanguageServer::DidOpen(const llvm::json::Object& params) -> void {
+  const llvm::json::Object* text_document = params.getObject("textDocument");
+  if (!text_document) {
+    return;
+  }
+  llvm::StringRef uri = text_document->getString("uri").value_or("");
+  auto document = std::make_unique<Document>(
+      uri.str(),
+      [this, uri = uri.str()](const llvm::json::Array& diagnostics) {
+        const Document& document = *documents_[uri];
+        Send(llvm::json::Object{
+            {"jsonrpc", "2.0"},
+            {"method", "textDocument/publishDiagnostics"},
+            {"params",
+             llvm::json::Object{
+                 {"uri", document.uri},
+                 {"version", document.version},
+                 {"diagnostics", llvm::json::Array(diagnostics)}}}});
+      },
+      utf8_positions_, diagnostics_delay_);
+  document->version = text_document->getInteger("version").value_or(0);
+  document->snapshot = Snapshot::Create(
+      UriToPath(uri), text_document->getString("text").value_or("").str(),
+      document->diagnostics);
+  if (!document->snapshot) {
+    *error_stream_ << "ERROR: Unable to read document: " << uri << "\n";
+  }
+  // Even without diagnostics, the client hears that there are none.
+  document->diagnostics.Delay();
+  documents_[uri] = std::move(document);
+}
+
+auto LanguageServer::DidChange(const llvm::json::Object& params) -> void {
+  Document* document = FindDocument(params);
+  const llvm::json::Array* changes = params.getArray("contentChanges");
+  if (!document || !changes) {
+    return;
+  }
+  document->version = params.getObject("textDocument")
+                          ->getInteger("version")
+                          .value_or(document->version);
+  for (const llvm::json::Value& change_value : *changes) {
+    const llvm::json::Object* change = change_value.getAsObject();
+    if (!change) {
+      continue;
+    }
+    llvm::StringRef text = change->getString("text").value_or("");
+    const llvm::json::Object* range = change->getObject("range");
+    if (!range || !document->snapshot) {
+      // The whole text is replaced, and checked from scratch.
+      document->diagnostics.Clear();
+      document->diagnostics_stale = false;
+      document->snapshot = Snapshot::Create(
+          UriToPath(document->uri), text.str(), document->diagnostics);
+      document->diagnostics.Delay();
+      continue;
+    }
+
+    const Snapshot& snapshot = *document->snapshot;
+    bool utf8 = utf8_positions_ || snapshot.source->is_ascii();
+    int64_t start = snapshot.GetOffset(range->getObject("start"), utf8);
+    int64_t end =
+        std::max(start, snapshot.GetOffset(range->getObject("end"), utf8));
+    // Without diagnostics before the edit, those of what it touched are all
+    // the text has. Otherwise, some may be gone, which only checking the
+    // whole text again tells.
+    bool stale = document->diagnostics_stale || !document->diagnostics.empty();
+    std::unique_ptr<Snapshot> next = snapshot.Edit(
+        {.offset = start, .removed_length = end - start, .inserted_text = text},
+        stale ? NullDiagnosticConsumer() : document->diagnostics);
+    if (!next) {
+      *error_stream_ << "ERROR: Unable to read document: " << document->uri
+                     << "\n";
+    }
+    document->snapshot = std::move(next);
+    if (stale) {
+      document->diagnostics_stale = true;
+      document->diagnostics.Delay();
+    }
+  }
+}
+
+auto LanguageServer::DidClose(const llvm::json::Object& params) -> void {
+  Document* document = FindDocument(params);
+  if (!document) {
+    return;
+  }
+  // The client drops the document's diagnostics once they're empty.
+  Send(llvm::json::Object{
+      {"jsonrpc", "2.0"},
+      {"method", "textDocument/publishDiagnostics"},
+      {"params", llvm::json::Object{{"uri", document->uri},
+                                    {"diagnostics", llvm::json::Array()}}}});
+  documents_.erase(document->uri);
+}
+
+auto LanguageServer::SemanticTokens(const Document& document)
+    -> llvm::json::Value {
+  const Snapshot& snapshot = *document.snapshot;
+  const TokenizedBuffer& tokens = *snapshot.tokens;
+  const ParseTree& tree = *snapshot.tree;
+  bool utf8 = utf8_positions_ || snapshot.source->is_ascii();
+
+  // The names that declarations declare, in the order of their tokens.
+  llvm::SmallVector<std::pair<TokenizedBuffer::Token, SemanticTokenType>>
+      declared_names;
+  for (ParseTree::Node n : tree.postorder()) {
+    ParseNodeKind kind = tree.node_kind(n);
+    if (kind != ParseNodeKind::FunctionDeclaration() &&
+        kind != ParseNodeKind::PatternBinding()) {
+      continue;
+    }
+    for (ParseTree::Node child : tree.children(n)) {
+      if (tree.node_kind(child) == ParseNodeKind::DeclaredName()) {
+        declared_names.push_back(
+            {tree.node_token(child),
+             kind == ParseNodeKind::FunctionDeclaration()
+                 ? SemanticTokenType::Function
+                 : SemanticTokenType::Variable});
+      }
+    }
+  }
+  llvm::sort(declared_names, [](const auto& lhs, const auto& rhs) {
+    return lhs.first < rhs.first;
+  });
+
+  // Each token is five integers: its line and start relative to the token
+  // before it, its length, its type and its modifiers.
+  llvm::json::Array data;
+  int64_t previous_line = 0;
+  int64_t previous_start = 0;
+  const auto* declared_name = declared_names.begin();
+  for (TokenizedBuffer::Token token : tokens.tokens()) {
+    std::optional<SemanticTokenType> type =
+        GetSemanticTokenType(tokens.GetKind(token));
+    int modifiers = 0;
+    while (declared_name != declared_names.end() &&
+           declared_name->first < token) {
+      ++declared_name;
+    }
+    if (declared_name != declared_names.end() &&
+        declared_name->first == token) {
+      type = declared_name->second;
+      modifiers = DeclarationModifier;
+    }
+    if (!type) {
+      continue;
+    }
+    int64_t line = tokens.GetLineNumber(token) - 1;
+    int64_t start = CountUnits(
+        snapshot.GetLine(line).take_front(tokens.GetColumnNumber(token) - 1),
+        utf8);
+    // A token spanning lines is only highlighted on its first.
+    int64_t length = CountUnits(
+        tokens.GetTokenText(token).take_until([](char c) { return c == '\n'; }),
+        utf8);
+    data.push_back(line - previous_line);
+    data.push_back(line == previous_line ? start - previous_start : start);
+    data.push_back(length);
+    data.push_back(static_cast<int>(*type));
+    data.push_back(modifiers);
+    previous_line = line;
+    previous_start = start;
+  }
+  return llvm::json::Object{{"data", std::move(data)}};
+}
+
+auto LanguageServer::DocumentSymbols(const Document& document)
+    -> llvm::json::Value {
+  const Snapshot& snapshot = *document.snapshot;
+  const ParseTree& tree = *snapshot.tree;
+  bool utf8 = utf8_positions_ || snapshot.source->is_ascii();
+
+  // Returns the symbol of the declaration `n`, which covers the tokens of its
+  // subtree, or nothing if it has no name.
+  auto make_symbol =
+      [&](ParseTree::Node n) -> std::optional<llvm::json::Object> {
+    TokenizedBuffer::Token first = tree.node_token(n);
+    TokenizedBuffer::Token last = first;
+    std::optional<TokenizedBuffer::Token> name;
+    for (ParseTree::Node child : tree.postorder(n)) {
+      TokenizedBuffer::Token token = tree.node_token(child);
+      first = std::min(first, token);
+      last = std::max(last, token);
+      if (!name && tree.node_kind(child) == ParseNodeKind::DeclaredName()) {
+        name = token;
+      }
+    }
+    if (!name) {
+      return std::nullopt;
+    }
+    return llvm::json::Object{
+        {"name", snapshot.tokens->GetTokenText(*name).str()},
+        {"kind",
+         tree.node_kind(n) == ParseNodeKind::FunctionDeclaration()
+             ? FunctionSymbol
+             : VariableSymbol},
+        {"range", snapshot.GetRange(first, last, utf8)},
+        {"selectionRange", snapshot.GetRange(*name, *name, utf8)}};
+  };
+
+  // Roots are visited last to first.
+  llvm::SmallVector<ParseTree::Node> roots(tree.roots().begin(),
+                                           tree.roots().end());
+  llvm::json::Array symbols;
+  for (ParseTree::Node root : llvm::reverse(roots)) {
+    ParseNodeKind kind = tree.node_kind(root);
+    if (kind != ParseNodeKind::FunctionDeclaration() &&
+        kind != ParseNodeKind::VariableDeclaration()) {
+      continue;
+    }
+    std::optional<llvm::json::Object> symbol = make_symbol(root);
+    if (!symbol) {
+      continue;
+    }
+    // A function's variables are its children.
+    llvm::json::Array children;
+    for (ParseTree::Node n : tree.postorder(root)) {
+      if (tree.node_kind(n) == ParseNodeKind::VariableDeclaration()) {
+        if (std::optional<llvm::json::Object> child = make_symbol(n)) {
+          children.push_back(std::move(*child));
+        }
+      }
+    }
+    if (!children.empty()) {
+      (*symbol)["children"] = std::move(children);
+    }
+    symbols.push_back(std::move(*symbol));
+  }
+  return symbols;
+}
+
+auto LanguageServer::PublishDiagnostics(bool all)
+    -> std::chrono::milliseconds {
+  Clock::time_point now = Clock::now();
+  std::optional<Clock::duration> next_due;
+  for (auto& entry : documents_) {
+    Document& document = *entry.second;
+    std::optional<Clock::time_point> due = document.diagnostics.due();
+    if (!due) {
+      continue;
+    }
+    if (!all && *due > now) {
+      next_due = std::min(next_due.value_or(*due - now), *due - now);
+      continue;
+    }
+    if (document.diagnostics_stale && document.snapshot) {
+      document.diagnostics.Clear();
+      document.snapshot->Check(document.diagnostics);
+      document.diagnostics_stale = false;
+    }
+    document.diagnostics.Flush();
+  }
+  if (!next_due) {
+    return std::chrono::milliseconds(-1);
+  }
+  return std::chrono::ceil<std::chrono::milliseconds>(*next_due);
+}
+
+#if COCKTAIL_LANGUAGE_SERVER_SUPPORTED
+
+namespace {
+
+// Moves the body of the first message in `buffer` to `body`, if all of it
+// has been read. A message whose header has no length is dropped.
+auto TakeMessage(std::string& buffer, std::string& body,
+                 llvm::raw_ostream& errors) -> bool {
+  while (true) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+      return false;
+    }
+    size_t body_start = header_end + 4;
+    std::optional<size_t> length;
+    llvm::SmallVector<llvm::StringRef> headers;
+    llvm::StringRef(buffer.data(), header_end).split(headers, "\r\n");
+    for (llvm::StringRef header : headers) {
+      auto [name, value] = header.split(':');
+      size_t parsed_length = 0;
+      if (name.trim().equals_insensitive("Content-Length") &&
+          !value.trim().getAsInteger(10, parsed_length)) {
+        length = parsed_length;
+      }
+    }
+    if (!length) {
+      errors << "ERROR: Message without a Content-Length header.\n";
+      buffer.erase(0, body_start);
+      continue;
+    }
+    if (buffer.size() - body_start < *length) {
+      return false;
+    }
+    body = buffer.substr(body_start, *length);
+    buffer.erase(0, body_start + *length);
+    return true;
+  }
+}
+
+}  // namespace
+
+auto LanguageServer::Serve(int input_fd) -> bool {
+  std::string buffer;
+  std::string body;
+  while (true) {
+    while (TakeMessage(buffer, body, *error_stream_)) {
+      llvm::Expected<llvm::json::Value> message = llvm::json::parse(body);
+      if (!message) {
+        ReplyError(nullptr, ParseError, llvm::toString(message.takeError()));
+        continue;
+      }
+      if (!HandleMessage(*message)) {
+        return shut_down_;
+      }
+    }
+
+    // Waits for the next message for no longer than until the next
+    // document's diagnostics are due.
+    std::chrono::milliseconds timeout = PublishDiagnostics();
+    pollfd input = {.fd = input_fd, .events = POLLIN, .revents = 0};
+    int ready = poll(&input, 1, timeout.count() < 0 ? -1 : timeout.count());
+    if (ready < 0 && errno != EINTR) {
+      *error_stream_ << "ERROR: Unable to wait for input: "
+                     << std::strerror(errno) << "\n";
+      return false;
+    }
+    if (ready <= 0) {
+      continue;
+    }
+    char chunk[1 << 16];
+    ssize_t bytes_read = read(input_fd, chunk, sizeof(chunk));
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      // The client went away without `exit`.
+      return false;
+    }
+    buffer.append(chunk, bytes_read);
+  }
+}
+
+#else  // COCKTAIL_LANGUAGE_SERVER_SUPPORTED
+
+auto LanguageServer::Serve(int /*input_fd*/) -> bool {
+  *error_stream_ << "ERROR: The language server is not supported on this "
+                    "host.\n";
+  return false;
+}
+
+#endif  // COCKTAIL_LANGUAGE_SERVER_SUPPORTED
+
+}  // namespace Cocktail
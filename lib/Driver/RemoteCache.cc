@@ -0,0 +1,162 @@
+#include "Cocktail/Driver/RemoteCache.h"
+
+#include <cstring>
+#include <system_error>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+namespace Cocktail {
+
+// Each blob is a fixed header followed by the payload. The header is the
+// magic, the version of the format, how the payload is compressed, the size
+// of the data and a hash of it; the integers are little-endian.
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "CKREMOTE";
+constexpr uint32_t FormatVersion = 1;
+constexpr uint64_t HeaderSize = 32;
+
+enum class Compression : uint32_t {
+  None = 0,
+  Zlib = 1,
+};
+
+// Data smaller than this is stored as is, as compressing it saves little.
+constexpr uint64_t MinCompressedSize = 256;
+
+// zlib can't compress by more than this, so a blob claiming more was
+// corrupted, and isn't allowed to make us allocate what it claims.
+constexpr uint64_t MaxCompressionRatio = 1032;
+
+constexpr llvm::StringLiteral BlobSuffix = ".blob";
+constexpr llvm::StringLiteral TemporarySuffix = ".tmp";
+
+}  // namespace
+
+auto EncodeRemoteArtifact(llvm::StringRef data) -> std::string {
+  Compression compression = Compression::None;
+  llvm::SmallVector<char, 0> compressed;
+  if (data.size() >= MinCompressedSize && llvm::zlib::isAvailable()) {
+    if (llvm::Error error = llvm::zlib::compress(data, compressed)) {
+      llvm::consumeError(std::move(error));
+    } else if (compressed.size() < data.size()) {
+      compression = Compression::Zlib;
+    }
+  }
+  llvm::StringRef payload =
+      compression == Compression::None
+          ? data
+          : llvm::StringRef(compressed.data(), compressed.size());
+
+  std::string blob(HeaderSize, '\0');
+  std::memcpy(blob.data(), Magic.data(), Magic.size());
+  char* header = blob.data() + Magic.size();
+  llvm::support::endian::write32le(header, FormatVersion);
+  llvm::support::endian::write32le(header + 4,
+                                   static_cast<uint32_t>(compression));
+  llvm::support::endian::write64le(header + 8, data.size());
+  llvm::support::endian::write64le(header + 16, llvm::xxHash64(data));
+  blob += payload;
+  return blob;
+}
+
+auto DecodeRemoteArtifact(llvm::StringRef blob) -> std::optional<std::string> {
+  if (blob.size() < HeaderSize || !blob.startswith(Magic)) {
+    return std::nullopt;
+  }
+  const char* header = blob.data() + Magic.size();
+  uint32_t version = llvm::support::endian::read32le(header);
+  uint32_t compression = llvm::support::endian::read32le(header + 4);
+  uint64_t size = llvm::support::endian::read64le(header + 8);
+  uint64_t hash = llvm::support::endian::read64le(header + 16);
+  llvm::StringRef payload = blob.drop_front(HeaderSize);
+  if (version != FormatVersion) {
+    return std::nullopt;
+  }
+
+  std::string data;
+  switch (static_cast<Compression>(compression)) {
+    case Compression::None:
+      if (payload.size() != size) {
+        return std::nullopt;
+      }
+      data = payload.str();
+      break;
+    case Compression::Zlib: {
+      if (!llvm::zlib::isAvailable() ||
+          size > payload.size() * MaxCompressionRatio) {
+        return std::nullopt;
+      }
+      llvm::SmallVector<char, 0> uncompressed;
+      if (llvm::Error error =
+              llvm::zlib::uncompress(payload, uncompressed, size)) {
+        llvm::consumeError(std::move(error));
+        return std::nullopt;
+      }
+      data.assign(uncompressed.data(), uncompressed.size());
+      break;
+    }
+    default:
+      return std::nullopt;
+  }
+  if (data.size() != size || llvm::xxHash64(data) != hash) {
+    return std::nullopt;
+  }
+  return data;
+}
+
+auto DirectoryRemoteCache::Fetch(llvm::StringRef key)
+    -> std::optional<std::string> {
+  llvm::SmallString<256> path(directory_);
+  llvm::sys::path::append(path, key + BlobSuffix);
+  auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    return std::nullopt;
+  }
+  return (*buffer)->getBuffer().str();
+}
+
+auto DirectoryRemoteCache::Store(llvm::StringRef key, llvm::StringRef blob)
+    -> bool {
+  if (llvm::sys::fs::create_directories(directory_)) {
+    return false;
+  }
+  llvm::SmallString<256> temporary_model(directory_);
+  llvm::sys::path::append(temporary_model,
+                          key + "-%%%%%%%%" + TemporarySuffix);
+  llvm::SmallString<256> temporary_path;
+  int fd = -1;
+  if (llvm::sys::fs::createUniqueFile(temporary_model, fd, temporary_path)) {
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out << blob;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(temporary_path);
+      return false;
+    }
+  }
+  llvm::SmallString<256> path(directory_);
+  llvm::sys::path::append(path, key + BlobSuffix);
+  if (llvm::sys::fs::rename(temporary_path, path)) {
+    llvm::sys::fs::remove(temporary_path);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace Cocktail
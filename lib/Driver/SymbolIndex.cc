@@ -0,0 +1,310 @@
+#include "Cocktail/Driver/SymbolIndex.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "Cocktail/Common/Check.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+
+namespace Cocktail {
+
+// The index starts with a header of the magic, the version, the number of
+// files and of identifiers, a reserved field, the number of occurrences and
+// the size of the string table. The tables follow, each entry of which is a
+// multiple of 8 bytes, so every table is aligned to 8 bytes:
+//
+// - for each file, the hash of its text and the offset and size of its name,
+// - for each identifier, the offset of its name and its first occurrence,
+//   then the size of its name and the number of its occurrences,
+// - for each occurrence, its file, token, line and column,
+// - the string table.
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "CKSYMIDX";
+
+constexpr uint64_t HeaderSize = 40;
+constexpr uint64_t FileEntrySize = 24;
+constexpr uint64_t IdentifierEntrySize = 24;
+constexpr uint64_t OccurrenceEntrySize = 16;
+
+auto Read32(const char* in) -> uint32_t {
+  return llvm::support::endian::read32le(in);
+}
+
+auto Read64(const char* in) -> uint64_t {
+  return llvm::support::endian::read64le(in);
+}
+
+// Returns whether `lhs` comes before `rhs` in the occurrences of an
+// identifier.
+auto OccursBefore(const SymbolIndex::Occurrence& lhs,
+                  const SymbolIndex::Occurrence& rhs) -> bool {
+  return std::tie(lhs.file, lhs.token) < std::tie(rhs.file, rhs.token);
+}
+
+}  // namespace
+
+auto SymbolIndex::Builder::AddFile(llvm::StringRef name) -> int32_t {
+  files_.push_back({.name = name.str()});
+  return files_.size() - 1;
+}
+
+auto SymbolIndex::Builder::SetFile(int32_t file, uint64_t source_hash,
+                                   TokenizedBuffer& tokens) -> void {
+  File& entry = files_[file];
+  entry.source_hash = source_hash;
+  entry.copied_from = -1;
+  entry.occurrences.clear();
+  tokens.InternIdentifiers(identifiers_);
+  int32_t index = 0;
+  for (TokenizedBuffer::Token token : tokens.tokens()) {
+    if (tokens.GetKind(token) == TokenKind::Identifier()) {
+      entry.occurrences.push_back(
+          {tokens.GetInternedIdentifier(tokens.GetIdentifier(token)),
+           {.file = file,
+            .token = index,
+            .line = tokens.GetLineNumber(token),
+            .column = tokens.GetColumnNumber(token)}});
+    }
+    ++index;
+  }
+}
+
+auto SymbolIndex::Builder::CopyFile(int32_t file, const SymbolIndex& index,
+                                    int32_t old_file) -> void {
+  COCKTAIL_CHECK(copied_index_ == nullptr || copied_index_ == &index)
+      << "Files copied from more than one index!";
+  copied_index_ = &index;
+  File& entry = files_[file];
+  entry.source_hash = index.source_hash(old_file);
+  entry.copied_from = old_file;
+  entry.occurrences.clear();
+}
+
+auto SymbolIndex::Builder::Write(llvm::raw_ostream& output) -> void {
+  llvm::DenseMap<IdentifierTable::Id, llvm::SmallVector<Occurrence, 4>>
+      occurrences;
+  for (const File& file : files_) {
+    for (auto [id, occurrence] : file.occurrences) {
+      occurrences[id].push_back(occurrence);
+    }
+  }
+  // The copied files' occurrences are found in one pass over the old index,
+  // and interned like the rest.
+  if (copied_index_ != nullptr) {
+    llvm::SmallVector<int32_t> copies(copied_index_->file_count(), -1);
+    for (int32_t i = 0; i != static_cast<int32_t>(files_.size()); ++i) {
+      if (files_[i].copied_from >= 0) {
+        copies[files_[i].copied_from] = i;
+      }
+    }
+    copied_index_->ForEachOccurrence(
+        [&](llvm::StringRef text, Occurrence occurrence) {
+          occurrence.file = copies[occurrence.file];
+          if (occurrence.file >= 0) {
+            occurrences[identifiers_.Intern(HashedIdentifier(text))]
+                .push_back(occurrence);
+          }
+        });
+  }
+
+  struct Entry {
+    llvm::StringRef text;
+    llvm::SmallVector<Occurrence, 4>* occurrences;
+  };
+  llvm::SmallVector<Entry, 0> entries;
+  uint64_t occurrence_count = 0;
+  for (auto& [id, id_occurrences] : occurrences) {
+    llvm::sort(id_occurrences, OccursBefore);
+    entries.push_back({identifiers_.GetText(id), &id_occurrences});
+    occurrence_count += id_occurrences.size();
+  }
+  llvm::sort(entries, [](const Entry& lhs, const Entry& rhs) {
+    return lhs.text < rhs.text;
+  });
+  uint64_t strings_size = 0;
+  for (const File& file : files_) {
+    strings_size += file.name.size();
+  }
+  for (const Entry& entry : entries) {
+    strings_size += entry.text.size();
+  }
+
+  llvm::support::endian::Writer writer(output, llvm::support::little);
+  output << Magic;
+  writer.write<uint32_t>(SerializationVersion);
+  writer.write<uint32_t>(files_.size());
+  writer.write<uint32_t>(entries.size());
+  writer.write<uint32_t>(0);
+  writer.write<uint64_t>(occurrence_count);
+  writer.write<uint64_t>(strings_size);
+  uint64_t string_offset = 0;
+  for (const File& file : files_) {
+    writer.write<uint64_t>(file.source_hash);
+    writer.write<uint64_t>(string_offset);
+    writer.write<uint64_t>(file.name.size());
+    string_offset += file.name.size();
+  }
+  uint64_t first_occurrence = 0;
+  for (const Entry& entry : entries) {
+    writer.write<uint64_t>(string_offset);
+    writer.write<uint64_t>(first_occurrence);
+    writer.write<uint32_t>(entry.text.size());
+    writer.write<uint32_t>(entry.occurrences->size());
+    string_offset += entry.text.size();
+    first_occurrence += entry.occurrences->size();
+  }
+  for (const Entry& entry : entries) {
+    for (const Occurrence& occurrence : *entry.occurrences) {
+      writer.write<uint32_t>(occurrence.file);
+      writer.write<uint32_t>(occurrence.token);
+      writer.write<uint32_t>(occurrence.line);
+      writer.write<uint32_t>(occurrence.column);
+    }
+  }
+  for (const File& file : files_) {
+    output << file.name;
+  }
+  for (const Entry& entry : entries) {
+    output << entry.text;
+  }
+}
+
+auto SymbolIndex::Open(llvm::StringRef data) -> std::optional<SymbolIndex> {
+  if (data.size() < HeaderSize || !data.startswith(Magic) ||
+      Read32(data.data() + 8) != SerializationVersion) {
+    return std::nullopt;
+  }
+  const char* header = data.data();
+  uint32_t file_count = Read32(header + 12);
+  uint32_t identifier_count = Read32(header + 16);
+  uint64_t occurrence_count = Read64(header + 24);
+  uint64_t strings_size = Read64(header + 32);
+  if (file_count > INT32_MAX || identifier_count > INT32_MAX) {
+    return std::nullopt;
+  }
+  // Each table is checked against what's left, so that no size overflows.
+  uint64_t rest = data.size() - HeaderSize;
+  for (auto [count, entry_size] :
+       {std::pair{uint64_t{file_count}, FileEntrySize},
+        std::pair{uint64_t{identifier_count}, IdentifierEntrySize},
+        std::pair{occurrence_count, OccurrenceEntrySize},
+        std::pair{strings_size, uint64_t{1}}}) {
+    if (count > rest / entry_size) {
+      return std::nullopt;
+    }
+    rest -= count * entry_size;
+  }
+
+  SymbolIndex index;
+  index.file_count_ = file_count;
+  index.identifier_count_ = identifier_count;
+  index.occurrence_count_ = occurrence_count;
+  index.files_ = header + HeaderSize;
+  index.identifiers_ = index.files_ + file_count * FileEntrySize;
+  index.occurrences_ =
+      index.identifiers_ + identifier_count * IdentifierEntrySize;
+  index.strings_ = llvm::StringRef(
+      index.occurrences_ + occurrence_count * OccurrenceEntrySize,
+      strings_size);
+  return index;
+}
+
+auto SymbolIndex::Lookup(llvm::StringRef identifier) const
+    -> llvm::SmallVector<Occurrence> {
+  int32_t low = 0;
+  int32_t high = identifier_count_;
+  while (low < high) {
+    int32_t middle = low + (high - low) / 2;
+    if (GetIdentifier(middle) < identifier) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  llvm::SmallVector<Occurrence> occurrences;
+  if (low == identifier_count_ || GetIdentifier(low) != identifier) {
+    return occurrences;
+  }
+  auto [begin, end] = GetOccurrences(low);
+  for (uint64_t i = begin; i != end; ++i) {
+    Occurrence occurrence = GetOccurrence(i);
+    if (occurrence.file >= 0 && occurrence.file < file_count_) {
+      occurrences.push_back(occurrence);
+    }
+  }
+  return occurrences;
+}
+
+auto SymbolIndex::ForEachOccurrence(
+    llvm::function_ref<auto(llvm::StringRef, Occurrence)->void> callback) const
+    -> void {
+  for (int32_t identifier = 0; identifier != identifier_count_;
+       ++identifier) {
+    llvm::StringRef text = GetIdentifier(identifier);
+    auto [begin, end] = GetOccurrences(identifier);
+    for (uint64_t i = begin; i != end; ++i) {
+      Occurrence occurrence = GetOccurrence(i);
+      if (occurrence.file >= 0 && occurrence.file < file_count_) {
+        callback(text, occurrence);
+      }
+    }
+  }
+}
+
+auto SymbolIndex::FindFile(llvm::StringRef name) const
+    -> std::optional<int32_t> {
+  for (int32_t file = 0; file != file_count_; ++file) {
+    if (file_name(file) == name) {
+      return file;
+    }
+  }
+  return std::nullopt;
+}
+
+auto SymbolIndex::file_name(int32_t file) const -> llvm::StringRef {
+  const char* entry = files_ + file * FileEntrySize;
+  return GetString(Read64(entry + 8), Read64(entry + 16));
+}
+
+auto SymbolIndex::source_hash(int32_t file) const -> uint64_t {
+  return Read64(files_ + file * FileEntrySize);
+}
+
+auto SymbolIndex::GetString(uint64_t offset, uint64_t size) const
+    -> llvm::StringRef {
+  if (offset > strings_.size() || size > strings_.size() - offset) {
+    return "";
+  }
+  return strings_.substr(offset, size);
+}
+
+auto SymbolIndex::GetIdentifier(int32_t identifier) const -> llvm::StringRef {
+  const char* entry = identifiers_ + identifier * IdentifierEntrySize;
+  return GetString(Read64(entry), Read32(entry + 16));
+}
+
+auto SymbolIndex::GetOccurrences(int32_t identifier) const
+    -> std::pair<uint64_t, uint64_t> {
+  const char* entry = identifiers_ + identifier * IdentifierEntrySize;
+  uint64_t begin = Read64(entry + 8);
+  uint64_t count = Read32(entry + 20);
+  if (begin > occurrence_count_) {
+    return {0, 0};
+  }
+  return {begin, begin + std::min(count, occurrence_count_ - begin)};
+}
+
+auto SymbolIndex::GetOccurrence(uint64_t occurrence) const -> Occurrence {
+  const char* entry = occurrences_ + occurrence * OccurrenceEntrySize;
+  return {.file = static_cast<int32_t>(Read32(entry)),
+          .token = static_cast<int32_t>(Read32(entry + 4)),
+          .line = static_cast<int32_t>(Read32(entry + 8)),
+          .column = static_cast<int32_t>(Read32(entry + 12))};
+}
+
+}  // namespace Cocktail
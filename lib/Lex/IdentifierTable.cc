@@ -0,0 +1,84 @@
+#include "Cocktail/Lexer/IdentifierTable.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Cocktail/Common/Check.h"
+
+namespace Cocktail {
+
+auto IdentifierTable::InternLocked(Shard& shard, int shard_index,
+                                   HashedIdentifier identifier) -> Id {
+  auto it = shard.map.find(identifier);
+  if (it == shard.map.end()) {
+    COCKTAIL_CHECK(shard.texts.size() <
+                   std::numeric_limits<int32_t>::max() / NumShards)
+        << "Too many identifiers in one table!";
+    // The table keeps its own copy of the text, so the key stays valid after
+    // the source is gone.
+    llvm::StringRef text = identifier.text.copy(shard.allocator);
+    it = shard.map
+             .insert({HashedIdentifier(text, identifier.hash),
+                      static_cast<int32_t>(shard.texts.size())})
+             .first;
+    shard.texts.push_back(text);
+  }
+  return Id(it->second * NumShards + shard_index);
+}
+
+auto IdentifierTable::Intern(HashedIdentifier identifier) -> Id {
+  int shard_index = GetShardIndex(identifier.hash);
+  Shard& shard = shards_[shard_index];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return InternLocked(shard, shard_index, identifier);
+}
+
+auto IdentifierTable::Intern(llvm::ArrayRef<HashedIdentifier> identifiers,
+                             llvm::MutableArrayRef<Id> ids) -> void {
+  COCKTAIL_CHECK(identifiers.size() == ids.size())
+      << "Need one ID for each identifier!";
+  // Group the identifiers by shard, so each shard is locked once.
+  std::array<int, NumShards + 1> shard_starts = {};
+  for (const HashedIdentifier& identifier : identifiers) {
+    ++shard_starts[GetShardIndex(identifier.hash) + 1];
+  }
+  for (int i = 0; i != NumShards; ++i) {
+    shard_starts[i + 1] += shard_starts[i];
+  }
+  std::array<int, NumShards> shard_ends;
+  std::copy(shard_starts.begin(), shard_starts.end() - 1, shard_ends.begin());
+  llvm::SmallVector<int, 0> order(identifiers.size());
+  for (int i = 0, size = identifiers.size(); i != size; ++i) {
+    order[shard_ends[GetShardIndex(identifiers[i].hash)]++] = i;
+  }
+
+  for (int shard_index = 0; shard_index != NumShards; ++shard_index) {
+    if (shard_starts[shard_index] == shard_starts[shard_index + 1]) {
+      continue;
+    }
+    Shard& shard = shards_[shard_index];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (int i = shard_starts[shard_index]; i != shard_starts[shard_index + 1];
+         ++i) {
+      ids[order[i]] = InternLocked(shard, shard_index, identifiers[order[i]]);
+    }
+  }
+}
+
+auto IdentifierTable::GetText(Id id) const -> llvm::StringRef {
+  COCKTAIL_CHECK(id.index_ >= 0) << "Invalid identifier ID!";
+  const Shard& shard = shards_[id.index_ % NumShards];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.texts[id.index_ / NumShards];
+}
+
+auto IdentifierTable::size() const -> int {
+  int size = 0;
+  for (const Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.texts.size();
+  }
+  return size;
+}
+
+}  // namespace Cocktail
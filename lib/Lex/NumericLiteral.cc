@@ -5,7 +5,9 @@
 #include "Cocktail/Common/CharacterSet.h"
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Lexer/LexHelpers.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/FormatVariadic.h"
 
 namespace Cocktail {
@@ -81,9 +83,7 @@ class LexedNumericLiteral::Parser {
  public:
   Parser(DiagnosticEmitter<const char*>& emitter, LexedNumericLiteral literal);
 
-  auto IsInteger() -> bool {
-    return literal_.radix_point_ == static_cast<int>(literal_.text_.size());
-  }
+  auto IsInteger() -> bool { return literal_.is_integer(); }
 
   auto Check() -> bool;
 
@@ -152,9 +152,77 @@ auto LexedNumericLiteral::Parser::Check() -> bool {
          CheckExponentPart();
 }
 
+// Returns whether all eight bytes of `chunk` are decimal digits.
+static auto IsEightDecimalDigits(uint64_t chunk) -> bool {
+  return (((chunk + 0x4646464646464646) | (chunk - 0x3030303030303030)) &
+          0x8080808080808080) == 0;
+}
+
+// Returns the value of eight decimal digits loaded little-endian into `chunk`,
+// combining adjacent digits, then pairs, then quads.
+static auto ParseEightDecimalDigits(uint64_t chunk) -> uint64_t {
+  chunk -= 0x3030303030303030;
+  chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FF;
+  chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFF;
+  return (chunk * 10000 + (chunk >> 32)) & 0xFFFFFFFF;
+}
+
+// Parses `digits` directly into a `uint64_t` when there are few enough digits
+// that the value can't overflow, skipping digit separators and any radix point
+// in place. Otherwise returns `llvm::None`.
+static auto ParseSmallInteger(llvm::StringRef digits,
+                              LexedNumericLiteral::Radix radix,
+                              bool needs_cleaning) -> llvm::Optional<uint64_t> {
+  int max_digits = 0;
+  switch (radix) {
+    case LexedNumericLiteral::Radix::Binary:
+      max_digits = 64;
+      break;
+    case LexedNumericLiteral::Radix::Decimal:
+      max_digits = 19;
+      break;
+    case LexedNumericLiteral::Radix::Hexadecimal:
+      max_digits = 16;
+      break;
+  }
+  int num_digits =
+      needs_cleaning
+          ? llvm::count_if(digits, [](char c) { return c != '_' && c != '.'; })
+          : digits.size();
+  if (num_digits > max_digits) {
+    return llvm::None;
+  }
+
+  uint64_t value = 0;
+  while (!digits.empty()) {
+    if (radix == LexedNumericLiteral::Radix::Decimal && digits.size() >= 8) {
+      uint64_t chunk = llvm::support::endian::read64le(digits.data());
+      if (IsEightDecimalDigits(chunk)) {
+        value = value * 100000000 + ParseEightDecimalDigits(chunk);
+        digits = digits.drop_front(8);
+        continue;
+      }
+    }
+    char c = digits.front();
+    digits = digits.drop_front(1);
+    if (c == '_' || c == '.') {
+      continue;
+    }
+    value = value * static_cast<int>(radix) + llvm::hexDigitValue(c);
+  }
+  return value;
+}
+
 static auto ParseInteger(llvm::StringRef digits,
                          LexedNumericLiteral::Radix radix, bool needs_cleaning)
     -> llvm::APInt {
+  if (llvm::Optional<uint64_t> value =
+          ParseSmallInteger(digits, radix, needs_cleaning)) {
+    // One bit wider than the value, so that like those of the slow path, it
+    // isn't negative to signed consumers.
+    return llvm::APInt(65, *value);
+  }
+
   llvm::SmallString<32> cleaned;
   if (needs_cleaning) {
     cleaned.reserve(digits.size());
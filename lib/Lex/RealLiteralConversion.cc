@@ -0,0 +1,385 @@
+#include "Cocktail/Lexer/RealLiteralConversion.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MathExtras.h"
+
+namespace Cocktail {
+
+namespace {
+
+// The layout of an IEEE floating-point type.
+template <typename FloatT>
+struct FloatFormat;
+
+template <>
+struct FloatFormat<double> {
+  using Bits = uint64_t;
+  static constexpr int MantissaBits = 52;
+  static constexpr int ExponentBias = 1023;
+  static constexpr int InfiniteExponent = 0x7FF;
+  // Powers of ten for which a `double` holds every integer up to
+  // `MaxExactMantissa` times them exactly.
+  static constexpr int MaxExactPowerOfTen = 22;
+  static constexpr uint64_t MaxExactMantissa = uint64_t{1} << 53;
+  // A decimal literal whose mantissa fits in 64 bits is zero below this power
+  // of ten and infinite above that one.
+  static constexpr int MinPowerOfTen = -342;
+  static constexpr int MaxPowerOfTen = 308;
+  // Ties can only arise from powers of ten in this range.
+  static constexpr int MinRoundToEvenPowerOfTen = -4;
+  static constexpr int MaxRoundToEvenPowerOfTen = 23;
+  static auto Semantics() -> const llvm::fltSemantics& {
+    return llvm::APFloat::IEEEdouble();
+  }
+};
+
+template <>
+struct FloatFormat<float> {
+  using Bits = uint32_t;
+  static constexpr int MantissaBits = 23;
+  static constexpr int ExponentBias = 127;
+  static constexpr int InfiniteExponent = 0xFF;
+  static constexpr int MaxExactPowerOfTen = 10;
+  static constexpr uint64_t MaxExactMantissa = uint64_t{1} << 24;
+  static constexpr int MinPowerOfTen = -64;
+  static constexpr int MaxPowerOfTen = 38;
+  static constexpr int MinRoundToEvenPowerOfTen = -17;
+  static constexpr int MaxRoundToEvenPowerOfTen = 10;
+  static auto Semantics() -> const llvm::fltSemantics& {
+    return llvm::APFloat::IEEEsingle();
+  }
+};
+
+template <typename FloatT>
+auto FromBits(typename FloatFormat<FloatT>::Bits bits) -> FloatT {
+  FloatT value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+template <typename FloatT>
+auto Infinity() -> FloatT {
+  return std::numeric_limits<FloatT>::infinity();
+}
+
+// Exponents are clamped to this, far beyond where any literal is zero or
+// infinite, so that adjusting them can't overflow.
+constexpr int64_t MaxExponent = int64_t{1} << 60;
+
+auto ClampExponent(const llvm::APInt& exponent) -> int64_t {
+  if (exponent.getMinSignedBits() > 64) {
+    return exponent.isNegative() ? -MaxExponent : MaxExponent;
+  }
+  return std::clamp(exponent.getSExtValue(), -MaxExponent, MaxExponent);
+}
+
+// The top 64 bits of a value, shifted so that the top one is set, and
+// whether any bits below them are set.
+struct Normalized {
+  uint64_t bits;
+  bool sticky;
+};
+
+auto NormalizeTo64Bits(const llvm::APInt& value) -> Normalized {
+  unsigned active_bits = value.getActiveBits();
+  if (active_bits <= 64) {
+    return {.bits = value.getZExtValue() << (64 - active_bits),
+            .sticky = false};
+  }
+  unsigned shift = active_bits - 64;
+  return {.bits = value.lshr(shift).getZExtValue(),
+          .sticky = value.countTrailingZeros() < shift};
+}
+
+// Returns `bits * 2^exponent`, where the top bit of `bits` is set and
+// `sticky` says whether the value continues below it, rounded to `FloatT`.
+template <typename FloatT>
+auto AssembleBinary(uint64_t bits, bool sticky, int64_t exponent) -> FloatT {
+  using Format = FloatFormat<FloatT>;
+  using Bits = typename Format::Bits;
+  // The biased exponent of the top bit.
+  int64_t biased = exponent + 63 + Format::ExponentBias;
+  if (biased >= Format::InfiniteExponent) {
+    return Infinity<FloatT>();
+  }
+  // How many of the low bits don't fit, more for subnormals.
+  int64_t drop = 63 - Format::MantissaBits + (biased <= 0 ? 1 - biased : 0);
+  if (drop > 64) {
+    return 0;
+  }
+  uint64_t kept = drop == 64 ? 0 : bits >> drop;
+  uint64_t half = uint64_t{1} << (drop - 1);
+  // With `drop` at 64, `half << 1` wraps to zero and this keeps every bit.
+  uint64_t rest = bits & ((half << 1) - 1);
+  if (rest > half || (rest == half && (sticky || (kept & 1) != 0))) {
+    ++kept;
+  }
+  constexpr uint64_t Hidden = uint64_t{1} << Format::MantissaBits;
+  if (biased <= 0) {
+    // A subnormal, which rounding up can make the smallest normal number,
+    // with its exponent field then correctly one.
+    return FromBits<FloatT>(static_cast<Bits>(kept));
+  }
+  if (kept == Hidden << 1) {
+    kept >>= 1;
+    ++biased;
+    if (biased >= Format::InfiniteExponent) {
+      return Infinity<FloatT>();
+    }
+  }
+  return FromBits<FloatT>(static_cast<Bits>(
+      (static_cast<uint64_t>(biased) << Format::MantissaBits) |
+      (kept & (Hidden - 1))));
+}
+
+// The powers of five from `5^-342` to `5^308`, each normalized to 128 bits
+// as the Eisel-Lemire algorithm needs them: truncated for the positive
+// powers, and for the negative ones the reciprocal's truncation, plus one.
+struct PowerOfFive {
+  uint64_t high;
+  uint64_t low;
+};
+
+constexpr int MinPowerOfFive = FloatFormat<double>::MinPowerOfTen;
+constexpr int MaxPowerOfFive = FloatFormat<double>::MaxPowerOfTen;
+
+auto ComputePowersOfFive() -> std::vector<PowerOfFive> {
+  // Wide enough for `2^(2 * 795 + 128)`, as `5^342` has 795 bits.
+  constexpr unsigned Width = 2048;
+  std::vector<PowerOfFive> powers;
+  powers.reserve(MaxPowerOfFive - MinPowerOfFive + 1);
+  auto add = [&](const llvm::APInt& power) {
+    powers.push_back({.high = power.extractBitsAsZExtValue(64, 64),
+                      .low = power.extractBitsAsZExtValue(64, 0)});
+  };
+  llvm::SmallVector<llvm::APInt, 0> negative_powers;
+  negative_powers.push_back(llvm::APInt(Width, 5));
+  while (static_cast<int>(negative_powers.size()) < -MinPowerOfFive) {
+    negative_powers.push_back(negative_powers.back() * 5);
+  }
+  for (int q = MinPowerOfFive; q < 0; ++q) {
+    const llvm::APInt& power = negative_powers[-q - 1];
+    unsigned z = power.getActiveBits();
+    unsigned b = q >= -27 ? z + 127 : 2 * z + 128;
+    llvm::APInt reciprocal = llvm::APInt::getOneBitSet(Width, b).udiv(power);
+    ++reciprocal;
+    unsigned active_bits = reciprocal.getActiveBits();
+    if (active_bits > 128) {
+      reciprocal.lshrInPlace(active_bits - 128);
+    }
+    add(reciprocal);
+  }
+  llvm::APInt power(Width, 1);
+  for (int q = 0; q <= MaxPowerOfFive; ++q) {
+    unsigned active_bits = power.getActiveBits();
+    add(active_bits > 128 ? power.lshr(active_bits - 128)
+                          : power.shl(128 - active_bits));
+    power *= 5;
+  }
+  return powers;
+}
+
+auto GetPowerOfFive(int q) -> const PowerOfFive& {
+  static const std::vector<PowerOfFive> powers = ComputePowersOfFive();
+  return powers[q - MinPowerOfFive];
+}
+
+struct Product {
+  uint64_t high;
+  uint64_t low;
+};
+
+auto Multiply(uint64_t a, uint64_t b) -> Product {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  return {.high = static_cast<uint64_t>(product >> 64),
+          .low = static_cast<uint64_t>(product)};
+#else
+  uint64_t a_low = a & 0xFFFFFFFF;
+  uint64_t a_high = a >> 32;
+  uint64_t b_low = b & 0xFFFFFFFF;
+  uint64_t b_high = b >> 32;
+  uint64_t low_low = a_low * b_low;
+  uint64_t high_low = a_high * b_low;
+  uint64_t low_high = a_low * b_high;
+  uint64_t middle = (low_low >> 32) + (high_low & 0xFFFFFFFF) +
+                    (low_high & 0xFFFFFFFF);
+  return {.high = a_high * b_high + (high_low >> 32) + (low_high >> 32) +
+                  (middle >> 32),
+          .low = (middle << 32) | (low_low & 0xFFFFFFFF)};
+#endif
+}
+
+// Returns `w * 10^q * 2^binary_exponent` rounded to `FloatT` by the
+// Eisel-Lemire algorithm, where `w` is nonzero and `q` is in the range of
+// `PowerOfFive`s. Mushtak and Lemire showed that, with the whole product
+// computed when its top bits are ambiguous, this is always correctly rounded.
+template <typename FloatT>
+auto EiselLemire(uint64_t w, int64_t q, int64_t binary_exponent) -> FloatT {
+  using Format = FloatFormat<FloatT>;
+  using Bits = typename Format::Bits;
+  constexpr int Precision = Format::MantissaBits + 3;
+  int leading_zeros = llvm::countLeadingZeros(w);
+  w <<= leading_zeros;
+
+  // The top `Precision` bits of `w * 5^q` are all that is needed, and the
+  // first half of the power of five is almost always enough to get them.
+  const PowerOfFive& power = GetPowerOfFive(q);
+  Product product = Multiply(w, power.high);
+  constexpr uint64_t PrecisionMask = ~uint64_t{0} >> Precision;
+  if ((product.high & PrecisionMask) == PrecisionMask) {
+    Product second = Multiply(w, power.low);
+    product.low += second.high;
+    if (second.high > product.low) {
+      ++product.high;
+    }
+  }
+
+  int upper_bit = product.high >> 63;
+  int shift = upper_bit + 64 - Precision;
+  uint64_t mantissa = product.high >> shift;
+  // `floor(q * log2(10))`, exact over the range of `q`.
+  int64_t power2 = (((152170 + 65536) * q) >> 16) + 63 + upper_bit -
+                   leading_zeros + Format::ExponentBias + binary_exponent;
+  if (power2 <= 0) {
+    if (-power2 + 1 >= 64) {
+      return FloatT(0);
+    }
+    mantissa >>= -power2 + 1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    // Rounding up may make this the smallest normal number, whose exponent
+    // field is then correctly one.
+    return FromBits<FloatT>(static_cast<Bits>(mantissa));
+  }
+  // A product that is exactly halfway between two values rounds to even,
+  // rather than up as below.
+  if (product.low <= 1 && q >= Format::MinRoundToEvenPowerOfTen &&
+      q <= Format::MaxRoundToEvenPowerOfTen && (mantissa & 3) == 1 &&
+      (mantissa << shift) == product.high) {
+    mantissa &= ~uint64_t{1};
+  }
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  constexpr uint64_t Hidden = uint64_t{1} << Format::MantissaBits;
+  if (mantissa >= Hidden << 1) {
+    mantissa = Hidden;
+    ++power2;
+  }
+  if (power2 >= Format::InfiniteExponent) {
+    return Infinity<FloatT>();
+  }
+  return FromBits<FloatT>(static_cast<Bits>(
+      (static_cast<uint64_t>(power2) << Format::MantissaBits) |
+      (mantissa & (Hidden - 1))));
+}
+
+// Converts by way of `llvm::APFloat`, which is exact but slow.
+template <typename FloatT>
+auto ConvertDecimalExactly(const llvm::APInt& mantissa, int64_t exponent)
+    -> FloatT {
+  llvm::SmallString<64> text;
+  mantissa.toStringUnsigned(text, 10);
+  text += 'e';
+  text += std::to_string(exponent);
+  llvm::APFloat value(FloatFormat<FloatT>::Semantics());
+  auto status =
+      value.convertFromString(text, llvm::APFloat::rmNearestTiesToEven);
+  if (!status) {
+    llvm::consumeError(status.takeError());
+    return 0;
+  }
+  if constexpr (std::is_same_v<FloatT, double>) {
+    return value.convertToDouble();
+  } else {
+    return value.convertToFloat();
+  }
+}
+
+template <typename FloatT>
+auto ConvertDecimal(const llvm::APInt& mantissa, int64_t exponent) -> FloatT {
+  using Format = FloatFormat<FloatT>;
+  if (mantissa.isZero()) {
+    return 0;
+  }
+  if (mantissa.getActiveBits() <= 64) {
+    uint64_t w = mantissa.getZExtValue();
+    // Both `w` and the power of ten are exact, and so is what is computed
+    // from them.
+    if (w <= Format::MaxExactMantissa &&
+        exponent >= -Format::MaxExactPowerOfTen &&
+        exponent <= Format::MaxExactPowerOfTen) {
+      constexpr FloatT PowersOfTen[] = {
+          1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+          1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+          1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+      FloatT value = static_cast<FloatT>(w);
+      return exponent < 0 ? value / PowersOfTen[-exponent]
+                          : value * PowersOfTen[exponent];
+    }
+    if (exponent < Format::MinPowerOfTen) {
+      return 0;
+    }
+    if (exponent > Format::MaxPowerOfTen) {
+      return Infinity<FloatT>();
+    }
+    return EiselLemire<FloatT>(w, exponent, 0);
+  }
+
+  // The literal lies between its top 64 bits and the next value above, scaled
+  // by the bits below; when both round the same way, so does the literal.
+  // Otherwise, which is rare, it is converted exactly.
+  if (exponent >= MinPowerOfFive && exponent <= MaxPowerOfFive) {
+    unsigned shift = mantissa.getActiveBits() - 64;
+    uint64_t w = mantissa.lshr(shift).getZExtValue();
+    FloatT value = EiselLemire<FloatT>(w, exponent, shift);
+    if (mantissa.countTrailingZeros() >= shift ||
+        (w != ~uint64_t{0} &&
+         EiselLemire<FloatT>(w + 1, exponent, shift) == value)) {
+      return value;
+    }
+  }
+  return ConvertDecimalExactly<FloatT>(mantissa, exponent);
+}
+
+template <typename FloatT>
+auto Convert(const llvm::APInt& mantissa, const llvm::APInt& exponent,
+             bool is_decimal) -> FloatT {
+  int64_t clamped_exponent = ClampExponent(exponent);
+  if (is_decimal) {
+    return ConvertDecimal<FloatT>(mantissa, clamped_exponent);
+  }
+  if (mantissa.isZero()) {
+    return 0;
+  }
+  Normalized normalized = NormalizeTo64Bits(mantissa);
+  return AssembleBinary<FloatT>(
+      normalized.bits, normalized.sticky,
+      clamped_exponent + static_cast<int64_t>(mantissa.getActiveBits()) - 64);
+}
+
+}  // namespace
+
+auto RealLiteralToDouble(const llvm::APInt& mantissa,
+                         const llvm::APInt& exponent, bool is_decimal)
+    -> double {
+  return Convert<double>(mantissa, exponent, is_decimal);
+}
+
+auto RealLiteralToFloat(const llvm::APInt& mantissa,
+                        const llvm::APInt& exponent, bool is_decimal)
+    -> float {
+  return Convert<float>(mantissa, exponent, is_decimal);
+}
+
+}  // namespace Cocktail
@@ -1,5 +1,8 @@
 #include "Cocktail/Lex/StringLiteral.h"
 
+#include <algorithm>
+
+#include "Cocktail/Common/ByteVector.h"
 #include "Cocktail/Common/CharacterSet.h"
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
@@ -63,17 +66,34 @@ auto StringLiteral::Introducer::Lex(llvm::StringRef source_text)
 }
 
 namespace {
-struct alignas(8) CharSet {
-  bool Elements[UCHAR_MAX + 1];
-
-  constexpr CharSet(std::initializer_list<char> chars) : Elements() {
-    for (char c : chars) {
-      Elements[static_cast<unsigned char>(c)] = true;
-    }
+// 匹配字符串字面量中不需要特殊处理的字符，
+// 即除 `\\`、`\n`、`"` 和 `'` 以外的字符。
+struct PlainStringCharMatcher {
+#if COCKTAIL_BYTE_VECTORS
+  static auto Match(ByteVector bytes) -> ByteVector {
+    return BytesNot(BytesOr(BytesOr(BytesEqual(bytes, SplatByte('\\')),
+                                    BytesEqual(bytes, SplatByte('\n'))),
+                            BytesOr(BytesEqual(bytes, SplatByte('"')),
+                                    BytesEqual(bytes, SplatByte('\'')))));
+  }
+#endif
+  static auto Match(char c) -> bool {
+    return c != '\\' && c != '\n' && c != '"' && c != '\'';
   }
+};
 
-  constexpr auto operator[](char c) const -> bool {
-    return Elements[static_cast<unsigned char>(c)];
+// 匹配计算字符串值时可以原样复制的字符，
+// 即除 `\\`、`\n` 和制表符以外的字符。
+struct VerbatimValueCharMatcher {
+#if COCKTAIL_BYTE_VECTORS
+  static auto Match(ByteVector bytes) -> ByteVector {
+    return BytesNot(BytesOr(BytesOr(BytesEqual(bytes, SplatByte('\\')),
+                                    BytesEqual(bytes, SplatByte('\n'))),
+                            BytesEqual(bytes, SplatByte('\t'))));
+  }
+#endif
+  static auto Match(char c) -> bool {
+    return c != '\\' && c != '\n' && c != '\t';
   }
 };
 }  // namespace
@@ -108,10 +128,10 @@ auto StringLiteral::Lex(llvm::StringRef source_text)
 
   /// TODO: 在找到终结符之前检测多行字符串字面量的缩进/反缩进。
   for (; cursor < source_text_size; ++cursor) {
-    // 快速跳过不感兴趣的字符。
-    static constexpr CharSet InterestingChars = {'\\', '\n', '"', '\''};
-    if (!InterestingChars[source_text[cursor]]) {
-      continue;
+    // 按向量批量跳过不感兴趣的字符。
+    cursor += ScanWhile<PlainStringCharMatcher>(source_text.substr(cursor));
+    if (cursor == source_text_size) {
+      break;
     }
 
     // 多字符的终结符和转义序列都以可预测的字符开始，
@@ -191,10 +211,50 @@ auto StringLiteral::Lex(llvm::StringRef source_text)
     return indent;
   }
 
+  // A string value written directly into a buffer of fixed capacity, such as
+  // one obtained from an allocator. The value of a string literal is never
+  // longer than its content, so the content's size is always enough.
+  class FixedStringBuffer {
+   public:
+    FixedStringBuffer(char* data, size_t capacity)
+        : data_(data), capacity_(capacity) {}
+
+    auto operator+=(char c) -> FixedStringBuffer& {
+      COCKTAIL_DCHECK(size_ < capacity_);
+      data_[size_++] = c;
+      return *this;
+    }
+
+    auto operator+=(llvm::StringRef text) -> FixedStringBuffer& {
+      append(text.begin(), text.end());
+      return *this;
+    }
+
+    auto append(const char* begin, const char* end) -> void {
+      COCKTAIL_DCHECK(size_ + (end - begin) <= capacity_);
+      std::copy(begin, end, data_ + size_);
+      size_ += end - begin;
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return size_ == 0; }
+    [[nodiscard]] auto back() const -> char { return data_[size_ - 1]; }
+    auto pop_back() -> void { --size_; }
+
+    [[nodiscard]] auto str() const -> llvm::StringRef {
+      return llvm::StringRef(data_, size_);
+    }
+
+   private:
+    char* data_;
+    size_t capacity_;
+    size_t size_ = 0;
+  };
+
   // Expand a `\u{HHHHHH}` escape sequence into a sequence of UTF-8 code units.
+  template <typename ResultT>
   static auto ExpandUnicodeEscapeSequence(LexerDiagnosticEmitter & emitter,
                                           llvm::StringRef digits,
-                                          std::string & result)
+                                          ResultT & result)
       ->bool {
     unsigned code_point;
     if (!CanLexInteger(emitter, digits)) {
@@ -226,14 +286,15 @@ auto StringLiteral::Lex(llvm::StringRef source_text)
     if (conv_result != llvm::conversionOK) {
       llvm_unreachable("conversion of valid code point to UTF-8 cannot fail");
     }
-    result.insert(result.end(), reinterpret_cast<char*>(utf8_code_units),
+    result.append(reinterpret_cast<char*>(utf8_code_units),
                   reinterpret_cast<char*>(dest_pos));
     return true;
   }
 
+  template <typename ResultT>
   static auto ExpandAndConsumeEscapeSequence(LexerDiagnosticEmitter & emitter,
                                              llvm::StringRef & content,
-                                             std::string & result)
+                                             ResultT & result)
       ->void {
     COCKTAIL_CHECK(!content.empty()) << "should have escaped closing delimiter";
     char first = content.front();
@@ -313,14 +374,13 @@ auto StringLiteral::Lex(llvm::StringRef source_text)
     result += first;
   }
 
-  // Expand any escape sequences in the given string literal.
+  // Expand any escape sequences in the given string literal and remove its
+  // indentation, appending the value to `result` in a single pass.
+  template <typename ResultT>
   static auto ExpandEscapeSequencesAndRemoveIndent(
       LexerDiagnosticEmitter & emitter, llvm::StringRef contents,
-      int hash_level, llvm::StringRef indent)
-      ->std::string {
-    std::string result;
-    result.reserve(contents.size());
-
+      int hash_level, llvm::StringRef indent, ResultT & result)
+      ->void {
     llvm::SmallString<16> escape("\\");
     escape.resize(1 + hash_level, '#');
 
@@ -338,15 +398,13 @@ auto StringLiteral::Lex(llvm::StringRef source_text)
       }
 
       while (true) {
-        auto end_of_regular_text = contents.find_if([](char c) {
-          return c == '\n' || c == '\\' ||
-                 (IsHorizontalWhitespace(c) && c != ' ');
-        });
+        auto end_of_regular_text =
+            ScanWhile<VerbatimValueCharMatcher>(contents);
         result += contents.substr(0, end_of_regular_text);
         contents = contents.substr(end_of_regular_text);
 
         if (contents.empty()) {
-          return result;
+          return;
         }
 
         if (contents.consume_front("\n")) {
@@ -397,7 +455,31 @@ auto StringLiteral::Lex(llvm::StringRef source_text)
     }
     llvm::StringRef indent =
         multi_line_ ? CheckIndent(emitter, text_, content_) : llvm::StringRef();
-    return ExpandEscapeSequencesAndRemoveIndent(emitter, content_, hash_level_,
-                                                indent);
+    std::string result;
+    result.reserve(content_.size());
+    ExpandEscapeSequencesAndRemoveIndent(emitter, content_, hash_level_, indent,
+                                         result);
+    return result;
+  }
+
+  auto LexedStringLiteral::ComputeValue(llvm::BumpPtrAllocator & allocator,
+                                        LexerDiagnosticEmitter & emitter)
+      const->llvm::StringRef {
+    if (!is_terminated_) {
+      return "";
+    }
+    // Only escapes, indentation and whitespace other than plain spaces need
+    // the content to be rewritten.
+    if (!multi_line_ &&
+        ScanWhile<VerbatimValueCharMatcher>(content_) == content_.size()) {
+      return content_;
+    }
+    llvm::StringRef indent =
+        multi_line_ ? CheckIndent(emitter, text_, content_) : llvm::StringRef();
+    FixedStringBuffer result(allocator.Allocate<char>(content_.size()),
+                             content_.size());
+    ExpandEscapeSequencesAndRemoveIndent(emitter, content_, hash_level_, indent,
+                                         result);
+    return result.str();
   }
 }  // namespace Cocktail::Lex
\ No newline at end of file
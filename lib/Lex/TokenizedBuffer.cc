@@ -2,25 +2,38 @@
 
 #include <algorithm>
 #include <array>
+#include <climits>
 #include <cmath>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <numeric>
 #include <string>
 
+#include "Cocktail/Common/ByteVector.h"
 #include "Cocktail/Common/CharacterSet.h"
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Common/StringHelpers.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
 #include "Cocktail/Lexer/LexHelpers.h"
 #include "Cocktail/Lexer/NumericLiteral.h"
+#include "Cocktail/Lexer/RealLiteralConversion.h"
 #include "Cocktail/Lexer/StringLiteral.h"
 #include "Cocktail/Lexer/TokenKind.h"
+#include "Cocktail/Lexer/UnicodeIdentifier.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Sequence.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
-#include "llvm/ADT/StringSwitch.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/ADT/bit.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace Cocktail {
@@ -38,6 +51,219 @@ auto VariantMatch(V&& v, Fs&&... fs) -> decltype(auto) {
   return std::visit(Overload{std::forward<Fs>(fs)...}, std::forward<V>(v));
 }
 
+namespace {
+
+// The kind and spelling of every symbol token, in registry order. The registry
+// lists every spelling before any spelling that is a prefix of it, so the first
+// match found in this order is the longest one.
+constexpr TokenKind SymbolTokenKinds[] = {
+#define COCKTAIL_SYMBOL_TOKEN(Name, Spelling) TokenKind::Name(),
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+constexpr llvm::StringLiteral SymbolTokenSpellings[] = {
+#define COCKTAIL_SYMBOL_TOKEN(Name, Spelling) Spelling,
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+constexpr unsigned char SymbolTokenFirstBytes[] = {
+#define COCKTAIL_SYMBOL_TOKEN(Name, Spelling) Spelling[0],
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+constexpr int NumSymbolTokens = std::size(SymbolTokenKinds);
+
+// A precomputed first-byte dispatch table over the symbol tokens. For each
+// byte, this holds the indices of the symbol tokens whose spelling starts with
+// that byte, in registry order and terminated by -1, so lexing a symbol only
+// compares against the handful of spellings that could possibly match.
+struct SymbolTokenTable {
+  // The most symbols sharing a first byte is currently 7, for `<`.
+  static constexpr int MaxSymbolsPerByte = 8;
+
+  constexpr SymbolTokenTable() : candidates() {
+    for (auto& byte_candidates : candidates) {
+      for (auto& index : byte_candidates) {
+        index = -1;
+      }
+    }
+
+    int counts[UCHAR_MAX + 1] = {};
+    for (int i = 0; i != NumSymbolTokens; ++i) {
+      unsigned char first_byte = SymbolTokenFirstBytes[i];
+      // Failing this check makes the table fail to constant evaluate.
+      COCKTAIL_CHECK(counts[first_byte] < MaxSymbolsPerByte)
+          << "Too many symbol tokens start with the same byte!";
+      candidates[first_byte][counts[first_byte]++] = i;
+    }
+  }
+
+  int8_t candidates[UCHAR_MAX + 1][MaxSymbolsPerByte + 1];
+};
+
+static_assert(NumSymbolTokens <= INT8_MAX,
+              "Too many symbol tokens to index with int8_t!");
+
+constexpr SymbolTokenTable SymbolTokens;
+
+// Returns the kind of the longest symbol token that `text` starts with, or
+// `Error` if it starts with none.
+auto LookupSymbolKind(llvm::StringRef text) -> TokenKind {
+  for (int8_t index :
+       SymbolTokens.candidates[static_cast<unsigned char>(text.front())]) {
+    if (index < 0) {
+      break;
+    }
+    if (text.startswith(SymbolTokenSpellings[index])) {
+      return SymbolTokenKinds[index];
+    }
+  }
+  return TokenKind::Error();
+}
+
+// The kind and spelling of every keyword token, in registry order.
+constexpr TokenKind KeywordTokenKinds[] = {
+#define COCKTAIL_KEYWORD_TOKEN(Name, Spelling) TokenKind::Name(),
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+constexpr llvm::StringLiteral KeywordTokenSpellings[] = {
+#define COCKTAIL_KEYWORD_TOKEN(Name, Spelling) Spelling,
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+constexpr int NumKeywordTokens = std::size(KeywordTokenKinds);
+
+// Packs the length, first byte, and last two bytes of a word into the key that
+// is hashed to find its keyword slot. These are enough to tell every keyword
+// apart; the candidate keyword is compared in full after the lookup anyway.
+constexpr auto KeywordHashKey(const char* text, size_t size) -> uint32_t {
+  auto byte = [&](size_t i) -> uint32_t {
+    return static_cast<unsigned char>(text[i]);
+  };
+  return static_cast<uint32_t>(size) | byte(0) << 8 |
+         (size > 1 ? byte(size - 2) : 0) << 16 | byte(size - 1) << 24;
+}
+
+constexpr uint32_t KeywordHashKeys[] = {
+#define COCKTAIL_KEYWORD_TOKEN(Name, Spelling) \
+  KeywordHashKey(Spelling, sizeof(Spelling) - 1),
+#include "Cocktail/Lexer/TokenRegistry.def"
+};
+
+// A precomputed perfect hash over the keyword tokens. Every keyword lands in
+// its own slot, so recognizing a keyword costs one multiply and at most one
+// string comparison rather than a comparison against each keyword spelling.
+struct KeywordTokenTable {
+  // The multiplier was found by searching for one that gives the current
+  // keyword set a collision-free table. If a keyword is added and the table
+  // no longer constant evaluates, search for a new one.
+  static constexpr uint32_t HashMultiplier = 0x402c91a1;
+  static constexpr int HashBits = 7;
+  static constexpr int NumSlots = 1 << HashBits;
+
+  static constexpr auto Hash(uint32_t key) -> int {
+    return static_cast<int>((key * HashMultiplier) >> (32 - HashBits));
+  }
+
+  constexpr KeywordTokenTable() : slots() {
+    for (auto& index : slots) {
+      index = -1;
+    }
+
+    for (int i = 0; i != NumKeywordTokens; ++i) {
+      int slot = Hash(KeywordHashKeys[i]);
+      // Failing this check makes the table fail to constant evaluate.
+      COCKTAIL_CHECK(slots[slot] == -1) << "Keyword hash collision!";
+      slots[slot] = i;
+    }
+  }
+
+  // Returns the keyword spelled by `text`, or `TokenKind::Error()` if `text`
+  // is not a keyword.
+  [[nodiscard]] auto Lookup(llvm::StringRef text) const -> TokenKind {
+    int index = slots[Hash(KeywordHashKey(text.data(), text.size()))];
+    if (index == -1 || KeywordTokenSpellings[index] != text) {
+      return TokenKind::Error();
+    }
+    return KeywordTokenKinds[index];
+  }
+
+  int8_t slots[NumSlots];
+};
+
+static_assert(NumKeywordTokens <= INT8_MAX,
+              "Too many keyword tokens to index with int8_t!");
+
+constexpr KeywordTokenTable KeywordTokens;
+
+// Matches `[ \t]`.
+struct HorizontalWhitespaceMatcher {
+#if COCKTAIL_BYTE_VECTORS
+  static auto Match(ByteVector bytes) -> ByteVector {
+    return BytesOr(BytesEqual(bytes, SplatByte(' ')),
+                   BytesEqual(bytes, SplatByte('\t')));
+  }
+#endif
+  static auto Match(char c) -> bool { return IsHorizontalWhitespace(c); }
+};
+
+// Matches `[a-zA-Z0-9_]`.
+struct IdentifierCharMatcher {
+#if COCKTAIL_BYTE_VECTORS
+  static auto Match(ByteVector bytes) -> ByteVector {
+    // Setting 0x20 maps `A-Z` onto `a-z`, and maps nothing else there.
+    ByteVector letters = BytesLessUnsigned(
+        BytesSub(BytesOr(bytes, SplatByte(0x20)), SplatByte('a')),
+        SplatByte(26));
+    ByteVector digits =
+        BytesLessUnsigned(BytesSub(bytes, SplatByte('0')), SplatByte(10));
+    return BytesOr(BytesOr(letters, digits), BytesEqual(bytes, SplatByte('_')));
+  }
+#endif
+  static auto Match(char c) -> bool { return IsIdentifierChar(c); }
+};
+
+// A diagnostic emitted while lexing one chunk of a source in parallel, along
+// with the number of tokens the chunk had when it was emitted. This is where
+// the diagnostic goes when the chunks are stitched back together.
+struct ChunkDiagnostic {
+  Diagnostic diagnostic;
+  int token_count;
+};
+
+// Buffers the diagnostics of a chunk until it is stitched.
+class ChunkDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  explicit ChunkDiagnosticConsumer(const TokenizedBuffer& chunk)
+      : chunk_(&chunk) {}
+
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    diagnostic.ResolveLocations();
+    diagnostics_.push_back(
+        {.diagnostic = std::move(diagnostic), .token_count = chunk_->size()});
+  }
+
+  auto diagnostics() -> llvm::MutableArrayRef<ChunkDiagnostic> {
+    return diagnostics_;
+  }
+
+ private:
+  const TokenizedBuffer* chunk_;
+  llvm::SmallVector<ChunkDiagnostic, 0> diagnostics_;
+};
+
+// Numeric literal values that are small enough are stored in the token's
+// payload rather than in the literal storage. They are stored complemented,
+// which makes them negative and so distinct from a storage index.
+constexpr int InlineLiteralBits = 31;
+// An inline real literal packs its mantissa above its signed exponent.
+constexpr int InlineRealExponentBits = 7;
+constexpr int InlineRealMantissaBits =
+    InlineLiteralBits - InlineRealExponentBits;
+
+}  // namespace
+
 class TokenizedBuffer::Lexer {
  public:
   class LexResult {
@@ -55,14 +281,63 @@ class TokenizedBuffer::Lexer {
     bool formed_token_;
   };
 
-  Lexer(TokenizedBuffer& buffer, DiagnosticConsumer& consumer)
+  // `start` is the offset in the source of the text to be lexed. When
+  // `defer_group_matching` is set, grouping symbols are not matched, so that a
+  // chunk of the source can be lexed on its own and later stitched into a
+  // buffer by `AppendChunk`.
+  Lexer(TokenizedBuffer& buffer, DiagnosticConsumer& consumer,
+        int64_t start = 0, bool defer_group_matching = false)
       : buffer_(buffer),
+        consumer_(consumer),
         translator_(buffer, &current_column_),
-        emitter_(translator_, consumer),
+        emitter_(translator_, consumer_),
         token_translator_(buffer, &current_column_),
-        token_emitter_(token_translator_, consumer),
-        current_line_(buffer.AddLine({0, 0, 0})),
-        current_line_info_(&buffer.GetLineInfo(current_line_)) {}
+        token_emitter_(token_translator_, consumer_),
+        current_line_(buffer.AddLine({start, 0, 0})),
+        current_line_info_(&buffer.GetLineInfo(current_line_)),
+        source_is_ascii_(buffer.source_->is_ascii()),
+        defer_group_matching_(defer_group_matching) {}
+
+  // How many tokens are lexed between polls of the cancellation token. Reading
+  // the clock for a deadline costs about as much as lexing a token, and a few
+  // hundred tokens take microseconds.
+  static constexpr int CancellationPollTokens = 256;
+
+  auto set_cancellation(const CancellationToken* cancellation) -> void {
+    cancellation_ = cancellation;
+  }
+
+  // Lexes all of `source_text`, which must start at the beginning of a line,
+  // or as much of it as was lexed before the consumer asked to stop or the
+  // lexer's cancellation token was cancelled.
+  auto LexText(llvm::StringRef source_text) -> void {
+    int until_poll = CancellationPollTokens;
+    while (!consumer_.stop_requested() && SkipWhitespace(source_text)) {
+      if (cancellation_ != nullptr && --until_poll == 0) {
+        until_poll = CancellationPollTokens;
+        if (cancellation_->cancelled()) {
+          buffer_.cancelled_ = true;
+          break;
+        }
+      }
+      LexResult result = LexSymbolToken(source_text);
+      if (!result) {
+        result = LexKeywordOrIdentifier(source_text);
+      }
+      if (!result) {
+        result = LexNumericLiteral(source_text);
+      }
+      if (!result) {
+        result = LexStringLiteral(source_text);
+      }
+      if (!result) {
+        result = LexError(source_text);
+      }
+      COCKTAIL_CHECK(result) << "No token was lexed.";
+    }
+
+    NoteWhitespace();
+  }
 
   auto HandleNewline() -> void {
     current_line_info_->length = current_column_;
@@ -75,8 +350,8 @@ class TokenizedBuffer::Lexer {
   }
 
   auto NoteWhitespace() -> void {
-    if (!buffer_.token_infos_.empty()) {
-      buffer_.token_infos_.back().has_trailing_space = true;
+    if (!buffer_.token_kinds_.empty()) {
+      buffer_.token_has_trailing_space_.set(buffer_.token_kinds_.size() - 1);
     }
   }
 
@@ -84,7 +359,7 @@ class TokenizedBuffer::Lexer {
     const char* const whitespace_start = source_text.begin();
 
     while (!source_text.empty()) {
-      if (source_text.startswith("//")) {
+      if (source_text.front() == '/' && source_text.startswith("//")) {
         // Any comment must be the only non-whitespace on the line.
         if (set_indent_) {
           COCKTAIL_DIAGNOSTIC(TrailingComment, Error,
@@ -99,10 +374,12 @@ class TokenizedBuffer::Lexer {
           emitter_.Emit(source_text.begin() + 2,
                         NoWhitespaceAfterCommentIntroducer);
         }
-        while (!source_text.empty() && source_text.front() != '\n') {
-          ++current_column_;
-          source_text = source_text.drop_front();
-        }
+        // Jump straight to the end of the line, which `find` locates with a
+        // single `memchr`.
+        size_t comment_length =
+            std::min(source_text.find('\n'), source_text.size());
+        current_column_ += comment_length;
+        source_text = source_text.drop_front(comment_length);
         if (source_text.empty()) {
           break;
         }
@@ -110,7 +387,7 @@ class TokenizedBuffer::Lexer {
 
       switch (source_text.front()) {
         default:
-          COCKTAIL_CHECK(!IsSpace(source_text.front()));
+          COCKTAIL_DCHECK(!IsSpace(source_text.front()));
           if (whitespace_start != source_text.begin()) {
             NoteWhitespace();
           }
@@ -126,10 +403,13 @@ class TokenizedBuffer::Lexer {
           continue;
 
         case ' ':
-        case '\t':
-          ++current_column_;
-          source_text = source_text.drop_front();
+        case '\t': {
+          size_t whitespace_length =
+              ScanWhile<HorizontalWhitespaceMatcher>(source_text);
+          current_column_ += whitespace_length;
+          source_text = source_text.drop_front(whitespace_length);
           continue;
+        }
       }
     }
 
@@ -156,25 +436,36 @@ class TokenizedBuffer::Lexer {
       set_indent_ = true;
     }
 
+    if (buffer_.lazy_literal_values_) {
+      return buffer_.AddToken(
+          {.kind = literal->is_integer() ? TokenKind::IntegerLiteral()
+                                         : TokenKind::RealLiteral(),
+           .token_line = current_line_,
+           .column = int_column,
+           .payload = {.literal = {.index = 0, .length = token_size}}});
+    }
+
     return VariantMatch(
         literal->ComputeValue(emitter_),
         [&](LexedNumericLiteral::IntegerValue&& value) {
-          auto token = buffer_.AddToken({.kind = TokenKind::IntegerLiteral(),
-                                         .token_line = current_line_,
-                                         .column = int_column});
-          buffer_.GetTokenInfo(token).literal_index =
-              buffer_.literal_int_storage_.size();
-          buffer_.literal_int_storage_.push_back(std::move(value.value));
+          auto token = buffer_.AddToken(
+              {.kind = TokenKind::IntegerLiteral(),
+               .token_line = current_line_,
+               .column = int_column,
+               .payload = {.literal = {.index = buffer_.AddIntegerValue(
+                                           std::move(value.value)),
+                                       .length = token_size}}});
           return token;
         },
         [&](LexedNumericLiteral::RealValue&& value) {
-          auto token = buffer_.AddToken({.kind = TokenKind::RealLiteral(),
-                                         .token_line = current_line_,
-                                         .column = int_column});
-          buffer_.GetTokenInfo(token).literal_index =
-              buffer_.literal_int_storage_.size();
-          buffer_.literal_int_storage_.push_back(std::move(value.mantissa));
-          buffer_.literal_int_storage_.push_back(std::move(value.exponent));
+          auto token = buffer_.AddToken(
+              {.kind = TokenKind::RealLiteral(),
+               .token_line = current_line_,
+               .column = int_column,
+               .payload = {.literal = {.index = buffer_.AddRealValue(
+                                           std::move(value.mantissa),
+                                           std::move(value.exponent)),
+                                       .length = token_size}}});
           COCKTAIL_CHECK(buffer_.GetRealLiteral(token).IsDecimal() ==
                          (value.radix == LexedNumericLiteral::Radix::Decimal));
           return token;
@@ -184,7 +475,7 @@ class TokenizedBuffer::Lexer {
               .kind = TokenKind::Error(),
               .token_line = current_line_,
               .column = int_column,
-              .error_length = token_size,
+              .payload = {.error_length = token_size},
           });
           return token;
         });
@@ -201,6 +492,10 @@ class TokenizedBuffer::Lexer {
     int string_column = current_column_;
     int literal_size = literal->text().size();
     source_text = source_text.drop_front(literal_size);
+    if (literal->is_multi_line() && source_text.empty()) {
+      // Lexing a prefix of the source may have cut this literal short.
+      lexed_multi_line_literal_to_end_ = true;
+    }
 
     if (!set_indent_) {
       current_line_info_->indent = string_column;
@@ -222,14 +517,24 @@ class TokenizedBuffer::Lexer {
     }
 
     if (literal->is_terminated()) {
+      if (buffer_.lazy_literal_values_) {
+        return buffer_.AddToken(
+            {.kind = TokenKind::StringLiteral(),
+             .token_line = string_line,
+             .column = string_column,
+             .payload = {.literal = {.index = 0, .length = literal_size}}});
+      }
       auto token =
           buffer_.AddToken({.kind = TokenKind::StringLiteral(),
                             .token_line = string_line,
                             .column = string_column,
-                            .literal_index = static_cast<int32_t>(
-                                buffer_.literal_string_storage_.size())});
-      buffer_.literal_string_storage_.push_back(
-          literal->ComputeValue(emitter_));
+                            .payload = {.literal = {
+                                            .index = static_cast<int32_t>(
+                                                buffer_.literal_string_storage_
+                                                    .size()),
+                                            .length = literal_size}}});
+      buffer_.literal_string_storage_.push_back(llvm::CachedHashStringRef(
+          literal->ComputeValue(buffer_.string_storage(), emitter_)));
       return token;
     } else {
       COCKTAIL_DIAGNOSTIC(UnterminatedString, Error,
@@ -238,16 +543,12 @@ class TokenizedBuffer::Lexer {
       return buffer_.AddToken({.kind = TokenKind::Error(),
                                .token_line = string_line,
                                .column = string_column,
-                               .error_length = literal_size});
+                               .payload = {.error_length = literal_size}});
     }
   }
 
   auto LexSymbolToken(llvm::StringRef& source_text) -> LexResult {
-    TokenKind kind = llvm::StringSwitch<TokenKind>(source_text)
-#define COCKTAIL_SYMBOL_TOKEN(Name, Spelling) \
-  .StartsWith(Spelling, TokenKind::Name())
-#include "Cocktail/Lexer/TokenRegistry.def"
-                         .Default(TokenKind::Error());
+    TokenKind kind = LookupSymbolKind(source_text);
     if (kind == TokenKind::Error()) {
       return LexResult::NoMatch();
     }
@@ -257,13 +558,25 @@ class TokenizedBuffer::Lexer {
       set_indent_ = true;
     }
 
-    CloseInvalidOpenGroups(kind);
-
-    const char* location = source_text.begin();
-    Token token = buffer_.AddToken(
-        {.kind = kind, .token_line = current_line_, .column = current_column_});
+    Token token = AddSymbolToken(
+        {.kind = kind, .token_line = current_line_, .column = current_column_},
+        source_text.begin());
     current_column_ += kind.GetFixedSpelling().size();
     source_text = source_text.drop_front(kind.GetFixedSpelling().size());
+    return token;
+  }
+
+  // Adds a symbol token at the current position, which is `location` in the
+  // source, and matches it against the open groups.
+  auto AddSymbolToken(TokenInfo info, const char* location) -> Token {
+    if (defer_group_matching_) {
+      return buffer_.AddToken(info);
+    }
+
+    TokenKind kind = info.kind;
+    CloseInvalidOpenGroups(kind);
+
+    Token token = buffer_.AddToken(info);
 
     if (kind.IsOpeningSymbol()) {
       open_groups_.push_back(token);
@@ -274,11 +587,10 @@ class TokenizedBuffer::Lexer {
       return token;
     }
 
-    TokenInfo& closing_token_info = buffer_.GetTokenInfo(token);
-
     if (open_groups_.empty()) {
-      closing_token_info.kind = TokenKind::Error();
-      closing_token_info.error_length = kind.GetFixedSpelling().size();
+      buffer_.token_kinds_[token.index_] = TokenKind::Error();
+      buffer_.GetTokenPayload(token).error_length =
+          kind.GetFixedSpelling().size();
 
       COCKTAIL_DIAGNOSTIC(
           UnmatchedClosing, Error,
@@ -288,9 +600,8 @@ class TokenizedBuffer::Lexer {
     }
 
     Token opening_token = open_groups_.pop_back_val();
-    TokenInfo& opening_token_info = buffer_.GetTokenInfo(opening_token);
-    opening_token_info.closing_token = token;
-    closing_token_info.opening_token = opening_token;
+    buffer_.GetTokenPayload(opening_token).closing_token = token;
+    buffer_.GetTokenPayload(token).opening_token = opening_token;
     return token;
   }
 
@@ -324,7 +635,7 @@ class TokenizedBuffer::Lexer {
           {.kind = TokenKind::Error(),
            .token_line = current_line_,
            .column = column,
-           .error_length = static_cast<int32_t>(word.size())});
+           .payload = {.error_length = static_cast<int32_t>(word.size())}});
     }
     llvm::APInt suffix_value;
     if (suffix.getAsInteger(10, suffix_value)) {
@@ -332,10 +643,12 @@ class TokenizedBuffer::Lexer {
     }
 
     auto token = buffer_.AddToken(
-        {.kind = *kind, .token_line = current_line_, .column = column});
-    buffer_.GetTokenInfo(token).literal_index =
-        buffer_.literal_int_storage_.size();
-    buffer_.literal_int_storage_.push_back(std::move(suffix_value));
+        {.kind = *kind,
+         .token_line = current_line_,
+         .column = column,
+         .payload = {.literal = {.index = buffer_.AddIntegerValue(
+                                     std::move(suffix_value)),
+                                 .length = static_cast<int32_t>(word.size())}}});
     return token;
   }
 
@@ -346,16 +659,19 @@ class TokenizedBuffer::Lexer {
 
     while (!open_groups_.empty()) {
       Token opening_token = open_groups_.back();
-      TokenKind opening_kind = buffer_.GetTokenInfo(opening_token).kind;
+      TokenKind opening_kind = buffer_.GetKind(opening_token);
       if (kind == opening_kind.GetClosingSymbol()) {
         return;
       }
 
       open_groups_.pop_back();
-      COCKTAIL_DIAGNOSTIC(
-          MismatchedClosing, Error,
-          "Closing symbol does not match most recent opening symbol.");
-      token_emitter_.Emit(opening_token, MismatchedClosing);
+      // Lexing may have been cancelled before the closing symbol was reached.
+      if (!buffer_.cancelled_) {
+        COCKTAIL_DIAGNOSTIC(
+            MismatchedClosing, Error,
+            "Closing symbol does not match most recent opening symbol.");
+        token_emitter_.Emit(opening_token, MismatchedClosing);
+      }
 
       COCKTAIL_CHECK(!buffer_.tokens().empty())
           << "Must have a prior opening token!";
@@ -367,24 +683,67 @@ class TokenizedBuffer::Lexer {
            .is_recovery = true,
            .token_line = current_line_,
            .column = current_column_});
-      TokenInfo& opening_token_info = buffer_.GetTokenInfo(opening_token);
-      TokenInfo& closing_token_info = buffer_.GetTokenInfo(closing_token);
-      opening_token_info.closing_token = closing_token;
-      closing_token_info.opening_token = opening_token;
+      buffer_.GetTokenPayload(opening_token).closing_token = closing_token;
+      buffer_.GetTokenPayload(closing_token).opening_token = opening_token;
     }
   }
 
   auto GetOrCreateIdentifier(llvm::StringRef text) -> Identifier {
+    size_t map_size = buffer_.identifier_map_.getMemorySize();
+    HashedIdentifier key(text);
     auto insert_result = buffer_.identifier_map_.insert(
-        {text, Identifier(buffer_.identifier_infos_.size())});
+        {key, Identifier(buffer_.identifier_infos_.size())});
     if (insert_result.second) {
-      buffer_.identifier_infos_.push_back({text});
+      if (buffer_.identifier_infos_.size() ==
+              buffer_.identifier_infos_.capacity() ||
+          buffer_.identifier_map_.getMemorySize() != map_size) {
+        ++buffer_.lex_stats_.identifier_reallocations;
+      }
+      buffer_.identifier_infos_.push_back({.text = text, .hash = key.hash});
     }
     return insert_result.first->second;
   }
 
+  // Returns whether `c` is the first byte of a UTF-8 sequence that may need
+  // to be matched as a Unicode identifier character.
+  auto MayStartUnicodeChar(char c) const -> bool {
+    return !source_is_ascii_ && static_cast<unsigned char>(c) >= 0x80;
+  }
+
+  // Returns the length of the identifier or keyword at the start of `text`,
+  // which is 0 if there isn't one. Runs of ASCII characters are scanned a
+  // vector at a time, and only a byte with its high bit set where such a run
+  // stops is decoded and looked up as a Unicode XID_Continue character.
+  auto ScanIdentifier(llvm::StringRef text) -> int64_t {
+    int64_t size = 0;
+    if (IsAlpha(text.front()) || text.front() == '_') {
+      size = 1;
+    } else if (MayStartUnicodeChar(text.front())) {
+      size = MatchUnicodeIdentifierChar(text, /*at_start=*/true);
+      if (size == 0) {
+        return 0;
+      }
+    } else {
+      return 0;
+    }
+    while (true) {
+      size += ScanWhile<IdentifierCharMatcher>(text.drop_front(size));
+      if (size == static_cast<int64_t>(text.size()) ||
+          !MayStartUnicodeChar(text[size])) {
+        return size;
+      }
+      int char_size =
+          MatchUnicodeIdentifierChar(text.drop_front(size), /*at_start=*/false);
+      if (char_size == 0) {
+        return size;
+      }
+      size += char_size;
+    }
+  }
+
   auto LexKeywordOrIdentifier(llvm::StringRef& source_text) -> LexResult {
-    if (!IsAlpha(source_text.front()) && source_text.front() != '_') {
+    int64_t identifier_size = ScanIdentifier(source_text);
+    if (identifier_size == 0) {
       return LexResult::NoMatch();
     }
 
@@ -393,10 +752,7 @@ class TokenizedBuffer::Lexer {
       set_indent_ = true;
     }
 
-    llvm::StringRef identifier_text =
-        source_text.take_while([](char c) { return IsAlnum(c) || c == '_'; });
-    COCKTAIL_CHECK(!identifier_text.empty())
-        << "Must have at least one character!";
+    llvm::StringRef identifier_text = source_text.take_front(identifier_size);
     int identifier_column = current_column_;
     current_column_ += identifier_text.size();
     source_text = source_text.drop_front(identifier_text.size());
@@ -406,11 +762,7 @@ class TokenizedBuffer::Lexer {
       return result;
     }
 
-    TokenKind kind = llvm::StringSwitch<TokenKind>(identifier_text)
-#define COCKTAIL_KEYWORD_TOKEN(Name, Spelling) \
-  .Case(Spelling, TokenKind::Name())
-#include "Cocktail/Lexer/TokenRegistry.def"
-                         .Default(TokenKind::Error());
+    TokenKind kind = KeywordTokens.Lookup(identifier_text);
     if (kind != TokenKind::Error()) {
       return buffer_.AddToken({.kind = kind,
                                .token_line = current_line_,
@@ -420,25 +772,26 @@ class TokenizedBuffer::Lexer {
     return buffer_.AddToken({.kind = TokenKind::Identifier(),
                              .token_line = current_line_,
                              .column = identifier_column,
-                             .id = GetOrCreateIdentifier(identifier_text)});
+                             .payload = {.id = GetOrCreateIdentifier(
+                                             identifier_text)}});
   }
 
   auto LexError(llvm::StringRef& source_text) -> LexResult {
-    llvm::StringRef error_text = source_text.take_while([](char c) {
-      if (IsAlnum(c)) {
-        return false;
-      }
-      switch (c) {
-        case '_':
-        case '\t':
-        case '\n':
-          return false;
+    // Stop at anything that could start a token: an identifier, keyword or
+    // number, a symbol, or whitespace other than a plain space.
+    int64_t error_size = 0;
+    for (; error_size != static_cast<int64_t>(source_text.size());
+         ++error_size) {
+      char c = source_text[error_size];
+      if (IsIdentifierChar(c) || c == '\t' || c == '\n' ||
+          SymbolTokens.candidates[static_cast<unsigned char>(c)][0] != -1 ||
+          (MayStartUnicodeChar(c) &&
+           MatchUnicodeIdentifierChar(source_text.drop_front(error_size),
+                                      /*at_start=*/true) != 0)) {
+        break;
       }
-      return llvm::StringSwitch<bool>(llvm::StringRef(&c, 1))
-#define COCKTAIL_SYMBOL_TOKEN(Name, Spelling) .StartsWith(Spelling, false)
-#include "Cocktail/Lexer/TokenRegistry.def"
-          .Default(true);
-    });
+    }
+    llvm::StringRef error_text = source_text.take_front(error_size);
     if (error_text.empty()) {
       error_text = source_text.take_front(1);
     }
@@ -447,7 +800,8 @@ class TokenizedBuffer::Lexer {
         {.kind = TokenKind::Error(),
          .token_line = current_line_,
          .column = current_column_,
-         .error_length = static_cast<int32_t>(error_text.size())});
+         .payload = {.error_length =
+                         static_cast<int32_t>(error_text.size())}});
     COCKTAIL_DIAGNOSTIC(UnrecognizedCharacters, Error,
                         "Encountered unrecognized characters while parsing.");
     emitter_.Emit(error_text.begin(), UnrecognizedCharacters);
@@ -463,8 +817,310 @@ class TokenizedBuffer::Lexer {
                       .column = current_column_});
   }
 
+  // Appends `chunk`, which was lexed with group matching deferred from the text
+  // that starts at the current line, as if this lexer had lexed that text
+  // itself. Groups are matched across the seam, and the chunk's diagnostics are
+  // passed on where this lexer would have emitted them.
+  auto AppendChunk(TokenizedBuffer& chunk,
+                   llvm::MutableArrayRef<ChunkDiagnostic> diagnostics)
+      -> void {
+    int line_base = current_line_.index_;
+    int int_literal_base = buffer_.literal_int_storage_.size();
+    int string_literal_base = buffer_.literal_string_storage_.size();
+
+    // The chunk's first line is the current line, which it has lexed.
+    *current_line_info_ = chunk.line_infos_.front();
+    for (const LineInfo& line_info : llvm::drop_begin(chunk.line_infos_)) {
+      buffer_.AddLine(line_info);
+    }
+    current_line_info_ = &buffer_.GetLineInfo(current_line_);
+    buffer_.literal_int_storage_.append(
+        std::make_move_iterator(chunk.literal_int_storage_.begin()),
+        std::make_move_iterator(chunk.literal_int_storage_.end()));
+    // Values that refer into the source stay valid; the rest live in the
+    // chunk's allocator, which is about to go away.
+    llvm::StringRef source_text = buffer_.source_->text();
+    for (llvm::CachedHashStringRef value : chunk.literal_string_storage_) {
+      llvm::StringRef text = value.val();
+      if (text.begin() < source_text.begin() ||
+          text.end() > source_text.end()) {
+        value = llvm::CachedHashStringRef(
+            text.copy(buffer_.string_storage()), value.hash());
+      }
+      buffer_.literal_string_storage_.push_back(value);
+    }
+
+    buffer_.lex_stats_.token_reallocations +=
+        chunk.lex_stats_.token_reallocations;
+    buffer_.lex_stats_.line_reallocations += chunk.lex_stats_.line_reallocations;
+    buffer_.lex_stats_.identifier_reallocations +=
+        chunk.lex_stats_.identifier_reallocations;
+
+    // Chunk identifiers are numbered in order of first use, so each is mapped
+    // to its identifier here the first time it is seen.
+    llvm::SmallVector<Identifier> identifiers;
+    identifiers.reserve(chunk.identifier_infos_.size());
+
+    auto* diagnostic_it = diagnostics.begin();
+    auto flush_diagnostics = [&](int token_count) {
+      for (; diagnostic_it != diagnostics.end() &&
+             diagnostic_it->token_count <= token_count;
+           ++diagnostic_it) {
+        Diagnostic& diagnostic = diagnostic_it->diagnostic;
+        diagnostic.message.ResolveLocation().line_number += line_base;
+        for (DiagnosticMessage& note : diagnostic.notes) {
+          note.ResolveLocation().line_number += line_base;
+        }
+        consumer_.HandleDiagnostic(std::move(diagnostic));
+      }
+    };
+
+    // The last token of the chunk is its end of file.
+    int num_tokens = chunk.size() - 1;
+    for (int i = 0; i != num_tokens; ++i) {
+      flush_diagnostics(i);
+
+      TokenInfo info = chunk.GetTokenInfo(Token(i));
+      info.token_line = Line(info.token_line.index_ + line_base);
+      if (info.kind == TokenKind::Identifier()) {
+        Identifier& id = info.payload.id;
+        if (id.index_ == static_cast<int>(identifiers.size())) {
+          identifiers.push_back(
+              GetOrCreateIdentifier(chunk.GetIdentifierText(id)));
+        }
+        id = identifiers[id.index_];
+      } else if (info.kind == TokenKind::StringLiteral()) {
+        info.payload.literal.index += string_literal_base;
+      } else if (info.kind == TokenKind::IntegerLiteral() ||
+                 info.kind == TokenKind::RealLiteral() ||
+                 info.kind == TokenKind::IntegerTypeLiteral() ||
+                 info.kind == TokenKind::UnsignedIntegerTypeLiteral() ||
+                 info.kind == TokenKind::FloatingPointTypeLiteral()) {
+        // Inline values don't refer to the storage.
+        if (info.payload.literal.index >= 0) {
+          info.payload.literal.index += int_literal_base;
+        }
+      }
+
+      if (!info.kind.IsSymbol()) {
+        buffer_.AddToken(info);
+        continue;
+      }
+      // Recovery tokens for groups closed here are lexed at this position.
+      current_line_ = info.token_line;
+      current_column_ = info.column;
+      AddSymbolToken(info, buffer_.source_->text().begin() +
+                               buffer_.GetLineInfo(info.token_line).start +
+                               info.column);
+    }
+    flush_diagnostics(num_tokens);
+
+    TokenInfo end_of_file_info = chunk.GetTokenInfo(Token(num_tokens));
+    current_line_ = Line(end_of_file_info.token_line.index_ + line_base);
+    current_line_info_ = &buffer_.GetLineInfo(current_line_);
+    current_column_ = end_of_file_info.column;
+  }
+
+  // Starts the buffer with the first `num_tokens` tokens of `previous`, which
+  // are on its first `num_lines` lines, as if this lexer had lexed their text
+  // itself. That text is unchanged at the start of this buffer's source, so
+  // the tokens and lines are copied as they are. Only the identifiers and
+  // literal values, which refer into the previous source, and the groups left
+  // open need any work.
+  auto CopyPreviousPrefix(const TokenizedBuffer& previous, int num_tokens,
+                          int num_lines) -> void {
+    COCKTAIL_CHECK(buffer_.size() == 0 && current_line_.index_ == 0)
+        << "The prefix must come first!";
+    llvm::StringRef previous_text = previous.source_->text();
+    llvm::StringRef source_text = buffer_.source_->text();
+    auto copy_prefix = [&](auto& column, const auto& previous_column) {
+      column.append(previous_column.begin(),
+                    previous_column.begin() + num_tokens);
+    };
+    copy_prefix(buffer_.token_kinds_, previous.token_kinds_);
+    copy_prefix(buffer_.token_offsets_, previous.token_offsets_);
+    copy_prefix(buffer_.token_payloads_, previous.token_payloads_);
+    buffer_.token_has_trailing_space_ = previous.token_has_trailing_space_;
+    buffer_.token_has_trailing_space_.resize(num_tokens);
+    buffer_.token_is_recovery_ = previous.token_is_recovery_;
+    buffer_.token_is_recovery_.resize(num_tokens);
+    buffer_.token_offset_segments_.assign(
+        previous.token_offset_segments_.begin(),
+        llvm::lower_bound(previous.token_offset_segments_, num_tokens));
+    buffer_.line_infos_.assign(previous.line_infos_.begin(),
+                               previous.line_infos_.begin() + num_lines);
+
+    // Identifiers are numbered in order of first use, and their text is that
+    // of their first use, so the ones used in the prefix come first.
+    const char* prefix_end =
+        previous_text.begin() + previous.line_infos_[num_lines - 1].start +
+        previous.line_infos_[num_lines - 1].length;
+    auto prefix_identifiers_end = llvm::partition_point(
+        previous.identifier_infos_, [&](const IdentifierInfo& info) {
+          return info.text.begin() < prefix_end;
+        });
+    for (const IdentifierInfo& info : llvm::make_range(
+             previous.identifier_infos_.begin(), prefix_identifiers_end)) {
+      GetOrCreateIdentifier(source_text.substr(
+          info.text.begin() - previous_text.begin(), info.text.size()));
+    }
+
+    // Numeric values are only stored when they are too wide to be inline, so
+    // they are all kept. String values are stored in token order, so the
+    // last string literal of the prefix tells how many are its own.
+    buffer_.literal_int_storage_ = previous.literal_int_storage_;
+    if (!previous.lazy_literal_values_) {
+      int num_strings = 0;
+      for (int i = num_tokens - 1; i >= 0; --i) {
+        if (previous.token_kinds_[i] == TokenKind::StringLiteral()) {
+          num_strings = previous.token_payloads_[i].literal.index + 1;
+          break;
+        }
+      }
+      for (llvm::CachedHashStringRef value :
+           llvm::makeArrayRef(previous.literal_string_storage_)
+               .take_front(num_strings)) {
+        buffer_.literal_string_storage_.push_back(llvm::CachedHashStringRef(
+            RelocateStringValue(previous, value.val(), /*offset_delta=*/0),
+            value.hash()));
+      }
+    }
+
+    // The groups still open are found by walking back from the end of the
+    // prefix, skipping over every group closed within it.
+    for (int i = num_tokens - 1; i >= 0; --i) {
+      TokenKind kind = buffer_.token_kinds_[i];
+      if (kind.IsClosingSymbol()) {
+        i = buffer_.token_payloads_[i].opening_token.index_;
+      } else if (kind.IsOpeningSymbol()) {
+        open_groups_.push_back(Token(i));
+      }
+    }
+    std::reverse(open_groups_.begin(), open_groups_.end());
+
+    current_line_ = Line(num_lines - 1);
+    current_line_info_ = &buffer_.GetLineInfo(current_line_);
+    current_column_ = current_line_info_->length;
+  }
+
+  // Appends the tokens of `previous` from `begin` up to its end of file, which
+  // start on its line `begin_line`, as if this lexer had lexed their text
+  // itself. That line is the current line. Their text is unchanged in this
+  // buffer's source, but lies `offset_delta` bytes later. Recovery tokens are
+  // dropped and groups are matched again, as text before may have changed.
+  auto AppendPreviousTokens(const TokenizedBuffer& previous, int begin,
+                            int begin_line, int64_t offset_delta) -> void {
+    int end = previous.size() - 1;
+    int end_line = previous.line_infos_.size();
+    int line_delta = current_line_.index_ - begin_line;
+    llvm::StringRef source_text = buffer_.source_->text();
+
+    auto shift_line = [&](LineInfo line_info) {
+      line_info.start += offset_delta;
+      return line_info;
+    };
+    llvm::SmallVector<Identifier> identifiers(previous.identifier_infos_.size(),
+                                              Identifier(-1));
+    *current_line_info_ = shift_line(previous.line_infos_[begin_line]);
+    for (int line = begin_line + 1; line != end_line; ++line) {
+      buffer_.AddLine(shift_line(previous.line_infos_[line]));
+    }
+
+    for (int i = begin; i != end; ++i) {
+      TokenInfo info = previous.GetTokenInfo(Token(i));
+      if (info.is_recovery) {
+        continue;
+      }
+      info.token_line = Line(info.token_line.index_ + line_delta);
+      const char* location = source_text.begin() +
+                             buffer_.GetLineInfo(info.token_line).start +
+                             info.column;
+
+      if (info.kind == TokenKind::Error()) {
+        // A closing symbol without an opening one was turned into an error,
+        // but may have one now.
+        TokenKind symbol_kind = LookupSymbolKind(
+            llvm::StringRef(location, info.payload.error_length));
+        if (symbol_kind.IsClosingSymbol() &&
+            static_cast<int>(symbol_kind.GetFixedSpelling().size()) ==
+                info.payload.error_length) {
+          info.kind = symbol_kind;
+        }
+      } else if (info.kind == TokenKind::Identifier()) {
+        // Each previous identifier is looked up once per call.
+        Identifier& id = identifiers[info.payload.id.index_];
+        if (id.index_ < 0) {
+          id = GetOrCreateIdentifier(llvm::StringRef(
+              location, previous.GetIdentifierText(info.payload.id).size()));
+        }
+        info.payload.id = id;
+      } else if (info.kind.IsSizedTypeLiteral()) {
+        if (info.payload.literal.index >= 0) {
+          info.payload.literal.index = buffer_.AddIntegerValue(
+              previous.literal_int_storage_[info.payload.literal.index]);
+        }
+      } else if (previous.lazy_literal_values_) {
+        // Lazy literal indices are unused.
+      } else if (info.kind == TokenKind::StringLiteral()) {
+        llvm::CachedHashStringRef value =
+            previous.literal_string_storage_[info.payload.literal.index];
+        info.payload.literal.index = buffer_.literal_string_storage_.size();
+        buffer_.literal_string_storage_.push_back(llvm::CachedHashStringRef(
+            RelocateStringValue(previous, value.val(), offset_delta),
+            value.hash()));
+      } else if (info.payload.literal.index < 0) {
+        // Inline values don't refer to the storage.
+      } else if (info.kind == TokenKind::RealLiteral()) {
+        int32_t index = info.payload.literal.index;
+        info.payload.literal.index =
+            buffer_.AddRealValue(previous.literal_int_storage_[index],
+                                 previous.literal_int_storage_[index + 1]);
+      } else if (info.kind == TokenKind::IntegerLiteral()) {
+        info.payload.literal.index = buffer_.AddIntegerValue(
+            previous.literal_int_storage_[info.payload.literal.index]);
+      }
+
+      if (!info.kind.IsSymbol()) {
+        buffer_.AddToken(info);
+        continue;
+      }
+      current_line_ = info.token_line;
+      current_column_ = info.column;
+      AddSymbolToken(info, location);
+    }
+
+    current_line_ = Line(end_line - 1 + line_delta);
+    current_line_info_ = &buffer_.GetLineInfo(current_line_);
+    current_column_ = current_line_info_->length;
+  }
+
+  // Returns a string literal value of `previous` for this buffer. A value that
+  // refers into the previous source refers to the same text in this one, which
+  // lies `offset_delta` bytes later; the rest live in the previous buffer's
+  // allocator and are copied.
+  auto RelocateStringValue(const TokenizedBuffer& previous,
+                           llvm::StringRef value, int64_t offset_delta)
+      -> llvm::StringRef {
+    llvm::StringRef previous_text = previous.source_->text();
+    if (value.begin() < previous_text.begin() ||
+        value.end() > previous_text.end()) {
+      return value.copy(buffer_.string_storage());
+    }
+    return buffer_.source_->text().substr(
+        value.begin() - previous_text.begin() + offset_delta, value.size());
+  }
+
+  // Returns whether a multi-line string literal ran to the end of the lexed
+  // text, in which case it may have been cut short.
+  [[nodiscard]] auto lexed_multi_line_literal_to_end() const -> bool {
+    return lexed_multi_line_literal_to_end_;
+  }
+
  private:
   TokenizedBuffer& buffer_;
+  // Notes when the consumer asks for lexing to stop, which is only asked after
+  // a diagnostic and so costs nothing while the source is valid.
+  ErrorTrackingDiagnosticConsumer consumer_;
 
   SourceBufferLocationTranslator translator_;
   LexerDiagnosticEmitter emitter_;
@@ -479,36 +1135,210 @@ class TokenizedBuffer::Lexer {
   bool set_indent_ = false;
 
   llvm::SmallVector<Token, 8> open_groups_;
+
+  // Whether the source was checked to be all ASCII, so that no identifier
+  // needs its Unicode characters matched.
+  bool source_is_ascii_;
+
+  bool defer_group_matching_;
+  bool lexed_multi_line_literal_to_end_ = false;
+
+  // Polled while lexing, if set, to stop once the result is no longer wanted.
+  const CancellationToken* cancellation_ = nullptr;
 };
 
-auto TokenizedBuffer::Lex(SourceBuffer& source, DiagnosticConsumer& consumer)
+auto TokenizedBuffer::Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                          LiteralValues literal_values) -> TokenizedBuffer {
+  return LexSerially(source, consumer, /*context=*/nullptr, literal_values);
+}
+
+auto TokenizedBuffer::Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                          CompilationContext& context,
+                          LiteralValues literal_values) -> TokenizedBuffer {
+  TokenizedBuffer buffer =
+      LexSerially(source, consumer, &context, literal_values);
+  buffer.InternIdentifiers(context.identifiers());
+  return buffer;
+}
+
+auto TokenizedBuffer::Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                          const CancellationToken& cancellation,
+                          LiteralValues literal_values) -> TokenizedBuffer {
+  return LexSerially(source, consumer, /*context=*/nullptr, literal_values,
+                     &cancellation);
+}
+
+auto TokenizedBuffer::LexSerially(SourceBuffer& source,
+                                  DiagnosticConsumer& consumer,
+                                  CompilationContext* context,
+                                  LiteralValues literal_values,
+                                  const CancellationToken* cancellation)
     -> TokenizedBuffer {
   TokenizedBuffer buffer(source);
+  buffer.context_ = context;
+  buffer.lazy_literal_values_ = literal_values == LiteralValues::Lazy;
+  buffer.ReserveFor(source.text());
   ErrorTrackingDiagnosticConsumer error_tracking_consumer(consumer);
   Lexer lexer(buffer, error_tracking_consumer);
+  lexer.set_cancellation(cancellation);
+
+  lexer.LexText(source.text());
+
+  lexer.CloseInvalidOpenGroups(TokenKind::Error());
+  lexer.AddEndOfFileToken();
+
+  if (error_tracking_consumer.seen_error()) {
+    buffer.has_errors_ = true;
+  }
+
+  return buffer;
+}
 
-  llvm::StringRef source_text = source.text();
-  while (lexer.SkipWhitespace(source_text)) {
-    Lexer::LexResult result = lexer.LexSymbolToken(source_text);
-    if (!result) {
-      result = lexer.LexKeywordOrIdentifier(source_text);
+auto TokenizedBuffer::Lex(SourceBuffer& source, DiagnosticConsumer& consumer,
+                          TaskScheduler& scheduler, int64_t chunk_size,
+                          LiteralValues literal_values) -> TokenizedBuffer {
+  COCKTAIL_CHECK(chunk_size > 0) << "Chunks must not be empty!";
+
+  // Split after the first newline at or past each `chunk_size` bytes. As no
+  // token other than a multi-line string literal contains a newline, lexing
+  // each chunk from the start of its line gives the same tokens as lexing
+  // serially unless a multi-line string literal crosses the split.
+  llvm::SmallVector<llvm::StringRef> chunk_texts;
+  llvm::StringRef text = source.text();
+  while (static_cast<int64_t>(text.size()) > chunk_size) {
+    size_t newline = text.find('\n', chunk_size - 1);
+    if (newline == llvm::StringRef::npos || newline + 1 == text.size()) {
+      break;
+    }
+    chunk_texts.push_back(text.take_front(newline + 1));
+    text = text.drop_front(newline + 1);
+  }
+  chunk_texts.push_back(text);
+  if (chunk_texts.size() == 1) {
+    return Lex(source, consumer, literal_values);
+  }
+
+  // Lex every chunk on its own, buffering its diagnostics.
+  llvm::SmallVector<TokenizedBuffer, 0> chunks;
+  chunks.reserve(chunk_texts.size());
+  for (int i = 0; i != static_cast<int>(chunk_texts.size()); ++i) {
+    chunks.push_back(TokenizedBuffer(source));
+    chunks.back().lazy_literal_values_ = literal_values == LiteralValues::Lazy;
+  }
+  llvm::SmallVector<ChunkDiagnosticConsumer, 0> chunk_consumers;
+  chunk_consumers.reserve(chunks.size());
+  for (const TokenizedBuffer& chunk : chunks) {
+    chunk_consumers.emplace_back(chunk);
+  }
+  llvm::SmallVector<bool> chunk_may_be_cut_short(chunks.size());
+  ParallelFor(scheduler, chunks.size(), [&](int i) {
+    chunks[i].ReserveFor(chunk_texts[i]);
+    Lexer lexer(chunks[i], chunk_consumers[i],
+                chunk_texts[i].begin() - source.text().begin(),
+                /*defer_group_matching=*/true);
+    lexer.LexText(chunk_texts[i]);
+    lexer.AddEndOfFileToken();
+    chunk_may_be_cut_short[i] = lexer.lexed_multi_line_literal_to_end();
+  });
+
+  // Only the last chunk may run to the end of the source.
+  if (llvm::is_contained(
+          llvm::makeArrayRef(chunk_may_be_cut_short).drop_back(), true)) {
+    return Lex(source, consumer, literal_values);
+  }
+
+  TokenizedBuffer buffer(source);
+  buffer.lazy_literal_values_ = literal_values == LiteralValues::Lazy;
+  buffer.ReserveFor(source.text());
+  ErrorTrackingDiagnosticConsumer error_tracking_consumer(consumer);
+  Lexer lexer(buffer, error_tracking_consumer);
+
+  for (int i = 0; i != static_cast<int>(chunks.size()); ++i) {
+    if (i != 0) {
+      lexer.HandleNewline();
     }
-    if (!result) {
-      result = lexer.LexNumericLiteral(source_text);
+    lexer.AppendChunk(chunks[i], chunk_consumers[i].diagnostics());
+  }
+
+  lexer.CloseInvalidOpenGroups(TokenKind::Error());
+  lexer.AddEndOfFileToken();
+
+  if (error_tracking_consumer.seen_error()) {
+    buffer.has_errors_ = true;
+  }
+
+  return buffer;
+}
+
+auto TokenizedBuffer::LexStream(SourceBuffer& source,
+                                DiagnosticConsumer& consumer,
+                                StreamedTokensHandler on_tokens,
+                                LiteralValues literal_values)
+    -> TokenizedBuffer {
+  TokenizedBuffer buffer(source);
+  buffer.lazy_literal_values_ = literal_values == LiteralValues::Lazy;
+  ErrorTrackingDiagnosticConsumer error_tracking_consumer(consumer);
+  Lexer lexer(buffer, error_tracking_consumer);
+
+  // The text is lexed a chunk of complete lines at a time, stitched together
+  // like the chunks of a parallel lex. A chunk ending in a multi-line string
+  // literal that may not be complete yet is lexed again once the text ahead of
+  // it has doubled, which keeps the work linear in the text.
+  int64_t searched_size = 0;
+  int64_t complete_size = 0;
+  int64_t lexed_size = 0;
+  int64_t retry_size = 0;
+  int reported_tokens = 0;
+  auto report_tokens = [&] {
+    on_tokens(buffer, llvm::make_range(TokenIterator(Token(reported_tokens)),
+                                       buffer.tokens().end()));
+    reported_tokens = buffer.size();
+  };
+  bool more = source.ReadMore(error_tracking_consumer);
+  while (true) {
+    llvm::StringRef text = source.text();
+    if (more) {
+      size_t newline = text.drop_front(searched_size).rfind('\n');
+      if (newline != llvm::StringRef::npos) {
+        complete_size = searched_size + newline + 1;
+      }
+      searched_size = text.size();
+    } else {
+      complete_size = text.size();
     }
-    if (!result) {
-      result = lexer.LexStringLiteral(source_text);
+
+    if (complete_size > lexed_size && (!more || complete_size >= retry_size)) {
+      llvm::StringRef chunk_text = text.slice(lexed_size, complete_size);
+      TokenizedBuffer chunk(source);
+      chunk.lazy_literal_values_ = buffer.lazy_literal_values_;
+      chunk.ReserveFor(chunk_text);
+      ChunkDiagnosticConsumer chunk_consumer(chunk);
+      Lexer chunk_lexer(chunk, chunk_consumer, lexed_size,
+                        /*defer_group_matching=*/true);
+      chunk_lexer.LexText(chunk_text);
+      chunk_lexer.AddEndOfFileToken();
+      if (more && chunk_lexer.lexed_multi_line_literal_to_end()) {
+        retry_size = complete_size + chunk_text.size();
+      } else {
+        if (lexed_size != 0) {
+          lexer.HandleNewline();
+        }
+        lexer.AppendChunk(chunk, chunk_consumer.diagnostics());
+        lexed_size = complete_size;
+        if (more) {
+          report_tokens();
+        }
+      }
     }
-    if (!result) {
-      result = lexer.LexError(source_text);
+    if (!more) {
+      break;
     }
-    COCKTAIL_CHECK(result) << "No token was lexed.";
+    more = source.ReadMore(error_tracking_consumer);
   }
 
-  lexer.NoteWhitespace();
-
   lexer.CloseInvalidOpenGroups(TokenKind::Error());
   lexer.AddEndOfFileToken();
+  report_tokens();
 
   if (error_tracking_consumer.seen_error()) {
     buffer.has_errors_ = true;
@@ -517,12 +1347,163 @@ auto TokenizedBuffer::Lex(SourceBuffer& source, DiagnosticConsumer& consumer)
   return buffer;
 }
 
-auto TokenizedBuffer::GetKind(Token token) const -> TokenKind {
-  return GetTokenInfo(token).kind;
+auto TokenizedBuffer::Relex(const TokenizedBuffer& previous,
+                            SourceBuffer& source, const TextEdit& edit,
+                            DiagnosticConsumer& consumer) -> TokenizedBuffer {
+  COCKTAIL_CHECK(!previous.literal_values_released_)
+      << "Relexing from a buffer whose literal values were released!";
+  llvm::StringRef previous_text = previous.source_->text();
+  llvm::StringRef text = source.text();
+  int64_t edit_end = edit.offset + edit.removed_length;
+  int64_t offset_delta =
+      static_cast<int64_t>(edit.inserted_text.size()) - edit.removed_length;
+  COCKTAIL_CHECK(edit.offset >= 0 && edit.removed_length >= 0 &&
+                 edit_end <= static_cast<int64_t>(previous_text.size()))
+      << "The edit must lie within the previous source!";
+  COCKTAIL_CHECK(
+      static_cast<int64_t>(text.size()) ==
+          static_cast<int64_t>(previous_text.size()) + offset_delta &&
+      text.substr(edit.offset, edit.inserted_text.size()) == edit.inserted_text)
+      << "The source must be the previous source after the edit!";
+
+  int num_lines = previous.line_infos_.size();
+  auto line_start = [&](int line) { return previous.line_infos_[line].start; };
+  auto line_containing = [&](int64_t offset) -> int {
+    return llvm::partition_point(previous.line_infos_,
+                                 [&](const LineInfo& line_info) {
+                                   return line_info.start <= offset;
+                                 }) -
+           previous.line_infos_.begin() - 1;
+  };
+  auto first_token_on = [&](int line) -> int {
+    auto tokens = llvm::seq(0, previous.size());
+    return *std::partition_point(tokens.begin(), tokens.end(), [&](int token) {
+      return previous.GetTokenStart(Token(token)) < line_start(line);
+    });
+  };
+  // Only a multi-line string literal, or an error where one was cut short,
+  // reaches past the line it starts on. One that ends at the start of a line
+  // has lexed its newline, and so has set that line's indent.
+  auto token_end = [&](int token) -> int64_t {
+    return previous.GetTokenStart(Token(token)) +
+           previous.GetTokenText(Token(token)).size();
+  };
+
+  // Restart from the line the edit begins on, or from the first line of a
+  // multi-line string literal that reaches it, which may itself be reached by
+  // another on the same line.
+  int restart_line = line_containing(edit.offset);
+  int restart_token = first_token_on(restart_line);
+  while (restart_token > 0 &&
+         token_end(restart_token - 1) >= line_start(restart_line)) {
+    restart_line = previous.GetLine(Token(restart_token - 1)).index_;
+    restart_token = first_token_on(restart_line);
+  }
+  int64_t restart_offset = line_start(restart_line);
+
+  // Lex from the restart line until the previous tokens line up again. That
+  // can first happen on a line after the edit that is preceded by an unchanged
+  // newline, which no previous token reaches past, and that no new token
+  // reaches either.
+  int resync_line = line_containing(edit_end) + 1;
+  int resync_token = previous.size() - 1;
+  int resync_step = 1;
+  TokenizedBuffer chunk(source);
+  llvm::Optional<ChunkDiagnosticConsumer> chunk_consumer;
+  while (true) {
+    while (resync_line < num_lines) {
+      // A multi-line string literal that ends with the source leaves an empty
+      // line after it, which is no line of the source.
+      if (line_start(resync_line) >=
+          static_cast<int64_t>(previous_text.size())) {
+        resync_line = num_lines;
+        break;
+      }
+      resync_token = first_token_on(resync_line);
+      int64_t previous_end =
+          resync_token > 0 ? token_end(resync_token - 1) : 0;
+      if (previous_end < line_start(resync_line)) {
+        break;
+      }
+      resync_line = line_containing(previous_end - 1) + 1;
+    }
+    int64_t resync_offset = resync_line < num_lines
+                                ? line_start(resync_line) + offset_delta
+                                : static_cast<int64_t>(text.size());
+    llvm::StringRef chunk_text = text.slice(restart_offset, resync_offset);
+
+    chunk = TokenizedBuffer(source);
+    chunk.lazy_literal_values_ = previous.lazy_literal_values_;
+    chunk.ReserveFor(chunk_text);
+    chunk_consumer.emplace(chunk);
+    Lexer lexer(chunk, *chunk_consumer, restart_offset,
+                /*defer_group_matching=*/true);
+    lexer.LexText(chunk_text);
+    lexer.AddEndOfFileToken();
+    // A multi-line string literal cut short at the resync line means the
+    // tokens don't line up there, so try a line further on. Stepping further
+    // each time keeps the work linear in the text finally lexed.
+    if (resync_line >= num_lines || !lexer.lexed_multi_line_literal_to_end()) {
+      break;
+    }
+    resync_line += resync_step;
+    resync_step *= 2;
+  }
+
+  TokenizedBuffer buffer(source);
+  buffer.lazy_literal_values_ = previous.lazy_literal_values_;
+  buffer.ReserveFor(text);
+  ErrorTrackingDiagnosticConsumer error_tracking_consumer(consumer);
+  Lexer lexer(buffer, error_tracking_consumer);
+
+  if (restart_line > 0) {
+    lexer.CopyPreviousPrefix(previous, restart_token, restart_line);
+    lexer.HandleNewline();
+  }
+  lexer.AppendChunk(chunk, chunk_consumer->diagnostics());
+  if (resync_line < num_lines) {
+    lexer.HandleNewline();
+    lexer.AppendPreviousTokens(previous, resync_token, resync_line,
+                               offset_delta);
+  }
+
+  lexer.CloseInvalidOpenGroups(TokenKind::Error());
+  lexer.AddEndOfFileToken();
+
+  // The errors of the text that was not lexed again aren't known, so they
+  // are assumed to remain.
+  if (previous.has_errors_ || error_tracking_consumer.seen_error()) {
+    buffer.has_errors_ = true;
+  }
+
+  return buffer;
 }
 
 auto TokenizedBuffer::GetLine(Token token) const -> Line {
-  return GetTokenInfo(token).token_line;
+  return FindLine(GetTokenStart(token));
+}
+
+auto TokenizedBuffer::FindLine(int64_t offset) const -> Line {
+  int line = line_cursor_.get();
+  int num_lines = line_infos_.size();
+  auto is_on = [&](int line) {
+    return line < num_lines && line_infos_[line].start <= offset &&
+           (line + 1 == num_lines || offset < line_infos_[line + 1].start);
+  };
+  if (is_on(line)) {
+    return Line(line);
+  }
+  if (is_on(line + 1)) {
+    ++line;
+  } else {
+    line = llvm::partition_point(line_infos_,
+                                 [&](const LineInfo& line_info) {
+                                   return line_info.start <= offset;
+                                 }) -
+           line_infos_.begin() - 1;
+  }
+  line_cursor_.set(line);
+  return Line(line);
 }
 
 auto TokenizedBuffer::GetLineNumber(Token token) const -> int {
@@ -530,128 +1511,225 @@ auto TokenizedBuffer::GetLineNumber(Token token) const -> int {
 }
 
 auto TokenizedBuffer::GetColumnNumber(Token token) const -> int {
-  return GetTokenInfo(token).column + 1;
+  int64_t offset = GetTokenStart(token);
+  return offset - line_infos_[FindLine(offset).index_].start + 1;
 }
 
 auto TokenizedBuffer::GetTokenText(Token token) const -> llvm::StringRef {
-  const auto& token_info = GetTokenInfo(token);
-  llvm::StringRef fixed_spelling = token_info.kind.GetFixedSpelling();
+  TokenKind kind = GetKind(token);
+  llvm::StringRef fixed_spelling = kind.GetFixedSpelling();
   if (!fixed_spelling.empty()) {
     return fixed_spelling;
   }
 
-  if (token_info.kind == TokenKind::Error()) {
-    const auto& line_info = GetLineInfo(token_info.token_line);
-    int64_t token_start = line_info.start + token_info.column;
-    return source_->text().substr(token_start, token_info.error_length);
-  }
-
-  if (token_info.kind == TokenKind::IntegerLiteral() ||
-      token_info.kind == TokenKind::RealLiteral()) {
-    const auto& line_info = GetLineInfo(token_info.token_line);
-    int64_t token_start = line_info.start + token_info.column;
-    llvm::Optional<LexedNumericLiteral> relexed_token =
-        LexedNumericLiteral::Lex(source_->text().substr(token_start));
-    COCKTAIL_CHECK(relexed_token) << "Could not reform numeric literal token.";
-    return relexed_token->text();
-  }
-
-  if (token_info.kind == TokenKind::StringLiteral()) {
-    const auto& line_info = GetLineInfo(token_info.token_line);
-    int64_t token_start = line_info.start + token_info.column;
-    llvm::Optional<LexedStringLiteral> relexed_token =
-        LexedStringLiteral::Lex(source_->text().substr(token_start));
-    COCKTAIL_CHECK(relexed_token) << "Could not reform string literal token.";
-    return relexed_token->text();
+  // The text starts at the token's offset, with no need for its line.
+  const TokenPayload& payload = GetTokenPayload(token);
+  if (kind == TokenKind::Error()) {
+    return source_->text().substr(GetTokenStart(token), payload.error_length);
   }
 
-  if (token_info.kind.IsSizedTypeLiteral()) {
-    const auto& line_info = GetLineInfo(token_info.token_line);
-    int64_t token_start = line_info.start + token_info.column;
-    llvm::StringRef suffix =
-        source_->text().substr(token_start + 1).take_while(IsDecimalDigit);
-    return llvm::StringRef(suffix.data() - 1, suffix.size() + 1);
+  if (kind == TokenKind::IntegerLiteral() || kind == TokenKind::RealLiteral() ||
+      kind == TokenKind::StringLiteral() || kind.IsSizedTypeLiteral()) {
+    return source_->text().substr(GetTokenStart(token),
+                                 payload.literal.length);
   }
 
-  if (token_info.kind == TokenKind::EndOfFile()) {
+  if (kind == TokenKind::EndOfFile()) {
     return llvm::StringRef();
   }
 
-  COCKTAIL_CHECK(token_info.kind == TokenKind::Identifier())
+  COCKTAIL_CHECK(kind == TokenKind::Identifier())
       << "Only identifiers have stored text!";
-  return GetIdentifierText(token_info.id);
+  return GetIdentifierText(payload.id);
 }
 
 auto TokenizedBuffer::GetIdentifier(Token token) const -> Identifier {
-  const auto& token_info = GetTokenInfo(token);
-  COCKTAIL_CHECK(token_info.kind == TokenKind::Identifier())
+  COCKTAIL_CHECK(GetKind(token) == TokenKind::Identifier())
       << "The token must be an identifier!";
-  return token_info.id;
+  return GetTokenPayload(token).id;
 }
 
-auto TokenizedBuffer::GetIntegerLiteral(Token token) const
-    -> const llvm::APInt& {
-  const auto& token_info = GetTokenInfo(token);
-  COCKTAIL_CHECK(token_info.kind == TokenKind::IntegerLiteral())
+auto TokenizedBuffer::GetIntegerLiteral(Token token) const -> llvm::APInt {
+  COCKTAIL_CHECK(GetKind(token) == TokenKind::IntegerLiteral())
       << "The token must be an integer literal!";
-  return literal_int_storage_[token_info.literal_index];
+  return GetIntegerValue(GetLiteralIndex(token));
 }
 
 auto TokenizedBuffer::GetRealLiteral(Token token) const -> RealLiteralValue {
-  const auto& token_info = GetTokenInfo(token);
-  COCKTAIL_CHECK(token_info.kind == TokenKind::RealLiteral())
+  COCKTAIL_CHECK(GetKind(token) == TokenKind::RealLiteral())
       << "The token must be a real literal!";
 
-  const auto& line_info = GetLineInfo(token_info.token_line);
-  int64_t token_start = line_info.start + token_info.column;
-  char second_char = source_->text()[token_start + 1];
+  char second_char = source_->text()[GetTokenStart(token) + 1];
   bool is_decimal = second_char != 'x' && second_char != 'b';
 
-  return RealLiteralValue(this, token_info.literal_index, is_decimal);
+  return RealLiteralValue(this, GetLiteralIndex(token), is_decimal);
 }
 
 auto TokenizedBuffer::GetStringLiteral(Token token) const -> llvm::StringRef {
-  const auto& token_info = GetTokenInfo(token);
-  COCKTAIL_CHECK(token_info.kind == TokenKind::StringLiteral())
+  COCKTAIL_CHECK(GetKind(token) == TokenKind::StringLiteral())
       << "The token must be a string literal!";
-  return literal_string_storage_[token_info.literal_index];
+  return literal_string_storage_[GetLiteralIndex(token)].val();
 }
 
-auto TokenizedBuffer::GetTypeLiteralSize(Token token) const
-    -> const llvm::APInt& {
-  const auto& token_info = GetTokenInfo(token);
-  COCKTAIL_CHECK(token_info.kind.IsSizedTypeLiteral())
+auto TokenizedBuffer::GetHashedStringLiteral(Token token) const
+    -> llvm::CachedHashStringRef {
+  COCKTAIL_CHECK(GetKind(token) == TokenKind::StringLiteral())
+      << "The token must be a string literal!";
+  return literal_string_storage_[GetLiteralIndex(token)];
+}
+
+auto TokenizedBuffer::GetTypeLiteralSize(Token token) const -> llvm::APInt {
+  COCKTAIL_CHECK(GetKind(token).IsSizedTypeLiteral())
       << "The token must be a sized type literal!";
-  return literal_int_storage_[token_info.literal_index];
+  return GetIntegerValue(GetTokenPayload(token).literal.index);
+}
+
+auto TokenizedBuffer::memory_bytes() const -> int64_t {
+  return GetMemoryUsage().allocated_bytes();
+}
+
+auto TokenizedBuffer::GetMemoryUsage() const -> MemoryUsage {
+  MemoryUsage usage;
+  MemoryUsage columns;
+  columns.Add("token_kinds", token_kinds_);
+  columns.Add("token_has_trailing_space", token_has_trailing_space_);
+  columns.Add("token_is_recovery", token_is_recovery_);
+  columns.Add("token_offsets", token_offsets_);
+  columns.Add("token_offset_segments", token_offset_segments_);
+  columns.Add("token_payloads", token_payloads_);
+  usage.Add("token_infos", columns.used_bytes(), columns.allocated_bytes());
+  usage.Add("line_infos", line_infos_);
+  usage.Add("identifier_infos", identifier_infos_);
+  usage.Add("identifier_map", identifier_map_);
+  usage.Add("interned_identifiers", interned_identifiers_);
+  if (literal_values_released_) {
+    return usage;
+  }
+  // Integers too wide for an `APInt`'s inline word are stored out of line.
+  int64_t int_words_bytes = 0;
+  for (const llvm::APInt& value : literal_int_storage_) {
+    if (!value.isSingleWord()) {
+      int_words_bytes += value.getNumWords() * sizeof(uint64_t);
+    }
+  }
+  usage.Add("literal_int_storage",
+            literal_int_storage_.size() * sizeof(llvm::APInt) +
+                int_words_bytes,
+            literal_int_storage_.capacity() * sizeof(llvm::APInt) +
+                int_words_bytes);
+  // Unescaped string values are allocated apart from their references, in
+  // the compilation's arena if there is one, which the buffer doesn't own.
+  usage.Add("literal_string_storage",
+            literal_string_storage_.size() *
+                    sizeof(llvm::CachedHashStringRef) +
+                string_storage_allocator_.getBytesAllocated(),
+            literal_string_storage_.capacity() *
+                    sizeof(llvm::CachedHashStringRef) +
+                string_storage_allocator_.getTotalMemory());
+  usage.Add("lazy_literal_indices", lazy_literal_indices_);
+  return usage;
+}
+
+auto TokenizedBuffer::ReleaseLiteralValues() -> int64_t {
+  if (literal_values_released_) {
+    return 0;
+  }
+  int64_t bytes = memory_bytes();
+  // Clearing alone keeps the allocations, so the storage is swapped out.
+  decltype(literal_int_storage_)().swap(literal_int_storage_);
+  decltype(literal_string_storage_)().swap(literal_string_storage_);
+  decltype(lazy_literal_indices_)().swap(lazy_literal_indices_);
+  // Values in a compilation's arena are only freed along with it.
+  string_storage_allocator_.Reset();
+  literal_values_released_ = true;
+  return bytes - memory_bytes();
 }
 
 auto TokenizedBuffer::GetMatchedClosingToken(Token opening_token) const
     -> Token {
-  const auto& opening_token_info = GetTokenInfo(opening_token);
-  COCKTAIL_CHECK(opening_token_info.kind.IsOpeningSymbol())
+  COCKTAIL_CHECK(GetKind(opening_token).IsOpeningSymbol())
       << "The token must be an opening group symbol!";
-  return opening_token_info.closing_token;
+  return GetTokenPayload(opening_token).closing_token;
 }
 
 auto TokenizedBuffer::GetMatchedOpeningToken(Token closing_token) const
     -> Token {
-  const auto& closing_token_info = GetTokenInfo(closing_token);
-  COCKTAIL_CHECK(closing_token_info.kind.IsClosingSymbol())
+  COCKTAIL_CHECK(GetKind(closing_token).IsClosingSymbol())
       << "The token must be an closing group symbol!";
-  return closing_token_info.opening_token;
+  return GetTokenPayload(closing_token).opening_token;
+}
+
+auto TokenizedBuffer::FindNextKindIn(Token token,
+                                     const TokenKindSet& kinds) const
+    -> TokenIterator {
+  const TokenKind* const begin = token_kinds_.begin();
+  const TokenKind* const end = token_kinds_.end();
+  const TokenKind* position = begin + token.index_;
+#if COCKTAIL_BYTE_VECTORS
+  // Each kind in the set costs a comparison per vector, so only small sets,
+  // like the ones the parser recovers with, are worth vectorizing.
+  static_assert(sizeof(TokenKind) == 1,
+                "Token kinds must be bytes to be scanned as vectors!");
+  constexpr int MaxVectorKinds = 16;
+  constexpr int VectorSize = sizeof(ByteVector);
+  int num_kinds = kinds.size();
+  if (num_kinds <= MaxVectorKinds) {
+    ByteVector splats[MaxVectorKinds];
+    int i = 0;
+    kinds.ForEach([&](TokenKind kind) {
+      splats[i++] = SplatByte(llvm::bit_cast<char>(kind));
+    });
+    for (; end - position >= VectorSize; position += VectorSize) {
+      ByteVector bytes =
+          LoadByteVector(reinterpret_cast<const char*>(position));
+      ByteVector matches = SplatByte(0);
+      for (int kind_index = 0; kind_index != num_kinds; ++kind_index) {
+        matches = BytesOr(matches, BytesEqual(bytes, splats[kind_index]));
+      }
+      if (AnyHighBit(matches)) {
+        position += CountLeadingMatches(BytesNot(matches));
+        return TokenIterator(Token(position - begin));
+      }
+    }
+  }
+#endif
+  while (position != end && !kinds.Contains(*position)) {
+    ++position;
+  }
+  return TokenIterator(Token(position - begin));
+}
+
+auto TokenizedBuffer::FindTokenAtOffset(int64_t offset) const
+    -> llvm::Optional<Token> {
+  auto token_start = [&](int index) { return GetTokenStart(Token(index)); };
+  // Tokens start in order, so find the last one starting at or before
+  // `offset` and check whether its text reaches it.
+  auto indices = llvm::seq(0, size());
+  auto it = std::partition_point(
+      indices.begin(), indices.end(),
+      [&](int index) { return token_start(index) <= offset; });
+  if (it == indices.begin()) {
+    return llvm::None;
+  }
+  Token token(*(it - 1));
+  if (offset >= token_start(token.index_) +
+                    static_cast<int64_t>(GetTokenText(token).size())) {
+    return llvm::None;
+  }
+  return token;
 }
 
 auto TokenizedBuffer::HasLeadingWhitespace(Token token) const -> bool {
   auto it = TokenIterator(token);
-  return it == tokens().begin() || GetTokenInfo(*(it - 1)).has_trailing_space;
+  return it == tokens().begin() || HasTrailingWhitespace(*(it - 1));
 }
 
 auto TokenizedBuffer::HasTrailingWhitespace(Token token) const -> bool {
-  return GetTokenInfo(token).has_trailing_space;
+  return token_has_trailing_space_.test(token.index_);
 }
 
 auto TokenizedBuffer::IsRecoveryToken(Token token) const -> bool {
-  return GetTokenInfo(token).is_recovery;
+  return token_is_recovery_.test(token.index_);
 }
 
 auto TokenizedBuffer::GetLineNumber(Line line) const -> int {
@@ -667,12 +1745,30 @@ auto TokenizedBuffer::GetIdentifierText(Identifier identifier) const
   return identifier_infos_[identifier.index_].text;
 }
 
-auto TokenizedBuffer::PrintWidths::Widen(const PrintWidths& widths) -> void {
-  index = std::max(index, widths.index);
-  kind = std::max(kind, widths.kind);
-  line = std::max(line, widths.line);
-  column = std::max(column, widths.column);
-  indent = std::max(indent, widths.indent);
+auto TokenizedBuffer::FindIdentifier(llvm::StringRef text) const
+    -> llvm::Optional<Identifier> {
+  auto it = identifier_map_.find(HashedIdentifier(text));
+  if (it == identifier_map_.end()) {
+    return llvm::None;
+  }
+  return it->second;
+}
+
+auto TokenizedBuffer::InternIdentifiers(IdentifierTable& table) -> void {
+  llvm::SmallVector<HashedIdentifier, 0> identifiers;
+  identifiers.reserve(identifier_infos_.size());
+  for (const IdentifierInfo& info : identifier_infos_) {
+    identifiers.push_back(HashedIdentifier(info.text, info.hash));
+  }
+  interned_identifiers_.resize(identifiers.size());
+  table.Intern(identifiers, interned_identifiers_);
+}
+
+auto TokenizedBuffer::GetInternedIdentifier(Identifier identifier) const
+    -> IdentifierTable::Id {
+  COCKTAIL_CHECK(interned_identifiers_.size() == identifier_infos_.size())
+      << "Identifiers have not been interned!";
+  return interned_identifiers_[identifier.index_];
 }
 
 static auto ComputeDecimalPrintedWidth(int number) -> int {
@@ -686,7 +1782,7 @@ static auto ComputeDecimalPrintedWidth(int number) -> int {
 
 auto TokenizedBuffer::GetTokenPrintWidths(Token token) const -> PrintWidths {
   PrintWidths widths = {};
-  widths.index = ComputeDecimalPrintedWidth(token_infos_.size());
+  widths.index = ComputeDecimalPrintedWidth(token_kinds_.size());
   widths.kind = GetKind(token).Name().size();
   widths.line = ComputeDecimalPrintedWidth(GetLineNumber(token));
   widths.column = ComputeDecimalPrintedWidth(GetColumnNumber(token));
@@ -695,16 +1791,38 @@ auto TokenizedBuffer::GetTokenPrintWidths(Token token) const -> PrintWidths {
   return widths;
 }
 
-auto TokenizedBuffer::Print(llvm::raw_ostream& output_stream) const -> void {
+auto TokenizedBuffer::Print(llvm::raw_ostream& output_stream,
+                            PrintFormat format) const -> void {
+  if (format == PrintFormat::Ndjson) {
+    PrintNdjson(output_stream);
+    return;
+  }
   if (tokens().begin() == tokens().end()) {
     return;
   }
 
-  PrintWidths widths = {};
-  widths.index = ComputeDecimalPrintedWidth(token_infos_.size());
-  for (Token token : tokens()) {
-    widths.Widen(GetTokenPrintWidths(token));
+  // Each width only depends on the largest value of its field, so find those
+  // with a scan over the columns rather than by formatting every field twice.
+  int max_kind_size = 0;
+  int max_line_index = 0;
+  int max_column = 0;
+  int max_indent = 0;
+  for (int i = 0; i != size(); ++i) {
+    max_kind_size = std::max<int>(max_kind_size, token_kinds_[i].Name().size());
+    int64_t offset = GetTokenStart(Token(i));
+    Line line = FindLine(offset);
+    const LineInfo& line_info = line_infos_[line.index_];
+    max_line_index = std::max(max_line_index, line.index_);
+    max_column =
+        std::max(max_column, static_cast<int>(offset - line_info.start));
+    max_indent = std::max(max_indent, line_info.indent);
   }
+  PrintWidths widths = {
+      .index = ComputeDecimalPrintedWidth(token_kinds_.size()),
+      .kind = max_kind_size,
+      .column = ComputeDecimalPrintedWidth(max_column + 1),
+      .line = ComputeDecimalPrintedWidth(max_line_index + 1),
+      .indent = ComputeDecimalPrintedWidth(max_indent + 1)};
 
   for (Token token : tokens()) {
     PrintToken(output_stream, token, widths);
@@ -714,14 +1832,13 @@ auto TokenizedBuffer::Print(llvm::raw_ostream& output_stream) const -> void {
 
 auto TokenizedBuffer::PrintToken(llvm::raw_ostream& output_stream,
                                  Token token) const -> void {
-  PrintToken(output_stream, token, {});
+  PrintToken(output_stream, token, GetTokenPrintWidths(token));
 }
 
 auto TokenizedBuffer::PrintToken(llvm::raw_ostream& output_stream, Token token,
                                  PrintWidths widths) const -> void {
-  widths.Widen(GetTokenPrintWidths(token));
   int token_index = token.index_;
-  const auto& token_info = GetTokenInfo(token);
+  TokenInfo token_info = GetTokenInfo(token);
   llvm::StringRef token_text = GetTokenText(token);
 
   output_stream << llvm::formatv(
@@ -742,7 +1859,9 @@ auto TokenizedBuffer::PrintToken(llvm::raw_ostream& output_stream, Token token,
       output_stream << ", identifier: " << GetIdentifier(token).index_;
       break;
     case TokenKind::IntegerLiteral():
-      output_stream << ", value: `" << GetIntegerLiteral(token) << "`";
+      output_stream << ", value: `";
+      GetIntegerLiteral(token).print(output_stream, /*isSigned=*/false);
+      output_stream << "`";
       break;
     case TokenKind::RealLiteral():
       output_stream << ", value: `" << GetRealLiteral(token) << "`";
@@ -771,6 +1890,82 @@ auto TokenizedBuffer::PrintToken(llvm::raw_ostream& output_stream, Token token,
   output_stream << " }";
 }
 
+auto TokenizedBuffer::PrintNdjson(llvm::raw_ostream& output_stream) const
+    -> void {
+  // Tokens are formatted into a large buffer that is written out each time it
+  // fills, rather than through the stream a field at a time.
+  constexpr size_t FlushSize = 1 << 16;
+  llvm::SmallString<0> out;
+  out.reserve(FlushSize * 2);
+
+  for (Token token : tokens()) {
+    TokenInfo token_info = GetTokenInfo(token);
+    auto append = [&](llvm::StringRef text) {
+      out.append(text.begin(), text.end());
+    };
+    append(R"({"index":)");
+    AppendInt(out, token.index_);
+    append(R"(,"kind":")");
+    append(token_info.kind.Name());
+    append(R"(","line":)");
+    AppendInt(out, GetLineNumber(token_info.token_line));
+    append(R"(,"column":)");
+    AppendInt(out, GetColumnNumber(token));
+    append(R"(,"indent":)");
+    AppendInt(out, GetIndentColumnNumber(token_info.token_line));
+    append(R"(,"spelling":)");
+    AppendJsonString(out, GetTokenText(token));
+
+    switch (token_info.kind) {
+      case TokenKind::Identifier():
+        append(R"(,"identifier":)");
+        AppendInt(out, GetIdentifier(token).index_);
+        break;
+      case TokenKind::IntegerLiteral():
+        // Values may be arbitrarily wide, so they are written as strings.
+        append(R"(,"value":")");
+        GetIntegerLiteral(token).toString(out, /*Radix=*/10, /*Signed=*/false);
+        append(R"(")");
+        break;
+      case TokenKind::RealLiteral(): {
+        llvm::SmallString<32> value;
+        llvm::raw_svector_ostream value_stream(value);
+        GetRealLiteral(token).Print(value_stream);
+        append(R"(,"value":)");
+        AppendJsonString(out, value);
+        break;
+      }
+      case TokenKind::StringLiteral():
+        append(R"(,"value":)");
+        AppendJsonString(out, GetStringLiteral(token));
+        break;
+      default:
+        if (token_info.kind.IsOpeningSymbol()) {
+          append(R"(,"closing_token":)");
+          AppendInt(out, GetMatchedClosingToken(token).index_);
+        } else if (token_info.kind.IsClosingSymbol()) {
+          append(R"(,"opening_token":)");
+          AppendInt(out, GetMatchedOpeningToken(token).index_);
+        }
+        break;
+    }
+
+    if (token_info.has_trailing_space) {
+      append(R"(,"has_trailing_space":true)");
+    }
+    if (token_info.is_recovery) {
+      append(R"(,"recovery":true)");
+    }
+    append("}\n");
+
+    if (out.size() >= FlushSize) {
+      output_stream << out;
+      out.clear();
+    }
+  }
+  output_stream << out;
+}
+
 auto TokenizedBuffer::GetLineInfo(Line line) -> LineInfo& {
   return line_infos_[line.index_];
 }
@@ -779,50 +1974,264 @@ auto TokenizedBuffer::GetLineInfo(Line line) const -> const LineInfo& {
   return line_infos_[line.index_];
 }
 
+auto TokenizedBuffer::ReserveFor(llvm::StringRef text) -> void {
+  // Lines are counted exactly. Tokens and identifiers are estimated from the
+  // byte count: punctuation-dense code averages about a token every three
+  // bytes and has far fewer distinct identifiers, so this rarely has to grow
+  // and over-reserves only modestly for comment-heavy files.
+  int64_t lines = std::count(text.begin(), text.end(), '\n') + 1;
+  // Tokens are indexed by `int32_t`, so the estimate is capped for buffers
+  // past 2GiB.
+  int64_t tokens = std::min<int64_t>(text.size() / 3 + 1,
+                                     std::numeric_limits<int32_t>::max());
+  int64_t identifiers = text.size() / 64 + 1;
+
+  line_infos_.reserve(lines);
+  token_kinds_.reserve(tokens);
+  token_has_trailing_space_.reserve(tokens);
+  token_is_recovery_.reserve(tokens);
+  token_offsets_.reserve(tokens);
+  token_payloads_.reserve(tokens);
+  identifier_infos_.reserve(identifiers);
+  identifier_map_.reserve(identifiers);
+}
+
 auto TokenizedBuffer::AddLine(LineInfo info) -> Line {
+  if (line_infos_.size() == line_infos_.capacity()) {
+    ++lex_stats_.line_reallocations;
+  }
+  COCKTAIL_CHECK(line_infos_.size() < std::numeric_limits<int32_t>::max())
+      << "Too many lines in one buffer!";
   line_infos_.push_back(info);
   return Line(static_cast<int>(line_infos_.size()) - 1);
 }
 
-auto TokenizedBuffer::GetTokenInfo(Token token) -> TokenInfo& {
-  return token_infos_[token.index_];
+auto TokenizedBuffer::GetTokenInfo(Token token) const -> TokenInfo {
+  int index = token.index_;
+  int64_t offset = GetTokenStart(token);
+  Line line = FindLine(offset);
+  return {.kind = token_kinds_[index],
+          .has_trailing_space = token_has_trailing_space_.test(index),
+          .is_recovery = token_is_recovery_.test(index),
+          .token_line = line,
+          .column = static_cast<int32_t>(offset - GetLineInfo(line).start),
+          .payload = token_payloads_[index]};
 }
 
-auto TokenizedBuffer::GetTokenInfo(Token token) const -> const TokenInfo& {
-  return token_infos_[token.index_];
+auto TokenizedBuffer::GetTokenPayload(Token token) -> TokenPayload& {
+  return token_payloads_[token.index_];
+}
+
+auto TokenizedBuffer::GetTokenPayload(Token token) const
+    -> const TokenPayload& {
+  return token_payloads_[token.index_];
 }
 
 auto TokenizedBuffer::AddToken(TokenInfo info) -> Token {
-  token_infos_.push_back(info);
-  return Token(static_cast<int>(token_infos_.size()) - 1);
+  if (token_kinds_.size() == token_kinds_.capacity()) {
+    ++lex_stats_.token_reallocations;
+  }
+  COCKTAIL_CHECK(token_kinds_.size() < std::numeric_limits<int32_t>::max())
+      << "Too many tokens in one buffer!";
+  token_kinds_.push_back(info.kind);
+  token_has_trailing_space_.push_back(info.has_trailing_space);
+  token_is_recovery_.push_back(info.is_recovery);
+  AddTokenOffset(GetLineInfo(info.token_line).start + info.column);
+  token_payloads_.push_back(info.payload);
+  return Token(static_cast<int>(token_kinds_.size()) - 1);
+}
+
+auto TokenizedBuffer::AddTokenOffset(int64_t offset) -> void {
+  // The token being added is the last one whose kind is stored.
+  int32_t index = token_offsets_.size();
+  while ((offset >> 32) > static_cast<int64_t>(token_offset_segments_.size())) {
+    token_offset_segments_.push_back(index);
+  }
+  token_offsets_.push_back(static_cast<uint32_t>(offset));
+}
+
+auto TokenizedBuffer::AddIntegerValue(llvm::APInt value) const -> int32_t {
+  if (value.getActiveBits() <= InlineLiteralBits) {
+    return ~static_cast<int32_t>(value.getZExtValue());
+  }
+  literal_int_storage_.push_back(std::move(value));
+  return literal_int_storage_.size() - 1;
+}
+
+auto TokenizedBuffer::AddRealValue(llvm::APInt mantissa,
+                                   llvm::APInt exponent) const -> int32_t {
+  if (mantissa.getActiveBits() <= InlineRealMantissaBits &&
+      exponent.getMinSignedBits() <= InlineRealExponentBits) {
+    uint64_t exponent_bits =
+        exponent.getSExtValue() & ((1 << InlineRealExponentBits) - 1);
+    uint64_t bits =
+        mantissa.getZExtValue() << InlineRealExponentBits | exponent_bits;
+    return ~static_cast<int32_t>(bits);
+  }
+  literal_int_storage_.push_back(std::move(mantissa));
+  literal_int_storage_.push_back(std::move(exponent));
+  return literal_int_storage_.size() - 2;
+}
+
+auto TokenizedBuffer::GetIntegerValue(int32_t index) const -> llvm::APInt {
+  if (index < 0) {
+    return llvm::APInt(64, ~index);
+  }
+  COCKTAIL_CHECK(!literal_values_released_)
+      << "The buffer's literal values were released!";
+  return literal_int_storage_[index];
+}
+
+auto TokenizedBuffer::GetLiteralIndex(Token token) const -> int32_t {
+  COCKTAIL_CHECK(!literal_values_released_)
+      << "The buffer's literal values were released!";
+  if (!lazy_literal_values_) {
+    return GetTokenPayload(token).literal.index;
+  }
+  auto [it, inserted] = lazy_literal_indices_.try_emplace(token.index_, 0);
+  if (inserted) {
+    // Diagnostics are left to `ValidateLiterals`. An invalid literal's value
+    // is zero, which is inline for both integers and reals.
+    it->second =
+        ComputeLiteralValue(token, NullDiagnosticEmitter<const char*>())
+            .getValueOr(AddIntegerValue(llvm::APInt(64, 0)));
+  }
+  return it->second;
+}
+
+auto TokenizedBuffer::ComputeLiteralValue(
+    Token token, DiagnosticEmitter<const char*>& emitter) const
+    -> llvm::Optional<int32_t> {
+  llvm::StringRef text = GetTokenText(token);
+  if (GetKind(token) == TokenKind::StringLiteral()) {
+    llvm::Optional<LexedStringLiteral> literal = LexedStringLiteral::Lex(text);
+    COCKTAIL_CHECK(literal) << "Relexing a string literal failed!";
+    literal_string_storage_.push_back(llvm::CachedHashStringRef(
+        literal->ComputeValue(string_storage(), emitter)));
+    return literal_string_storage_.size() - 1;
+  }
+
+  llvm::Optional<LexedNumericLiteral> literal = LexedNumericLiteral::Lex(text);
+  COCKTAIL_CHECK(literal) << "Relexing a numeric literal failed!";
+  return VariantMatch(
+      literal->ComputeValue(emitter),
+      [&](LexedNumericLiteral::IntegerValue&& value) -> llvm::Optional<int32_t> {
+        return AddIntegerValue(std::move(value.value));
+      },
+      [&](LexedNumericLiteral::RealValue&& value) -> llvm::Optional<int32_t> {
+        return AddRealValue(std::move(value.mantissa),
+                            std::move(value.exponent));
+      },
+      [&](LexedNumericLiteral::UnrecoverableError) -> llvm::Optional<int32_t> {
+        return llvm::None;
+      });
+}
+
+auto TokenizedBuffer::ValidateLiterals(DiagnosticConsumer& consumer) -> void {
+  COCKTAIL_CHECK(!literal_values_released_)
+      << "The buffer's literal values were released!";
+  if (!lazy_literal_values_) {
+    return;
+  }
+
+  ErrorTrackingDiagnosticConsumer error_tracking_consumer(consumer);
+  SourceBufferLocationTranslator translator(
+      *this, /*last_line_lexed_to_column=*/nullptr);
+  LexerDiagnosticEmitter emitter(translator, error_tracking_consumer);
+  // String values are stored again in token order, as in a buffer lexed
+  // eagerly.
+  literal_string_storage_.clear();
+  for (int i = 0; i != size(); ++i) {
+    TokenKind kind = token_kinds_[i];
+    if (kind != TokenKind::IntegerLiteral() &&
+        kind != TokenKind::RealLiteral() &&
+        kind != TokenKind::StringLiteral()) {
+      continue;
+    }
+    // Values that were already asked for are computed again, as their
+    // diagnostics were dropped.
+    TokenPayload& payload = token_payloads_[i];
+    if (llvm::Optional<int32_t> index = ComputeLiteralValue(Token(i), emitter)) {
+      payload.literal.index = *index;
+    } else {
+      token_kinds_[i] = TokenKind::Error();
+      payload = {.error_length = payload.literal.length};
+    }
+  }
+  lazy_literal_values_ = false;
+  lazy_literal_indices_.clear();
+
+  if (error_tracking_consumer.seen_error()) {
+    has_errors_ = true;
+  }
+}
+
+auto TokenizedBuffer::RealLiteralValue::Mantissa() const -> llvm::APInt {
+  if (literal_index_ < 0) {
+    return llvm::APInt(64, ~literal_index_ >> InlineRealExponentBits);
+  }
+  return buffer_->literal_int_storage_[literal_index_];
+}
+
+auto TokenizedBuffer::RealLiteralValue::Exponent() const -> llvm::APInt {
+  if (literal_index_ < 0) {
+    return llvm::APInt(InlineRealExponentBits, ~literal_index_).sext(64);
+  }
+  return buffer_->literal_int_storage_[literal_index_ + 1];
+}
+
+auto TokenizedBuffer::RealLiteralValue::ToDouble() const -> double {
+  return RealLiteralToDouble(Mantissa(), Exponent(), is_decimal_);
+}
+
+auto TokenizedBuffer::RealLiteralValue::ToFloat() const -> float {
+  return RealLiteralToFloat(Mantissa(), Exponent(), is_decimal_);
 }
 
 auto TokenizedBuffer::TokenIterator::Print(llvm::raw_ostream& output) const
     -> void {
   output << token_.index_;
 }
-auto TokenizedBuffer::SourceBufferLocationTranslator::GetLocation(
-    const char* loc) -> DiagnosticLocation {
-  COCKTAIL_CHECK(StringRefContainsPointer(buffer_->source_->text(), loc))
-      << "location not within buffer";
-  int64_t offset = loc - buffer_->source_->text().begin();
+auto TokenizedBuffer::SourceBufferLocationTranslator::FindLine(
+    int64_t offset, int first) const -> int {
+  const auto& lines = buffer_->line_infos_;
+  COCKTAIL_CHECK(offset >= lines[first].start)
+      << "location precedes the start of the first line";
 
+  // Diagnostics are usually for the most recently lexed line, and batches of
+  // locations tend to be close together, so gallop forward from `first`
+  // before binary searching.
+  int size = lines.size();
+  if (lines.back().start <= offset) {
+    return size - 1;
+  }
+  int step = 1;
+  int low = first;
+  int high = first + 1;
+  while (high < size && lines[high].start <= offset) {
+    low = high;
+    high = std::min(size, high + step);
+    step *= 2;
+  }
   auto* line_it = std::partition_point(
-      buffer_->line_infos_.begin(), buffer_->line_infos_.end(),
+      lines.begin() + low + 1, lines.begin() + high,
       [offset](const LineInfo& line) { return line.start <= offset; });
-  bool incomplete_line_info = last_line_lexed_to_column_ != nullptr &&
-                              line_it == buffer_->line_infos_.end();
+  return line_it - lines.begin() - 1;
+}
 
-  COCKTAIL_CHECK(line_it != buffer_->line_infos_.begin())
-      << "location precedes the start of the first line";
-  --line_it;
-  int line_number = line_it - buffer_->line_infos_.begin();
-  int column_number = offset - line_it->start;
+auto TokenizedBuffer::SourceBufferLocationTranslator::MakeLocation(
+    int64_t offset, int line_index) const -> DiagnosticLocation {
+  int line_number = line_index;
+  int column_number = offset - buffer_->line_infos_[line_index].start;
 
+  bool incomplete_line_info =
+      last_line_lexed_to_column_ != nullptr &&
+      line_index == static_cast<int>(buffer_->line_infos_.size()) - 1;
   if (incomplete_line_info && column_number > *last_line_lexed_to_column_) {
     column_number = *last_line_lexed_to_column_;
-    for (int64_t i = line_it->start + *last_line_lexed_to_column_; i != offset;
-         ++i) {
+    for (int64_t i = buffer_->line_infos_[line_index].start +
+                     *last_line_lexed_to_column_;
+         i != offset; ++i) {
       if (buffer_->source_->text()[i] == '\n') {
         ++line_number;
         column_number = 0;
@@ -832,20 +2241,64 @@ auto TokenizedBuffer::SourceBufferLocationTranslator::GetLocation(
     }
   }
 
-  return {.file_name = buffer_->source_->filename().str(),
+  return {.file_name = buffer_->source_->filename(),
           .line_number = line_number + 1,
           .column_number = column_number + 1};
 }
 
+auto TokenizedBuffer::SourceBufferLocationTranslator::GetLocation(
+    const char* loc) -> DiagnosticLocation {
+  COCKTAIL_CHECK(StringRefContainsPointer(buffer_->source_->text(), loc))
+      << "location not within buffer";
+  int64_t offset = loc - buffer_->source_->text().begin();
+  return MakeLocation(offset, FindLine(offset, /*first=*/0));
+}
+
+auto TokenizedBuffer::SourceBufferLocationTranslator::GetLocations(
+    llvm::ArrayRef<const char*> locs,
+    llvm::MutableArrayRef<DiagnosticLocation> locations) -> void {
+  COCKTAIL_CHECK(locs.size() == locations.size())
+      << "mismatched number of locations";
+  llvm::SmallVector<int, 0> order(locs.size());
+  std::iota(order.begin(), order.end(), 0);
+  // Sorting is unnecessary for the common case of locations emitted in order.
+  auto by_address = [&](int lhs, int rhs) {
+    return std::less<>()(locs[lhs], locs[rhs]);
+  };
+  if (!std::is_sorted(order.begin(), order.end(), by_address)) {
+    std::sort(order.begin(), order.end(), by_address);
+  }
+
+  int line_index = 0;
+  for (int i : order) {
+    COCKTAIL_CHECK(StringRefContainsPointer(buffer_->source_->text(), locs[i]))
+        << "location not within buffer";
+    int64_t offset = locs[i] - buffer_->source_->text().begin();
+    line_index = FindLine(offset, line_index);
+    locations[i] = MakeLocation(offset, line_index);
+  }
+}
+
 auto TokenizedBuffer::TokenLocationTranslator::GetLocation(Token token)
     -> DiagnosticLocation {
-  auto& token_info = buffer_->GetTokenInfo(token);
-  auto& line_info = buffer_->GetLineInfo(token_info.token_line);
-  const char* token_start =
-      buffer_->source_->text().begin() + line_info.start + token_info.column;
+  // The token's line is found from its offset, starting at the line found
+  // last. The exception is a token past the point that the lexer has finished
+  // computing lines for; those go through the source translator.
+  int64_t offset = buffer_->GetTokenStart(token);
+  Line line = buffer_->FindLine(offset);
+  int column = offset - buffer_->GetLineInfo(line).start;
+  if (last_line_lexed_to_column_ != nullptr &&
+      line.index_ == static_cast<int>(buffer_->line_infos_.size()) - 1 &&
+      column > *last_line_lexed_to_column_) {
+    const char* token_start = buffer_->source_->text().begin() +
+                              buffer_->GetLineInfo(line).start + column;
+    return SourceBufferLocationTranslator(*buffer_, last_line_lexed_to_column_)
+        .GetLocation(token_start);
+  }
 
-  return SourceBufferLocationTranslator(*buffer_, last_line_lexed_to_column_)
-      .GetLocation(token_start);
+  return {.file_name = buffer_->source_->filename(),
+          .line_number = line.index_ + 1,
+          .column_number = column + 1};
 }
 
 }  // namespace Cocktail
\ No newline at end of file
@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#include "Cocktail/Lexer/TokenKindSet.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/xxhash.h"
+
+namespace Cocktail {
+
+// The serialized format is a fixed header followed by one table after another,
+// each starting at a multiple of `TableAlignment` bytes from the start and
+// made of fixed-width little-endian fields:
+//
+// - the kind of each token, as its index in the token registry, one byte each,
+// - the flags of each token, one byte each,
+// - the line and the column of each token,
+// - the payload of each token, as two 32-bit fields,
+// - the start, length and indent of each line,
+// - the offset and length in the source of each identifier,
+// - the bit width and first word of each stored integer value, then the words,
+// - the offset, length and place of each string value, then the text of those
+//   not in the source,
+// - for a buffer with lazy literal values, the token and literal index of each
+//   value computed so far, by token.
+//
+// The header holds a hash of the tables, so that corrupted data is rejected
+// rather than read. Nothing refers into the source by address, so the data can
+// be shipped to other machines and checked against a source with the same
+// text.
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "CKTOKENS";
+
+constexpr size_t TableAlignment = 8;
+
+// The magic, version, flags, the source's size and hash, the token registry's
+// hash, the size of each table, the lexing statistics and the tables' hash.
+constexpr uint64_t HeaderSize = 100;
+
+enum HeaderFlags : uint32_t {
+  HasErrors = 1 << 0,
+  LazyLiteralValues = 1 << 1,
+};
+
+enum TokenFlags : uint8_t {
+  HasTrailingSpace = 1 << 0,
+  IsRecovery = 1 << 1,
+};
+
+// Where a string value's text is.
+enum class StringPlace : uint32_t {
+  Source,
+  Data,
+};
+
+// Token kinds are written as their index in the registry, from
+// `GetTokenKindIndex`, so that the format doesn't depend on how `TokenKind`
+// represents them.
+static_assert(NumTokenKinds <= UINT8_MAX + 1,
+              "Too many token kinds to serialize in one byte!");
+
+// A hash of the token registry, so that data written before a token kind was
+// added or removed is rejected even if nobody remembered to bump the version.
+auto TokenKindsHash() -> uint64_t {
+  static const uint64_t hash = [] {
+    std::string names;
+#define COCKTAIL_TOKEN(Name) names += #Name "\n";
+#include "Cocktail/Lexer/TokenRegistry.def"
+    return llvm::xxHash64(names);
+  }();
+  return hash;
+}
+
+// What a token's payload holds.
+enum class PayloadKind {
+  // `id`.
+  Identifier,
+  // `literal`, referring to the integer storage.
+  IntegerLiteral,
+  // `literal`, referring to two values in the integer storage.
+  RealLiteral,
+  // `literal`, referring to the string storage.
+  StringLiteral,
+  // `closing_token`.
+  OpeningSymbol,
+  // `opening_token`.
+  ClosingSymbol,
+  // `error_length`.
+  Error,
+  // Nothing.
+  Other,
+};
+
+auto GetPayloadKind(TokenKind kind) -> PayloadKind {
+  if (kind == TokenKind::Identifier()) {
+    return PayloadKind::Identifier;
+  } else if (kind == TokenKind::IntegerLiteral() ||
+             kind.IsSizedTypeLiteral()) {
+    return PayloadKind::IntegerLiteral;
+  } else if (kind == TokenKind::RealLiteral()) {
+    return PayloadKind::RealLiteral;
+  } else if (kind == TokenKind::StringLiteral()) {
+    return PayloadKind::StringLiteral;
+  } else if (kind.IsOpeningSymbol()) {
+    return PayloadKind::OpeningSymbol;
+  } else if (kind.IsClosingSymbol()) {
+    return PayloadKind::ClosingSymbol;
+  } else if (kind == TokenKind::Error()) {
+    return PayloadKind::Error;
+  }
+  return PayloadKind::Other;
+}
+
+// Returns the payload kind of each token kind, by registry index, so that
+// (de)serializing each token's payload needn't classify its kind again.
+auto GetPayloadKinds() -> llvm::ArrayRef<PayloadKind> {
+  static const auto payload_kinds = [] {
+    std::array<PayloadKind, NumTokenKinds> payload_kinds;
+    for (int i = 0; i != NumTokenKinds; ++i) {
+      payload_kinds[i] = GetPayloadKind(AllTokenKinds[i]);
+    }
+    return payload_kinds;
+  }();
+  return payload_kinds;
+}
+
+auto IsLiteral(PayloadKind payload_kind) -> bool {
+  return payload_kind == PayloadKind::IntegerLiteral ||
+         payload_kind == PayloadKind::RealLiteral ||
+         payload_kind == PayloadKind::StringLiteral;
+}
+
+template <typename T>
+auto Store(char* out, T value) -> void {
+  llvm::support::endian::write<T, llvm::support::little>(out, value);
+}
+
+template <typename T>
+auto Load(const char* in) -> T {
+  return llvm::support::endian::read<T, llvm::support::little,
+                                     llvm::support::unaligned>(in);
+}
+
+// Appends fields to a buffer. This avoids going through a stream for every
+// field, which would dominate the time taken to serialize.
+class Writer {
+ public:
+  auto Reserve(size_t size) -> void { data_.reserve(size); }
+
+  template <typename T>
+  auto Write(T value) -> void {
+    char bytes[sizeof(T)];
+    Store(bytes, value);
+    data_.append(std::begin(bytes), std::end(bytes));
+  }
+
+  // Extends the data by `size` bytes and returns where they start, so that a
+  // large table can be filled in without growing the data for every field.
+  auto Extend(size_t size) -> char* {
+    size_t start = data_.size();
+    data_.resize(start + size);
+    return data_.data() + start;
+  }
+
+  auto WriteBytes(llvm::StringRef bytes) -> void {
+    data_.append(bytes.begin(), bytes.end());
+  }
+
+  // Pads to the start of the next table.
+  auto Align() -> void {
+    data_.resize(llvm::alignTo(data_.size(), TableAlignment));
+  }
+
+  [[nodiscard]] auto data() const -> llvm::StringRef {
+    return llvm::StringRef(data_.data(), data_.size());
+  }
+
+ private:
+  llvm::SmallVector<char, 0> data_;
+};
+
+class Reader {
+ public:
+  explicit Reader(llvm::StringRef data) : data_(data) {}
+
+  // Moves to the start of the next table, which has `count` elements of
+  // `element_size` bytes, and returns whether the data is long enough for it.
+  // Reads within the table need no further checks.
+  [[nodiscard]] auto StartTable(uint64_t count, uint64_t element_size)
+      -> bool {
+    position_ = llvm::alignTo(position_, TableAlignment);
+    return position_ <= data_.size() &&
+           count <= (data_.size() - position_) / element_size;
+  }
+
+  // Like `StartTable`, but reads the whole table and returns where it starts,
+  // or null if the data isn't long enough for it.
+  [[nodiscard]] auto ReadTable(uint64_t count, uint64_t element_size)
+      -> const char* {
+    if (!StartTable(count, element_size)) {
+      return nullptr;
+    }
+    const char* table = data_.data() + position_;
+    position_ += count * element_size;
+    return table;
+  }
+
+  template <typename T>
+  auto Read() -> T {
+    T value = Load<T>(data_.data() + position_);
+    position_ += sizeof(T);
+    return value;
+  }
+
+  auto ReadBytes(uint64_t size) -> llvm::StringRef {
+    llvm::StringRef bytes = data_.substr(position_, size);
+    position_ += size;
+    return bytes;
+  }
+
+  // Returns the data from the current position on.
+  [[nodiscard]] auto rest() const -> llvm::StringRef {
+    return data_.drop_front(position_);
+  }
+
+  [[nodiscard]] auto at_end() const -> bool {
+    return llvm::alignTo(position_, TableAlignment) == data_.size();
+  }
+
+ private:
+  llvm::StringRef data_;
+  uint64_t position_ = 0;
+};
+
+// Returns whether `offset` and `length` describe a range within `text`.
+auto IsRangeOf(llvm::StringRef text, int64_t offset, int64_t length) -> bool {
+  return offset >= 0 && length >= 0 &&
+         static_cast<uint64_t>(offset) <= text.size() &&
+         static_cast<uint64_t>(length) <= text.size() - offset;
+}
+
+}  // namespace
+
+auto TokenizedBuffer::Serialize(llvm::raw_ostream& output_stream) const
+    -> void {
+  COCKTAIL_CHECK(!literal_values_released_)
+      << "Serializing a buffer whose literal values were released!";
+  llvm::StringRef source_text = source_->text();
+  auto source_offset = [&](llvm::StringRef text) -> int64_t {
+    return text.begin() - source_text.begin();
+  };
+  auto in_source = [&](llvm::StringRef text) {
+    return text.begin() >= source_text.begin() &&
+           text.end() <= source_text.end();
+  };
+
+  uint64_t num_int_words = 0;
+  for (const llvm::APInt& value : literal_int_storage_) {
+    num_int_words += value.getNumWords();
+  }
+  std::string string_data;
+  for (llvm::CachedHashStringRef value : literal_string_storage_) {
+    if (!in_source(value.val())) {
+      string_data += value.val();
+    }
+  }
+  llvm::SmallVector<std::pair<int32_t, int32_t>, 0> lazy_indices(
+      lazy_literal_indices_.begin(), lazy_literal_indices_.end());
+  llvm::sort(lazy_indices);
+
+  // The tables are written first, so that the header can hold their hash.
+  Writer writer;
+  writer.Reserve(size() * 20 + line_infos_.size() * 16);
+  std::string kind_indices;
+  kind_indices.reserve(size());
+  for (TokenKind kind : token_kinds_) {
+    kind_indices.push_back(GetTokenKindIndex(kind));
+  }
+  writer.WriteBytes(kind_indices);
+  writer.Align();
+  char* flags = writer.Extend(size());
+  for (int i = 0; i != size(); ++i) {
+    flags[i] = (token_has_trailing_space_[i] ? HasTrailingSpace : 0) |
+               (token_is_recovery_[i] ? IsRecovery : 0);
+  }
+  writer.Align();
+  // Tokens are stored by line and column rather than by offset, which are
+  // found here in order, one line after another.
+  char* lines = writer.Extend(size() * sizeof(int32_t));
+  for (int i = 0; i != size(); ++i) {
+    Store<int32_t>(lines + i * sizeof(int32_t), GetLine(Token(i)).index_);
+  }
+  writer.Align();
+  char* columns = writer.Extend(size() * sizeof(int32_t));
+  for (int i = 0; i != size(); ++i) {
+    Store<int32_t>(columns + i * sizeof(int32_t),
+                   GetColumnNumber(Token(i)) - 1);
+  }
+  writer.Align();
+  char* payloads = writer.Extend(size() * 2 * sizeof(int32_t));
+  for (int i = 0; i != size(); ++i) {
+    const TokenPayload& payload = token_payloads_[i];
+    char* out = payloads + i * 2 * sizeof(int32_t);
+    if (IsLiteral(GetPayloadKinds()[static_cast<uint8_t>(kind_indices[i])])) {
+      Store<int32_t>(out, payload.literal.index);
+      Store<int32_t>(out + sizeof(int32_t), payload.literal.length);
+    } else {
+      // Every other payload is a single 32-bit field. The rest is unused, and
+      // is left as zero so that the same buffer always serializes to the same
+      // bytes.
+      static_assert(sizeof(Identifier) == sizeof(int32_t) &&
+                    sizeof(Token) == sizeof(int32_t));
+      int32_t value;
+      std::memcpy(&value, &payload, sizeof(value));
+      Store<int32_t>(out, value);
+    }
+  }
+  writer.Align();
+  for (const LineInfo& info : line_infos_) {
+    writer.Write<int64_t>(info.start);
+    writer.Write<int32_t>(info.length);
+    writer.Write<int32_t>(info.indent);
+  }
+  writer.Align();
+  for (const IdentifierInfo& info : identifier_infos_) {
+    COCKTAIL_CHECK(in_source(info.text))
+        << "Identifier text is not in the source!";
+    writer.Write<int64_t>(source_offset(info.text));
+    writer.Write<int32_t>(info.text.size());
+    writer.Write<int32_t>(0);
+  }
+  writer.Align();
+  uint64_t first_word = 0;
+  for (const llvm::APInt& value : literal_int_storage_) {
+    writer.Write<uint32_t>(value.getBitWidth());
+    writer.Write<uint32_t>(first_word);
+    first_word += value.getNumWords();
+  }
+  writer.Align();
+  for (const llvm::APInt& value : literal_int_storage_) {
+    for (unsigned i = 0; i != value.getNumWords(); ++i) {
+      writer.Write<uint64_t>(value.getRawData()[i]);
+    }
+  }
+  writer.Align();
+  int64_t data_offset = 0;
+  for (llvm::CachedHashStringRef hashed_value : literal_string_storage_) {
+    llvm::StringRef value = hashed_value.val();
+    if (in_source(value)) {
+      writer.Write<int64_t>(source_offset(value));
+      writer.Write<int32_t>(value.size());
+      writer.Write<uint32_t>(static_cast<uint32_t>(StringPlace::Source));
+    } else {
+      writer.Write<int64_t>(data_offset);
+      writer.Write<int32_t>(value.size());
+      writer.Write<uint32_t>(static_cast<uint32_t>(StringPlace::Data));
+      data_offset += value.size();
+    }
+  }
+  writer.Align();
+  writer.WriteBytes(string_data);
+  writer.Align();
+  for (auto [token_index, literal_index] : lazy_indices) {
+    writer.Write<int32_t>(token_index);
+    writer.Write<int32_t>(literal_index);
+  }
+  writer.Align();
+
+  Writer header;
+  header.WriteBytes(Magic);
+  header.Write<uint32_t>(SerializationVersion);
+  header.Write<uint32_t>((has_errors_ ? HasErrors : 0) |
+                         (lazy_literal_values_ ? LazyLiteralValues : 0));
+  header.Write<uint64_t>(source_text.size());
+  header.Write<uint64_t>(llvm::xxHash64(source_text));
+  header.Write<uint64_t>(TokenKindsHash());
+  header.Write<uint32_t>(token_kinds_.size());
+  header.Write<uint32_t>(line_infos_.size());
+  header.Write<uint32_t>(identifier_infos_.size());
+  header.Write<uint32_t>(literal_int_storage_.size());
+  header.Write<uint64_t>(num_int_words);
+  header.Write<uint32_t>(literal_string_storage_.size());
+  header.Write<uint32_t>(lazy_indices.size());
+  header.Write<uint64_t>(string_data.size());
+  header.Write<int32_t>(lex_stats_.token_reallocations);
+  header.Write<int32_t>(lex_stats_.line_reallocations);
+  header.Write<int32_t>(lex_stats_.identifier_reallocations);
+  header.Write<uint64_t>(llvm::xxHash64(writer.data()));
+  header.Align();
+  output_stream << header.data() << writer.data();
+}
+
+auto TokenizedBuffer::Deserialize(SourceBuffer& source, llvm::StringRef data)
+    -> llvm::Optional<TokenizedBuffer> {
+  llvm::StringRef source_text = source.text();
+  Reader reader(data);
+
+  if (!reader.StartTable(1, HeaderSize) ||
+      reader.ReadBytes(Magic.size()) != Magic ||
+      reader.Read<uint32_t>() != SerializationVersion) {
+    return llvm::None;
+  }
+  uint32_t header_flags = reader.Read<uint32_t>();
+  if (reader.Read<uint64_t>() != source_text.size() ||
+      reader.Read<uint64_t>() != llvm::xxHash64(source_text) ||
+      reader.Read<uint64_t>() != TokenKindsHash()) {
+    return llvm::None;
+  }
+  uint32_t num_tokens = reader.Read<uint32_t>();
+  uint32_t num_lines = reader.Read<uint32_t>();
+  uint32_t num_identifiers = reader.Read<uint32_t>();
+  uint32_t num_int_values = reader.Read<uint32_t>();
+  uint64_t num_int_words = reader.Read<uint64_t>();
+  uint32_t num_string_values = reader.Read<uint32_t>();
+  uint32_t num_lazy_indices = reader.Read<uint32_t>();
+  uint64_t string_data_size = reader.Read<uint64_t>();
+  // Every buffer has an end of file token, on a line.
+  if (num_tokens == 0 || num_lines == 0 || num_tokens > INT32_MAX ||
+      num_lines > INT32_MAX || num_identifiers > INT32_MAX ||
+      num_int_values > INT32_MAX || num_string_values > INT32_MAX) {
+    return llvm::None;
+  }
+
+  TokenizedBuffer buffer(source);
+  buffer.has_errors_ = header_flags & HasErrors;
+  buffer.lazy_literal_values_ = header_flags & LazyLiteralValues;
+  buffer.lex_stats_.token_reallocations = reader.Read<int32_t>();
+  buffer.lex_stats_.line_reallocations = reader.Read<int32_t>();
+  buffer.lex_stats_.identifier_reallocations = reader.Read<int32_t>();
+  uint64_t tables_hash = reader.Read<uint64_t>();
+  if (!reader.StartTable(0, 1) ||
+      llvm::xxHash64(reader.rest()) != tables_hash) {
+    return llvm::None;
+  }
+
+  const char* kind_indices = reader.ReadTable(num_tokens, 1);
+  const char* flags = reader.ReadTable(num_tokens, 1);
+  const char* lines = reader.ReadTable(num_tokens, sizeof(int32_t));
+  const char* columns = reader.ReadTable(num_tokens, sizeof(int32_t));
+  const char* payloads = reader.ReadTable(num_tokens, 2 * sizeof(int32_t));
+  if (!kind_indices || !flags || !lines || !columns || !payloads) {
+    return llvm::None;
+  }
+
+  llvm::SmallVector<PayloadKind, 0> payload_kinds;
+  payload_kinds.reserve(num_tokens);
+  buffer.token_kinds_.reserve(num_tokens);
+  for (uint32_t i = 0; i != num_tokens; ++i) {
+    uint8_t kind_index = kind_indices[i];
+    if (kind_index >= NumTokenKinds) {
+      return llvm::None;
+    }
+    buffer.token_kinds_.push_back(AllTokenKinds[kind_index]);
+    payload_kinds.push_back(GetPayloadKinds()[kind_index]);
+  }
+  if (buffer.token_kinds_.back() != TokenKind::EndOfFile()) {
+    return llvm::None;
+  }
+
+  buffer.token_has_trailing_space_.resize(num_tokens);
+  buffer.token_is_recovery_.resize(num_tokens);
+  for (uint32_t i = 0; i != num_tokens; ++i) {
+    if (flags[i] & HasTrailingSpace) {
+      buffer.token_has_trailing_space_.set(i);
+    }
+    if (flags[i] & IsRecovery) {
+      buffer.token_is_recovery_.set(i);
+    }
+  }
+
+  // Each token's offset is found from its line and column once the lines
+  // have been read.
+  for (uint32_t i = 0; i != num_tokens; ++i) {
+    int32_t line_index = Load<int32_t>(lines + i * sizeof(int32_t));
+    if (line_index < 0 || static_cast<uint32_t>(line_index) >= num_lines) {
+      return llvm::None;
+    }
+  }
+
+  // A literal index either holds an inline value, or refers to the storage.
+  auto is_valid_literal_index = [&](PayloadKind payload_kind, int32_t index) {
+    switch (payload_kind) {
+      case PayloadKind::IntegerLiteral:
+        return index < 0 || static_cast<uint32_t>(index) < num_int_values;
+      case PayloadKind::RealLiteral:
+        return index < 0 || static_cast<uint32_t>(index) + 1 < num_int_values;
+      case PayloadKind::StringLiteral:
+        return index >= 0 && static_cast<uint32_t>(index) < num_string_values;
+      default:
+        return false;
+    }
+  };
+  buffer.token_payloads_.resize(num_tokens);
+  for (uint32_t i = 0; i != num_tokens; ++i) {
+    const char* in = payloads + i * 2 * sizeof(int32_t);
+    int32_t first = Load<int32_t>(in);
+    int32_t second = Load<int32_t>(in + sizeof(int32_t));
+    bool valid = true;
+    switch (payload_kinds[i]) {
+      case PayloadKind::Identifier:
+        valid = first >= 0 && static_cast<uint32_t>(first) < num_identifiers;
+        break;
+      case PayloadKind::IntegerLiteral:
+      case PayloadKind::RealLiteral:
+      case PayloadKind::StringLiteral:
+        // Lazy literal indices are unused.
+        valid = second >= 0 &&
+                (buffer.lazy_literal_values_ ||
+                 is_valid_literal_index(payload_kinds[i], first));
+        break;
+      case PayloadKind::OpeningSymbol:
+      case PayloadKind::ClosingSymbol:
+        valid = first >= 0 && static_cast<uint32_t>(first) < num_tokens;
+        break;
+      case PayloadKind::Error:
+      case PayloadKind::Other:
+        break;
+    }
+    if (!valid) {
+      return llvm::None;
+    }
+    buffer.token_payloads_[i] = {.literal = {.index = first, .length = second}};
+  }
+
+  if (!reader.StartTable(num_lines, 16)) {
+    return llvm::None;
+  }
+  buffer.line_infos_.reserve(num_lines);
+  for (uint32_t i = 0; i != num_lines; ++i) {
+    LineInfo info = {.start = reader.Read<int64_t>(),
+                     .length = reader.Read<int32_t>(),
+                     .indent = reader.Read<int32_t>()};
+    if (!IsRangeOf(source_text, info.start, info.length)) {
+      return llvm::None;
+    }
+    buffer.line_infos_.push_back(info);
+  }
+  // The text of error and literal tokens is found from their length. Only
+  // offsets are kept, so tokens must start in order.
+  buffer.token_offsets_.reserve(num_tokens);
+  int64_t previous_offset = 0;
+  for (uint32_t i = 0; i != num_tokens; ++i) {
+    const LineInfo& line_info =
+        buffer.line_infos_[Load<int32_t>(lines + i * sizeof(int32_t))];
+    int64_t column = Load<int32_t>(columns + i * sizeof(int32_t));
+    if (column < 0 || column > line_info.length ||
+        line_info.start + column < previous_offset) {
+      return llvm::None;
+    }
+    previous_offset = line_info.start + column;
+    buffer.AddTokenOffset(previous_offset);
+    const TokenPayload& payload = buffer.token_payloads_[i];
+    int64_t length = 0;
+    if (payload_kinds[i] == PayloadKind::Error) {
+      length = payload.error_length;
+    } else if (IsLiteral(payload_kinds[i])) {
+      length = payload.literal.length;
+    }
+    if (!IsRangeOf(source_text, line_info.start + column, length)) {
+      return llvm::None;
+    }
+  }
+
+  if (!reader.StartTable(num_identifiers, 16)) {
+    return llvm::None;
+  }
+  buffer.identifier_infos_.reserve(num_identifiers);
+  for (uint32_t i = 0; i != num_identifiers; ++i) {
+    int64_t offset = reader.Read<int64_t>();
+    int32_t length = reader.Read<int32_t>();
+    reader.Read<int32_t>();
+    if (!IsRangeOf(source_text, offset, length)) {
+      return llvm::None;
+    }
+    llvm::StringRef text = source_text.substr(offset, length);
+    HashedIdentifier key(text);
+    buffer.identifier_infos_.push_back({.text = text, .hash = key.hash});
+    buffer.identifier_map_.insert({key, Identifier(i)});
+  }
+
+  if (!reader.StartTable(num_int_values, 2 * sizeof(uint32_t))) {
+    return llvm::None;
+  }
+  llvm::SmallVector<std::pair<uint32_t, uint32_t>, 0> int_values;
+  int_values.reserve(num_int_values);
+  for (uint32_t i = 0; i != num_int_values; ++i) {
+    uint32_t bit_width = reader.Read<uint32_t>();
+    uint32_t value_first_word = reader.Read<uint32_t>();
+    if (bit_width == 0 ||
+        uint64_t{value_first_word} + llvm::APInt::getNumWords(bit_width) >
+            num_int_words) {
+      return llvm::None;
+    }
+    int_values.push_back({bit_width, value_first_word});
+  }
+  if (!reader.StartTable(num_int_words, sizeof(uint64_t))) {
+    return llvm::None;
+  }
+  llvm::SmallVector<uint64_t, 0> words;
+  words.reserve(num_int_words);
+  for (uint64_t i = 0; i != num_int_words; ++i) {
+    words.push_back(reader.Read<uint64_t>());
+  }
+  buffer.literal_int_storage_.reserve(num_int_values);
+  for (auto [bit_width, value_first_word] : int_values) {
+    buffer.literal_int_storage_.push_back(llvm::APInt(
+        bit_width, llvm::makeArrayRef(words).slice(
+                       value_first_word, llvm::APInt::getNumWords(bit_width))));
+  }
+
+  if (!reader.StartTable(num_string_values, 16)) {
+    return llvm::None;
+  }
+  struct StringValue {
+    int64_t offset;
+    int32_t length;
+    StringPlace place;
+  };
+  llvm::SmallVector<StringValue, 0> string_values;
+  string_values.reserve(num_string_values);
+  for (uint32_t i = 0; i != num_string_values; ++i) {
+    string_values.push_back(
+        {.offset = reader.Read<int64_t>(),
+         .length = reader.Read<int32_t>(),
+         .place = static_cast<StringPlace>(reader.Read<uint32_t>())});
+  }
+  if (!reader.StartTable(string_data_size, 1)) {
+    return llvm::None;
+  }
+  llvm::StringRef string_data = reader.ReadBytes(string_data_size);
+  buffer.literal_string_storage_.reserve(num_string_values);
+  for (const StringValue& value : string_values) {
+    switch (value.place) {
+      case StringPlace::Source:
+        if (!IsRangeOf(source_text, value.offset, value.length)) {
+          return llvm::None;
+        }
+        buffer.literal_string_storage_.push_back(llvm::CachedHashStringRef(
+            source_text.substr(value.offset, value.length)));
+        break;
+      case StringPlace::Data:
+        if (!IsRangeOf(string_data, value.offset, value.length)) {
+          return llvm::None;
+        }
+        buffer.literal_string_storage_.push_back(llvm::CachedHashStringRef(
+            string_data.substr(value.offset, value.length)
+                .copy(buffer.string_storage_allocator_)));
+        break;
+      default:
+        return llvm::None;
+    }
+  }
+
+  if (!reader.StartTable(num_lazy_indices, 2 * sizeof(int32_t))) {
+    return llvm::None;
+  }
+  for (uint32_t i = 0; i != num_lazy_indices; ++i) {
+    int32_t token_index = reader.Read<int32_t>();
+    int32_t literal_index = reader.Read<int32_t>();
+    if (!buffer.lazy_literal_values_ || token_index < 0 ||
+        static_cast<uint32_t>(token_index) >= num_tokens ||
+        !is_valid_literal_index(payload_kinds[token_index], literal_index)) {
+      return llvm::None;
+    }
+    buffer.lazy_literal_indices_.insert({token_index, literal_index});
+  }
+
+  if (!reader.at_end()) {
+    return llvm::None;
+  }
+  return buffer;
+}
+
+}  // namespace Cocktail
@@ -1,12 +1,387 @@
 #include "Cocktail/Lowering/LowerToLLVM.h"
 
+#include <string>
+
+#include "Cocktail/Common/Check.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
 namespace Cocktail {
 
+namespace {
+
+// The largest tuple or struct value, in bytes, that is built in registers with
+// `insertvalue`. Larger ones are built in memory, where an element is a store
+// rather than a copy of the whole value.
+constexpr uint64_t MaxSSAAggregateBytes = 64;
+
+// Lowers the functions of an IR into a module. Each IR type is converted the
+// first time it is used, and since types are interned, that is once however
+// many functions use it.
+class Lowering {
+ public:
+  Lowering(llvm::LLVMContext& llvm_context, llvm::StringRef module_name,
+           const SemanticsIR& semantics_ir, const llvm::BitVector* reachable)
+      : llvm_context_(&llvm_context),
+        semantics_ir_(&semantics_ir),
+        reachable_(reachable),
+        module_(std::make_unique<llvm::Module>(module_name, llvm_context)),
+        types_(semantics_ir.types().size()),
+        strings_(semantics_ir.string_constants().size()) {}
+
+  // Declares every reachable function, in the order they are declared in, and
+  // defines those in `[begin, end)` that have bodies.
+  auto Run(int begin, int end) -> std::unique_ptr<llvm::Module>;
+
+ private:
+  auto GetType(Semantics::TypeId type) -> llvm::Type*;
+  auto GetFunctionType(Semantics::TypeId type) -> llvm::FunctionType*;
+
+  // Returns the value of the IR's `index`-th string constant, emitting the
+  // global holding its characters the first time it is used.
+  auto GetString(int32_t index) -> llvm::Constant*;
+
+  // Returns a value of `type` with `elements` as its fields. The constant
+  // elements are folded into one constant, and only the others are inserted,
+  // in registers when the value is small and through a stack slot otherwise.
+  auto BuildAggregate(llvm::IRBuilder<>& builder, llvm::StructType* type,
+                      llvm::ArrayRef<llvm::Value*> elements) -> llvm::Value*;
+
+  auto DefineFunction(int index) -> void;
+
+  llvm::LLVMContext* llvm_context_;
+  const SemanticsIR* semantics_ir_;
+  // The functions to lower, or null for all of them.
+  const llvm::BitVector* reachable_;
+  std::unique_ptr<llvm::Module> module_;
+  // The LLVM type of each IR type, by ID, or null until it is first used.
+  llvm::SmallVector<llvm::Type*, 0> types_;
+  // The value of each string constant, by index, or null until it is first
+  // used. Since the constants are interned, each distinct string is one
+  // global however many literals spell it.
+  llvm::SmallVector<llvm::Constant*, 0> strings_;
+  // The LLVM function of each IR function, by index, or null for one that
+  // isn't reachable. Reachable functions only call reachable ones.
+  llvm::SmallVector<llvm::Function*, 0> functions_;
+};
+
+auto Lowering::Run(int begin, int end) -> std::unique_ptr<llvm::Module> {
+  llvm::ArrayRef<Semantics::Function> functions = semantics_ir_->functions();
+  for (int i = 0; i != static_cast<int>(functions.size()); ++i) {
+    if (reachable_ != nullptr && !reachable_->test(i)) {
+      functions_.push_back(nullptr);
+      continue;
+    }
+    functions_.push_back(llvm::Function::Create(
+        GetFunctionType(functions[i].type()), llvm::Function::ExternalLinkage,
+        functions[i].name(), module_.get()));
+  }
+  for (int i = begin; i != end; ++i) {
+    if (functions_[i] != nullptr && functions[i].body_node()) {
+      DefineFunction(i);
+    }
+  }
+  return std::move(module_);
+}
+
+auto Lowering::GetType(Semantics::TypeId type) -> llvm::Type* {
+  llvm::Type*& llvm_type = types_[static_cast<int32_t>(type)];
+  if (llvm_type != nullptr) {
+    return llvm_type;
+  }
+  const Semantics::TypeTable& types = semantics_ir_->types();
+  auto get_element_types = [&] {
+    llvm::SmallVector<llvm::Type*> element_types;
+    for (Semantics::TypeId element : types.elements(type)) {
+      element_types.push_back(GetType(element));
+    }
+    return element_types;
+  };
+  switch (types.kind(type)) {
+    case Semantics::TypeKind::Error:
+    case Semantics::TypeKind::Type:
+      // Values of these types are never used at run time, so they're empty.
+      llvm_type = llvm::StructType::get(*llvm_context_);
+      break;
+    case Semantics::TypeKind::Bool:
+      llvm_type = llvm::Type::getInt1Ty(*llvm_context_);
+      break;
+    case Semantics::TypeKind::String:
+      // A pointer to the characters and their count.
+      llvm_type = llvm::StructType::get(
+          llvm::Type::getInt8PtrTy(*llvm_context_),
+          llvm::Type::getInt64Ty(*llvm_context_));
+      break;
+    case Semantics::TypeKind::Int:
+    case Semantics::TypeKind::UnsignedInt:
+      llvm_type = llvm::Type::getIntNTy(*llvm_context_, types.bit_width(type));
+      break;
+    case Semantics::TypeKind::Float:
+      switch (types.bit_width(type)) {
+        case 16:
+          llvm_type = llvm::Type::getHalfTy(*llvm_context_);
+          break;
+        case 32:
+          llvm_type = llvm::Type::getFloatTy(*llvm_context_);
+          break;
+        case 64:
+          llvm_type = llvm::Type::getDoubleTy(*llvm_context_);
+          break;
+        case 128:
+          llvm_type = llvm::Type::getFP128Ty(*llvm_context_);
+          break;
+        default:
+          COCKTAIL_FATAL() << "Float type of an unsupported width!";
+      }
+      break;
+    case Semantics::TypeKind::Tuple:
+    case Semantics::TypeKind::Struct:
+      llvm_type = llvm::StructType::get(*llvm_context_, get_element_types());
+      break;
+    case Semantics::TypeKind::Function:
+      llvm_type = llvm::PointerType::getUnqual(GetFunctionType(type));
+      break;
+    case Semantics::TypeKind::Pointer:
+      llvm_type = llvm::PointerType::getUnqual(GetType(types.pointee(type)));
+      break;
+  }
+  return llvm_type;
+}
+
+auto Lowering::GetFunctionType(Semantics::TypeId type) -> llvm::FunctionType* {
+  const Semantics::TypeTable& types = semantics_ir_->types();
+  llvm::SmallVector<llvm::Type*> param_types;
+  for (Semantics::TypeId param : types.elements(type)) {
+    param_types.push_back(GetType(param));
+  }
+  Semantics::TypeId return_type = types.return_type(type);
+  // A function returning `()` returns nothing at all.
+  llvm::Type* llvm_return_type = return_type == Semantics::TypeId::EmptyTuple
+                                     ? llvm::Type::getVoidTy(*llvm_context_)
+                                     : GetType(return_type);
+  return llvm::FunctionType::get(llvm_return_type, param_types,
+                                 /*isVarArg=*/false);
+}
+
+auto Lowering::GetString(int32_t index) -> llvm::Constant* {
+  llvm::Constant*& value = strings_[index];
+  if (value != nullptr) {
+    return value;
+  }
+  llvm::StringRef text = semantics_ir_->string_constants()[index];
+  llvm::Constant* characters = llvm::ConstantDataArray::getString(
+      *llvm_context_, text, /*AddNull=*/false);
+  // Private and unnamed, so that constants of other files, or of other
+  // shards once they're linked, can be merged with it.
+  auto* global = new llvm::GlobalVariable(
+      *module_, characters->getType(), /*isConstant=*/true,
+      llvm::GlobalValue::PrivateLinkage, characters, ".str");
+  global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  global->setAlignment(llvm::Align(1));
+  auto* string_type =
+      llvm::cast<llvm::StructType>(GetType(Semantics::TypeId::String));
+  value = llvm::ConstantStruct::get(
+      string_type,
+      {llvm::ConstantExpr::getPointerCast(global,
+                                          string_type->getElementType(0)),
+       llvm::ConstantInt::get(string_type->getElementType(1), text.size())});
+  return value;
+}
+
+auto Lowering::BuildAggregate(llvm::IRBuilder<>& builder,
+                              llvm::StructType* type,
+                              llvm::ArrayRef<llvm::Value*> elements)
+    -> llvm::Value* {
+  llvm::SmallVector<llvm::Constant*> constants;
+  llvm::SmallVector<unsigned> variable;
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    if (auto* constant = llvm::dyn_cast<llvm::Constant>(elements[i])) {
+      constants.push_back(constant);
+    } else {
+      constants.push_back(llvm::PoisonValue::get(elements[i]->getType()));
+      variable.push_back(i);
+    }
+  }
+  llvm::Constant* init = llvm::ConstantStruct::get(type, constants);
+  if (variable.empty()) {
+    return init;
+  }
+
+  const llvm::DataLayout& layout = module_->getDataLayout();
+  if (layout.getTypeAllocSize(type).getFixedSize() <= MaxSSAAggregateBytes) {
+    llvm::Value* value = init;
+    for (unsigned i : variable) {
+      value = builder.CreateInsertValue(value, elements[i], i);
+    }
+    return value;
+  }
+
+  // Allocas in the entry block are promoted back to registers where that
+  // pays off, and are allocated once however often the literal is evaluated.
+  llvm::BasicBlock& entry = builder.GetInsertBlock()->getParent()->front();
+  llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+  llvm::AllocaInst* slot = entry_builder.CreateAlloca(type);
+  llvm::Align align = layout.getABITypeAlign(type);
+  uint64_t size = layout.getTypeAllocSize(type).getFixedSize();
+  for (unsigned i : variable) {
+    constants[i] = llvm::Constant::getNullValue(elements[i]->getType());
+  }
+  init = llvm::ConstantStruct::get(type, constants);
+  if (init->isNullValue()) {
+    builder.CreateMemSet(slot, builder.getInt8(0), size, align);
+  } else {
+    auto* global = new llvm::GlobalVariable(
+        *module_, type, /*isConstant=*/true,
+        llvm::GlobalValue::PrivateLinkage, init, ".agg");
+    global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    global->setAlignment(align);
+    builder.CreateMemCpy(slot, align, global, align, size);
+  }
+  for (unsigned i : variable) {
+    builder.CreateStore(elements[i], builder.CreateStructGEP(type, slot, i));
+  }
+  return builder.CreateLoad(type, slot);
+}
+
+auto Lowering::DefineFunction(int index) -> void {
+  const Semantics::Function& function = semantics_ir_->functions()[index];
+  const Semantics::InstTable& insts = semantics_ir_->insts();
+  llvm::Function* llvm_function = functions_[index];
+  llvm::IRBuilder<> builder(
+      llvm::BasicBlock::Create(*llvm_context_, "entry", llvm_function));
+  // The value of each instruction of the body, by its offset in the body.
+  llvm::SmallVector<llvm::Value*> values;
+  for (int32_t inst : function.body()) {
+    llvm::Value* value = nullptr;
+    llvm::ArrayRef<int32_t> operands = insts.operands(inst);
+    switch (insts.kind(inst)) {
+      case Semantics::InstKind::IntegerConstant:
+        value = llvm::ConstantInt::get(
+            GetType(insts.type(inst)),
+            semantics_ir_->integer_constants()[operands[0]]);
+        break;
+      case Semantics::InstKind::StringConstant:
+        value = GetString(operands[0]);
+        break;
+      case Semantics::InstKind::TupleValue:
+      case Semantics::InstKind::StructValue: {
+        llvm::SmallVector<llvm::Value*> elements;
+        for (int32_t element : operands) {
+          elements.push_back(values[element]);
+        }
+        value = BuildAggregate(
+            builder, llvm::cast<llvm::StructType>(GetType(insts.type(inst))),
+            elements);
+        break;
+      }
+      case Semantics::InstKind::Call: {
+        llvm::Function* callee = functions_[operands[0]];
+        llvm::SmallVector<llvm::Value*> args;
+        for (auto [arg, param] :
+             llvm::zip(operands.drop_front(), callee->args())) {
+          // Arguments that aren't analyzed yet have no value to pass.
+          args.push_back(arg == -1 ? llvm::PoisonValue::get(param.getType())
+                                   : values[arg]);
+        }
+        value = builder.CreateCall(callee, args);
+        // A call returning `()` is used as the empty tuple.
+        if (value->getType()->isVoidTy()) {
+          value = llvm::ConstantStruct::get(
+              llvm::StructType::get(*llvm_context_), {});
+        }
+        break;
+      }
+    }
+    values.push_back(value);
+  }
+  // Return statements aren't analyzed yet, so control reaching the end of a
+  // function only returns from one that returns `()`.
+  if (llvm_function->getReturnType()->isVoidTy()) {
+    builder.CreateRetVoid();
+  } else {
+    builder.CreateUnreachable();
+  }
+}
+
+}  // namespace
+
 auto LowerToLLVM(llvm::LLVMContext& llvm_context, llvm::StringRef module_name,
-                 const SemanticsIR& semantics_ir)
+                 const SemanticsIR& semantics_ir,
+                 const llvm::BitVector* reachable)
+    -> std::unique_ptr<llvm::Module> {
+  return LowerToLLVMShard(llvm_context, module_name, semantics_ir,
+                          /*shard=*/0, /*num_shards=*/1, reachable);
+}
+
+auto LowerToLLVMShard(llvm::LLVMContext& llvm_context,
+                      llvm::StringRef module_name,
+                      const SemanticsIR& semantics_ir, int shard,
+                      int num_shards, const llvm::BitVector* reachable)
+    -> std::unique_ptr<llvm::Module> {
+  COCKTAIL_CHECK(shard >= 0 && shard < num_shards) << "Invalid shard!";
+  int64_t count = semantics_ir.functions().size();
+  return Lowering(llvm_context, module_name, semantics_ir, reachable)
+      .Run(count * shard / num_shards, count * (shard + 1) / num_shards);
+}
+
+auto LinkLLVMShards(llvm::LLVMContext& llvm_context,
+                    llvm::StringRef module_name,
+                    llvm::MutableArrayRef<std::unique_ptr<llvm::Module>> shards)
     -> std::unique_ptr<llvm::Module> {
   auto module = std::make_unique<llvm::Module>(module_name, llvm_context);
+  // The linker moves definitions in the order it reaches them, so the
+  // functions are put back in the order the shards declare them in after.
+  llvm::SmallVector<std::string> names;
+  if (!shards.empty()) {
+    for (const llvm::Function& function : *shards.front()) {
+      names.push_back(function.getName().str());
+    }
+  }
+  llvm::Linker linker(*module);
+  for (std::unique_ptr<llvm::Module>& shard : shards) {
+    // Modules can only be linked within a context, so a shard lowered in
+    // another is moved into this one through bitcode.
+    if (&shard->getContext() != &llvm_context) {
+      llvm::SmallVector<char, 0> bitcode;
+      llvm::raw_svector_ostream bitcode_stream(bitcode);
+      llvm::WriteBitcodeToFile(*shard, bitcode_stream);
+      shard.reset();
+      llvm::Expected<std::unique_ptr<llvm::Module>> read_shard =
+          llvm::parseBitcodeFile(
+              llvm::MemoryBufferRef(
+                  llvm::StringRef(bitcode.data(), bitcode.size()),
+                  module_name),
+              llvm_context);
+      if (!read_shard) {
+        COCKTAIL_FATAL() << "Unable to read back a shard: "
+                         << llvm::toString(read_shard.takeError());
+      }
+      shard = std::move(*read_shard);
+    }
+    // The shards declare every function in the same order, and define
+    // disjoint runs of them, so linking never has a conflict to report.
+    bool failed = linker.linkInModule(std::move(shard));
+    COCKTAIL_CHECK(!failed) << "Unable to link a shard!";
+  }
+  for (const std::string& name : names) {
+    llvm::Function* function = module->getFunction(name);
+    function->removeFromParent();
+    module->getFunctionList().push_back(function);
+  }
   return module;
 }
 
-}  // namespace Cocktail
\ No newline at end of file
+}  // namespace Cocktail
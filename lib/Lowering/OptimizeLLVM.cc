@@ -0,0 +1,94 @@
+#include "Cocktail/Lowering/OptimizeLLVM.h"
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/SROA.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+
+namespace Cocktail {
+
+auto GetOptimizationLevel(llvm::StringRef text)
+    -> std::optional<OptimizationLevel> {
+  return llvm::StringSwitch<std::optional<OptimizationLevel>>(text)
+      .Case("0", OptimizationLevel::O0)
+      .Case("1", OptimizationLevel::O1)
+      .Case("2", OptimizationLevel::O2)
+      .Case("3", OptimizationLevel::O3)
+      .Case("fast-compile", OptimizationLevel::FastCompile)
+      .Default(std::nullopt);
+}
+
+auto GetCodeGenOptLevel(OptimizationLevel level) -> llvm::CodeGenOpt::Level {
+  switch (level) {
+    case OptimizationLevel::O0:
+    case OptimizationLevel::FastCompile:
+      // Selects instructions with FastISel, which is most of what makes
+      // `O0` codegen fast.
+      return llvm::CodeGenOpt::None;
+    case OptimizationLevel::O1:
+      return llvm::CodeGenOpt::Less;
+    case OptimizationLevel::O2:
+      return llvm::CodeGenOpt::Default;
+    case OptimizationLevel::O3:
+      return llvm::CodeGenOpt::Aggressive;
+  }
+  llvm_unreachable("Unknown optimization level!");
+}
+
+auto OptimizeLLVM(llvm::Module& module, OptimizationLevel level,
+                  llvm::TargetMachine* target_machine,
+                  llvm::PassInstrumentationCallbacks* instrumentation)
+    -> void {
+  // The analysis managers refer to each other through proxies, so they're
+  // declared innermost first, to be destroyed outermost first.
+  llvm::LoopAnalysisManager loop_analyses;
+  llvm::FunctionAnalysisManager function_analyses;
+  llvm::CGSCCAnalysisManager cgscc_analyses;
+  llvm::ModuleAnalysisManager module_analyses;
+  llvm::PassBuilder pass_builder(target_machine, llvm::PipelineTuningOptions(),
+                                 llvm::None, instrumentation);
+  pass_builder.registerModuleAnalyses(module_analyses);
+  pass_builder.registerCGSCCAnalyses(cgscc_analyses);
+  pass_builder.registerFunctionAnalyses(function_analyses);
+  pass_builder.registerLoopAnalyses(loop_analyses);
+  pass_builder.crossRegisterProxies(loop_analyses, function_analyses,
+                                    cgscc_analyses, module_analyses);
+
+  llvm::ModulePassManager pass_manager;
+  switch (level) {
+    case OptimizationLevel::O0:
+      pass_manager =
+          pass_builder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+      break;
+    case OptimizationLevel::O1:
+      pass_manager = pass_builder.buildPerModuleDefaultPipeline(
+          llvm::OptimizationLevel::O1);
+      break;
+    case OptimizationLevel::O2:
+      pass_manager = pass_builder.buildPerModuleDefaultPipeline(
+          llvm::OptimizationLevel::O2);
+      break;
+    case OptimizationLevel::O3:
+      pass_manager = pass_builder.buildPerModuleDefaultPipeline(
+          llvm::OptimizationLevel::O3);
+      break;
+    case OptimizationLevel::FastCompile: {
+      // Each of these is linear in the size of a function, unlike inlining
+      // or the loop and instruction combining passes of `O1`.
+      llvm::FunctionPassManager function_passes;
+      function_passes.addPass(llvm::SROAPass());
+      function_passes.addPass(llvm::EarlyCSEPass());
+      function_passes.addPass(llvm::SimplifyCFGPass());
+      pass_manager.addPass(
+          llvm::createModuleToFunctionPassAdaptor(std::move(function_passes)));
+      break;
+    }
+  }
+  pass_manager.run(module, module_analyses);
+}
+
+}  // namespace Cocktail
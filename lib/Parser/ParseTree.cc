@@ -1,27 +1,81 @@
 #include "Cocktail/Parser/ParseTree.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
 
 #include "Cocktail/Common/Check.h"
+#include "Cocktail/Common/StringHelpers.h"
 #include "Cocktail/Lexer/TokenKind.h"
 #include "Cocktail/Parser/ParseNodeKind.h"
 #include "Cocktail/Parser/ParserImpl.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/Sequence.h"
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/iterator.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace Cocktail {
 
-auto ParseTree::Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer)
+auto ParseTree::Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                      NodeStorage node_storage, FunctionBodies function_bodies,
+                      Separators separators) -> ParseTree {
+  TokenizedBuffer::TokenLocationTranslator translator(tokens, nullptr);
+  TokenDiagnosticEmitter emitter(translator, consumer);
+
+  return Parser::Parse(tokens, emitter, node_storage, function_bodies,
+                       separators);
+}
+
+ParseTree::ScratchSpace::ScratchSpace()
+    : storage_(std::make_unique<Storage>()) {}
+
+ParseTree::ScratchSpace::~ScratchSpace() = default;
+
+ParseTree::ScratchSpace::ScratchSpace(ScratchSpace&&) noexcept = default;
+
+auto ParseTree::ScratchSpace::operator=(ScratchSpace&&) noexcept
+    -> ScratchSpace& = default;
+
+auto ParseTree::ScratchSpace::Recycle(ParseTree tree) -> void {
+  storage_->node_storage = std::move(tree.node_impls_);
+}
+
+auto ParseTree::Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                      ScratchSpace& scratch, NodeStorage node_storage,
+                      FunctionBodies function_bodies, Separators separators)
     -> ParseTree {
   TokenizedBuffer::TokenLocationTranslator translator(tokens, nullptr);
   TokenDiagnosticEmitter emitter(translator, consumer);
 
-  return Parser::Parse(tokens, emitter);
+  return Parser::Parse(tokens, emitter, node_storage, function_bodies,
+                       separators, scratch.storage_.get());
+}
+
+auto ParseTree::Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                      const CancellationToken& cancellation,
+                      NodeStorage node_storage, FunctionBodies function_bodies,
+                      Separators separators) -> ParseTree {
+  TokenizedBuffer::TokenLocationTranslator translator(tokens, nullptr);
+  TokenDiagnosticEmitter emitter(translator, consumer);
+
+  return Parser::Parse(tokens, emitter, node_storage, function_bodies,
+                       separators, /*scratch=*/nullptr, &cancellation);
+}
+
+auto ParseTree::Parse(TokenizedBuffer& tokens, DiagnosticConsumer& consumer,
+                      TaskScheduler& scheduler, int chunk_size,
+                      NodeStorage node_storage, FunctionBodies function_bodies,
+                      Separators separators) -> ParseTree {
+  return Parser::Parse(tokens, consumer, scheduler, chunk_size, node_storage,
+                       function_bodies, separators);
 }
 
 auto ParseTree::postorder() const -> llvm::iterator_range<PostorderIterator> {
@@ -32,14 +86,14 @@ auto ParseTree::postorder() const -> llvm::iterator_range<PostorderIterator> {
 auto ParseTree::postorder(Node n) const
     -> llvm::iterator_range<PostorderIterator> {
   int end_index = n.index_ + 1;
-  int start_index = end_index - node_impls_[n.index_].subtree_size;
+  int start_index = end_index - node_impls_[n.index_].subtree_size();
   return {PostorderIterator(Node(start_index)),
           PostorderIterator(Node(end_index))};
 }
 
 auto ParseTree::children(Node n) const
     -> llvm::iterator_range<SiblingIterator> {
-  int end_index = n.index_ - node_impls_[n.index_].subtree_size;
+  int end_index = n.index_ - node_impls_[n.index_].subtree_size();
   return {SiblingIterator(*this, Node(n.index_ - 1)),
           SiblingIterator(*this, Node(end_index))};
 }
@@ -50,101 +104,461 @@ auto ParseTree::roots() const -> llvm::iterator_range<SiblingIterator> {
       SiblingIterator(*this, Node(-1))};
 }
 
+auto ParseTree::parent(Node n) const -> llvm::Optional<Node> {
+  BuildParentIndex();
+  int parent_index = parent_indices_[n.index_];
+  if (parent_index == Node::InvalidValue) {
+    return llvm::None;
+  }
+  return Node(parent_index);
+}
+
+auto ParseTree::BuildParentIndex() const -> void {
+  if (!parent_indices_.empty() || node_impls_.empty()) {
+    return;
+  }
+  parent_indices_.resize(node_impls_.size(), Node::InvalidValue);
+  // In postorder, a node's children are the roots of the subtrees completed
+  // since its subtree started, so keep a stack of those roots.
+  llvm::SmallVector<int32_t> subtree_roots;
+  for (int i = 0; i != static_cast<int>(node_impls_.size()); ++i) {
+    int subtree_begin = i - node_impls_[i].subtree_size() + 1;
+    while (!subtree_roots.empty() && subtree_roots.back() >= subtree_begin) {
+      parent_indices_[subtree_roots.back()] = i;
+      subtree_roots.pop_back();
+    }
+    subtree_roots.push_back(i);
+  }
+}
+
+auto ParseTree::subtree_hash(Node n) const -> uint64_t {
+  BuildSubtreeHashes();
+  return subtree_hashes_[n.index_];
+}
+
+auto ParseTree::BuildSubtreeHashes() const -> void {
+  if (!subtree_hashes_.empty() || node_impls_.empty()) {
+    return;
+  }
+  subtree_hashes_.resize(node_impls_.size());
+  // A node's hash covers its own fields and then its children's hashes, in
+  // order. In postorder, its children are the roots of the subtrees completed
+  // since its subtree started, which are on top of the stack left to right.
+  llvm::SmallVector<int32_t> subtree_roots;
+  llvm::SmallVector<uint64_t> fields;
+  for (int i = 0; i != static_cast<int>(node_impls_.size()); ++i) {
+    const NodeImpl& n_impl = node_impls_[i];
+    int subtree_begin = i - n_impl.subtree_size() + 1;
+    auto children = subtree_roots.end();
+    while (children != subtree_roots.begin() &&
+           *std::prev(children) >= subtree_begin) {
+      --children;
+    }
+    fields.assign({n_impl.kind().AsInt(),
+                   static_cast<uint64_t>(n_impl.has_error()),
+                   static_cast<uint64_t>(n_impl.has_trailing_separator()),
+                   static_cast<uint64_t>(n_impl.subtree_size()),
+                   llvm::xxHash64(tokens_->GetTokenText(n_impl.token()))});
+    for (int32_t child : llvm::make_range(children, subtree_roots.end())) {
+      fields.push_back(subtree_hashes_[child]);
+    }
+    subtree_hashes_[i] = llvm::xxHash64(llvm::StringRef(
+        reinterpret_cast<const char*>(fields.data()),
+        fields.size() * sizeof(uint64_t)));
+    subtree_roots.erase(children, subtree_roots.end());
+    subtree_roots.push_back(i);
+  }
+}
+
+auto ParseTree::FindInnermostNode(TokenizedBuffer::Token token) const
+    -> llvm::Optional<Node> {
+  BuildTokenIndex();
+  int token_index = TokenizedBuffer::TokenIterator(token) -
+                    tokens_->tokens().begin();
+  int node_index = token_node_indices_[token_index];
+  if (node_index == Node::InvalidValue) {
+    return llvm::None;
+  }
+  return Node(node_index);
+}
+
+auto ParseTree::FindNodeAtOffset(int64_t offset) const
+    -> llvm::Optional<Node> {
+  if (auto token = tokens_->FindTokenAtOffset(offset)) {
+    return FindInnermostNode(*token);
+  }
+  return llvm::None;
+}
+
+auto ParseTree::BuildTokenIndex() const -> void {
+  if (!token_node_indices_.empty()) {
+    return;
+  }
+  auto index_of = [&](TokenizedBuffer::Token token) -> int {
+    return TokenizedBuffer::TokenIterator(token) - tokens_->tokens().begin();
+  };
+
+  // Compute the range of tokens each node covers, from those of its children,
+  // which in postorder are the roots of the subtrees completed since its
+  // subtree started.
+  int num_nodes = node_impls_.size();
+  llvm::SmallVector<int32_t, 0> first_tokens(num_nodes);
+  llvm::SmallVector<int32_t, 0> last_tokens(num_nodes);
+  llvm::SmallVector<int32_t> subtree_roots;
+  for (int i = 0; i != num_nodes; ++i) {
+    TokenizedBuffer::Token token = node_impls_[i].token();
+    first_tokens[i] = index_of(token);
+    last_tokens[i] = tokens_->GetKind(token).IsOpeningSymbol()
+                         ? index_of(tokens_->GetMatchedClosingToken(token))
+                         : first_tokens[i];
+    int subtree_begin = i - node_impls_[i].subtree_size() + 1;
+    while (!subtree_roots.empty() && subtree_roots.back() >= subtree_begin) {
+      int child = subtree_roots.pop_back_val();
+      first_tokens[i] = std::min(first_tokens[i], first_tokens[child]);
+      last_tokens[i] = std::max(last_tokens[i], last_tokens[child]);
+    }
+    subtree_roots.push_back(i);
+  }
+
+  // Descendants come before their ancestors in postorder, so giving each node
+  // the tokens it covers that no earlier node took leaves every token with its
+  // innermost node. `next_untaken` skips over runs of taken tokens, and is
+  // compressed as it is followed, so each token is visited about once.
+  int num_tokens = tokens_->size();
+  token_node_indices_.resize(num_tokens, Node::InvalidValue);
+  llvm::SmallVector<int32_t, 0> next_untaken(num_tokens + 1);
+  for (int i = 0; i != num_tokens + 1; ++i) {
+    next_untaken[i] = i;
+  }
+  auto find_untaken = [&](int token_index) {
+    int untaken = token_index;
+    while (next_untaken[untaken] != untaken) {
+      untaken = next_untaken[untaken];
+    }
+    while (next_untaken[token_index] != untaken) {
+      token_index = std::exchange(next_untaken[token_index], untaken);
+    }
+    return untaken;
+  };
+  for (int i = 0; i != num_nodes; ++i) {
+    for (int token_index = find_untaken(first_tokens[i]);
+         token_index <= last_tokens[i];
+         token_index = find_untaken(token_index + 1)) {
+      token_node_indices_[token_index] = i;
+      next_untaken[token_index] = token_index + 1;
+    }
+  }
+}
+
+auto ParseTree::node_has_trailing_separator(Node n) const -> bool {
+  COCKTAIL_DCHECK(n.is_valid());
+  return node_impls_[n.index_].has_trailing_separator();
+}
+
 auto ParseTree::node_has_error(Node n) const -> bool {
-  COCKTAIL_CHECK(n.is_valid());
-  return node_impls_[n.index_].has_error;
+  COCKTAIL_DCHECK(n.is_valid());
+  return node_impls_[n.index_].has_error();
 }
 
 auto ParseTree::node_kind(Node n) const -> ParseNodeKind {
-  COCKTAIL_CHECK(n.is_valid());
-  return node_impls_[n.index_].kind;
+  COCKTAIL_DCHECK(n.is_valid());
+  return node_impls_[n.index_].kind();
 }
 
 auto ParseTree::node_token(Node n) const -> TokenizedBuffer::Token {
-  COCKTAIL_CHECK(n.is_valid());
-  return node_impls_[n.index_].token;
+  COCKTAIL_DCHECK(n.is_valid());
+  return node_impls_[n.index_].token();
 }
 
 auto ParseTree::GetNodeText(Node n) const -> llvm::StringRef {
-  COCKTAIL_CHECK(n.is_valid());
-  return tokens_->GetTokenText(node_impls_[n.index_].token);
+  COCKTAIL_DCHECK(n.is_valid());
+  return tokens_->GetTokenText(node_impls_[n.index_].token());
+}
+
+auto ParseTree::Reparse(const ParseTree& previous, TokenizedBuffer& tokens,
+                        const TokenEdit& edit, DiagnosticConsumer& consumer)
+    -> ParseTree {
+  TokenizedBuffer::TokenLocationTranslator translator(tokens, nullptr);
+  TokenDiagnosticEmitter emitter(translator, consumer);
+
+  return Parser::Reparse(previous, tokens, edit, emitter);
+}
+
+auto ParseTree::ComputeTokenEdit(const TokenizedBuffer& previous,
+                                 const TokenizedBuffer& tokens,
+                                 llvm::StringRef previous_text,
+                                 const TokenizedBuffer::TextEdit& edit)
+    -> llvm::Optional<TokenEdit> {
+  // The first line the edit touched, and its last line before and after it.
+  int first_line = 1 + previous_text.take_front(edit.offset).count('\n');
+  int previous_last_line =
+      first_line +
+      previous_text.substr(edit.offset, edit.removed_length).count('\n');
+  int last_line = first_line + edit.inserted_text.count('\n');
+  auto same = [&](TokenizedBuffer::Token a, TokenizedBuffer::Token b) {
+    return previous.GetKind(a) == tokens.GetKind(b) &&
+           previous.GetTokenText(a) == tokens.GetTokenText(b) &&
+           previous.GetColumnNumber(a) == tokens.GetColumnNumber(b);
+  };
+  int max_unchanged = std::min(previous.size(), tokens.size());
+  int prefix = 0;
+  for (; prefix < max_unchanged; ++prefix) {
+    TokenizedBuffer::Token a = *(previous.tokens().begin() + prefix);
+    TokenizedBuffer::Token b = *(tokens.tokens().begin() + prefix);
+    if (previous.GetLineNumber(a) >= first_line || !same(a, b) ||
+        previous.GetLineNumber(a) != tokens.GetLineNumber(b)) {
+      break;
+    }
+  }
+  int suffix = 0;
+  for (; suffix < max_unchanged - prefix; ++suffix) {
+    TokenizedBuffer::Token a = *(previous.tokens().end() - (suffix + 1));
+    TokenizedBuffer::Token b = *(tokens.tokens().end() - (suffix + 1));
+    if (previous.GetLineNumber(a) <= previous_last_line ||
+        tokens.GetLineNumber(b) <= last_line || !same(a, b)) {
+      break;
+    }
+  }
+  if (suffix == 0) {
+    return llvm::None;
+  }
+  return TokenEdit{.first_token = prefix,
+                   .removed_count = previous.size() - prefix - suffix,
+                   .inserted_count = tokens.size() - prefix - suffix};
+}
+
+auto ParseTree::ParseSkippedCodeBlock(Node n,
+                                      DiagnosticConsumer& consumer) const
+    -> ParseTree {
+  COCKTAIL_CHECK(node_kind(n) == ParseNodeKind::SkippedCodeBlock())
+      << "Only a skipped code block can be parsed later!";
+  TokenizedBuffer::TokenLocationTranslator translator(*tokens_, nullptr);
+  TokenDiagnosticEmitter emitter(translator, consumer);
+
+  return Parser::ParseCodeBlock(*tokens_, emitter, node_token(n), separators_);
 }
 
-auto ParseTree::Print(llvm::raw_ostream& output) const -> void {
-  output << "[\n";
+auto ParseTree::Print(llvm::raw_ostream& output, PrintFormat format) const
+    -> void {
+  if (format == PrintFormat::Ndjson) {
+    PrintNdjson(output);
+    return;
+  }
+
+  // Nodes are formatted into a large buffer that is written out each time it
+  // fills, rather than through the stream a field at a time.
+  constexpr size_t FlushSize = 1 << 16;
+  llvm::SmallString<0> out;
+  out.reserve(FlushSize * 2);
+  auto append = [&](llvm::StringRef text) {
+    out.append(text.begin(), text.end());
+  };
+
+  append("[\n");
   llvm::SmallVector<std::pair<Node, int>, 16> node_stack;
   for (Node n : roots()) {
     node_stack.push_back({n, 0});
   }
 
   while (!node_stack.empty()) {
+    if (out.size() >= FlushSize) {
+      output << out;
+      out.clear();
+    }
+
     Node n;
     int depth;
     std::tie(n, depth) = node_stack.pop_back_val();
     const auto& n_impl = node_impls_[n.index()];
 
-    for (int unused_indent : llvm::seq(0, depth)) {
-      (void)unused_indent;
-      output << "  ";
+    out.append(depth * 2, ' ');
+    append("{node_index: ");
+    AppendInt(out, n.index_);
+    append(", kind: '");
+    append(n_impl.kind().name());
+    append("', text: '");
+    append(tokens_->GetTokenText(n_impl.token()));
+    append("'");
+
+    if (n_impl.has_error()) {
+      append(", has_error: yes");
     }
-
-    output << "{node_index: " << n.index_ << ", kind: '" << n_impl.kind.name()
-           << "', text: '" << tokens_->GetTokenText(n_impl.token) << "'";
-
-    if (n_impl.has_error) {
-      output << ", has_error: yes";
+    if (n_impl.has_trailing_separator()) {
+      append(", has_trailing_separator: yes");
     }
 
-    if (n_impl.subtree_size > 1) {
-      output << ", subtree_size: " << n_impl.subtree_size;
-      output << ", children: [\n";
+    if (n_impl.subtree_size() > 1) {
+      append(", subtree_size: ");
+      AppendInt(out, n_impl.subtree_size());
+      append(", children: [\n");
       for (Node sibling_n : children(n)) {
         node_stack.push_back({sibling_n, depth + 1});
       }
       continue;
     }
 
-    COCKTAIL_CHECK(n_impl.subtree_size == 1)
+    COCKTAIL_CHECK(n_impl.subtree_size() == 1)
         << "Subtree size must always be a positive integer!";
-    output << "}";
+    append("}");
 
     int next_depth = node_stack.empty() ? 0 : node_stack.back().second;
     COCKTAIL_CHECK(next_depth <= depth)
         << "Cannot have the next depth increase!";
     for (int close_children_count : llvm::seq(0, depth - next_depth)) {
       (void)close_children_count;
-      output << "]}";
+      append("]}");
+    }
+
+    append(",\n");
+  }
+  append("]\n");
+  output << out;
+}
+
+auto ParseTree::PrintNdjson(llvm::raw_ostream& output) const -> void {
+  constexpr size_t FlushSize = 1 << 16;
+  llvm::SmallString<0> out;
+  out.reserve(FlushSize * 2);
+  auto append = [&](llvm::StringRef text) {
+    out.append(text.begin(), text.end());
+  };
+
+  auto first_token = tokens_->tokens().begin();
+  for (int i = 0; i != size(); ++i) {
+    const NodeImpl& n_impl = node_impls_[i];
+    append(R"({"node_index":)");
+    AppendInt(out, i);
+    append(R"(,"kind":")");
+    append(n_impl.kind().name());
+    append(R"(","text":)");
+    AppendJsonString(out, tokens_->GetTokenText(n_impl.token()));
+    append(R"(,"token":)");
+    AppendInt(out, TokenizedBuffer::TokenIterator(n_impl.token()) -
+                       first_token);
+    append(R"(,"subtree_size":)");
+    AppendInt(out, n_impl.subtree_size());
+    if (n_impl.has_error()) {
+      append(R"(,"has_error":true)");
     }
+    if (n_impl.has_trailing_separator()) {
+      append(R"(,"has_trailing_separator":true)");
+    }
+    append("}\n");
 
-    output << ",\n";
+    if (out.size() >= FlushSize) {
+      output << out;
+      out.clear();
+    }
   }
-  output << "]\n";
+  output << out;
 }
 
 auto ParseTree::Verify() const -> bool {
-  llvm::SmallVector<ParseTree::Node, 16> ancestors;
-  for (Node n : llvm::reverse(postorder())) {
+  return VerifyNodes(0, node_impls_.size(), llvm::errs());
+}
+
+auto ParseTree::Verify(TaskScheduler& scheduler) const -> bool {
+  llvm::SmallVector<int> root_begins;
+  if (!FindRootBegins(root_begins)) {
+    return false;
+  }
+
+  // Group the roots so that each task has enough nodes to be worth handing to
+  // another thread. Each task prints to its own buffer, and the buffers are
+  // printed in order afterwards.
+  constexpr int MinNodesPerTask = 1 << 14;
+  llvm::SmallVector<int> task_begins;
+  for (int root_begin : root_begins) {
+    if (task_begins.empty() ||
+        root_begin - task_begins.back() >= MinNodesPerTask) {
+      task_begins.push_back(root_begin);
+    }
+  }
+  task_begins.push_back(node_impls_.size());
+  int num_tasks = static_cast<int>(task_begins.size()) - 1;
+  llvm::SmallVector<std::string> task_errors(num_tasks);
+  llvm::SmallVector<char> task_results(num_tasks);
+  ParallelFor(scheduler, num_tasks, [&](int i) {
+    llvm::raw_string_ostream errors(task_errors[i]);
+    task_results[i] = VerifyNodes(task_begins[i], task_begins[i + 1], errors);
+  });
+  bool result = true;
+  for (int i = 0; i != num_tasks; ++i) {
+    llvm::errs() << task_errors[i];
+    result &= static_cast<bool>(task_results[i]);
+  }
+  return result;
+}
+
+auto ParseTree::Verify(double sampling_rate) const -> bool {
+  COCKTAIL_CHECK(sampling_rate >= 0 && sampling_rate <= 1)
+      << "Sampling rate " << sampling_rate << " is not between 0 and 1!";
+  llvm::SmallVector<int> root_begins;
+  if (!FindRootBegins(root_begins)) {
+    return false;
+  }
+  root_begins.push_back(node_impls_.size());
+  // Hashing the position spreads the checked subtrees over the tree, rather
+  // than always checking the same declarations of similar files.
+  constexpr uint64_t HashRange = 1 << 16;
+  auto threshold = static_cast<uint64_t>(sampling_rate * HashRange);
+  for (int i = 0; i + 1 != static_cast<int>(root_begins.size()); ++i) {
+    if (llvm::hash_value(root_begins[i]) % HashRange < threshold &&
+        !VerifyNodes(root_begins[i], root_begins[i + 1], llvm::errs())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto ParseTree::FindRootBegins(llvm::SmallVectorImpl<int>& root_begins) const
+    -> bool {
+  for (int i = static_cast<int>(node_impls_.size()) - 1; i >= 0;) {
+    int subtree_size = node_impls_[i].subtree_size();
+    if (subtree_size < 1 || subtree_size > i + 1) {
+      llvm::errs() << "Root node #" << i << " has an invalid subtree size of "
+                   << subtree_size << "!\n";
+      return false;
+    }
+    i -= subtree_size;
+    root_begins.push_back(i + 1);
+  }
+  std::reverse(root_begins.begin(), root_begins.end());
+  return true;
+}
+
+auto ParseTree::VerifyNodes(int begin, int end, llvm::raw_ostream& errors) const
+    -> bool {
+  llvm::SmallVector<Node, 16> ancestors;
+  return VerifyNodes(begin, end, errors, ancestors);
+}
+
+auto ParseTree::VerifyNodes(int begin, int end, llvm::raw_ostream& errors,
+                            llvm::SmallVectorImpl<Node>& ancestors) const
+    -> bool {
+  ancestors.clear();
+  for (int i = end - 1; i >= begin; --i) {
+    Node n(i);
     const auto& n_impl = node_impls_[n.index()];
 
-    if (n_impl.has_error && !has_errors_) {
-      llvm::errs()
-          << "Node #" << n.index()
-          << " has errors, but the tree is not marked as having any.\n";
+    if (n_impl.has_error() && !has_errors_) {
+      errors << "Node #" << n.index()
+             << " has errors, but the tree is not marked as having any.\n";
       return false;
     }
 
-    if (n_impl.subtree_size > 1) {
+    if (n_impl.subtree_size() > 1) {
       if (!ancestors.empty()) {
         auto parent_n = ancestors.back();
         const auto& parent_n_impl = node_impls_[parent_n.index()];
-        int end_index = n.index() - n_impl.subtree_size;
-        int parent_end_index = parent_n.index() - parent_n_impl.subtree_size;
+        int end_index = n.index() - n_impl.subtree_size();
+        int parent_end_index = parent_n.index() - parent_n_impl.subtree_size();
         if (parent_end_index > end_index) {
-          llvm::errs() << "Node #" << n.index() << " has a subtree size of "
-                       << n_impl.subtree_size
-                       << " which extends beyond its parent's (node #"
-                       << parent_n.index() << ") subtree (size "
-                       << parent_n_impl.subtree_size << ")\n";
+          errors << "Node #" << n.index() << " has a subtree size of "
+                 << n_impl.subtree_size()
+                 << " which extends beyond its parent's (node #"
+                 << parent_n.index() << ") subtree (size "
+                 << parent_n_impl.subtree_size() << ")\n";
           return false;
         }
       }
@@ -152,17 +566,16 @@ auto ParseTree::Verify() const -> bool {
       continue;
     }
 
-    if (n_impl.subtree_size < 1) {
-      llvm::errs() << "Node #" << n.index()
-                   << " has an invalid subtree size of " << n_impl.subtree_size
-                   << "!\n";
+    if (n_impl.subtree_size() < 1) {
+      errors << "Node #" << n.index() << " has an invalid subtree size of "
+             << n_impl.subtree_size() << "!\n";
       return false;
     }
 
     int next_index = n.index() - 1;
     while (!ancestors.empty()) {
       ParseTree::Node parent_n = ancestors.back();
-      if ((parent_n.index() - node_impls_[parent_n.index()].subtree_size) !=
+      if ((parent_n.index() - node_impls_[parent_n.index()].subtree_size()) !=
           next_index) {
         break;
       }
@@ -170,10 +583,10 @@ auto ParseTree::Verify() const -> bool {
     }
   }
   if (!ancestors.empty()) {
-    llvm::errs()
+    errors
         << "Finished walking the parse tree and there are still ancestors:\n";
     for (Node ancestor_n : ancestors) {
-      llvm::errs() << "  Node #" << ancestor_n.index() << "\n";
+      errors << "  Node #" << ancestor_n.index() << "\n";
     }
     return false;
   }
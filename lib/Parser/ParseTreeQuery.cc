@@ -0,0 +1,229 @@
+#include "Cocktail/Parser/ParseTreeQuery.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MathExtras.h"
+
+namespace Cocktail {
+
+namespace {
+
+// Returns the kind named `name`, if any.
+auto LookupKind(llvm::StringRef name) -> std::optional<ParseNodeKind> {
+  static const llvm::StringMap<ParseNodeKind> kinds = [] {
+    llvm::StringMap<ParseNodeKind> kinds;
+    for (int i = 0; i != ParseNodeKind::NumKinds; ++i) {
+      ParseNodeKind kind = ParseNodeKind::FromInt(i);
+      kinds.insert({kind.name(), kind});
+    }
+    return kinds;
+  }();
+  auto it = kinds.find(name);
+  if (it == kinds.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+}  // namespace
+
+// Parses the text of one pattern into steps of the query.
+class ParseTreeQuery::Compiler {
+ public:
+  Compiler(ParseTreeQuery& query, int pattern, llvm::StringRef text)
+      : query_(&query), pattern_(pattern), text_(text), rest_(text) {}
+
+  // Parses the whole text as a pattern, returning its root step.
+  auto ParseText() -> ErrorOr<int> {
+    COCKTAIL_ASSIGN_OR_RETURN(int step, ParsePattern());
+    SkipSpace();
+    if (!rest_.empty()) {
+      return MakeError() << "Unexpected `" << rest_.front()
+                         << "` after the pattern.";
+    }
+    return step;
+  }
+
+ private:
+  auto SkipSpace() -> void { rest_ = rest_.ltrim(); }
+
+  // Returns an error located at the current position.
+  auto MakeError() -> ErrorBuilder {
+    return ErrorBuilder(llvm::formatv("pattern {0}:{1}", pattern_ + 1,
+                                      text_.size() - rest_.size() + 1)
+                            .str());
+  }
+
+  auto ParsePattern() -> ErrorOr<int>;
+
+  ParseTreeQuery* query_;
+  int pattern_;
+  llvm::StringRef text_;
+  // The text that is left to parse.
+  llvm::StringRef rest_;
+};
+
+auto ParseTreeQuery::Compiler::ParsePattern() -> ErrorOr<int> {
+  SkipSpace();
+  if (!rest_.consume_front("(")) {
+    return MakeError() << "Expected `(` to start a pattern.";
+  }
+  SkipSpace();
+  size_t name_size = std::min(
+      rest_.size(), rest_.find_if_not([](char c) {
+        return llvm::isAlnum(c) || c == '_';
+      }));
+  if (name_size == 0) {
+    return MakeError() << "Expected a node kind or `_`.";
+  }
+  Step step;
+  llvm::StringRef name = rest_.take_front(name_size);
+  if (name != "_") {
+    step.kind = LookupKind(name);
+    if (!step.kind) {
+      return MakeError() << "Unknown node kind `" << name << "`.";
+    }
+  }
+  rest_ = rest_.drop_front(name_size);
+  SkipSpace();
+  if (rest_.consume_front("\"")) {
+    size_t end = rest_.find('"');
+    if (end == llvm::StringRef::npos) {
+      return MakeError() << "Unterminated string.";
+    }
+    step.text = rest_.take_front(end).str();
+    rest_ = rest_.drop_front(end + 1);
+  }
+  while (true) {
+    SkipSpace();
+    if (rest_.consume_front(")")) {
+      break;
+    }
+    bool descendant = rest_.consume_front("..");
+    bool anchored = !descendant && rest_.consume_front(".");
+    COCKTAIL_ASSIGN_OR_RETURN(int child, ParsePattern());
+    if (descendant) {
+      step.descendants.push_back(child);
+    } else {
+      step.children.push_back({child, anchored});
+    }
+  }
+  query_->steps_.push_back(std::move(step));
+  return static_cast<int>(query_->steps_.size()) - 1;
+}
+
+auto ParseTreeQuery::Compile(llvm::ArrayRef<llvm::StringRef> patterns)
+    -> ErrorOr<ParseTreeQuery> {
+  ParseTreeQuery query;
+  for (int i = 0; i != static_cast<int>(patterns.size()); ++i) {
+    COCKTAIL_ASSIGN_OR_RETURN(int root,
+                              Compiler(query, i, patterns[i]).ParseText());
+    query.patterns_.push_back(root);
+    const std::optional<ParseNodeKind>& kind = query.steps_[root].kind;
+    for (int k = 0; k != ParseNodeKind::NumKinds; ++k) {
+      if (!kind || kind->AsInt() == k) {
+        query.patterns_by_kind_[k].push_back(i);
+        query.is_root_kind_[k] = 1;
+      }
+    }
+  }
+  return query;
+}
+
+auto ParseTreeQuery::Run(const ParseTree& tree,
+                         llvm::function_ref<auto(Match)->void> on_match) const
+    -> void {
+  const auto& nodes = tree.node_impls_;
+  int32_t size = nodes.size();
+  // Candidates are found a block of nodes at a time, as a mask built by
+  // looking up each node's kind, which has no branches for the compiler to
+  // keep it from vectorizing. Only the candidates are matched further.
+  constexpr int32_t BlockSize = 64;
+  for (int32_t begin = 0; begin < size; begin += BlockSize) {
+    int32_t count = std::min(BlockSize, size - begin);
+    uint64_t candidates = 0;
+    for (int32_t i = 0; i != count; ++i) {
+      candidates |= static_cast<uint64_t>(
+                        is_root_kind_[nodes[begin + i].kind().AsInt()])
+                    << i;
+    }
+    while (candidates != 0) {
+      int32_t index = begin + llvm::countTrailingZeros(candidates);
+      candidates &= candidates - 1;
+      for (int pattern :
+           patterns_by_kind_[nodes[index].kind().AsInt()]) {
+        if (MatchStep(tree, patterns_[pattern], index)) {
+          on_match({.pattern = pattern, .node = ParseTree::Node(index)});
+        }
+      }
+    }
+  }
+}
+
+auto ParseTreeQuery::FindMatches(const ParseTree& tree) const
+    -> llvm::SmallVector<Match> {
+  llvm::SmallVector<Match> matches;
+  Run(tree, [&](Match match) { matches.push_back(match); });
+  return matches;
+}
+
+auto ParseTreeQuery::MatchStep(const ParseTree& tree, int step,
+                               int32_t index) const -> bool {
+  const Step& s = steps_[step];
+  const ParseTree::NodeImpl& node = tree.node_impls_[index];
+  if (s.kind && node.kind() != *s.kind) {
+    return false;
+  }
+  if (s.text && tree.tokens_->GetTokenText(node.token()) != *s.text) {
+    return false;
+  }
+  int32_t subtree_begin = index - node.subtree_size() + 1;
+  if (!s.children.empty()) {
+    // Each child's subtree ends right before the next one's starts, so the
+    // children are found from the last by their subtree sizes.
+    llvm::SmallVector<int32_t, 8> children;
+    for (int32_t child = index - 1; child >= subtree_begin;
+         child -= tree.node_impls_[child].subtree_size()) {
+      children.push_back(child);
+    }
+    std::reverse(children.begin(), children.end());
+    if (!MatchChildren(tree, s, 0, children, 0)) {
+      return false;
+    }
+  }
+  for (int descendant : s.descendants) {
+    bool found = false;
+    for (int32_t i = subtree_begin; i != index && !found; ++i) {
+      found = MatchStep(tree, descendant, i);
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto ParseTreeQuery::MatchChildren(const ParseTree& tree, const Step& step,
+                                   int item, llvm::ArrayRef<int32_t> children,
+                                   int first) const -> bool {
+  if (item == static_cast<int>(step.children.size())) {
+    return true;
+  }
+  auto [child_step, anchored] = step.children[item];
+  int end = anchored ? std::min<int>(first + 1, children.size())
+                     : children.size();
+  for (int i = first; i < end; ++i) {
+    // A later match for this child only leaves fewer for those after it, but
+    // an anchored child after it may need it to match later.
+    if (MatchStep(tree, child_step, children[i]) &&
+        MatchChildren(tree, step, item + 1, children, i + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace Cocktail
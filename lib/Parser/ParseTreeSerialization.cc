@@ -0,0 +1,192 @@
+#include <cstring>
+#include <string>
+
+#include "Cocktail/Lexer/TokenKindSet.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseNodeKind.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+namespace Cocktail {
+
+// The serialized format is a fixed header followed by the table of nodes, in
+// postorder, each made of two little-endian 32-bit fields: the packed kind,
+// flags and subtree size of `NodeImpl`, with the kind as its index in the node
+// kind registry, then the index of the node's token. This is how the
+// nodes are laid out in memory, so reading them back is a single pass over
+// the table that checks each node as it copies it.
+//
+// The header holds a fingerprint of the tokens: a hash of the kind of each
+// token and whether whitespace follows it, which is all that the parser reads
+// of them. The tree is only read back for tokens with the same fingerprint, as
+// a buffer deserialized from the token data written alongside it has. The
+// header also holds a hash of everything after that hash, so that corrupted
+// data is rejected rather than read.
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "CKPARSED";
+
+// The magic, the hash of the rest, the version, flags, the number of tokens
+// and nodes, the tokens' fingerprint, the node registry's hash and the parse
+// statistics.
+constexpr uint64_t HeaderSize = 72;
+
+// Where the data that the hash is of starts.
+constexpr uint64_t HashedOffset = 16;
+
+enum HeaderFlags : uint32_t {
+  HasErrors = 1 << 0,
+  SkippedFunctionBodies = 1 << 1,
+  ElidedSeparators = 1 << 2,
+  AllFlags = HasErrors | SkippedFunctionBodies | ElidedSeparators,
+};
+
+constexpr uint64_t NodeSize = 2 * sizeof(uint32_t);
+
+// A hash of the node kind registry, so that data written before a node kind
+// was added or removed is rejected even if nobody remembered to bump the
+// version.
+auto NodeKindsHash() -> uint64_t {
+  static const uint64_t hash = [] {
+    std::string names;
+#define COCKTAIL_PARSE_NODE_KIND(Name) names += #Name "\n";
+#include "Cocktail/Parser/ParseNodeKind.def"
+    return llvm::xxHash64(names);
+  }();
+  return hash;
+}
+
+auto TokensFingerprint(const TokenizedBuffer& tokens) -> uint64_t {
+  std::string fingerprint;
+  fingerprint.reserve(tokens.size() * 2);
+  for (TokenizedBuffer::Token token : tokens.tokens()) {
+    fingerprint.push_back(GetTokenKindIndex(tokens.GetKind(token)));
+    fingerprint.push_back(tokens.HasTrailingWhitespace(token));
+  }
+  return llvm::xxHash64(fingerprint);
+}
+
+template <typename T>
+auto Store(char* out, T value) -> void {
+  llvm::support::endian::write<T, llvm::support::little>(out, value);
+}
+
+template <typename T>
+auto Load(const char* in) -> T {
+  return llvm::support::endian::read<T, llvm::support::little,
+                                     llvm::support::unaligned>(in);
+}
+
+}  // namespace
+
+auto ParseTree::Serialize(llvm::raw_ostream& output_stream) const -> void {
+  llvm::SmallVector<char, 0> data;
+  data.resize(HeaderSize + size() * NodeSize);
+
+  char* out = data.data();
+  auto write = [&](auto value) {
+    Store(out, value);
+    out += sizeof(value);
+  };
+  std::memcpy(out, Magic.data(), Magic.size());
+  out += Magic.size() + sizeof(uint64_t);
+  write(SerializationVersion);
+  write(static_cast<uint32_t>(
+      (has_errors_ ? HasErrors : 0) |
+      (function_bodies_ == FunctionBodies::Skipped ? SkippedFunctionBodies
+                                                   : 0) |
+      (separators_ == Separators::Elided ? ElidedSeparators : 0)));
+  write(static_cast<uint32_t>(tokens_->size()));
+  write(static_cast<uint32_t>(size()));
+  write(TokensFingerprint(*tokens_));
+  write(NodeKindsHash());
+  write(static_cast<int32_t>(parse_stats_.node_reallocations));
+  write(static_cast<int32_t>(0));
+  write(static_cast<int64_t>(parse_stats_.peak_node_storage_bytes));
+  write(static_cast<int64_t>(parse_stats_.final_node_storage_bytes));
+  COCKTAIL_CHECK(out == data.data() + HeaderSize) << "Unexpected header size!";
+
+  auto first_token = tokens_->tokens().begin();
+  for (const NodeImpl& node_impl : node_impls_) {
+    write(node_impl.bits_);
+    write(static_cast<uint32_t>(
+        TokenizedBuffer::TokenIterator(node_impl.token_) - first_token));
+  }
+
+  llvm::StringRef hashed(data.data() + HashedOffset,
+                         data.size() - HashedOffset);
+  Store<uint64_t>(data.data() + Magic.size(), llvm::xxHash64(hashed));
+  output_stream << llvm::StringRef(data.data(), data.size());
+}
+
+auto ParseTree::Deserialize(TokenizedBuffer& tokens, llvm::StringRef data)
+    -> llvm::Optional<ParseTree> {
+  if (data.size() < HeaderSize || !data.startswith(Magic)) {
+    return llvm::None;
+  }
+  const char* in = data.data() + Magic.size();
+  auto read = [&](auto value) {
+    value = Load<decltype(value)>(in);
+    in += sizeof(value);
+    return value;
+  };
+  uint64_t hash = read(uint64_t{});
+  if (read(uint32_t{}) != SerializationVersion ||
+      hash != llvm::xxHash64(data.drop_front(HashedOffset))) {
+    return llvm::None;
+  }
+  uint32_t header_flags = read(uint32_t{});
+  uint32_t num_tokens = read(uint32_t{});
+  uint32_t num_nodes = read(uint32_t{});
+  if ((header_flags & ~AllFlags) != 0 ||
+      num_tokens != static_cast<uint32_t>(tokens.size()) ||
+      num_nodes > INT32_MAX ||
+      (data.size() - HeaderSize) / NodeSize != num_nodes ||
+      (data.size() - HeaderSize) % NodeSize != 0 ||
+      read(uint64_t{}) != TokensFingerprint(tokens) ||
+      read(uint64_t{}) != NodeKindsHash()) {
+    return llvm::None;
+  }
+
+  ParseTree tree(tokens);
+  tree.has_errors_ = header_flags & HasErrors;
+  tree.function_bodies_ = header_flags & SkippedFunctionBodies
+                              ? FunctionBodies::Skipped
+                              : FunctionBodies::Parsed;
+  tree.separators_ = header_flags & ElidedSeparators ? Separators::Elided
+                                                     : Separators::Kept;
+  tree.parse_stats_.node_reallocations = read(int32_t{});
+  read(int32_t{});
+  tree.parse_stats_.peak_node_storage_bytes = read(int64_t{});
+  tree.parse_stats_.final_node_storage_bytes = read(int64_t{});
+
+  // The nodes are copied over placeholders, rather than appended one by one,
+  // so that reading them back costs little more than copying the table.
+  auto first_token = tokens.tokens().begin();
+  tree.node_impls_.resize(num_nodes,
+                          NodeImpl(ParseNodeKind::FileEnd(), *first_token, 1));
+  for (uint32_t i = 0; i != num_nodes; ++i) {
+    NodeImpl& node_impl = tree.node_impls_[i];
+    node_impl.bits_ = read(uint32_t{});
+    uint32_t token_index = read(uint32_t{});
+    // This, along with `VerifyNodes` below, keeps every walk of the tree in
+    // bounds.
+    uint32_t subtree_size = node_impl.subtree_size();
+    if ((node_impl.bits_ >> NodeImpl::KindShift) >= ParseNodeKind::NumKinds ||
+        token_index >= num_tokens || subtree_size < 1 ||
+        subtree_size > i + 1) {
+      return llvm::None;
+    }
+    node_impl.token_ = first_token[token_index];
+  }
+  if (!tree.VerifyNodes(0, tree.size(), llvm::nulls())) {
+    return llvm::None;
+  }
+  return tree;
+}
+
+}  // namespace Cocktail
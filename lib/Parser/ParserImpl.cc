@@ -1,13 +1,18 @@
 #include "Cocktail/Parser/ParserImpl.h"
 
+#include <algorithm>
 #include <cstdlib>
 
 #include "Cocktail/Lexer/TokenKind.h"
+#include "Cocktail/Lexer/TokenKindSet.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
 #include "Cocktail/Parser/ParseNodeKind.h"
 #include "Cocktail/Parser/ParseTree.h"
 #include "Cocktail/Common/Check.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -16,33 +21,10 @@ namespace Cocktail {
 COCKTAIL_DIAGNOSTIC(ExpectedSemiAfterExpression, Error,
                   "Expected `;` after expression.");
 
-class ParseTree::Parser::ScopedStackStep {
- public:
-  explicit ScopedStackStep(ParseTree::Parser* parser) : parser_(parser) {
-    ++parser_->stack_depth_;
-  }
-  ~ScopedStackStep() { --parser_->stack_depth_; }
-
-  auto VerifyUnderLimit() -> bool {
-    if (parser_->stack_depth_ >= StackDepthLimit) {
-      COCKTAIL_DIAGNOSTIC(StackLimitExceeded, Error,
-                        "Exceeded recursion limit ({0})", int);
-      parser_->emitter_.Emit(*parser_->position_, StackLimitExceeded,
-                             ParseTree::StackDepthLimit);
-      return false;
-    }
-    return true;
-  }
-
- private:
-  ParseTree::Parser* parser_;
-};
-
-#define RETURN_IF_STACK_LIMITED(error_return_expr) \
-  ScopedStackStep scoped_stack_step(this);         \
-  if (!scoped_stack_step.VerifyUnderLimit()) {     \
-    return (error_return_expr);                    \
-  }
+// May be omitted a couple different ways here.
+COCKTAIL_DIAGNOSTIC(
+    OperatorRequiresParentheses, Error,
+    "Parentheses are required to disambiguate operator precedence.");
 
 enum class RelativeLocation : int8_t {
   Around,
@@ -66,13 +48,33 @@ static auto operator<<(llvm::raw_ostream& out, RelativeLocation loc)
   return out;
 }
 
+namespace {
+
+// Buffers the diagnostics of a chunk of declarations parsed in parallel until
+// the chunk is concatenated with the others.
+class ChunkDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    diagnostic.ResolveLocations();
+    diagnostics_.push_back(std::move(diagnostic));
+  }
+
+  auto diagnostics() -> llvm::MutableArrayRef<Diagnostic> {
+    return diagnostics_;
+  }
+
+ private:
+  llvm::SmallVector<Diagnostic, 0> diagnostics_;
+};
+
+}  // namespace
+
 ParseTree::Parser::Parser(ParseTree& tree_arg, TokenizedBuffer& tokens_arg,
-                          TokenDiagnosticEmitter& emitter)
-    : tree_(tree_arg),
-      tokens_(tokens_arg),
-      emitter_(emitter),
-      position_(tokens_.tokens().begin()),
-      end_(tokens_.tokens().end()) {
+                          TokenDiagnosticEmitter& emitter, Scratch* scratch)
+    : Parser(tree_arg, tokens_arg, emitter, tokens_arg.tokens().begin(),
+             // Each node is for a distinct token, so a node per token is
+             // enough to avoid any reallocation.
+             tokens_arg.size(), scratch) {
   COCKTAIL_CHECK(std::find_if(position_, end_,
                      [&](TokenizedBuffer::Token t) {
                        return tokens_.GetKind(t) == TokenKind::EndOfFile();
@@ -80,36 +82,348 @@ ParseTree::Parser::Parser(ParseTree& tree_arg, TokenizedBuffer& tokens_arg,
       << "No EndOfFileToken in token buffer.";
 }
 
+ParseTree::Parser::Parser(ParseTree& tree_arg, TokenizedBuffer& tokens_arg,
+                          TokenDiagnosticEmitter& emitter,
+                          TokenizedBuffer::TokenIterator begin,
+                          int reserved_nodes, Scratch* scratch)
+    : tree_(tree_arg),
+      tokens_(tokens_arg),
+      emitter_(emitter),
+      position_(begin),
+      end_(tokens_.tokens().end()),
+      scratch_(scratch) {
+  if (scratch_) {
+    state_stack_ = std::move(scratch_->state_stack);
+    tree_.node_impls_ = std::move(scratch_->node_storage);
+    tree_.node_impls_.clear();
+  }
+  tree_.node_impls_.reserve(reserved_nodes);
+}
+
+ParseTree::Parser::~Parser() {
+  if (scratch_) {
+    scratch_->state_stack = std::move(state_stack_);
+  }
+}
+
+auto ParseTree::Parser::Parse(TokenizedBuffer& tokens,
+                              TokenDiagnosticEmitter& emitter,
+                              NodeStorage node_storage,
+                              FunctionBodies function_bodies,
+                              Separators separators, Scratch* scratch,
+                              const CancellationToken* cancellation)
+    -> ParseTree {
+  ParseTree tree(tokens);
+  tree.function_bodies_ = function_bodies;
+  tree.separators_ = separators;
+  Parser parser(tree, tokens, emitter, scratch);
+  parser.function_bodies_ = function_bodies;
+  parser.separators_ = separators;
+  parser.cancellation_ = cancellation;
+  parser.ParseDeclarations(parser.end_);
+  parser.AddLeafNode(ParseNodeKind::FileEnd(), *parser.position_);
+  parser.FinishTree(node_storage);
+  return tree;
+}
+
 auto ParseTree::Parser::Parse(TokenizedBuffer& tokens,
-                              TokenDiagnosticEmitter& emitter) -> ParseTree {
+                              DiagnosticConsumer& consumer,
+                              TaskScheduler& scheduler, int chunk_size,
+                              NodeStorage node_storage,
+                              FunctionBodies function_bodies,
+                              Separators separators) -> ParseTree {
+  COCKTAIL_CHECK(chunk_size > 0) << "Chunks must not be empty!";
+  TokenizedBuffer::TokenLocationTranslator translator(tokens, nullptr);
+  TokenDiagnosticEmitter emitter(translator, consumer);
+
+  // Find where each chunk starts. Nothing deeper than the top level can start
+  // a declaration, so bracketed groups are skipped over whole.
+  llvm::SmallVector<TokenizedBuffer::TokenIterator> chunk_begins = {
+      tokens.tokens().begin()};
+  for (auto it = tokens.tokens().begin();; ++it) {
+    TokenKind kind = tokens.GetKind(*it);
+    if (kind == TokenKind::EndOfFile()) {
+      break;
+    }
+    if (kind.IsOneOf({TokenKind::Fn(), TokenKind::Var()}) &&
+        it - chunk_begins.back() >= chunk_size) {
+      chunk_begins.push_back(it);
+    }
+    if (kind.IsOpeningSymbol()) {
+      it = TokenizedBuffer::TokenIterator(tokens.GetMatchedClosingToken(*it));
+    }
+  }
+  if (chunk_begins.size() == 1) {
+    return Parse(tokens, emitter, node_storage, function_bodies, separators);
+  }
+
+  // Parse every chunk into a tree of its own, buffering its diagnostics. A
+  // chunk ends at the first declaration that reaches the start of the next.
+  int num_chunks = chunk_begins.size();
+  chunk_begins.push_back(tokens.tokens().end());
+  llvm::SmallVector<ParseTree, 0> chunks;
+  chunks.reserve(num_chunks);
+  for (int i = 0; i != num_chunks; ++i) {
+    chunks.push_back(ParseTree(tokens));
+  }
+  llvm::SmallVector<ChunkDiagnosticConsumer, 0> chunk_consumers(num_chunks);
+  llvm::SmallVector<TokenizedBuffer::TokenIterator> chunk_ends(num_chunks);
+  ParallelFor(scheduler, num_chunks, [&](int i) {
+    TokenDiagnosticEmitter chunk_emitter(translator, chunk_consumers[i]);
+    Parser parser(chunks[i], tokens, chunk_emitter, chunk_begins[i],
+                  chunk_begins[i + 1] - chunk_begins[i]);
+    parser.function_bodies_ = function_bodies;
+    parser.separators_ = separators;
+    parser.ParseDeclarations(chunk_begins[i + 1]);
+    chunk_ends[i] = parser.position_;
+  });
+
   ParseTree tree(tokens);
+  tree.function_bodies_ = function_bodies;
+  tree.separators_ = separators;
+  Parser parser(tree, tokens, emitter);
+  parser.function_bodies_ = function_bodies;
+  parser.separators_ = separators;
+  for (int i = 0; i != num_chunks; ++i) {
+    // If the chunk before this one ran past its start, parse serially until
+    // a chunk starts where a declaration ends again.
+    parser.ParseDeclarations(chunk_begins[i]);
+    if (parser.position_ != chunk_begins[i]) {
+      continue;
+    }
+    tree.node_impls_.append(chunks[i].node_impls_.begin(),
+                            chunks[i].node_impls_.end());
+    tree.has_errors_ |= chunks[i].has_errors_;
+    for (Diagnostic& diagnostic : chunk_consumers[i].diagnostics()) {
+      consumer.HandleDiagnostic(std::move(diagnostic));
+    }
+    parser.position_ = chunk_ends[i];
+  }
+  parser.ParseDeclarations(parser.end_);
+  parser.AddLeafNode(ParseNodeKind::FileEnd(), *parser.position_);
+  parser.FinishTree(node_storage, &scheduler);
+  return tree;
+}
 
-  // We expect to have a 1:1 correspondence between tokens and tree nodes, so
-  // reserve the space we expect to need here to avoid allocation and copying
-  // overhead.
-  tree.node_impls_.reserve(tokens.size());
+auto ParseTree::Parser::Reparse(const ParseTree& previous,
+                                TokenizedBuffer& tokens, const TokenEdit& edit,
+                                TokenDiagnosticEmitter& emitter) -> ParseTree {
+  const TokenizedBuffer& previous_tokens = *previous.tokens_;
+  int token_delta = edit.inserted_count - edit.removed_count;
+  COCKTAIL_CHECK(edit.first_token >= 0 && edit.removed_count >= 0 &&
+                 edit.inserted_count >= 0 &&
+                 edit.first_token + edit.removed_count <
+                     previous_tokens.size())
+      << "The edit must lie within the previous tokens, before the end!";
+  COCKTAIL_CHECK(tokens.size() == previous_tokens.size() + token_delta)
+      << "The tokens must be the previous tokens after the edit!";
+  auto index_of = [&](TokenizedBuffer::Token token) -> int {
+    return TokenizedBuffer::TokenIterator(token) - tokens.tokens().begin();
+  };
+  auto shifted = [&](TokenizedBuffer::Token token) {
+    return *(TokenizedBuffer::TokenIterator(token) + token_delta);
+  };
+  int edit_end = edit.first_token + edit.removed_count;
+  TokenizedBuffer::Token first_after_edit =
+      *(previous_tokens.tokens().begin() + edit_end);
+  llvm::ArrayRef<NodeImpl> previous_nodes = previous.node_impls_;
 
+  ParseTree tree(tokens);
+  tree.function_bodies_ = previous.function_bodies_;
+  tree.separators_ = previous.separators_;
+  // The errors of what isn't parsed again aren't known, so they are assumed
+  // to remain.
+  tree.has_errors_ = previous.has_errors_;
   Parser parser(tree, tokens, emitter);
-  while (!parser.AtEndOfFile()) {
-    if (!parser.ParseDeclaration()) {
-      // We don't have an enclosing parse tree node to mark as erroneous, so
-      // just mark the tree as a whole.
-      tree.has_errors_ = true;
+  parser.function_bodies_ = previous.function_bodies_;
+  parser.separators_ = previous.separators_;
+
+  // Find the innermost code block whose braces enclose the edit and still
+  // match each other, as opening braces come first.
+  int block = -1;
+  for (int i = 0; i != static_cast<int>(previous_nodes.size()); ++i) {
+    const NodeImpl& node = previous_nodes[i];
+    if ((node.kind() != ParseNodeKind::CodeBlock() &&
+         node.kind() != ParseNodeKind::SkippedCodeBlock()) ||
+        index_of(node.token()) >= edit.first_token ||
+        (block != -1 && node.token() < previous_nodes[block].token())) {
+      continue;
     }
+    TokenizedBuffer::Token close =
+        previous_tokens.GetMatchedClosingToken(node.token());
+    if (index_of(close) >= edit_end &&
+        tokens.GetMatchedClosingToken(node.token()) == shifted(close)) {
+      block = i;
+    }
+  }
+
+  if (block != -1) {
+    // Everything outside the code block stays as it was, except that its
+    // ancestors grow or shrink by as many nodes as it does.
+    const NodeImpl& block_node = previous_nodes[block];
+    int block_begin = block - block_node.subtree_size() + 1;
+    tree.node_impls_.append(previous_nodes.begin(),
+                            previous_nodes.begin() + block_begin);
+    parser.position_ = TokenizedBuffer::TokenIterator(block_node.token());
+    if (block_node.kind() == ParseNodeKind::SkippedCodeBlock()) {
+      parser.AddLeafNode(ParseNodeKind::SkippedCodeBlock(),
+                         *parser.position_);
+    } else {
+      parser.RunStates({.state = State::CodeBlock,
+                        .subtree_start = parser.GetSubtreeStartPosition()});
+    }
+    int node_delta = static_cast<int>(tree.node_impls_.size()) - block - 1;
+    parser.AppendPreviousNodes(previous_nodes.drop_front(block + 1),
+                               first_after_edit, token_delta);
+    for (int i = block + 1; i != static_cast<int>(previous_nodes.size());
+         ++i) {
+      if (i - previous_nodes[i].subtree_size() < block_begin) {
+        NodeImpl& ancestor = tree.node_impls_[i + node_delta];
+        ancestor.set_subtree_size(ancestor.subtree_size() + node_delta);
+      }
+    }
+    parser.FinishTree(NodeStorage::Reserved);
+    return tree;
+  }
+
+  // Otherwise parse the top-level declarations again. Only a function or
+  // variable declaration node is sure to be for the token its declaration
+  // started at.
+  struct Root {
+    int begin;
+    TokenizedBuffer::Token token;
+  };
+  llvm::SmallVector<Root> declaration_roots;
+  for (int i = static_cast<int>(previous_nodes.size()) - 1; i >= 0;
+       i -= previous_nodes[i].subtree_size()) {
+    if (previous_nodes[i].kind() == ParseNodeKind::FunctionDeclaration() ||
+        previous_nodes[i].kind() == ParseNodeKind::VariableDeclaration()) {
+      declaration_roots.push_back(
+          {.begin = i - previous_nodes[i].subtree_size() + 1,
+           .token = previous_nodes[i].token()});
+    }
+  }
+  std::reverse(declaration_roots.begin(), declaration_roots.end());
+  auto first_after = llvm::partition_point(declaration_roots, [&](Root root) {
+    return index_of(root.token) < edit.first_token;
+  });
+  if (first_after != declaration_roots.begin()) {
+    const Root& restart = *(first_after - 1);
+    tree.node_impls_.append(previous_nodes.begin(),
+                            previous_nodes.begin() + restart.begin);
+    parser.position_ = TokenizedBuffer::TokenIterator(restart.token);
   }
 
+  // As for parsing in parallel, parse until a declaration starts where one
+  // did before.
+  for (const Root& resync : llvm::make_range(first_after,
+                                             declaration_roots.end())) {
+    if (index_of(resync.token) < edit_end) {
+      continue;
+    }
+    TokenizedBuffer::TokenIterator resync_position(shifted(resync.token));
+    parser.ParseDeclarations(resync_position);
+    if (parser.position_ == resync_position) {
+      parser.AppendPreviousNodes(previous_nodes.drop_front(resync.begin),
+                                 first_after_edit, token_delta);
+      parser.FinishTree(NodeStorage::Reserved);
+      return tree;
+    }
+  }
+  parser.ParseDeclarations(parser.end_);
   parser.AddLeafNode(ParseNodeKind::FileEnd(), *parser.position_);
+  parser.FinishTree(NodeStorage::Reserved);
+  return tree;
+}
+
+auto ParseTree::Parser::AppendPreviousNodes(llvm::ArrayRef<NodeImpl> nodes,
+                                            TokenizedBuffer::Token shift_from,
+                                            int token_delta) -> void {
+  for (NodeImpl node : nodes) {
+    if (node.token() >= shift_from) {
+      node.set_token(
+          *(TokenizedBuffer::TokenIterator(node.token()) + token_delta));
+    }
+    CountNodeReallocation();
+    tree_.node_impls_.push_back(node);
+  }
+}
 
+auto ParseTree::Parser::ParseCodeBlock(TokenizedBuffer& tokens,
+                                       TokenDiagnosticEmitter& emitter,
+                                       TokenizedBuffer::Token open_curly,
+                                       Separators separators) -> ParseTree {
+  TokenizedBuffer::TokenIterator begin(open_curly);
+  TokenizedBuffer::TokenIterator end(tokens.GetMatchedClosingToken(open_curly));
+  ParseTree tree(tokens);
+  tree.separators_ = separators;
+  // Each node is for a distinct token of the code block.
+  Parser parser(tree, tokens, emitter, begin, end - begin + 1);
+  parser.separators_ = separators;
+  parser.RunStates({.state = State::CodeBlock,
+                    .subtree_start = parser.GetSubtreeStartPosition()});
   COCKTAIL_CHECK(tree.Verify()) << "Parse tree built but does not verify!";
   return tree;
 }
 
+auto ParseTree::Parser::ParseDeclarations(TokenizedBuffer::TokenIterator stop)
+    -> void {
+  while (position_ < stop && !AtEndOfFile()) {
+    // Only a tree with errors can have had diagnostics to stop after.
+    if (tree_.has_errors_ && emitter_.ShouldStop()) {
+      // The rest of the declarations are skipped rather than diagnosed.
+      position_ = stop == end_ ? std::prev(end_) : stop;
+      return;
+    }
+    if (cancellation_ != nullptr && cancellation_->cancelled()) {
+      tree_.cancelled_ = true;
+      position_ = stop == end_ ? std::prev(end_) : stop;
+      return;
+    }
+    if (!ParseDeclaration()) {
+      // We don't have an enclosing parse tree node to mark as erroneous, so
+      // just mark the tree as a whole.
+      tree_.has_errors_ = true;
+    }
+  }
+}
+
+auto ParseTree::Parser::FinishTree(NodeStorage node_storage,
+                                   TaskScheduler* scheduler) -> void {
+  // Node storage only grows while parsing, so its peak is what it is now.
+  tree_.parse_stats_.peak_node_storage_bytes = tree_.node_storage_bytes();
+  if (node_storage == NodeStorage::ShrinkToFit &&
+      tree_.node_impls_.size() != tree_.node_impls_.capacity()) {
+    // Copying a `SmallVector` allocates exactly as much as it needs. Any
+    // scratch space keeps the storage reserved up front for the next parse.
+    llvm::SmallVector<NodeImpl, 0> fitted(tree_.node_impls_.begin(),
+                                          tree_.node_impls_.end());
+    if (scratch_) {
+      scratch_->node_storage = std::move(tree_.node_impls_);
+    }
+    tree_.node_impls_ = std::move(fitted);
+  }
+  tree_.parse_stats_.final_node_storage_bytes = tree_.node_storage_bytes();
+
+  bool verified = false;
+  if (scheduler) {
+    verified = tree_.Verify(*scheduler);
+  } else if (scratch_) {
+    verified = tree_.VerifyNodes(0, tree_.size(), llvm::errs(),
+                                 scratch_->verify_ancestors);
+  } else {
+    verified = tree_.Verify();
+  }
+  COCKTAIL_CHECK(verified) << "Parse tree built but does not verify!";
+}
+
 auto ParseTree::Parser::Consume(TokenKind kind) -> TokenizedBuffer::Token {
-  COCKTAIL_CHECK(kind != TokenKind::EndOfFile()) << "Cannot consume the EOF token!";
-  COCKTAIL_CHECK(NextTokenIs(kind)) << "The current token is the wrong kind!";
+  COCKTAIL_DCHECK(kind != TokenKind::EndOfFile())
+      << "Cannot consume the EOF token!";
+  COCKTAIL_DCHECK(NextTokenIs(kind)) << "The current token is the wrong kind!";
   TokenizedBuffer::Token t = *position_;
   ++position_;
-  COCKTAIL_CHECK(position_ != end_)
+  COCKTAIL_DCHECK(position_ != end_)
       << "Reached end of tokens without finding EOF token.";
   return t;
 }
@@ -125,6 +439,7 @@ auto ParseTree::Parser::ConsumeIf(TokenKind kind)
 auto ParseTree::Parser::AddLeafNode(ParseNodeKind kind,
                                     TokenizedBuffer::Token token) -> Node {
   Node n(tree_.node_impls_.size());
+  CountNodeReallocation();
   tree_.node_impls_.push_back(NodeImpl(kind, token, /*subtree_size_arg=*/1));
   return n;
 }
@@ -141,18 +456,10 @@ auto ParseTree::Parser::ConsumeAndAddLeafNodeIf(TokenKind t_kind,
 }
 
 auto ParseTree::Parser::MarkNodeError(Node n) -> void {
-  tree_.node_impls_[n.index_].has_error = true;
+  tree_.node_impls_[n.index_].set_has_error();
   tree_.has_errors_ = true;
 }
 
-// A marker for the start of a node's subtree.
-//
-// This is used to track the size of the node's subtree. It can be used
-// repeatedly if multiple subtrees start at the same position.
-struct ParseTree::Parser::SubtreeStart {
-  int tree_size;
-};
-
 auto ParseTree::Parser::GetSubtreeStartPosition() -> SubtreeStart {
   return {static_cast<int>(tree_.node_impls_.size())};
 }
@@ -165,6 +472,7 @@ auto ParseTree::Parser::AddNode(ParseNodeKind n_kind, TokenizedBuffer::Token t,
   int subtree_size = tree_stop_size - start.tree_size;
 
   Node n(tree_.node_impls_.size());
+  CountNodeReallocation();
   tree_.node_impls_.push_back(NodeImpl(n_kind, t, subtree_size));
   if (has_error) {
     MarkNodeError(n);
@@ -186,19 +494,35 @@ auto ParseTree::Parser::SkipMatchingGroup() -> bool {
 }
 
 auto ParseTree::Parser::SkipTo(TokenizedBuffer::Token t) -> void {
-  COCKTAIL_CHECK(t >= *position_) << "Tried to skip backwards.";
+  COCKTAIL_DCHECK(t >= *position_) << "Tried to skip backwards.";
   position_ = TokenizedBuffer::TokenIterator(t);
-  COCKTAIL_CHECK(position_ != end_) << "Skipped past EOF.";
+  COCKTAIL_DCHECK(position_ != end_) << "Skipped past EOF.";
 }
 
-auto ParseTree::Parser::FindNextOf(
-    std::initializer_list<TokenKind> desired_kinds)
+// The tokens that start or end a bracketing level, along with the end of the
+// file, which ends every level.
+static constexpr TokenKindSet BracketingKinds = {
+#define COCKTAIL_OPENING_GROUP_SYMBOL_TOKEN(Name, Spelling, ClosingName) \
+  TokenKind::Name(),
+#define COCKTAIL_CLOSING_GROUP_SYMBOL_TOKEN(Name, Spelling, OpeningName) \
+  TokenKind::Name(),
+#include "Cocktail/Lexer/TokenRegistry.def"
+    TokenKind::EndOfFile()};
+
+auto ParseTree::Parser::FindNextOf(const TokenKindSet& desired_kinds)
     -> llvm::Optional<TokenizedBuffer::Token> {
+  // Only the desired kinds and the kinds that change the bracketing level
+  // need a closer look, so everything else is skipped in bulk.
+  TokenKindSet stop_kinds = desired_kinds | BracketingKinds;
   auto new_position = position_;
   while (true) {
+    new_position = tokens_.FindNextKindIn(*new_position, stop_kinds);
+    if (new_position == tokens_.tokens().end()) {
+      return llvm::None;
+    }
     TokenizedBuffer::Token token = *new_position;
     TokenKind kind = tokens_.GetKind(token);
-    if (kind.IsOneOf(desired_kinds)) {
+    if (desired_kinds.Contains(kind)) {
       return token;
     }
 
@@ -206,14 +530,11 @@ auto ParseTree::Parser::FindNextOf(
     if (kind.IsClosingSymbol() || kind == TokenKind::EndOfFile()) {
       // There are no more tokens at this level.
       return llvm::None;
-    } else if (kind.IsOpeningSymbol()) {
-      new_position =
-          TokenizedBuffer::TokenIterator(tokens_.GetMatchedClosingToken(token));
-      // Advance past the closing token.
-      ++new_position;
-    } else {
-      ++new_position;
     }
+    new_position =
+        TokenizedBuffer::TokenIterator(tokens_.GetMatchedClosingToken(token));
+    // Advance past the closing token.
+    ++new_position;
   }
 }
 
@@ -281,114 +602,17 @@ auto ParseTree::Parser::ParseCloseParen(TokenizedBuffer::Token open_paren,
   return llvm::None;
 }
 
-template <typename ListElementParser, typename ListCompletionHandler>
-auto ParseTree::Parser::ParseList(TokenKind open, TokenKind close,
-                                  ListElementParser list_element_parser,
-                                  ParseNodeKind comma_kind,
-                                  ListCompletionHandler list_handler,
-                                  bool allow_trailing_comma)
-    -> llvm::Optional<Node> {
-  // `(` element-list[opt] `)`
-  //
-  // element-list ::= element
-  //              ::= element `,` element-list
-  TokenizedBuffer::Token open_paren = Consume(open);
-
-  bool has_errors = false;
-  bool any_commas = false;
-  int64_t num_elements = 0;
-
-  // Parse elements, if any are specified.
-  if (!NextTokenIs(close)) {
-    while (true) {
-      bool element_error = !list_element_parser();
-      has_errors |= element_error;
-      ++num_elements;
-
-      if (!NextTokenIsOneOf({close, TokenKind::Comma()})) {
-        if (!element_error) {
-          COCKTAIL_DIAGNOSTIC(UnexpectedTokenAfterListElement, Error,
-                            "Expected `,` or `{0}`.", TokenKind);
-          emitter_.Emit(*position_, UnexpectedTokenAfterListElement, close);
-        }
-        has_errors = true;
-
-        auto end_of_element = FindNextOf({TokenKind::Comma(), close});
-        // The lexer guarantees that parentheses are balanced.
-        COCKTAIL_CHECK(end_of_element) << "missing matching `)` for `(`";
-        SkipTo(*end_of_element);
-      }
-
-      if (NextTokenIs(close)) {
-        break;
-      }
-
-      AddLeafNode(comma_kind, Consume(TokenKind::Comma()));
-      any_commas = true;
-
-      if (allow_trailing_comma && NextTokenIs(close)) {
-        break;
-      }
-    }
-  }
-
-  bool is_single_item = num_elements == 1 && !any_commas;
-  return list_handler(open_paren, is_single_item, Consume(close), has_errors);
-}
-
-auto ParseTree::Parser::ParsePattern(PatternKind kind) -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  if (NextTokenIs(TokenKind::Identifier()) &&
-      tokens_.GetKind(*(position_ + 1)) == TokenKind::Colon()) {
-    // identifier `:` type
-    auto start = GetSubtreeStartPosition();
-    AddLeafNode(ParseNodeKind::DeclaredName(),
-                Consume(TokenKind::Identifier()));
-    auto colon = Consume(TokenKind::Colon());
-    auto type = ParseType();
-    return AddNode(ParseNodeKind::PatternBinding(), colon, start,
-                   /*has_error=*/!type);
-  }
-
-  switch (kind) {
-    case PatternKind::Parameter:
-      COCKTAIL_DIAGNOSTIC(ExpectedParameterName, Error,
-                        "Expected parameter declaration.");
-      emitter_.Emit(*position_, ExpectedParameterName);
-      break;
-
-    case PatternKind::Variable:
-      COCKTAIL_DIAGNOSTIC(ExpectedVariableName, Error,
-                        "Expected pattern in `var` declaration.");
-      emitter_.Emit(*position_, ExpectedVariableName);
-      break;
-  }
-
-  return llvm::None;
-}
-
-auto ParseTree::Parser::ParseFunctionParameter() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  return ParsePattern(PatternKind::Parameter);
-}
-
 auto ParseTree::Parser::ParseFunctionSignature() -> bool {
-  RETURN_IF_STACK_LIMITED(false);
-  auto start = GetSubtreeStartPosition();
-
-  auto params = ParseParenList(
-      [&] { return ParseFunctionParameter(); },
-      ParseNodeKind::ParameterListComma(),
-      [&](TokenizedBuffer::Token open_paren, bool /*is_single_item*/,
-          TokenizedBuffer::Token close_paren, bool has_errors) {
-        AddLeafNode(ParseNodeKind::ParameterListEnd(), close_paren);
-        return AddNode(ParseNodeKind::ParameterList(), open_paren, start,
-                       has_errors);
-      });
+  bool params = RunStates({.state = State::List,
+                           .list_kind = ListKind::ParameterList,
+                           .subtree_start = GetSubtreeStartPosition()});
 
   auto start_return_type = GetSubtreeStartPosition();
   if (auto arrow = ConsumeIf(TokenKind::MinusGreater())) {
-    auto return_type = ParseType();
+    bool return_type =
+        RunStates({.state = State::OperatorExpression,
+                   .ambient_precedence = PrecedenceGroup::ForType(),
+                   .subtree_start = GetSubtreeStartPosition()});
     AddNode(ParseNodeKind::ReturnType(), *arrow, start_return_type,
             /*has_error=*/!return_type);
     if (!return_type) {
@@ -396,44 +620,7 @@ auto ParseTree::Parser::ParseFunctionSignature() -> bool {
     }
   }
 
-  return params.hasValue();
-}
-
-auto ParseTree::Parser::ParseCodeBlock() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  llvm::Optional<TokenizedBuffer::Token> maybe_open_curly =
-      ConsumeIf(TokenKind::OpenCurlyBrace());
-  if (!maybe_open_curly) {
-    // Recover by parsing a single statement.
-    COCKTAIL_DIAGNOSTIC(ExpectedCodeBlock, Error, "Expected braced code block.");
-    emitter_.Emit(*position_, ExpectedCodeBlock);
-    return ParseStatement();
-  }
-  TokenizedBuffer::Token open_curly = *maybe_open_curly;
-
-  auto start = GetSubtreeStartPosition();
-
-  bool has_errors = false;
-
-  // Loop over all the different possibly nested elements in the code block.
-  while (!NextTokenIs(TokenKind::CloseCurlyBrace())) {
-    if (!ParseStatement()) {
-      // We detected and diagnosed an error of some kind. We can trivially skip
-      // to the actual close curly brace from here.
-      // FIXME: It would be better to skip to the next semicolon, or the next
-      // token at the start of a line with the same indent as this one.
-      SkipTo(tokens_.GetMatchedClosingToken(open_curly));
-      has_errors = true;
-      break;
-    }
-  }
-
-  // We always reach here having set our position in the token stream to the
-  // close curly brace.
-  AddLeafNode(ParseNodeKind::CodeBlockEnd(),
-              Consume(TokenKind::CloseCurlyBrace()));
-
-  return AddNode(ParseNodeKind::CodeBlock(), open_curly, start, has_errors);
+  return params;
 }
 
 auto ParseTree::Parser::ParseFunctionDeclaration() -> Node {
@@ -444,7 +631,6 @@ auto ParseTree::Parser::ParseFunctionDeclaration() -> Node {
     return AddNode(ParseNodeKind::FunctionDeclaration(), function_intro_token,
                    start, /*has_error=*/true);
   };
-  RETURN_IF_STACK_LIMITED(add_error_function_node());
 
   auto handle_semi_in_error_recovery = [&](TokenizedBuffer::Token semi) {
     return AddLeafNode(ParseNodeKind::DeclarationEnd(), semi);
@@ -483,7 +669,12 @@ auto ParseTree::Parser::ParseFunctionDeclaration() -> Node {
 
   // See if we should parse a definition which is represented as a code block.
   if (NextTokenIs(TokenKind::OpenCurlyBrace())) {
-    if (!ParseCodeBlock()) {
+    if (function_bodies_ == FunctionBodies::Skipped) {
+      // The body is only parsed if `ParseSkippedCodeBlock` is asked to.
+      AddLeafNode(ParseNodeKind::SkippedCodeBlock(), *position_);
+      SkipMatchingGroup();
+    } else if (!RunStates({.state = State::CodeBlock,
+                           .subtree_start = GetSubtreeStartPosition()})) {
       return add_error_function_node();
     }
   } else if (!ConsumeAndAddLeafNodeIf(TokenKind::Semi(),
@@ -504,59 +695,24 @@ auto ParseTree::Parser::ParseFunctionDeclaration() -> Node {
                  start);
 }
 
-auto ParseTree::Parser::ParseVariableDeclaration() -> Node {
-  // `var` pattern [= expression] `;`
-  TokenizedBuffer::Token var_token = Consume(TokenKind::Var());
-  auto start = GetSubtreeStartPosition();
-
-  RETURN_IF_STACK_LIMITED(AddNode(ParseNodeKind::VariableDeclaration(),
-                                  var_token, start,
-                                  /*has_error=*/true));
-
-  auto pattern = ParsePattern(PatternKind::Variable);
-  if (!pattern) {
-    if (auto after_pattern =
-            FindNextOf({TokenKind::Equal(), TokenKind::Semi()})) {
-      SkipTo(*after_pattern);
-    }
-  }
-
-  auto start_init = GetSubtreeStartPosition();
-  if (auto equal_token = ConsumeIf(TokenKind::Equal())) {
-    auto init = ParseExpression();
-    AddNode(ParseNodeKind::VariableInitializer(), *equal_token, start_init,
-            /*has_error=*/!init);
-  }
-
-  auto semi = ConsumeAndAddLeafNodeIf(TokenKind::Semi(),
-                                      ParseNodeKind::DeclarationEnd());
-  if (!semi) {
-    emitter_.Emit(*position_, ExpectedSemiAfterExpression);
-    SkipPastLikelyEnd(var_token, [&](TokenizedBuffer::Token semi) {
-      return AddLeafNode(ParseNodeKind::DeclarationEnd(), semi);
-    });
-  }
-
-  return AddNode(ParseNodeKind::VariableDeclaration(), var_token, start,
-                 /*has_error=*/!pattern || !semi);
-}
-
 auto ParseTree::Parser::ParseEmptyDeclaration() -> Node {
   return AddLeafNode(ParseNodeKind::EmptyDeclaration(),
                      Consume(TokenKind::Semi()));
 }
 
-auto ParseTree::Parser::ParseDeclaration() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
+auto ParseTree::Parser::ParseDeclaration() -> bool {
   switch (NextTokenKind()) {
     case TokenKind::Fn():
-      return ParseFunctionDeclaration();
+      ParseFunctionDeclaration();
+      return true;
     case TokenKind::Var():
-      return ParseVariableDeclaration();
+      return RunStates({.state = State::VariableDeclaration,
+                        .subtree_start = GetSubtreeStartPosition()});
     case TokenKind::Semi():
-      return ParseEmptyDeclaration();
+      ParseEmptyDeclaration();
+      return true;
     case TokenKind::EndOfFile():
-      return llvm::None;
+      return false;
     default:
       // Errors are handled outside the switch.
       break;
@@ -574,146 +730,11 @@ auto ParseTree::Parser::ParseDeclaration() -> llvm::Optional<Node> {
             return AddLeafNode(ParseNodeKind::EmptyDeclaration(), semi);
           })) {
     MarkNodeError(*found_semi_n);
-    return *found_semi_n;
+    return true;
   }
 
   // Nothing, not even a semicolon found.
-  return llvm::None;
-}
-
-auto ParseTree::Parser::ParseParenExpression() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  // parenthesized-expression ::= `(` expression `)`
-  // tuple-literal ::= `(` `)`
-  //               ::= `(` expression `,` [expression-list [`,`]] `)`
-  //
-  // Parse the union of these, `(` [expression-list [`,`]] `)`, and work out
-  // whether it's a tuple or a parenthesized expression afterwards.
-  auto start = GetSubtreeStartPosition();
-  return ParseParenList(
-      [&] { return ParseExpression(); }, ParseNodeKind::TupleLiteralComma(),
-      [&](TokenizedBuffer::Token open_paren, bool is_single_item,
-          TokenizedBuffer::Token close_paren, bool has_arg_errors) {
-        AddLeafNode(is_single_item ? ParseNodeKind::ParenExpressionEnd()
-                                   : ParseNodeKind::TupleLiteralEnd(),
-                    close_paren);
-        return AddNode(is_single_item ? ParseNodeKind::ParenExpression()
-                                      : ParseNodeKind::TupleLiteral(),
-                       open_paren, start, has_arg_errors);
-      },
-      /*allow_trailing_comma=*/true);
-}
-
-auto ParseTree::Parser::ParseBraceExpression() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  // braced-expression ::= `{` [field-value-list] `}`
-  //                   ::= `{` field-type-list `}`
-  // field-value-list ::= field-value [`,`]
-  //                  ::= field-value `,` field-value-list
-  // field-value ::= `.` identifier `=` expression
-  // field-type-list ::= field-type [`,`]
-  //                 ::= field-type `,` field-type-list
-  // field-type ::= `.` identifier `:` type
-  //
-  // Note that `{` `}` is the first form (an empty struct), but that an empty
-  // struct value also behaves as an empty struct type.
-  auto start = GetSubtreeStartPosition();
-  enum Kind { Unknown, Value, Type };
-  Kind kind = Unknown;
-  return ParseList(
-      TokenKind::OpenCurlyBrace(), TokenKind::CloseCurlyBrace(),
-      [&]() -> llvm::Optional<Node> {
-        auto start_elem = GetSubtreeStartPosition();
-
-        auto diagnose_invalid_syntax = [&] {
-          COCKTAIL_DIAGNOSTIC(ExpectedStructLiteralField, Error,
-                            "Expected {0}{1}{2}.", llvm::StringRef,
-                            llvm::StringRef, llvm::StringRef);
-          bool can_be_type = kind != Value;
-          bool can_be_value = kind != Type;
-          emitter_.Emit(*position_, ExpectedStructLiteralField,
-                        can_be_type ? "`.field: type`" : "",
-                        (can_be_type && can_be_value) ? " or " : "",
-                        can_be_value ? "`.field = value`" : "");
-          return llvm::None;
-        };
-
-        if (!NextTokenIs(TokenKind::Period())) {
-          return diagnose_invalid_syntax();
-        }
-        auto designator = ParseDesignatorExpression(
-            start_elem, ParseNodeKind::StructFieldDesignator(),
-            /*has_errors=*/false);
-        if (!designator) {
-          auto recovery_pos = FindNextOf(
-              {TokenKind::Equal(), TokenKind::Colon(), TokenKind::Comma()});
-          if (!recovery_pos ||
-              tokens_.GetKind(*recovery_pos) == TokenKind::Comma()) {
-            return llvm::None;
-          }
-          SkipTo(*recovery_pos);
-        }
-
-        // Work out the kind of this element
-        Kind elem_kind = (NextTokenIs(TokenKind::Equal())   ? Value
-                          : NextTokenIs(TokenKind::Colon()) ? Type
-                                                            : Unknown);
-        if (elem_kind == Unknown || (kind != Unknown && elem_kind != kind)) {
-          return diagnose_invalid_syntax();
-        }
-        kind = elem_kind;
-
-        // Struct type fields and value fields use the same grammar except that
-        // one has a `:` separator and the other has an `=` separator.
-        auto equal_or_colon_token =
-            Consume(kind == Type ? TokenKind::Colon() : TokenKind::Equal());
-        auto type_or_value = ParseExpression();
-        return AddNode(kind == Type ? ParseNodeKind::StructFieldType()
-                                    : ParseNodeKind::StructFieldValue(),
-                       equal_or_colon_token, start_elem,
-                       /*has_error=*/!designator || !type_or_value);
-      },
-      ParseNodeKind::StructComma(),
-      [&](TokenizedBuffer::Token open_brace, bool /*is_single_item*/,
-          TokenizedBuffer::Token close_brace, bool has_errors) {
-        AddLeafNode(ParseNodeKind::StructEnd(), close_brace);
-        return AddNode(kind == Type ? ParseNodeKind::StructTypeLiteral()
-                                    : ParseNodeKind::StructLiteral(),
-                       open_brace, start, has_errors);
-      },
-      /*allow_trailing_comma=*/true);
-}
-
-auto ParseTree::Parser::ParsePrimaryExpression() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  llvm::Optional<ParseNodeKind> kind;
-  switch (NextTokenKind()) {
-    case TokenKind::Identifier():
-      kind = ParseNodeKind::NameReference();
-      break;
-
-    case TokenKind::IntegerLiteral():
-    case TokenKind::RealLiteral():
-    case TokenKind::StringLiteral():
-    case TokenKind::IntegerTypeLiteral():
-    case TokenKind::UnsignedIntegerTypeLiteral():
-    case TokenKind::FloatingPointTypeLiteral():
-      kind = ParseNodeKind::Literal();
-      break;
-
-    case TokenKind::OpenParen():
-      return ParseParenExpression();
-
-    case TokenKind::OpenCurlyBrace():
-      return ParseBraceExpression();
-
-    default:
-      COCKTAIL_DIAGNOSTIC(ExpectedExpression, Error, "Expected expression.");
-      emitter_.Emit(*position_, ExpectedExpression);
-      return llvm::None;
-  }
-
-  return AddLeafNode(*kind, Consume(NextTokenKind()));
+  return false;
 }
 
 auto ParseTree::Parser::ParseDesignatorExpression(SubtreeStart start,
@@ -744,77 +765,36 @@ auto ParseTree::Parser::ParseDesignatorExpression(SubtreeStart start,
   return name ? result : llvm::Optional<Node>();
 }
 
-auto ParseTree::Parser::ParseCallExpression(SubtreeStart start, bool has_errors)
-    -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  // `(` expression-list[opt] `)`
-  //
-  // expression-list ::= expression
-  //                 ::= expression `,` expression-list
-  return ParseParenList(
-      [&] { return ParseExpression(); }, ParseNodeKind::CallExpressionComma(),
-      [&](TokenizedBuffer::Token open_paren, bool /*is_single_item*/,
-          TokenizedBuffer::Token close_paren, bool has_arg_errors) {
-        AddLeafNode(ParseNodeKind::CallExpressionEnd(), close_paren);
-        return AddNode(ParseNodeKind::CallExpression(), open_paren, start,
-                       has_errors || has_arg_errors);
-      });
+// Determines whether the given token is considered to be the start of an
+// operand according to the rules for infix operator parsing.
+static auto IsAssumedStartOfOperand(TokenKind kind) -> bool {
+  static constexpr TokenKindSet Kinds = {
+      TokenKind::OpenParen(), TokenKind::Identifier(),
+      TokenKind::IntegerLiteral(), TokenKind::RealLiteral(),
+      TokenKind::StringLiteral()};
+  return Kinds.Contains(kind);
 }
 
-auto ParseTree::Parser::ParsePostfixExpression() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  auto start = GetSubtreeStartPosition();
-  llvm::Optional<Node> expression = ParsePrimaryExpression();
-
-  TokenizedBuffer::TokenIterator last_position = position_;
-  while (true) {
-    switch (NextTokenKind()) {
-      case TokenKind::Period():
-        expression = ParseDesignatorExpression(
-            start, ParseNodeKind::DesignatorExpression(), !expression);
-        break;
-
-      case TokenKind::OpenParen():
-        expression = ParseCallExpression(start, !expression);
-        break;
-
-      default:
-        return expression;
-    }
-    // This is subject to an infinite loop if a child call fails, so monitor for
-    // stalling.
-    if (last_position == position_) {
-      COCKTAIL_CHECK(expression == llvm::None);
-      return expression;
-    }
-    last_position = position_;
-  }
-}
-
-// Determines whether the given token is considered to be the start of an
-// operand according to the rules for infix operator parsing.
-static auto IsAssumedStartOfOperand(TokenKind kind) -> bool {
-  return kind.IsOneOf({TokenKind::OpenParen(), TokenKind::Identifier(),
-                       TokenKind::IntegerLiteral(), TokenKind::RealLiteral(),
-                       TokenKind::StringLiteral()});
-}
-
-// Determines whether the given token is considered to be the end of an operand
-// according to the rules for infix operator parsing.
-static auto IsAssumedEndOfOperand(TokenKind kind) -> bool {
-  return kind.IsOneOf({TokenKind::CloseParen(), TokenKind::CloseCurlyBrace(),
-                       TokenKind::CloseSquareBracket(), TokenKind::Identifier(),
-                       TokenKind::IntegerLiteral(), TokenKind::RealLiteral(),
-                       TokenKind::StringLiteral()});
-}
+// Determines whether the given token is considered to be the end of an operand
+// according to the rules for infix operator parsing.
+static auto IsAssumedEndOfOperand(TokenKind kind) -> bool {
+  static constexpr TokenKindSet Kinds = {
+      TokenKind::CloseParen(),         TokenKind::CloseCurlyBrace(),
+      TokenKind::CloseSquareBracket(), TokenKind::Identifier(),
+      TokenKind::IntegerLiteral(),     TokenKind::RealLiteral(),
+      TokenKind::StringLiteral()};
+  return Kinds.Contains(kind);
+}
 
 // Determines whether the given token could possibly be the start of an operand.
 // This is conservatively correct, and will never incorrectly return `false`,
 // but can incorrectly return `true`.
 static auto IsPossibleStartOfOperand(TokenKind kind) -> bool {
-  return !kind.IsOneOf({TokenKind::CloseParen(), TokenKind::CloseCurlyBrace(),
-                        TokenKind::CloseSquareBracket(), TokenKind::Comma(),
-                        TokenKind::Semi(), TokenKind::Colon()});
+  static constexpr TokenKindSet Kinds = {
+      TokenKind::CloseParen(),         TokenKind::CloseCurlyBrace(),
+      TokenKind::CloseSquareBracket(), TokenKind::Comma(),
+      TokenKind::Semi(),               TokenKind::Colon()};
+  return !Kinds.Contains(kind);
 }
 
 auto ParseTree::Parser::IsLexicallyValidInfixOperator() -> bool {
@@ -912,235 +892,813 @@ auto ParseTree::Parser::IsTrailingOperatorInfix() -> bool {
   return false;
 }
 
-auto ParseTree::Parser::ParseOperatorExpression(
-    PrecedenceGroup ambient_precedence) -> llvm::Optional<Node> {
-  // May be omitted a couple different ways here.
-  COCKTAIL_DIAGNOSTIC(
-      OperatorRequiresParentheses, Error,
-      "Parentheses are required to disambiguate operator precedence.");
 
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  auto start = GetSubtreeStartPosition();
+auto ParseTree::Parser::RunStates(StateStackEntry entry) -> bool {
+  int base_size = state_stack_.size();
+  PushState(entry);
+  while (static_cast<int>(state_stack_.size()) > base_size) {
+    switch (state_stack_.back().state) {
+#define COCKTAIL_PARSER_STATE(Name) \
+  case State::Name:                 \
+    Handle##Name##State();          \
+    break;
+      COCKTAIL_PARSER_STATE(CodeBlock)
+      COCKTAIL_PARSER_STATE(CodeBlockAfterStatement)
+      COCKTAIL_PARSER_STATE(Statement)
+      COCKTAIL_PARSER_STATE(VariableDeclaration)
+      COCKTAIL_PARSER_STATE(VariableDeclarationAfterPattern)
+      COCKTAIL_PARSER_STATE(VariableDeclarationFinish)
+      COCKTAIL_PARSER_STATE(VariableInitializerFinish)
+      COCKTAIL_PARSER_STATE(IfStatement)
+      COCKTAIL_PARSER_STATE(IfStatementAfterCondition)
+      COCKTAIL_PARSER_STATE(IfStatementAfterThen)
+      COCKTAIL_PARSER_STATE(IfStatementAfterElse)
+      COCKTAIL_PARSER_STATE(WhileStatement)
+      COCKTAIL_PARSER_STATE(WhileStatementAfterCondition)
+      COCKTAIL_PARSER_STATE(WhileStatementAfterBody)
+      COCKTAIL_PARSER_STATE(KeywordStatement)
+      COCKTAIL_PARSER_STATE(KeywordStatementAfterArgument)
+      COCKTAIL_PARSER_STATE(ExpressionStatement)
+      COCKTAIL_PARSER_STATE(ExpressionStatementAfterExpression)
+      COCKTAIL_PARSER_STATE(ParenConditionAfterExpression)
+      COCKTAIL_PARSER_STATE(Pattern)
+      COCKTAIL_PARSER_STATE(PatternAfterType)
+      COCKTAIL_PARSER_STATE(OperatorExpression)
+      COCKTAIL_PARSER_STATE(OperatorExpressionAfterPrefix)
+      COCKTAIL_PARSER_STATE(OperatorExpressionAfterInfix)
+      COCKTAIL_PARSER_STATE(PostfixExpressionAfterPrimary)
+      COCKTAIL_PARSER_STATE(PostfixExpressionAfterCall)
+      COCKTAIL_PARSER_STATE(List)
+      COCKTAIL_PARSER_STATE(ListAfterElement)
+      COCKTAIL_PARSER_STATE(StructFieldFinish)
+#undef COCKTAIL_PARSER_STATE
+    }
+  }
+  return state_result_;
+}
 
-  llvm::Optional<Node> lhs;
-  PrecedenceGroup lhs_precedence = PrecedenceGroup::ForPostfixExpression();
+auto ParseTree::Parser::HandleCodeBlockState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  llvm::Optional<TokenizedBuffer::Token> maybe_open_curly =
+      ConsumeIf(TokenKind::OpenCurlyBrace());
+  if (!maybe_open_curly) {
+    // Recover by parsing a single statement.
+    COCKTAIL_DIAGNOSTIC(ExpectedCodeBlock, Error,
+                        "Expected braced code block.");
+    emitter_.Emit(*position_, ExpectedCodeBlock);
+    entry.state = State::Statement;
+    return;
+  }
+  entry.token = *maybe_open_curly;
+  ContinueCodeBlock();
+}
 
-  // Check for a prefix operator.
-  if (auto operator_precedence = PrecedenceGroup::ForLeading(NextTokenKind());
-      !operator_precedence) {
-    lhs = ParsePostfixExpression();
-  } else {
-    if (PrecedenceGroup::GetPriority(ambient_precedence,
-                                     *operator_precedence) !=
-        OperatorPriority::RightFirst) {
-      // The precedence rules don't permit this prefix operator in this
-      // context. Diagnose this, but carry on and parse it anyway.
-      emitter_.Emit(*position_, OperatorRequiresParentheses);
-    } else {
-      // Check that this operator follows the proper whitespace rules.
-      DiagnoseOperatorFixity(OperatorFixity::Prefix);
+auto ParseTree::Parser::ContinueCodeBlock() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  // Parse the next of the possibly nested elements in the code block.
+  if (!NextTokenIs(TokenKind::CloseCurlyBrace())) {
+    entry.state = State::CodeBlockAfterStatement;
+    PushState(State::Statement);
+    return;
+  }
+
+  // We always reach here having set our position in the token stream to the
+  // close curly brace.
+  AddLeafNode(ParseNodeKind::CodeBlockEnd(),
+              Consume(TokenKind::CloseCurlyBrace()));
+  AddNode(ParseNodeKind::CodeBlock(), entry.token, entry.subtree_start,
+          entry.has_error);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::HandleCodeBlockAfterStatementState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  if (!state_result_) {
+    // We detected and diagnosed an error of some kind. We can trivially skip
+    // to the actual close curly brace from here.
+    // FIXME: It would be better to skip to the next semicolon, or the next
+    // token at the start of a line with the same indent as this one.
+    SkipTo(tokens_.GetMatchedClosingToken(entry.token));
+    entry.has_error = true;
+  }
+  ContinueCodeBlock();
+}
+
+auto ParseTree::Parser::HandleStatementState() -> void {
+  // The statement's own state is replaced by that of the kind of statement.
+  State& state = state_stack_.back().state;
+  switch (NextTokenKind()) {
+    case TokenKind::Var():
+      state = State::VariableDeclaration;
+      break;
+
+    case TokenKind::If():
+      state = State::IfStatement;
+      break;
+
+    case TokenKind::While():
+      state = State::WhileStatement;
+      break;
+
+    case TokenKind::Continue():
+    case TokenKind::Break():
+    case TokenKind::Return():
+      state = State::KeywordStatement;
+      break;
+
+    default:
+      // A statement with no introducer token can only be an expression
+      // statement.
+      state = State::ExpressionStatement;
+      break;
+  }
+}
+
+auto ParseTree::Parser::HandleVariableDeclarationState() -> void {
+  // `var` pattern [= expression] `;`
+  StateStackEntry& entry = state_stack_.back();
+  entry.token = Consume(TokenKind::Var());
+  entry.state = State::VariableDeclarationAfterPattern;
+  PushState({.state = State::Pattern,
+             .pattern_kind = PatternKind::Variable,
+             .subtree_start = GetSubtreeStartPosition()});
+}
+
+auto ParseTree::Parser::HandleVariableDeclarationAfterPatternState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  if (!state_result_) {
+    entry.has_error = true;
+    if (auto after_pattern =
+            FindNextOf({TokenKind::Equal(), TokenKind::Semi()})) {
+      SkipTo(*after_pattern);
     }
+  }
+
+  auto start_init = GetSubtreeStartPosition();
+  if (auto equal_token = ConsumeIf(TokenKind::Equal())) {
+    entry.state = State::VariableDeclarationFinish;
+    PushState({.state = State::VariableInitializerFinish,
+               .token = *equal_token,
+               .subtree_start = start_init});
+    PushExpressionState(PrecedenceGroup::ForTopLevelExpression());
+    return;
+  }
+
+  HandleVariableDeclarationFinishState();
+}
+
+auto ParseTree::Parser::HandleVariableInitializerFinishState() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  AddNode(ParseNodeKind::VariableInitializer(), entry.token,
+          entry.subtree_start, /*has_error=*/!state_result_);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::HandleVariableDeclarationFinishState() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  auto semi = ConsumeAndAddLeafNodeIf(TokenKind::Semi(),
+                                      ParseNodeKind::DeclarationEnd());
+  if (!semi) {
+    emitter_.Emit(*position_, ExpectedSemiAfterExpression);
+    SkipPastLikelyEnd(entry.token, [&](TokenizedBuffer::Token semi) {
+      return AddLeafNode(ParseNodeKind::DeclarationEnd(), semi);
+    });
+  }
+
+  AddNode(ParseNodeKind::VariableDeclaration(), entry.token,
+          entry.subtree_start, /*has_error=*/entry.has_error || !semi);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::StartParenCondition(TokenKind introducer) -> void {
+  // `(` expression `)`
+  StateStackEntry entry = {.state = State::ParenConditionAfterExpression,
+                           .subtree_start = GetSubtreeStartPosition()};
+  if (auto open_paren = ConsumeIf(TokenKind::OpenParen())) {
+    entry.token = *open_paren;
+  } else {
+    COCKTAIL_DIAGNOSTIC(ExpectedParenAfter, Error, "Expected `(` after `{0}`.",
+                      TokenKind);
+    emitter_.Emit(*position_, ExpectedParenAfter, introducer);
+    entry.has_error = true;
+  }
+  PushState(entry);
+  PushExpressionState(PrecedenceGroup::ForTopLevelExpression());
+}
+
+auto ParseTree::Parser::HandleParenConditionAfterExpressionState() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  if (entry.has_error) {
+    // Don't expect a matching closing paren if there wasn't an opening paren.
+    ReturnState(false);
+    return;
+  }
+
+  bool expr = state_result_;
+  auto close_paren =
+      ParseCloseParen(entry.token, ParseNodeKind::ConditionEnd());
+
+  AddNode(ParseNodeKind::Condition(), entry.token, entry.subtree_start,
+          /*has_error=*/!expr || !close_paren);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::HandleIfStatementState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  entry.token = Consume(TokenKind::If());
+  entry.state = State::IfStatementAfterCondition;
+  StartParenCondition(TokenKind::If());
+}
+
+auto ParseTree::Parser::HandleIfStatementAfterConditionState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  entry.has_error = !state_result_;
+  entry.state = State::IfStatementAfterThen;
+  PushState(State::CodeBlock);
+}
+
+auto ParseTree::Parser::HandleIfStatementAfterThenState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  entry.has_error |= !state_result_;
+  if (ConsumeAndAddLeafNodeIf(TokenKind::Else(),
+                              ParseNodeKind::IfStatementElse())) {
+    entry.state = State::IfStatementAfterElse;
+    // 'else if' is permitted as a special case.
+    PushState(NextTokenIs(TokenKind::If()) ? State::IfStatement
+                                           : State::CodeBlock);
+    return;
+  }
+  FinishIfStatement();
+}
+
+auto ParseTree::Parser::HandleIfStatementAfterElseState() -> void {
+  state_stack_.back().has_error |= !state_result_;
+  FinishIfStatement();
+}
+
+auto ParseTree::Parser::FinishIfStatement() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  AddNode(ParseNodeKind::IfStatement(), entry.token, entry.subtree_start,
+          entry.has_error);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::HandleWhileStatementState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  entry.token = Consume(TokenKind::While());
+  entry.state = State::WhileStatementAfterCondition;
+  StartParenCondition(TokenKind::While());
+}
+
+auto ParseTree::Parser::HandleWhileStatementAfterConditionState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  entry.has_error = !state_result_;
+  entry.state = State::WhileStatementAfterBody;
+  PushState(State::CodeBlock);
+}
+
+auto ParseTree::Parser::HandleWhileStatementAfterBodyState() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  AddNode(ParseNodeKind::WhileStatement(), entry.token, entry.subtree_start,
+          /*has_error=*/entry.has_error || !state_result_);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::HandleKeywordStatementState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  auto keyword_kind = NextTokenKind();
+  COCKTAIL_CHECK(keyword_kind.IsKeyword());
+  entry.token = Consume(keyword_kind);
+
+  // Only `return` has an argument, which is optional.
+  if (keyword_kind == TokenKind::Return() &&
+      NextTokenKind() != TokenKind::Semi()) {
+    entry.state = State::KeywordStatementAfterArgument;
+    PushExpressionState(PrecedenceGroup::ForTopLevelExpression());
+    return;
+  }
+  FinishKeywordStatement();
+}
+
+auto ParseTree::Parser::HandleKeywordStatementAfterArgumentState() -> void {
+  state_stack_.back().has_error = !state_result_;
+  FinishKeywordStatement();
+}
+
+auto ParseTree::Parser::FinishKeywordStatement() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  auto keyword_kind = tokens_.GetKind(entry.token);
+  auto semi =
+      ConsumeAndAddLeafNodeIf(TokenKind::Semi(), ParseNodeKind::StatementEnd());
+  if (!semi) {
+    COCKTAIL_DIAGNOSTIC(ExpectedSemiAfter, Error, "Expected `;` after `{0}`.",
+                      TokenKind);
+    emitter_.Emit(*position_, ExpectedSemiAfter, keyword_kind);
+    // FIXME: Try to skip to a semicolon to recover.
+  }
+  ParseNodeKind kind = keyword_kind == TokenKind::Continue()
+                           ? ParseNodeKind::ContinueStatement()
+                       : keyword_kind == TokenKind::Break()
+                           ? ParseNodeKind::BreakStatement()
+                           : ParseNodeKind::ReturnStatement();
+  AddNode(kind, entry.token, entry.subtree_start,
+          /*has_error=*/!semi || entry.has_error);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::HandleExpressionStatementState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  entry.token = *position_;
+  entry.state = State::ExpressionStatementAfterExpression;
+  PushExpressionState(PrecedenceGroup::ForTopLevelExpression());
+}
+
+auto ParseTree::Parser::HandleExpressionStatementAfterExpressionState()
+    -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  bool has_errors = !state_result_;
+
+  if (auto semi = ConsumeIf(TokenKind::Semi())) {
+    AddNode(ParseNodeKind::ExpressionStatement(), *semi, entry.subtree_start,
+            has_errors);
+    ReturnState(true);
+    return;
+  }
 
-    auto operator_token = Consume(NextTokenKind());
-    bool has_errors = !ParseOperatorExpression(*operator_precedence);
-    lhs = AddNode(ParseNodeKind::PrefixOperator(), operator_token, start,
-                  has_errors);
-    lhs_precedence = *operator_precedence;
+  if (!has_errors) {
+    emitter_.Emit(*position_, ExpectedSemiAfterExpression);
   }
 
-  // Consume a sequence of infix and postfix operators.
+  auto recovery_node =
+      SkipPastLikelyEnd(entry.token, [&](TokenizedBuffer::Token semi) {
+        return AddNode(ParseNodeKind::ExpressionStatement(), semi,
+                       entry.subtree_start, true);
+      });
+  // Without a recovery node, we found junk not even followed by a `;`.
+  ReturnState(recovery_node.hasValue());
+}
+
+auto ParseTree::Parser::HandlePatternState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  if (NextTokenIs(TokenKind::Identifier()) &&
+      tokens_.GetKind(*(position_ + 1)) == TokenKind::Colon()) {
+    // identifier `:` type
+    AddLeafNode(ParseNodeKind::DeclaredName(),
+                Consume(TokenKind::Identifier()));
+    entry.token = Consume(TokenKind::Colon());
+    entry.state = State::PatternAfterType;
+    PushExpressionState(PrecedenceGroup::ForType());
+    return;
+  }
+
+  switch (entry.pattern_kind) {
+    case PatternKind::Parameter:
+      COCKTAIL_DIAGNOSTIC(ExpectedParameterName, Error,
+                        "Expected parameter declaration.");
+      emitter_.Emit(*position_, ExpectedParameterName);
+      break;
+
+    case PatternKind::Variable:
+      COCKTAIL_DIAGNOSTIC(ExpectedVariableName, Error,
+                        "Expected pattern in `var` declaration.");
+      emitter_.Emit(*position_, ExpectedVariableName);
+      break;
+  }
+
+  ReturnState(false);
+}
+
+auto ParseTree::Parser::HandlePatternAfterTypeState() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  AddNode(ParseNodeKind::PatternBinding(), entry.token, entry.subtree_start,
+          /*has_error=*/!state_result_);
+  ReturnState(true);
+}
+
+auto ParseTree::Parser::HandleOperatorExpressionState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+
+  // Check for a prefix operator.
+  auto operator_precedence = PrecedenceGroup::ForLeading(NextTokenKind());
+  if (!operator_precedence) {
+    StartPostfixExpression();
+    return;
+  }
+
+  if (PrecedenceGroup::GetPriority(entry.ambient_precedence,
+                                   *operator_precedence) !=
+      OperatorPriority::RightFirst) {
+    // The precedence rules don't permit this prefix operator in this
+    // context. Diagnose this, but carry on and parse it anyway.
+    emitter_.Emit(*position_, OperatorRequiresParentheses);
+  } else {
+    // Check that this operator follows the proper whitespace rules.
+    DiagnoseOperatorFixity(OperatorFixity::Prefix);
+  }
+
+  entry.token = Consume(NextTokenKind());
+  entry.lhs_precedence = *operator_precedence;
+  entry.state = State::OperatorExpressionAfterPrefix;
+  PushExpressionState(*operator_precedence);
+}
+
+auto ParseTree::Parser::HandleOperatorExpressionAfterPrefixState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  AddNode(ParseNodeKind::PrefixOperator(), entry.token, entry.subtree_start,
+          /*has_error=*/!state_result_);
+  entry.has_error = false;
+  ContinueOperatorExpression();
+}
+
+auto ParseTree::Parser::HandleOperatorExpressionAfterInfixState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  AddNode(ParseNodeKind::InfixOperator(), entry.token, entry.subtree_start,
+          /*has_error=*/entry.has_error || !state_result_);
+  entry.has_error = false;
+  ContinueOperatorExpression();
+}
+
+auto ParseTree::Parser::ContinueOperatorExpression() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  // Consume a sequence of infix and postfix operators. The surrounding tokens
+  // only need to be inspected for an operator that has both forms.
   while (auto trailing_operator = PrecedenceGroup::ForTrailing(
-             NextTokenKind(), IsTrailingOperatorInfix())) {
+             NextTokenKind(),
+             PrecedenceGroup::HasInfixAndPostfixForms(NextTokenKind()) &&
+                 IsTrailingOperatorInfix())) {
     auto [operator_precedence, is_binary] = *trailing_operator;
 
     // FIXME: If this operator is ambiguous with either the ambient precedence
     // or the LHS precedence, and there's a variant with a different fixity
     // that would work, use that one instead for error recovery.
-    if (PrecedenceGroup::GetPriority(ambient_precedence, operator_precedence) !=
+    if (PrecedenceGroup::GetPriority(entry.ambient_precedence,
+                                     operator_precedence) !=
         OperatorPriority::RightFirst) {
       // The precedence rules don't permit this operator in this context. Try
       // again in the enclosing expression context.
-      return lhs;
+      break;
     }
 
-    if (PrecedenceGroup::GetPriority(lhs_precedence, operator_precedence) !=
+    if (PrecedenceGroup::GetPriority(entry.lhs_precedence,
+                                     operator_precedence) !=
         OperatorPriority::LeftFirst) {
       // Either the LHS operator and this operator are ambiguous, or the
       // LHS operaor is a unary operator that can't be nested within
       // this operator. Either way, parentheses are required.
       emitter_.Emit(*position_, OperatorRequiresParentheses);
-      lhs = llvm::None;
+      entry.has_error = true;
     } else {
       DiagnoseOperatorFixity(is_binary ? OperatorFixity::Infix
                                        : OperatorFixity::Postfix);
     }
 
-    auto operator_token = Consume(NextTokenKind());
+    entry.token = Consume(NextTokenKind());
+    entry.lhs_precedence = operator_precedence;
 
     if (is_binary) {
-      auto rhs = ParseOperatorExpression(operator_precedence);
-      lhs = AddNode(ParseNodeKind::InfixOperator(), operator_token, start,
-                    /*has_error=*/!lhs || !rhs);
-    } else {
-      lhs = AddNode(ParseNodeKind::PostfixOperator(), operator_token, start,
-                    /*has_error=*/!lhs);
+      entry.state = State::OperatorExpressionAfterInfix;
+      PushExpressionState(operator_precedence);
+      return;
     }
-    lhs_precedence = operator_precedence;
+
+    AddNode(ParseNodeKind::PostfixOperator(), entry.token, entry.subtree_start,
+            /*has_error=*/entry.has_error);
+    entry.has_error = false;
   }
 
-  return lhs;
+  ReturnState(!entry.has_error);
 }
 
-auto ParseTree::Parser::ParseExpression() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  return ParseOperatorExpression(PrecedenceGroup::ForTopLevelExpression());
-}
+auto ParseTree::Parser::StartPostfixExpression() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  llvm::Optional<ParseNodeKind> kind;
+  switch (NextTokenKind()) {
+    case TokenKind::Identifier():
+      kind = ParseNodeKind::NameReference();
+      break;
 
-auto ParseTree::Parser::ParseType() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  return ParseOperatorExpression(PrecedenceGroup::ForType());
-}
+    case TokenKind::IntegerLiteral():
+    case TokenKind::RealLiteral():
+    case TokenKind::StringLiteral():
+    case TokenKind::IntegerTypeLiteral():
+    case TokenKind::UnsignedIntegerTypeLiteral():
+    case TokenKind::FloatingPointTypeLiteral():
+      kind = ParseNodeKind::Literal();
+      break;
 
-auto ParseTree::Parser::ParseExpressionStatement() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  TokenizedBuffer::Token start_token = *position_;
-  auto start = GetSubtreeStartPosition();
+    case TokenKind::OpenParen():
+      // parenthesized-expression ::= `(` expression `)`
+      // tuple-literal ::= `(` `)`
+      //               ::= `(` expression `,` [expression-list [`,`]] `)`
+      //
+      // Parse the union of these, `(` [expression-list [`,`]] `)`, and work
+      // out whether it's a tuple or a parenthesized expression afterwards.
+      entry.state = State::PostfixExpressionAfterPrimary;
+      PushState({.state = State::List,
+                 .list_kind = ListKind::ParenExpression,
+                 .subtree_start = GetSubtreeStartPosition()});
+      return;
 
-  bool has_errors = !ParseExpression();
+    case TokenKind::OpenCurlyBrace():
+      // braced-expression ::= `{` [field-value-list] `}`
+      //                   ::= `{` field-type-list `}`
+      // field-value-list ::= field-value [`,`]
+      //                  ::= field-value `,` field-value-list
+      // field-value ::= `.` identifier `=` expression
+      // field-type-list ::= field-type [`,`]
+      //                 ::= field-type `,` field-type-list
+      // field-type ::= `.` identifier `:` type
+      //
+      // Note that `{` `}` is the first form (an empty struct), but that an
+      // empty struct value also behaves as an empty struct type.
+      entry.state = State::PostfixExpressionAfterPrimary;
+      PushState({.state = State::List,
+                 .list_kind = ListKind::StructLiteral,
+                 .subtree_start = GetSubtreeStartPosition()});
+      return;
 
-  if (auto semi = ConsumeIf(TokenKind::Semi())) {
-    return AddNode(ParseNodeKind::ExpressionStatement(), *semi, start,
-                   has_errors);
+    default:
+      COCKTAIL_DIAGNOSTIC(ExpectedExpression, Error, "Expected expression.");
+      emitter_.Emit(*position_, ExpectedExpression);
+      entry.token = *position_;
+      ContinuePostfixExpression(/*expression=*/false);
+      return;
   }
 
-  if (!has_errors) {
-    emitter_.Emit(*position_, ExpectedSemiAfterExpression);
-  }
+  AddLeafNode(*kind, Consume(NextTokenKind()));
+  entry.token = *position_;
+  ContinuePostfixExpression(/*expression=*/true);
+}
 
-  if (auto recovery_node =
-          SkipPastLikelyEnd(start_token, [&](TokenizedBuffer::Token semi) {
-            return AddNode(ParseNodeKind::ExpressionStatement(), semi, start,
-                           true);
-          })) {
-    return recovery_node;
-  }
+auto ParseTree::Parser::HandlePostfixExpressionAfterPrimaryState() -> void {
+  state_stack_.back().token = *position_;
+  ContinuePostfixExpression(/*expression=*/state_result_);
+}
 
-  // Found junk not even followed by a `;`.
-  return llvm::None;
+auto ParseTree::Parser::HandlePostfixExpressionAfterCallState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  bool expression = state_result_;
+  // This is subject to an infinite loop if a child call fails, so monitor for
+  // stalling.
+  if (entry.token == *position_) {
+    COCKTAIL_CHECK(!expression);
+    FinishPostfixExpression(expression);
+    return;
+  }
+  entry.token = *position_;
+  ContinuePostfixExpression(expression);
 }
 
-auto ParseTree::Parser::ParseParenCondition(TokenKind introducer)
-    -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  // `(` expression `)`
-  auto start = GetSubtreeStartPosition();
-  auto open_paren = ConsumeIf(TokenKind::OpenParen());
-  if (!open_paren) {
-    COCKTAIL_DIAGNOSTIC(ExpectedParenAfter, Error, "Expected `(` after `{0}`.",
-                      TokenKind);
-    emitter_.Emit(*position_, ExpectedParenAfter, introducer);
+auto ParseTree::Parser::ContinuePostfixExpression(bool expression) -> void {
+  StateStackEntry& entry = state_stack_.back();
+  while (true) {
+    switch (NextTokenKind()) {
+      case TokenKind::Period():
+        expression = ParseDesignatorExpression(
+                         entry.subtree_start,
+                         ParseNodeKind::DesignatorExpression(), !expression)
+                         .hasValue();
+        break;
+
+      case TokenKind::OpenParen():
+        // `(` expression-list[opt] `)`
+        //
+        // expression-list ::= expression
+        //                 ::= expression `,` expression-list
+        entry.state = State::PostfixExpressionAfterCall;
+        PushState({.state = State::List,
+                   .has_error = !expression,
+                   .list_kind = ListKind::CallExpression,
+                   .subtree_start = entry.subtree_start});
+        return;
+
+      default:
+        FinishPostfixExpression(expression);
+        return;
+    }
+    // This is subject to an infinite loop if a child call fails, so monitor for
+    // stalling.
+    if (entry.token == *position_) {
+      COCKTAIL_CHECK(!expression);
+      FinishPostfixExpression(expression);
+      return;
+    }
+    entry.token = *position_;
   }
+}
 
-  auto expr = ParseExpression();
+auto ParseTree::Parser::FinishPostfixExpression(bool expression) -> void {
+  // The postfix expression is the operand of the operator expression.
+  StateStackEntry& entry = state_stack_.back();
+  entry.has_error = !expression;
+  entry.lhs_precedence = PrecedenceGroup::ForPostfixExpression();
+  ContinueOperatorExpression();
+}
 
-  if (!open_paren) {
-    // Don't expect a matching closing paren if there wasn't an opening paren.
-    return llvm::None;
+auto ParseTree::Parser::HandleListState() -> void {
+  // `(` element-list[opt] `)`
+  //
+  // element-list ::= element
+  //              ::= element `,` element-list
+  StateStackEntry& entry = state_stack_.back();
+  entry.token = Consume(entry.list_kind == ListKind::StructLiteral
+                            ? TokenKind::OpenCurlyBrace()
+                            : TokenKind::OpenParen());
+
+  // Parse elements, if any are specified.
+  if (NextTokenIs(tokens_.GetKind(entry.token).GetClosingSymbol())) {
+    FinishList();
+    return;
   }
+  StartListElement();
+}
 
-  auto close_paren =
-      ParseCloseParen(*open_paren, ParseNodeKind::ConditionEnd());
+auto ParseTree::Parser::StartListElement() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  entry.state = State::ListAfterElement;
+  switch (entry.list_kind) {
+    case ListKind::ParameterList:
+      PushState({.state = State::Pattern,
+                 .pattern_kind = PatternKind::Parameter,
+                 .subtree_start = GetSubtreeStartPosition()});
+      break;
 
-  return AddNode(ParseNodeKind::Condition(), *open_paren, start,
-                 /*has_error=*/!expr || !close_paren);
+    case ListKind::ParenExpression:
+    case ListKind::CallExpression:
+      PushExpressionState(PrecedenceGroup::ForTopLevelExpression());
+      break;
+
+    case ListKind::StructLiteral:
+      StartStructField();
+      break;
+  }
 }
 
-auto ParseTree::Parser::ParseIfStatement() -> llvm::Optional<Node> {
-  auto start = GetSubtreeStartPosition();
-  auto if_token = Consume(TokenKind::If());
-  auto cond = ParseParenCondition(TokenKind::If());
-  auto then_case = ParseCodeBlock();
-  bool else_has_errors = false;
-  if (ConsumeAndAddLeafNodeIf(TokenKind::Else(),
-                              ParseNodeKind::IfStatementElse())) {
-    // 'else if' is permitted as a special case.
-    if (NextTokenIs(TokenKind::If())) {
-      else_has_errors = !ParseIfStatement();
-    } else {
-      else_has_errors = !ParseCodeBlock();
+auto ParseTree::Parser::StartStructField() -> void {
+  StructKind& kind = state_stack_.back().struct_kind;
+  auto start_elem = GetSubtreeStartPosition();
+
+  auto diagnose_invalid_syntax = [&] {
+    COCKTAIL_DIAGNOSTIC(ExpectedStructLiteralField, Error,
+                      "Expected {0}{1}{2}.", llvm::StringRef, llvm::StringRef,
+                      llvm::StringRef);
+    bool can_be_type = kind != StructKind::Value;
+    bool can_be_value = kind != StructKind::Type;
+    emitter_.Emit(*position_, ExpectedStructLiteralField,
+                  can_be_type ? "`.field: type`" : "",
+                  (can_be_type && can_be_value) ? " or " : "",
+                  can_be_value ? "`.field = value`" : "");
+    // The element failed, so go straight on to what follows it.
+    state_result_ = false;
+  };
+
+  if (!NextTokenIs(TokenKind::Period())) {
+    diagnose_invalid_syntax();
+    return;
+  }
+  auto designator = ParseDesignatorExpression(
+      start_elem, ParseNodeKind::StructFieldDesignator(),
+      /*has_errors=*/false);
+  if (!designator) {
+    auto recovery_pos = FindNextOf(
+        {TokenKind::Equal(), TokenKind::Colon(), TokenKind::Comma()});
+    if (!recovery_pos ||
+        tokens_.GetKind(*recovery_pos) == TokenKind::Comma()) {
+      state_result_ = false;
+      return;
     }
+    SkipTo(*recovery_pos);
   }
-  return AddNode(ParseNodeKind::IfStatement(), if_token, start,
-                 /*has_error=*/!cond || !then_case || else_has_errors);
-}
 
-auto ParseTree::Parser::ParseWhileStatement() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  auto start = GetSubtreeStartPosition();
-  auto while_token = Consume(TokenKind::While());
-  auto cond = ParseParenCondition(TokenKind::While());
-  auto body = ParseCodeBlock();
-  return AddNode(ParseNodeKind::WhileStatement(), while_token, start,
-                 /*has_error=*/!cond || !body);
+  // Work out the kind of this element
+  StructKind elem_kind = (NextTokenIs(TokenKind::Equal())   ? StructKind::Value
+                          : NextTokenIs(TokenKind::Colon()) ? StructKind::Type
+                                                         : StructKind::Unknown);
+  if (elem_kind == StructKind::Unknown ||
+      (kind != StructKind::Unknown && elem_kind != kind)) {
+    diagnose_invalid_syntax();
+    return;
+  }
+  kind = elem_kind;
+
+  // Struct type fields and value fields use the same grammar except that
+  // one has a `:` separator and the other has an `=` separator.
+  auto equal_or_colon_token = Consume(
+      elem_kind == StructKind::Type ? TokenKind::Colon() : TokenKind::Equal());
+  PushState({.state = State::StructFieldFinish,
+             .has_error = !designator,
+             .struct_kind = elem_kind,
+             .token = equal_or_colon_token,
+             .subtree_start = start_elem});
+  PushExpressionState(PrecedenceGroup::ForTopLevelExpression());
 }
 
-auto ParseTree::Parser::ParseKeywordStatement(ParseNodeKind kind,
-                                              KeywordStatementArgument argument)
-    -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  auto keyword_kind = NextTokenKind();
-  COCKTAIL_CHECK(keyword_kind.IsKeyword());
+auto ParseTree::Parser::HandleStructFieldFinishState() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  AddNode(entry.struct_kind == StructKind::Type
+              ? ParseNodeKind::StructFieldType()
+              : ParseNodeKind::StructFieldValue(),
+          entry.token, entry.subtree_start,
+          /*has_error=*/entry.has_error || !state_result_);
+  ReturnState(true);
+}
 
-  auto start = GetSubtreeStartPosition();
-  auto keyword = Consume(keyword_kind);
+auto ParseTree::Parser::HandleListAfterElementState() -> void {
+  StateStackEntry& entry = state_stack_.back();
+  TokenKind close = tokens_.GetKind(entry.token).GetClosingSymbol();
+  bool element_error = !state_result_;
+  entry.has_error |= element_error;
+  entry.has_element = true;
+
+  if (!NextTokenIsOneOf({close, TokenKind::Comma()})) {
+    if (!element_error) {
+      COCKTAIL_DIAGNOSTIC(UnexpectedTokenAfterListElement, Error,
+                        "Expected `,` or `{0}`.", TokenKind);
+      emitter_.Emit(*position_, UnexpectedTokenAfterListElement, close);
+    }
+    entry.has_error = true;
 
-  bool arg_error = false;
-  if ((argument == KeywordStatementArgument::Optional &&
-       NextTokenKind() != TokenKind::Semi()) ||
-      argument == KeywordStatementArgument::Mandatory) {
-    arg_error = !ParseExpression();
+    auto end_of_element = FindNextOf({TokenKind::Comma(), close});
+    // The lexer guarantees that parentheses are balanced.
+    COCKTAIL_CHECK(end_of_element) << "missing matching `)` for `(`";
+    SkipTo(*end_of_element);
   }
 
-  auto semi =
-      ConsumeAndAddLeafNodeIf(TokenKind::Semi(), ParseNodeKind::StatementEnd());
-  if (!semi) {
-    COCKTAIL_DIAGNOSTIC(ExpectedSemiAfter, Error, "Expected `;` after `{0}`.",
-                      TokenKind);
-    emitter_.Emit(*position_, ExpectedSemiAfter, keyword_kind);
-    // FIXME: Try to skip to a semicolon to recover.
+  if (NextTokenIs(close)) {
+    FinishList();
+    return;
   }
-  return AddNode(kind, keyword, start, /*has_error=*/!semi || arg_error);
-}
-
-auto ParseTree::Parser::ParseStatement() -> llvm::Optional<Node> {
-  RETURN_IF_STACK_LIMITED(llvm::None);
-  switch (NextTokenKind()) {
-    case TokenKind::Var():
-      return ParseVariableDeclaration();
 
-    case TokenKind::If():
-      return ParseIfStatement();
+  bool allow_trailing_comma = false;
+  ParseNodeKind comma_kind = ParseNodeKind::ParameterListComma();
+  switch (entry.list_kind) {
+    case ListKind::ParameterList:
+      break;
+    case ListKind::ParenExpression:
+      comma_kind = ParseNodeKind::TupleLiteralComma();
+      allow_trailing_comma = true;
+      break;
+    case ListKind::CallExpression:
+      comma_kind = ParseNodeKind::CallExpressionComma();
+      break;
+    case ListKind::StructLiteral:
+      comma_kind = ParseNodeKind::StructComma();
+      allow_trailing_comma = true;
+      break;
+  }
+  auto comma_token = Consume(TokenKind::Comma());
+  if (separators_ == Separators::Kept) {
+    AddLeafNode(comma_kind, comma_token);
+  }
+  entry.has_comma = true;
 
-    case TokenKind::While():
-      return ParseWhileStatement();
+  if (allow_trailing_comma && NextTokenIs(close)) {
+    entry.has_trailing_comma = true;
+    FinishList();
+    return;
+  }
+  StartListElement();
+}
 
-    case TokenKind::Continue():
-      return ParseKeywordStatement(ParseNodeKind::ContinueStatement(),
-                                   KeywordStatementArgument::None);
+auto ParseTree::Parser::FinishList() -> void {
+  const StateStackEntry& entry = state_stack_.back();
+  bool is_single_item = entry.has_element && !entry.has_comma;
+  auto close_token = Consume(tokens_.GetKind(entry.token).GetClosingSymbol());
+  ParseNodeKind end_kind = ParseNodeKind::ParameterListEnd();
+  ParseNodeKind list_kind = ParseNodeKind::ParameterList();
+  switch (entry.list_kind) {
+    case ListKind::ParameterList:
+      break;
 
-    case TokenKind::Break():
-      return ParseKeywordStatement(ParseNodeKind::BreakStatement(),
-                                   KeywordStatementArgument::None);
+    case ListKind::ParenExpression:
+      end_kind = is_single_item ? ParseNodeKind::ParenExpressionEnd()
+                                : ParseNodeKind::TupleLiteralEnd();
+      list_kind = is_single_item ? ParseNodeKind::ParenExpression()
+                                 : ParseNodeKind::TupleLiteral();
+      break;
 
-    case TokenKind::Return():
-      return ParseKeywordStatement(ParseNodeKind::ReturnStatement(),
-                                   KeywordStatementArgument::Optional);
+    case ListKind::CallExpression:
+      end_kind = ParseNodeKind::CallExpressionEnd();
+      list_kind = ParseNodeKind::CallExpression();
+      break;
 
-    default:
-      // A statement with no introducer token can only be an expression
-      // statement.
-      return ParseExpressionStatement();
+    case ListKind::StructLiteral:
+      end_kind = ParseNodeKind::StructEnd();
+      list_kind = entry.struct_kind == StructKind::Type
+                      ? ParseNodeKind::StructTypeLiteral()
+                      : ParseNodeKind::StructLiteral();
+      break;
+  }
+  if (separators_ == Separators::Kept) {
+    AddLeafNode(end_kind, close_token);
+  }
+  Node list =
+      AddNode(list_kind, entry.token, entry.subtree_start, entry.has_error);
+  // Without a node for the trailing comma, the list remembers it instead.
+  if (separators_ == Separators::Elided && entry.has_trailing_comma) {
+    tree_.node_impls_[list.index_].set_has_trailing_separator();
   }
+  ReturnState(true);
 }
 
-}  // namespace Cocktail
\ No newline at end of file
+}  // namespace Cocktail
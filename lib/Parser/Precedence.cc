@@ -1,8 +1,10 @@
 #include "Cocktail/Parser/Precedence.h"
 
+#include <initializer_list>
 #include <utility>
 
 #include "Cocktail/Common/Check.h"
+#include "Cocktail/Lexer/TokenKindSet.h"
 
 namespace Cocktail {
 
@@ -175,6 +177,116 @@ struct OperatorPriorityTable {
 
   OperatorPriority table[NumPrecedenceLevels][NumPrecedenceLevels];
 };
+
+// The operator information for a token kind. `Highest` represents the
+// absence of an operator, as no operator is in that precedence group.
+struct OperatorTokenInfo {
+  // The precedence level of the token as a prefix operator.
+  PrecedenceLevel leading = Highest;
+  // The precedence level of the token as a trailing operator, indexed by
+  // whether it is used as infix. The two only differ for a token that is both
+  // an infix and a postfix operator.
+  PrecedenceLevel trailing[2] = {Highest, Highest};
+  // Whether the trailing operator is binary, indexed the same way.
+  bool trailing_is_binary[2] = {false, false};
+};
+
+// A precomputed lookup table with the operator information of every token
+// kind, so that the operator expression loop does a single indexed load per
+// token instead of switching over the token kind.
+struct OperatorTokenTable {
+  constexpr OperatorTokenTable() {
+    MarkPrefix({TokenKind::Star()}, TermPrefix);
+    MarkPrefix({TokenKind::Not()}, LogicalPrefix);
+    MarkPrefix(
+        {TokenKind::Minus(), TokenKind::MinusMinus(), TokenKind::PlusPlus()},
+        NumericPrefix);
+    MarkPrefix({TokenKind::Tilde()}, BitwisePrefix);
+
+    // Assignment operators.
+    MarkInfix({TokenKind::Equal()}, SimpleAssignment);
+    MarkInfix({TokenKind::PlusEqual(), TokenKind::MinusEqual(),
+               TokenKind::StarEqual(), TokenKind::SlashEqual(),
+               TokenKind::PercentEqual(), TokenKind::AmpEqual(),
+               TokenKind::PipeEqual(), TokenKind::GreaterGreaterEqual(),
+               TokenKind::LessLessEqual()},
+              CompoundAssignment);
+
+    // Logical operators.
+    MarkInfix({TokenKind::And()}, LogicalAnd);
+    MarkInfix({TokenKind::Or()}, LogicalOr);
+
+    // Bitwise operators.
+    MarkInfix({TokenKind::Amp()}, BitwiseAnd);
+    MarkInfix({TokenKind::Pipe()}, BitwiseOr);
+    MarkInfix({TokenKind::Xor()}, BitwiseXor);
+    MarkInfix({TokenKind::GreaterGreater(), TokenKind::LessLess()}, BitShift);
+
+    // Relational operators.
+    MarkInfix({TokenKind::EqualEqual(), TokenKind::ExclaimEqual(),
+               TokenKind::Less(), TokenKind::LessEqual(), TokenKind::Greater(),
+               TokenKind::GreaterEqual(), TokenKind::LessEqualGreater()},
+              Relational);
+
+    // Addative operators.
+    MarkInfix({TokenKind::Plus(), TokenKind::Minus()}, Additive);
+
+    // Multiplicative operators.
+    MarkInfix({TokenKind::Slash(), TokenKind::Star()}, Multiplicative);
+    MarkInfix({TokenKind::Percent()}, Modulo);
+
+    // Postfix operators. `*` is also pointer type formation when it isn't
+    // used as infix.
+    MarkPostfix({TokenKind::MinusMinus(), TokenKind::PlusPlus()},
+                NumericPostfix);
+    MarkPostfix({TokenKind::Star()}, TypePostfix);
+  }
+
+  constexpr void MarkPrefix(std::initializer_list<TokenKind> kinds,
+                            PrecedenceLevel level) {
+    for (TokenKind kind : kinds) {
+      entries[GetTokenKindIndex(kind)].leading = level;
+    }
+  }
+
+  // An infix operator is used regardless of whether the token looks infix,
+  // unless the same token is also a postfix operator.
+  constexpr void MarkInfix(std::initializer_list<TokenKind> kinds,
+                           PrecedenceLevel level) {
+    for (TokenKind kind : kinds) {
+      OperatorTokenInfo& info = entries[GetTokenKindIndex(kind)];
+      info.trailing[true] = level;
+      info.trailing_is_binary[true] = true;
+      if (info.trailing[false] == Highest) {
+        info.trailing[false] = level;
+        info.trailing_is_binary[false] = true;
+      }
+    }
+  }
+
+  // Postfix operators must be marked after any infix operator with the same
+  // token.
+  constexpr void MarkPostfix(std::initializer_list<TokenKind> kinds,
+                             PrecedenceLevel level) {
+    for (TokenKind kind : kinds) {
+      OperatorTokenInfo& info = entries[GetTokenKindIndex(kind)];
+      info.trailing[false] = level;
+      info.trailing_is_binary[false] = false;
+      if (info.trailing[true] == Highest) {
+        info.trailing[true] = level;
+      }
+    }
+  }
+
+  [[nodiscard]] constexpr auto Get(TokenKind kind) const
+      -> const OperatorTokenInfo& {
+    return entries[GetTokenKindIndex(kind)];
+  }
+
+  OperatorTokenInfo entries[NumTokenKinds];
+};
+
+constexpr OperatorTokenTable OperatorTokens;
 }  // namespace
 
 auto PrecedenceGroup::ForPostfixExpression() -> PrecedenceGroup {
@@ -191,123 +303,26 @@ auto PrecedenceGroup::ForType() -> PrecedenceGroup {
 
 auto PrecedenceGroup::ForLeading(TokenKind kind)
     -> llvm::Optional<PrecedenceGroup> {
-  switch (kind) {
-    case TokenKind::Star():
-      return PrecedenceGroup(TermPrefix);
-
-    case TokenKind::Not():
-      return PrecedenceGroup(LogicalPrefix);
-
-    case TokenKind::Minus():
-    case TokenKind::MinusMinus():
-    case TokenKind::PlusPlus():
-      return PrecedenceGroup(NumericPrefix);
-
-    case TokenKind::Tilde():
-      return PrecedenceGroup(BitwisePrefix);
-
-    default:
-      return llvm::None;
+  PrecedenceLevel level = OperatorTokens.Get(kind).leading;
+  if (level == Highest) {
+    return llvm::None;
   }
+  return PrecedenceGroup(level);
 }
 
 auto PrecedenceGroup::ForTrailing(TokenKind kind, bool infix)
     -> llvm::Optional<Trailing> {
-  switch (kind) {
-    // Assignment operators.
-    case TokenKind::Equal():
-      return Trailing{.level = SimpleAssignment, .is_binary = true};
-    case TokenKind::PlusEqual():
-    case TokenKind::MinusEqual():
-    case TokenKind::StarEqual():
-    case TokenKind::SlashEqual():
-    case TokenKind::PercentEqual():
-    case TokenKind::AmpEqual():
-    case TokenKind::PipeEqual():
-    case TokenKind::GreaterGreaterEqual():
-    case TokenKind::LessLessEqual():
-      return Trailing{.level = CompoundAssignment, .is_binary = true};
-
-    // Logical operators.
-    case TokenKind::And():
-      return Trailing{.level = LogicalAnd, .is_binary = true};
-    case TokenKind::Or():
-      return Trailing{.level = LogicalOr, .is_binary = true};
-
-    // Bitwise operators.
-    case TokenKind::Amp():
-      return Trailing{.level = BitwiseAnd, .is_binary = true};
-    case TokenKind::Pipe():
-      return Trailing{.level = BitwiseOr, .is_binary = true};
-    case TokenKind::Xor():
-      return Trailing{.level = BitwiseXor, .is_binary = true};
-    case TokenKind::GreaterGreater():
-    case TokenKind::LessLess():
-      return Trailing{.level = BitShift, .is_binary = true};
-
-    // Relational operators.
-    case TokenKind::EqualEqual():
-    case TokenKind::ExclaimEqual():
-    case TokenKind::Less():
-    case TokenKind::LessEqual():
-    case TokenKind::Greater():
-    case TokenKind::GreaterEqual():
-    case TokenKind::LessEqualGreater():
-      return Trailing{.level = Relational, .is_binary = true};
-
-    // Addative operators.
-    case TokenKind::Plus():
-    case TokenKind::Minus():
-      return Trailing{.level = Additive, .is_binary = true};
-
-    // Multiplicative operators.
-    case TokenKind::Slash():
-      return Trailing{.level = Multiplicative, .is_binary = true};
-    case TokenKind::Percent():
-      return Trailing{.level = Modulo, .is_binary = true};
-
-    // `*` could be multiplication or pointer type formation.
-    case TokenKind::Star():
-      return infix ? Trailing{.level = Multiplicative, .is_binary = true}
-                   : Trailing{.level = TypePostfix, .is_binary = false};
-
-    // Postfix operators.
-    case TokenKind::MinusMinus():
-    case TokenKind::PlusPlus():
-      return Trailing{.level = NumericPostfix, .is_binary = false};
-
-    // Prefix-only operators.
-    case TokenKind::Tilde():
-    case TokenKind::Not():
-      break;
-
-    // Symbolic tokens that might be operators eventually.
-    case TokenKind::Backslash():
-    case TokenKind::Caret():
-    case TokenKind::CaretEqual():
-    case TokenKind::Comma():
-    case TokenKind::TildeEqual():
-    case TokenKind::Exclaim():
-    case TokenKind::LessGreater():
-    case TokenKind::Question():
-    case TokenKind::Colon():
-      break;
-
-    // Symbolic tokens that are intentionally not operators.
-    case TokenKind::At():
-    case TokenKind::LessMinus():
-    case TokenKind::MinusGreater():
-    case TokenKind::EqualGreater():
-    case TokenKind::ColonEqual():
-    case TokenKind::Period():
-    case TokenKind::Semi():
-      break;
-
-    default:
-      break;
+  const OperatorTokenInfo& info = OperatorTokens.Get(kind);
+  PrecedenceLevel level = info.trailing[infix];
+  if (level == Highest) {
+    return llvm::None;
   }
+  return Trailing{.level = level, .is_binary = info.trailing_is_binary[infix]};
+}
 
-  return llvm::None;
+auto PrecedenceGroup::HasInfixAndPostfixForms(TokenKind kind) -> bool {
+  const OperatorTokenInfo& info = OperatorTokens.Get(kind);
+  return info.trailing_is_binary[true] != info.trailing_is_binary[false];
 }
 
 auto PrecedenceGroup::GetPriority(PrecedenceGroup left, PrecedenceGroup right)
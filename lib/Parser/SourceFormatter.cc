@@ -0,0 +1,258 @@
+#include "Cocktail/Parser/SourceFormatter.h"
+
+#include <optional>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Lexer/TokenKind.h"
+#include "Cocktail/Parser/ParseNodeKind.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace Cocktail {
+
+namespace {
+
+// What a token does in the tree, as far as its layout goes.
+enum class TokenRole : uint8_t {
+  None,
+  // The braces of a code block.
+  BlockOpen,
+  BlockClose,
+  // The semicolon ending a statement or declaration.
+  End,
+  Infix,
+  Prefix,
+  Postfix,
+  Comma,
+};
+
+constexpr int IndentWidth = 2;
+constexpr int ContinuationIndentWidth = 4;
+
+// Returns whether whitespace can be taken out from between tokens of kinds
+// `lhs` and `rhs` without them lexing as one.
+auto CanJoin(TokenKind lhs, TokenKind rhs) -> bool {
+  if (lhs.is_one_char_symbol() || rhs.is_one_char_symbol() ||
+      lhs.is_grouping_symbol() || rhs.is_grouping_symbol()) {
+    return true;
+  }
+  // Words run together with words, and symbols with symbols.
+  return lhs.is_symbol() != rhs.is_symbol();
+}
+
+class Formatter {
+ public:
+  Formatter(const SourceBuffer& source, const TokenizedBuffer& tokens,
+            const ParseTree& tree, llvm::raw_ostream& output)
+      : tokens_(&tokens), output_(&output) {
+    // The line starts are found up front, so that the lines between tokens,
+    // which can only be blank or comments, are found without searching.
+    llvm::StringRef text = source.text();
+    lines_.push_back(0);
+    for (size_t i = text.find('\n'); i != llvm::StringRef::npos;
+         i = text.find('\n', i + 1)) {
+      lines_.push_back(i + 1);
+    }
+    text_ = text;
+    roles_.resize(tokens.size(), TokenRole::None);
+    for (ParseTree::Node node : tree.postorder()) {
+      TokenRole role = GetRole(tree.node_kind(node));
+      if (role != TokenRole::None) {
+        roles_[GetIndex(tree.node_token(node))] = role;
+      }
+    }
+  }
+
+  auto Run() -> void;
+
+ private:
+  static auto GetRole(ParseNodeKind kind) -> TokenRole {
+    if (kind == ParseNodeKind::CodeBlock()) {
+      return TokenRole::BlockOpen;
+    } else if (kind == ParseNodeKind::CodeBlockEnd()) {
+      return TokenRole::BlockClose;
+    } else if (kind == ParseNodeKind::StatementEnd() ||
+               kind == ParseNodeKind::DeclarationEnd()) {
+      return TokenRole::End;
+    } else if (kind == ParseNodeKind::InfixOperator() ||
+               kind == ParseNodeKind::VariableInitializer() ||
+               kind == ParseNodeKind::ReturnType() ||
+               kind == ParseNodeKind::StructFieldValue()) {
+      return TokenRole::Infix;
+    } else if (kind == ParseNodeKind::PrefixOperator()) {
+      return TokenRole::Prefix;
+    } else if (kind == ParseNodeKind::PostfixOperator()) {
+      return TokenRole::Postfix;
+    } else if (kind == ParseNodeKind::ParameterListComma() ||
+               kind == ParseNodeKind::CallExpressionComma() ||
+               kind == ParseNodeKind::TupleLiteralComma() ||
+               kind == ParseNodeKind::StructComma()) {
+      return TokenRole::Comma;
+    }
+    return TokenRole::None;
+  }
+
+  auto GetIndex(TokenizedBuffer::Token token) const -> int32_t {
+    return TokenizedBuffer::TokenIterator(token) - tokens_->tokens().begin();
+  }
+
+  // Returns the text of the 1-based `line`, without its newline.
+  auto GetLine(int line) const -> llvm::StringRef {
+    size_t start = lines_[line - 1];
+    size_t end = line < static_cast<int>(lines_.size()) ? lines_[line] - 1
+                                                         : text_.size();
+    return text_.slice(start, end);
+  }
+
+  // Returns whether the lines in `[first, last]` hold a comment.
+  auto HasComments(int first, int last) const -> bool {
+    for (int line = first; line <= last; ++line) {
+      if (!GetLine(line).trim().empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Writes the comments on the lines in `[first, last]`, each on a line of
+  // its own at `indent`, keeping one blank line wherever there were some,
+  // except before the first comment unless `blank_first`. Returns whether a
+  // blank line is kept after the last comment, by the same rule.
+  auto WriteComments(int first, int last, bool blank_first, int indent)
+      -> bool {
+    bool blank = false;
+    for (int line = first; line <= last; ++line) {
+      llvm::StringRef comment = GetLine(line).trim();
+      if (comment.empty()) {
+        blank = true;
+        continue;
+      }
+      if (blank && blank_first) {
+        *output_ << "\n";
+      }
+      output_->indent(indent) << comment << "\n";
+      blank = false;
+      blank_first = true;
+    }
+    return blank && blank_first;
+  }
+
+  // Returns whether a space goes between `prev` and `next`, which are on one
+  // line.
+  auto IsSpaced(TokenizedBuffer::Token prev, TokenRole prev_role,
+                TokenizedBuffer::Token next, TokenRole next_role) const
+      -> bool {
+    TokenKind prev_kind = tokens_->GetKind(prev);
+    TokenKind next_kind = tokens_->GetKind(next);
+    if (CanJoin(prev_kind, next_kind) &&
+        (next_kind == TokenKind::Semi() || next_role == TokenRole::Comma ||
+         next_role == TokenRole::Postfix || prev_role == TokenRole::Prefix ||
+         (next_kind.is_closing_symbol() &&
+          next_kind != TokenKind::CloseCurlyBrace()) ||
+         (prev_kind.is_opening_symbol() &&
+          prev_kind != TokenKind::OpenCurlyBrace()))) {
+      return false;
+    }
+    if (prev_role == TokenRole::Comma || prev_role == TokenRole::Infix ||
+        next_role == TokenRole::Infix || next_role == TokenRole::BlockOpen ||
+        (prev_kind.is_keyword() && next_kind == TokenKind::OpenParen())) {
+      return true;
+    }
+    return tokens_->HasTrailingWhitespace(prev);
+  }
+
+  const TokenizedBuffer* tokens_;
+  llvm::raw_ostream* output_;
+  llvm::StringRef text_;
+  // The offset of the start of each line.
+  llvm::SmallVector<size_t, 0> lines_;
+  llvm::SmallVector<TokenRole, 0> roles_;
+};
+
+auto Formatter::Run() -> void {
+  int depth = 0;
+  std::optional<TokenizedBuffer::Token> prev;
+  TokenRole prev_role = TokenRole::None;
+  // The line the previous token ends on, which is later than the one it
+  // starts on for a block string literal.
+  int prev_end_line = 0;
+  for (TokenizedBuffer::Token token : tokens_->tokens()) {
+    TokenKind kind = tokens_->GetKind(token);
+    if (kind == TokenKind::EndOfFile()) {
+      break;
+    }
+    TokenRole role = roles_[GetIndex(token)];
+    int line = tokens_->GetLineNumber(token);
+    if (role == TokenRole::BlockClose) {
+      --depth;
+    }
+    int indent = depth * IndentWidth;
+
+    if (!prev) {
+      if (WriteComments(1, line - 1, /*blank_first=*/false, indent)) {
+        *output_ << "\n";
+      }
+    } else {
+      bool has_comments = HasComments(prev_end_line + 1, line - 1);
+      bool breaks =
+          prev_role == TokenRole::End ||
+          (prev_role == TokenRole::BlockOpen &&
+           (role != TokenRole::BlockClose || has_comments)) ||
+          (prev_role == TokenRole::BlockClose && kind != TokenKind::Else()) ||
+          (role == TokenRole::BlockClose &&
+           (prev_role != TokenRole::BlockOpen || has_comments));
+      // Braces stay on the line they follow unless comments are between.
+      bool joined = role == TokenRole::BlockOpen ||
+                    (prev_role == TokenRole::BlockClose &&
+                     kind == TokenKind::Else());
+      if (breaks) {
+        *output_ << "\n";
+        // Comments before a closing brace are in the block.
+        int comment_indent =
+            role == TokenRole::BlockClose ? indent + IndentWidth : indent;
+        if (WriteComments(prev_end_line + 1, line - 1,
+                          /*blank_first=*/prev_role != TokenRole::BlockOpen,
+                          comment_indent) &&
+            role != TokenRole::BlockClose) {
+          *output_ << "\n";
+        }
+        output_->indent(indent);
+      } else if (line > prev_end_line && (!joined || has_comments)) {
+        indent += ContinuationIndentWidth;
+        *output_ << "\n";
+        WriteComments(prev_end_line + 1, line - 1, /*blank_first=*/false,
+                      indent);
+        output_->indent(indent);
+      } else if (IsSpaced(*prev, prev_role, token, role)) {
+        *output_ << " ";
+      }
+    }
+
+    llvm::StringRef text = tokens_->GetTokenText(token);
+    *output_ << text;
+    if (role == TokenRole::BlockOpen) {
+      ++depth;
+    }
+    prev = token;
+    prev_role = role;
+    prev_end_line = line + text.count('\n');
+  }
+
+  // The comments after the last token are kept too.
+  if (prev) {
+    *output_ << "\n";
+  }
+  WriteComments(prev_end_line + 1, lines_.size(),
+                /*blank_first=*/prev.has_value(), 0);
+}
+
+}  // namespace
+
+auto FormatSource(const SourceBuffer& source, const TokenizedBuffer& tokens,
+                  const ParseTree& tree, llvm::raw_ostream& output) -> void {
+  COCKTAIL_CHECK(tree.separators() == ParseTree::Separators::Kept)
+      << "Formatting needs the separators' nodes!";
+  Formatter(source, tokens, tree, output).Run();
+}
+
+}  // namespace Cocktail
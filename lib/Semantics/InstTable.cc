@@ -0,0 +1,23 @@
+#include "Cocktail/Semantics/InstTable.h"
+
+#include "llvm/Support/ErrorHandling.h"
+
+namespace Cocktail::Semantics {
+
+auto GetInstKindName(InstKind kind) -> llvm::StringRef {
+  switch (kind) {
+    case InstKind::Call:
+      return "Call";
+    case InstKind::IntegerConstant:
+      return "IntegerConstant";
+    case InstKind::StringConstant:
+      return "StringConstant";
+    case InstKind::TupleValue:
+      return "TupleValue";
+    case InstKind::StructValue:
+      return "StructValue";
+  }
+  llvm_unreachable("Unknown instruction kind!");
+}
+
+}  // namespace Cocktail::Semantics
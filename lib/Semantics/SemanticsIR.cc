@@ -2,23 +2,241 @@
 
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/StringSaver.h"
 
 namespace Cocktail {
 
-void SemanticsIR::Block::Add(llvm::StringRef name, Node named_entity) {
+namespace {
+
+using IdentifierInfo = llvm::DenseMapInfo<TokenizedBuffer::Identifier>;
+
+}  // namespace
+
+auto SemanticsIR::Block::Add(TokenizedBuffer::Identifier name,
+                             Node named_entity) -> std::optional<Node> {
+  if (lookup_.empty()) {
+    Grow();
+  }
+  int slot = FindSlot(name);
+  if (lookup_[slot].name == name) {
+    return lookup_[slot].named_entity;
+  }
   ordering_.push_back(named_entity);
-  name_lookup_.insert({name, named_entity});
+  lookup_[slot] = {.name = name, .named_entity = named_entity};
+  if (2 * ordering_.size() > lookup_.size()) {
+    Grow();
+  }
+  return std::nullopt;
+}
+
+auto SemanticsIR::Block::Lookup(TokenizedBuffer::Identifier name) const
+    -> std::optional<Node> {
+  if (lookup_.empty()) {
+    return std::nullopt;
+  }
+  const Entry& entry = lookup_[FindSlot(name)];
+  if (entry.name != name) {
+    return std::nullopt;
+  }
+  return entry.named_entity;
+}
+
+auto SemanticsIR::Block::memory_bytes() const -> int64_t {
+  return ordering_.capacity() * sizeof(Node) +
+         lookup_.capacity() * sizeof(Entry);
+}
+
+auto SemanticsIR::Block::FindSlot(TokenizedBuffer::Identifier name) const
+    -> int {
+  COCKTAIL_CHECK(name != IdentifierInfo::getEmptyKey())
+      << "Looking up the empty identifier!";
+  // The size is a power of two, so masking wraps around the table.
+  unsigned mask = lookup_.size() - 1;
+  unsigned slot = IdentifierInfo::getHashValue(name) & mask;
+  // The table is never more than half full, so there is always an empty slot
+  // to stop at.
+  while (lookup_[slot].name != name &&
+         lookup_[slot].name != IdentifierInfo::getEmptyKey()) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+auto SemanticsIR::Block::Grow() -> void {
+  constexpr int InitialSize = 16;
+  llvm::SmallVector<Entry, 0> old_lookup = std::move(lookup_);
+  int size = old_lookup.empty() ? InitialSize : 2 * old_lookup.size();
+  lookup_.assign(size, {.name = IdentifierInfo::getEmptyKey()});
+  for (const Entry& entry : old_lookup) {
+    if (entry.name != IdentifierInfo::getEmptyKey()) {
+      lookup_[FindSlot(entry.name)] = entry;
+    }
+  }
 }
 
 auto SemanticsIR::AddFunction(Block& block, ParseTree::Node decl_node,
-                              ParseTree::Node name_node)
-    -> Semantics::Function& {
-  auto index = functions_.size();
-  functions_.emplace_back(Semantics::Function(decl_node, name_node));
-  block.Add(parse_tree_->GetNodeText(name_node),
-            Node(Node::Kind::Function, index));
-  return functions_[index];
+                              ParseTree::Node name_node,
+                              TokenizedBuffer::Identifier name)
+    -> std::optional<ParseTree::Node> {
+  Node entity(Node::Kind::Function, functions_.size());
+  if (std::optional<Node> previous = block.Add(name, entity)) {
+    return GetNameNode(*previous);
+  }
+  functions_.emplace_back(Semantics::Function(
+      decl_node, name_node, parse_tree_->GetNodeText(name_node)));
+  return std::nullopt;
+}
+
+auto SemanticsIR::AddImportedFunction(TokenizedBuffer::Identifier name,
+                                      llvm::StringRef text,
+                                      Semantics::TypeId type) -> bool {
+  Node entity(Node::Kind::Function, functions_.size());
+  if (root_block_.Add(name, entity)) {
+    return false;
+  }
+  functions_.emplace_back(Semantics::Function(
+      llvm::StringSaver(string_storage()).save(text), type));
+  return true;
+}
+
+auto SemanticsIR::AddIntegerConstant(const llvm::APInt& value) -> int32_t {
+  auto [it, inserted] =
+      integer_constant_indices_.insert({value, integer_constants_.size()});
+  if (inserted) {
+    integer_constants_.push_back(value);
+  }
+  return it->second;
+}
+
+auto SemanticsIR::AddStringConstant(llvm::CachedHashStringRef value)
+    -> int32_t {
+  auto it = string_constant_indices_.find(value);
+  if (it != string_constant_indices_.end()) {
+    return it->second;
+  }
+  llvm::StringRef copy = value.val().copy(string_storage());
+  int32_t index = string_constants_.size();
+  string_constant_indices_.insert(
+      {llvm::CachedHashStringRef(copy, value.hash()), index});
+  string_constants_.push_back(copy);
+  return index;
+}
+
+auto SemanticsIR::GetNameNode(Node entity) const -> ParseTree::Node {
+  // Functions are the only entities so far.
+  COCKTAIL_CHECK(entity.kind_ == Node::Kind::Function)
+      << "Looking up the name of an invalid node!";
+  return functions_[entity.index_].name_node();
+}
+
+auto SemanticsIR::GetFunctionIndex(Node entity) const
+    -> std::optional<int32_t> {
+  if (entity.kind_ != Node::Kind::Function) {
+    return std::nullopt;
+  }
+  return entity.index_;
+}
+
+auto SemanticsIR::memory_bytes() const -> int64_t {
+  return functions_.capacity() * sizeof(Semantics::Function) +
+         insts_.memory_bytes() + types_.memory_bytes() +
+         integer_constants_.capacity() * sizeof(llvm::APInt) +
+         integer_constant_indices_.getMemorySize() +
+         string_constants_.capacity() * sizeof(llvm::StringRef) +
+         string_constant_indices_.getMemorySize() +
+         root_block_.memory_bytes() + strings_.getTotalMemory();
+}
+
+auto SemanticsIR::FindReachableFunctions(
+    llvm::ArrayRef<llvm::StringRef> entry_points) const -> llvm::BitVector {
+  llvm::BitVector reachable(functions_.size());
+  llvm::SmallVector<int32_t> worklist;
+  for (int32_t i = 0; i != static_cast<int32_t>(functions_.size()); ++i) {
+    if (llvm::is_contained(entry_points, functions_[i].name())) {
+      reachable.set(i);
+      worklist.push_back(i);
+    }
+  }
+  while (!worklist.empty()) {
+    for (int32_t inst : functions_[worklist.pop_back_val()].body()) {
+      if (insts_.kind(inst) != Semantics::InstKind::Call) {
+        continue;
+      }
+      int32_t callee = insts_.operands(inst)[0];
+      if (!reachable.test(callee)) {
+        reachable.set(callee);
+        worklist.push_back(callee);
+      }
+    }
+  }
+  return reachable;
+}
+
+auto SemanticsIR::Print(llvm::raw_ostream& output) const -> void {
+  output << "[\n";
+  for (const Semantics::Function& function : functions_) {
+    output << "{kind: Function, name: '" << function.name() << "'";
+    if (function.is_imported()) {
+      output << ", imported: true},\n";
+      continue;
+    }
+    output << ", node_index: " << function.decl_node().index();
+    if (!function.body().empty()) {
+      output << ", body: [";
+      llvm::ListSeparator sep;
+      for (int32_t inst : function.body()) {
+        output << sep << "{kind: "
+               << Semantics::GetInstKindName(insts_.kind(inst))
+               << ", type: '";
+        types_.Print(output, insts_.type(inst), *tokens_);
+        output << "'";
+        switch (insts_.kind(inst)) {
+          case Semantics::InstKind::Call: {
+            llvm::ArrayRef<int32_t> operands = insts_.operands(inst);
+            output << ", callee: '" << functions_[operands[0]].name() << "'";
+            if (operands.size() > 1) {
+              output << ", args: [";
+              llvm::ListSeparator arg_sep;
+              for (int32_t arg : operands.drop_front()) {
+                output << arg_sep << arg;
+              }
+              output << "]";
+            }
+            break;
+          }
+          case Semantics::InstKind::IntegerConstant:
+            output << ", value: ";
+            integer_constants_[insts_.operands(inst)[0]].print(
+                output, /*isSigned=*/true);
+            break;
+          case Semantics::InstKind::StringConstant:
+            output << ", value: \"";
+            llvm::printEscapedString(
+                string_constants_[insts_.operands(inst)[0]], output);
+            output << "\"";
+            break;
+          case Semantics::InstKind::TupleValue:
+          case Semantics::InstKind::StructValue: {
+            output << ", elements: [";
+            llvm::ListSeparator element_sep;
+            for (int32_t element : insts_.operands(inst)) {
+              output << element_sep << element;
+            }
+            output << "]";
+            break;
+          }
+        }
+        output << "}";
+      }
+      output << "]";
+    }
+    output << "},\n";
+  }
+  output << "]\n";
 }
 
-}  // namespace Cocktail
\ No newline at end of file
+}  // namespace Cocktail
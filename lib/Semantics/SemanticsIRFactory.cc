@@ -1,21 +1,829 @@
 #include "Cocktail/Semantics/SemanticsIRFactory.h"
 
+#include <algorithm>
+
 #include "Cocktail/Common/Check.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
 #include "Cocktail/Parser/ParseNodeKind.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormatVariadic.h"
 
 namespace Cocktail {
 
-auto SemanticsIRFactory::Build(const ParseTree& parse_tree) -> SemanticsIR {
-  SemanticsIRFactory factory(parse_tree);
+COCKTAIL_DIAGNOSTIC(NameDeclarationDuplicate, Error,
+                    "Duplicate name being declared in the same scope.");
+COCKTAIL_DIAGNOSTIC(NameDeclarationPrevious, Note,
+                    "Name is previously declared here.");
+COCKTAIL_DIAGNOSTIC(IntegerLiteralTooLarge, Error,
+                    "Integer literal does not fit in `i{0}`.", int);
+COCKTAIL_DIAGNOSTIC(IntegerTypeTooWide, Error,
+                    "Integer types can be at most {0} bits wide.", int);
+COCKTAIL_DIAGNOSTIC(IntegerOverflow, Error,
+                    "Result of `{0}` does not fit in `i{1}`.", TokenKind, int);
+COCKTAIL_DIAGNOSTIC(DivisionByZero, Error, "Division by zero in `{0}`.",
+                    TokenKind);
+COCKTAIL_DIAGNOSTIC(CallArgCountMismatch, Error,
+                    "{0} argument(s) passed to function expecting {1} "
+                    "argument(s).",
+                    int, int);
+COCKTAIL_DIAGNOSTIC(InCallToFunction, Note, "Calling function declared here.");
+COCKTAIL_DIAGNOSTIC(ImplicitAsConversionFailure, Error,
+                    "Cannot implicitly convert argument of type `{0}`.",
+                    std::string);
+COCKTAIL_DIAGNOSTIC(InCallToFunctionParam, Note,
+                    "Initializing parameter of type `{0}` declared here.",
+                    std::string);
+
+namespace {
+
+// Buffers the diagnostics of a batch of function bodies processed in
+// parallel until the batch is added to the IR.
+class BatchDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    diagnostic.ResolveLocations();
+    diagnostics_.push_back(std::move(diagnostic));
+  }
+
+  auto diagnostics() -> llvm::MutableArrayRef<Diagnostic> {
+    return diagnostics_;
+  }
+
+ private:
+  llvm::SmallVector<Diagnostic, 0> diagnostics_;
+};
+
+}  // namespace
+
+struct SemanticsIRFactory::Batch {
+  Semantics::InstTable insts;
+  // The end of each function's body in `insts`.
+  llvm::SmallVector<int32_t, 0> body_ends;
+  // The values of the batch's integer constants, which are only deduplicated
+  // once they're added to the IR.
+  llvm::SmallVector<llvm::APInt, 0> integer_constants;
+  // Likewise the values of its string literals, hashed by the lexer.
+  llvm::SmallVector<llvm::CachedHashStringRef, 0> string_constants;
+  BatchDiagnosticConsumer consumer;
+  // Whether the batch stopped for a cancellation before its last body.
+  bool cancelled = false;
+};
+
+auto SemanticsIRFactory::Build(TokenizedBuffer& tokens,
+                               const ParseTree& parse_tree,
+                               DiagnosticConsumer& consumer,
+                               TaskScheduler* scheduler,
+                               llvm::ArrayRef<SemanticsInterface> imports,
+                               CompilationContext* context,
+                               const CancellationToken* cancellation)
+    -> SemanticsIR {
+  SemanticsIRFactory factory(tokens, parse_tree, consumer);
+  factory.semantics_.context_ = context;
+  factory.cancellation_ = cancellation;
   factory.ProcessRoots();
-  return factory.semantics_;
+  for (Semantics::Function& function : factory.semantics_.functions_) {
+    factory.ProcessSignature(function);
+  }
+  for (const SemanticsInterface& interface : imports) {
+    factory.ProcessImport(interface);
+  }
+  factory.ProcessFunctionBodies(scheduler);
+  return std::move(factory.semantics_);
 }
 
-void SemanticsIRFactory::ProcessRoots() {}
+void SemanticsIRFactory::ProcessRoots() {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  // Roots are visited last to first, so they're collected to be processed in
+  // the order they're declared.
+  llvm::SmallVector<ParseTree::Node> roots(parse_tree.roots().begin(),
+                                           parse_tree.roots().end());
+  for (ParseTree::Node node : llvm::reverse(roots)) {
+    if (parse_tree.node_kind(node) == ParseNodeKind::FunctionDeclaration()) {
+      ProcessFuntionNode(semantics_.root_block_, node);
+    }
+  }
+}
 
 void SemanticsIRFactory::ProcessFuntionNode(SemanticsIR::Block& block,
-                                            ParseTree::Node decl_node) {}
+                                            ParseTree::Node decl_node) {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  for (ParseTree::Node child : parse_tree.children(decl_node)) {
+    if (parse_tree.node_kind(child) != ParseNodeKind::DeclaredName()) {
+      continue;
+    }
+    TokenizedBuffer::Token name_token = parse_tree.node_token(child);
+    if (std::optional<ParseTree::Node> previous = semantics_.AddFunction(
+            block, decl_node, child, tokens_->GetIdentifier(name_token))) {
+      emitter_.Build(name_token, NameDeclarationDuplicate)
+          .Note(parse_tree.node_token(*previous), NameDeclarationPrevious)
+          .Emit();
+      semantics_.has_errors_ = true;
+      return;
+    }
+    Semantics::Function& function = semantics_.functions_.back();
+    for (ParseTree::Node body : parse_tree.children(decl_node)) {
+      if (parse_tree.node_kind(body) == ParseNodeKind::CodeBlock()) {
+        function.body_node_ = body;
+        break;
+      }
+    }
+    return;
+  }
+  // Without a name, the error was already diagnosed while parsing.
+}
+
+void SemanticsIRFactory::ProcessSignature(Semantics::Function& function) {
+  function.type_ = BuildFunctionType(function.decl_node());
+}
+
+void SemanticsIRFactory::ProcessImport(const SemanticsInterface& interface) {
+  // The type of each of the interface's types, by index, or none for one
+  // that names a struct field that no token of this file spells, which this
+  // file can't have values of. The interface lists a type after those it is
+  // made of.
+  llvm::SmallVector<std::optional<Semantics::TypeId>, 0> types;
+  types.reserve(interface.type_count());
+  for (int32_t type = 0; type != interface.type_count(); ++type) {
+    types.push_back(ImportType(interface, type, types));
+  }
+  for (int i = 0; i != interface.function_count(); ++i) {
+    // A name that no token spells can't be called, so it isn't imported.
+    llvm::StringRef name = interface.function_name(i);
+    llvm::Optional<TokenizedBuffer::Identifier> identifier =
+        tokens_->FindIdentifier(name);
+    std::optional<Semantics::TypeId> type = types[interface.function_type(i)];
+    if (!identifier || !type) {
+      continue;
+    }
+    // Names declared in this file, or imported earlier, take precedence.
+    semantics_.AddImportedFunction(*identifier, name, *type);
+  }
+}
+
+auto SemanticsIRFactory::ImportType(
+    const SemanticsInterface& interface, int32_t type,
+    llvm::ArrayRef<std::optional<Semantics::TypeId>> types)
+    -> std::optional<Semantics::TypeId> {
+  Semantics::TypeTable& table = semantics_.types_;
+  llvm::SmallVector<Semantics::TypeId> elements;
+  for (int i = 0; i != interface.element_count(type); ++i) {
+    std::optional<Semantics::TypeId> element =
+        types[interface.element(type, i)];
+    if (!element) {
+      return std::nullopt;
+    }
+    elements.push_back(*element);
+  }
+  Semantics::TypeKind kind = interface.type_kind(type);
+  switch (kind) {
+    case Semantics::TypeKind::Error:
+      return Semantics::TypeId::Error;
+    case Semantics::TypeKind::Bool:
+      return Semantics::TypeId::Bool;
+    case Semantics::TypeKind::Type:
+      return Semantics::TypeId::Type;
+    case Semantics::TypeKind::String:
+      return Semantics::TypeId::String;
+    case Semantics::TypeKind::Int:
+    case Semantics::TypeKind::UnsignedInt:
+    case Semantics::TypeKind::Float:
+      return table.GetSizedType(kind, interface.bit_width(type));
+    case Semantics::TypeKind::Tuple:
+      return table.GetTupleType(elements);
+    case Semantics::TypeKind::Struct: {
+      llvm::SmallVector<TokenizedBuffer::Identifier> field_names;
+      for (int i = 0; i != interface.element_count(type); ++i) {
+        llvm::Optional<TokenizedBuffer::Identifier> field_name =
+            tokens_->FindIdentifier(interface.field_name(type, i));
+        if (!field_name) {
+          return std::nullopt;
+        }
+        field_names.push_back(*field_name);
+      }
+      return table.GetStructType(field_names, elements);
+    }
+    case Semantics::TypeKind::Function:
+      if (std::optional<Semantics::TypeId> return_type =
+              types[interface.return_type(type)]) {
+        return table.GetFunctionType(elements, *return_type);
+      }
+      return std::nullopt;
+    case Semantics::TypeKind::Pointer:
+      if (std::optional<Semantics::TypeId> pointee =
+              types[interface.pointee(type)]) {
+        return table.GetPointerType(*pointee);
+      }
+      return std::nullopt;
+  }
+  llvm_unreachable("Unknown type kind!");
+}
+
+auto SemanticsIRFactory::BuildFunctionType(ParseTree::Node decl_node)
+    -> Semantics::TypeId {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  llvm::SmallVector<Semantics::TypeId> params;
+  // Without a return type, a function returns `()`.
+  Semantics::TypeId return_type = Semantics::TypeId::EmptyTuple;
+  for (ParseTree::Node child : parse_tree.children(decl_node)) {
+    ParseNodeKind kind = parse_tree.node_kind(child);
+    if (kind == ParseNodeKind::ParameterList()) {
+      for (ParseTree::Node param : parse_tree.children(child)) {
+        if (parse_tree.node_kind(param) != ParseNodeKind::PatternBinding()) {
+          continue;
+        }
+        // The type comes after the name, so it's visited first. A binding
+        // without one was diagnosed while parsing.
+        Semantics::TypeId type = Semantics::TypeId::Error;
+        for (ParseTree::Node part : parse_tree.children(param)) {
+          if (parse_tree.node_kind(part) != ParseNodeKind::DeclaredName()) {
+            type = BuildType(part);
+          }
+          break;
+        }
+        params.push_back(type);
+      }
+    } else if (kind == ParseNodeKind::ReturnType()) {
+      return_type = Semantics::TypeId::Error;
+      for (ParseTree::Node type : parse_tree.children(child)) {
+        return_type = BuildType(type);
+      }
+    }
+  }
+  // Parameters are visited last to first.
+  std::reverse(params.begin(), params.end());
+  return semantics_.types_.GetFunctionType(params, return_type);
+}
+
+auto SemanticsIRFactory::BuildType(ParseTree::Node node) -> Semantics::TypeId {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  Semantics::TypeTable& types = semantics_.types_;
+  ParseNodeKind kind = parse_tree.node_kind(node);
+  if (kind == ParseNodeKind::Literal()) {
+    TokenizedBuffer::Token token = parse_tree.node_token(node);
+    TokenKind token_kind = tokens_->GetKind(token);
+    if (token_kind == TokenKind::StringTypeLiteral()) {
+      return Semantics::TypeId::String;
+    }
+    if (token_kind == TokenKind::Bool()) {
+      return Semantics::TypeId::Bool;
+    }
+    if (token_kind == TokenKind::Type()) {
+      return Semantics::TypeId::Type;
+    }
+    if (!token_kind.IsSizedTypeLiteral()) {
+      return Semantics::TypeId::Error;
+    }
+    llvm::APInt bit_width = tokens_->GetTypeLiteralSize(token);
+    Semantics::TypeKind type_kind =
+        token_kind == TokenKind::IntegerTypeLiteral() ? Semantics::TypeKind::Int
+        : token_kind == TokenKind::UnsignedIntegerTypeLiteral()
+            ? Semantics::TypeKind::UnsignedInt
+            : Semantics::TypeKind::Float;
+    // LLVM can't represent wider integers, so lowering would crash on them.
+    if (bit_width.ugt(llvm::IntegerType::MAX_INT_BITS)) {
+      if (type_kind != Semantics::TypeKind::Float) {
+        emitter_.Emit(token, IntegerTypeTooWide,
+                      llvm::IntegerType::MAX_INT_BITS);
+        semantics_.has_errors_ = true;
+      }
+      return Semantics::TypeId::Error;
+    }
+    int32_t width = bit_width.getZExtValue();
+    // Only the widths of IEEE formats name floating-point types.
+    if (type_kind == Semantics::TypeKind::Float && width != 16 &&
+        width != 32 && width != 64 && width != 128) {
+      return Semantics::TypeId::Error;
+    }
+    return types.GetSizedType(type_kind, width);
+  }
+  if (kind == ParseNodeKind::ParenExpression()) {
+    for (ParseTree::Node child : parse_tree.children(node)) {
+      if (parse_tree.node_kind(child) != ParseNodeKind::ParenExpressionEnd()) {
+        return BuildType(child);
+      }
+    }
+    return Semantics::TypeId::Error;
+  }
+  if (kind == ParseNodeKind::TupleLiteral()) {
+    llvm::SmallVector<Semantics::TypeId> elements;
+    for (ParseTree::Node child : parse_tree.children(node)) {
+      ParseNodeKind child_kind = parse_tree.node_kind(child);
+      if (child_kind != ParseNodeKind::TupleLiteralComma() &&
+          child_kind != ParseNodeKind::TupleLiteralEnd()) {
+        elements.push_back(BuildType(child));
+      }
+    }
+    std::reverse(elements.begin(), elements.end());
+    return types.GetTupleType(elements);
+  }
+  if (kind == ParseNodeKind::StructTypeLiteral() ||
+      kind == ParseNodeKind::StructLiteral()) {
+    // Only `{}` is both, and it's taken as the type.
+    llvm::SmallVector<TokenizedBuffer::Identifier> field_names;
+    llvm::SmallVector<Semantics::TypeId> field_types;
+    for (ParseTree::Node field : parse_tree.children(node)) {
+      ParseNodeKind field_kind = parse_tree.node_kind(field);
+      if (field_kind == ParseNodeKind::StructComma() ||
+          field_kind == ParseNodeKind::StructEnd()) {
+        continue;
+      }
+      if (field_kind != ParseNodeKind::StructFieldType()) {
+        return Semantics::TypeId::Error;
+      }
+      // The field's type is visited before its designator, whose only child
+      // is the name.
+      llvm::Optional<Semantics::TypeId> field_type;
+      for (ParseTree::Node part : parse_tree.children(field)) {
+        if (!field_type) {
+          field_type = BuildType(part);
+          continue;
+        }
+        for (ParseTree::Node name : parse_tree.children(part)) {
+          field_names.push_back(
+              tokens_->GetIdentifier(parse_tree.node_token(name)));
+        }
+      }
+      if (!field_type || field_names.size() != field_types.size() + 1) {
+        return Semantics::TypeId::Error;
+      }
+      field_types.push_back(*field_type);
+    }
+    std::reverse(field_names.begin(), field_names.end());
+    std::reverse(field_types.begin(), field_types.end());
+    return types.GetStructType(field_names, field_types);
+  }
+  if (kind == ParseNodeKind::PostfixOperator() &&
+      tokens_->GetKind(parse_tree.node_token(node)) == TokenKind::Star()) {
+    for (ParseTree::Node operand : parse_tree.children(node)) {
+      return types.GetPointerType(BuildType(operand));
+    }
+  }
+  // Names of types, and other expressions that evaluate to types, aren't
+  // evaluated yet.
+  return Semantics::TypeId::Error;
+}
+
+void SemanticsIRFactory::ProcessFunctionBodies(TaskScheduler* scheduler) {
+  // Bodies are handed out in batches, so that small functions don't each
+  // cost a task.
+  constexpr int FunctionsPerBatch = 64;
+  auto& functions = semantics_.functions_;
+  int count = functions.size();
+  int num_batches = (count + FunctionsPerBatch - 1) / FunctionsPerBatch;
+
+  // Each batch's instructions go in a table of its own, which are then added
+  // to the IR in declaration order however the batches ran.
+  llvm::SmallVector<Batch, 0> batches(num_batches);
+  auto process_batch = [&](int batch_index) {
+    Batch& batch = batches[batch_index];
+    TokenDiagnosticEmitter emitter(translator_, batch.consumer);
+    int end = std::min(count, (batch_index + 1) * FunctionsPerBatch);
+    for (int i = batch_index * FunctionsPerBatch; i != end; ++i) {
+      // A cancelled batch still ends every body, so that the rest are empty.
+      if (!batch.cancelled && cancellation_ != nullptr &&
+          cancellation_->cancelled()) {
+        batch.cancelled = true;
+      }
+      if (!batch.cancelled) {
+        ProcessFunctionBody(functions[i], batch, emitter);
+      }
+      batch.body_ends.push_back(batch.insts.size());
+    }
+  };
+  if (scheduler == nullptr || num_batches <= 1) {
+    for (int i = 0; i != num_batches; ++i) {
+      process_batch(i);
+    }
+  } else {
+    ParallelFor(*scheduler, num_batches, process_batch);
+  }
+
+  Semantics::InstTable& insts = semantics_.insts_;
+  for (int batch_index = 0; batch_index != num_batches; ++batch_index) {
+    Batch& batch = batches[batch_index];
+    semantics_.cancelled_ |= batch.cancelled;
+    int32_t offset = insts.size();
+    int32_t begin = 0;
+    for (int i = 0; i != static_cast<int>(batch.body_ends.size()); ++i) {
+      Semantics::Function& function =
+          functions[batch_index * FunctionsPerBatch + i];
+      function.body_begin_ = offset + begin;
+      function.body_end_ = offset + batch.body_ends[i];
+      begin = batch.body_ends[i];
+    }
+    llvm::SmallVector<int32_t, 0> constant_indices;
+    for (const llvm::APInt& value : batch.integer_constants) {
+      constant_indices.push_back(semantics_.AddIntegerConstant(value));
+    }
+    llvm::SmallVector<int32_t, 0> string_indices;
+    for (llvm::CachedHashStringRef value : batch.string_constants) {
+      string_indices.push_back(semantics_.AddStringConstant(value));
+    }
+    for (int32_t inst = 0; inst != batch.insts.size(); ++inst) {
+      llvm::ArrayRef<int32_t> batch_operands = batch.insts.operands(inst);
+      llvm::SmallVector<int32_t, 1> operands(batch_operands.begin(),
+                                             batch_operands.end());
+      if (batch.insts.kind(inst) == Semantics::InstKind::IntegerConstant) {
+        operands[0] = constant_indices[operands[0]];
+      } else if (batch.insts.kind(inst) ==
+                 Semantics::InstKind::StringConstant) {
+        operands[0] = string_indices[operands[0]];
+      }
+      insts.Add(batch.insts.kind(inst), batch.insts.type(inst),
+                batch.insts.node(inst), operands);
+    }
+    for (Diagnostic& diagnostic : batch.consumer.diagnostics()) {
+      consumer_->HandleDiagnostic(std::move(diagnostic));
+      semantics_.has_errors_ = true;
+    }
+  }
+}
+
+void SemanticsIRFactory::ProcessFunctionBody(
+    const Semantics::Function& function, Batch& batch,
+    TokenDiagnosticEmitter& emitter) const {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  llvm::Optional<ParseTree::Node> body = function.body_node();
+  if (!body) {
+    return;
+  }
+  int32_t body_begin = batch.insts.size();
+  FoldedValues folded;
+  // The instruction whose value each expression is, by node index.
+  llvm::DenseMap<int32_t, int32_t> values;
+  for (ParseTree::Node node : parse_tree.postorder(*body)) {
+    if (FoldExpression(node, folded, emitter)) {
+      continue;
+    }
+    if (parse_tree.node_kind(node) == ParseNodeKind::Literal()) {
+      TokenizedBuffer::Token token = parse_tree.node_token(node);
+      if (tokens_->GetKind(token) == TokenKind::StringLiteral()) {
+        int32_t index = batch.string_constants.size();
+        batch.string_constants.push_back(
+            tokens_->GetHashedStringLiteral(token));
+        values[node.index()] =
+            batch.insts.Add(Semantics::InstKind::StringConstant,
+                            Semantics::TypeId::String, node, {index});
+      }
+      continue;
+    }
+    // The node isn't constant itself, so the constants it uses are emitted
+    // before it. Children are visited last to first, so they're collected to
+    // be emitted in source order.
+    llvm::SmallVector<ParseTree::Node> constants;
+    for (ParseTree::Node child : parse_tree.children(node)) {
+      if (folded.count(child.index()) != 0) {
+        constants.push_back(child);
+      }
+    }
+    for (ParseTree::Node constant : llvm::reverse(constants)) {
+      auto it = folded.find(constant.index());
+      if (it->second) {
+        int32_t index = batch.integer_constants.size();
+        batch.integer_constants.push_back(*it->second);
+        values[constant.index()] =
+            batch.insts.Add(Semantics::InstKind::IntegerConstant,
+                            integer_type_, constant, {index});
+      }
+      folded.erase(it);
+    }
+
+    ParseNodeKind kind = parse_tree.node_kind(node);
+    if (kind == ParseNodeKind::TupleLiteral() ||
+        kind == ParseNodeKind::StructLiteral()) {
+      if (std::optional<int32_t> inst =
+              BuildAggregate(node, values, body_begin, batch)) {
+        values[node.index()] = *inst;
+      }
+      continue;
+    }
+    if (kind != ParseNodeKind::CallExpression()) {
+      continue;
+    }
+    // Children are visited last to first, so the callee comes last.
+    llvm::SmallVector<ParseTree::Node> args;
+    for (ParseTree::Node child : parse_tree.children(node)) {
+      ParseNodeKind child_kind = parse_tree.node_kind(child);
+      if (child_kind != ParseNodeKind::CallExpressionComma() &&
+          child_kind != ParseNodeKind::CallExpressionEnd()) {
+        args.push_back(child);
+      }
+    }
+    if (args.empty()) {
+      continue;
+    }
+    ParseTree::Node callee = args.pop_back_val();
+    std::reverse(args.begin(), args.end());
+    if (parse_tree.node_kind(callee) != ParseNodeKind::NameReference()) {
+      continue;
+    }
+    // Names that aren't declared at file scope may be declared in the body,
+    // which isn't analyzed yet, so they're left alone rather than
+    // diagnosed.
+    std::optional<SemanticsIR::Node> entity = semantics_.root_block_.Lookup(
+        tokens_->GetIdentifier(parse_tree.node_token(callee)));
+    if (!entity) {
+      continue;
+    }
+    std::optional<int32_t> index = semantics_.GetFunctionIndex(*entity);
+    if (!index) {
+      continue;
+    }
+    const Semantics::Function& callee_function = semantics_.functions_[*index];
+    const Semantics::TypeTable& types = semantics_.types_;
+    llvm::ArrayRef<Semantics::TypeId> params =
+        types.elements(callee_function.type());
+    if (args.size() != params.size()) {
+      auto builder =
+          emitter.Build(parse_tree.node_token(node), CallArgCountMismatch,
+                        static_cast<int>(args.size()),
+                        static_cast<int>(params.size()));
+      // An imported function is declared in another file, which there's no
+      // token of to point at.
+      if (!callee_function.is_imported()) {
+        builder.Note(parse_tree.node_token(callee_function.name_node()),
+                     InCallToFunction);
+      }
+      builder.Emit();
+      continue;
+    }
+    llvm::SmallVector<int32_t> operands = {*index};
+    bool has_error = false;
+    for (int i = 0; i != static_cast<int>(args.size()); ++i) {
+      ParseTree::Node arg = args[i];
+      auto it = values.find(arg.index());
+      Semantics::TypeId param_type = params[i];
+      if (it == values.end() || param_type == Semantics::TypeId::Error) {
+        operands.push_back(-1);
+        continue;
+      }
+      Semantics::TypeId arg_type = batch.insts.type(it->second);
+      if (arg_type != param_type) {
+        auto builder =
+            emitter.Build(parse_tree.node_token(arg),
+                          ImplicitAsConversionFailure, GetTypeName(arg_type));
+        if (!callee_function.is_imported()) {
+          builder.Note(
+              parse_tree.node_token(GetParameterNode(callee_function, i)),
+              InCallToFunctionParam, GetTypeName(param_type));
+        }
+        builder.Emit();
+        has_error = true;
+        continue;
+      }
+      operands.push_back(it->second - body_begin);
+    }
+    if (has_error) {
+      continue;
+    }
+    values[node.index()] = batch.insts.Add(
+        Semantics::InstKind::Call, types.return_type(callee_function.type()),
+        node, operands);
+  }
+}
+
+auto SemanticsIRFactory::BuildAggregate(
+    ParseTree::Node node, const llvm::DenseMap<int32_t, int32_t>& values,
+    int32_t body_begin, Batch& batch) const -> std::optional<int32_t> {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  bool is_struct = parse_tree.node_kind(node) == ParseNodeKind::StructLiteral();
+  llvm::SmallVector<TokenizedBuffer::Identifier> field_names;
+  llvm::SmallVector<int32_t> elements;
+  llvm::SmallVector<Semantics::TypeId> element_types;
+  for (ParseTree::Node child : parse_tree.children(node)) {
+    ParseNodeKind child_kind = parse_tree.node_kind(child);
+    if (child_kind == ParseNodeKind::TupleLiteralComma() ||
+        child_kind == ParseNodeKind::TupleLiteralEnd() ||
+        child_kind == ParseNodeKind::StructComma() ||
+        child_kind == ParseNodeKind::StructEnd()) {
+      continue;
+    }
+    llvm::Optional<ParseTree::Node> value = child;
+    if (is_struct) {
+      if (child_kind != ParseNodeKind::StructFieldValue()) {
+        return std::nullopt;
+      }
+      // The field's value is visited before its designator, whose only child
+      // is the name.
+      value = llvm::None;
+      for (ParseTree::Node part : parse_tree.children(child)) {
+        if (!value) {
+          value = part;
+          continue;
+        }
+        for (ParseTree::Node name : parse_tree.children(part)) {
+          field_names.push_back(
+              tokens_->GetIdentifier(parse_tree.node_token(name)));
+        }
+      }
+      if (!value || field_names.size() != elements.size() + 1) {
+        return std::nullopt;
+      }
+    }
+    auto it = values.find(value->index());
+    if (it == values.end()) {
+      return std::nullopt;
+    }
+    elements.push_back(it->second - body_begin);
+    element_types.push_back(batch.insts.type(it->second));
+  }
+  // Children are visited last to first.
+  std::reverse(field_names.begin(), field_names.end());
+  std::reverse(elements.begin(), elements.end());
+  std::reverse(element_types.begin(), element_types.end());
+  const Semantics::TypeTable& types = semantics_.types_;
+  std::optional<Semantics::TypeId> type =
+      is_struct ? types.FindStructType(field_names, element_types)
+                : types.FindTupleType(element_types);
+  if (!type) {
+    return std::nullopt;
+  }
+  return batch.insts.Add(is_struct ? Semantics::InstKind::StructValue
+                                   : Semantics::InstKind::TupleValue,
+                         *type, node, elements);
+}
+
+void SemanticsIRFactory::BuildFunctionBody(
+    const Semantics::Function& function, Semantics::InstTable& insts,
+    llvm::SmallVectorImpl<llvm::APInt>& integer_constants,
+    llvm::SmallVectorImpl<llvm::StringRef>& string_constants,
+    llvm::SmallVectorImpl<Diagnostic>& diagnostics) {
+  Batch batch;
+  TokenDiagnosticEmitter emitter(translator_, batch.consumer);
+  ProcessFunctionBody(function, batch, emitter);
+  insts = std::move(batch.insts);
+  integer_constants.append(batch.integer_constants.begin(),
+                           batch.integer_constants.end());
+  for (llvm::CachedHashStringRef value : batch.string_constants) {
+    string_constants.push_back(value.val());
+  }
+  for (Diagnostic& diagnostic : batch.consumer.diagnostics()) {
+    diagnostics.push_back(std::move(diagnostic));
+  }
+}
+
+auto SemanticsIRFactory::FindCallees(const Semantics::Function& function) const
+    -> llvm::SmallVector<Callee> {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  llvm::SmallVector<Callee> callees;
+  llvm::Optional<ParseTree::Node> body = function.body_node();
+  if (!body) {
+    return callees;
+  }
+  for (ParseTree::Node node : parse_tree.postorder(*body)) {
+    if (parse_tree.node_kind(node) != ParseNodeKind::CallExpression()) {
+      continue;
+    }
+    // Children are visited last to first, so the callee comes last.
+    llvm::Optional<ParseTree::Node> callee;
+    for (ParseTree::Node child : parse_tree.children(node)) {
+      ParseNodeKind child_kind = parse_tree.node_kind(child);
+      if (child_kind != ParseNodeKind::CallExpressionComma() &&
+          child_kind != ParseNodeKind::CallExpressionEnd()) {
+        callee = child;
+      }
+    }
+    if (!callee ||
+        parse_tree.node_kind(*callee) != ParseNodeKind::NameReference()) {
+      continue;
+    }
+    TokenizedBuffer::Identifier name =
+        tokens_->GetIdentifier(parse_tree.node_token(*callee));
+    callees.push_back({name, LookupFunction(name)});
+  }
+  return callees;
+}
+
+auto SemanticsIRFactory::LookupFunction(TokenizedBuffer::Identifier name) const
+    -> std::optional<int32_t> {
+  if (std::optional<SemanticsIR::Node> entity =
+          semantics_.root_block_.Lookup(name)) {
+    return semantics_.GetFunctionIndex(*entity);
+  }
+  return std::nullopt;
+}
+
+auto SemanticsIRFactory::GetParameterNode(const Semantics::Function& function,
+                                          int index) const -> ParseTree::Node {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  // Parameters are visited last to first, so this collects them all.
+  llvm::SmallVector<ParseTree::Node> params;
+  for (ParseTree::Node child : parse_tree.children(function.decl_node())) {
+    if (parse_tree.node_kind(child) != ParseNodeKind::ParameterList()) {
+      continue;
+    }
+    for (ParseTree::Node param : parse_tree.children(child)) {
+      if (parse_tree.node_kind(param) == ParseNodeKind::PatternBinding()) {
+        params.push_back(param);
+      }
+    }
+  }
+  COCKTAIL_CHECK(index < static_cast<int>(params.size()))
+      << "Function has no parameter " << index << "!";
+  return params[params.size() - 1 - index];
+}
+
+auto SemanticsIRFactory::GetTypeName(Semantics::TypeId type) const
+    -> std::string {
+  std::string name;
+  llvm::raw_string_ostream out(name);
+  semantics_.types_.Print(out, type, *tokens_);
+  return name;
+}
+
+auto SemanticsIRFactory::FoldExpression(ParseTree::Node node,
+                                        FoldedValues& folded,
+                                        TokenDiagnosticEmitter& emitter) const
+    -> bool {
+  const ParseTree& parse_tree = *semantics_.parse_tree_;
+  ParseNodeKind kind = parse_tree.node_kind(node);
+  TokenizedBuffer::Token token = parse_tree.node_token(node);
+  TokenKind token_kind = tokens_->GetKind(token);
+  if (kind == ParseNodeKind::Literal()) {
+    if (token_kind != TokenKind::IntegerLiteral()) {
+      return false;
+    }
+    // Literals are never negative, so one that fits has a clear sign bit.
+    llvm::APInt value = tokens_->GetIntegerLiteral(token);
+    if (value.getActiveBits() >= static_cast<unsigned>(IntegerBitWidth)) {
+      emitter.Emit(token, IntegerLiteralTooLarge, IntegerBitWidth);
+      folded[node.index()] = std::nullopt;
+    } else {
+      folded[node.index()] = value.zextOrTrunc(IntegerBitWidth);
+    }
+    return true;
+  }
+
+  if (kind == ParseNodeKind::PrefixOperator()) {
+    if (token_kind != TokenKind::Minus()) {
+      return false;
+    }
+  } else if (kind == ParseNodeKind::InfixOperator()) {
+    if (!token_kind.IsOneOf({TokenKind::Plus(), TokenKind::Minus(),
+                             TokenKind::Star(), TokenKind::Slash(),
+                             TokenKind::Percent()})) {
+      return false;
+    }
+  } else if (kind != ParseNodeKind::ParenExpression()) {
+    return false;
+  }
+  // Operands are visited last to first.
+  llvm::SmallVector<ParseTree::Node, 2> operands;
+  for (ParseTree::Node child : parse_tree.children(node)) {
+    if (parse_tree.node_kind(child) == ParseNodeKind::ParenExpressionEnd()) {
+      continue;
+    }
+    if (folded.count(child.index()) == 0) {
+      return false;
+    }
+    operands.push_back(child);
+  }
+  std::reverse(operands.begin(), operands.end());
+  llvm::SmallVector<llvm::APInt, 2> values;
+  bool has_error = false;
+  for (ParseTree::Node operand : operands) {
+    auto it = folded.find(operand.index());
+    if (it->second) {
+      values.push_back(*it->second);
+    } else {
+      has_error = true;
+    }
+    folded.erase(it);
+  }
+  std::optional<llvm::APInt>& result = folded[node.index()];
+  if (has_error || values.empty()) {
+    // An operand was diagnosed, or the parentheses are empty, which was
+    // diagnosed while parsing.
+    return true;
+  }
+
+  bool overflow = false;
+  if (kind == ParseNodeKind::ParenExpression()) {
+    result = values[0];
+  } else if (kind == ParseNodeKind::PrefixOperator()) {
+    result = llvm::APInt(IntegerBitWidth, 0).ssub_ov(values[0], overflow);
+  } else if (token_kind == TokenKind::Plus()) {
+    result = values[0].sadd_ov(values[1], overflow);
+  } else if (token_kind == TokenKind::Minus()) {
+    result = values[0].ssub_ov(values[1], overflow);
+  } else if (token_kind == TokenKind::Star()) {
+    result = values[0].smul_ov(values[1], overflow);
+  } else if (values[1].isZero()) {
+    emitter.Emit(token, DivisionByZero, token_kind);
+    return true;
+  } else if (token_kind == TokenKind::Slash()) {
+    result = values[0].sdiv_ov(values[1], overflow);
+  } else {
+    result = values[0].srem(values[1]);
+  }
+  if (overflow) {
+    emitter.Emit(token, IntegerOverflow, token_kind, IntegerBitWidth);
+    result = std::nullopt;
+  }
+  return true;
+}
 
-}  // namespace Cocktail
\ No newline at end of file
+}  // namespace Cocktail
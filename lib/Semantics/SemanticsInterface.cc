@@ -0,0 +1,407 @@
+#include "Cocktail/Semantics/SemanticsInterface.h"
+
+#include <cstring>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/xxhash.h"
+
+namespace Cocktail {
+
+// The serialized format is a fixed header followed by five tables, each of
+// little-endian 32-bit fields:
+//
+// - The strings, each its offset in the string data and its size.
+// - The types, each its kind, its payload as in `TypeTable`, and where its
+//   elements end in the element table. They start where the previous type's
+//   end. A struct has two elements for each field: its type, then the index
+//   of its name among the strings.
+// - The elements, each the index of a type before the one it is of.
+// - The functions, each the index of its name among the strings, then of its
+//   type.
+// - The string data, which is the text of every name, each once.
+//
+// The header holds a hash of everything after that hash, which both rejects
+// corrupted data and tells whether an interface changed.
+
+namespace {
+
+constexpr llvm::StringLiteral Magic = "CKSEMAPI";
+
+// The magic, the hash of the rest, the version, the number of strings, types,
+// elements and functions, and the size of the string data.
+constexpr uint64_t HeaderSize = 40;
+
+// Where the data that the hash is of starts.
+constexpr uint64_t HashedOffset = 16;
+
+constexpr uint64_t StringSize = 2 * sizeof(uint32_t);
+constexpr uint64_t TypeSize = 3 * sizeof(uint32_t);
+constexpr uint64_t ElementSize = sizeof(uint32_t);
+constexpr uint64_t FunctionSize = 2 * sizeof(uint32_t);
+
+template <typename T>
+auto Store(char* out, T value) -> void {
+  llvm::support::endian::write<T, llvm::support::little>(out, value);
+}
+
+template <typename T>
+auto Load(const char* in) -> T {
+  return llvm::support::endian::read<T, llvm::support::little,
+                                     llvm::support::unaligned>(in);
+}
+
+auto Load32(llvm::StringRef data, uint64_t offset) -> uint32_t {
+  return Load<uint32_t>(data.data() + offset);
+}
+
+// Collects the tables of an interface as it's written.
+class InterfaceWriter {
+ public:
+  explicit InterfaceWriter(const SemanticsIR& semantics_ir)
+      : semantics_ir_(&semantics_ir) {}
+
+  // Adds `type` and the types it is made of, if they aren't added yet, and
+  // returns the index of `type`.
+  auto AddType(Semantics::TypeId type) -> uint32_t;
+
+  // Returns the index of `text`, adding it if it's new.
+  auto AddString(llvm::StringRef text) -> uint32_t;
+
+  auto AddFunction(const Semantics::Function& function) -> void {
+    uint32_t name = AddString(function.name());
+    functions_.append({name, AddType(function.type())});
+  }
+
+  auto Write(llvm::raw_ostream& output_stream) -> void;
+
+ private:
+  const SemanticsIR* semantics_ir_;
+  llvm::SmallVector<uint32_t, 0> strings_;
+  llvm::StringMap<uint32_t> string_indices_;
+  std::string string_data_;
+  llvm::SmallVector<uint32_t, 0> types_;
+  llvm::DenseMap<int32_t, uint32_t> type_indices_;
+  llvm::SmallVector<uint32_t, 0> elements_;
+  llvm::SmallVector<uint32_t, 0> functions_;
+};
+
+auto InterfaceWriter::AddType(Semantics::TypeId type) -> uint32_t {
+  auto it = type_indices_.find(static_cast<int32_t>(type));
+  if (it != type_indices_.end()) {
+    return it->second;
+  }
+  const Semantics::TypeTable& table = semantics_ir_->types();
+  Semantics::TypeKind kind = table.kind(type);
+  // The types a type is made of go first, so that reading the interface
+  // back only ever looks backwards.
+  uint32_t payload = 0;
+  switch (kind) {
+    case Semantics::TypeKind::Int:
+    case Semantics::TypeKind::UnsignedInt:
+    case Semantics::TypeKind::Float:
+      payload = table.bit_width(type);
+      break;
+    case Semantics::TypeKind::Function:
+      payload = AddType(table.return_type(type));
+      break;
+    case Semantics::TypeKind::Pointer:
+      payload = AddType(table.pointee(type));
+      break;
+    default:
+      break;
+  }
+  llvm::SmallVector<uint32_t> elements;
+  llvm::ArrayRef<Semantics::TypeId> element_types = table.elements(type);
+  for (int i = 0; i != static_cast<int>(element_types.size()); ++i) {
+    elements.push_back(AddType(element_types[i]));
+    if (kind == Semantics::TypeKind::Struct) {
+      elements.push_back(AddString(semantics_ir_->tokens().GetIdentifierText(
+          table.field_names(type)[i])));
+    }
+  }
+  elements_.append(elements.begin(), elements.end());
+  uint32_t index = types_.size() / 3;
+  types_.append({static_cast<uint32_t>(kind), payload,
+                 static_cast<uint32_t>(elements_.size())});
+  type_indices_[static_cast<int32_t>(type)] = index;
+  return index;
+}
+
+auto InterfaceWriter::AddString(llvm::StringRef text) -> uint32_t {
+  uint32_t index = strings_.size() / 2;
+  auto [it, inserted] = string_indices_.insert({text, index});
+  if (inserted) {
+    strings_.append({static_cast<uint32_t>(string_data_.size()),
+                     static_cast<uint32_t>(text.size())});
+    string_data_ += text;
+  }
+  return it->second;
+}
+
+auto InterfaceWriter::Write(llvm::raw_ostream& output_stream) -> void {
+  llvm::SmallVector<char, 0> data;
+  data.resize(HeaderSize +
+              (strings_.size() + types_.size() + elements_.size() +
+               functions_.size()) *
+                  sizeof(uint32_t) +
+              string_data_.size());
+
+  char* out = data.data();
+  auto write = [&](auto value) {
+    Store(out, value);
+    out += sizeof(value);
+  };
+  std::memcpy(out, Magic.data(), Magic.size());
+  out += Magic.size() + sizeof(uint64_t);
+  write(SemanticsInterface::SerializationVersion);
+  write(static_cast<uint32_t>(strings_.size() / 2));
+  write(static_cast<uint32_t>(types_.size() / 3));
+  write(static_cast<uint32_t>(elements_.size()));
+  write(static_cast<uint32_t>(functions_.size() / 2));
+  write(static_cast<uint32_t>(string_data_.size()));
+  COCKTAIL_CHECK(out == data.data() + HeaderSize) << "Unexpected header size!";
+
+  for (const auto* table : {&strings_, &types_, &elements_, &functions_}) {
+    for (uint32_t field : *table) {
+      write(field);
+    }
+  }
+  std::memcpy(out, string_data_.data(), string_data_.size());
+
+  llvm::StringRef hashed(data.data() + HashedOffset,
+                         data.size() - HashedOffset);
+  Store<uint64_t>(data.data() + Magic.size(), llvm::xxHash64(hashed));
+  output_stream << llvm::StringRef(data.data(), data.size());
+}
+
+}  // namespace
+
+auto SemanticsInterface::Serialize(const SemanticsIR& semantics_ir,
+                                   llvm::raw_ostream& output_stream) -> void {
+  InterfaceWriter writer(semantics_ir);
+  for (const Semantics::Function& function : semantics_ir.functions()) {
+    // Imported functions are part of the interfaces they're from.
+    if (function.is_imported()) {
+      continue;
+    }
+    writer.AddFunction(function);
+  }
+  writer.Write(output_stream);
+}
+
+auto SemanticsInterface::Deserialize(llvm::StringRef data)
+    -> llvm::Optional<SemanticsInterface> {
+  if (data.size() < HeaderSize || !data.startswith(Magic)) {
+    return llvm::None;
+  }
+  const char* in = data.data() + Magic.size();
+  auto read = [&](auto value) {
+    value = Load<decltype(value)>(in);
+    in += sizeof(value);
+    return value;
+  };
+  uint64_t hash = read(uint64_t{});
+  if (read(uint32_t{}) != SerializationVersion ||
+      hash != llvm::xxHash64(data.drop_front(HashedOffset))) {
+    return llvm::None;
+  }
+  uint64_t num_strings = read(uint32_t{});
+  uint64_t num_types = read(uint32_t{});
+  uint64_t num_elements = read(uint32_t{});
+  uint64_t num_functions = read(uint32_t{});
+  uint64_t string_data_size = read(uint32_t{});
+  if (num_strings > INT32_MAX || num_types > INT32_MAX ||
+      num_functions > INT32_MAX ||
+      data.size() != HeaderSize + num_strings * StringSize +
+                         num_types * TypeSize + num_elements * ElementSize +
+                         num_functions * FunctionSize + string_data_size) {
+    return llvm::None;
+  }
+
+  SemanticsInterface interface(data);
+  interface.hash_ = hash;
+  interface.string_count_ = num_strings;
+  interface.type_count_ = num_types;
+  interface.function_count_ = num_functions;
+  interface.strings_offset_ = HeaderSize;
+  interface.types_offset_ =
+      interface.strings_offset_ + num_strings * StringSize;
+  interface.elements_offset_ = interface.types_offset_ + num_types * TypeSize;
+  interface.functions_offset_ =
+      interface.elements_offset_ + num_elements * ElementSize;
+  interface.string_data_offset_ =
+      interface.functions_offset_ + num_functions * FunctionSize;
+
+  // Each table is checked once here, so that the accessors never go out of
+  // bounds and every type only refers to those before it.
+  for (uint64_t i = 0; i != num_strings; ++i) {
+    uint64_t offset = Load32(data, interface.strings_offset_ + i * StringSize);
+    uint64_t size = Load32(data, interface.strings_offset_ + i * StringSize +
+                                     sizeof(uint32_t));
+    if (offset + size > string_data_size) {
+      return llvm::None;
+    }
+  }
+  uint32_t elements_begin = 0;
+  for (uint64_t i = 0; i != num_types; ++i) {
+    uint64_t type_offset = interface.types_offset_ + i * TypeSize;
+    uint32_t kind = Load32(data, type_offset);
+    uint32_t payload = Load32(data, type_offset + sizeof(uint32_t));
+    uint32_t elements_end = Load32(data, type_offset + 2 * sizeof(uint32_t));
+    if (kind > static_cast<uint32_t>(Semantics::TypeKind::Pointer) ||
+        elements_end < elements_begin || elements_end > num_elements) {
+      return llvm::None;
+    }
+    uint32_t count = elements_end - elements_begin;
+    switch (static_cast<Semantics::TypeKind>(kind)) {
+      case Semantics::TypeKind::Int:
+      case Semantics::TypeKind::UnsignedInt:
+        // Checked as `BuildType` does, since lowering can't go past it.
+        if (payload == 0 || payload > llvm::IntegerType::MAX_INT_BITS ||
+            count != 0) {
+          return llvm::None;
+        }
+        break;
+      case Semantics::TypeKind::Float:
+        if ((payload != 16 && payload != 32 && payload != 64 &&
+             payload != 128) ||
+            count != 0) {
+          return llvm::None;
+        }
+        break;
+      case Semantics::TypeKind::Function:
+        if (payload >= i) {
+          return llvm::None;
+        }
+        break;
+      case Semantics::TypeKind::Pointer:
+        if (payload >= i || count != 0) {
+          return llvm::None;
+        }
+        break;
+      case Semantics::TypeKind::Tuple:
+        break;
+      case Semantics::TypeKind::Struct:
+        if (count % 2 != 0) {
+          return llvm::None;
+        }
+        break;
+      default:
+        if (count != 0) {
+          return llvm::None;
+        }
+        break;
+    }
+    for (uint32_t j = 0; j != count; ++j) {
+      uint32_t element =
+          Load32(data, interface.elements_offset_ +
+                           (elements_begin + j) * ElementSize);
+      bool is_field_name =
+          kind == static_cast<uint32_t>(Semantics::TypeKind::Struct) &&
+          j % 2 == 1;
+      if (element >= (is_field_name ? num_strings : i)) {
+        return llvm::None;
+      }
+    }
+    elements_begin = elements_end;
+  }
+  if (elements_begin != num_elements) {
+    return llvm::None;
+  }
+  for (uint64_t i = 0; i != num_functions; ++i) {
+    uint64_t function_offset = interface.functions_offset_ + i * FunctionSize;
+    uint32_t name = Load32(data, function_offset);
+    uint32_t type = Load32(data, function_offset + sizeof(uint32_t));
+    if (name >= num_strings || type >= num_types ||
+        interface.type_kind(type) != Semantics::TypeKind::Function) {
+      return llvm::None;
+    }
+  }
+  return interface;
+}
+
+auto SemanticsInterface::function_name(int index) const -> llvm::StringRef {
+  COCKTAIL_DCHECK(index >= 0 && index < function_count_) << "Invalid function!";
+  return GetString(Load32(data_, functions_offset_ + index * FunctionSize));
+}
+
+auto SemanticsInterface::function_type(int index) const -> int32_t {
+  COCKTAIL_DCHECK(index >= 0 && index < function_count_) << "Invalid function!";
+  return Load32(data_,
+                functions_offset_ + index * FunctionSize + sizeof(uint32_t));
+}
+
+auto SemanticsInterface::type_kind(int32_t type) const -> Semantics::TypeKind {
+  COCKTAIL_DCHECK(type >= 0 && type < type_count_) << "Invalid type!";
+  return static_cast<Semantics::TypeKind>(
+      Load32(data_, types_offset_ + type * TypeSize));
+}
+
+auto SemanticsInterface::bit_width(int32_t type) const -> int32_t {
+  COCKTAIL_DCHECK(type_kind(type) == Semantics::TypeKind::Int ||
+                  type_kind(type) == Semantics::TypeKind::UnsignedInt ||
+                  type_kind(type) == Semantics::TypeKind::Float)
+      << "Type isn't sized!";
+  return Load32(data_, types_offset_ + type * TypeSize + sizeof(uint32_t));
+}
+
+auto SemanticsInterface::return_type(int32_t type) const -> int32_t {
+  COCKTAIL_DCHECK(type_kind(type) == Semantics::TypeKind::Function)
+      << "Type isn't a function!";
+  return Load32(data_, types_offset_ + type * TypeSize + sizeof(uint32_t));
+}
+
+auto SemanticsInterface::pointee(int32_t type) const -> int32_t {
+  COCKTAIL_DCHECK(type_kind(type) == Semantics::TypeKind::Pointer)
+      << "Type isn't a pointer!";
+  return Load32(data_, types_offset_ + type * TypeSize + sizeof(uint32_t));
+}
+
+auto SemanticsInterface::element_count(int32_t type) const -> int {
+  uint32_t end =
+      Load32(data_, types_offset_ + type * TypeSize + 2 * sizeof(uint32_t));
+  int count = end - GetElementsBegin(type);
+  return type_kind(type) == Semantics::TypeKind::Struct ? count / 2 : count;
+}
+
+auto SemanticsInterface::element(int32_t type, int index) const -> int32_t {
+  COCKTAIL_DCHECK(index >= 0 && index < element_count(type))
+      << "Invalid element!";
+  int stride = type_kind(type) == Semantics::TypeKind::Struct ? 2 : 1;
+  return Load32(data_,
+                elements_offset_ +
+                    (GetElementsBegin(type) + index * stride) * ElementSize);
+}
+
+auto SemanticsInterface::field_name(int32_t type, int index) const
+    -> llvm::StringRef {
+  COCKTAIL_DCHECK(type_kind(type) == Semantics::TypeKind::Struct)
+      << "Type isn't a struct!";
+  COCKTAIL_DCHECK(index >= 0 && index < element_count(type))
+      << "Invalid field!";
+  uint64_t element = GetElementsBegin(type) + index * 2 + 1;
+  return GetString(Load32(data_, elements_offset_ + element * ElementSize));
+}
+
+auto SemanticsInterface::GetString(uint32_t index) const -> llvm::StringRef {
+  uint64_t offset = strings_offset_ + index * StringSize;
+  return data_.substr(string_data_offset_ + Load32(data_, offset),
+                      Load32(data_, offset + sizeof(uint32_t)));
+}
+
+auto SemanticsInterface::GetElementsBegin(int32_t type) const -> uint32_t {
+  COCKTAIL_DCHECK(type >= 0 && type < type_count_) << "Invalid type!";
+  if (type == 0) {
+    return 0;
+  }
+  return Load32(data_, types_offset_ + (type - 1) * TypeSize +
+                           2 * sizeof(uint32_t));
+}
+
+}  // namespace Cocktail
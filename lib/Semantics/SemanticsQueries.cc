@@ -0,0 +1,198 @@
+#include "Cocktail/Semantics/SemanticsQueries.h"
+
+#include <algorithm>
+
+#include "Cocktail/Semantics/SemanticsIRFactory.h"
+#include "llvm/ADT/STLExtras.h"
+
+namespace Cocktail {
+
+SemanticsQueries::SemanticsQueries(TokenizedBuffer& tokens,
+                                   const ParseTree& parse_tree,
+                                   DiagnosticConsumer& consumer)
+    : tokens_(&tokens),
+      parse_tree_(&parse_tree),
+      consumer_(&consumer),
+      factory_(new SemanticsIRFactory(tokens, parse_tree, consumer)) {}
+
+SemanticsQueries::~SemanticsQueries() = default;
+
+auto SemanticsQueries::Update(TokenizedBuffer& tokens,
+                              const ParseTree& parse_tree,
+                              const ParseTree::TokenEdit& edit) -> void {
+  // The functions that end before the edit are parsed from the same tokens
+  // into the same nodes.
+  int kept = 0;
+  while (kept < static_cast<int>(function_ends_.size()) &&
+         function_ends_[kept] <= edit.first_token) {
+    ++kept;
+  }
+  llvm::SmallVector<int32_t> kept_decl_nodes;
+  for (const Semantics::Function& function :
+       llvm::makeArrayRef(factory_->semantics_.functions_).take_front(kept)) {
+    kept_decl_nodes.push_back(function.decl_node().index());
+  }
+  auto bodies = std::move(bodies_);
+
+  // The types are kept, along with their IDs. Identifiers before the edit
+  // are the same in the new tokens, so the types of the kept functions
+  // still mean the same thing.
+  std::unique_ptr<SemanticsIRFactory> previous = std::move(factory_);
+  tokens_ = &tokens;
+  parse_tree_ = &parse_tree;
+  factory_.reset(new SemanticsIRFactory(tokens, parse_tree, *consumer_));
+  factory_->semantics_.types_ = std::move(previous->semantics_.types_);
+  factory_->integer_type_ = factory_->semantics_.types_.GetSizedType(
+      Semantics::TypeKind::Int, SemanticsIRFactory::IntegerBitWidth);
+  declared_ = false;
+  function_ends_.clear();
+  has_type_.clear();
+  bodies_.clear();
+  if (kept == 0) {
+    return;
+  }
+
+  Declare();
+  kept = std::min(kept, static_cast<int>(bodies_.size()));
+  for (int i = 0; i != kept; ++i) {
+    if (factory_->semantics_.functions_[i].decl_node().index() !=
+        kept_decl_nodes[i]) {
+      kept = i;
+      break;
+    }
+  }
+  for (int i = 0; i != kept; ++i) {
+    if (!bodies[i]) {
+      continue;
+    }
+    // A body depends on the types of the functions it calls, which are
+    // only sure to be the same if they are kept too.
+    bool valid = llvm::all_of(bodies[i]->callees, [&](const auto& callee) {
+      return LookupFunction(callee.first) == callee.second &&
+             (!callee.second || *callee.second < kept);
+    });
+    if (valid) {
+      bodies_[i] = std::move(bodies[i]);
+    }
+  }
+}
+
+auto SemanticsQueries::Declare() -> void {
+  if (declared_) {
+    return;
+  }
+  declared_ = true;
+  ++stats_.declarations;
+  factory_->ProcessRoots();
+
+  // Roots are visited last to first, so each function ends where the root
+  // visited before its own starts.
+  llvm::SmallVector<std::pair<int32_t, int32_t>> root_starts;
+  int32_t next_start = tokens_->size();
+  for (ParseTree::Node root : parse_tree_->roots()) {
+    root_starts.push_back({root.index(), next_start});
+    for (ParseTree::Node node : parse_tree_->postorder(root)) {
+      next_start = std::min<int32_t>(
+          next_start, TokenizedBuffer::TokenIterator(
+                          parse_tree_->node_token(node)) -
+                          tokens_->tokens().begin());
+    }
+  }
+  std::reverse(root_starts.begin(), root_starts.end());
+  llvm::ArrayRef<Semantics::Function> functions =
+      factory_->semantics_.functions_;
+  for (const Semantics::Function& function : functions) {
+    const auto* root = llvm::partition_point(root_starts, [&](auto root) {
+      return root.first < function.decl_node().index();
+    });
+    function_ends_.push_back(root->second);
+  }
+  has_type_.resize(functions.size());
+  bodies_.resize(functions.size());
+}
+
+auto SemanticsQueries::functions() -> llvm::ArrayRef<Semantics::Function> {
+  Declare();
+  return factory_->semantics_.functions_;
+}
+
+auto SemanticsQueries::LookupFunction(TokenizedBuffer::Identifier name)
+    -> std::optional<int32_t> {
+  Declare();
+  return factory_->LookupFunction(name);
+}
+
+auto SemanticsQueries::FindFunction(ParseTree::Node node)
+    -> std::optional<int32_t> {
+  llvm::ArrayRef<Semantics::Function> declared = functions();
+  // A declaration's subtree ends with its own node in postorder.
+  const auto* function =
+      llvm::partition_point(declared, [&](const Semantics::Function& f) {
+        return f.decl_node().index() < node.index();
+      });
+  if (function == declared.end() ||
+      (*parse_tree_->postorder(function->decl_node()).begin()).index() >
+          node.index()) {
+    return std::nullopt;
+  }
+  return function - declared.begin();
+}
+
+auto SemanticsQueries::FunctionType(int32_t function) -> Semantics::TypeId {
+  Declare();
+  Semantics::Function& declared = factory_->semantics_.functions_[function];
+  if (!has_type_[function]) {
+    factory_->ProcessSignature(declared);
+    has_type_[function] = true;
+    ++stats_.signatures;
+  }
+  return declared.type();
+}
+
+auto SemanticsQueries::Body(int32_t function) -> const FunctionBody& {
+  Declare();
+  std::unique_ptr<BodyEntry>& entry = bodies_[function];
+  if (entry) {
+    return entry->body;
+  }
+  const Semantics::Function& declared =
+      factory_->semantics_.functions_[function];
+  entry = std::make_unique<BodyEntry>();
+  for (const SemanticsIRFactory::Callee& callee :
+       factory_->FindCallees(declared)) {
+    if (callee.function) {
+      FunctionType(*callee.function);
+    }
+    entry->callees.push_back({callee.name, callee.function});
+  }
+  FunctionBody& body = entry->body;
+  factory_->BuildFunctionBody(declared, body.insts, body.integer_constants,
+                              body.string_constants, body.diagnostics);
+  for (int32_t inst = 0; inst != body.insts.size(); ++inst) {
+    entry->insts_by_node[body.insts.node(inst).index()] = inst;
+  }
+  ++stats_.bodies;
+  return body;
+}
+
+auto SemanticsQueries::ExpressionType(ParseTree::Node node)
+    -> std::optional<Semantics::TypeId> {
+  std::optional<int32_t> function = FindFunction(node);
+  if (!function) {
+    return std::nullopt;
+  }
+  const FunctionBody& body = Body(*function);
+  const llvm::DenseMap<int32_t, int32_t>& insts_by_node =
+      bodies_[*function]->insts_by_node;
+  auto it = insts_by_node.find(node.index());
+  if (it == insts_by_node.end()) {
+    return std::nullopt;
+  }
+  return body.insts.type(it->second);
+}
+
+auto SemanticsQueries::types() const -> const Semantics::TypeTable& {
+  return factory_->semantics_.types_;
+}
+
+}  // namespace Cocktail
@@ -0,0 +1,258 @@
+#include "Cocktail/Semantics/TypeTable.h"
+
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/ErrorHandling.h"
+
+namespace Cocktail::Semantics {
+
+namespace {
+
+using IdentifierInfo = llvm::DenseMapInfo<TokenizedBuffer::Identifier>;
+
+}  // namespace
+
+TypeTable::TypeTable() {
+  // Interned in the order of their fixed IDs.
+  for (TypeKind kind :
+       {TypeKind::Error, TypeKind::Bool, TypeKind::Type, TypeKind::String}) {
+    Intern({.kind = kind});
+  }
+  TypeId empty_tuple = GetTupleType({});
+  COCKTAIL_CHECK(empty_tuple == TypeId::EmptyTuple)
+      << "Builtin types out of order!";
+}
+
+auto TypeTable::GetSizedType(TypeKind kind, int32_t bit_width) -> TypeId {
+  COCKTAIL_CHECK(IsSized(kind)) << "Kind isn't sized!";
+  return Intern({.kind = kind, .payload = bit_width});
+}
+
+auto TypeTable::GetTupleType(llvm::ArrayRef<TypeId> elements) -> TypeId {
+  return Intern({.kind = TypeKind::Tuple, .elements = elements});
+}
+
+auto TypeTable::GetStructType(
+    llvm::ArrayRef<TokenizedBuffer::Identifier> field_names,
+    llvm::ArrayRef<TypeId> field_types) -> TypeId {
+  COCKTAIL_CHECK(field_names.size() == field_types.size())
+      << "Every field needs a name and a type!";
+  return Intern({.kind = TypeKind::Struct,
+                 .elements = field_types,
+                 .field_names = field_names});
+}
+
+auto TypeTable::FindTupleType(llvm::ArrayRef<TypeId> elements) const
+    -> std::optional<TypeId> {
+  return Find({.kind = TypeKind::Tuple, .elements = elements});
+}
+
+auto TypeTable::FindStructType(
+    llvm::ArrayRef<TokenizedBuffer::Identifier> field_names,
+    llvm::ArrayRef<TypeId> field_types) const -> std::optional<TypeId> {
+  COCKTAIL_CHECK(field_names.size() == field_types.size())
+      << "Every field needs a name and a type!";
+  return Find({.kind = TypeKind::Struct,
+               .elements = field_types,
+               .field_names = field_names});
+}
+
+auto TypeTable::GetFunctionType(llvm::ArrayRef<TypeId> params,
+                                TypeId return_type) -> TypeId {
+  return Intern({.kind = TypeKind::Function,
+                 .payload = Index(return_type),
+                 .elements = params});
+}
+
+auto TypeTable::GetPointerType(TypeId pointee) -> TypeId {
+  return Intern({.kind = TypeKind::Pointer, .payload = Index(pointee)});
+}
+
+auto TypeTable::elements(TypeId type) const -> llvm::ArrayRef<TypeId> {
+  int32_t index = Index(type);
+  COCKTAIL_DCHECK(index >= 0 && index < size()) << "Invalid type!";
+  int32_t begin = index == 0 ? 0 : element_ends_[index - 1];
+  return llvm::makeArrayRef(elements_).slice(begin,
+                                             element_ends_[index] - begin);
+}
+
+auto TypeTable::field_names(TypeId type) const
+    -> llvm::ArrayRef<TokenizedBuffer::Identifier> {
+  COCKTAIL_DCHECK(kind(type) == TypeKind::Struct) << "Type isn't a struct!";
+  return llvm::makeArrayRef(field_names_)
+      .slice(payloads_[Index(type)], elements(type).size());
+}
+
+auto TypeTable::Print(llvm::raw_ostream& output, TypeId type,
+                      const TokenizedBuffer& tokens) const -> void {
+  switch (kind(type)) {
+    case TypeKind::Error:
+      output << "<error>";
+      return;
+    case TypeKind::Bool:
+      output << "bool";
+      return;
+    case TypeKind::Type:
+      output << "type";
+      return;
+    case TypeKind::String:
+      output << "String";
+      return;
+    case TypeKind::Int:
+      output << "i" << bit_width(type);
+      return;
+    case TypeKind::UnsignedInt:
+      output << "u" << bit_width(type);
+      return;
+    case TypeKind::Float:
+      output << "f" << bit_width(type);
+      return;
+    case TypeKind::Tuple: {
+      output << "(";
+      llvm::ListSeparator sep;
+      for (TypeId element : elements(type)) {
+        output << sep;
+        Print(output, element, tokens);
+      }
+      // A tuple of one element is spelled with a trailing comma.
+      if (elements(type).size() == 1) {
+        output << ",";
+      }
+      output << ")";
+      return;
+    }
+    case TypeKind::Struct: {
+      output << "{";
+      llvm::ListSeparator sep;
+      for (auto [name, field_type] :
+           llvm::zip(field_names(type), elements(type))) {
+        output << sep << "." << tokens.GetIdentifierText(name) << ": ";
+        Print(output, field_type, tokens);
+      }
+      output << "}";
+      return;
+    }
+    case TypeKind::Function: {
+      output << "fn (";
+      llvm::ListSeparator sep;
+      for (TypeId param : elements(type)) {
+        output << sep;
+        Print(output, param, tokens);
+      }
+      output << ") -> ";
+      Print(output, return_type(type), tokens);
+      return;
+    }
+    case TypeKind::Pointer:
+      Print(output, pointee(type), tokens);
+      output << "*";
+      return;
+  }
+  llvm_unreachable("Unknown type kind!");
+}
+
+auto TypeTable::memory_bytes() const -> int64_t {
+  return kinds_.capacity() * sizeof(TypeKind) +
+         (payloads_.capacity() + element_ends_.capacity() +
+          lookup_.capacity()) *
+             sizeof(int32_t) +
+         elements_.capacity() * sizeof(TypeId) +
+         field_names_.capacity() * sizeof(TokenizedBuffer::Identifier);
+}
+
+auto TypeTable::HashKey(const Key& key) -> unsigned {
+  llvm::hash_code hash = llvm::hash_combine(
+      key.kind, key.payload,
+      llvm::hash_combine_range(key.elements.begin(), key.elements.end()));
+  for (TokenizedBuffer::Identifier name : key.field_names) {
+    hash = llvm::hash_combine(hash, IdentifierInfo::getHashValue(name));
+  }
+  return hash;
+}
+
+auto TypeTable::GetKey(TypeId type) const -> Key {
+  if (kind(type) == TypeKind::Struct) {
+    // The payload is where the names are stored, which isn't part of the
+    // type.
+    return {.kind = TypeKind::Struct,
+            .elements = elements(type),
+            .field_names = field_names(type)};
+  }
+  return {.kind = kind(type),
+          .payload = payloads_[Index(type)],
+          .elements = elements(type)};
+}
+
+auto TypeTable::Intern(const Key& key) -> TypeId {
+  if (lookup_.empty()) {
+    Grow();
+  }
+  int slot = FindSlot(key);
+  if (lookup_[slot] != -1) {
+    return static_cast<TypeId>(lookup_[slot]);
+  }
+  // The key may refer to the pools it is about to be added to, such as when
+  // a tuple's elements are those of another type, so it is copied first.
+  llvm::SmallVector<TypeId> new_elements(key.elements.begin(),
+                                         key.elements.end());
+  llvm::SmallVector<TokenizedBuffer::Identifier> new_field_names(
+      key.field_names.begin(), key.field_names.end());
+  int32_t index = kinds_.size();
+  kinds_.push_back(key.kind);
+  if (key.kind == TypeKind::Struct) {
+    payloads_.push_back(field_names_.size());
+    field_names_.append(new_field_names.begin(), new_field_names.end());
+  } else {
+    payloads_.push_back(key.payload);
+  }
+  elements_.append(new_elements.begin(), new_elements.end());
+  element_ends_.push_back(elements_.size());
+  lookup_[slot] = index;
+  if (2 * kinds_.size() > lookup_.size()) {
+    Grow();
+  }
+  return static_cast<TypeId>(index);
+}
+
+auto TypeTable::Find(const Key& key) const -> std::optional<TypeId> {
+  if (lookup_.empty()) {
+    return std::nullopt;
+  }
+  int32_t index = lookup_[FindSlot(key)];
+  if (index == -1) {
+    return std::nullopt;
+  }
+  return static_cast<TypeId>(index);
+}
+
+auto TypeTable::FindSlot(const Key& key) const -> int {
+  // The size is a power of two, so masking wraps around the table.
+  unsigned mask = lookup_.size() - 1;
+  unsigned slot = HashKey(key) & mask;
+  // The table is never more than half full, so there is always an empty slot
+  // to stop at.
+  while (lookup_[slot] != -1) {
+    Key other = GetKey(static_cast<TypeId>(lookup_[slot]));
+    if (other.kind == key.kind && other.payload == key.payload &&
+        other.elements == key.elements &&
+        other.field_names == key.field_names) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+auto TypeTable::Grow() -> void {
+  constexpr int InitialSize = 16;
+  int size = lookup_.empty() ? InitialSize : 2 * lookup_.size();
+  lookup_.assign(size, -1);
+  for (int32_t index = 0; index != static_cast<int32_t>(kinds_.size());
+       ++index) {
+    lookup_[FindSlot(GetKey(static_cast<TypeId>(index)))] = index;
+  }
+}
+
+}  // namespace Cocktail::Semantics
@@ -1,8 +1,23 @@
 #include "Cocktail/Source/SourceBuffer.h"
 
+#include <cstring>
+#include <deque>
 #include <limits>
+#include <mutex>
 
+#include "Cocktail/Common/StringHelpers.h"
+#include "Cocktail/Common/TaskScheduler.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Memory.h"
+
+#if LLVM_ON_UNIX
+#include <sys/mman.h>
+#endif
 
 namespace Cocktail {
 namespace {
@@ -11,8 +26,198 @@ struct FilenameTranslator : DiagnosticLocationTranslator<llvm::StringRef> {
     return {.file_name = filename};
   }
 };
+
+// 将文本中的位置转换为行号和列号。只在诊断时使用，所以直接从头开始数行。
+class TextTranslator : public DiagnosticLocationTranslator<const char*> {
+ public:
+  TextTranslator(llvm::StringRef filename, llvm::StringRef text)
+      : filename_(filename), text_(text) {}
+
+  auto GetLocation(const char* loc) -> DiagnosticLocation override {
+    size_t offset = loc - text_.begin();
+    llvm::StringRef before = text_.take_front(offset);
+    size_t line_start = before.rfind('\n') + 1;
+    size_t line_end = text_.find('\n', offset);
+    return {.file_name = filename_,
+            .line = text_.slice(line_start, line_end),
+            .line_number = static_cast<int32_t>(before.count('\n') + 1),
+            .column_number = static_cast<int32_t>(offset - line_start + 1)};
+  }
+
+ private:
+  llvm::StringRef filename_;
+  llvm::StringRef text_;
+};
+
+// 保存一个文件在其他线程上读取时的诊断，之后再在调用线程上发送出去。
+class BufferingDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    diagnostic.ResolveLocations();
+    diagnostics_.push_back(std::move(diagnostic));
+  }
+
+  auto Replay(DiagnosticConsumer& consumer) -> void {
+    for (Diagnostic& diagnostic : diagnostics_) {
+      consumer.HandleDiagnostic(std::move(diagnostic));
+    }
+    diagnostics_.clear();
+  }
+
+ private:
+  llvm::SmallVector<Diagnostic, 0> diagnostics_;
+};
+
+// 拥有一段只读文件映射的内存缓冲区。
+class MappedFileMemoryBuffer : public llvm::MemoryBuffer {
+ public:
+  MappedFileMemoryBuffer(llvm::StringRef filename,
+                         llvm::sys::fs::mapped_file_region region)
+      : filename_(filename.str()), region_(std::move(region)) {
+    init(region_.const_data(), region_.const_data() + region_.size(),
+         /*RequiresNullTerminator=*/false);
+  }
+
+  auto getBufferIdentifier() const -> llvm::StringRef override {
+    return filename_;
+  }
+
+  auto getBufferKind() const -> BufferKind override {
+    return MemoryBuffer_MMap;
+  }
+
+ private:
+  std::string filename_;
+  llvm::sys::fs::mapped_file_region region_;
+};
 }  // namespace
 
+// 流式读取的文本。预留的地址空间只有被写入的页面才会真正占用内存。
+class SourceBuffer::StreamedText : public llvm::MemoryBuffer {
+ public:
+  // 每次最多读取的字节数。从管道中读取时，只要有可用的文本就会返回。
+  static constexpr size_t ReadSize = 64 * 1024;
+
+  StreamedText(llvm::StringRef filename, llvm::sys::fs::file_t file,
+               bool owns_file, llvm::sys::OwningMemoryBlock memory,
+               int64_t max_size)
+      : filename_(filename.str()),
+        file_(file),
+        owns_file_(owns_file),
+        memory_(std::move(memory)),
+        max_size_(max_size) {
+    SetSize(0);
+  }
+
+  ~StreamedText() override { CloseFile(); }
+
+  auto getBufferIdentifier() const -> llvm::StringRef override {
+    return filename_;
+  }
+
+  auto getBufferKind() const -> BufferKind override {
+    return MemoryBuffer_Malloc;
+  }
+
+  // 读取下一段文本，返回之后是否还可能有更多的文本。
+  auto ReadMore(DiagnosticEmitter<llvm::StringRef>& emitter) -> bool {
+    if (size_ == max_size_) {
+      // 再读一个字节就知道流是否超出了限制。
+      char extra;
+      llvm::Expected<size_t> read = llvm::sys::fs::readNativeFile(
+          file_, llvm::makeMutableArrayRef(extra));
+      if (read && *read != 0) {
+        COCKTAIL_DIAGNOSTIC(StreamTooLarge, Error,
+                            "Stream is over the {0}-byte input limit.",
+                            int64_t);
+        emitter.Emit(filename_, StreamTooLarge, max_size_);
+      }
+      return EndOfStream(emitter, read.takeError());
+    }
+
+    size_t read_size = std::min<int64_t>(ReadSize, max_size_ - size_);
+    llvm::Expected<size_t> read = llvm::sys::fs::readNativeFile(
+        file_, llvm::makeMutableArrayRef(data() + size_, read_size));
+    if (!read || *read == 0) {
+      return EndOfStream(emitter, read.takeError());
+    }
+    SetSize(size_ + *read);
+    return true;
+  }
+
+ private:
+  auto data() -> char* { return static_cast<char*>(memory_.base()); }
+
+  auto SetSize(int64_t size) -> void {
+    size_ = size;
+    init(data(), data() + size_, /*RequiresNullTerminator=*/false);
+  }
+
+  auto EndOfStream(DiagnosticEmitter<llvm::StringRef>& emitter,
+                   llvm::Error error) -> bool {
+    if (error) {
+      COCKTAIL_DIAGNOSTIC(ErrorReadingFile, Error, "Error reading file: {0}",
+                          std::string);
+      emitter.Emit(filename_, ErrorReadingFile,
+                   llvm::toString(std::move(error)));
+    }
+    CloseFile();
+    return false;
+  }
+
+  auto CloseFile() -> void {
+    if (owns_file_) {
+      llvm::sys::fs::closeFile(file_);
+      owns_file_ = false;
+    }
+  }
+
+  std::string filename_;
+  llvm::sys::fs::file_t file_;
+  bool owns_file_;
+  llvm::sys::OwningMemoryBlock memory_;
+  int64_t max_size_;
+  int64_t size_ = 0;
+};
+
+// 词法分析器的列号和行长度是 `int32_t`，只有行的起始位置是 `int64_t`。因此超过
+// 2GiB 的文件是可以接受的，只要其中每一行以及行数都在限制之内。对于较小的文件，
+// 这些条件自然成立，不需要扫描。
+static auto CheckLineLimits(llvm::StringRef filename, llvm::StringRef text,
+                            DiagnosticEmitter<llvm::StringRef>& emitter)
+    -> bool {
+  constexpr int64_t Limit = std::numeric_limits<int32_t>::max();
+  if (static_cast<int64_t>(text.size()) < Limit) {
+    return true;
+  }
+
+  int64_t line_count = 0;
+  const char* line_start = text.begin();
+  while (true) {
+    const auto* newline = static_cast<const char*>(
+        memchr(line_start, '\n', text.end() - line_start));
+    const char* line_end = newline ? newline : text.end();
+    ++line_count;
+    if (line_end - line_start >= Limit) {
+      COCKTAIL_DIAGNOSTIC(LineTooLong, Error,
+                          "Line {0} is over the 2GiB line length limit.",
+                          int64_t);
+      emitter.Emit(filename, LineTooLong, line_count);
+      return false;
+    }
+    if (line_count >= Limit) {
+      COCKTAIL_DIAGNOSTIC(TooManyLines, Error,
+                          "File is over the limit of {0} lines.", int64_t);
+      emitter.Emit(filename, TooManyLines, Limit);
+      return false;
+    }
+    if (!newline) {
+      return true;
+    }
+    line_start = newline + 1;
+  }
+}
+
 auto SourceBuffer::CreateFromFile(llvm::vfs::FileSystem& fs,
                                   llvm::StringRef filename,
                                   DiagnosticConsumer& consumer)
@@ -40,11 +245,11 @@ auto SourceBuffer::CreateFromFile(llvm::vfs::FileSystem& fs,
   }
 
   // 检查文件大小。
-  int64_t size = status->getSize();
-  if (size >= std::numeric_limits<int32_t>::max()) {
+  uint64_t size = status->getSize();
+  if (size > std::numeric_limits<size_t>::max()) {
     COCKTAIL_DIAGNOSTIC(FileTooLarge, Error,
-                        "File is over the 2GiB input limit; size is {0} bytes.",
-                        int64_t);
+                        "File is too large to load; size is {0} bytes.",
+                        uint64_t);
     emitter.Emit(filename, FileTooLarge, size);
     return std::nullopt;
   }
@@ -59,7 +264,219 @@ auto SourceBuffer::CreateFromFile(llvm::vfs::FileSystem& fs,
     return std::nullopt;
   }
 
-  return SourceBuffer(filename.str(), std::move(buffer.get()));
+  if (!CheckLineLimits(filename, (*buffer)->getBuffer(), emitter)) {
+    return std::nullopt;
+  }
+
+  SourceBuffer source(filename.str(), std::move(buffer.get()));
+  if (!source.ValidateText(consumer)) {
+    return std::nullopt;
+  }
+  return source;
+}
+
+auto SourceBuffer::CreateFromFiles(
+    llvm::vfs::FileSystem& fs, llvm::ArrayRef<llvm::StringRef> filenames,
+    TaskScheduler& scheduler, DiagnosticConsumer& consumer,
+    llvm::function_ref<auto(int index, std::optional<SourceBuffer> buffer)
+                           ->void>
+        on_loaded) -> void {
+  struct Loaded {
+    int index;
+    std::optional<SourceBuffer> buffer;
+  };
+  std::mutex mutex;
+  std::deque<Loaded> loaded;
+  llvm::SmallVector<BufferingDiagnosticConsumer, 0> consumers(filenames.size());
+
+  // 任务组在每个任务完成后都会唤醒等待的线程。
+  TaskGroup group(scheduler);
+  for (int i = 0; i != static_cast<int>(filenames.size()); ++i) {
+    group.Run([&, i] {
+      std::optional<SourceBuffer> buffer =
+          CreateFromFile(fs, filenames[i], consumers[i]);
+      std::lock_guard<std::mutex> lock(mutex);
+      loaded.push_back({.index = i, .buffer = std::move(buffer)});
+    });
+  }
+
+  // 每个文件都会恰好完成一次，所以全部交出之后就不会再有线程访问这里的状态了。
+  // 等待时调用线程也会读取文件。
+  for (int remaining = filenames.size(); remaining != 0; --remaining) {
+    scheduler.HelpWhile([&] {
+      std::lock_guard<std::mutex> lock(mutex);
+      return loaded.empty();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    Loaded next = std::move(loaded.front());
+    loaded.pop_front();
+    lock.unlock();
+
+    consumers[next.index].Replay(consumer);
+    on_loaded(next.index, std::move(next.buffer));
+  }
+}
+
+auto SourceBuffer::CreateFromMappedFile(llvm::StringRef filename,
+                                        DiagnosticConsumer& consumer)
+    -> std::optional<SourceBuffer> {
+  FilenameTranslator translator;
+  DiagnosticEmitter<llvm::StringRef> emitter(translator, consumer);
+
+  // 打开文件。映射建立之后就不再需要文件描述符了。
+  llvm::Expected<llvm::sys::fs::file_t> file =
+      llvm::sys::fs::openNativeFileForRead(filename);
+  if (!file) {
+    COCKTAIL_DIAGNOSTIC(ErrorOpeningFile, Error,
+                        "Error opening file for read: {0}", std::string);
+    emitter.Emit(filename, ErrorOpeningFile,
+                 llvm::toString(file.takeError()));
+    return std::nullopt;
+  }
+  auto close_file =
+      llvm::make_scope_exit([&] { llvm::sys::fs::closeFile(*file); });
+
+  // 获取文件状态。
+  llvm::sys::fs::file_status status;
+  if (std::error_code ec = llvm::sys::fs::status(*file, status)) {
+    COCKTAIL_DIAGNOSTIC(ErrorStattingFile, Error, "Error statting file: {0}",
+                        std::string);
+    emitter.Emit(filename, ErrorStattingFile, ec.message());
+    return std::nullopt;
+  }
+
+  // 检查文件大小。
+  uint64_t size = status.getSize();
+  if (size > std::numeric_limits<size_t>::max()) {
+    COCKTAIL_DIAGNOSTIC(FileTooLarge, Error,
+                        "File is too large to load; size is {0} bytes.",
+                        uint64_t);
+    emitter.Emit(filename, FileTooLarge, size);
+    return std::nullopt;
+  }
+
+  // 空文件无法被映射。
+  if (size == 0) {
+    SourceBuffer source(
+        filename.str(),
+        llvm::MemoryBuffer::getMemBuffer("", filename,
+                                         /*RequiresNullTerminator=*/false));
+    source.is_ascii_ = true;
+    return source;
+  }
+
+  // 映射文件。
+  std::error_code ec;
+  llvm::sys::fs::mapped_file_region region(
+      *file, llvm::sys::fs::mapped_file_region::readonly, size, /*offset=*/0,
+      ec);
+  if (ec) {
+    COCKTAIL_DIAGNOSTIC(ErrorMappingFile, Error, "Error mapping file: {0}",
+                        std::string);
+    emitter.Emit(filename, ErrorMappingFile, ec.message());
+    return std::nullopt;
+  }
+
+#if LLVM_ON_UNIX
+  // 这些只是提示：词法分析器从头到尾读取一次文件，并且大文件可以受益于大页。
+  // 内核不支持时忽略错误即可。
+  void* data = const_cast<char*>(region.const_data());
+  (void)madvise(data, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  (void)madvise(data, size, MADV_HUGEPAGE);
+#endif
+#endif
+
+  auto buffer =
+      std::make_unique<MappedFileMemoryBuffer>(filename, std::move(region));
+  if (!CheckLineLimits(filename, buffer->getBuffer(), emitter)) {
+    return std::nullopt;
+  }
+
+  SourceBuffer source(filename.str(), std::move(buffer));
+  if (!source.ValidateText(consumer)) {
+    return std::nullopt;
+  }
+  return source;
+}
+
+auto SourceBuffer::CreateFromStream(llvm::StringRef filename,
+                                    DiagnosticConsumer& consumer,
+                                    int64_t max_size)
+    -> std::optional<SourceBuffer> {
+  COCKTAIL_CHECK(max_size > 0) << "Streams must be allowed some text!";
+  FilenameTranslator translator;
+  DiagnosticEmitter<llvm::StringRef> emitter(translator, consumer);
+
+  // 打开流。标准输入不归源缓冲区所有，所以不会被关闭。
+  bool is_stdin = filename == "-";
+  llvm::sys::fs::file_t file = llvm::sys::fs::getStdinHandle();
+  if (!is_stdin) {
+    llvm::Expected<llvm::sys::fs::file_t> opened =
+        llvm::sys::fs::openNativeFileForRead(filename);
+    if (!opened) {
+      COCKTAIL_DIAGNOSTIC(ErrorOpeningFile, Error,
+                          "Error opening file for read: {0}", std::string);
+      emitter.Emit(filename, ErrorOpeningFile,
+                   llvm::toString(opened.takeError()));
+      return std::nullopt;
+    }
+    file = *opened;
+  }
+
+  // 预留地址空间。
+  std::error_code ec;
+  llvm::sys::MemoryBlock memory = llvm::sys::Memory::allocateMappedMemory(
+      max_size, /*NearBlock=*/nullptr,
+      llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, ec);
+  if (ec) {
+    COCKTAIL_DIAGNOSTIC(ErrorMappingFile, Error, "Error mapping file: {0}",
+                        std::string);
+    emitter.Emit(filename, ErrorMappingFile, ec.message());
+    if (!is_stdin) {
+      llvm::sys::fs::closeFile(file);
+    }
+    return std::nullopt;
+  }
+
+  auto text = std::make_unique<StreamedText>(
+      filename, file, /*owns_file=*/!is_stdin,
+      llvm::sys::OwningMemoryBlock(memory), max_size);
+  StreamedText* stream = text.get();
+  SourceBuffer buffer(filename.str(), std::move(text));
+  buffer.stream_ = stream;
+  return buffer;
+}
+
+auto SourceBuffer::ReadMore(DiagnosticConsumer& consumer) -> bool {
+  if (!stream_) {
+    return false;
+  }
+  FilenameTranslator translator;
+  DiagnosticEmitter<llvm::StringRef> emitter(translator, consumer);
+  if (!stream_->ReadMore(emitter)) {
+    stream_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+auto SourceBuffer::ValidateText(DiagnosticConsumer& consumer) -> bool {
+  if (text().startswith("\xEF\xBB\xBF")) {
+    bom_size_ = 3;
+  }
+
+  llvm::StringRef text = this->text();
+  Utf8Validation validation = ValidateUtf8(text);
+  if (validation.invalid_offset) {
+    TextTranslator translator(filename_, text);
+    DiagnosticEmitter<const char*> emitter(translator, consumer);
+    COCKTAIL_DIAGNOSTIC(InvalidUtf8, Error, "Invalid UTF-8 encoding.");
+    emitter.Emit(text.begin() + *validation.invalid_offset, InvalidUtf8);
+    return false;
+  }
+  is_ascii_ = validation.is_ascii;
+  return true;
 }
 
-}  // namespace Cocktail
\ No newline at end of file
+}  // namespace Cocktail
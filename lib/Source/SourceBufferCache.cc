@@ -0,0 +1,76 @@
+#include "Cocktail/Source/SourceBufferCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/xxhash.h"
+
+namespace Cocktail {
+
+auto SourceBufferCache::Global() -> SourceBufferCache& {
+  static llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs =
+      llvm::vfs::getRealFileSystem();
+  static SourceBufferCache cache(*fs);
+  return cache;
+}
+
+auto SourceBufferCache::Get(llvm::StringRef filename,
+                            DiagnosticConsumer& consumer)
+    -> std::shared_ptr<SourceBuffer> {
+  llvm::SmallString<256> path = filename;
+  if (fs_->makeAbsolute(path)) {
+    path = filename;
+  }
+
+  // 状态获取失败时交给 `CreateFromFile` 来诊断，不缓存。
+  llvm::ErrorOr<llvm::vfs::Status> status = fs_->status(path);
+  if (!status) {
+    std::optional<SourceBuffer> source =
+        SourceBuffer::CreateFromFile(*fs_, filename, consumer);
+    return source ? std::make_shared<SourceBuffer>(std::move(*source))
+                  : nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end() &&
+        it->second.modification_time == status->getLastModificationTime() &&
+        it->second.size == status->getSize()) {
+      return it->second.buffer;
+    }
+  }
+
+  // 读取文件时不持有锁，这样其他文件的请求可以同时进行。状态是在读取之前获取的，
+  // 所以如果文件在此期间发生了变化，下一次请求会重新读取它。
+  std::optional<SourceBuffer> source =
+      SourceBuffer::CreateFromFile(*fs_, filename, consumer);
+  if (!source) {
+    return nullptr;
+  }
+  Entry entry = {.modification_time = status->getLastModificationTime(),
+                 .size = status->getSize(),
+                 .content_hash = 0,
+                 .buffer = std::make_shared<SourceBuffer>(std::move(*source))};
+  if (validation_ == Validation::ContentHash) {
+    entry.content_hash = llvm::xxHash64(entry.buffer->text());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto [it, inserted] = entries_.try_emplace(path, entry);
+  if (!inserted) {
+    if (validation_ == Validation::ContentHash &&
+        it->second.content_hash == entry.content_hash &&
+        it->second.buffer->text() == entry.buffer->text()) {
+      entry.buffer = it->second.buffer;
+    }
+    it->second = entry;
+  }
+  return entry.buffer;
+}
+
+auto SourceBufferCache::Clear() -> void {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+
+}  // namespace Cocktail
@@ -5,9 +5,9 @@ namespace Cocktail {
 void PrintTo(const Diagnostic& diagnostic, std::ostream* os) {
   *os << "Diagnostic{" << diagnostic.kind << ", ";
   PrintTo(diagnostic.level, os);
-  *os << ", " << diagnostic.location.file_name << ":"
-      << diagnostic.location.line_number << ":"
-      << diagnostic.location.column_number << ", \""
+  *os << ", " << diagnostic.location().file_name << ":"
+      << diagnostic.location().line_number << ":"
+      << diagnostic.location().column_number << ", \""
       << diagnostic.format_fn(diagnostic) << "\"}";
 }
 
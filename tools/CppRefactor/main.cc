@@ -1,16 +1,84 @@
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Driver/ArtifactCache.h"
 #include "Cocktail/CppRefactor/FnInserter.h"
 #include "Cocktail/CppRefactor/ForRange.h"
 #include "Cocktail/CppRefactor/MatcherManager.h"
+#include "Cocktail/CppRefactor/PreambleCache.h"
+#include "Cocktail/CppRefactor/ReplacementCache.h"
+#include "Cocktail/CppRefactor/ReplacementWriter.h"
 #include "Cocktail/CppRefactor/VarDecl.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Refactoring.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 
+using clang::tooling::ClangTool;
+using clang::tooling::CompilationDatabase;
 using clang::tooling::RefactoringTool;
 
-static void InitReplacements(RefactoringTool* tool) {
-  clang::FileManager& files = tool->getFiles();
-  Cocktail::Matcher::ReplacementMap& repl = tool->getReplacements();
-  for (const std::string& path : tool->getSourcePaths()) {
+static llvm::cl::OptionCategory category("C++ refactoring options");
+
+static llvm::cl::opt<unsigned> jobs(
+    "j",
+    llvm::cl::desc("Number of threads to process source files on; each "
+                   "thread parses its share of the files with a tool of "
+                   "its own"),
+    llvm::cl::init(1), llvm::cl::cat(category));
+
+static llvm::cl::opt<bool> print_stats(
+    "print-stats",
+    llvm::cl::desc("Print how often each refactoring matched and the time it "
+                   "took to rewrite its matches"),
+    llvm::cl::cat(category));
+
+static llvm::cl::opt<std::string> cache_dir(
+    "cache-dir",
+    llvm::cl::desc("Directory to cache the replacements of each file in, so "
+                   "that a file is only matched again once it or a header it "
+                   "includes changes"),
+    llvm::cl::value_desc("dir"), llvm::cl::cat(category));
+
+static llvm::cl::opt<bool> reuse_preambles(
+    "reuse-preambles",
+    llvm::cl::desc("Precompile the headers at the top of each file once for "
+                   "all the files that start with the same ones and are "
+                   "compiled with the same flags"),
+    llvm::cl::cat(category));
+
+static llvm::cl::opt<Cocktail::ReplacementOutput> output(
+    "output", llvm::cl::desc("Where to write the replacements"),
+    llvm::cl::values(
+        clEnumValN(Cocktail::ReplacementOutput::InPlace, "in-place",
+                   "Rewrite the source files"),
+        clEnumValN(Cocktail::ReplacementOutput::Diff, "diff",
+                   "Print a unified diff of the changes"),
+        clEnumValN(Cocktail::ReplacementOutput::Yaml, "yaml",
+                   "Print the replacements as YAML documents, as "
+                   "clang-apply-replacements reads them")),
+    llvm::cl::init(Cocktail::ReplacementOutput::InPlace),
+    llvm::cl::cat(category));
+
+static llvm::cl::opt<bool> write_each_file(
+    "write-each-file",
+    llvm::cl::desc("Write the replacements of each source file as soon as "
+                   "it has been matched rather than once all have been, so "
+                   "that they aren't all held in memory"),
+    llvm::cl::cat(category));
+
+// Adds an empty entry for each of `paths` to `repl`. Replacements are only
+// kept for files with an entry, so that headers outside of the sources being
+// migrated aren't touched.
+static void InitReplacements(clang::FileManager& files,
+                             llvm::ArrayRef<std::string> paths,
+                             Cocktail::Matcher::ReplacementMap& repl) {
+  for (const std::string& path : paths) {
     llvm::ErrorOr<const clang::FileEntry*> file = files.getFile(path);
     if (file.getError()) {
       llvm::report_fatal_error(llvm::Twine("Error accessing `") + path +
@@ -20,19 +88,199 @@ static void InitReplacements(RefactoringTool* tool) {
   }
 }
 
-auto main(int argc, const char** argv) -> int {
-  llvm::cl::OptionCategory category("C++ refactoring options");
-  auto parser =
-      clang::tooling::CommonOptionsParser::create(argc, argv, category);
-  RefactoringTool tool(parser->getCompilations(), parser->getSourcePathList());
-  InitReplacements(&tool);
-
-  // Set up AST matcher callbacks.
-  Cocktail::MatcherManager matchers(&tool.getReplacements());
+static void RegisterMatchers(Cocktail::MatcherManager& matchers) {
   matchers.Register(std::make_unique<Cocktail::FnInserterFactory>());
   matchers.Register(std::make_unique<Cocktail::ForRangeFactory>());
   matchers.Register(std::make_unique<Cocktail::VarDeclFactory>());
+}
 
-  return tool.runAndSave(
-      clang::tooling::newFrontendActionFactory(matchers.GetFinder()).get());
-}
\ No newline at end of file
+// What running the matchers over some of the files found.
+struct RunResult {
+  // Nonzero if a file couldn't be processed, as `ClangTool::run` returns.
+  int status = 0;
+  std::vector<Cocktail::MatcherStats> stats;
+  // How many files' replacements were cached, and how many weren't.
+  int cache_hits = 0;
+  int cache_misses = 0;
+};
+
+// Adds `run` to `total`, which are of runs with the same matchers registered.
+static void AddResult(const RunResult& run, RunResult& total) {
+  total.status = std::max(total.status, run.status);
+  if (total.stats.empty()) {
+    total.stats = run.stats;
+  } else {
+    for (size_t i = 0; i < run.stats.size(); ++i) {
+      total.stats[i].matches += run.stats[i].matches;
+      total.stats[i].time += run.stats[i].time;
+    }
+  }
+  total.cache_hits += run.cache_hits;
+  total.cache_misses += run.cache_misses;
+}
+
+// Prints `stats`, the costliest matcher first.
+static void PrintStats(std::vector<Cocktail::MatcherStats> stats) {
+  std::sort(stats.begin(), stats.end(),
+            [](const Cocktail::MatcherStats& a,
+               const Cocktail::MatcherStats& b) { return a.time > b.time; });
+  llvm::errs() << llvm::format("%10s %10s  %s\n", "matches", "ms", "matcher");
+  for (const Cocktail::MatcherStats& matcher : stats) {
+    double ms =
+        std::chrono::duration<double, std::milli>(matcher.time).count();
+    llvm::errs() << llvm::format("%10lld %10.3f  %s\n",
+                                 static_cast<long long>(matcher.matches), ms,
+                                 matcher.name.c_str());
+  }
+}
+
+// Runs the matchers over the files of `tool`, adding their replacements to
+// `repl`, which has an entry for each file that can be migrated. Reuses the
+// preambles of `preambles` and the replacements cached in `cache` if they're
+// not null. If `writer` isn't null, each file's replacements are written with
+// it and dropped once the file has been matched.
+static auto RunMatchers(ClangTool& tool,
+                        Cocktail::Matcher::ReplacementMap& repl,
+                        Cocktail::PreambleCache* preambles,
+                        Cocktail::ArtifactCache* cache,
+                        Cocktail::ReplacementWriter* writer) -> RunResult {
+  // With a cache, the replacements of each file are found apart from the
+  // others', so that they can be stored.
+  Cocktail::Matcher::ReplacementMap scratch;
+  if (cache) {
+    for (const auto& [path, replacements] : repl) {
+      scratch.insert({path, {}});
+    }
+  }
+  Cocktail::MatcherManager matchers(cache ? &scratch : &repl);
+  RegisterMatchers(matchers);
+  std::unique_ptr<clang::tooling::ToolAction> action =
+      clang::tooling::newFrontendActionFactory(matchers.GetFinder());
+  if (preambles) {
+    action = std::make_unique<Cocktail::PreambleReusingAction>(
+        clang::tooling::newFrontendActionFactory(matchers.GetFinder()),
+        preambles);
+  }
+  clang::tooling::ToolAction* run_action = action.get();
+  std::optional<Cocktail::ReplacementCachingAction> caching;
+  if (cache) {
+    std::string matcher_set;
+    for (const Cocktail::MatcherStats& matcher : matchers.GetStats()) {
+      matcher_set += matcher.name + ",";
+    }
+    run_action = &caching.emplace(run_action, &scratch, &repl, cache,
+                                  matcher_set);
+  }
+  std::optional<Cocktail::ReplacementStreamingAction> streaming;
+  if (writer) {
+    run_action = &streaming.emplace(run_action, &repl, writer);
+  }
+  RunResult result;
+  result.status = tool.run(run_action);
+  if (caching) {
+    result.cache_hits = caching->hits();
+    result.cache_misses = caching->misses();
+  }
+  result.stats = matchers.GetStats();
+  return result;
+}
+
+// Finds the replacements for the source files `paths` with `num_shards`
+// tools run concurrently, each on every `num_shards`th file, and adds them to
+// `tool`'s.
+static auto RunSharded(const CompilationDatabase& compilations,
+                       llvm::ArrayRef<std::string> paths,
+                       RefactoringTool& tool, int num_shards,
+                       Cocktail::PreambleCache* preambles,
+                       Cocktail::ArtifactCache* cache,
+                       Cocktail::ReplacementWriter* writer) -> RunResult {
+  num_shards = std::min<int>(num_shards, paths.size());
+  std::vector<Cocktail::Matcher::ReplacementMap> shard_repls(num_shards);
+  std::vector<RunResult> shard_results(num_shards);
+  // The calling thread runs a shard as well.
+  Cocktail::TaskScheduler scheduler(num_shards - 1);
+  Cocktail::ParallelFor(scheduler, num_shards, [&](int shard) {
+    std::vector<std::string> shard_paths;
+    for (int i = shard; i < static_cast<int>(paths.size()); i += num_shards) {
+      shard_paths.push_back(paths[i]);
+    }
+    ClangTool shard_tool(compilations, shard_paths);
+    // Every source file has an entry, so that a header shared with another
+    // shard's files is migrated by whichever shard includes it.
+    Cocktail::Matcher::ReplacementMap& repl = shard_repls[shard];
+    InitReplacements(shard_tool.getFiles(), paths, repl);
+    shard_results[shard] = RunMatchers(shard_tool, repl, preambles, cache,
+                                        writer);
+  });
+  RunResult result;
+  for (int shard = 0; shard < num_shards; ++shard) {
+    Cocktail::MergeReplacements(shard_repls[shard], tool.getReplacements());
+    AddResult(shard_results[shard], result);
+  }
+  return result;
+}
+
+// Writes the replacements found by `tool` that haven't been written yet.
+static auto WriteReplacements(RefactoringTool& tool,
+                              Cocktail::ReplacementWriter& writer) -> int {
+  int status = 0;
+  for (const auto& [path, replacements] : tool.getReplacements()) {
+    if (!writer.Write(path, replacements, tool.getFiles())) {
+      status = 1;
+    }
+  }
+  return status;
+}
+
+auto main(int argc, const char** argv) -> int {
+  auto parser =
+      clang::tooling::CommonOptionsParser::create(argc, argv, category);
+  const std::vector<std::string>& paths = parser->getSourcePathList();
+  RefactoringTool tool(parser->getCompilations(), paths);
+  InitReplacements(tool.getFiles(), paths, tool.getReplacements());
+
+  // Shared by the shards, so that a preamble is built once for them all.
+  Cocktail::PreambleCache preamble_cache;
+  Cocktail::PreambleCache* preambles =
+      reuse_preambles ? &preamble_cache : nullptr;
+  std::optional<Cocktail::ArtifactCache> cache;
+  if (!cache_dir.empty()) {
+    if (std::error_code err = llvm::sys::fs::create_directories(cache_dir)) {
+      llvm::errs() << "Error creating `" << cache_dir
+                   << "`: " << err.message() << "\n";
+      return 1;
+    }
+    cache.emplace(cache_dir);
+  }
+  Cocktail::ArtifactCache* cache_ptr = cache ? &*cache : nullptr;
+  Cocktail::ReplacementWriter writer(output, llvm::outs());
+  Cocktail::ReplacementWriter* streaming_writer =
+      write_each_file ? &writer : nullptr;
+  RunResult result;
+  if (jobs > 1 && paths.size() > 1) {
+    result = RunSharded(parser->getCompilations(), paths, tool, jobs,
+                        preambles, cache_ptr, streaming_writer);
+  } else {
+    result = RunMatchers(tool, tool.getReplacements(), preambles, cache_ptr,
+                         streaming_writer);
+  }
+  int status = result.status;
+  if (status == 0) {
+    status = WriteReplacements(tool, writer);
+  }
+  if (cache) {
+    cache->Prune();
+  }
+  if (print_stats) {
+    PrintStats(std::move(result.stats));
+    if (preambles) {
+      llvm::errs() << "preambles: " << preambles->misses() << " built, "
+                   << preambles->hits() << " reused\n";
+    }
+    if (cache) {
+      llvm::errs() << "cache: " << result.cache_misses << " files matched, "
+                   << result.cache_hits << " skipped\n";
+    }
+  }
+  return status;
+}
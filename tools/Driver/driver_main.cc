@@ -1,10 +1,13 @@
 #include <cstdlib>
 #include <iostream>
+#include <optional>
 
 #include "Cocktail/Driver/Driver.h"
+#include "Cocktail/Driver/DriverServer.h"
 #include "llvm/ADT/Sequence.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
 
 auto main(int argc, char** argv) -> int {
   if (argc < 1) {
@@ -14,7 +17,25 @@ auto main(int argc, char** argv) -> int {
   std::cout << "This is cocktail driver!!!\n";
 
   llvm::SmallVector<llvm::StringRef, 16> args(argv + 1, argv + argc);
+
+  // `--server=SOCKET` runs the command on a `cocktail serve` server, and
+  // `--server=SOCKET --stop-server` stops it. When no server can be reached,
+  // the command runs here instead.
+  if (!args.empty() && args.front().consume_front("--server=")) {
+    llvm::StringRef socket_path = args.front();
+    args.erase(args.begin());
+    if (args.size() == 1 && args.front() == "--stop-server") {
+      return Cocktail::StopDriverServer(socket_path) ? EXIT_SUCCESS
+                                                     : EXIT_FAILURE;
+    }
+    std::cout.flush();
+    if (std::optional<bool> success = Cocktail::RunOnDriverServer(
+            socket_path, args, llvm::outs(), llvm::errs())) {
+      return *success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
   Cocktail::Driver driver;
   bool success = driver.RunFullCommand(args);
   return success ? EXIT_SUCCESS : EXIT_FAILURE;
-}
\ No newline at end of file
+}
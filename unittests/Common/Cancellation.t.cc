@@ -0,0 +1,31 @@
+#include "Cocktail/Common/Cancellation.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace Cocktail {
+namespace {
+
+TEST(CancellationToken, Cancel) {
+  CancellationToken token;
+  EXPECT_FALSE(token.cancelled());
+  // Another thread can cancel the work.
+  std::thread([&] { token.Cancel(); }).join();
+  EXPECT_TRUE(token.cancelled());
+}
+
+TEST(CancellationToken, Deadline) {
+  CancellationToken passed(CancellationToken::Clock::now());
+  EXPECT_TRUE(passed.cancelled());
+
+  CancellationToken future(CancellationToken::Clock::now() +
+                           std::chrono::hours(1));
+  EXPECT_FALSE(future.cancelled());
+  future.Cancel();
+  EXPECT_TRUE(future.cancelled());
+}
+
+}  // namespace
+}  // namespace Cocktail
@@ -93,6 +93,52 @@ TEST(ErrorTest, AssignOrReturnHasErrorInExpected) {
   EXPECT_EQ(result.error().message(), "error");
 }
 
+COCKTAIL_ERROR_MESSAGE(StaticMessage, "static");
+COCKTAIL_ERROR_MESSAGE(ArgsMessage, "{1} then {0}, {1}: {2} {x}");
+
+TEST(ErrorTest, StaticMessage) {
+  Error err(StaticMessage);
+  EXPECT_EQ(err.static_message(), &StaticMessage);
+  EXPECT_EQ(err.message(), "static");
+  EXPECT_EQ(err.location(), "");
+}
+
+TEST(ErrorTest, StaticMessageArgs) {
+  std::string text = "text";
+  Error err(ArgsMessage, text, -12, llvm::StringRef("ref"));
+  // The arguments are copied, so they may go away before the error does.
+  text = "changed";
+  EXPECT_EQ(err.static_message(), &ArgsMessage);
+  EXPECT_EQ(err.message(), "-12 then text, -12: ref {x}");
+}
+
+TEST(ErrorTest, StaticMessageLongArgs) {
+  std::string text(Error::InlineArgsSize + 1, 'a');
+  Error err(ArgsMessage, text, 1, "b");
+  EXPECT_EQ(err.static_message(), nullptr);
+  EXPECT_EQ(err.message(), "1 then " + text + ", 1: b {x}");
+}
+
+TEST(ErrorTest, StaticMessageErrorOr) {
+  auto result = []() -> ErrorOr<std::string> {
+    COCKTAIL_ASSIGN_OR_RETURN(int a, ErrorOr<int>(Error(ArgsMessage, 1, 2, 3)));
+    return std::to_string(a);
+  }();
+  ASSERT_FALSE(result.ok());
+  EXPECT_EQ(result.error().message(), "2 then 1, 2: 3 {x}");
+}
+
+TEST(ErrorTest, ErrorOrMove) {
+  ErrorOr<std::string> value(std::string("value"));
+  ErrorOr<std::string> moved = std::move(value);
+  ASSERT_TRUE(moved.ok());
+  EXPECT_EQ(*moved, "value");
+
+  moved = ErrorOr<std::string>(Error("error"));
+  ASSERT_FALSE(moved.ok());
+  EXPECT_EQ(moved.error().message(), "error");
+}
+
 TEST(ErrorTest, ErrorBuilderOperatorImplicitCast) {
   ErrorOr<int> result1 = ErrorBuilder() << "msg";
   ASSERT_FALSE(result1.ok());
@@ -103,6 +149,11 @@ TEST(ErrorTest, ErrorBuilderOperatorImplicitCast) {
   llvm::raw_string_ostream oss(result2_output);
   result2.Print(oss);
   EXPECT_EQ(oss.str(), "TestFunc: msg");
+  EXPECT_EQ(result2.location(), "TestFunc");
+  EXPECT_EQ(result2.message(), "msg");
+
+  Error result3 = ErrorBuilder() << "line " << 12 << ": " << 'x';
+  EXPECT_EQ(result3.message(), "line 12: x");
 }
 
 }  // namespace
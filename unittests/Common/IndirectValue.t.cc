@@ -4,6 +4,8 @@
 
 #include <string>
 
+#include "llvm/Support/Allocator.h"
+
 namespace Cocktail {
 namespace {
 
@@ -171,5 +173,59 @@ TEST(IndirectValueTest, IncompleteType) {
   S s = {.v = S{}};
 }
 
+TEST(SmallIndirectValueTest, Inline) {
+  SmallIndirectValue<int> v = 42;
+  EXPECT_TRUE(v.is_inline());
+  EXPECT_EQ(*v, 42);
+  auto moved = std::move(v);
+  EXPECT_TRUE(moved.is_inline());
+  EXPECT_EQ(*moved, 42);
+}
+
+TEST(SmallIndirectValueTest, Heap) {
+  SmallIndirectValue<std::string, llvm::MallocAllocator, 8> v("Hello, world!");
+  EXPECT_FALSE(v.is_inline());
+  const std::string* pointer = v.GetPointer();
+  // Moving a value on the heap only hands over the pointer.
+  auto moved = std::move(v);
+  EXPECT_EQ(moved.GetPointer(), pointer);
+  EXPECT_EQ(*moved, "Hello, world!");
+  EXPECT_EQ(v.GetPointer(), nullptr);
+
+  v = std::move(moved);
+  EXPECT_EQ(v.GetPointer(), pointer);
+}
+
+TEST(SmallIndirectValueTest, MoveAssign) {
+  SmallIndirectValue<TestValue> v1;
+  SmallIndirectValue<TestValue> v2;
+  v2 = std::move(v1);
+  EXPECT_EQ(v2->state, "move constructed");
+}
+
+TEST(SmallIndirectValueTest, Arena) {
+  struct Node {
+    int value;
+    std::optional<SmallIndirectValue<Node, llvm::BumpPtrAllocator>> next;
+  };
+
+  llvm::BumpPtrAllocator arena;
+  Node list = {.value = 0};
+  Node* last = &list;
+  for (int i = 1; i < 10; ++i) {
+    last->next.emplace(arena, Node{.value = i});
+    EXPECT_FALSE(last->next->is_inline());
+    last = last->next->GetPointer();
+  }
+  EXPECT_EQ(arena.getBytesAllocated(), 9 * sizeof(Node));
+
+  int sum = 0;
+  for (const Node* node = &list; node != nullptr;
+       node = node->next ? node->next->GetPointer() : nullptr) {
+    sum += node->value;
+  }
+  EXPECT_EQ(sum, 45);
+}
+
 }  // namespace
 }  // namespace Cocktail
\ No newline at end of file
@@ -70,6 +70,23 @@ TEST(UnescapeStringLiteral, InvalidUnicodes) {
   EXPECT_THAT(UnescapeStringLiteral("\\u{FF000000E9}"), Eq(std::nullopt));
 }
 
+TEST(UnescapeStringLiteral, LongPlainRuns) {
+  // Plain runs both shorter and longer than a vector, with escapes and tabs
+  // landing at every offset within one.
+  for (int length = 0; length < 40; ++length) {
+    SCOPED_TRACE(length);
+    std::string plain(length, 'a');
+    EXPECT_THAT(UnescapeStringLiteral(plain), Optional(Eq(plain)));
+    EXPECT_THAT(UnescapeStringLiteral(plain + "\\n" + plain),
+                Optional(Eq(plain + "\n" + plain)));
+    EXPECT_THAT(UnescapeStringLiteral(plain + "\\#n" + plain, 1),
+                Optional(Eq(plain + "\n" + plain)));
+    EXPECT_THAT(UnescapeStringLiteral(plain + "\\n" + plain, 1),
+                Optional(Eq(plain + "\\n" + plain)));
+    EXPECT_THAT(UnescapeStringLiteral(plain + "\t" + plain), Eq(std::nullopt));
+  }
+}
+
 TEST(UnescapeStringLiteral, Nul) {
   std::optional<std::string> str = UnescapeStringLiteral("a\\0b");
   ASSERT_NE(str, std::nullopt);
@@ -80,6 +97,61 @@ TEST(UnescapeStringLiteral, Nul) {
   EXPECT_THAT((*str)[2], Eq('b'));
 }
 
+TEST(ValidateUtf8, Valid) {
+  for (llvm::StringRef text :
+       {"", "plain", "r\xC3\xA9" "al", "\xE2\x9D\xA4\xEF\xB8\x8F",
+        "\xF0\x9F\x94\x8A", "\xF4\x8F\xBF\xBF", "\xED\x9F\xBF"}) {
+    SCOPED_TRACE(text);
+    Utf8Validation validation = ValidateUtf8(text);
+    EXPECT_THAT(validation.invalid_offset, Eq(std::nullopt));
+    EXPECT_THAT(validation.is_ascii, Eq(text.find_if([](char c) {
+                                          return c & 0x80;
+                                        }) == llvm::StringRef::npos));
+  }
+}
+
+TEST(ValidateUtf8, Invalid) {
+  // Continuation byte without a lead.
+  EXPECT_THAT(ValidateUtf8("a\x80").invalid_offset, Optional(Eq(1)));
+  // Overlong encodings.
+  EXPECT_THAT(ValidateUtf8("\xC0\xAF").invalid_offset, Optional(Eq(0)));
+  EXPECT_THAT(ValidateUtf8("\xE0\x9F\xBF").invalid_offset, Optional(Eq(0)));
+  EXPECT_THAT(ValidateUtf8("\xF0\x8F\xBF\xBF").invalid_offset,
+              Optional(Eq(0)));
+  // Surrogate.
+  EXPECT_THAT(ValidateUtf8("ab\xED\xA0\x80").invalid_offset,
+              Optional(Eq(2)));
+  // Past U+10FFFF.
+  EXPECT_THAT(ValidateUtf8("\xF4\x90\x80\x80").invalid_offset,
+              Optional(Eq(0)));
+  EXPECT_THAT(ValidateUtf8("\xFF").invalid_offset, Optional(Eq(0)));
+  // Truncated sequences.
+  EXPECT_THAT(ValidateUtf8("abc\xE2\x9D").invalid_offset, Optional(Eq(3)));
+  EXPECT_THAT(ValidateUtf8("\xE2\x9Dz").invalid_offset, Optional(Eq(0)));
+}
+
+TEST(ValidateUtf8, LongText) {
+  // Invalid and non-ASCII bytes landing at every offset within and across
+  // vector blocks.
+  for (int length = 0; length < 150; ++length) {
+    SCOPED_TRACE(length);
+    std::string ascii(length, 'a');
+    Utf8Validation validation = ValidateUtf8(ascii + "0123456789");
+    EXPECT_THAT(validation.invalid_offset, Eq(std::nullopt));
+    EXPECT_TRUE(validation.is_ascii);
+
+    validation = ValidateUtf8(ascii + "\xF0\x9F\x94\x8A" + ascii);
+    EXPECT_THAT(validation.invalid_offset, Eq(std::nullopt));
+    EXPECT_FALSE(validation.is_ascii);
+
+    EXPECT_THAT(ValidateUtf8(ascii + "\xF0\x9F\x94" + ascii).invalid_offset,
+                Optional(Eq(length)));
+    EXPECT_THAT(ValidateUtf8(ascii + "\xC3\xA9" + ascii + "\x80" + ascii)
+                    .invalid_offset,
+                Optional(Eq(2 * length + 2)));
+  }
+}
+
 TEST(ParseBlockStringLiteral, FailTooFewLines) {
   EXPECT_THAT(ParseBlockStringLiteral("").error().message(),
               Eq("Too few lines"));
@@ -225,5 +297,15 @@ TEST(ParseBlockStringLiteral, OkMultipleSlashes) {
   EXPECT_THAT(*ParseBlockStringLiteral(Input), Eq(Expected));
 }
 
+TEST(ParseBlockStringLiteral, OkWithHashtagSlashNewline) {
+  constexpr char Input[] = R"('''
+     A block \
+     string \#
+     literal
+     ''')";
+  constexpr char Expected[] = "A block \\\nstring literal\n";
+  EXPECT_THAT(*ParseBlockStringLiteral(Input, 1), Eq(Expected));
+}
+
 }  // namespace
 }  // namespace Cocktail
\ No newline at end of file
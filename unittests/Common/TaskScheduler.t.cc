@@ -0,0 +1,81 @@
+#include "Cocktail/Common/TaskScheduler.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+namespace Cocktail {
+namespace {
+
+TEST(TaskScheduler, RunsEveryTask) {
+  std::atomic<int> count = 0;
+  {
+    TaskScheduler scheduler(4);
+    EXPECT_EQ(scheduler.num_threads(), 4);
+    for (int i = 0; i != 1000; ++i) {
+      scheduler.Spawn([&] { ++count; });
+    }
+    // The tasks spawned before destruction all run.
+  }
+  EXPECT_EQ(count, 1000);
+}
+
+TEST(TaskScheduler, ParallelFor) {
+  TaskScheduler scheduler(4);
+  std::vector<int> values(1000);
+  ParallelFor(scheduler, values.size(), [&](int i) { values[i] = i * 2; });
+  for (int i = 0; i != static_cast<int>(values.size()); ++i) {
+    EXPECT_EQ(values[i], i * 2);
+  }
+
+  // Nothing to do returns at once.
+  ParallelFor(scheduler, 0, [&](int /*i*/) { ADD_FAILURE(); });
+}
+
+TEST(TaskScheduler, NestedWaits) {
+  // Every task waits for tasks of its own, many more than there are threads,
+  // which only finishes because waiting runs the queued tasks.
+  TaskScheduler scheduler(2);
+  std::atomic<int> count = 0;
+  ParallelFor(scheduler, 16, [&](int /*i*/) {
+    ParallelFor(scheduler, 16, [&](int /*j*/) {
+      ParallelFor(scheduler, 4, [&](int /*k*/) { ++count; });
+    });
+  });
+  EXPECT_EQ(count, 16 * 16 * 4);
+}
+
+TEST(TaskGroup, Cancel) {
+  TaskScheduler scheduler(2);
+  std::atomic<int> count = 0;
+  TaskGroup group(scheduler);
+  group.Cancel();
+  EXPECT_TRUE(group.cancelled());
+  for (int i = 0; i != 100; ++i) {
+    group.Run([&] { ++count; });
+  }
+  group.Wait();
+  EXPECT_EQ(count, 0);
+}
+
+TEST(TaskGroup, CancelFromTask) {
+  // Tasks that haven't started by the time one cancels the group are skipped.
+  TaskScheduler scheduler(1);
+  std::atomic<int> count = 0;
+  TaskGroup group(scheduler);
+  for (int i = 0; i != 100; ++i) {
+    group.Run([&] {
+      if (++count == 10) {
+        group.Cancel();
+      }
+    });
+  }
+  group.Wait();
+  EXPECT_GE(count, 10);
+  EXPECT_LT(count, 100);
+}
+
+}  // namespace
+}  // namespace Cocktail
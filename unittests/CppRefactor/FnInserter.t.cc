@@ -85,5 +85,13 @@ TEST_F(FnInserterTest, LegacyReturn) {
   ExpectReplacement(Before, Before);
 }
 
+TEST_F(FnInserterTest, Stats) {
+  ExpectReplacement("void A(); int B(); auto C() -> int;",
+                    "fn A(); int B(); fn C() -> int;");
+  std::vector<MatcherStats> stats = matchers.GetStats();
+  ASSERT_THAT(stats, testing::SizeIs(1));
+  EXPECT_THAT(stats[0].name, testing::Eq("FnInserter"));
+  EXPECT_THAT(stats[0].matches, testing::Eq(2));
+}
 
 }  // namespace
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "Cocktail/CppRefactor/ReplacementWriter.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace Cocktail;
+
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+TEST(MakeUnifiedDiffTest, NoChanges) {
+  EXPECT_EQ(MakeUnifiedDiff("a.cc", "int a;\n", Replacements()), "");
+  Replacements same(Replacement("a.cc", 0, 3, "int"));
+  EXPECT_EQ(MakeUnifiedDiff("a.cc", "int a;\n", same), "");
+}
+
+TEST(MakeUnifiedDiffTest, Line) {
+  Replacements replacements(Replacement("a.cc", 2, 1, "x"));
+  EXPECT_EQ(MakeUnifiedDiff("a.cc", "a\nb\nc\n", replacements),
+            "--- a.cc\n"
+            "+++ a.cc\n"
+            "@@ -1,3 +1,3 @@\n"
+            " a\n"
+            "-b\n"
+            "+x\n"
+            " c\n");
+}
+
+TEST(MakeUnifiedDiffTest, NoNewlineAtEnd) {
+  Replacements replacements(Replacement("a.cc", 1, 0, "b"));
+  EXPECT_EQ(MakeUnifiedDiff("a.cc", "a", replacements),
+            "--- a.cc\n"
+            "+++ a.cc\n"
+            "@@ -1,1 +1,1 @@\n"
+            "-a\n"
+            "\\ No newline at end of file\n"
+            "+ab\n"
+            "\\ No newline at end of file\n");
+}
+
+TEST(MakeUnifiedDiffTest, Hunks) {
+  std::string code;
+  for (int line = 1; line <= 12; ++line) {
+    code += std::to_string(line) + "\n";
+  }
+  Replacements replacements;
+  llvm::cantFail(replacements.add(Replacement("a.cc", 0, 1, "1\n1b")));
+  llvm::cantFail(replacements.add(Replacement("a.cc", 24, 2, "twelve")));
+  EXPECT_EQ(MakeUnifiedDiff("a.cc", code, replacements),
+            "--- a.cc\n"
+            "+++ a.cc\n"
+            "@@ -1,4 +1,5 @@\n"
+            "-1\n"
+            "+1\n"
+            "+1b\n"
+            " 2\n"
+            " 3\n"
+            " 4\n"
+            "@@ -9,4 +10,4 @@\n"
+            " 9\n"
+            " 10\n"
+            " 11\n"
+            "-12\n"
+            "+twelve\n");
+}
+
+}  // namespace
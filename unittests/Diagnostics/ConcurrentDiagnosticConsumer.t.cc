@@ -0,0 +1,101 @@
+#include "Cocktail/Diagnostics/ConcurrentDiagnosticConsumer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ThreadPool.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+
+COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0}", llvm::StringRef);
+
+struct FakeDiagnosticLocationTranslator
+    : DiagnosticLocationTranslator<DiagnosticLocation> {
+  auto GetLocation(DiagnosticLocation loc) -> DiagnosticLocation override {
+    return loc;
+  }
+};
+
+// Records each diagnostic as `file:line:column: message`.
+struct RecordingDiagnosticConsumer : DiagnosticConsumer {
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    const DiagnosticMessage& message = diagnostic.message;
+    diagnostics.push_back(llvm::formatv(
+        "{0}:{1}:{2}: {3}", message.location().file_name,
+        message.location().line_number, message.location().column_number,
+        message.format_fn(message)));
+  }
+
+  std::vector<std::string> diagnostics;
+};
+
+auto At(llvm::StringRef file_name, int line_number) -> DiagnosticLocation {
+  return {.file_name = file_name, .line_number = line_number,
+          .column_number = 1};
+}
+
+TEST(ConcurrentDiagnosticConsumerTest, SortsByFileThenPosition) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  ConcurrentDiagnosticConsumer concurrent_consumer(consumer);
+  DiagnosticEmitter<DiagnosticLocation> emitter(translator,
+                                                concurrent_consumer);
+
+  emitter.Emit(At("b", 1), TestDiagnostic, "M1");
+  emitter.Emit(At("a", 2), TestDiagnostic, "M2");
+  emitter.Emit(At("a", 1), TestDiagnostic, "M4");
+  emitter.Emit(At("a", 1), TestDiagnostic, "M3");
+  concurrent_consumer.Flush();
+
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("a:1:1: M3", "a:1:1: M4", "a:2:1: M2", "b:1:1: M1"));
+}
+
+TEST(ConcurrentDiagnosticConsumerTest, HandlesDiagnosticsConcurrently) {
+  constexpr int NumFiles = 16;
+  constexpr int NumLines = 200;
+  std::vector<std::string> file_names;
+  for (int file = 0; file != NumFiles; ++file) {
+    file_names.push_back(llvm::formatv("file{0:2}", file));
+  }
+
+  RecordingDiagnosticConsumer consumer;
+  ConcurrentDiagnosticConsumer concurrent_consumer(consumer);
+  llvm::ThreadPool thread_pool;
+  for (int file = 0; file != NumFiles; ++file) {
+    thread_pool.async([&, file] {
+      FakeDiagnosticLocationTranslator translator;
+      DiagnosticEmitter<DiagnosticLocation> emitter(translator,
+                                                    concurrent_consumer);
+      // Each file reports its lines out of order.
+      for (int i = 0; i != NumLines; ++i) {
+        int line = (i * 7 + file) % NumLines + 1;
+        emitter.Emit(At(file_names[file], line), TestDiagnostic, "M");
+      }
+    });
+  }
+  thread_pool.wait();
+  concurrent_consumer.Flush();
+
+  ASSERT_THAT(consumer.diagnostics.size(), Eq(NumFiles * NumLines));
+  for (int file = 0; file != NumFiles; ++file) {
+    for (int line = 1; line <= NumLines; ++line) {
+      EXPECT_THAT(consumer.diagnostics[file * NumLines + line - 1],
+                  Eq(llvm::formatv("{0}:{1}:1: M", file_names[file], line)
+                         .str()));
+    }
+  }
+}
+
+}  // namespace
@@ -0,0 +1,84 @@
+#include "Cocktail/Diagnostics/DeduplicatingDiagnosticConsumer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FormatVariadic.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+
+COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0}", llvm::StringRef);
+COCKTAIL_DIAGNOSTIC(TestDiagnosticNote, Note, "{0}", llvm::StringRef);
+
+struct FakeDiagnosticLocationTranslator : DiagnosticLocationTranslator<int> {
+  auto GetLocation(int n) -> DiagnosticLocation override {
+    return {.file_name = "f", .line_number = 1, .column_number = n};
+  }
+};
+
+// Records each diagnostic as `line:column: message`.
+struct RecordingDiagnosticConsumer : DiagnosticConsumer {
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    const DiagnosticMessage& message = diagnostic.message;
+    diagnostics.push_back(llvm::formatv("{0}:{1}: {2}",
+                                        message.location().line_number,
+                                        message.location().column_number,
+                                        message.format_fn(message)));
+  }
+
+  std::vector<std::string> diagnostics;
+};
+
+TEST(DeduplicatingDiagnosticConsumerTest, DropsDuplicates) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  DeduplicatingDiagnosticConsumer deduplicating_consumer(consumer);
+  DiagnosticEmitter<int> emitter(translator, deduplicating_consumer);
+
+  emitter.Emit(1, TestDiagnostic, "M1");
+  emitter.Emit(1, TestDiagnostic, "M1");
+  emitter.Emit(2, TestDiagnostic, "M1");
+  emitter.Emit(1, TestDiagnostic, "M2");
+  // The same message with a different note isn't a duplicate.
+  emitter.Build(1, TestDiagnostic, "M1")
+      .Note(3, TestDiagnosticNote, "N1")
+      .Emit();
+  emitter.Build(1, TestDiagnostic, "M1")
+      .Note(3, TestDiagnosticNote, "N1")
+      .Emit();
+
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("1:1: M1", "1:2: M1", "1:1: M2", "1:1: M1"));
+  EXPECT_THAT(deduplicating_consumer.duplicates(), Eq(2));
+}
+
+TEST(DeduplicatingDiagnosticConsumerTest, RemembersAtMostLimit) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  DeduplicatingDiagnosticConsumer deduplicating_consumer(
+      consumer, /*max_remembered=*/2);
+  DiagnosticEmitter<int> emitter(translator, deduplicating_consumer);
+
+  emitter.Emit(1, TestDiagnostic, "M1");
+  emitter.Emit(2, TestDiagnostic, "M1");
+  // Past the limit, new diagnostics are passed on without being remembered.
+  emitter.Emit(3, TestDiagnostic, "M1");
+  emitter.Emit(3, TestDiagnostic, "M1");
+  emitter.Emit(1, TestDiagnostic, "M1");
+
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("1:1: M1", "1:2: M1", "1:3: M1", "1:3: M1"));
+  EXPECT_THAT(deduplicating_consumer.duplicates(), Eq(1));
+}
+
+}  // namespace
@@ -0,0 +1,179 @@
+#include "Cocktail/Diagnostics/DiagnosticCache.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FormatVariadic.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsNull;
+using ::testing::NotNull;
+
+COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0}", llvm::StringRef);
+COCKTAIL_DIAGNOSTIC(TestDiagnosticNote, Note, "{0}", llvm::StringRef);
+
+struct FakeDiagnosticLocationTranslator : DiagnosticLocationTranslator<int> {
+  auto GetLocation(int n) -> DiagnosticLocation override {
+    return {.file_name = "f", .line = "text", .line_number = 1,
+            .column_number = n};
+  }
+};
+
+// Records each diagnostic as `line:column: message`, with its notes.
+struct RecordingDiagnosticConsumer : DiagnosticConsumer {
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    Record(diagnostic.message);
+    for (const DiagnosticMessage& note : diagnostic.notes) {
+      Record(note);
+    }
+  }
+
+  auto Record(const DiagnosticMessage& message) -> void {
+    diagnostics.push_back(llvm::formatv(
+        "{0}:{1}:{2}: {3} ({4})", message.location().file_name,
+        message.location().line_number, message.location().column_number,
+        message.format_fn(message), message.location().line));
+  }
+
+  auto ShouldStop() -> bool override { return stop; }
+
+  std::vector<std::string> diagnostics;
+  bool stop = false;
+};
+
+TEST(DiagnosticCacheTest, RecordsAndReplays) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  DiagnosticCache cache;
+
+  DiagnosticCache::Recorder recorder(consumer);
+  {
+    DiagnosticEmitter<int> emitter(translator, recorder);
+    std::string text = "M1";
+    emitter.Emit(1, TestDiagnostic, text);
+    // The recorded text doesn't refer to the argument.
+    text = "XX";
+    emitter.Build(2, TestDiagnostic, "M2")
+        .Note(3, TestDiagnosticNote, "N1")
+        .Emit();
+  }
+  EXPECT_FALSE(recorder.ShouldStop());
+  cache.Insert(DiagnosticCache::Stage::Lex, "f", 42,
+               recorder.Take("output"));
+  EXPECT_THAT(consumer.diagnostics.size(), Eq(3));
+  consumer.diagnostics.clear();
+
+  EXPECT_THAT(cache.Lookup(DiagnosticCache::Stage::Parse, "f", 42), IsNull());
+  EXPECT_THAT(cache.Lookup(DiagnosticCache::Stage::Lex, "g", 42), IsNull());
+  EXPECT_THAT(cache.Lookup(DiagnosticCache::Stage::Lex, "f", 43), IsNull());
+  auto entry = cache.Lookup(DiagnosticCache::Stage::Lex, "f", 42);
+  ASSERT_THAT(entry, NotNull());
+  EXPECT_THAT(entry->data(), Eq("output"));
+
+  entry->Replay(consumer);
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("f:1:1: M1 (text)", "f:1:2: M2 (text)",
+                          "f:1:3: N1 (text)"));
+
+  // Only the latest content of each file is kept.
+  cache.Insert(DiagnosticCache::Stage::Lex, "f", 43,
+               DiagnosticCache::Recorder(consumer).Take("new output"));
+  EXPECT_THAT(cache.Lookup(DiagnosticCache::Stage::Lex, "f", 42), IsNull());
+  ASSERT_THAT(cache.Lookup(DiagnosticCache::Stage::Lex, "f", 43), NotNull());
+  EXPECT_THAT(cache.Lookup(DiagnosticCache::Stage::Lex, "f", 43)->data(),
+              Eq("new output"));
+
+  cache.Clear();
+  EXPECT_THAT(cache.Lookup(DiagnosticCache::Stage::Lex, "f", 43), IsNull());
+}
+
+TEST(DiagnosticCacheTest, Serialize) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  DiagnosticCache::Recorder recorder(consumer);
+  {
+    DiagnosticEmitter<int> emitter(translator, recorder);
+    emitter.Emit(1, TestDiagnostic, "M1");
+    emitter.Build(2, TestDiagnostic, "M2")
+        .Note(3, TestDiagnosticNote, "N1")
+        .Emit();
+  }
+  auto entry = recorder.Take("output");
+  ASSERT_THAT(entry, NotNull());
+  consumer.diagnostics.clear();
+
+  std::string data;
+  llvm::raw_string_ostream data_stream(data);
+  entry->Serialize(data_stream);
+  auto read_entry = DiagnosticCache::Entry::Deserialize(data_stream.str());
+  ASSERT_THAT(read_entry, NotNull());
+  EXPECT_THAT(read_entry->data(), Eq("output"));
+  read_entry->Replay(consumer);
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("f:1:1: M1 (text)", "f:1:2: M2 (text)",
+                          "f:1:3: N1 (text)"));
+
+  // Truncated or extended data is rejected.
+  for (size_t size = 0; size != data.size(); ++size) {
+    llvm::StringRef truncated = llvm::StringRef(data).take_front(size);
+    EXPECT_THAT(DiagnosticCache::Entry::Deserialize(truncated), IsNull());
+  }
+  EXPECT_THAT(DiagnosticCache::Entry::Deserialize(data + "x"), IsNull());
+}
+
+// Keeps each diagnostic it's passed, as sorting does.
+struct KeepingDiagnosticConsumer : DiagnosticConsumer {
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    diagnostics.push_back(std::move(diagnostic));
+  }
+
+  std::vector<Diagnostic> diagnostics;
+};
+
+TEST(DiagnosticCacheTest, ReplayedDiagnosticsOutliveEntry) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  DiagnosticCache cache;
+  DiagnosticCache::Recorder recorder(consumer);
+  {
+    DiagnosticEmitter<int> emitter(translator, recorder);
+    emitter.Emit(1, TestDiagnostic, "M1");
+  }
+  cache.Insert(DiagnosticCache::Stage::Lex, "f", 42, recorder.Take(""));
+  consumer.diagnostics.clear();
+
+  KeepingDiagnosticConsumer keeping_consumer;
+  cache.Lookup(DiagnosticCache::Stage::Lex, "f", 42)->Replay(keeping_consumer);
+  // Replacing the entry doesn't free what the kept diagnostics refer to.
+  cache.Insert(DiagnosticCache::Stage::Lex, "f", 42,
+               DiagnosticCache::Recorder(consumer).Take(""));
+  cache.Clear();
+  ASSERT_THAT(keeping_consumer.diagnostics.size(), Eq(1));
+  consumer.Record(keeping_consumer.diagnostics[0].message);
+  EXPECT_THAT(consumer.diagnostics, ElementsAre("f:1:1: M1 (text)"));
+}
+
+TEST(DiagnosticCacheTest, DoesNotKeepStoppedStages) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  DiagnosticCache::Recorder recorder(consumer);
+  DiagnosticEmitter<int> emitter(translator, recorder);
+
+  emitter.Emit(1, TestDiagnostic, "M1");
+  consumer.stop = true;
+  EXPECT_TRUE(recorder.ShouldStop());
+  consumer.stop = false;
+  EXPECT_THAT(recorder.Take("output"), IsNull());
+}
+
+}  // namespace
@@ -3,6 +3,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <string>
+
 #include "Cocktail/Testing/Mocks.t.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FormatVariadic.h"
@@ -56,4 +58,71 @@ TEST_F(DiagnosticEmitterTest, EmitOneArgDiagnostic) {
   emitter_.Emit(1, TestDiagnostic, "str");
 }
 
+TEST_F(DiagnosticEmitterTest, EmitMultipleArgDiagnostic) {
+  COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0} {1} {2}", llvm::StringRef,
+                      int, llvm::StringRef);
+  EXPECT_CALL(consumer_, HandleDiagnostic(IsDiagnostic(
+                             DiagnosticKind::TestDiagnostic,
+                             DiagnosticLevel::Error, 1, 1, "a 42 b")));
+  emitter_.Emit(1, TestDiagnostic, "a", 42, "b");
+}
+
+TEST_F(DiagnosticEmitterTest, CopyAndMoveFormatArgs) {
+  COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0}: {1}", std::string, int);
+  DiagnosticMessage message(
+      DiagnosticKind::TestDiagnostic, {.line_number = 1, .column_number = 1},
+      TestDiagnostic.Format,
+      DiagnosticFormatArgs::Make<std::string, int>(
+          std::string("a string too long to be stored inline"), 1),
+      &decltype(TestDiagnostic)::FormatFn);
+  DiagnosticMessage copy = message;
+  DiagnosticMessage moved = std::move(message);
+  EXPECT_EQ(copy.format_fn(copy), "a string too long to be stored inline: 1");
+  EXPECT_EQ(moved.format_fn(moved),
+            "a string too long to be stored inline: 1");
+  copy = moved;
+  moved = std::move(copy);
+  EXPECT_EQ(moved.format_fn(moved),
+            "a string too long to be stored inline: 1");
+}
+
+TEST(DiagnosticEmitterLocationTest, ResolvesLocationsLazily) {
+  struct CountingTranslator : DiagnosticLocationTranslator<int> {
+    auto GetLocation(int n) -> DiagnosticLocation override {
+      ++count;
+      return {.line_number = 1, .column_number = n};
+    }
+    int count = 0;
+  } translator;
+  struct : DiagnosticConsumer {
+    auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+      if (resolve) {
+        columns.push_back(diagnostic.message.location().column_number);
+        columns.push_back(diagnostic.message.location().column_number);
+      }
+    }
+    bool resolve = false;
+    llvm::SmallVector<int> columns;
+  } consumer;
+  DiagnosticEmitter<int> emitter(translator, consumer);
+  COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "simple error");
+
+  emitter.Emit(1, TestDiagnostic);
+  EXPECT_EQ(translator.count, 0);
+
+  consumer.resolve = true;
+  emitter.Emit(2, TestDiagnostic);
+  EXPECT_EQ(translator.count, 1);
+  EXPECT_THAT(consumer.columns, testing::ElementsAre(2, 2));
+}
+
+TEST_F(DiagnosticEmitterTest, GetLocations) {
+  int locs[] = {3, 1, 2};
+  DiagnosticLocation locations[3];
+  translator_.GetLocations(locs, locations);
+  EXPECT_EQ(locations[0].column_number, 3);
+  EXPECT_EQ(locations[1].column_number, 1);
+  EXPECT_EQ(locations[2].column_number, 2);
+}
+
 }  // namespace
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "Cocktail/Diagnostics/ErrorBudgetDiagnosticConsumer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FormatVariadic.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+
+COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0}", llvm::StringRef);
+COCKTAIL_DIAGNOSTIC(TestDiagnosticNote, Warning, "{0}", llvm::StringRef);
+
+struct FakeDiagnosticLocationTranslator : DiagnosticLocationTranslator<int> {
+  auto GetLocation(int n) -> DiagnosticLocation override {
+    return {.file_name = "f", .line_number = 1, .column_number = n};
+  }
+};
+
+// Records each diagnostic as `line:column: message`.
+struct RecordingDiagnosticConsumer : DiagnosticConsumer {
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    const DiagnosticMessage& message = diagnostic.message;
+    diagnostics.push_back(llvm::formatv("{0}:{1}: {2}",
+                                        message.location().line_number,
+                                        message.location().column_number,
+                                        message.format_fn(message)));
+  }
+
+  std::vector<std::string> diagnostics;
+};
+
+TEST(ErrorBudgetDiagnosticConsumerTest, LimitsErrors) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  ErrorBudgetDiagnosticConsumer budget(consumer, /*max_errors=*/2);
+  DiagnosticEmitter<int> emitter(translator, budget);
+
+  emitter.Emit(1, TestDiagnostic, "M1");
+  emitter.Emit(2, TestDiagnosticNote, "W1");
+  EXPECT_FALSE(budget.ShouldStop());
+  emitter.Emit(3, TestDiagnostic, "M2");
+  EXPECT_TRUE(budget.ShouldStop());
+  emitter.Emit(4, TestDiagnostic, "M3");
+  emitter.Emit(5, TestDiagnosticNote, "W2");
+  EXPECT_EQ(budget.suppressed(), 2);
+
+  budget.Flush();
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("1:1: M1", "1:2: W1", "1:3: M2",
+                          "0:0: 2 more diagnostic(s) suppressed by error "
+                          "limits."));
+  EXPECT_EQ(budget.suppressed(), 0);
+}
+
+TEST(ErrorBudgetDiagnosticConsumerTest, LimitsKinds) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  ErrorBudgetDiagnosticConsumer budget(consumer);
+  budget.SetKindLimit(DiagnosticKind::TestDiagnostic, 1);
+  DiagnosticEmitter<int> emitter(translator, budget);
+
+  emitter.Emit(1, TestDiagnostic, "M1");
+  emitter.Emit(2, TestDiagnostic, "M2");
+  emitter.Emit(3, TestDiagnosticNote, "W1");
+  // Only the total number of errors stops lexing and parsing.
+  EXPECT_FALSE(budget.ShouldStop());
+
+  budget.Flush();
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("1:1: M1", "1:3: W1",
+                          "0:0: 1 more diagnostic(s) suppressed by error "
+                          "limits."));
+}
+
+}  // namespace
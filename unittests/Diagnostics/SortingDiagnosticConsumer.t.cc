@@ -3,6 +3,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
 #include "Cocktail/Testing/Mocks.t.h"
 #include "llvm/ADT/StringRef.h"
@@ -12,6 +15,7 @@ namespace {
 
 using namespace Cocktail;
 using namespace Cocktail::Testing;
+using ::testing::ElementsAre;
 using ::testing::InSequence;
 
 COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0}", llvm::StringRef);
@@ -54,4 +58,65 @@ TEST(SortedDiagnosticEmitterTest, SortErrors) {
   sorting_consumer.Flush();
 }
 
+// Records each diagnostic as `line:column: message`.
+struct RecordingDiagnosticConsumer : DiagnosticConsumer {
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    const DiagnosticMessage& message = diagnostic.message;
+    diagnostics.push_back(llvm::formatv("{0}:{1}: {2}",
+                                        message.location().line_number,
+                                        message.location().column_number,
+                                        message.format_fn(message)));
+  }
+
+  std::vector<std::string> diagnostics;
+};
+
+auto At(int line_number, int column_number) -> DiagnosticLocation {
+  return {.file_name = "f",
+          .line_number = line_number,
+          .column_number = column_number};
+}
+
+TEST(SortedDiagnosticEmitterTest, MergesRunsStably) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  SortingDiagnosticConsumer sorting_consumer(consumer);
+  DiagnosticEmitter<DiagnosticLocation> emitter(translator, sorting_consumer);
+
+  emitter.Emit(At(1, 1), TestDiagnostic, "M1");
+  emitter.Emit(At(3, 1), TestDiagnostic, "M2");
+  emitter.Emit(At(2, 1), TestDiagnostic, "M3");
+  emitter.Emit(At(3, 1), TestDiagnostic, "M4");
+  emitter.Emit(At(1, 2), TestDiagnostic, "M5");
+  emitter.Emit(At(5, 1), TestDiagnostic, "M6");
+  emitter.Emit(At(4, 1), TestDiagnostic, "M7");
+
+  sorting_consumer.Flush();
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("1:1: M1", "1:2: M5", "2:1: M3", "3:1: M2",
+                          "3:1: M4", "4:1: M7", "5:1: M6"));
+}
+
+TEST(SortedDiagnosticEmitterTest, FlushBefore) {
+  FakeDiagnosticLocationTranslator translator;
+  RecordingDiagnosticConsumer consumer;
+  SortingDiagnosticConsumer sorting_consumer(consumer);
+  DiagnosticEmitter<DiagnosticLocation> emitter(translator, sorting_consumer);
+
+  emitter.Emit(At(2, 1), TestDiagnostic, "M1");
+  emitter.Emit(At(1, 1), TestDiagnostic, "M2");
+  emitter.Emit(At(3, 1), TestDiagnostic, "M3");
+  sorting_consumer.FlushBefore(3);
+  EXPECT_THAT(consumer.diagnostics, ElementsAre("1:1: M2", "2:1: M1"));
+
+  // Diagnostics before the watermark are no longer sorted.
+  emitter.Emit(At(2, 2), TestDiagnostic, "M4");
+  emitter.Emit(At(4, 1), TestDiagnostic, "M5");
+  emitter.Emit(At(3, 2), TestDiagnostic, "M6");
+  sorting_consumer.Flush();
+  EXPECT_THAT(consumer.diagnostics,
+              ElementsAre("1:1: M2", "2:1: M1", "2:2: M4", "3:1: M3",
+                          "3:2: M6", "4:1: M5"));
+}
+
 }  // namespace
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "Cocktail/Diagnostics/StructuredDiagnosticConsumer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::Eq;
+using ::testing::StrEq;
+
+COCKTAIL_DIAGNOSTIC(TestDiagnostic, Error, "{0}", llvm::StringRef);
+COCKTAIL_DIAGNOSTIC(TestDiagnosticNote, Note, "{0}", llvm::StringRef);
+
+struct FakeDiagnosticLocationTranslator : DiagnosticLocationTranslator<int> {
+  auto GetLocation(int n) -> DiagnosticLocation override {
+    return {.file_name = "f", .line_number = n, .column_number = n};
+  }
+};
+
+TEST(StructuredDiagnosticConsumerTest, Json) {
+  std::string output;
+  llvm::raw_string_ostream stream(output);
+  FakeDiagnosticLocationTranslator translator;
+  StructuredDiagnosticConsumer consumer(
+      stream, StructuredDiagnosticConsumer::Format::Json);
+  DiagnosticEmitter<int> emitter(translator, consumer);
+
+  emitter.Emit(1, TestDiagnostic, "M\"1\"");
+  emitter.Build(2, TestDiagnostic, "M2")
+      .Note(0, TestDiagnosticNote, "N1")
+      .Emit();
+  // The output is only written when flushed.
+  EXPECT_THAT(output, StrEq(""));
+
+  consumer.Flush();
+  EXPECT_THAT(
+      output,
+      StrEq(R"({"kind":"TestDiagnostic","file":"f","line":1,"column":1,)"
+            R"("message":"M\"1\"","level":"error"})"
+            "\n"
+            R"({"kind":"TestDiagnostic","file":"f","line":2,"column":2,)"
+            R"("message":"M2","level":"error","notes":[)"
+            R"({"kind":"TestDiagnosticNote","file":"f","message":"N1"}]})"
+            "\n"));
+}
+
+TEST(StructuredDiagnosticConsumerTest, Binary) {
+  std::string output;
+  llvm::raw_string_ostream stream(output);
+  FakeDiagnosticLocationTranslator translator;
+  StructuredDiagnosticConsumer consumer(
+      stream, StructuredDiagnosticConsumer::Format::Binary);
+  DiagnosticEmitter<int> emitter(translator, consumer);
+
+  emitter.Emit(3, TestDiagnostic, "M1");
+  consumer.Flush();
+
+  const char* in = output.data();
+  auto read = [&](auto value) {
+    value = llvm::support::endian::read<decltype(value),
+                                        llvm::support::little,
+                                        llvm::support::unaligned>(in);
+    in += sizeof(value);
+    return value;
+  };
+  auto read_string = [&] {
+    uint32_t size = read(uint32_t{});
+    llvm::StringRef text(in, size);
+    in += size;
+    return text;
+  };
+
+  constexpr auto& Magic = StructuredDiagnosticConsumer::BinaryMagic;
+  EXPECT_THAT(llvm::StringRef(in, sizeof(Magic)),
+              Eq(llvm::StringRef(Magic, sizeof(Magic))));
+  in += sizeof(Magic);
+  EXPECT_THAT(read(uint32_t{}),
+              Eq(StructuredDiagnosticConsumer::BinaryVersion));
+  std::vector<llvm::StringRef> kind_names(read(uint32_t{}));
+  for (llvm::StringRef& name : kind_names) {
+    name = read_string();
+  }
+
+  EXPECT_THAT(read(uint8_t{}),
+              Eq(static_cast<uint8_t>(DiagnosticLevel::Error)));
+  EXPECT_THAT(read(uint32_t{}), Eq(0));
+  EXPECT_THAT(kind_names[read(uint16_t{})], Eq("TestDiagnostic"));
+  EXPECT_THAT(read(uint32_t{}), Eq(3));
+  EXPECT_THAT(read(uint32_t{}), Eq(3));
+  EXPECT_THAT(read_string(), Eq("f"));
+  EXPECT_THAT(read_string(), Eq("M1"));
+  EXPECT_THAT(in, Eq(output.data() + output.size()));
+}
+
+}  // namespace
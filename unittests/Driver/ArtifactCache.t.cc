@@ -0,0 +1,122 @@
+#include "Cocktail/Driver/ArtifactCache.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+class ArtifactCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("artifact_cache", directory_));
+  }
+
+  void TearDown() override { llvm::sys::fs::remove_directories(directory_); }
+
+  // Returns the number of files in the cache directory.
+  auto CountFiles() -> int {
+    int count = 0;
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(directory_, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      ++count;
+    }
+    return count;
+  }
+
+  // Sets the time that the artifact for `key` was last used.
+  auto SetLastUsed(llvm::StringRef key, int seconds_ago) -> void {
+    llvm::SmallString<256> path = directory_;
+    llvm::sys::path::append(path, key + ".artifact");
+    int fd = -1;
+    ASSERT_FALSE(llvm::sys::fs::openFileForWrite(
+        path, fd, llvm::sys::fs::CD_OpenExisting));
+    llvm::sys::TimePoint<> time = std::chrono::system_clock::now() -
+                                  std::chrono::seconds(seconds_ago);
+    EXPECT_FALSE(llvm::sys::fs::setLastAccessAndModificationTime(fd, time));
+    llvm::sys::fs::closeFile(fd);
+  }
+
+  llvm::SmallString<256> directory_;
+};
+
+TEST_F(ArtifactCacheTest, MakeKey) {
+  EXPECT_THAT(ArtifactCache::MakeKey({"a", "b"}),
+              Eq(ArtifactCache::MakeKey({"a", "b"})));
+  EXPECT_THAT(ArtifactCache::MakeKey({"a", "b"}),
+              Ne(ArtifactCache::MakeKey({"ab", ""})));
+  EXPECT_THAT(ArtifactCache::MakeKey({"a"}).size(), Eq(64));
+}
+
+TEST_F(ArtifactCacheTest, InsertAndLookup) {
+  ArtifactCache cache(directory_);
+  std::string key = ArtifactCache::MakeKey({"source"});
+  EXPECT_FALSE(cache.Lookup(key));
+  ASSERT_TRUE(cache.Insert(key, "data"));
+  auto artifact = cache.Lookup(key);
+  ASSERT_TRUE(artifact);
+  EXPECT_THAT(artifact->data(), Eq("data"));
+
+  // Another cache on the same directory sees it, and replaces it.
+  ArtifactCache other_cache(directory_);
+  ASSERT_TRUE(other_cache.Insert(key, "new data"));
+  EXPECT_THAT(cache.Lookup(key)->data(), Eq("new data"));
+  // The artifact read before the replacement is unchanged.
+  EXPECT_THAT(artifact->data(), Eq("data"));
+  // No temporary files are left behind.
+  EXPECT_THAT(CountFiles(), Eq(1));
+}
+
+TEST_F(ArtifactCacheTest, RejectsCorruptArtifacts) {
+  ArtifactCache cache(directory_);
+  std::string key = ArtifactCache::MakeKey({"source"});
+  ASSERT_TRUE(cache.Insert(key, "data"));
+
+  llvm::SmallString<256> path = directory_;
+  llvm::sys::path::append(path, key + ".artifact");
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_Append);
+  ASSERT_FALSE(ec);
+  out << "more";
+  out.close();
+  EXPECT_FALSE(cache.Lookup(key));
+}
+
+TEST_F(ArtifactCacheTest, EvictsLeastRecentlyUsed) {
+  // Room for three artifacts of this size, but not four.
+  std::string data(1000, 'x');
+  ArtifactCache cache(directory_, /*max_size=*/3500);
+  std::string keys[4];
+  for (int i = 0; i != 3; ++i) {
+    keys[i] = ArtifactCache::MakeKey({std::to_string(i)});
+    ASSERT_TRUE(cache.Insert(keys[i], data));
+    SetLastUsed(keys[i], /*seconds_ago=*/100 - i * 10);
+  }
+  // Using the oldest makes the second the least recently used.
+  EXPECT_TRUE(cache.Lookup(keys[0]));
+
+  keys[3] = ArtifactCache::MakeKey({"3"});
+  ASSERT_TRUE(cache.Insert(keys[3], data));
+  cache.Prune();
+  EXPECT_TRUE(cache.Lookup(keys[0]));
+  EXPECT_FALSE(cache.Lookup(keys[1]));
+  EXPECT_TRUE(cache.Lookup(keys[3]));
+  EXPECT_THAT(CountFiles(), Eq(2));
+}
+
+}  // namespace
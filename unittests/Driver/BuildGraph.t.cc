@@ -0,0 +1,126 @@
+#include "Cocktail/Driver/BuildGraph.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::StrEq;
+
+// Returns the names of the files of `graph`, in order.
+auto GetNames(const BuildGraph& graph) -> std::vector<std::string> {
+  std::vector<std::string> names;
+  for (const BuildGraph::File& file : graph.files()) {
+    names.push_back(file.name);
+  }
+  return names;
+}
+
+TEST(BuildGraphTest, Parse) {
+  std::string errors;
+  llvm::raw_string_ostream errors_stream(errors);
+  std::optional<BuildGraph> graph = BuildGraph::Parse(
+      "# The program.\n"
+      "main.ck: io.ck  math.ck\n"
+      "\n"
+      "  io.ck : math.ck\n"
+      "math.ck\n"
+      "other.ck:\n",
+      errors_stream);
+  ASSERT_TRUE(graph);
+  EXPECT_THAT(errors_stream.str(), StrEq(""));
+  // Each file comes after its imports, and otherwise keeps its place.
+  EXPECT_THAT(GetNames(*graph),
+              ElementsAre("math.ck", "io.ck", "main.ck", "other.ck"));
+  auto files = graph->files();
+  EXPECT_THAT(files[0].imports, IsEmpty());
+  EXPECT_THAT(files[0].dependents, ElementsAre(1, 2));
+  EXPECT_THAT(files[1].imports, ElementsAre(0));
+  EXPECT_THAT(files[1].dependents, ElementsAre(2));
+  EXPECT_THAT(files[2].imports, ElementsAre(1, 0));
+  EXPECT_THAT(files[2].dependents, IsEmpty());
+  EXPECT_THAT(files[3].imports, IsEmpty());
+  EXPECT_FALSE(files[0].stamp);
+}
+
+TEST(BuildGraphTest, ParseErrors) {
+  for (auto [manifest, error] :
+       {std::pair{"a.ck\n: b.ck\n", "line 2 names no file"},
+        std::pair{"a.ck\nb.ck\na.ck: b.ck\n", "listed twice"},
+        std::pair{"a.ck: b.ck\n", "a.ck imports b.ck, which isn't"},
+        std::pair{"a.ck: a.ck\n", "cycle through a.ck"},
+        std::pair{"a.ck: b.ck\nb.ck: c.ck\nc.ck: a.ck\n", "cycle through"}}) {
+    std::string errors;
+    llvm::raw_string_ostream errors_stream(errors);
+    EXPECT_FALSE(BuildGraph::Parse(manifest, errors_stream)) << manifest;
+    EXPECT_THAT(errors_stream.str(), HasSubstr(error));
+  }
+}
+
+TEST(BuildGraphTest, Stamps) {
+  std::string errors;
+  llvm::raw_string_ostream errors_stream(errors);
+  llvm::StringRef manifest = "lib.ck\nmain.ck: lib.ck\n";
+  std::optional<BuildGraph> graph = BuildGraph::Parse(manifest, errors_stream);
+  ASSERT_TRUE(graph);
+  graph->files()[0].stamp = {
+      .source_hash = 0x12, .options_hash = 0x9, .interface_hash = 0xab};
+  graph->files()[1].stamp = {.source_hash = 0x34,
+                             .options_hash = 0x9,
+                             .import_hashes = {0xab, 0xcd},
+                             .interface_hash = 0xef};
+  std::string stamps;
+  llvm::raw_string_ostream stamps_stream(stamps);
+  graph->WriteStamps(stamps_stream);
+  EXPECT_THAT(stamps_stream.str(), StrEq("cocktail-build-stamps 2\n"
+                                         "12 9 ab 0 lib.ck\n"
+                                         "34 9 ef 2 ab cd main.ck\n"));
+
+  // Stamps are read back into a new graph by file name, and only those of
+  // files still in it are kept.
+  std::optional<BuildGraph> new_graph = BuildGraph::Parse(
+      "main.ck: lib.ck\nnew.ck\nlib.ck\n", errors_stream);
+  ASSERT_TRUE(new_graph);
+  new_graph->ReadStamps(stamps);
+  auto files = new_graph->files();
+  ASSERT_THAT(GetNames(*new_graph),
+              ElementsAre("lib.ck", "main.ck", "new.ck"));
+  ASSERT_TRUE(files[0].stamp);
+  EXPECT_EQ(files[0].stamp->source_hash, 0x12);
+  EXPECT_EQ(files[0].stamp->options_hash, 0x9);
+  EXPECT_THAT(files[0].stamp->import_hashes, IsEmpty());
+  EXPECT_EQ(files[0].stamp->interface_hash, 0xab);
+  ASSERT_TRUE(files[1].stamp);
+  EXPECT_EQ(files[1].stamp->source_hash, 0x34);
+  EXPECT_THAT(files[1].stamp->import_hashes, ElementsAre(0xab, 0xcd));
+  EXPECT_EQ(files[1].stamp->interface_hash, 0xef);
+  EXPECT_FALSE(files[2].stamp);
+
+  // Malformed stamps, or those of another version, are all dropped.
+  for (llvm::StringRef bad_stamps :
+       {"cocktail-build-stamps 1\n12 ab 0 lib.ck\n",
+        "cocktail-build-stamps 2\n12 9 ab 0 lib.ck\n34 9 ef 2 ab main.ck\n",
+        "cocktail-build-stamps 2\n12 9 ab 0 lib.ck\n34 9 zz 0 main.ck\n",
+        "cocktail-build-stamps 2\n12 9 ab 0 lib.ck\n34 9 ef 0\n"}) {
+    std::optional<BuildGraph> bad_graph =
+        BuildGraph::Parse(manifest, errors_stream);
+    ASSERT_TRUE(bad_graph);
+    bad_graph->ReadStamps(bad_stamps);
+    EXPECT_FALSE(bad_graph->files()[0].stamp) << bad_stamps.str();
+    EXPECT_FALSE(bad_graph->files()[1].stamp) << bad_stamps.str();
+  }
+}
+
+}  // namespace
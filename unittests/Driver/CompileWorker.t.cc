@@ -0,0 +1,72 @@
+#include "Cocktail/Driver/CompileWorker.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::StrEq;
+
+TEST(CompileWorkerTest, EncodeAndDecodeJob) {
+  CompileJob job;
+  job.target_triple = "x86_64-unknown-linux-gnu";
+  job.file_name = "test.ck";
+  job.source_text = "fn F() {}";
+  job.tokens = "tokens";
+  job.parse_tree = "tree";
+  job.interfaces = {"a", ""};
+  job.entry_points = {"F"};
+  job.optimization_level = OptimizationLevel::O2;
+  job.codegen_shards = 2;
+  job.codegen_threads = 3;
+  std::string data = EncodeCompileJob(job);
+
+  CompileJob decoded;
+  ASSERT_TRUE(DecodeCompileJob(data, decoded));
+  EXPECT_THAT(decoded.target_triple, StrEq(job.target_triple));
+  EXPECT_THAT(decoded.file_name, StrEq("test.ck"));
+  EXPECT_THAT(decoded.source_text, StrEq("fn F() {}"));
+  EXPECT_THAT(decoded.tokens, StrEq("tokens"));
+  EXPECT_THAT(decoded.parse_tree, StrEq("tree"));
+  EXPECT_THAT(decoded.interfaces, ElementsAre("a", ""));
+  EXPECT_THAT(decoded.entry_points, ElementsAre("F"));
+  EXPECT_THAT(decoded.optimization_level, Eq(OptimizationLevel::O2));
+  EXPECT_THAT(decoded.codegen_shards, Eq(2));
+  EXPECT_THAT(decoded.codegen_threads, Eq(3));
+
+  // Truncated or extended data is rejected.
+  for (size_t size = 0; size != data.size(); ++size) {
+    EXPECT_FALSE(DecodeCompileJob(llvm::StringRef(data).take_front(size),
+                                  decoded))
+        << size;
+  }
+  EXPECT_FALSE(DecodeCompileJob(data + "x", decoded));
+}
+
+TEST(CompileWorkerTest, EncodeAndDecodeResult) {
+  CompileJobResult result = {
+      .success = true, .objects = {"one", "two"}, .errors = "warning"};
+  auto decoded = DecodeCompileJobResult(EncodeCompileJobResult(result));
+  ASSERT_TRUE(decoded);
+  EXPECT_TRUE(decoded->success);
+  EXPECT_THAT(decoded->objects, ElementsAre("one", "two"));
+  EXPECT_THAT(decoded->errors, StrEq("warning"));
+  EXPECT_FALSE(DecodeCompileJobResult(""));
+  EXPECT_FALSE(DecodeCompileJobResult("\x01"));
+}
+
+TEST(CompileWorkerTest, UnreachableWorkers) {
+  CompileWorkerPool pool({"/nonexistent/a", "/nonexistent/b"});
+  CompileJob job;
+  EXPECT_FALSE(pool.Run(job));
+  // Nothing is tried once every worker is known to be unreachable.
+  EXPECT_FALSE(pool.Run(job));
+}
+
+}  // namespace
@@ -3,10 +3,15 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
 #include "Cocktail/Testing/Yaml.t.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/SourceMgr.h"
 
 namespace {
@@ -15,8 +20,11 @@ using namespace Cocktail;
 using namespace Cocktail::Testing;
 using namespace Cocktail::Testing::Yaml;
 
+using ::testing::ContainsRegex;
 using ::testing::ElementsAre;
+using ::testing::Eq;
 using ::testing::HasSubstr;
+using ::testing::Not;
 using ::testing::StrEq;
 
 /// A raw_ostream that makes it easy to repeatedly check streamed output.
@@ -162,6 +170,37 @@ TEST(DriverTest, DumpTokens) {
   EXPECT_THAT(test_output_stream.TakeStr(), StrEq(tokenized_text));
 }
 
+TEST(DriverTest, DumpTokensNdjson) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("Hello World");
+  EXPECT_TRUE(driver.RunDumpTokensSubcommand(
+      ConsoleDiagnosticConsumer(), {"--format=ndjson", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(
+      test_output_stream.TakeStr(),
+      StrEq(R"({"index":0,"kind":"Identifier","line":1,"column":1,)"
+            R"("indent":1,"spelling":"Hello","identifier":0,)"
+            R"("has_trailing_space":true})"
+            "\n"
+            R"({"index":1,"kind":"Identifier","line":1,"column":7,)"
+            R"("indent":1,"spelling":"World","identifier":1,)"
+            R"("has_trailing_space":true})"
+            "\n"
+            R"({"index":2,"kind":"EndOfFile","line":1,"column":12,)"
+            R"("indent":1,"spelling":""})"
+            "\n"));
+
+  // Integer literals are unsigned, however large.
+  auto literal_file_path = CreateTestFile("18446744073709551615");
+  EXPECT_TRUE(driver.RunDumpTokensSubcommand(
+      ConsoleDiagnosticConsumer(), {"--format=ndjson", literal_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              HasSubstr(R"("value":"18446744073709551615")"));
+}
+
 TEST(DriverTest, DumpTokenErrors) {
   RawTestOstream test_output_stream;
   RawTestOstream test_error_stream;
@@ -180,6 +219,291 @@ TEST(DriverTest, DumpTokenErrors) {
                                               {"/not/a/real/file/name"}));
   EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
   EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+
+  EXPECT_FALSE(driver.RunDumpTokensSubcommand(
+      ConsoleDiagnosticConsumer(), {"--format=xml", "/not/a/real/file/name"}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+}
+
+TEST(DriverTest, MaxErrors) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("a $ b $ c");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-tokens", "--max-errors=1", "--format=ndjson", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  // Lexing stops at the first error.
+  EXPECT_THAT(
+      test_output_stream.TakeStr(),
+      StrEq(R"({"index":0,"kind":"Identifier","line":1,"column":1,)"
+            R"("indent":1,"spelling":"a","identifier":0,)"
+            R"("has_trailing_space":true})"
+            "\n"
+            R"({"index":1,"kind":"Error","line":1,"column":3,)"
+            R"("indent":1,"spelling":"$ ","has_trailing_space":true})"
+            "\n"
+            R"({"index":2,"kind":"EndOfFile","line":1,"column":5,)"
+            R"("indent":1,"spelling":""})"
+            "\n"));
+
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-tokens", "--max-errors=NoSuchKind:1", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-tokens", "--max-errors=-1", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+}
+
+TEST(DriverTest, PrintErrorsJson) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("a $ b");
+  EXPECT_FALSE(driver.RunFullCommand({"dump-tokens", "--print-errors=json",
+                                      "--format=ndjson", test_file_path}));
+  test_output_stream.TakeStr();
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              StrEq(R"({"kind":"UnrecognizedCharacters","file":")" +
+                    test_file_path + R"(","line":1,"column":3,)"
+                    R"("message":"Encountered unrecognized characters )"
+                    R"(while parsing.","level":"error"})"
+                    "\n"));
+}
+
+TEST(DriverTest, DiagnosticCache) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  DiagnosticCache diagnostic_cache;
+  Driver driver = Driver(test_output_stream, test_error_stream,
+                         SourceBufferCache::Global(), &diagnostic_cache);
+
+  auto test_file_path = CreateTestFile("var v: Int = $;");
+  llvm::SmallVector<llvm::StringRef> args = {
+      "dump-parse-tree", "--print-errors=json", "--format=ndjson",
+      test_file_path};
+  EXPECT_FALSE(driver.RunFullCommand(args));
+  std::string tree = test_output_stream.TakeStr();
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("UnrecognizedCharacters"));
+
+  // The second run reads back the tokens and tree, and replays the same
+  // diagnostics.
+  EXPECT_FALSE(driver.RunFullCommand(args));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(tree));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(errors));
+}
+
+TEST(DriverTest, ArtifactCache) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  llvm::SmallString<256> cache_dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("cache", cache_dir));
+  auto test_file_path = CreateTestFile("var v: Int = $;");
+  std::string cache_dir_flag = ("--cache-dir=" + cache_dir).str();
+  llvm::SmallVector<llvm::StringRef> args = {
+      "dump-parse-tree", "--print-errors=json", cache_dir_flag,
+      "--format=ndjson", test_file_path};
+  EXPECT_FALSE(driver.RunFullCommand(args));
+  std::string tree = test_output_stream.TakeStr();
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("UnrecognizedCharacters"));
+
+  // Another driver, as in another process, reads back the tokens and tree
+  // from the cache directory, and replays the same diagnostics.
+  Driver other_driver = Driver(test_output_stream, test_error_stream);
+  EXPECT_FALSE(other_driver.RunFullCommand(args));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(tree));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(errors));
+
+  int num_artifacts = 0;
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(cache_dir, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    ++num_artifacts;
+  }
+  // One artifact for the tokens and one for the tree.
+  EXPECT_THAT(num_artifacts, Eq(2));
+  llvm::sys::fs::remove_directories(cache_dir);
+
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-tokens", "--cache-max-size=lots", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-tokens", "--remote-cache=remote", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: A remote cache needs a cache directory."));
+}
+
+TEST(DriverTest, Stats) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("var v: Int = 42;");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-parse-tree", "--stats", "--format=ndjson", test_file_path}));
+  test_output_stream.TakeStr();
+  std::string stats = test_error_stream.TakeStr();
+  for (llvm::StringRef phase : {"total", "read", "lex", "parse", "print"}) {
+    EXPECT_THAT(stats, HasSubstr(("\n" + phase + " ").str()));
+  }
+  EXPECT_THAT(stats, HasSubstr("\nbytes           16\n"));
+  EXPECT_THAT(stats, HasSubstr("\ntokens          8\n"));
+  EXPECT_THAT(stats, HasSubstr("\nidentifiers     2\n"));
+  EXPECT_THAT(stats, HasSubstr("\nnodes  "));
+}
+
+TEST(DriverTest, TimeTrace) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("var v: Int = 42;");
+  auto trace_file_path = CreateTestFile("");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-tokens", "--time-trace=" + trace_file_path, test_file_path}));
+  test_output_stream.TakeStr();
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+
+  auto trace = llvm::MemoryBuffer::getFile(trace_file_path);
+  ASSERT_TRUE(trace);
+  EXPECT_THAT((*trace)->getBuffer().str(), HasSubstr("\"traceEvents\""));
+  EXPECT_THAT((*trace)->getBuffer().str(), HasSubstr("\"name\":\"lex\""));
+}
+
+TEST(DriverTest, Bench) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("fn F() {}\nfn G() { F(); }");
+  for (llvm::StringRef stage :
+       {"read", "lex", "parse", "verify", "semantics", "lower"}) {
+    EXPECT_TRUE(driver.RunFullCommand({"bench", ("--stage=" + stage).str(),
+                                       "--runs=3", "--warmup=1",
+                                       test_file_path}))
+        << stage;
+    std::string report = test_output_stream.TakeStr();
+    EXPECT_THAT(report, HasSubstr(("\nstage           " + stage).str()));
+    EXPECT_THAT(report, HasSubstr("\nruns            3\n"));
+    for (llvm::StringRef name :
+         {"median_ms", "p99_ms", "mb_per_s", "allocs_per_run"}) {
+      EXPECT_THAT(report, HasSubstr(("\n" + name + " ").str()));
+    }
+    EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  }
+
+  // Lexing allocates its token storage on every run.
+  EXPECT_TRUE(driver.RunFullCommand({"bench", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              Not(HasSubstr("\nallocs_per_run  0\n")));
+
+  EXPECT_FALSE(
+      driver.RunFullCommand({"bench", "--stage=link", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Unknown stage 'link'."));
+
+  auto error_file_path = CreateTestFile("fn F() { $ }");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"bench", "--stage=semantics", error_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("which has errors."));
+}
+
+TEST(DriverTest, MultipleFiles) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto first_path = CreateTestFile("a $ b");
+  auto second_path = CreateTestFile("var v: Int = 42;");
+  auto third_path = CreateTestFile("c $ d");
+  EXPECT_FALSE(driver.RunFullCommand({"dump-tokens", "--print-errors=json",
+                                      "--format=ndjson", first_path,
+                                      second_path, third_path}));
+  std::string output = test_output_stream.TakeStr();
+  std::string errors = test_error_stream.TakeStr();
+  // Each file's errors are written together, in the order of the files.
+  EXPECT_THAT(errors, HasSubstr(first_path));
+  EXPECT_LT(errors.find(first_path), errors.find(third_path));
+  EXPECT_THAT(errors, Not(HasSubstr(second_path)));
+
+  // Running the files on several threads gives the same output, and so does
+  // listing them in a response file.
+  EXPECT_FALSE(driver.RunFullCommand({"dump-tokens", "--print-errors=json",
+                                      "-j", "2", "--format=ndjson", first_path,
+                                      second_path, third_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(output));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(errors));
+
+  auto response_path =
+      CreateTestFile(first_path + "\n" + second_path + " " + third_path);
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-tokens", "--print-errors=json", "-j", "3", "--format=ndjson",
+       "@" + response_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(output));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(errors));
+
+  // Lexing and parsing in a pipeline gives the same trees as one file at a
+  // time, whatever the number of threads for each stage.
+  std::string response_arg = "@" + response_path;
+  EXPECT_FALSE(driver.RunFullCommand({"dump-parse-tree", "--print-errors=json",
+                                      response_arg, response_arg}));
+  std::string tree_output = test_output_stream.TakeStr();
+  std::string tree_errors = test_error_stream.TakeStr();
+  std::vector<std::vector<llvm::StringRef>> jobs_args = {
+      {"--parse-jobs=1"}, {"--lex-jobs=3"}, {"-j", "4"}};
+  for (const auto& jobs : jobs_args) {
+    llvm::SmallVector<llvm::StringRef> args = {"dump-parse-tree",
+                                               "--print-errors=json"};
+    args.append(jobs.begin(), jobs.end());
+    args.append({response_arg, response_arg});
+    EXPECT_FALSE(driver.RunFullCommand(args));
+    EXPECT_THAT(test_output_stream.TakeStr(), StrEq(tree_output));
+    EXPECT_THAT(test_error_stream.TakeStr(), StrEq(tree_errors));
+  }
+
+  // Once the error limit is reached, the remaining files are skipped, however
+  // they're run.
+  std::vector<std::vector<llvm::StringRef>> limited_args = {
+      {}, {"-j", "2"}, {"--lex-jobs=2"}};
+  for (const auto& jobs : limited_args) {
+    llvm::SmallVector<llvm::StringRef> args = {
+        "dump-parse-tree", "--print-errors=json", "--max-errors=1"};
+    args.append(jobs.begin(), jobs.end());
+    args.append({first_path, second_path, third_path});
+    EXPECT_FALSE(driver.RunFullCommand(args));
+    test_output_stream.TakeStr();
+    errors = test_error_stream.TakeStr();
+    EXPECT_THAT(errors, HasSubstr(first_path));
+    EXPECT_THAT(errors, Not(HasSubstr(third_path)));
+  }
+
+  // The command only succeeds if every file does.
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-parse-tree", "-j", "2", second_path, second_path}));
+  test_output_stream.TakeStr();
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+
+  EXPECT_FALSE(driver.RunFullCommand({"dump-tokens", "-j", "0", first_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+
+  EXPECT_FALSE(
+      driver.RunFullCommand({"dump-tokens", "@/not/a/real/file/name"}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
 }
 
 TEST(DriverTest, DumpParseTree) {
@@ -238,4 +562,947 @@ TEST(DriverTest, DumpParseTree) {
   EXPECT_THAT(test_output_stream.TakeStr(), StrEq(tokenized_text));
 }
 
+TEST(DriverTest, DumpParseTreeNdjson) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("var v: Int = 42;");
+  EXPECT_TRUE(driver.RunDumpParseTreeSubcommand(
+      ConsoleDiagnosticConsumer(), {"--format=ndjson", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(
+      test_output_stream.TakeStr(),
+      StrEq(R"({"node_index":0,"kind":"DeclaredName","text":"v","token":1,)"
+            R"("subtree_size":1})"
+            "\n"
+            R"({"node_index":1,"kind":"NameReference","text":"Int","token":3,)"
+            R"("subtree_size":1})"
+            "\n"
+            R"({"node_index":2,"kind":"PatternBinding","text":":","token":2,)"
+            R"("subtree_size":3})"
+            "\n"
+            R"({"node_index":3,"kind":"Literal","text":"42","token":5,)"
+            R"("subtree_size":1})"
+            "\n"
+            R"({"node_index":4,"kind":"VariableInitializer","text":"=",)"
+            R"("token":4,"subtree_size":2})"
+            "\n"
+            R"({"node_index":5,"kind":"DeclarationEnd","text":";","token":6,)"
+            R"("subtree_size":1})"
+            "\n"
+            R"({"node_index":6,"kind":"VariableDeclaration","text":"var",)"
+            R"("token":0,"subtree_size":7})"
+            "\n"
+            R"({"node_index":7,"kind":"FileEnd","text":"","token":7,)"
+            R"("subtree_size":1})"
+            "\n"));
+
+  EXPECT_FALSE(driver.RunDumpParseTreeSubcommand(
+      ConsoleDiagnosticConsumer(), {"--format=xml", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+}
+
+TEST(DriverTest, DumpSemanticsIR) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path =
+      CreateTestFile("fn F() {}\nvar v: Int = 42;\nfn G() {}");
+  EXPECT_TRUE(driver.RunFullCommand({"dump-semantics-ir", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(Yaml::Value::FromText(test_output_stream.TakeStr()),
+              ElementsAre(Yaml::SequenceValue{
+                  Yaml::MappingValue{{"kind", "Function"},
+                                     {"name", "F"},
+                                     {"node_index", "5"}},
+                  Yaml::MappingValue{{"kind", "Function"},
+                                     {"name", "G"},
+                                     {"node_index", "18"}}}));
+
+  // Semantics isn't built for a file that doesn't parse.
+  auto error_file_path = CreateTestFile("fn F( {}");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--print-errors=json", error_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr(error_file_path));
+}
+
+TEST(DriverTest, DumpSemanticsIRNameResolution) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Enough names to grow the root block's table a few times.
+  std::string text;
+  for (int i = 0; i != 100; ++i) {
+    text += "fn F" + std::to_string(i) + "() {}\n";
+  }
+  auto test_file_path = CreateTestFile(text);
+  EXPECT_TRUE(driver.RunFullCommand({"dump-semantics-ir", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  std::string functions = test_output_stream.TakeStr();
+  EXPECT_THAT(functions, HasSubstr("name: 'F0'"));
+  EXPECT_THAT(functions, HasSubstr("name: 'F99'"));
+
+  // A name declared twice in the same scope is diagnosed at the second
+  // declaration, with a note at the first.
+  auto duplicate_file_path =
+      CreateTestFile("fn F() {}\nfn G() {}\nfn F() {}");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--print-errors=json", duplicate_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("NameDeclarationDuplicate"));
+  EXPECT_THAT(errors, HasSubstr("NameDeclarationPrevious"));
+}
+
+TEST(DriverTest, DumpSemanticsIRCalls) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Calls to functions declared later resolve too, while names that aren't
+  // declared at file scope are left alone.
+  auto test_file_path = CreateTestFile(
+      "fn F(x: i32) {\n  G(x);\n  x();\n  F(1);\n}\nfn G(y: i32) {}");
+  EXPECT_TRUE(driver.RunFullCommand({"dump-semantics-ir", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              HasSubstr("name: 'F', node_index: 22, body: ["
+                        "{kind: Call, type: '()', callee: 'G', args: [-1]}, "
+                        "{kind: IntegerConstant, type: 'i32', value: 1}, "
+                        "{kind: Call, type: '()', callee: 'F', args: [1]}]},\n"
+                        "{kind: Function, name: 'G', node_index: 31},\n"));
+
+  // Enough functions for their bodies to be processed on several threads,
+  // which gives the same result as processing them on one.
+  std::string text;
+  for (int i = 0; i != 1000; ++i) {
+    text += "fn F" + std::to_string(i) + "() { F" +
+            std::to_string((i * 7) % 1000) + "(); }\n";
+  }
+  auto large_file_path = CreateTestFile(text);
+  EXPECT_TRUE(driver.RunFullCommand({"dump-semantics-ir", large_file_path}));
+  std::string serial = test_output_stream.TakeStr();
+  EXPECT_THAT(serial, HasSubstr("name: 'F999', node_index: 9999, body: "
+                                "[{kind: Call, type: '()', callee: 'F993'}]"));
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-semantics-ir", "-j", "4", large_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(serial));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+}
+
+TEST(DriverTest, DumpSemanticsIRTypes) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // A call has the type its callee returns.
+  auto test_file_path = CreateTestFile(
+      "fn I() -> i32 {}\n"
+      "fn T(x: i32) -> (i32, f64) {}\n"
+      "fn O() -> (u8,) {}\n"
+      "fn S() -> {.a: i32, .b: i32*} {}\n"
+      "fn E() -> {} {}\n"
+      "fn V() {}\n"
+      "fn F() { I(); T(1); O(); S(); E(); V(); }");
+  EXPECT_TRUE(driver.RunFullCommand({"dump-semantics-ir", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              HasSubstr("body: [{kind: Call, type: 'i32', callee: 'I'}, "
+                        "{kind: IntegerConstant, type: 'i32', value: 1}, "
+                        "{kind: Call, type: '(i32, f64)', callee: 'T', "
+                        "args: [1]}, "
+                        "{kind: Call, type: '(u8,)', callee: 'O'}, "
+                        "{kind: Call, type: '{.a: i32, .b: i32*}', "
+                        "callee: 'S'}, "
+                        "{kind: Call, type: '{}', callee: 'E'}, "
+                        "{kind: Call, type: '()', callee: 'V'}]}"));
+
+  // Each distinct type is interned once: the five builtins, then `i32` and
+  // `fn () -> i32`, which every later function has too.
+  auto shared_file_path =
+      CreateTestFile("fn A() -> i32 {}\nfn B() -> i32 {}\nfn C() -> i32 {}");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--stats", shared_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\ntypes           7\n"));
+  test_output_stream.TakeStr();
+}
+
+TEST(DriverTest, DumpSemanticsIRConstants) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Only the folded results are emitted, and each value is stored once.
+  auto test_file_path = CreateTestFile(
+      "fn G(a: i32, b: i32) {}\n"
+      "fn F() {\n  G(-(1 + 2) * 3, 7 % 4);\n  G(9 - 18, 10 / 3);\n}");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--stats", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              HasSubstr("name: 'F', node_index: 45, body: ["
+                        "{kind: IntegerConstant, type: 'i32', value: -9}, "
+                        "{kind: IntegerConstant, type: 'i32', value: 3}, "
+                        "{kind: Call, type: '()', callee: 'G', args: [0, 1]}, "
+                        "{kind: IntegerConstant, type: 'i32', value: -9}, "
+                        "{kind: IntegerConstant, type: 'i32', value: 3}, "
+                        "{kind: Call, type: '()', callee: 'G', "
+                        "args: [3, 4]}]}"));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("\nconstants       2\n"));
+
+  // Each error is diagnosed once, without diagnosing the expressions that
+  // use its result again.
+  auto error_file_path = CreateTestFile(
+      "fn G(a: i32) {}\n"
+      "fn F() {\n"
+      "  G(-2147483647 - 1);\n"
+      "  G((2147483647 + 1) * 2);\n"
+      "  G(-(1 / (2 - 2)));\n"
+      "  G(2147483648 - 1);\n"
+      "}");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--print-errors=json", error_file_path}));
+  test_output_stream.TakeStr();
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr(R"("kind":"IntegerOverflow","file":")" +
+                                error_file_path + R"(","line":4,)"));
+  EXPECT_THAT(errors, HasSubstr(R"("kind":"DivisionByZero","file":")" +
+                                error_file_path + R"(","line":5,)"));
+  EXPECT_THAT(errors,
+              HasSubstr(R"("kind":"IntegerLiteralTooLarge","file":")" +
+                        error_file_path + R"(","line":6,)"));
+  EXPECT_EQ(llvm::StringRef(errors).count("\n"), 3);
+}
+
+TEST(DriverTest, IntegerTypeTooWide) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Widths past what LLVM can represent are diagnosed rather than lowered.
+  auto test_file_path = CreateTestFile(
+      "fn F(x: i8388608) {}\n"
+      "fn G(x: u16777216) {}\n");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"emit-llvm", "--print-errors=json", test_file_path}));
+  test_output_stream.TakeStr();
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr(R"("kind":"IntegerTypeTooWide","file":")" +
+                                test_file_path + R"(","line":2,)"));
+  EXPECT_EQ(llvm::StringRef(errors).count("\n"), 1);
+}
+
+TEST(DriverTest, DumpSemanticsIRStrings) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // A string used twice is stored once.
+  auto test_file_path = CreateTestFile(
+      "fn G(s: String) {}\n"
+      "fn F() { G(\"msg\"); G(\"msg\"); G(\"a\\tb\"); }");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--stats", test_file_path}));
+  std::string ir = test_output_stream.TakeStr();
+  EXPECT_THAT(ir, HasSubstr("{kind: StringConstant, type: 'String', "
+                            "value: \"msg\"}"));
+  EXPECT_THAT(ir, HasSubstr("{kind: StringConstant, type: 'String', "
+                            "value: \"a\\09b\"}"));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("\nstrings         2\n"));
+}
+
+TEST(DriverTest, DumpSemanticsIRCallErrors) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Each mismatch is diagnosed at the call, with a note at what it should
+  // have matched.
+  auto test_file_path = CreateTestFile(
+      "fn G(a: i32, b: u8) {}\n"
+      "fn F() {\n"
+      "  G(1);\n"
+      "  G(1, 2);\n"
+      "}");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--print-errors=json", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr(R"("kind":"CallArgCountMismatch","file":")" +
+                                test_file_path + R"(","line":3,)"));
+  EXPECT_THAT(errors, HasSubstr(R"("kind":"InCallToFunction","file":")" +
+                                test_file_path + R"(","line":1,)"));
+  EXPECT_THAT(errors,
+              HasSubstr(R"("kind":"ImplicitAsConversionFailure","file":")" +
+                        test_file_path + R"(","line":4,)"));
+  EXPECT_THAT(errors, HasSubstr(R"("kind":"InCallToFunctionParam","file":")" +
+                                test_file_path + R"(","line":1,)"));
+  EXPECT_EQ(llvm::StringRef(errors).count("\n"), 2);
+}
+
+TEST(DriverTest, EmitInterface) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto write_file = [](llvm::StringRef path, llvm::StringRef text) {
+    std::error_code ec;
+    llvm::raw_fd_ostream s(path, ec);
+    ASSERT_FALSE(ec) << ec.message();
+    s << text;
+  };
+  auto library_path =
+      CreateTestFile("fn Add(a: i32, b: i32) -> i32 {}\nfn Unused() {}");
+  llvm::SmallString<256> interface_path(library_path);
+  llvm::sys::path::replace_extension(interface_path, "api");
+  EXPECT_TRUE(driver.RunFullCommand({"emit-interface", library_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_TRUE(llvm::sys::fs::exists(interface_path));
+  std::string import_flag = ("--import=" + interface_path).str();
+
+  // Only the imported names that the file spells are declared, after the
+  // file's own functions, and they're lowered as declarations.
+  auto user_path = CreateTestFile("fn F() { Add(1, 2); }");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-semantics-ir", import_flag, user_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  std::string ir = test_output_stream.TakeStr();
+  EXPECT_THAT(ir, HasSubstr("callee: 'Add', args: [0, 1]"));
+  EXPECT_THAT(ir, HasSubstr("{kind: Function, name: 'Add', imported: true},\n"
+                            "]\n"));
+  EXPECT_THAT(ir, Not(HasSubstr("Unused")));
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", import_flag, user_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              HasSubstr("declare i32 @Add(i32, i32)"));
+
+  // Calls to imported functions are checked, with no note in a file that
+  // isn't being compiled.
+  auto error_path = CreateTestFile("fn F() { Add(1); }");
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--print-errors=json", import_flag, error_path}));
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("CallArgCountMismatch"));
+  EXPECT_EQ(llvm::StringRef(errors).count("\n"), 1);
+
+  // Changing a body leaves the interface as it was, and its file untouched.
+  write_file(library_path,
+             "fn Add(a: i32, b: i32) -> i32 { Add(1, 2); }\nfn Unused() {}");
+  EXPECT_TRUE(
+      driver.RunFullCommand({"emit-interface", "--stats", library_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\napi_unchanged   1\n"));
+
+  // With a cache, a file is only checked again once its text or an imported
+  // interface changes.
+  llvm::SmallString<256> cache_dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("cache", cache_dir));
+  std::string cache_dir_flag = ("--cache-dir=" + cache_dir).str();
+  llvm::SmallVector<llvm::StringRef> args = {
+      "emit-interface", "--stats", "--print-errors=json", cache_dir_flag,
+      import_flag, user_path};
+  EXPECT_TRUE(driver.RunFullCommand(args));
+  EXPECT_THAT(test_error_stream.TakeStr(), Not(HasSubstr("sem_cache_hits")));
+  EXPECT_TRUE(driver.RunFullCommand(args));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("\nsem_cache_hits  1\n"));
+  write_file(library_path, "fn Add(a: i32) -> i32 {}");
+  EXPECT_TRUE(driver.RunFullCommand({"emit-interface", library_path}));
+  EXPECT_FALSE(driver.RunFullCommand(args));
+  errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("CallArgCountMismatch"));
+  EXPECT_THAT(errors, Not(HasSubstr("sem_cache_hits")));
+  // Errors are replayed from the cache too.
+  EXPECT_FALSE(driver.RunFullCommand(args));
+  errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("CallArgCountMismatch"));
+  EXPECT_THAT(errors, HasSubstr("\nsem_cache_hits  1\n"));
+  llvm::sys::fs::remove_directories(cache_dir);
+
+  // Only interfaces can be imported.
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"dump-semantics-ir", "--import=" + user_path, user_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Invalid interface file"));
+  EXPECT_FALSE(
+      driver.RunFullCommand({"dump-semantics-ir", "--import=", user_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+  llvm::sys::fs::remove(interface_path);
+}
+
+TEST(DriverTest, Build) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto write_file = [](llvm::StringRef path, llvm::StringRef text) {
+    std::error_code ec;
+    llvm::raw_fd_ostream s(path, ec);
+    ASSERT_FALSE(ec) << ec.message();
+    s << text;
+  };
+  auto library_path = CreateTestFile("fn Add(a: i32, b: i32) -> i32 {}");
+  auto user_path = CreateTestFile("fn F() -> i32 { Add(1, 2); }");
+  // The user is listed first, but built after the library it imports.
+  auto manifest_path =
+      CreateTestFile("# A comment.\n" + user_path + ": " + library_path +
+                     "\n\n" + library_path + "\n");
+  auto build = [&](llvm::StringRef jobs = "1",
+                   llvm::StringRef shards = "--codegen-shards=1") {
+    return driver.RunFullCommand({"build", "--stats", "--print-errors=json",
+                                  "-j", jobs, shards, manifest_path});
+  };
+  auto output_path = [](llvm::StringRef path, llvm::StringRef extension) {
+    llvm::SmallString<256> output(path);
+    llvm::sys::path::replace_extension(output, extension);
+    return std::string(output);
+  };
+
+  EXPECT_TRUE(build());
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\nfiles_rebuilt   2\n"));
+  for (llvm::StringRef path : {library_path, user_path}) {
+    EXPECT_TRUE(llvm::sys::fs::exists(output_path(path, "api")));
+    EXPECT_TRUE(llvm::sys::fs::exists(output_path(path, "o")));
+  }
+
+  // Nothing has changed, so nothing is built, on one thread or several.
+  EXPECT_TRUE(build());
+  std::string stats = test_error_stream.TakeStr();
+  EXPECT_THAT(stats, HasSubstr("\nfiles_skipped   2\n"));
+  EXPECT_THAT(stats, Not(HasSubstr("files_rebuilt")));
+  EXPECT_TRUE(build("2"));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\nfiles_skipped   2\n"));
+
+  // Options that change the objects build every file again, and code
+  // generation split into shards leaves the files up to date once the
+  // object of each shard is there.
+  EXPECT_TRUE(build("1", "--codegen-shards=2"));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\nfiles_rebuilt   2\n"));
+  for (llvm::StringRef path : {library_path, user_path}) {
+    EXPECT_TRUE(llvm::sys::fs::exists(output_path(path, "0.o")));
+    EXPECT_TRUE(llvm::sys::fs::exists(output_path(path, "1.o")));
+  }
+  EXPECT_TRUE(build("1", "--codegen-shards=2"));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\nfiles_skipped   2\n"));
+  EXPECT_TRUE(build());
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\nfiles_rebuilt   2\n"));
+
+  // A change to a body leaves the interface as it was, so the files that
+  // import it are up to date.
+  write_file(library_path, "fn Add(a: i32, b: i32) -> i32 { Add(1, 2); }");
+  EXPECT_TRUE(build());
+  stats = test_error_stream.TakeStr();
+  EXPECT_THAT(stats, HasSubstr("\nfiles_rebuilt   1\n"));
+  EXPECT_THAT(stats, HasSubstr("\nfiles_skipped   1\n"));
+  EXPECT_THAT(stats, HasSubstr("\napi_unchanged   1\n"));
+
+  // A change to the interface rebuilds them, and a file that fails is built
+  // again next time.
+  write_file(library_path, "fn Add(a: i32) -> i32 {}");
+  EXPECT_FALSE(build("2"));
+  std::string errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("CallArgCountMismatch"));
+  EXPECT_THAT(errors, HasSubstr("\nfiles_rebuilt   2\n"));
+  write_file(user_path, "fn F() -> i32 { Add(1); }");
+  EXPECT_TRUE(build());
+  stats = test_error_stream.TakeStr();
+  EXPECT_THAT(stats, HasSubstr("\nfiles_rebuilt   1\n"));
+  EXPECT_THAT(stats, HasSubstr("\nfiles_skipped   1\n"));
+
+  // Files that import one that failed aren't built.
+  write_file(library_path, "fn Add(a: i32) -> i32 { Add(); }");
+  EXPECT_FALSE(build());
+  errors = test_error_stream.TakeStr();
+  EXPECT_THAT(errors, HasSubstr("ERROR: Not building " + user_path));
+  EXPECT_THAT(errors, HasSubstr("\nfiles_rebuilt   1\n"));
+
+  // Manifests must name every import, without cycles.
+  write_file(manifest_path, library_path + ": " + user_path + "\n" +
+                                user_path + ": " + library_path + "\n");
+  EXPECT_FALSE(driver.RunFullCommand({"build", manifest_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Import cycle through"));
+  write_file(manifest_path, user_path + ": missing.ck\n");
+  EXPECT_FALSE(driver.RunFullCommand({"build", manifest_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("which isn't in the build manifest"));
+  EXPECT_FALSE(driver.RunFullCommand({"build"}));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+
+  for (llvm::StringRef path : {library_path, user_path}) {
+    llvm::sys::fs::remove(output_path(path, "api"));
+    llvm::sys::fs::remove(output_path(path, "o"));
+  }
+  llvm::sys::fs::remove(manifest_path + ".stamps");
+}
+
+TEST(DriverTest, Index) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto write_file = [](llvm::StringRef path, llvm::StringRef text) {
+    std::error_code ec;
+    llvm::raw_fd_ostream s(path, ec);
+    ASSERT_FALSE(ec) << ec.message();
+    s << text;
+  };
+  auto f_path = CreateTestFile("fn F() {}\nfn G() { F(); }\n");
+  auto g_path = CreateTestFile("fn H() {\n  G();\n}\n");
+  auto index_path = CreateTestFile("");
+  auto index = [&](llvm::StringRef jobs = "1") {
+    return driver.RunFullCommand(
+        {"index", "--stats", "-j", jobs, index_path, f_path, g_path});
+  };
+
+  EXPECT_TRUE(index("2"));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\nfiles_indexed   2\n"));
+  EXPECT_TRUE(driver.RunFullCommand({"lookup", index_path, "G", "Missing"}));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              StrEq(f_path + ":2:4: G\n" + g_path + ":2:3: G\n"));
+
+  // Only the file that changed is lexed again.
+  write_file(g_path, "fn H() { F(); }\n");
+  EXPECT_TRUE(index());
+  std::string stats = test_error_stream.TakeStr();
+  EXPECT_THAT(stats, HasSubstr("\nfiles_indexed   1\n"));
+  EXPECT_THAT(stats, HasSubstr("\nfiles_reused    1\n"));
+  EXPECT_TRUE(driver.RunFullCommand({"lookup", index_path, "F", "G"}));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              StrEq(f_path + ":1:4: F\n" + f_path + ":2:10: F\n" + g_path +
+                    ":1:10: F\n" + f_path + ":2:4: G\n"));
+
+  write_file(index_path, "Not an index.");
+  EXPECT_FALSE(driver.RunFullCommand({"lookup", index_path, "F"}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Invalid index file"));
+  EXPECT_FALSE(driver.RunFullCommand({"lookup", index_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: No identifier specified"));
+  llvm::sys::fs::remove(index_path);
+}
+
+TEST(DriverTest, Format) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto read_file = [](llvm::StringRef path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    return buffer ? (*buffer)->getBuffer().str() : std::string();
+  };
+  auto path = CreateTestFile("fn F(a: i32,b: i32)->i32{return a+b;}");
+  EXPECT_FALSE(driver.RunFullCommand({"format", "--check", path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: " + path + " isn't formatted."));
+
+  EXPECT_TRUE(driver.RunFullCommand({"format", "--stats", path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("\nfiles_formatted 1\n"));
+  EXPECT_THAT(read_file(path),
+              StrEq("fn F(a: i32, b: i32) -> i32 {\n  return a + b;\n}\n"));
+
+  EXPECT_TRUE(driver.RunFullCommand({"format", "--stats", "--check", path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("\nfiles_unchanged 1\n"));
+
+  auto error_path = CreateTestFile("fn F( {");
+  EXPECT_FALSE(driver.RunFullCommand({"format", error_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Not formatting " + error_path));
+  EXPECT_THAT(read_file(error_path), StrEq("fn F( {"));
+}
+
+TEST(DriverTest, EmitLLVM) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("fn F() {}\nfn G() {}");
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", "--stats", test_file_path}));
+  std::string ir = test_output_stream.TakeStr();
+  EXPECT_THAT(ir, HasSubstr("define void @F() {\nentry:\n  ret void\n}"));
+  EXPECT_THAT(ir, HasSubstr("define void @G() {\nentry:\n  ret void\n}"));
+  // Each stage is timed on its own.
+  std::string stats = test_error_stream.TakeStr();
+  for (llvm::StringRef phase :
+       {"read", "lex", "parse", "semantics", "lower", "print"}) {
+    EXPECT_THAT(stats, HasSubstr(("\n" + phase + " ").str()));
+  }
+  EXPECT_THAT(stats, HasSubstr("\nfunctions "));
+  EXPECT_THAT(stats, HasSubstr("\ninsts "));
+  EXPECT_THAT(stats, HasSubstr("\nir_bytes "));
+}
+
+TEST(DriverTest, EmitLLVMBodies) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Folded constants are passed as immediates, and the result of each call
+  // is what its callee returns.
+  auto test_file_path = CreateTestFile(
+      "fn G(a: i32, b: f64) {}\n"
+      "fn I() -> i32 {}\n"
+      "fn F() { G(-(1 + 2) * 3, 1.5); I(); }");
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  std::string ir = test_output_stream.TakeStr();
+  EXPECT_THAT(ir, HasSubstr("define void @G(i32 %0, double %1)"));
+  // Return statements aren't analyzed, so nothing is known to be returned.
+  EXPECT_THAT(ir, HasSubstr("define i32 @I() {\nentry:\n  unreachable\n}"));
+  EXPECT_THAT(ir, HasSubstr("define void @F() {\nentry:\n"
+                            "  call void @G(i32 -9, double poison)\n"
+                            "  %0 = call i32 @I()\n"
+                            "  ret void\n}"));
+
+  // Lowering the functions in shards, each on a thread of its own, gives the
+  // same module as lowering them all at once.
+  std::string text;
+  for (int i = 0; i != 100; ++i) {
+    text += "fn F" + std::to_string(i) + "(x: i32) { F" +
+            std::to_string((i * 7) % 100) + "(" + std::to_string(i) + "); }\n";
+  }
+  auto large_file_path = CreateTestFile(text);
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", large_file_path}));
+  std::string serial = test_output_stream.TakeStr();
+  EXPECT_THAT(serial, HasSubstr("define void @F99(i32 %0) {\nentry:\n"
+                                "  call void @F93(i32 99)\n"));
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"emit-llvm", "--codegen-shards=3", "-j", "4", large_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(serial));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"emit-llvm", "--codegen-shards=0", large_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Invalid number of shards '0'."));
+}
+
+TEST(DriverTest, EmitLLVMAggregates) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Constant literals are constants, small ones with other elements are built
+  // in registers, and large ones in a stack slot.
+  std::string large_type = "(i32";
+  std::string large_value = "(I()";
+  for (int i = 1; i != 20; ++i) {
+    large_type += ", i32";
+    large_value += ", " + std::to_string(i);
+  }
+  auto test_file_path = CreateTestFile(
+      "fn G(t: (i32, i32)) {}\n"
+      "fn H(s: {.a: i32, .b: i32}) {}\n"
+      "fn L(t: " + large_type + ")) {}\n"
+      "fn I() -> i32 {}\n"
+      "fn F() {\n"
+      "  G((1, 2));\n"
+      "  G((I(), 3));\n"
+      "  H({.a = I(), .b = 4});\n"
+      "  L(" + large_value + "));\n"
+      "}");
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  std::string ir = test_output_stream.TakeStr();
+  EXPECT_THAT(ir, HasSubstr("call void @G({ i32, i32 } { i32 1, i32 2 })"));
+  EXPECT_THAT(ir, HasSubstr("insertvalue { i32, i32 } { i32 poison, i32 3 }, "
+                            "i32 %0, 0"));
+  EXPECT_THAT(ir, HasSubstr("insertvalue { i32, i32 } { i32 poison, i32 4 }, "
+                            "i32 %"));
+  EXPECT_THAT(ir, HasSubstr("= private unnamed_addr constant"));
+  EXPECT_THAT(ir, HasSubstr("alloca { i32"));
+  EXPECT_THAT(ir, HasSubstr("call void @llvm.memcpy"));
+  EXPECT_THAT(ir, HasSubstr("= load { i32"));
+}
+
+TEST(DriverTest, EmitLLVMStrings) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Each string is emitted once, however often it's used.
+  auto test_file_path = CreateTestFile(
+      "fn G(s: String) {}\n"
+      "fn F() { G(\"msg\"); G(\"msg\"); }");
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  std::string ir = test_output_stream.TakeStr();
+  EXPECT_THAT(ir, HasSubstr("@.str = private unnamed_addr constant "
+                            "[3 x i8] c\"msg\", align 1\n"));
+  EXPECT_EQ(llvm::StringRef(ir).count("constant [3 x i8]"), 1);
+  EXPECT_EQ(llvm::StringRef(ir).count("call void @G({ i8*, i64 } { i8* "
+                                      "getelementptr inbounds ([3 x i8], "
+                                      "[3 x i8]* @.str, i32 0, i32 0), "
+                                      "i64 3 })"),
+            2);
+
+  // Strings are kept by the IR, so they're still there to be emitted once
+  // the tokens' literal values have been released.
+  test_file_path = CreateTestFile(
+      "fn G(s: String) {}\n"
+      "fn F() { G(\"a\\tb\"); }");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"emit-llvm", "--low-memory", "--stats", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(),
+              HasSubstr("[3 x i8] c\"a\\09b\", align 1\n"));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\narena_bytes "));
+}
+
+TEST(DriverTest, EmitLLVMEntryPoints) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Only `main`, the entry point, and the functions they call are lowered.
+  auto test_file_path = CreateTestFile(
+      "fn Dead() { Leaf(); }\n"
+      "fn Leaf() {}\n"
+      "fn Mid() { Leaf(); }\n"
+      "fn main() { Mid(); }\n"
+      "fn Exported() {}\n"
+      "fn Unused() { Dead(); }\n");
+  for (llvm::StringRef shards : {"--codegen-shards=1", "--codegen-shards=2"}) {
+    EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", "--stats", shards,
+                                       "--entry-point=Exported",
+                                       test_file_path}));
+    std::string ir = test_output_stream.TakeStr();
+    for (llvm::StringRef name : {"Leaf", "Mid", "main", "Exported"}) {
+      EXPECT_THAT(ir, HasSubstr(("define void @" + name + "()").str()));
+    }
+    EXPECT_THAT(ir, Not(HasSubstr("@Dead")));
+    EXPECT_THAT(ir, Not(HasSubstr("@Unused")));
+    EXPECT_THAT(test_error_stream.TakeStr(),
+                ContainsRegex("\nunreachable_functions +2\n"));
+  }
+
+  // Without entry points, every function is lowered.
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), HasSubstr("define void @Dead()"));
+}
+
+TEST(DriverTest, EmitLLVMOptimizationLevels) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Only the full pipelines inline, so the call is left by the others.
+  auto test_file_path = CreateTestFile("fn G() {}\nfn F() { G(); }");
+  for (llvm::StringRef level : {"-O0", "-Ofast-compile"}) {
+    EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", level, test_file_path}));
+    EXPECT_THAT(test_output_stream.TakeStr(), HasSubstr("call void @G()"))
+        << level;
+    EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  }
+  for (llvm::StringRef level : {"-O1", "-O2", "-O3"}) {
+    EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", level, test_file_path}));
+    std::string ir = test_output_stream.TakeStr();
+    EXPECT_THAT(ir, HasSubstr("define void @F()")) << level;
+    EXPECT_THAT(ir, Not(HasSubstr("call void @G()"))) << level;
+    EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  }
+
+  // Each pass is timed in a table of its own, alongside the whole pipeline.
+  EXPECT_TRUE(
+      driver.RunFullCommand({"emit-llvm", "-O2", "--stats", test_file_path}));
+  test_output_stream.TakeStr();
+  std::string stats = test_error_stream.TakeStr();
+  EXPECT_THAT(stats, HasSubstr("\noptimize "));
+  EXPECT_THAT(stats, HasSubstr("\npass "));
+  EXPECT_THAT(stats, HasSubstr("\nInstCombinePass "));
+  EXPECT_THAT(stats, Not(HasSubstr("\nModuleToFunctionPassAdaptor ")));
+
+  // Shards are optimized on threads of their own, timing each pass into the
+  // same stats. Functions are only inlined into those of their own shard.
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", "-O2", "--stats",
+                                     "--codegen-shards=2", "-j", "2",
+                                     test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), HasSubstr("call void @G()"));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\nInstCombinePass "));
+
+  EXPECT_FALSE(driver.RunFullCommand({"emit-llvm", "-O4", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Unknown optimization level '4'."));
+}
+
+TEST(DriverTest, Run) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  // Functions that are only declared are found in this process, and those
+  // that are never called are never compiled.
+  auto test_file_path = CreateTestFile(
+      "fn abs(x: i32) -> i32;\n"
+      "fn G() { abs(-3); }\n"
+      "fn H() {}\n"
+      "fn main() { G(); }");
+  EXPECT_TRUE(driver.RunFullCommand({"run", "--stats", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  std::string stats = test_error_stream.TakeStr();
+  EXPECT_THAT(stats, HasSubstr("\njit "));
+  EXPECT_THAT(stats, HasSubstr("\nrun "));
+  EXPECT_THAT(stats, HasSubstr("\njit_objects     2\n"));
+  EXPECT_THAT(stats, Not(HasSubstr("\njit_cache_hits ")));
+
+  // With a cache, a second run compiles nothing.
+  llvm::SmallString<256> cache_dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("jit_cache", cache_dir));
+  std::string cache_flag = ("--cache-dir=" + cache_dir).str();
+  EXPECT_TRUE(driver.RunFullCommand({"run", cache_flag, test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_TRUE(
+      driver.RunFullCommand({"run", cache_flag, "--stats", test_file_path}));
+  stats = test_error_stream.TakeStr();
+  EXPECT_THAT(stats, HasSubstr("\njit_cache_hits  2\n"));
+  EXPECT_THAT(stats, Not(HasSubstr("\njit_objects ")));
+  llvm::sys::fs::remove_directories(cache_dir);
+
+  auto no_main_path = CreateTestFile("fn F() {}");
+  EXPECT_FALSE(driver.RunFullCommand({"run", no_main_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: No `main` function to run in"));
+  auto bad_main_path = CreateTestFile("fn main(x: i32) {}");
+  EXPECT_FALSE(driver.RunFullCommand({"run", bad_main_path}));
+  EXPECT_THAT(
+      test_error_stream.TakeStr(),
+      HasSubstr("ERROR: `main` must take no parameters and return `()`."));
+  auto missing_path = CreateTestFile(
+      "fn NotInThisProcess();\nfn main() { NotInThisProcess(); }");
+  EXPECT_FALSE(driver.RunFullCommand({"run", missing_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Unable to find `NotInThisProcess`"));
+  EXPECT_FALSE(driver.RunFullCommand({"run", test_file_path, test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+}
+
+TEST(DriverTest, LowMemory) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path =
+      CreateTestFile("fn F() {}\nvar v: Int = 42;\nfn G() {}");
+  EXPECT_TRUE(driver.RunFullCommand({"emit-llvm", test_file_path}));
+  std::string ir = test_output_stream.TakeStr();
+  EXPECT_THAT(ir, HasSubstr("define void @G()"));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+
+  // Freeing each stage's data early doesn't change what's produced, and the
+  // memory of each stage is reported.
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"emit-llvm", "--low-memory", "--stats", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(ir));
+  std::string stats = test_error_stream.TakeStr();
+  for (llvm::StringRef count : {"token_bytes", "node_bytes"}) {
+    EXPECT_THAT(stats, HasSubstr(("\n" + count + " ").str()));
+  }
+  EXPECT_THAT(stats, HasSubstr("\nreleased_bytes  "));
+  for (llvm::StringRef container : {"tokens.token_infos", "tree.node_impls"}) {
+    EXPECT_THAT(stats, HasSubstr(("\n" + container + " ").str()));
+  }
+
+  EXPECT_TRUE(driver.RunFullCommand({"dump-parse-tree", test_file_path}));
+  std::string tree = test_output_stream.TakeStr();
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"dump-parse-tree", "--low-memory", "-j", "2", test_file_path,
+       test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(tree + tree));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+
+  // Without `--low-memory`, nothing is released early.
+  EXPECT_TRUE(
+      driver.RunFullCommand({"emit-llvm", "--stats", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(ir));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              Not(HasSubstr("\nreleased_bytes ")));
+}
+
+TEST(DriverTest, Compile) {
+  RawTestOstream test_output_stream;
+  RawTestOstream test_error_stream;
+  Driver driver = Driver(test_output_stream, test_error_stream);
+
+  auto test_file_path = CreateTestFile("fn F() {}");
+  llvm::SmallString<256> object_path(test_file_path);
+  llvm::sys::path::replace_extension(object_path, "o");
+  EXPECT_TRUE(driver.RunFullCommand({"compile", "--stats", test_file_path}));
+  EXPECT_THAT(test_output_stream.TakeStr(), StrEq(""));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("\ncodegen "));
+  EXPECT_TRUE(llvm::sys::fs::exists(object_path));
+  llvm::sys::fs::remove(object_path);
+
+  auto output_path = CreateTestFile("");
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"compile", "--output=" + output_path, test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  uint64_t size = 0;
+  EXPECT_FALSE(llvm::sys::fs::file_size(output_path, size));
+  EXPECT_NE(size, 0);
+  EXPECT_FALSE(llvm::sys::fs::exists(object_path));
+
+  // An output file is only for one input.
+  EXPECT_FALSE(driver.RunFullCommand({"compile", "--output=" + output_path,
+                                      test_file_path, test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+  EXPECT_FALSE(
+      driver.RunFullCommand({"compile", "--output=", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), HasSubstr("ERROR"));
+
+  // Every level generates code.
+  for (llvm::StringRef level : {"-O0", "-O1", "-O2", "-O3", "-Ofast-compile"}) {
+    EXPECT_TRUE(driver.RunFullCommand({"compile", level, test_file_path}));
+    EXPECT_THAT(test_error_stream.TakeStr(), StrEq("")) << level;
+    EXPECT_TRUE(llvm::sys::fs::exists(object_path)) << level;
+    llvm::sys::fs::remove(object_path);
+  }
+
+  // The backend splits a module into an object for each thread, and with
+  // shards too, each shard's objects are numbered in turn.
+  auto functions_file_path =
+      CreateTestFile("fn F() {}\nfn G() { F(); }\nfn H() { G(); }");
+  auto expect_objects = [&](int count) {
+    for (int i = 0; i != count + 1; ++i) {
+      llvm::SmallString<256> part_path(functions_file_path);
+      llvm::sys::path::replace_extension(part_path, llvm::Twine(i) + ".o");
+      EXPECT_EQ(llvm::sys::fs::exists(part_path), i != count) << part_path;
+      llvm::sys::fs::remove(part_path);
+    }
+  };
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"compile", "--codegen-threads=2", functions_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  expect_objects(2);
+  EXPECT_TRUE(driver.RunFullCommand({"compile", "--codegen-threads=2",
+                                     "--codegen-shards=2", "-j", "2",
+                                     functions_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  expect_objects(4);
+  EXPECT_FALSE(driver.RunFullCommand(
+      {"compile", "--codegen-threads=0", functions_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(),
+              HasSubstr("ERROR: Invalid number of threads '0'."));
+
+  // Each shard is codegenned into an object of its own, next to the input.
+  EXPECT_TRUE(driver.RunFullCommand(
+      {"compile", "--codegen-shards=3", "-j", "2", test_file_path}));
+  EXPECT_THAT(test_error_stream.TakeStr(), StrEq(""));
+  EXPECT_FALSE(llvm::sys::fs::exists(object_path));
+  for (llvm::StringRef shard : {"0", "1", "2"}) {
+    llvm::SmallString<256> shard_path(test_file_path);
+    llvm::sys::path::replace_extension(shard_path, shard + ".o");
+    EXPECT_TRUE(llvm::sys::fs::exists(shard_path)) << shard_path;
+    llvm::sys::fs::remove(shard_path);
+  }
+}
+
 }  // namespace
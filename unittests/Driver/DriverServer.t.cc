@@ -0,0 +1,205 @@
+#include "Cocktail/Driver/DriverServer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "Cocktail/Diagnostics/DiagnosticCache.h"
+#include "Cocktail/Driver/Driver.h"
+#include "Cocktail/Source/SourceBufferCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+using ::testing::StrEq;
+
+auto CreateTestFile(llvm::StringRef directory, llvm::StringRef name,
+                    llvm::StringRef text) -> std::string {
+  llvm::SmallString<256> path = directory;
+  llvm::sys::path::append(path, name);
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec);
+  out << text;
+  return path.str().str();
+}
+
+class DriverServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("driver_server", directory_));
+    socket_path_ = directory_;
+    llvm::sys::path::append(socket_path_, "socket");
+  }
+
+  void TearDown() override { llvm::sys::fs::remove_directories(directory_); }
+
+  // Starts the server on a thread and waits until it answers.
+  auto StartServer() -> void {
+    server_thread_ = std::thread([this] {
+      server_result_ = server_.Serve(socket_path_);
+    });
+    for (int attempt = 0; attempt != 1000; ++attempt) {
+      std::string output;
+      llvm::raw_string_ostream output_stream(output);
+      if (RunOnDriverServer(socket_path_, {"help"}, output_stream,
+                            llvm::nulls())) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ADD_FAILURE() << "The server didn't start.";
+  }
+
+  auto StopServer() -> void {
+    EXPECT_TRUE(StopDriverServer(socket_path_));
+    server_thread_.join();
+    EXPECT_TRUE(server_result_);
+  }
+
+  llvm::SmallString<256> directory_;
+  llvm::SmallString<256> socket_path_;
+  SourceBufferCache source_cache_{*llvm::vfs::getRealFileSystem()};
+  DiagnosticCache diagnostic_cache_;
+  std::string server_errors_;
+  llvm::raw_string_ostream server_error_stream_{server_errors_};
+  DriverServer server_{source_cache_, diagnostic_cache_, server_error_stream_};
+  std::thread server_thread_;
+  bool server_result_ = false;
+};
+
+TEST_F(DriverServerTest, Run) {
+  auto test_file_path = CreateTestFile(directory_, "test.ck", "a $ b");
+  std::string output;
+  std::string errors;
+  llvm::raw_string_ostream output_stream(output);
+  llvm::raw_string_ostream errors_stream(errors);
+  EXPECT_FALSE(server_.Run({"dump-tokens", test_file_path}, output_stream,
+                           errors_stream));
+  // Diagnostics are written with the errors, rather than to the console.
+  EXPECT_THAT(errors_stream.str(),
+              HasSubstr("Encountered unrecognized characters"));
+  EXPECT_THAT(output_stream.str(), HasSubstr("Identifier"));
+
+  errors.clear();
+  EXPECT_FALSE(server_.Run({"serve", socket_path_}, llvm::nulls(),
+                           errors_stream));
+  EXPECT_THAT(errors_stream.str(), HasSubstr("ERROR"));
+
+  // Nor a language server, which would read the server's standard input.
+  errors.clear();
+  EXPECT_FALSE(server_.Run({"lsp"}, llvm::nulls(), errors_stream));
+  EXPECT_THAT(errors_stream.str(), HasSubstr("ERROR"));
+}
+
+TEST_F(DriverServerTest, Serve) {
+  auto test_file_path =
+      CreateTestFile(directory_, "test.ck", "var v: Int = 42;");
+  std::string expected_output;
+  llvm::raw_string_ostream expected_output_stream(expected_output);
+  Driver driver(expected_output_stream, llvm::nulls());
+  EXPECT_TRUE(driver.RunFullCommand({"dump-parse-tree", test_file_path}));
+
+  StartServer();
+  // The second request reads the tokens and tree back from the server's
+  // caches, and gets the same result.
+  for (int i = 0; i != 2; ++i) {
+    std::string output;
+    std::string errors;
+    llvm::raw_string_ostream output_stream(output);
+    llvm::raw_string_ostream errors_stream(errors);
+    std::optional<bool> success = RunOnDriverServer(
+        socket_path_, {"dump-parse-tree", test_file_path}, output_stream,
+        errors_stream);
+    ASSERT_TRUE(success.has_value());
+    EXPECT_TRUE(*success);
+    EXPECT_THAT(output_stream.str(), StrEq(expected_output_stream.str()));
+    EXPECT_THAT(errors_stream.str(), StrEq(""));
+  }
+
+  // Relative paths are resolved in the client's working directory.
+  llvm::SmallString<256> working_directory;
+  ASSERT_FALSE(llvm::sys::fs::current_path(working_directory));
+  ASSERT_FALSE(llvm::sys::fs::set_current_path(directory_));
+  std::string output;
+  llvm::raw_string_ostream output_stream(output);
+  EXPECT_THAT(RunOnDriverServer(socket_path_, {"dump-parse-tree", "test.ck"},
+                                output_stream, llvm::nulls()),
+              ::testing::Optional(true));
+  ASSERT_FALSE(llvm::sys::fs::set_current_path(working_directory));
+  EXPECT_THAT(output_stream.str(), StrEq(expected_output_stream.str()));
+
+  StopServer();
+  EXPECT_FALSE(llvm::sys::fs::exists(socket_path_));
+  EXPECT_FALSE(RunOnDriverServer(socket_path_, {"help"}, llvm::nulls(),
+                                 llvm::nulls()));
+  EXPECT_THAT(server_error_stream_.str(), StrEq(""));
+}
+
+TEST_F(DriverServerTest, CompileJobs) {
+  auto test_file_path = CreateTestFile(directory_, "test.ck", "fn F() {}");
+  llvm::SmallString<256> object_path(test_file_path);
+  llvm::sys::path::replace_extension(object_path, "o");
+  llvm::SmallString<256> cache_dir = directory_;
+  llvm::sys::path::append(cache_dir, "cache");
+  std::string workers_flag = ("--workers=" + socket_path_).str();
+  std::string cache_dir_flag = ("--cache-dir=" + cache_dir).str();
+
+  StartServer();
+  std::string errors;
+  llvm::raw_string_ostream errors_stream(errors);
+  Driver driver(llvm::nulls(), errors_stream);
+  EXPECT_TRUE(driver.RunFullCommand({"compile", "--stats", workers_flag,
+                                     cache_dir_flag, test_file_path}));
+  EXPECT_THAT(errors_stream.str(), HasSubstr("\nremote_jobs "));
+  uint64_t size = 0;
+  EXPECT_FALSE(llvm::sys::fs::file_size(object_path, size));
+  EXPECT_NE(size, 0);
+  llvm::sys::fs::remove(object_path);
+
+  // The objects are found in the artifact cache rather than sent for again.
+  errors.clear();
+  EXPECT_TRUE(driver.RunFullCommand({"compile", "--stats", workers_flag,
+                                     cache_dir_flag, test_file_path}));
+  EXPECT_THAT(errors_stream.str(), HasSubstr("\nobject_cache_hits "));
+  EXPECT_THAT(errors_stream.str(), Not(HasSubstr("\nremote_jobs ")));
+  EXPECT_TRUE(llvm::sys::fs::exists(object_path));
+  llvm::sys::fs::remove(object_path);
+  StopServer();
+
+  // Without a server to reach, the file is compiled here.
+  errors.clear();
+  EXPECT_TRUE(driver.RunFullCommand({"compile", workers_flag, test_file_path}));
+  EXPECT_THAT(errors_stream.str(), StrEq(""));
+  EXPECT_TRUE(llvm::sys::fs::exists(object_path));
+}
+
+TEST_F(DriverServerTest, ServeErrors) {
+  StartServer();
+  // Only one server listens on a socket.
+  std::string errors;
+  llvm::raw_string_ostream errors_stream(errors);
+  DriverServer second_server(source_cache_, diagnostic_cache_, errors_stream);
+  EXPECT_FALSE(second_server.Serve(socket_path_));
+  EXPECT_THAT(errors_stream.str(), HasSubstr("ERROR"));
+  StopServer();
+
+  errors.clear();
+  auto test_file_path = CreateTestFile(directory_, "test.ck", "");
+  EXPECT_FALSE(second_server.Serve(test_file_path));
+  EXPECT_THAT(errors_stream.str(), HasSubstr("ERROR"));
+  EXPECT_TRUE(llvm::sys::fs::exists(test_file_path));
+}
+
+}  // namespace
@@ -0,0 +1,354 @@
+#include "Cocktail/Driver/LanguageServer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Not;
+using ::testing::SizeIs;
+
+constexpr llvm::StringLiteral Uri = "file:///test.cocktail";
+
+// Returns the messages in `output`, each framed by its header.
+auto ParseMessages(llvm::StringRef output) -> std::vector<llvm::json::Value> {
+  std::vector<llvm::json::Value> messages;
+  while (output.consume_front("Content-Length: ")) {
+    size_t length = 0;
+    output.consumeInteger(10, length);
+    EXPECT_TRUE(output.consume_front("\r\n\r\n"));
+    llvm::Expected<llvm::json::Value> message =
+        llvm::json::parse(output.take_front(length));
+    EXPECT_TRUE(static_cast<bool>(message));
+    if (message) {
+      messages.push_back(std::move(*message));
+    }
+    output = output.drop_front(length);
+  }
+  EXPECT_THAT(output.str(), IsEmpty());
+  return messages;
+}
+
+// Returns the range starting at `line` and `character` and `length` long.
+auto MakeRange(int line, int character, int length) -> llvm::json::Object {
+  return llvm::json::Object{
+      {"start", llvm::json::Object{{"line", line}, {"character", character}}},
+      {"end", llvm::json::Object{{"line", line},
+                                 {"character", character + length}}}};
+}
+
+class LanguageServerTest : public ::testing::Test {
+ protected:
+  // Handles a request, returning the messages written for it.
+  auto Request(llvm::StringRef method, llvm::json::Object params)
+      -> std::vector<llvm::json::Value> {
+    EXPECT_TRUE(server_.HandleMessage(
+        llvm::json::Object{{"jsonrpc", "2.0"},
+                           {"id", ++id_},
+                           {"method", method},
+                           {"params", std::move(params)}}));
+    return TakeMessages();
+  }
+
+  auto Notify(llvm::StringRef method, llvm::json::Object params) -> void {
+    EXPECT_TRUE(server_.HandleMessage(
+        llvm::json::Object{{"jsonrpc", "2.0"},
+                           {"method", method},
+                           {"params", std::move(params)}}));
+  }
+
+  // Returns the result of the request, which must be the only message.
+  auto RequestResult(llvm::StringRef method, llvm::json::Object params)
+      -> llvm::json::Value {
+    std::vector<llvm::json::Value> messages =
+        Request(method, std::move(params));
+    if (messages.size() != 1 || !messages[0].getAsObject() ||
+        !messages[0].getAsObject()->get("result")) {
+      ADD_FAILURE() << "No result for " << method.str();
+      return nullptr;
+    }
+    return *messages[0].getAsObject()->get("result");
+  }
+
+  auto Open(llvm::StringRef uri, llvm::StringRef text) -> void {
+    Notify("textDocument/didOpen",
+           llvm::json::Object{{"textDocument",
+                               llvm::json::Object{{"uri", uri},
+                                                  {"version", 1},
+                                                  {"text", text}}}});
+  }
+
+  auto Change(llvm::StringRef uri, llvm::json::Object range,
+              llvm::StringRef text) -> void {
+    Notify("textDocument/didChange",
+           llvm::json::Object{
+               {"textDocument",
+                llvm::json::Object{{"uri", uri}, {"version", 2}}},
+               {"contentChanges",
+                llvm::json::Array{llvm::json::Object{
+                    {"range", std::move(range)}, {"text", text}}}}});
+  }
+
+  auto SemanticTokens(llvm::StringRef uri) -> llvm::json::Value {
+    llvm::json::Value result = RequestResult(
+        "textDocument/semanticTokens/full",
+        llvm::json::Object{{"textDocument", llvm::json::Object{{"uri", uri}}}});
+    const llvm::json::Object* object = result.getAsObject();
+    return object && object->get("data") ? *object->get("data") : nullptr;
+  }
+
+  auto DocumentSymbols(llvm::StringRef uri) -> llvm::json::Value {
+    return RequestResult(
+        "textDocument/documentSymbol",
+        llvm::json::Object{{"textDocument", llvm::json::Object{{"uri", uri}}}});
+  }
+
+  // Returns the messages written since the last call.
+  auto TakeMessages() -> std::vector<llvm::json::Value> {
+    output_stream_.flush();
+    std::vector<llvm::json::Value> messages = ParseMessages(output_);
+    output_.clear();
+    return messages;
+  }
+
+  // Publishes the diagnostics that are waiting, returning those of `Uri`.
+  auto PublishDiagnostics() -> std::vector<llvm::json::Value> {
+    server_.PublishDiagnostics(/*all=*/true);
+    std::vector<llvm::json::Value> diagnostics;
+    for (const llvm::json::Value& message : TakeMessages()) {
+      const llvm::json::Object* params =
+          message.getAsObject()->getObject("params");
+      EXPECT_THAT(message.getAsObject()->getString("method").value_or(""),
+                  Eq("textDocument/publishDiagnostics"));
+      if (params->getString("uri").value_or("") == Uri) {
+        for (const llvm::json::Value& diagnostic :
+             *params->getArray("diagnostics")) {
+          diagnostics.push_back(diagnostic);
+        }
+      }
+    }
+    return diagnostics;
+  }
+
+  int id_ = 0;
+  std::string output_;
+  llvm::raw_string_ostream output_stream_{output_};
+  // Diagnostics are only published when the test asks.
+  LanguageServer server_{output_stream_, llvm::nulls(),
+                         std::chrono::hours(1)};
+};
+
+TEST_F(LanguageServerTest, Initialize) {
+  llvm::json::Value result = RequestResult("initialize", {});
+  const llvm::json::Object* capabilities =
+      result.getAsObject()->getObject("capabilities");
+  ASSERT_TRUE(capabilities != nullptr);
+  EXPECT_THAT(capabilities->getString("positionEncoding").value_or(""),
+              Eq("utf-16"));
+  EXPECT_THAT(capabilities->getObject("textDocumentSync")
+                  ->getInteger("change")
+                  .value_or(0),
+              Eq(2));
+
+  // Positions count bytes for a client that supports it.
+  result = RequestResult(
+      "initialize",
+      llvm::json::Object{
+          {"capabilities",
+           llvm::json::Object{
+               {"general",
+                llvm::json::Object{
+                    {"positionEncodings",
+                     llvm::json::Array{"utf-16", "utf-8"}}}}}}});
+  EXPECT_THAT(result.getAsObject()
+                  ->getObject("capabilities")
+                  ->getString("positionEncoding")
+                  .value_or(""),
+              Eq("utf-8"));
+
+  std::vector<llvm::json::Value> messages = Request("unknown", {});
+  ASSERT_THAT(messages, SizeIs(1));
+  EXPECT_TRUE(messages[0].getAsObject()->getObject("error") != nullptr);
+
+  EXPECT_THAT(RequestResult("shutdown", {}), Eq(llvm::json::Value(nullptr)));
+  EXPECT_FALSE(server_.HandleMessage(
+      llvm::json::Object{{"jsonrpc", "2.0"}, {"method", "exit"}}));
+}
+
+TEST_F(LanguageServerTest, SemanticTokens) {
+  Open(Uri, "fn F() {\n  var x: i32 = 1;\n}\n");
+  // Each token is its line and start relative to the one before, its length,
+  // its type and whether it's declared.
+  EXPECT_THAT(SemanticTokens(Uri),
+              Eq(llvm::json::Value(llvm::json::Array{
+                  0, 0, 2, 0, 0,  // fn
+                  0, 3, 1, 1, 1,  // F
+                  1, 2, 3, 0, 0,  // var
+                  0, 4, 1, 2, 1,  // x
+                  0, 1, 1, 5, 0,  // :
+                  0, 2, 3, 6, 0,  // i32
+                  0, 4, 1, 5, 0,  // =
+                  0, 2, 1, 3, 0,  // 1
+              })));
+}
+
+TEST_F(LanguageServerTest, SemanticTokensCountUtf16) {
+  // The string is five UTF-16 code units long, and eight bytes.
+  Open(Uri, "var x: i32 = \"\xC3\xA9\xF0\x9F\x98\x80\" + y;\n");
+  llvm::json::Value data = SemanticTokens(Uri);
+  const llvm::json::Array* array = data.getAsArray();
+  ASSERT_TRUE(array != nullptr);
+  ASSERT_THAT(*array, SizeIs(40));
+  // The string, then the `+` after it.
+  EXPECT_THAT(
+      std::vector<llvm::json::Value>(array->begin() + 25, array->begin() + 35),
+      ElementsAre(0, 2, 5, 4, 0, 0, 6, 1, 5, 0));
+}
+
+TEST_F(LanguageServerTest, EditsMatchOpeningTheResult) {
+  Open(Uri, "fn F() {\n  if (x) {\n    y;\n  }\n}\nvar z: i32 = 1;\n");
+  struct Edit {
+    llvm::json::Object range;
+    llvm::StringLiteral text;
+  };
+  Edit edits[] = {
+      // Within a code block.
+      {.range = MakeRange(2, 4, 2), .text = "var w: i32 = f(1, 2);"},
+      // Adding lines.
+      {.range = MakeRange(3, 3, 0), .text = "\n  while (w) {\n  }"},
+      // Outside any code block.
+      {.range = MakeRange(0, 4, 0), .text = "a: i32"},
+      // Leaving a declaration without its `;`.
+      {.range = MakeRange(7, 14, 1), .text = ""},
+  };
+  std::string text = "fn F() {\n  if (x) {\n    y;\n  }\n}\nvar z: i32 = 1;\n";
+  for (Edit& edit : edits) {
+    SCOPED_TRACE(edit.text);
+    // Apply the edit to `text` too.
+    const llvm::json::Object* start = edit.range.getObject("start");
+    const llvm::json::Object* end = edit.range.getObject("end");
+    auto offset = [&](const llvm::json::Object* position) {
+      size_t line_start = 0;
+      for (int64_t line = *position->getInteger("line"); line > 0; --line) {
+        line_start = text.find('\n', line_start) + 1;
+      }
+      return line_start + *position->getInteger("character");
+    };
+    size_t start_offset = offset(start);
+    text.replace(start_offset, offset(end) - start_offset, edit.text.str());
+    Change(Uri, std::move(edit.range), edit.text);
+
+    constexpr llvm::StringLiteral OpenedUri = "file:///opened.cocktail";
+    Open(OpenedUri, text);
+    EXPECT_THAT(SemanticTokens(Uri), Eq(SemanticTokens(OpenedUri)));
+    EXPECT_THAT(DocumentSymbols(Uri), Eq(DocumentSymbols(OpenedUri)));
+    Notify("textDocument/didClose",
+           llvm::json::Object{
+               {"textDocument", llvm::json::Object{{"uri", OpenedUri}}}});
+    TakeMessages();
+  }
+}
+
+TEST_F(LanguageServerTest, EditsWithoutPositions) {
+  Open(Uri, "var z: i32 = 1;\n");
+  // A range without a start or end is taken to start the text.
+  Change(Uri, llvm::json::Object{}, "var y: i32 = 2;\n");
+  Change(Uri, llvm::json::Object{{"end", nullptr}}, "\n");
+  constexpr llvm::StringLiteral OpenedUri = "file:///opened.cocktail";
+  Open(OpenedUri, "\nvar y: i32 = 2;\nvar z: i32 = 1;\n");
+  EXPECT_THAT(SemanticTokens(Uri), Eq(SemanticTokens(OpenedUri)));
+}
+
+TEST_F(LanguageServerTest, DocumentSymbols) {
+  Open(Uri, "fn F() {\n  var x: i32 = 1;\n}\nvar y: i32 = 2;\n");
+  llvm::json::Value symbols = DocumentSymbols(Uri);
+  llvm::json::Value expected = llvm::json::Array{
+      llvm::json::Object{
+          {"name", "F"},
+          {"kind", 12},
+          {"range",
+           llvm::json::Object{
+               {"start", llvm::json::Object{{"line", 0}, {"character", 0}}},
+               {"end", llvm::json::Object{{"line", 2}, {"character", 1}}}}},
+          {"selectionRange", MakeRange(0, 3, 1)},
+          {"children",
+           llvm::json::Array{llvm::json::Object{
+               {"name", "x"},
+               {"kind", 13},
+               {"range", MakeRange(1, 2, 15)},
+               {"selectionRange", MakeRange(1, 6, 1)}}}}},
+      llvm::json::Object{{"name", "y"},
+                         {"kind", 13},
+                         {"range", MakeRange(3, 0, 15)},
+                         {"selectionRange", MakeRange(3, 4, 1)}}};
+  EXPECT_THAT(symbols, Eq(expected));
+}
+
+TEST_F(LanguageServerTest, DiagnosticsAreDebounced) {
+  Open(Uri, "fn F(");
+  // Nothing is published until the delay is up.
+  EXPECT_GT(server_.PublishDiagnostics().count(), 0);
+  EXPECT_THAT(TakeMessages(), IsEmpty());
+  EXPECT_THAT(PublishDiagnostics(), Not(IsEmpty()));
+  EXPECT_THAT(server_.PublishDiagnostics().count(), Eq(-1));
+
+  // Fixing the error clears the diagnostics, though only the edit was
+  // relexed and reparsed.
+  Change(Uri, MakeRange(0, 5, 0), ");");
+  EXPECT_THAT(PublishDiagnostics(), IsEmpty());
+
+  // Breaking it again publishes the diagnostics of the edit.
+  Change(Uri, MakeRange(0, 6, 1), "");
+  EXPECT_THAT(PublishDiagnostics(), Not(IsEmpty()));
+
+  // A clean edit of clean text has nothing to publish.
+  Change(Uri, MakeRange(0, 6, 0), ";");
+  PublishDiagnostics();
+  Change(Uri, MakeRange(0, 3, 1), "G");
+  server_.PublishDiagnostics(/*all=*/true);
+  EXPECT_THAT(TakeMessages(), IsEmpty());
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_F(LanguageServerTest, Serve) {
+  int fds[2];
+  ASSERT_THAT(pipe(fds), Eq(0));
+  std::string input;
+  for (llvm::StringRef body :
+       {R"({"jsonrpc":"2.0","id":1,"method":"initialize","params":{}})",
+        R"({"jsonrpc":"2.0","method":"initialized","params":{}})",
+        R"({"jsonrpc":"2.0","id":2,"method":"shutdown"})",
+        R"({"jsonrpc":"2.0","method":"exit"})"}) {
+    input += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    input += body;
+  }
+  ASSERT_THAT(write(fds[1], input.data(), input.size()),
+              Eq(static_cast<ssize_t>(input.size())));
+  close(fds[1]);
+  EXPECT_TRUE(server_.Serve(fds[0]));
+  close(fds[0]);
+
+  std::vector<llvm::json::Value> messages = TakeMessages();
+  ASSERT_THAT(messages, SizeIs(2));
+  EXPECT_THAT(messages[0].getAsObject()->getInteger("id").value_or(0), Eq(1));
+  EXPECT_THAT(messages[1].getAsObject()->getInteger("id").value_or(0), Eq(2));
+}
+#endif
+
+}  // namespace
@@ -0,0 +1,105 @@
+#include "Cocktail/Driver/RemoteCache.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "Cocktail/Driver/ArtifactCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/FileSystem.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::Eq;
+using ::testing::Lt;
+
+class RemoteCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (llvm::SmallString<256>* directory :
+         {&remote_directory_, &local_directory_, &other_directory_}) {
+      ASSERT_FALSE(
+          llvm::sys::fs::createUniqueDirectory("remote_cache", *directory));
+    }
+  }
+
+  void TearDown() override {
+    for (llvm::SmallString<256>* directory :
+         {&remote_directory_, &local_directory_, &other_directory_}) {
+      llvm::sys::fs::remove_directories(*directory);
+    }
+  }
+
+  llvm::SmallString<256> remote_directory_;
+  llvm::SmallString<256> local_directory_;
+  llvm::SmallString<256> other_directory_;
+};
+
+TEST_F(RemoteCacheTest, EncodeAndDecode) {
+  for (llvm::StringRef data : {"", "short"}) {
+    EXPECT_THAT(DecodeRemoteArtifact(EncodeRemoteArtifact(data)), Eq(data));
+  }
+  std::string data(10000, 'x');
+  std::string blob = EncodeRemoteArtifact(data);
+  EXPECT_THAT(DecodeRemoteArtifact(blob), Eq(data));
+  if (llvm::zlib::isAvailable()) {
+    EXPECT_THAT(blob.size(), Lt(data.size()));
+  }
+
+  // Any change to the blob is caught.
+  for (size_t i : {size_t{0}, size_t{20}, blob.size() - 1}) {
+    std::string corrupt = blob;
+    corrupt[i] ^= 1;
+    EXPECT_FALSE(DecodeRemoteArtifact(corrupt));
+  }
+  EXPECT_FALSE(DecodeRemoteArtifact(blob.substr(0, blob.size() - 1)));
+  EXPECT_FALSE(DecodeRemoteArtifact(""));
+}
+
+TEST_F(RemoteCacheTest, SharesArtifacts) {
+  std::string key = ArtifactCache::MakeKey({"source"});
+  std::string data(1000, 'x');
+  {
+    ArtifactCache cache(local_directory_);
+    cache.SetRemote(std::make_unique<DirectoryRemoteCache>(remote_directory_));
+    ASSERT_TRUE(cache.Insert(key, data));
+    // The remote store finishes before the cache is destroyed.
+  }
+
+  ArtifactCache other_cache(other_directory_);
+  other_cache.SetRemote(
+      std::make_unique<DirectoryRemoteCache>(remote_directory_));
+  auto artifact = other_cache.Lookup(key);
+  ASSERT_TRUE(artifact);
+  EXPECT_THAT(artifact->data(), Eq(data));
+  EXPECT_FALSE(other_cache.Lookup(ArtifactCache::MakeKey({"missing"})));
+
+  // What was fetched is kept locally.
+  ArtifactCache local_only(other_directory_);
+  EXPECT_TRUE(local_only.Lookup(key));
+}
+
+TEST_F(RemoteCacheTest, Prefetch) {
+  std::string key = ArtifactCache::MakeKey({"source"});
+  DirectoryRemoteCache remote(remote_directory_);
+  ASSERT_TRUE(remote.Store(key, EncodeRemoteArtifact("data")));
+  std::string corrupt_key = ArtifactCache::MakeKey({"corrupt"});
+  ASSERT_TRUE(remote.Store(corrupt_key, "not a blob"));
+
+  ArtifactCache cache(local_directory_);
+  cache.SetRemote(std::make_unique<DirectoryRemoteCache>(remote_directory_));
+  cache.Prefetch(key);
+  cache.Prefetch(key);
+  cache.Prefetch(corrupt_key);
+  auto artifact = cache.Lookup(key);
+  ASSERT_TRUE(artifact);
+  EXPECT_THAT(artifact->data(), Eq("data"));
+  EXPECT_FALSE(cache.Lookup(corrupt_key));
+}
+
+}  // namespace
@@ -0,0 +1,128 @@
+#include "Cocktail/Driver/SymbolIndex.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <forward_list>
+#include <string>
+#include <vector>
+
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+
+class SymbolIndexTest : public ::testing::Test {
+ protected:
+  auto Lex(llvm::StringRef text) -> TokenizedBuffer& {
+    text_storage.push_front(text.str());
+    llvm::vfs::InMemoryFileSystem fs;
+    fs.addFile("test.cocktail", /*ModificationTime=*/0,
+               llvm::MemoryBuffer::getMemBuffer(
+                   text_storage.front(), "test.cocktail",
+                   /*RequiresNullTerminator=*/false));
+    source_storage.push_front(std::move(
+        *SourceBuffer::CreateFromFile(fs, "test.cocktail", consumer)));
+    token_storage.push_front(
+        TokenizedBuffer::Lex(source_storage.front(), consumer));
+    return token_storage.front();
+  }
+
+  // Writes `builder`'s index and opens it.
+  auto Write(SymbolIndex::Builder& builder) -> SymbolIndex {
+    data_storage.emplace_front();
+    llvm::raw_string_ostream out(data_storage.front());
+    builder.Write(out);
+    out.flush();
+    std::optional<SymbolIndex> index = SymbolIndex::Open(data_storage.front());
+    EXPECT_TRUE(index.has_value());
+    return *index;
+  }
+
+  // Returns each occurrence of `identifier` in `index` as
+  // `FILE:TOKEN:LINE:COLUMN`.
+  static auto Lookup(const SymbolIndex& index, llvm::StringRef identifier)
+      -> std::vector<std::string> {
+    std::vector<std::string> occurrences;
+    for (const SymbolIndex::Occurrence& o : index.Lookup(identifier)) {
+      occurrences.push_back((index.file_name(o.file) + ":" +
+                             llvm::Twine(o.token) + ":" + llvm::Twine(o.line) +
+                             ":" + llvm::Twine(o.column))
+                                .str());
+    }
+    return occurrences;
+  }
+
+  std::forward_list<std::string> text_storage;
+  std::forward_list<SourceBuffer> source_storage;
+  std::forward_list<TokenizedBuffer> token_storage;
+  std::forward_list<std::string> data_storage;
+  DiagnosticConsumer& consumer = NullDiagnosticConsumer();
+};
+
+TEST_F(SymbolIndexTest, Lookup) {
+  SymbolIndex::Builder builder;
+  int32_t a = builder.AddFile("a.ck");
+  int32_t b = builder.AddFile("b.ck");
+  builder.SetFile(b, 2, Lex("fn G() {\n  F();\n}\n"));
+  builder.SetFile(a, 1, Lex("fn F() {}\nfn G() { F(); }\n"));
+  SymbolIndex index = Write(builder);
+
+  EXPECT_THAT(index.file_count(), Eq(2));
+  EXPECT_THAT(index.identifier_count(), Eq(2));
+  EXPECT_THAT(index.source_hash(b), Eq(2));
+  EXPECT_THAT(index.FindFile("b.ck"), Eq(b));
+  EXPECT_THAT(index.FindFile("c.ck"), Eq(std::nullopt));
+  EXPECT_THAT(Lookup(index, "F"),
+              ElementsAre("a.ck:1:1:4", "a.ck:11:2:10", "b.ck:5:2:3"));
+  EXPECT_THAT(Lookup(index, "G"), ElementsAre("a.ck:7:2:4", "b.ck:1:1:4"));
+  EXPECT_THAT(Lookup(index, "E"), IsEmpty());
+  EXPECT_THAT(Lookup(index, "H"), IsEmpty());
+  EXPECT_THAT(Lookup(index, "fn"), IsEmpty());
+}
+
+TEST_F(SymbolIndexTest, CopyFile) {
+  SymbolIndex::Builder old_builder;
+  old_builder.AddFile("a.ck");
+  old_builder.AddFile("b.ck");
+  old_builder.SetFile(0, 1, Lex("fn F() {}\n"));
+  old_builder.SetFile(1, 2, Lex("fn G() { F(); }\n"));
+  SymbolIndex old_index = Write(old_builder);
+
+  // `b.ck` keeps its entries, under its new index, while `a.ck` is dropped
+  // and `c.ck` added.
+  SymbolIndex::Builder builder;
+  int32_t c = builder.AddFile("c.ck");
+  int32_t b = builder.AddFile("b.ck");
+  builder.SetFile(c, 3, Lex("fn F() {}\n"));
+  builder.CopyFile(b, old_index, *old_index.FindFile("b.ck"));
+  SymbolIndex index = Write(builder);
+  EXPECT_THAT(index.source_hash(b), Eq(2));
+  EXPECT_THAT(Lookup(index, "F"), ElementsAre("c.ck:1:1:4", "b.ck:5:1:10"));
+  EXPECT_THAT(Lookup(index, "G"), ElementsAre("b.ck:1:1:4"));
+}
+
+TEST_F(SymbolIndexTest, OpenRejectsMalformedData) {
+  SymbolIndex::Builder builder;
+  builder.SetFile(builder.AddFile("a.ck"), 1, Lex("fn F() {}\n"));
+  std::string data;
+  llvm::raw_string_ostream out(data);
+  builder.Write(out);
+  out.flush();
+  ASSERT_TRUE(SymbolIndex::Open(data).has_value());
+  EXPECT_FALSE(SymbolIndex::Open(llvm::StringRef(data).drop_back()));
+  EXPECT_FALSE(SymbolIndex::Open(""));
+  data[8] = 0x7f;
+  EXPECT_FALSE(SymbolIndex::Open(data));
+}
+
+}  // namespace
@@ -0,0 +1,13 @@
+#include <cstddef>
+
+#include "llvm/FuzzMutate/FuzzerCLI.h"
+
+// Defined by each fuzzer.
+extern "C" auto LLVMFuzzerTestOneInput(const unsigned char* data,
+                                       std::size_t size) -> int;
+
+// Runs a fuzzer built without libFuzzer over each of the files it's given,
+// which is how its corpus is run as a test.
+auto main(int argc, char** argv) -> int {
+  return llvm::runFuzzerOnInputs(argc, argv, LLVMFuzzerTestOneInput);
+}
@@ -1,34 +1,19 @@
+#include <cassert>
+#include <climits>
 #include <cstdint>
-#include <cstring>
 
-#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
 #include "Cocktail/Diagnostics/NullDiagnostics.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
-#include "llvm/ADT/StringRef.h"
+#include "Cocktail/Testing/Fuzzer.t.h"
 
 namespace Cocktail {
 
 extern "C" auto LLVMFuzzerTestOneInput(const unsigned char* data,
                                        std::size_t size) -> int {
-  if (size < 2) {
+  auto source = Testing::CreateFuzzerSource(data, size);
+  if (!source) {
     return 0;
   }
-  uint16_t raw_filename_length;
-  std::memcpy(&raw_filename_length, data, 2);
-  data += 2;
-  size -= 2;
-  size_t filename_length = raw_filename_length;
-
-  if (size < filename_length) {
-    return 0;
-  }
-  llvm::StringRef filename(reinterpret_cast<const char*>(data),
-                           filename_length);
-  data += filename_length;
-  size -= filename_length;
-
-  auto source = SourceBuffer::CreateFromText(
-      llvm::StringRef(reinterpret_cast<const char*>(data), size), filename);
 
   auto buffer = TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
   if (buffer.has_errors()) {
@@ -49,4 +34,4 @@ extern "C" auto LLVMFuzzerTestOneInput(const unsigned char* data,
   return 0;
 }
 
-}  // namespace Cocktail
\ No newline at end of file
+}  // namespace Cocktail
@@ -0,0 +1,36 @@
+#include <cstdint>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Common/TaskScheduler.h"
+#include "Cocktail/Testing/FastPaths.t.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+
+// Lexes and parses each input serially and with each fast path, and checks
+// that they agree on every token, line, identifier and node. How the fast
+// paths split and edit the input is picked from a hash of it, so that each
+// input tries a different split and edit.
+extern "C" auto LLVMFuzzerTestOneInput(const unsigned char* data,
+                                       std::size_t size) -> int {
+  static TaskScheduler scheduler(2);
+
+  llvm::StringRef text(reinterpret_cast<const char*>(data), size);
+  uint64_t hash = llvm::hash_value(text);
+  Testing::FastPathOptions options = {
+      .lex_chunk_size = static_cast<int64_t>(1 + hash % 64),
+      .parse_chunk_size = static_cast<int>(1 + (hash >> 8) % 64),
+      .edit_offset = static_cast<int64_t>(size == 0 ? 0 : (hash >> 16) % size),
+      .edit_length = static_cast<int64_t>((hash >> 40) % 32)};
+  auto differences = Testing::CompareFastPaths(text, scheduler, options);
+  for (const Testing::FastPathDifference& difference : differences) {
+    llvm::errs() << difference.fast_path << " differs at "
+                 << difference.difference << "\n";
+  }
+  COCKTAIL_CHECK(differences.empty()) << "Fast paths differ from serial";
+
+  return 0;
+}
+
+}  // namespace Cocktail
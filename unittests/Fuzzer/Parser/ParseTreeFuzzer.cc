@@ -0,0 +1,32 @@
+#include <cstdint>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Testing/Fuzzer.t.h"
+
+namespace Cocktail {
+
+// Lexes and parses each input, with or without errors, and checks that the
+// tree is well-formed. The parser's storage is kept from one input to the
+// next, as a long-running process keeps it, so that after the first few
+// inputs the time goes to parsing rather than allocating.
+extern "C" auto LLVMFuzzerTestOneInput(const unsigned char* data,
+                                       std::size_t size) -> int {
+  static ParseTree::ScratchSpace scratch;
+
+  auto source = Testing::CreateFuzzerSource(data, size);
+  if (!source) {
+    return 0;
+  }
+
+  auto tokens = TokenizedBuffer::Lex(*source, NullDiagnosticConsumer());
+  auto tree = ParseTree::Parse(tokens, NullDiagnosticConsumer(), scratch);
+  COCKTAIL_CHECK(tree.Verify()) << "Invalid parse tree";
+  scratch.Recycle(std::move(tree));
+
+  return 0;
+}
+
+}  // namespace Cocktail
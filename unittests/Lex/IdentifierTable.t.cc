@@ -0,0 +1,77 @@
+#include "Cocktail/Lexer/IdentifierTable.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/ThreadPool.h"
+
+namespace Cocktail {
+namespace {
+
+using ::testing::Eq;
+using ::testing::StrEq;
+
+TEST(IdentifierTableTest, Intern) {
+  IdentifierTable table;
+  IdentifierTable::Id foo = table.Intern(HashedIdentifier("foo"));
+  IdentifierTable::Id bar = table.Intern(HashedIdentifier("bar"));
+  EXPECT_TRUE(foo != bar);
+  EXPECT_TRUE(table.Intern(HashedIdentifier("foo")) == foo);
+  EXPECT_THAT(table.size(), Eq(2));
+
+  // The text is copied, so it need not outlive the table.
+  std::string text = "bar";
+  EXPECT_TRUE(table.Intern(HashedIdentifier(text)) == bar);
+  text = "baz";
+  EXPECT_THAT(table.GetText(foo).str(), StrEq("foo"));
+  EXPECT_THAT(table.GetText(bar).str(), StrEq("bar"));
+}
+
+TEST(IdentifierTableTest, InternBatch) {
+  IdentifierTable table;
+  IdentifierTable::Id b = table.Intern(HashedIdentifier("b"));
+  llvm::SmallVector<HashedIdentifier> identifiers = {
+      HashedIdentifier("a"), HashedIdentifier("b"), HashedIdentifier("c"),
+      HashedIdentifier("a")};
+  llvm::SmallVector<IdentifierTable::Id> ids(identifiers.size());
+  table.Intern(identifiers, ids);
+  EXPECT_TRUE(ids[1] == b);
+  EXPECT_TRUE(ids[0] == ids[3]);
+  EXPECT_TRUE(ids[0] != ids[2]);
+  EXPECT_THAT(table.GetText(ids[2]).str(), StrEq("c"));
+  EXPECT_THAT(table.size(), Eq(3));
+}
+
+TEST(IdentifierTableTest, InternConcurrently) {
+  constexpr int NumThreads = 8;
+  constexpr int NumIdentifiers = 1000;
+  IdentifierTable table;
+  llvm::SmallVector<llvm::SmallVector<IdentifierTable::Id>> ids(NumThreads);
+  llvm::ThreadPool thread_pool;
+  for (int thread = 0; thread != NumThreads; ++thread) {
+    thread_pool.async([&, thread] {
+      for (int i = 0; i != NumIdentifiers; ++i) {
+        // Each thread interns the identifiers in a different order.
+        int n = (i * 7 + thread * 131) % NumIdentifiers;
+        ids[thread].push_back(
+            table.Intern(HashedIdentifier("id" + std::to_string(n))));
+      }
+    });
+  }
+  thread_pool.wait();
+
+  EXPECT_THAT(table.size(), Eq(NumIdentifiers));
+  for (int thread = 0; thread != NumThreads; ++thread) {
+    for (int i = 0; i != NumIdentifiers; ++i) {
+      int n = (i * 7 + thread * 131) % NumIdentifiers;
+      EXPECT_THAT(table.GetText(ids[thread][i]).str(),
+                  StrEq("id" + std::to_string(n)));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace Cocktail
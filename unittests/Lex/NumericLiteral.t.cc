@@ -88,11 +88,31 @@ TEST_F(NumericLiteralTest, HandlesIntegerLiteral) {
       {.token = "0x12_3ABC", .value = 0x12'3ABC, .radix = 16},
       {.token = "0b10_10_11", .value = 0b10'10'11, .radix = 2},
       {.token = "1_234_567", .value = 1'234'567, .radix = 10},
+      // The largest values of each radix that fit in 64 bits.
+      {.token = "9999999999999999999",
+       .value = 9'999'999'999'999'999'999U,
+       .radix = 10},
+      {.token = "18446744073709551615",
+       .value = 18'446'744'073'709'551'615U,
+       .radix = 10},
+      {.token = "0xFFFF_FFFF_FFFF_FFFF",
+       .value = 0xFFFF'FFFF'FFFF'FFFF,
+       .radix = 16},
+      {.token = "0b1111111111111111111111111111111111111111111111111111111111111111",
+       .value = 0xFFFF'FFFF'FFFF'FFFF,
+       .radix = 2},
+      // Digit runs broken up by separators.
+      {.token = "1_000_000_000_000_000_000",
+       .value = 1'000'000'000'000'000'000,
+       .radix = 10},
+      {.token = "12_345_678_901", .value = 12'345'678'901, .radix = 10},
   };
   for (Testcase testcase : testcases) {
     error_tracker.Reset();
+    // Values of 2^63 and up read as signed aren't negative either.
     EXPECT_THAT(Parse(testcase.token),
-                HasIntValue(IsUnsignedInteger(testcase.value)));
+                HasIntValue(AllOf(IsUnsignedInteger(testcase.value),
+                                  Property(&llvm::APInt::isNegative, false))));
     EXPECT_FALSE(error_tracker.seen_error());
   }
 }
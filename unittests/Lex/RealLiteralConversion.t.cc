@@ -0,0 +1,105 @@
+#include "Cocktail/Lexer/RealLiteralConversion.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <limits>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace {
+
+using namespace Cocktail;
+
+// Converts `mantissa`, in `radix`, times `radix` to the `exponent`, which is
+// 10 for decimal and 2 otherwise.
+auto ToDouble(llvm::StringRef mantissa, int64_t exponent, bool is_decimal)
+    -> double {
+  llvm::APInt value(4096, mantissa, is_decimal ? 10 : 16);
+  value = value.trunc(std::max(1U, value.getActiveBits()));
+  return RealLiteralToDouble(value, llvm::APInt(64, exponent, true),
+                             is_decimal);
+}
+
+auto ToFloat(llvm::StringRef mantissa, int64_t exponent, bool is_decimal)
+    -> float {
+  llvm::APInt value(4096, mantissa, is_decimal ? 10 : 16);
+  value = value.trunc(std::max(1U, value.getActiveBits()));
+  return RealLiteralToFloat(value, llvm::APInt(64, exponent, true),
+                            is_decimal);
+}
+
+constexpr double Infinity = std::numeric_limits<double>::infinity();
+
+TEST(RealLiteralConversionTest, Decimal) {
+  EXPECT_EQ(ToDouble("0", -1, true), 0.0);
+  EXPECT_EQ(ToDouble("15", -1, true), 1.5);
+  EXPECT_EQ(ToDouble("12345", 3, true), 12345e3);
+  EXPECT_EQ(ToDouble("3141592653589793238", -18, true), 3.141592653589793);
+  EXPECT_EQ(ToDouble("17976931348623157", 292, true),
+            std::numeric_limits<double>::max());
+  EXPECT_EQ(ToDouble("22250738585072014", -324, true),
+            std::numeric_limits<double>::min());
+  EXPECT_EQ(ToDouble("49406564584124654", -340, true),
+            std::numeric_limits<double>::denorm_min());
+  EXPECT_EQ(ToFloat("31415926535", -10, true), 3.1415926535f);
+  EXPECT_EQ(ToFloat("34028234664", 28, true),
+            std::numeric_limits<float>::max());
+}
+
+TEST(RealLiteralConversionTest, DecimalTiesRoundToEven) {
+  // 2^53 + 1 and 2^53 + 3 are halfway between two doubles.
+  EXPECT_EQ(ToDouble("9007199254740993", 0, true), 9007199254740992.0);
+  EXPECT_EQ(ToDouble("9007199254740995", 0, true), 9007199254740996.0);
+  EXPECT_EQ(ToDouble("90071992547409930", -1, true), 9007199254740992.0);
+  // Just above halfway, which only the last digits show.
+  EXPECT_EQ(ToDouble("9007199254740993000000000000000000001", -21, true),
+            9007199254740994.0);
+  // 1 + 2^-24 is halfway between two floats.
+  EXPECT_EQ(ToFloat("100000005960464477539062500", -26, true), 1.0f);
+  EXPECT_EQ(ToFloat("100000005960464477539062501", -26, true),
+            1.00000012f);
+}
+
+TEST(RealLiteralConversionTest, DecimalOutOfRange) {
+  EXPECT_EQ(ToDouble("1", 309, true), Infinity);
+  EXPECT_EQ(ToDouble("18", 307, true), Infinity);
+  EXPECT_EQ(ToDouble("1", -400, true), 0.0);
+  EXPECT_EQ(ToDouble("24703282292062327", -340, true), 0.0);
+  EXPECT_EQ(ToDouble("24703282292062328", -340, true),
+            std::numeric_limits<double>::denorm_min());
+  EXPECT_EQ(ToFloat("1", 39, true), std::numeric_limits<float>::infinity());
+  EXPECT_EQ(ToDouble("1", INT64_MAX, true), Infinity);
+  EXPECT_EQ(ToDouble("1", INT64_MIN, true), 0.0);
+
+  // Exponents wider than 64 bits.
+  llvm::APInt huge = llvm::APInt::getOneBitSet(80, 70);
+  EXPECT_EQ(RealLiteralToDouble(llvm::APInt(64, 1), huge, true), Infinity);
+  EXPECT_EQ(RealLiteralToDouble(llvm::APInt(64, 1), -huge, true), 0.0);
+  EXPECT_EQ(RealLiteralToDouble(llvm::APInt(64, 1), -huge, false), 0.0);
+}
+
+TEST(RealLiteralConversionTest, Binary) {
+  EXPECT_EQ(ToDouble("18", -4, false), 1.5);
+  EXPECT_EQ(ToDouble("1921FB54442D18", -51, false), 3.141592653589793);
+  EXPECT_EQ(ToDouble("1", -1074, false),
+            std::numeric_limits<double>::denorm_min());
+  EXPECT_EQ(ToDouble("1", -1075, false), 0.0);
+  EXPECT_EQ(ToDouble("3", -1076, false),
+            std::numeric_limits<double>::denorm_min());
+  EXPECT_EQ(ToDouble("1FFFFFFFFFFFFF", 971, false),
+            std::numeric_limits<double>::max());
+  EXPECT_EQ(ToDouble("1", 1024, false), Infinity);
+  // Rounding 2^54 - 1 up carries into the exponent.
+  EXPECT_EQ(ToDouble("3FFFFFFFFFFFFF", 0, false), 18014398509481984.0);
+  // Ties round to even, and bits beyond the first 64 break them.
+  EXPECT_EQ(ToDouble("20000000000001", 0, false), 9007199254740992.0);
+  EXPECT_EQ(ToDouble("200000000000010000000000000000001", -76, false),
+            9007199254740994.0);
+  EXPECT_EQ(ToFloat("1000001", -24, false), 1.0f);
+  EXPECT_EQ(ToFloat("1", -150, false), 0.0f);
+  EXPECT_EQ(ToFloat("1", -149, false),
+            std::numeric_limits<float>::denorm_min());
+}
+
+}  // namespace
@@ -295,6 +295,36 @@ TEST_F(StringLiteralTest, TabInBlockString) {
   EXPECT_EQ(value, "x\ty\n");
 }
 
+TEST_F(StringLiteralTest, ValueInAllocator) {
+  llvm::StringLiteral testcases[] = {
+      R"("")",
+      R"("plain text")",
+      R"("escaped\ttext")",
+      R"(#"raw \n text"#)",
+      "\"x\ty\"",
+      "\"\"\"\n  block\n  \"\"\"",
+  };
+
+  for (llvm::StringLiteral test : testcases) {
+    LexedStringLiteral token = Lex(test);
+    Testing::SingleTokenDiagnosticTranslator translator(test);
+    DiagnosticEmitter<const char*> emitter(translator, error_tracker);
+    llvm::BumpPtrAllocator allocator;
+    EXPECT_EQ(token.ComputeValue(allocator, emitter),
+              token.ComputeValue(emitter))
+        << "`" << test << "`";
+  }
+
+  // A value that needs no unescaping refers into the source text.
+  llvm::StringRef text = R"("plain text")";
+  Testing::SingleTokenDiagnosticTranslator translator(text);
+  DiagnosticEmitter<const char*> emitter(translator, error_tracker);
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringRef value = Lex(text).ComputeValue(allocator, emitter);
+  EXPECT_EQ(value.data(), text.data() + 1);
+  EXPECT_EQ(allocator.getBytesAllocated(), 0);
+}
+
 TEST_F(StringLiteralTest, UnicodeTooManyDigits) {
   std::string text = "u{";
   text.append(10000, '9');
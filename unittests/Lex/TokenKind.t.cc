@@ -74,5 +74,24 @@ TEST(TokenKindTest, SymbolsInDescendingLength) {
   EXPECT_GT(previous_length, 0);
 }
 
+TEST(TokenKindTest, FixedSpellingSize) {
+#define COCKTAIL_TOKEN(TokenName)                                           \
+  EXPECT_EQ(static_cast<int>(TokenKind::TokenName.fixed_spelling().size()), \
+            TokenKind::TokenName.fixed_spelling_size())                     \
+      << #TokenName;
+#include "Cocktail/Lex/TokenKind.def"
+}
+
+TEST(TokenKindTest, SizedTypeLiterals) {
+  int sized_type_literals = 0;
+#define COCKTAIL_TOKEN(TokenName) \
+  sized_type_literals += TokenKind::TokenName.is_sized_type_literal();
+#include "Cocktail/Lex/TokenKind.def"
+  EXPECT_EQ(sized_type_literals, 3);
+  EXPECT_TRUE(TokenKind::IntegerTypeLiteral.is_sized_type_literal());
+  EXPECT_TRUE(TokenKind::UnsignedIntegerTypeLiteral.is_sized_type_literal());
+  EXPECT_TRUE(TokenKind::FloatingPointTypeLiteral.is_sized_type_literal());
+}
+
 }  // namespace
 }  // namespace Cocktail::Lex
\ No newline at end of file
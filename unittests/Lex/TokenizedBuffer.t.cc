@@ -4,8 +4,14 @@
 #include <gtest/gtest.h>
 
 #include <iterator>
+#include <string>
+#include <vector>
 
+#include "Cocktail/Common/Cancellation.h"
+#include "Cocktail/Common/TaskScheduler.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Diagnostics/ErrorBudgetDiagnosticConsumer.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
 #include "Cocktail/Testing/Mocks.t.h"
 #include "Cocktail/Testing/TokenizedBuffer.t.h"
 #include "Cocktail/Testing/Yaml.t.h"
@@ -13,7 +19,11 @@
 #include "llvm/ADT/None.h"
 #include "llvm/ADT/Sequence.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/YAMLParser.h"
 #include "llvm/Support/raw_ostream.h"
@@ -25,8 +35,13 @@ using namespace Cocktail::Testing;
 
 using ::testing::_;
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
 using ::testing::Eq;
+using ::testing::Gt;
 using ::testing::HasSubstr;
+using ::testing::IsSubsetOf;
+using ::testing::Le;
+using ::testing::Lt;
 using ::testing::StrEq;
 
 class LexerTest : public ::testing::Test {
@@ -171,6 +186,35 @@ TEST_F(LexerTest, HandlesNumericLiteral) {
   EXPECT_EQ(value_1_5e9.Mantissa().getZExtValue(), 15);
   EXPECT_EQ(value_1_5e9.Exponent().getSExtValue(), 8);
   EXPECT_EQ(value_1_5e9.IsDecimal(), true);
+  EXPECT_EQ(value_1_5e9.ToDouble(), 1.5e9);
+  EXPECT_EQ(value_1_5e9.ToFloat(), 1.5e9f);
+}
+
+TEST_F(LexerTest, HandlesNumericLiteralValuesOfAnyWidth) {
+  // Values on both sides of what fits in a token.
+  auto buffer = Lex(
+      "2147483647 2147483648 99999999999999999999 0xFF 16777215.0 1.0e64 "
+      "1.0e-66 i2147483648");
+  EXPECT_FALSE(buffer.has_errors());
+  auto token = buffer.tokens().begin();
+  EXPECT_EQ(buffer.GetIntegerLiteral(*token++), 2147483647);
+  EXPECT_EQ(buffer.GetIntegerLiteral(*token++), 2147483648);
+  EXPECT_EQ(llvm::toString(buffer.GetIntegerLiteral(*token++), /*Radix=*/10,
+                           /*Signed=*/false),
+            "99999999999999999999");
+  EXPECT_EQ(buffer.GetIntegerLiteral(*token++), 0xFF);
+  auto value_16777215_0 = buffer.GetRealLiteral(*token++);
+  EXPECT_EQ(value_16777215_0.Mantissa().getZExtValue(), 167772150);
+  EXPECT_EQ(value_16777215_0.Exponent().getSExtValue(), -1);
+  auto value_1_0e64 = buffer.GetRealLiteral(*token++);
+  EXPECT_EQ(value_1_0e64.Mantissa().getZExtValue(), 10);
+  EXPECT_EQ(value_1_0e64.Exponent().getSExtValue(), 63);
+  auto value_1_0e_66 = buffer.GetRealLiteral(*token++);
+  EXPECT_EQ(value_1_0e_66.Mantissa().getZExtValue(), 10);
+  EXPECT_EQ(value_1_0e_66.Exponent().getSExtValue(), -67);
+  EXPECT_EQ(value_1_0e_66.ToDouble(), 1.0e-66);
+  EXPECT_EQ(value_1_0e_66.ToFloat(), 0.0f);
+  EXPECT_EQ(buffer.GetTypeLiteralSize(*token++), 2147483648);
 }
 
 TEST_F(LexerTest, HandlesInvalidNumericLiterals) {
@@ -625,6 +669,19 @@ TEST_F(LexerTest, Comments) {
       buffer,
       HasTokens(llvm::ArrayRef<ExpectedToken>{{TokenKind::EndOfFile()}}));
 
+  // Make sure columns stay right across long runs of whitespace and comments.
+  buffer = Lex(std::string(40, ' ') + "// " + std::string(100, 'x') + "\n" +
+               std::string(20, '\t') + " \t;");
+  EXPECT_FALSE(buffer.has_errors());
+  EXPECT_THAT(buffer,
+              HasTokens(llvm::ArrayRef<ExpectedToken>{
+                  {.kind = TokenKind::Semi(),
+                   .line = 2,
+                   .column = 23,
+                   .indent_column = 23},
+                  {.kind = TokenKind::EndOfFile(), .line = 2, .column = 24},
+              }));
+
   // Make sure we can lex a comment at the end of the input.
   buffer = Lex("//");
   EXPECT_FALSE(buffer.has_errors());
@@ -681,6 +738,67 @@ TEST_F(LexerTest, Identifiers) {
                           {TokenKind::EndOfFile()},
                       }));
 
+  // Check identifiers longer than a vector stride, ending just before bytes
+  // that neighbor identifier characters.
+  buffer = Lex(
+      "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"
+      "@abcdefghijklmnop`");
+  EXPECT_TRUE(buffer.has_errors());
+  EXPECT_THAT(buffer,
+              HasTokens(llvm::ArrayRef<ExpectedToken>{
+                  {.kind = TokenKind::Identifier(),
+                   .column = 1,
+                   .text = "abcdefghijklmnopqrstuvwxyz_"
+                           "ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"},
+                  {.kind = TokenKind::At(), .column = 65},
+                  {.kind = TokenKind::Identifier(),
+                   .column = 66,
+                   .text = "abcdefghijklmnop"},
+                  {.kind = TokenKind::Error(), .column = 82, .text = "`"},
+                  {TokenKind::EndOfFile()},
+              }));
+
+  // Check identifiers with Unicode letters, digits and combining marks, whose
+  // columns count bytes.
+  buffer = Lex("caf\xC3\xA9 \xE4\xB8\xAD\xE6\x96\x87x2 _\xD9\xA3 x\xCC\x81y");
+  EXPECT_FALSE(buffer.has_errors());
+  EXPECT_THAT(buffer,
+              HasTokens(llvm::ArrayRef<ExpectedToken>{
+                  {.kind = TokenKind::Identifier(),
+                   .column = 1,
+                   .text = "caf\xC3\xA9"},
+                  {.kind = TokenKind::Identifier(),
+                   .column = 7,
+                   .text = "\xE4\xB8\xAD\xE6\x96\x87x2"},
+                  {.kind = TokenKind::Identifier(),
+                   .column = 16,
+                   .text = "_\xD9\xA3"},
+                  {.kind = TokenKind::Identifier(),
+                   .column = 20,
+                   .text = "x\xCC\x81y"},
+                  {TokenKind::EndOfFile()},
+              }));
+
+  // Check that other Unicode characters, and a combining mark at the start,
+  // are errors that stop at the next identifier.
+  buffer = Lex("a\xE2\x82\xAC\xC3\xA9 \xCC\x81x");
+  EXPECT_TRUE(buffer.has_errors());
+  EXPECT_THAT(buffer,
+              HasTokens(llvm::ArrayRef<ExpectedToken>{
+                  {.kind = TokenKind::Identifier(), .column = 1, .text = "a"},
+                  {.kind = TokenKind::Error(),
+                   .column = 2,
+                   .text = "\xE2\x82\xAC"},
+                  {.kind = TokenKind::Identifier(),
+                   .column = 5,
+                   .text = "\xC3\xA9"},
+                  {.kind = TokenKind::Error(),
+                   .column = 8,
+                   .text = "\xCC\x81"},
+                  {.kind = TokenKind::Identifier(), .column = 10, .text = "x"},
+                  {TokenKind::EndOfFile()},
+              }));
+
   // Check multiple identifiers with indent and interning.
   buffer = Lex("   foo;bar\nbar \n  foo\tfoo");
   EXPECT_FALSE(buffer.has_errors());
@@ -956,6 +1074,367 @@ TEST_F(LexerTest, TypeLiteralTooManyDigits) {
       }));
 }
 
+// Records each diagnostic as `line:column: message`.
+class RecordingDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    const DiagnosticMessage& message = diagnostic.message;
+    diagnostics.push_back(llvm::formatv("{0}:{1}: {2}",
+                                        message.location().line_number,
+                                        message.location().column_number,
+                                        message.format_fn(message)));
+  }
+
+  std::vector<std::string> diagnostics;
+};
+
+TEST_F(LexerTest, ParallelLexMatchesSerial) {
+  llvm::StringLiteral testcases[] = {
+      "fn F() {\n  var x: i32 = 42;\n  return x;\n}\nfn G() { F(); }\n",
+      // Groups that are matched, mismatched and unmatched across chunks.
+      "fn F() {\n  (\n  ]\n}\n) foo bar\n foo\n$$ 12 0x1G \"abc\n{\n",
+      // Multi-line string literals that chunks must not split.
+      "var s: String = \"\"\"\nline one\n  fn ( {\n\"\"\";\nfoo(bar);\n",
+      "// comment\n  //bad\nx; // trailing\n[ ( \n ) ]\n\"\"\"\nopen\n( ]\n",
+      // String values that refer into the source and that are unescaped.
+      "x = \"tab\\there\" \"plain\";\ny = \"more\\n\";\n",
+  };
+  TaskScheduler scheduler;
+  for (llvm::StringLiteral testcase : testcases) {
+    RecordingDiagnosticConsumer serial_consumer;
+    auto& source = GetSourceBuffer(testcase);
+    auto serial = TokenizedBuffer::Lex(source, serial_consumer);
+    std::string serial_print;
+    llvm::raw_string_ostream serial_stream(serial_print);
+    serial.Print(serial_stream);
+
+    // Try every split, from one chunk per line to a single chunk.
+    for (int chunk_size = 1; chunk_size <= static_cast<int>(testcase.size());
+         ++chunk_size) {
+      SCOPED_TRACE(llvm::formatv("chunk_size: {0}", chunk_size).str());
+      RecordingDiagnosticConsumer parallel_consumer;
+      auto parallel = TokenizedBuffer::Lex(source, parallel_consumer,
+                                           scheduler, chunk_size);
+      std::string parallel_print;
+      llvm::raw_string_ostream parallel_stream(parallel_print);
+      parallel.Print(parallel_stream);
+      EXPECT_THAT(parallel_stream.str(), StrEq(serial_stream.str()));
+      EXPECT_THAT(parallel_consumer.diagnostics,
+                  ElementsAreArray(serial_consumer.diagnostics));
+      EXPECT_THAT(parallel.has_errors(), Eq(serial.has_errors()));
+    }
+  }
+}
+
+TEST_F(LexerTest, LazyLiteralValues) {
+  llvm::StringLiteral testcase =
+      "x = 12 0x1G 1.5e3 0x1.8p-4 12345678901234567890123;\n"
+      "y = \"plain\" \"tab\\there\" \"bad\\q\" \"\"\"\n  block\n  \"\"\";\n";
+  auto& source = GetSourceBuffer(testcase);
+  RecordingDiagnosticConsumer eager_consumer;
+  auto eager = TokenizedBuffer::Lex(source, eager_consumer);
+  std::string eager_print;
+  llvm::raw_string_ostream eager_stream(eager_print);
+  eager.Print(eager_stream);
+
+  // Lexing lazily diagnoses nothing about the literals themselves.
+  RecordingDiagnosticConsumer lazy_consumer;
+  auto lazy = TokenizedBuffer::Lex(source, lazy_consumer,
+                                   TokenizedBuffer::LiteralValues::Lazy);
+  EXPECT_THAT(lazy_consumer.diagnostics, ElementsAre());
+  EXPECT_FALSE(lazy.has_errors());
+
+  // Values are computed on demand, and an invalid one is zero.
+  auto token = lazy.tokens().begin() + 2;
+  EXPECT_EQ(lazy.GetIntegerLiteral(*token++), 12);
+  EXPECT_EQ(lazy.GetKind(*token), TokenKind::IntegerLiteral());
+  EXPECT_EQ(lazy.GetIntegerLiteral(*token++), 0);
+  EXPECT_EQ(lazy.GetRealLiteral(*token).Mantissa().getZExtValue(), 15);
+  token = lazy.tokens().begin() + 11;
+  EXPECT_EQ(lazy.GetStringLiteral(*token), "tab\there");
+  // The second time, the value is memoized.
+  EXPECT_EQ(lazy.GetStringLiteral(*token).data(),
+            lazy.GetStringLiteral(*token).data());
+
+  // Validating gives the same buffer and diagnostics as lexing eagerly.
+  lazy.ValidateLiterals(lazy_consumer);
+  std::string lazy_print;
+  llvm::raw_string_ostream lazy_stream(lazy_print);
+  lazy.Print(lazy_stream);
+  EXPECT_THAT(lazy_stream.str(), StrEq(eager_stream.str()));
+  EXPECT_THAT(lazy_consumer.diagnostics,
+              ElementsAreArray(eager_consumer.diagnostics));
+  EXPECT_THAT(lazy.has_errors(), Eq(eager.has_errors()));
+}
+
+TEST_F(LexerTest, RelexMatchesLex) {
+  struct Testcase {
+    llvm::StringLiteral text;
+    int64_t offset;
+    int64_t removed_length;
+    llvm::StringLiteral inserted_text;
+  };
+  llvm::StringLiteral text =
+      "fn F() {\n  var x: i32 = 42;\n  return x;\n}\n"
+      "var s: String = \"\"\"\nline one\n  fn ( {\n\"\"\";\n"
+      "y = \"tab\\there\" 1.5 12345678901234567890123;\n[ ( \n ) ]\n";
+  Testcase testcases[] = {
+      // Edits within a line.
+      {text, 19, 2, "y"},
+      {text, 26, 0, "7"},
+      // Edits that add and remove lines.
+      {text, 9, 0, "  (\n  ]\n"},
+      {text, 8, 20, ""},
+      // Edits inside, into and out of a multi-line string literal.
+      {text, 62, 3, "two"},
+      {text, 58, 3, "\"\""},
+      {text, 88, 0, "\"\"\"\n"},
+      // Edits that change how groups after them match.
+      {text, 0, 0, "{"},
+      {text, 130, 1, ""},
+      // Edits at the very start and end.
+      {text, 0, 2, "var"},
+      {text, static_cast<int64_t>(text.size()), 0, "z\n"},
+      {"", 0, 0, "fn F() {}\n"},
+  };
+  for (const Testcase& testcase : testcases) {
+    SCOPED_TRACE(llvm::formatv("offset: {0}", testcase.offset).str());
+    RecordingDiagnosticConsumer previous_consumer;
+    auto previous = TokenizedBuffer::Lex(GetSourceBuffer(testcase.text),
+                                         previous_consumer);
+    std::string edited_text = testcase.text.str();
+    edited_text.replace(testcase.offset, testcase.removed_length,
+                        testcase.inserted_text.str());
+    auto& source = GetSourceBuffer(edited_text);
+
+    RecordingDiagnosticConsumer relex_consumer;
+    auto relexed = TokenizedBuffer::Relex(
+        previous, source,
+        {.offset = testcase.offset,
+         .removed_length = testcase.removed_length,
+         .inserted_text = source.text().substr(testcase.offset,
+                                               testcase.inserted_text.size())},
+        relex_consumer);
+    RecordingDiagnosticConsumer lex_consumer;
+    auto lexed = TokenizedBuffer::Lex(source, lex_consumer);
+
+    std::string relexed_print;
+    llvm::raw_string_ostream relexed_stream(relexed_print);
+    relexed.Print(relexed_stream);
+    std::string lexed_print;
+    llvm::raw_string_ostream lexed_stream(lexed_print);
+    lexed.Print(lexed_stream);
+    EXPECT_THAT(relexed_stream.str(), StrEq(lexed_stream.str()));
+    // Only the diagnostics of what was lexed or matched again are emitted.
+    EXPECT_THAT(relex_consumer.diagnostics,
+                IsSubsetOf(lex_consumer.diagnostics));
+    if (!previous.has_errors()) {
+      EXPECT_THAT(relexed.has_errors(), Eq(lexed.has_errors()));
+    }
+  }
+}
+
+TEST_F(LexerTest, LexStreamMatchesLex) {
+  // Long enough to be read in several pieces, with multi-line string literals
+  // and groups crossing between them.
+  std::string text;
+  for (int i = 0; i < 2000; ++i) {
+    text += llvm::formatv(
+        "fn F{0}() {\n  var s: String = \"\"\"\n  line {0}\n  \"\"\";\n"
+        "  [ 0x{0}G \"tab\\there\n",
+        i);
+  }
+  text += "\"\"\"\nunterminated";
+
+  llvm::SmallString<128> path;
+  int fd;
+  COCKTAIL_CHECK(
+      !llvm::sys::fs::createTemporaryFile("test", "cocktail", fd, path));
+  llvm::FileRemover remover(path);
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out << text;
+  }
+
+  RecordingDiagnosticConsumer stream_consumer;
+  auto stream = SourceBuffer::CreateFromStream(path, stream_consumer);
+  ASSERT_TRUE(stream);
+  int calls = 0;
+  int handed_tokens = 0;
+  auto streamed = TokenizedBuffer::LexStream(
+      *stream, stream_consumer,
+      [&](const TokenizedBuffer& buffer,
+          llvm::iterator_range<TokenizedBuffer::TokenIterator> tokens) {
+        ++calls;
+        EXPECT_TRUE(tokens.begin() == buffer.tokens().begin() + handed_tokens);
+        EXPECT_TRUE(tokens.end() == buffer.tokens().end());
+        handed_tokens = buffer.size();
+      });
+  EXPECT_FALSE(stream->is_streaming());
+  EXPECT_THAT(stream->text(), StrEq(text));
+  EXPECT_THAT(calls, Gt(1));
+  EXPECT_THAT(handed_tokens, Eq(streamed.size()));
+
+  RecordingDiagnosticConsumer lex_consumer;
+  auto lexed = Lex(text, lex_consumer);
+  std::string streamed_print;
+  llvm::raw_string_ostream streamed_stream(streamed_print);
+  streamed.Print(streamed_stream);
+  std::string lexed_print;
+  llvm::raw_string_ostream lexed_stream(lexed_print);
+  lexed.Print(lexed_stream);
+  EXPECT_THAT(streamed_stream.str(), StrEq(lexed_stream.str()));
+  EXPECT_THAT(stream_consumer.diagnostics,
+              ElementsAreArray(lex_consumer.diagnostics));
+  EXPECT_THAT(streamed.has_errors(), Eq(lexed.has_errors()));
+}
+
+TEST_F(LexerTest, SerializeRoundTrips) {
+  llvm::StringLiteral testcase =
+      "fn F() {\n  (\n  ]\n}\n) foo bar\n foo\n$$ 12 0x1G \"abc\n{\n"
+      "x = 1.5e3 12345678901234567890123 i32 \"tab\\there\" \"plain\";\n"
+      "var s: String = \"\"\"\nline one\n\"\"\";\n";
+  auto& source = GetSourceBuffer(testcase);
+  auto buffer = TokenizedBuffer::Lex(source, NullDiagnosticConsumer());
+  std::string print;
+  llvm::raw_string_ostream print_stream(print);
+  buffer.Print(print_stream);
+  std::string data;
+  llvm::raw_string_ostream data_stream(data);
+  buffer.Serialize(data_stream);
+
+  auto deserialized = TokenizedBuffer::Deserialize(source, data_stream.str());
+  ASSERT_TRUE(deserialized.hasValue());
+  std::string deserialized_print;
+  llvm::raw_string_ostream deserialized_stream(deserialized_print);
+  deserialized->Print(deserialized_stream);
+  EXPECT_THAT(deserialized_stream.str(), StrEq(print_stream.str()));
+  EXPECT_THAT(deserialized->has_errors(), Eq(buffer.has_errors()));
+  std::string reserialized;
+  llvm::raw_string_ostream reserialized_stream(reserialized);
+  deserialized->Serialize(reserialized_stream);
+  EXPECT_THAT(reserialized_stream.str(), StrEq(data_stream.str()));
+
+  // Data for other text, and truncated or corrupted data, is rejected.
+  auto& other_source = GetSourceBuffer("fn G() {}\n");
+  EXPECT_FALSE(
+      TokenizedBuffer::Deserialize(other_source, data_stream.str()).hasValue());
+  for (size_t size = 0; size < data.size(); ++size) {
+    EXPECT_FALSE(TokenizedBuffer::Deserialize(
+                     source, llvm::StringRef(data).take_front(size))
+                     .hasValue());
+  }
+  data.back() ^= 1;
+  EXPECT_FALSE(TokenizedBuffer::Deserialize(source, data).hasValue());
+}
+
+TEST_F(LexerTest, InternsIdentifiersAcrossBuffers) {
+  auto first = Lex("foo bar foo");
+  auto second = Lex("baz foo");
+  IdentifierTable table;
+  first.InternIdentifiers(table);
+  second.InternIdentifiers(table);
+  EXPECT_THAT(table.size(), Eq(3));
+
+  auto interned = [&](const TokenizedBuffer& buffer, int index) {
+    return buffer.GetInternedIdentifier(
+        buffer.GetIdentifier(buffer.tokens().begin()[index]));
+  };
+  EXPECT_TRUE(interned(first, 0) == interned(first, 2));
+  EXPECT_TRUE(interned(first, 0) == interned(second, 1));
+  EXPECT_TRUE(interned(first, 1) != interned(second, 0));
+  EXPECT_THAT(table.GetText(interned(second, 0)).str(), StrEq("baz"));
+}
+
+TEST_F(LexerTest, LexInCompilationContext) {
+  CompilationContext context;
+  auto buffer = TokenizedBuffer::Lex(GetSourceBuffer(R"(x "a\tb" y x)"),
+                                     ConsoleDiagnosticConsumer(), context);
+  EXPECT_FALSE(buffer.has_errors());
+  // The unescaped value is allocated in the context, and outlives the
+  // buffer's literal storage.
+  llvm::StringRef value = buffer.GetStringLiteral(buffer.tokens().begin()[1]);
+  EXPECT_THAT(value.str(), StrEq("a\tb"));
+  EXPECT_THAT(context.arena_bytes(), Eq(3));
+  buffer.ReleaseLiteralValues();
+  EXPECT_THAT(value.str(), StrEq("a\tb"));
+
+  // The identifiers are interned into the context's table.
+  auto interned = [&](int index) {
+    return buffer.GetInternedIdentifier(
+        buffer.GetIdentifier(buffer.tokens().begin()[index]));
+  };
+  EXPECT_THAT(context.identifiers().size(), Eq(2));
+  EXPECT_TRUE(interned(0) == interned(3));
+  EXPECT_THAT(context.identifiers().GetText(interned(2)).str(), StrEq("y"));
+}
+
+TEST_F(LexerTest, LexStats) {
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    text +=
+        "// Returns the answer.\n"
+        "fn Answer(scale: i32) -> i32 {\n"
+        "  var answer: i32 = 42;\n"
+        "  return answer * scale;\n"
+        "}\n";
+  }
+  auto buffer = Lex(text);
+  EXPECT_THAT(buffer.lex_stats().token_reallocations, Eq(0));
+  EXPECT_THAT(buffer.lex_stats().line_reallocations, Eq(0));
+  EXPECT_THAT(buffer.lex_stats().identifier_reallocations, Eq(0));
+
+  // Tokens this dense outgrow the estimate, but lines are counted exactly.
+  std::string dense_text;
+  for (int i = 0; i < 1000; ++i) {
+    dense_text += "((\n";
+  }
+  auto dense_buffer = Lex(dense_text);
+  EXPECT_THAT(dense_buffer.lex_stats().token_reallocations, Gt(0));
+  EXPECT_THAT(dense_buffer.lex_stats().line_reallocations, Eq(0));
+}
+
+TEST_F(LexerTest, ReleaseLiteralValues) {
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    text += "x = 12345678901234567890123 + 1.5e3 + \"tab\\there\";\n";
+  }
+  auto buffer = Lex(text);
+  int64_t bytes = buffer.memory_bytes();
+  int size = buffer.size();
+  EXPECT_THAT(buffer.ReleaseLiteralValues(), Gt(0));
+  EXPECT_THAT(buffer.memory_bytes(), Lt(bytes));
+  EXPECT_THAT(buffer.ReleaseLiteralValues(), Eq(0));
+
+  // Everything but the values is kept.
+  EXPECT_THAT(buffer.size(), Eq(size));
+  auto literal = buffer.tokens().begin()[2];
+  EXPECT_THAT(buffer.GetKind(literal), Eq(TokenKind::IntegerLiteral()));
+  EXPECT_THAT(buffer.GetTokenText(literal).str(),
+              StrEq("12345678901234567890123"));
+}
+
+TEST_F(LexerTest, GetMemoryUsage) {
+  auto buffer = Lex("x = 12345678901234567890123 + \"tab\\there\";\ny = x;\n");
+  MemoryUsage usage = buffer.GetMemoryUsage();
+  EXPECT_THAT(usage.allocated_bytes(), Eq(buffer.memory_bytes()));
+  llvm::SmallVector<llvm::StringRef> names;
+  for (const MemoryUsage::Entry& entry : usage.entries) {
+    names.push_back(entry.name);
+    EXPECT_THAT(entry.used, Le(entry.allocated)) << entry.name.str();
+  }
+  EXPECT_THAT(names,
+              ElementsAre("token_infos", "line_infos", "identifier_infos",
+                          "identifier_map", "interned_identifiers",
+                          "literal_int_storage", "literal_string_storage",
+                          "lazy_literal_indices"));
+  EXPECT_THAT(usage.entries[0].used, Gt(0));
+
+  // Released literal storage is no longer counted.
+  buffer.ReleaseLiteralValues();
+  EXPECT_THAT(buffer.GetMemoryUsage().entries.size(), Eq(5));
+}
+
 TEST_F(LexerTest, DiagnosticTrailingComment) {
   llvm::StringLiteral testcase = R"(
     // Hello!
@@ -1017,6 +1496,22 @@ TEST_F(LexerTest, DiagnosticUnrecognizedChar) {
   Lex("\b", consumer);
 }
 
+TEST_F(LexerTest, StopsWhenConsumerAsks) {
+  ErrorBudgetDiagnosticConsumer budget(NullDiagnosticConsumer(),
+                                       /*max_errors=*/2);
+  auto buffer = Lex("a $ b $ c $ d", budget);
+  EXPECT_TRUE(buffer.has_errors());
+  // Nothing past the second error is lexed.
+  EXPECT_THAT(buffer, HasTokens(llvm::ArrayRef<ExpectedToken>{
+                          {.kind = TokenKind::Identifier(), .text = "a"},
+                          {.kind = TokenKind::Error(), .text = "$ "},
+                          {.kind = TokenKind::Identifier(), .text = "b"},
+                          {.kind = TokenKind::Error(), .text = "$ "},
+                          {.kind = TokenKind::EndOfFile()},
+                      }));
+  budget.Flush();
+}
+
 auto GetAndDropLine(llvm::StringRef& text) -> std::string {
   auto newline_offset = text.find_first_of('\n');
   llvm::StringRef line = text.slice(0, newline_offset);
@@ -1046,6 +1541,114 @@ TEST_F(LexerTest, PrintingBasic) {
   EXPECT_TRUE(print.empty());
 }
 
+TEST_F(LexerTest, FindNextKindIn) {
+  // Enough tokens before the `;` that the scan runs over whole vectors.
+  auto buffer = Lex(
+      "a b c d e f g h i j k l m n o p q r s t ; u ( v ) ; w");
+  ASSERT_FALSE(buffer.has_errors());
+  auto begin = buffer.tokens().begin();
+  TokenKindSet semi = {TokenKind::Semi()};
+
+  EXPECT_THAT(buffer.FindNextKindIn(*begin, semi) - begin, Eq(20));
+  EXPECT_THAT(buffer.FindNextKindIn(*(begin + 20), semi) - begin, Eq(20));
+  EXPECT_THAT(buffer.FindNextKindIn(*(begin + 21), semi) - begin, Eq(25));
+  TokenKindSet semi_or_paren = {TokenKind::Semi(), TokenKind::OpenParen()};
+  EXPECT_THAT(buffer.FindNextKindIn(*(begin + 21), semi_or_paren) - begin,
+              Eq(22));
+  EXPECT_TRUE(buffer.FindNextKindIn(*(begin + 26), semi) ==
+              buffer.tokens().end());
+  EXPECT_TRUE(buffer.FindNextKindIn(*begin, TokenKindSet()) ==
+              buffer.tokens().end());
+
+  // A set too large to compare against a vector at a time still works.
+  TokenKindSet all_kinds;
+  for (TokenKind kind : AllTokenKinds) {
+    if (kind != TokenKind::Identifier()) {
+      all_kinds.Add(kind);
+    }
+  }
+  EXPECT_THAT(buffer.FindNextKindIn(*begin, all_kinds) - begin, Eq(20));
+}
+
+TEST_F(LexerTest, FindTokenAtOffset) {
+  llvm::StringRef text = "x  +\n  // comment\n  \"str\" 42";
+  auto buffer = Lex(text);
+  ASSERT_FALSE(buffer.has_errors());
+  auto begin = buffer.tokens().begin();
+  auto index_at = [&](int64_t offset) -> int {
+    auto token = buffer.FindTokenAtOffset(offset);
+    return token ? TokenizedBuffer::TokenIterator(*token) - begin : -1;
+  };
+
+  EXPECT_THAT(index_at(0), Eq(0));
+  EXPECT_THAT(index_at(1), Eq(-1));
+  EXPECT_THAT(index_at(text.find('+')), Eq(1));
+  EXPECT_THAT(index_at(text.find("comment")), Eq(-1));
+  EXPECT_THAT(index_at(text.find('"')), Eq(2));
+  EXPECT_THAT(index_at(text.find("tr")), Eq(2));
+  EXPECT_THAT(index_at(text.find("42") + 1), Eq(3));
+  EXPECT_THAT(index_at(text.size()), Eq(-1));
+}
+
+TEST_F(LexerTest, LinesAndColumnsFromOffsets) {
+  auto buffer = Lex("a b\n\n  cc\n    \"s\" 1.5\nd");
+  ASSERT_FALSE(buffer.has_errors());
+  auto position = [&](int index) -> std::pair<int, int> {
+    auto token = buffer.tokens().begin()[index];
+    return {buffer.GetLineNumber(token), buffer.GetColumnNumber(token)};
+  };
+  std::pair<int, int> positions[] = {{1, 1}, {1, 3}, {3, 3},
+                                     {4, 5}, {4, 9}, {5, 1}};
+
+  // In order, then backwards and out of order, which can't use the line found
+  // last.
+  for (int i = 0; i != 6; ++i) {
+    EXPECT_THAT(position(i), Eq(positions[i])) << i;
+  }
+  for (int i : {5, 2, 4, 0, 3, 1, 5, 0}) {
+    EXPECT_THAT(position(i), Eq(positions[i])) << i;
+  }
+  EXPECT_THAT(buffer.GetTokenText(buffer.tokens().begin()[3]).str(),
+              StrEq("\"s\""));
+  EXPECT_THAT(buffer.GetTokenText(buffer.tokens().begin()[4]).str(),
+              StrEq("1.5"));
+}
+
+TEST_F(LexerTest, Cancellation) {
+  std::string text = "(";
+  for (int i = 0; i != 10000; ++i) {
+    text += " x";
+  }
+  text += ")";
+  auto& source = GetSourceBuffer(text);
+
+  CancellationToken not_cancelled;
+  auto buffer = TokenizedBuffer::Lex(source, ConsoleDiagnosticConsumer(),
+                                     not_cancelled);
+  EXPECT_FALSE(buffer.cancelled());
+  EXPECT_FALSE(buffer.has_errors());
+  EXPECT_THAT(buffer.size(), Eq(10003));
+
+  // Both a cancelled token and a passed deadline stop lexing within a few
+  // hundred tokens. The group left open is closed without a diagnostic.
+  CancellationToken cancelled;
+  cancelled.Cancel();
+  CancellationToken passed(CancellationToken::Clock::now());
+  for (const CancellationToken* cancellation : {&cancelled, &passed}) {
+    RecordingDiagnosticConsumer consumer;
+    buffer = TokenizedBuffer::Lex(source, consumer, *cancellation);
+    EXPECT_TRUE(buffer.cancelled());
+    EXPECT_FALSE(buffer.has_errors());
+    EXPECT_THAT(consumer.diagnostics, ElementsAre());
+    EXPECT_THAT(buffer.size(), Lt(1000));
+    auto open_paren = *buffer.tokens().begin();
+    auto close_paren = buffer.tokens().end()[-2];
+    EXPECT_THAT(buffer.GetMatchedClosingToken(open_paren), Eq(close_paren));
+    EXPECT_THAT(buffer.GetKind(buffer.tokens().end()[-1]),
+                Eq(TokenKind::EndOfFile()));
+  }
+}
+
 TEST_F(LexerTest, PrintingInteger) {
   auto buffer = Lex("123");
   ASSERT_FALSE(buffer.has_errors());
@@ -0,0 +1,66 @@
+#include "Cocktail/Lexer/UnicodeIdentifier.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace Cocktail;
+
+TEST(UnicodeIdentifierTest, Properties) {
+  for (char c = 'a'; c <= 'z'; ++c) {
+    EXPECT_TRUE(IsXidStart(c));
+    EXPECT_TRUE(IsXidContinue(c));
+  }
+  EXPECT_FALSE(IsXidStart('_'));
+  EXPECT_TRUE(IsXidContinue('_'));
+  EXPECT_FALSE(IsXidStart('7'));
+  EXPECT_TRUE(IsXidContinue('7'));
+  EXPECT_FALSE(IsXidContinue(' '));
+
+  // Letters of other scripts: Latin, Cyrillic, Greek, CJK, Katakana, Hangul
+  // and CJK past the Basic Multilingual Plane.
+  for (char32_t c : {0xE9, 0xDF, 0x416, 0x3BB, 0x4E2D, 0x6587, 0x30A2,
+                     0xD55C, 0x20000, 0x30000}) {
+    EXPECT_TRUE(IsXidStart(c)) << static_cast<uint32_t>(c);
+    EXPECT_TRUE(IsXidContinue(c)) << static_cast<uint32_t>(c);
+  }
+  // Combining marks, digits and variation selectors only continue
+  // identifiers.
+  for (char32_t c : {0x301, 0x663, 0x93F, 0xE0100}) {
+    EXPECT_FALSE(IsXidStart(c)) << static_cast<uint32_t>(c);
+    EXPECT_TRUE(IsXidContinue(c)) << static_cast<uint32_t>(c);
+  }
+  // Spaces, symbols, unassigned and invalid code points are neither.
+  for (char32_t c : {0xA0, 0x3000, 0x20AC, 0x2192, 0x1F600, 0xE01F0,
+                     0x10FFFF, 0x110000}) {
+    EXPECT_FALSE(IsXidStart(c)) << static_cast<uint32_t>(c);
+    EXPECT_FALSE(IsXidContinue(c)) << static_cast<uint32_t>(c);
+  }
+}
+
+TEST(UnicodeIdentifierTest, Match) {
+  EXPECT_EQ(MatchUnicodeIdentifierChar("\xC3\xA9", /*at_start=*/true), 2);
+  EXPECT_EQ(MatchUnicodeIdentifierChar("\xE4\xB8\xAD\xE6\x96\x87",
+                                       /*at_start=*/true),
+            3);
+  EXPECT_EQ(MatchUnicodeIdentifierChar("\xF0\xA0\x80\x80x",
+                                       /*at_start=*/true),
+            4);
+  // U+0301, a combining acute accent.
+  EXPECT_EQ(MatchUnicodeIdentifierChar("\xCC\x81", /*at_start=*/true), 0);
+  EXPECT_EQ(MatchUnicodeIdentifierChar("\xCC\x81", /*at_start=*/false), 2);
+  // U+20AC, the euro sign.
+  EXPECT_EQ(MatchUnicodeIdentifierChar("\xE2\x82\xAC", /*at_start=*/false),
+            0);
+  EXPECT_EQ(MatchUnicodeIdentifierChar("", /*at_start=*/false), 0);
+
+  // Invalid UTF-8 never matches: a continuation byte on its own, a truncated
+  // sequence, an overlong encoding and an encoded surrogate.
+  for (llvm::StringRef text :
+       {"\xA9", "\xC3", "\xE4\xB8", "\xC1\xA1", "\xED\xA0\x80"}) {
+    EXPECT_EQ(MatchUnicodeIdentifierChar(text, /*at_start=*/false), 0);
+  }
+}
+
+}  // namespace
@@ -0,0 +1,75 @@
+#include "Cocktail/Testing/FastPaths.t.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "Cocktail/Common/TaskScheduler.h"
+#include "llvm/Support/FormatVariadic.h"
+
+namespace {
+
+using namespace Cocktail;
+using namespace Cocktail::Testing;
+
+// Checks every fast path on `text` with chunk sizes that split it in many
+// places, and with an edit starting at each line.
+void ExpectSameAsSerial(llvm::StringRef text) {
+  TaskScheduler scheduler(2);
+  for (int64_t chunk_size : {1, 7, 64}) {
+    for (size_t offset = 0; offset <= text.size();
+         offset = text.find('\n', offset) + 1) {
+      FastPathOptions options = {
+          .lex_chunk_size = chunk_size,
+          .parse_chunk_size = static_cast<int>(chunk_size),
+          .edit_offset = static_cast<int64_t>(offset),
+          .edit_length = static_cast<int64_t>(chunk_size)};
+      SCOPED_TRACE(llvm::formatv("chunk size: {0}, edit at: {1}", chunk_size,
+                                 offset)
+                       .str());
+      for (const FastPathDifference& difference :
+           CompareFastPaths(text, scheduler, options)) {
+        ADD_FAILURE() << difference.fast_path << " differs at "
+                      << difference.difference;
+      }
+      if (text.find('\n', offset) == llvm::StringRef::npos) {
+        break;
+      }
+    }
+  }
+}
+
+TEST(FastPathsTest, Declarations) {
+  ExpectSameAsSerial(
+      "fn F(a: i32, b: i32) -> i32 {\n"
+      "  var x: i32 = a + b * 2;\n"
+      "  if (x) { return (x + 1) * 2; }\n"
+      "  while (x < 10) { x = x + 1; }\n"
+      "  return x;\n"
+      "}\n"
+      "var s: String = \"tab\\there\";\n"
+      "fn G() -> f64 { return 1.5e3; }\n");
+}
+
+TEST(FastPathsTest, MultiLineStrings) {
+  ExpectSameAsSerial(
+      "var s: String = \"\"\"\n"
+      "  line one\n"
+      "  fn ( {\n"
+      "  \"\"\";\n"
+      "fn F() { return s; }\n");
+}
+
+TEST(FastPathsTest, Errors) {
+  ExpectSameAsSerial(
+      "fn F() {\n"
+      "  var x: = ;\n"
+      "  [ ( \n"
+      "  ) ]\n"
+      "}}\n"
+      "var y: i32 = 0x1G + 123456789012345678901234567890;\n"
+      "fn G(\n"
+      "\"unterminated\n");
+}
+
+}  // namespace
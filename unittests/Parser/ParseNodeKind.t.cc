@@ -10,9 +10,12 @@ namespace {
 
 using namespace Cocktail;
 
-#define COCKTAIL_PARSE_NODE_KIND(Name)              \
-  TEST(ParseNodeKindTest, Name) {                   \
-    EXPECT_EQ(#Name, ParseNodeKind::Name().name()); \
+#define COCKTAIL_PARSE_NODE_KIND(Name)                                        \
+  TEST(ParseNodeKindTest, Name) {                                             \
+    EXPECT_EQ(#Name, ParseNodeKind::Name().name());                           \
+    EXPECT_LT(ParseNodeKind::Name().AsInt(), ParseNodeKind::NumKinds);        \
+    EXPECT_TRUE(ParseNodeKind::FromInt(ParseNodeKind::Name().AsInt()) ==      \
+                ParseNodeKind::Name());                                       \
   }
 #include "Cocktail/Parser/ParseNodeKind.def"
 
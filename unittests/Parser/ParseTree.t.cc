@@ -4,8 +4,15 @@
 #include <gtest/gtest.h>
 
 #include <forward_list>
+#include <iterator>
+#include <string>
+#include <vector>
 
+#include "Cocktail/Common/Cancellation.h"
+#include "Cocktail/Common/TaskScheduler.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Diagnostics/ErrorBudgetDiagnosticConsumer.h"
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
 #include "Cocktail/Lexer/TokenizedBuffer.h"
 #include "Cocktail/Parser/ParseNodeKind.h"
 #include "Cocktail/Testing/Mocks.t.h"
@@ -13,6 +20,7 @@
 #include "Cocktail/Testing/TokenizedBuffer.t.h"
 #include "Cocktail/Testing/Yaml.t.h"
 #include "llvm/ADT/Sequence.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/YAMLParser.h"
 
@@ -23,6 +31,7 @@ using namespace Cocktail::Testing;
 
 using ::testing::AtLeast;
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
 using ::testing::Eq;
 using ::testing::Ne;
 using ::testing::StrEq;
@@ -131,6 +140,19 @@ TEST_F(ParseTreeTest, JustFunctionIntroducerAndSemi) {
                                          MatchFileEnd()}));
 }
 
+TEST_F(ParseTreeTest, StopsWhenConsumerAsks) {
+  TokenizedBuffer tokens = GetTokenizedBuffer("fn;\nfn;\nfn F();");
+  ErrorBudgetDiagnosticConsumer budget(NullDiagnosticConsumer(),
+                                       /*max_errors=*/1);
+  ParseTree tree = ParseTree::Parse(tokens, budget);
+  EXPECT_TRUE(tree.has_errors());
+  // The declarations after the first error are skipped.
+  EXPECT_THAT(tree, MatchParseTreeNodes({MatchFunctionDeclaration(
+                                             HasError, MatchDeclarationEnd()),
+                                         MatchFileEnd()}));
+  budget.Flush();
+}
+
 TEST_F(ParseTreeTest, RepeatedFunctionIntroducerAndSemi) {
   TokenizedBuffer tokens = GetTokenizedBuffer("fn fn;");
   ParseTree tree = ParseTree::Parse(tokens, consumer);
@@ -240,6 +262,50 @@ TEST_F(ParseTreeTest, FunctionDefinitionWithReturnType) {
                    MatchFileEnd()}));
 }
 
+TEST_F(ParseTreeTest, SkippedFunctionBodies) {
+  TokenizedBuffer tokens = GetTokenizedBuffer(
+      "fn foo() -> f64 {\n"
+      "  return 42;\n"
+      "}\n"
+      "fn bar() { var; }\n"
+      "fn baz();");
+  ParseTree tree =
+      ParseTree::Parse(tokens, consumer, ParseTree::NodeStorage::Reserved,
+                       ParseTree::FunctionBodies::Skipped);
+  // Nothing in a skipped body is diagnosed.
+  EXPECT_FALSE(tree.has_errors());
+  EXPECT_THAT(tree,
+              MatchParseTreeNodes(
+                  {MatchFunctionDeclaration(
+                       MatchDeclaredName("foo"), MatchParameters(),
+                       MatchReturnType(MatchLiteral("f64")),
+                       MatchSkippedCodeBlock("{")),
+                   MatchFunctionDeclaration(MatchDeclaredName("bar"),
+                                            MatchParameters(),
+                                            MatchSkippedCodeBlock("{")),
+                   MatchFunctionDeclaration(MatchDeclaredName("baz"),
+                                            MatchParameters(),
+                                            MatchDeclarationEnd()),
+                   MatchFileEnd()}));
+
+  llvm::SmallVector<ParseTree::Node> bodies;
+  for (ParseTree::Node n : tree.postorder()) {
+    if (tree.node_kind(n) == ParseNodeKind::SkippedCodeBlock()) {
+      bodies.push_back(n);
+    }
+  }
+  ASSERT_THAT(bodies.size(), Eq(2));
+  ParseTree foo_body = tree.ParseSkippedCodeBlock(bodies[0], consumer);
+  EXPECT_FALSE(foo_body.has_errors());
+  EXPECT_THAT(foo_body, MatchParseTreeNodes({MatchCodeBlock(
+                            MatchReturnStatement(MatchLiteral("42"),
+                                                 MatchStatementEnd()),
+                            MatchCodeBlockEnd())}));
+  ParseTree bar_body =
+      tree.ParseSkippedCodeBlock(bodies[1], NullDiagnosticConsumer());
+  EXPECT_TRUE(bar_body.has_errors());
+}
+
 TEST_F(ParseTreeTest, FunctionDeclarationWithSingleIdentifierParameterList) {
   TokenizedBuffer tokens = GetTokenizedBuffer("fn foo(bar);");
   ParseTree tree = ParseTree::Parse(tokens, consumer);
@@ -1256,33 +1322,33 @@ TEST_F(ParseTreeTest, ParenMatchRegression) {
                  MatchFileEnd()}));
 }
 
-TEST_F(ParseTreeTest, RecursionLimit) {
+TEST_F(ParseTreeTest, DeepNesting) {
+  // Nesting is limited only by memory, so this is far too deep for a parser
+  // that recursed for each level.
+  constexpr int Depth = 100000;
   std::string code = "fn Foo() { return ";
-  code.append(10000, '(');
-  code.append(10000, ')');
-  code += "; }";
+  code.append(Depth, '(');
+  code.append(Depth, ')');
+  code += "; ";
+  for (int i = 0; i < Depth; ++i) {
+    code += "if (x) {";
+  }
+  code.append(Depth, '}');
+  code += " }";
   TokenizedBuffer tokens = GetTokenizedBuffer(code);
   ASSERT_FALSE(tokens.has_errors());
-  Testing::MockDiagnosticConsumer consumer;
-  // Recursion might be exceeded multiple times due to quirks in parse tree
-  // handling; we only need to be sure it's hit at least once for test
-  // correctness.
-  EXPECT_CALL(consumer, HandleDiagnostic(IsDiagnosticMessage(
-                            llvm::formatv("Exceeded recursion limit ({0})",
-                                          ParseTree::StackDepthLimit)
-                                .str())))
-      .Times(AtLeast(1));
   ParseTree tree = ParseTree::Parse(tokens, consumer);
-  EXPECT_TRUE(tree.has_errors());
+  EXPECT_FALSE(tree.has_errors());
+  EXPECT_THAT(tree.size(), Eq(tokens.size()));
 }
 
 TEST_F(ParseTreeTest, ParsePostfixExpressionRegression) {
-  // Stack depth errors could cause ParsePostfixExpression to infinitely loop
-  // when calling children and those children error. Because of the fragility of
-  // stack depth, this tries a few different values.
+  // An error in the operand of a call could cause postfix expression parsing
+  // to loop forever without consuming any tokens. This tries a few different
+  // nesting depths.
   for (int n = 0; n <= 10; ++n) {
     std::string code = "var x: auto = ";
-    code.append(ParseTree::StackDepthLimit - n, '*');
+    code.append(200 - n, '*');
     code += "(z);";
     TokenizedBuffer tokens = GetTokenizedBuffer(code);
     ASSERT_FALSE(tokens.has_errors());
@@ -1291,4 +1357,477 @@ TEST_F(ParseTreeTest, ParsePostfixExpressionRegression) {
   }
 }
 
+// Records each diagnostic as `line:column: message`.
+class RecordingDiagnosticConsumer : public DiagnosticConsumer {
+ public:
+  auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+    const DiagnosticMessage& message = diagnostic.message;
+    diagnostics.push_back(llvm::formatv("{0}:{1}: {2}",
+                                        message.location().line_number,
+                                        message.location().column_number,
+                                        message.format_fn(message)));
+  }
+
+  std::vector<std::string> diagnostics;
+};
+
+TEST_F(ParseTreeTest, ParallelParseMatchesSerial) {
+  llvm::StringLiteral testcases[] = {
+      "fn F() {\n  var x: i32 = 42;\n  return x;\n}\nfn G() { F(); }\n"
+      "var y: i32 = (1, {.a = 2});\n;\nfn H(a: i32) -> i32;\n",
+      // Declarations with errors, some of which recover past where the next
+      // chunk starts.
+      "fn F( {\n}\nfn G() { return }\nvar x: i32 = 1 fn H() {}\n"
+      "3 + 4;\nvar y: = fn;\nvar z: i32 = 5;\nfoo bar\n",
+  };
+  TaskScheduler scheduler;
+  for (llvm::StringLiteral testcase : testcases) {
+    TokenizedBuffer& tokens = GetTokenizedBuffer(testcase);
+    RecordingDiagnosticConsumer serial_consumer;
+    ParseTree serial = ParseTree::Parse(tokens, serial_consumer);
+    std::string serial_print;
+    llvm::raw_string_ostream serial_stream(serial_print);
+    serial.Print(serial_stream);
+
+    // Try every split, from a chunk per declaration to a single chunk.
+    for (int chunk_size = 1; chunk_size <= tokens.size(); ++chunk_size) {
+      SCOPED_TRACE(llvm::formatv("chunk_size: {0}", chunk_size).str());
+      RecordingDiagnosticConsumer parallel_consumer;
+      ParseTree parallel =
+          ParseTree::Parse(tokens, parallel_consumer, scheduler, chunk_size);
+      std::string parallel_print;
+      llvm::raw_string_ostream parallel_stream(parallel_print);
+      parallel.Print(parallel_stream);
+      EXPECT_THAT(parallel_stream.str(), StrEq(serial_stream.str()));
+      EXPECT_THAT(parallel_consumer.diagnostics,
+                  ElementsAreArray(serial_consumer.diagnostics));
+      EXPECT_THAT(parallel.has_errors(), Eq(serial.has_errors()));
+    }
+  }
+}
+
+TEST_F(ParseTreeTest, ReparseMatchesParse) {
+  struct Testcase {
+    llvm::StringLiteral before;
+    llvm::StringLiteral after;
+    ParseTree::TokenEdit edit;
+  };
+  Testcase testcases[] = {
+      // An edit inside a code block, which is all that is parsed again.
+      {.before = "fn F() {\n  if (x) {\n    y;\n  }\n}\nvar z: i32 = 1;\n",
+       .after = "fn F() {\n  if (x) {\n    y = f(1, 2);\n  }\n}\n"
+                "var z: i32 = 1;\n",
+       .edit = {.first_token = 10, .removed_count = 2, .inserted_count = 9}},
+      // An edit outside any code block, where the declarations are parsed
+      // again up to the next one, which is reused.
+      {.before = "fn F() {\n  y;\n}\nfn G() {}\n",
+       .after = "fn F(a: i32) {\n  y;\n}\nfn G() {}\n",
+       .edit = {.first_token = 0, .removed_count = 5, .inserted_count = 8}},
+      // An edit that leaves a declaration without its `;`.
+      {.before = "var x: i32 = 1;\nvar y: i32 = 2;\nfn G() {}\n",
+       .after = "var x: i32 = 1\nvar y: i32 = 2;\nfn G() {}\n",
+       .edit = {.first_token = 0, .removed_count = 7, .inserted_count = 6}},
+  };
+  for (const Testcase& testcase : testcases) {
+    SCOPED_TRACE(testcase.after);
+    TokenizedBuffer& before_tokens = GetTokenizedBuffer(testcase.before);
+    ParseTree before = ParseTree::Parse(before_tokens, consumer);
+    ASSERT_FALSE(before.has_errors());
+    TokenizedBuffer& after_tokens = GetTokenizedBuffer(testcase.after);
+    RecordingDiagnosticConsumer parse_consumer;
+    ParseTree parsed = ParseTree::Parse(after_tokens, parse_consumer);
+    std::string parsed_print;
+    llvm::raw_string_ostream parsed_stream(parsed_print);
+    parsed.Print(parsed_stream);
+
+    RecordingDiagnosticConsumer reparse_consumer;
+    ParseTree reparsed = ParseTree::Reparse(before, after_tokens, testcase.edit,
+                                            reparse_consumer);
+    std::string reparsed_print;
+    llvm::raw_string_ostream reparsed_stream(reparsed_print);
+    reparsed.Print(reparsed_stream);
+    EXPECT_THAT(reparsed_stream.str(), StrEq(parsed_stream.str()));
+    EXPECT_THAT(reparse_consumer.diagnostics,
+                ElementsAreArray(parse_consumer.diagnostics));
+    EXPECT_THAT(reparsed.has_errors(), Eq(parsed.has_errors()));
+  }
+}
+
+TEST_F(ParseTreeTest, ComputeTokenEdit) {
+  // Replacing `y;` with two lines changes only the tokens on its line.
+  llvm::StringLiteral before = "fn F() {\n  if (x) {\n    y;\n  }\n}\n";
+  TokenizedBuffer& before_tokens = GetTokenizedBuffer(before);
+  TokenizedBuffer& after_tokens = GetTokenizedBuffer(
+      "fn F() {\n  if (x) {\n    y = 1;\n    z;\n  }\n}\n");
+  llvm::Optional<ParseTree::TokenEdit> edit = ParseTree::ComputeTokenEdit(
+      before_tokens, after_tokens, before,
+      {.offset = static_cast<int64_t>(before.find('y')),
+       .removed_length = 2,
+       .inserted_text = "y = 1;\n    z;"});
+  ASSERT_TRUE(edit.hasValue());
+  EXPECT_THAT(edit->first_token, Eq(10));
+  EXPECT_THAT(edit->removed_count, Eq(2));
+  EXPECT_THAT(edit->inserted_count, Eq(6));
+
+  // An edit on the line of the end of file token leaves nothing after it.
+  llvm::StringLiteral last_line = "var x: i32 = 1;";
+  TokenizedBuffer& last_line_tokens = GetTokenizedBuffer(last_line);
+  TokenizedBuffer& appended_tokens = GetTokenizedBuffer("var x: i32 = 12;");
+  EXPECT_FALSE(ParseTree::ComputeTokenEdit(
+                   last_line_tokens, appended_tokens, last_line,
+                   {.offset = 14, .removed_length = 0, .inserted_text = "2"})
+                   .hasValue());
+}
+
+TEST_F(ParseTreeTest, Parent) {
+  TokenizedBuffer& tokens = GetTokenizedBuffer(
+      "fn F(a: i32) -> i32 {\n"
+      "  if (a) { return (a + 1) * 2; }\n"
+      "  return a;\n"
+      "}\n"
+      "var x: i32 = F(1);\n");
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_FALSE(tree.has_errors());
+  for (ParseTree::Node root : tree.roots()) {
+    EXPECT_FALSE(tree.parent(root).hasValue());
+  }
+  int children = 0;
+  for (ParseTree::Node n : tree.postorder()) {
+    for (ParseTree::Node child : tree.children(n)) {
+      EXPECT_TRUE(tree.parent(child) == n);
+      ++children;
+    }
+  }
+  // Every node other than a root is some node's child.
+  int roots = std::distance(tree.roots().begin(), tree.roots().end());
+  EXPECT_THAT(children + roots, Eq(tree.size()));
+}
+
+TEST_F(ParseTreeTest, SubtreeHash) {
+  // `G` is the same declaration in both files, at different positions.
+  TokenizedBuffer& before = GetTokenizedBuffer(
+      "fn F() { a; }\n"
+      "fn G(x: i32) { (x + 1) * 2; }\n");
+  TokenizedBuffer& after = GetTokenizedBuffer(
+      "fn F() {\n  a;\n  b(1, 2);\n}\n"
+      "fn G(x: i32) { (x + 1) * 2; }\n");
+  ParseTree before_tree = ParseTree::Parse(before, consumer);
+  ParseTree after_tree = ParseTree::Parse(after, consumer);
+  auto declarations = [](const ParseTree& tree) {
+    // Roots are visited last to first, after the end of file.
+    std::vector<ParseTree::Node> roots(tree.roots().begin(),
+                                       tree.roots().end());
+    return std::vector<ParseTree::Node>(roots.rbegin(), roots.rend() - 1);
+  };
+  std::vector<ParseTree::Node> before_decls = declarations(before_tree);
+  std::vector<ParseTree::Node> after_decls = declarations(after_tree);
+  ASSERT_THAT(before_decls.size(), Eq(2));
+  ASSERT_THAT(after_decls.size(), Eq(2));
+  EXPECT_THAT(before_tree.subtree_hash(before_decls[1]),
+              Eq(after_tree.subtree_hash(after_decls[1])));
+  EXPECT_THAT(before_tree.subtree_hash(before_decls[0]),
+              Ne(after_tree.subtree_hash(after_decls[0])));
+
+  // Renaming a parameter, or nesting the same tokens differently, changes
+  // the hash.
+  for (llvm::StringLiteral text : {"fn G(y: i32) { (x + 1) * 2; }\n",
+                                   "fn G(x: i32) { x + (1 * 2); }\n"}) {
+    ParseTree tree = ParseTree::Parse(GetTokenizedBuffer(text), consumer);
+    EXPECT_THAT(tree.subtree_hash(declarations(tree)[0]),
+                Ne(before_tree.subtree_hash(before_decls[1])));
+  }
+}
+
+TEST_F(ParseTreeTest, FindNodeAtOffset) {
+  llvm::StringRef text = "fn F() {\n  (a + b);\n}\n";
+  TokenizedBuffer& tokens = GetTokenizedBuffer(text);
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_FALSE(tree.has_errors());
+
+  auto kind_at = [&](int64_t offset) -> llvm::Optional<ParseNodeKind> {
+    if (auto n = tree.FindNodeAtOffset(offset)) {
+      return tree.node_kind(*n);
+    }
+    return llvm::None;
+  };
+  EXPECT_TRUE(kind_at(text.find('a')) == ParseNodeKind::NameReference());
+  EXPECT_TRUE(kind_at(text.find('+')) == ParseNodeKind::InfixOperator());
+  EXPECT_TRUE(kind_at(text.find('(', 5)) == ParseNodeKind::ParenExpression());
+  EXPECT_TRUE(kind_at(text.find(')', 6)) ==
+              ParseNodeKind::ParenExpressionEnd());
+  EXPECT_TRUE(kind_at(text.find('{')) == ParseNodeKind::CodeBlock());
+  EXPECT_TRUE(kind_at(text.find(';')) == ParseNodeKind::ExpressionStatement());
+  EXPECT_TRUE(kind_at(text.find('F')) == ParseNodeKind::DeclaredName());
+  // Whitespace isn't in any token.
+  EXPECT_FALSE(kind_at(text.find(' ')).hasValue());
+
+  // Every token with a node of its own is covered by that node.
+  for (ParseTree::Node n : tree.postorder()) {
+    auto innermost = tree.FindInnermostNode(tree.node_token(n));
+    ASSERT_TRUE(innermost.hasValue());
+    EXPECT_TRUE(tree.node_token(*innermost) == tree.node_token(n));
+  }
+}
+
+TEST_F(ParseTreeTest, VerifyInParallelAndSampled) {
+  // Enough declarations that verifying splits them into several tasks.
+  std::string text;
+  for (int i = 0; i != 2000; ++i) {
+    text += llvm::formatv("fn F{0}(a: i32) -> i32 {{ return (a + {0}) * 2; }\n"
+                          "var x{0}: i32 = F{0}(1);\n",
+                          i);
+  }
+  TokenizedBuffer& tokens = GetTokenizedBuffer(text);
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_FALSE(tree.has_errors());
+  TaskScheduler scheduler;
+  EXPECT_TRUE(tree.Verify(scheduler));
+  EXPECT_TRUE(tree.Verify(/*sampling_rate=*/0.0));
+  EXPECT_TRUE(tree.Verify(/*sampling_rate=*/0.1));
+  EXPECT_TRUE(tree.Verify(/*sampling_rate=*/1.0));
+}
+
+TEST_F(ParseTreeTest, PrintNdjson) {
+  TokenizedBuffer& tokens = GetTokenizedBuffer("var s: Str = \"a\\\"b\"\n");
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  std::string print;
+  llvm::raw_string_ostream print_stream(print);
+  tree.Print(print_stream, ParseTree::PrintFormat::Ndjson);
+  EXPECT_THAT(
+      print_stream.str(),
+      StrEq(R"({"node_index":0,"kind":"DeclaredName","text":"s","token":1,)"
+            R"("subtree_size":1})"
+            "\n"
+            R"({"node_index":1,"kind":"NameReference","text":"Str","token":3,)"
+            R"("subtree_size":1})"
+            "\n"
+            R"({"node_index":2,"kind":"PatternBinding","text":":","token":2,)"
+            R"("subtree_size":3})"
+            "\n"
+            R"({"node_index":3,"kind":"Literal","text":"\"a\\\"b\"",)"
+            R"("token":5,"subtree_size":1})"
+            "\n"
+            R"({"node_index":4,"kind":"VariableInitializer","text":"=",)"
+            R"("token":4,"subtree_size":2})"
+            "\n"
+            R"({"node_index":5,"kind":"VariableDeclaration","text":"var",)"
+            R"("token":0,"subtree_size":6,"has_error":true})"
+            "\n"
+            R"({"node_index":6,"kind":"FileEnd","text":"","token":6,)"
+            R"("subtree_size":1})"
+            "\n"));
+}
+
+TEST_F(ParseTreeTest, SerializeRoundTrips) {
+  TokenizedBuffer& tokens = GetTokenizedBuffer(
+      "fn F(a: i32) -> i32 { return -a * (a + 1); }\n"
+      "var x: i32 = F(1)\n"
+      "fn G() { if (x) { F(x); } }\n");
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_TRUE(tree.has_errors());
+  std::string print;
+  llvm::raw_string_ostream print_stream(print);
+  tree.Print(print_stream);
+  std::string data;
+  llvm::raw_string_ostream data_stream(data);
+  tree.Serialize(data_stream);
+
+  auto deserialized = ParseTree::Deserialize(tokens, data_stream.str());
+  ASSERT_TRUE(deserialized.hasValue());
+  EXPECT_TRUE(deserialized->Verify());
+  EXPECT_THAT(deserialized->has_errors(), Eq(tree.has_errors()));
+  std::string deserialized_print;
+  llvm::raw_string_ostream deserialized_stream(deserialized_print);
+  deserialized->Print(deserialized_stream);
+  EXPECT_THAT(deserialized_stream.str(), StrEq(print_stream.str()));
+  std::string reserialized;
+  llvm::raw_string_ostream reserialized_stream(reserialized);
+  deserialized->Serialize(reserialized_stream);
+  EXPECT_THAT(reserialized_stream.str(), StrEq(data_stream.str()));
+
+  // Data for other tokens, even with the same number of them, and truncated or
+  // corrupted data, is rejected.
+  TokenizedBuffer& other_tokens = GetTokenizedBuffer(
+      "fn F(a: i32) -> i32 { return -a * (a - 1); }\n"
+      "var x: i32 = F(1)\n"
+      "fn G() { if (x) { F(x); } }\n");
+  EXPECT_FALSE(
+      ParseTree::Deserialize(other_tokens, data_stream.str()).hasValue());
+  for (size_t size = 0; size < data.size(); ++size) {
+    EXPECT_FALSE(
+        ParseTree::Deserialize(tokens, llvm::StringRef(data).take_front(size))
+            .hasValue());
+  }
+  data.back() ^= 1;
+  EXPECT_FALSE(ParseTree::Deserialize(tokens, data).hasValue());
+}
+
+TEST_F(ParseTreeTest, ElidedSeparators) {
+  TokenizedBuffer& tokens = GetTokenizedBuffer(
+      "fn F(a: i32, b: (i32, i32)) -> i32 { return G(a, (b)); }\n"
+      "var t: (i32, i32) = (1, 2,);\n"
+      "var s: {.a: i32} = {.a = F(1, (2, 3)),};\n");
+  ParseTree kept = ParseTree::Parse(tokens, consumer);
+  ParseTree elided =
+      ParseTree::Parse(tokens, consumer, ParseTree::NodeStorage::Reserved,
+                       ParseTree::FunctionBodies::Parsed,
+                       ParseTree::Separators::Elided);
+  EXPECT_FALSE(elided.has_errors());
+  EXPECT_TRUE(elided.Verify());
+  EXPECT_THAT(elided.separators(), Eq(ParseTree::Separators::Elided));
+
+  // The elided tree is the kept one without the separators, in the same
+  // order.
+  auto is_separator = [](ParseNodeKind kind) {
+    return kind == ParseNodeKind::ParameterListComma() ||
+           kind == ParseNodeKind::ParameterListEnd() ||
+           kind == ParseNodeKind::TupleLiteralComma() ||
+           kind == ParseNodeKind::TupleLiteralEnd() ||
+           kind == ParseNodeKind::ParenExpressionEnd() ||
+           kind == ParseNodeKind::CallExpressionComma() ||
+           kind == ParseNodeKind::CallExpressionEnd() ||
+           kind == ParseNodeKind::StructComma() ||
+           kind == ParseNodeKind::StructEnd();
+  };
+  std::vector<std::pair<ParseNodeKind, TokenizedBuffer::Token>> expected;
+  for (ParseTree::Node n : kept.postorder()) {
+    if (!is_separator(kept.node_kind(n))) {
+      expected.push_back({kept.node_kind(n), kept.node_token(n)});
+    }
+  }
+  std::vector<std::pair<ParseNodeKind, TokenizedBuffer::Token>> actual;
+  std::vector<ParseTree::Node> trailing;
+  for (ParseTree::Node n : elided.postorder()) {
+    actual.push_back({elided.node_kind(n), elided.node_token(n)});
+    if (elided.node_has_trailing_separator(n)) {
+      trailing.push_back(n);
+    }
+  }
+  EXPECT_THAT(actual, ElementsAreArray(expected));
+  EXPECT_THAT(elided.size(), Eq(static_cast<int>(expected.size())));
+
+  // Only the tuple and struct literals with trailing commas are flagged.
+  ASSERT_THAT(trailing.size(), Eq(2));
+  EXPECT_THAT(elided.node_kind(trailing[0]),
+              Eq(ParseNodeKind::TupleLiteral()));
+  EXPECT_THAT(elided.node_kind(trailing[1]),
+              Eq(ParseNodeKind::StructLiteral()));
+  for (ParseTree::Node n : kept.postorder()) {
+    EXPECT_FALSE(kept.node_has_trailing_separator(n));
+  }
+
+  // Serializing and parsing in parallel keep the mode and the flags.
+  std::string print;
+  llvm::raw_string_ostream print_stream(print);
+  elided.Print(print_stream);
+  std::string data;
+  llvm::raw_string_ostream data_stream(data);
+  elided.Serialize(data_stream);
+  auto deserialized = ParseTree::Deserialize(tokens, data_stream.str());
+  ASSERT_TRUE(deserialized.hasValue());
+  EXPECT_THAT(deserialized->separators(), Eq(ParseTree::Separators::Elided));
+  std::string deserialized_print;
+  llvm::raw_string_ostream deserialized_stream(deserialized_print);
+  deserialized->Print(deserialized_stream);
+  EXPECT_THAT(deserialized_stream.str(), StrEq(print_stream.str()));
+
+  TaskScheduler scheduler(4);
+  ParseTree parallel = ParseTree::Parse(
+      tokens, consumer, scheduler, /*chunk_size=*/1,
+      ParseTree::NodeStorage::Reserved, ParseTree::FunctionBodies::Parsed,
+      ParseTree::Separators::Elided);
+  std::string parallel_print;
+  llvm::raw_string_ostream parallel_stream(parallel_print);
+  parallel.Print(parallel_stream);
+  EXPECT_THAT(parallel_stream.str(), StrEq(print_stream.str()));
+}
+
+TEST_F(ParseTreeTest, ParseWithScratchSpace) {
+  // Nesting deep enough that the parser's state stack outgrows its inline
+  // storage.
+  std::string text;
+  for (int i = 0; i != 100; ++i) {
+    text += llvm::formatv("fn F{0}() {{ return {1}{0}{2}; }\n", i,
+                          std::string(20, '('), std::string(20, ')'));
+  }
+  TokenizedBuffer& tokens = GetTokenizedBuffer(text);
+  ParseTree expected = ParseTree::Parse(tokens, consumer);
+  std::string expected_print;
+  llvm::raw_string_ostream expected_stream(expected_print);
+  expected.Print(expected_stream);
+
+  ParseTree::ScratchSpace scratch;
+  for (auto node_storage :
+       {ParseTree::NodeStorage::Reserved, ParseTree::NodeStorage::ShrinkToFit,
+        ParseTree::NodeStorage::Reserved}) {
+    ParseTree tree = ParseTree::Parse(tokens, consumer, scratch, node_storage);
+    EXPECT_FALSE(tree.has_errors());
+    EXPECT_THAT(tree.parse_stats().node_reallocations, Eq(0));
+    std::string print;
+    llvm::raw_string_ostream print_stream(print);
+    tree.Print(print_stream);
+    EXPECT_THAT(print_stream.str(), StrEq(expected_stream.str()));
+    scratch.Recycle(std::move(tree));
+  }
+}
+
+TEST_F(ParseTreeTest, Cancellation) {
+  TokenizedBuffer& tokens = GetTokenizedBuffer("fn F() {}\nfn G( {}\n");
+  CancellationToken not_cancelled;
+  ParseTree tree =
+      ParseTree::Parse(tokens, NullDiagnosticConsumer(), not_cancelled);
+  EXPECT_FALSE(tree.cancelled());
+  EXPECT_TRUE(tree.has_errors());
+
+  // Once cancelled, no declaration is parsed or diagnosed, and the tree only
+  // has its end.
+  CancellationToken cancelled;
+  cancelled.Cancel();
+  ParseTree cancelled_tree = ParseTree::Parse(tokens, consumer, cancelled);
+  EXPECT_TRUE(cancelled_tree.cancelled());
+  EXPECT_FALSE(cancelled_tree.has_errors());
+  EXPECT_THAT(cancelled_tree, MatchParseTreeNodes({MatchFileEnd()}));
+}
+
+TEST_F(ParseTreeTest, ParseStats) {
+  TokenizedBuffer& tokens =
+      GetTokenizedBuffer("fn F() {}\n// A comment.\nvar x: i32 = 1;\n");
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_FALSE(tree.has_errors());
+  EXPECT_THAT(tree.parse_stats().node_reallocations, Eq(0));
+  EXPECT_THAT(tree.parse_stats().final_node_storage_bytes,
+              Eq(tree.parse_stats().peak_node_storage_bytes));
+  EXPECT_THAT(tree.node_storage_bytes(),
+              Eq(tree.parse_stats().final_node_storage_bytes));
+
+  // Tokens skipped while recovering from an error have no nodes, so shrinking
+  // frees their storage.
+  TokenizedBuffer& error_tokens = GetTokenizedBuffer("var x: i32 = 1 2 3 4 5;");
+  ParseTree reserved =
+      ParseTree::Parse(error_tokens, NullDiagnosticConsumer());
+  ParseTree shrunk = ParseTree::Parse(error_tokens, NullDiagnosticConsumer(),
+                                      ParseTree::NodeStorage::ShrinkToFit);
+  EXPECT_THAT(shrunk.parse_stats().peak_node_storage_bytes,
+              Eq(reserved.parse_stats().peak_node_storage_bytes));
+  EXPECT_LT(shrunk.parse_stats().final_node_storage_bytes,
+            reserved.parse_stats().final_node_storage_bytes);
+  EXPECT_THAT(shrunk.size(), Eq(reserved.size()));
+}
+
+TEST_F(ParseTreeTest, GetMemoryUsage) {
+  TokenizedBuffer& tokens = GetTokenizedBuffer("fn F() {}\nvar x: i32 = 1;\n");
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  MemoryUsage usage = tree.GetMemoryUsage();
+  ASSERT_THAT(usage.entries.size(), Eq(3));
+  EXPECT_THAT(usage.entries[0].name.str(), StrEq("node_impls"));
+  EXPECT_THAT(usage.entries[0].allocated, Eq(tree.node_storage_bytes()));
+  EXPECT_THAT(usage.entries[0].used, Eq(tree.size() * 8));
+  // The indices are only built when they're first needed.
+  EXPECT_THAT(usage.entries[1].allocated, Eq(0));
+  EXPECT_THAT(usage.entries[2].allocated, Eq(0));
+  tree.BuildParentIndex();
+  EXPECT_THAT(tree.GetMemoryUsage().entries[1].used,
+              Eq(tree.size() * static_cast<int64_t>(sizeof(int32_t))));
+}
+
 }  // namespace
\ No newline at end of file
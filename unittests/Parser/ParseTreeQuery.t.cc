@@ -0,0 +1,120 @@
+#include "Cocktail/Parser/ParseTreeQuery.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <forward_list>
+#include <string>
+
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lex/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::SizeIs;
+
+constexpr llvm::StringLiteral TestFileName = "test.cocktail";
+
+class ParseTreeQueryTest : public ::testing::Test {
+ protected:
+  auto Parse(llvm::StringRef text) -> const ParseTree& {
+    text_storage.push_front(text.str());
+    llvm::vfs::InMemoryFileSystem fs;
+    fs.addFile(TestFileName, /*ModificationTime=*/0,
+               llvm::MemoryBuffer::getMemBuffer(
+                   text_storage.front(), TestFileName,
+                   /*RequiresNullTerminator=*/false));
+    source_storage.push_front(
+        std::move(*SourceBuffer::CreateFromFile(fs, TestFileName, consumer)));
+    token_storage.push_front(
+        TokenizedBuffer::Lex(source_storage.front(), consumer));
+    tree_storage.push_front(ParseTree::Parse(token_storage.front(), consumer));
+    return tree_storage.front();
+  }
+
+  static auto Compile(llvm::ArrayRef<llvm::StringRef> patterns)
+      -> ParseTreeQuery {
+    ErrorOr<ParseTreeQuery> query = ParseTreeQuery::Compile(patterns);
+    EXPECT_TRUE(query.ok()) << query.error();
+    return std::move(*query);
+  }
+
+  std::forward_list<std::string> text_storage;
+  std::forward_list<SourceBuffer> source_storage;
+  std::forward_list<TokenizedBuffer> token_storage;
+  std::forward_list<ParseTree> tree_storage;
+  DiagnosticConsumer& consumer = NullDiagnosticConsumer();
+};
+
+TEST_F(ParseTreeQueryTest, AnchoredChild) {
+  const ParseTree& tree = Parse("fn F() { foo(bar); bar(foo); foo(); }");
+  ParseTreeQuery query =
+      Compile({"(CallExpression . (NameReference \"foo\"))"});
+  llvm::SmallVector<ParseTreeQuery::Match> matches = query.FindMatches(tree);
+  ASSERT_THAT(matches, SizeIs(2));
+  for (const ParseTreeQuery::Match& match : matches) {
+    EXPECT_THAT(match.pattern, Eq(0));
+    EXPECT_THAT(tree.node_kind(match.node),
+                Eq(ParseNodeKind::CallExpression()));
+  }
+
+  // Without the anchor, the argument of the call to `bar` matches too.
+  EXPECT_THAT(Compile({"(CallExpression (NameReference \"foo\"))"})
+                  .FindMatches(tree),
+              SizeIs(3));
+}
+
+TEST_F(ParseTreeQueryTest, Descendant) {
+  const ParseTree& tree = Parse(
+      "fn F() {\n"
+      "  while (true) { if (true) { break; } }\n"
+      "  while (true) { continue; }\n"
+      "}\n");
+  llvm::SmallVector<ParseTreeQuery::Match> matches =
+      Compile({"(WhileStatement .. (BreakStatement))"}).FindMatches(tree);
+  ASSERT_THAT(matches, SizeIs(1));
+  EXPECT_THAT(tree.node_kind(matches[0].node),
+              Eq(ParseNodeKind::WhileStatement()));
+  EXPECT_THAT(
+      Compile({"(WhileStatement (BreakStatement))"}).FindMatches(tree),
+      IsEmpty());
+}
+
+TEST_F(ParseTreeQueryTest, PatternsMatchInOnePass) {
+  const ParseTree& tree = Parse("fn F() { G(); }");
+  ParseTreeQuery query = Compile({"(NameReference \"G\")", "(_ \"G\")",
+                                  "(CallExpression . (_ \"G\"))"});
+  llvm::SmallVector<ParseTreeQuery::Match> matches = query.FindMatches(tree);
+  ASSERT_THAT(matches, SizeIs(3));
+  // Matches are in postorder, and in pattern order for each node.
+  EXPECT_THAT(matches[0].pattern, Eq(0));
+  EXPECT_THAT(matches[1].pattern, Eq(1));
+  EXPECT_THAT(matches[1].node, Eq(matches[0].node));
+  EXPECT_THAT(matches[2].pattern, Eq(2));
+  EXPECT_THAT(tree.node_kind(matches[2].node),
+              Eq(ParseNodeKind::CallExpression()));
+}
+
+TEST_F(ParseTreeQueryTest, CompileErrors) {
+  auto error = [](llvm::ArrayRef<llvm::StringRef> patterns) -> std::string {
+    ErrorOr<ParseTreeQuery> query = ParseTreeQuery::Compile(patterns);
+    EXPECT_FALSE(query.ok());
+    return query.ok() ? "" : query.error().message();
+  };
+  EXPECT_THAT(error({"(_)", "(Nonsense)"}), HasSubstr("Unknown node kind"));
+  EXPECT_THAT(error({"(_ \"x)"}), HasSubstr("Unterminated"));
+  EXPECT_THAT(error({"_"}), HasSubstr("Expected `(`"));
+  EXPECT_THAT(error({"(_) (_)"}), HasSubstr("after the pattern"));
+  EXPECT_THAT(error({"(_ (_"}), HasSubstr("Expected `(`"));
+}
+
+}  // namespace
@@ -0,0 +1,213 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <forward_list>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "Cocktail/Lexer/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseNodeKind.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Testing/Fuzzer.t.h"
+#include "Cocktail/Testing/Parse.t.h"
+#include "llvm/Support/FormatVariadic.h"
+
+namespace {
+
+using namespace Cocktail;
+using namespace Cocktail::Testing;
+
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+// Generated inputs are this many lines long, so that the regular test run
+// covers how the parser scales.
+constexpr int NumLines = 100000;
+
+class ParseTreeScaleTest : public ::testing::Test {
+ protected:
+  auto GetTokenizedBuffer(std::string text) -> TokenizedBuffer& {
+    text_storage.push_front(std::move(text));
+    std::optional<SourceBuffer> source =
+        CreateSourceFromText(text_storage.front());
+    COCKTAIL_CHECK(source) << "Generated text isn't valid UTF-8!";
+    source_storage.push_front(std::move(*source));
+    token_storage.push_front(
+        TokenizedBuffer::Lex(source_storage.front(), consumer));
+    return token_storage.front();
+  }
+
+  // Checks that parsing `tokens` reserved all the node storage it needed up
+  // front, and that shrinking it keeps no more than that.
+  void ExpectNodeStorageReserved(TokenizedBuffer& tokens,
+                                 const ParseTree& tree) {
+    EXPECT_THAT(tree.parse_stats().node_reallocations, Eq(0));
+    EXPECT_THAT(tree.parse_stats().final_node_storage_bytes,
+                Eq(tree.parse_stats().peak_node_storage_bytes));
+    ParseTree shrunk =
+        ParseTree::Parse(tokens, consumer, ParseTree::NodeStorage::ShrinkToFit);
+    EXPECT_THAT(shrunk.parse_stats().node_reallocations, Eq(0));
+    EXPECT_LE(shrunk.node_storage_bytes(), tree.node_storage_bytes());
+  }
+
+  std::forward_list<std::string> text_storage;
+  std::forward_list<SourceBuffer> source_storage;
+  std::forward_list<TokenizedBuffer> token_storage;
+  DiagnosticConsumer& consumer = ConsoleDiagnosticConsumer();
+};
+
+TEST_F(ParseTreeScaleTest, PostorderMatcherExplainsMismatches) {
+  TokenizedBuffer& tokens = GetTokenizedBuffer("fn F();");
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  PostorderBuilder expected;
+  expected.Begin();
+  expected.Leaf(ParseNodeKind::DeclaredName());
+  expected.Begin();
+  expected.Leaf(ParseNodeKind::ParameterListEnd());
+  expected.End(ParseNodeKind::ParameterList());
+  expected.Leaf(ParseNodeKind::DeclarationEnd());
+  expected.End(ParseNodeKind::FunctionDeclaration());
+  expected.Leaf(ParseNodeKind::FileEnd());
+  std::vector<ExpectedPostorderNode> nodes = std::move(expected).Build();
+  EXPECT_THAT(tree, MatchParseTreePostorder(nodes));
+
+  nodes[1].kind = ParseNodeKind::DeclarationEnd();
+  nodes[4].subtree_size = 1;
+  nodes[5].has_error = true;
+  ::testing::StringMatchResultListener explanation;
+  EXPECT_FALSE(::testing::ExplainMatchResult(MatchParseTreePostorder(nodes),
+                                             tree, &explanation));
+  EXPECT_THAT(explanation.str(),
+              HasSubstr("(postorder index #1) is a ParameterListEnd, "
+                        "expected a DeclarationEnd."));
+  EXPECT_THAT(explanation.str(),
+              HasSubstr("(postorder index #4) has a subtree of 5 nodes, "
+                        "expected 1."));
+  EXPECT_THAT(explanation.str(),
+              HasSubstr("(postorder index #5) does not have an error"));
+
+  nodes.pop_back();
+  EXPECT_THAT(tree, Not(MatchParseTreePostorder(nodes)));
+}
+
+TEST_F(ParseTreeScaleTest, ManyFunctions) {
+  // Three lines a function.
+  constexpr int NumFunctions = NumLines / 3;
+  std::string text;
+  PostorderBuilder expected;
+  for (int i = 0; i < NumFunctions; ++i) {
+    text += llvm::formatv("fn F{0}() {{\n  return ((({0})));\n}\n", i);
+    expected.Begin();
+    expected.Leaf(ParseNodeKind::DeclaredName());
+    expected.Begin();
+    expected.Leaf(ParseNodeKind::ParameterListEnd());
+    expected.End(ParseNodeKind::ParameterList());
+    expected.Begin();
+    expected.Begin();
+    for (int depth = 0; depth < 3; ++depth) {
+      expected.Begin();
+    }
+    expected.Leaf(ParseNodeKind::Literal());
+    for (int depth = 0; depth < 3; ++depth) {
+      expected.Leaf(ParseNodeKind::ParenExpressionEnd());
+      expected.End(ParseNodeKind::ParenExpression());
+    }
+    expected.Leaf(ParseNodeKind::StatementEnd());
+    expected.End(ParseNodeKind::ReturnStatement());
+    expected.Leaf(ParseNodeKind::CodeBlockEnd());
+    expected.End(ParseNodeKind::CodeBlock());
+    expected.End(ParseNodeKind::FunctionDeclaration());
+  }
+  expected.Leaf(ParseNodeKind::FileEnd());
+
+  TokenizedBuffer& tokens = GetTokenizedBuffer(std::move(text));
+  ASSERT_FALSE(tokens.has_errors());
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_FALSE(tree.has_errors());
+  EXPECT_THAT(tree, MatchParseTreePostorder(std::move(expected).Build()));
+  ExpectNodeStorageReserved(tokens, tree);
+}
+
+TEST_F(ParseTreeScaleTest, DeeplyNestedBlocks) {
+  // Half the lines open a block and half close one.
+  constexpr int Depth = NumLines / 2;
+  std::string text = "fn F() {\n";
+  PostorderBuilder expected;
+  expected.Begin();
+  expected.Leaf(ParseNodeKind::DeclaredName());
+  expected.Begin();
+  expected.Leaf(ParseNodeKind::ParameterListEnd());
+  expected.End(ParseNodeKind::ParameterList());
+  expected.Begin();
+  for (int i = 0; i < Depth; ++i) {
+    text += "if (x) {\n";
+    expected.Begin();
+    expected.Begin();
+    expected.Leaf(ParseNodeKind::NameReference());
+    expected.Leaf(ParseNodeKind::ConditionEnd());
+    expected.End(ParseNodeKind::Condition());
+    expected.Begin();
+  }
+  for (int i = 0; i < Depth; ++i) {
+    text += "}\n";
+    expected.Leaf(ParseNodeKind::CodeBlockEnd());
+    expected.End(ParseNodeKind::CodeBlock());
+    expected.End(ParseNodeKind::IfStatement());
+  }
+  text += "}\n";
+  expected.Leaf(ParseNodeKind::CodeBlockEnd());
+  expected.End(ParseNodeKind::CodeBlock());
+  expected.End(ParseNodeKind::FunctionDeclaration());
+  expected.Leaf(ParseNodeKind::FileEnd());
+
+  TokenizedBuffer& tokens = GetTokenizedBuffer(std::move(text));
+  ASSERT_FALSE(tokens.has_errors());
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_FALSE(tree.has_errors());
+  EXPECT_THAT(tree, MatchParseTreePostorder(std::move(expected).Build()));
+  ExpectNodeStorageReserved(tokens, tree);
+}
+
+TEST_F(ParseTreeScaleTest, DeeplyNestedParens) {
+  // Half the lines open a paren and half close one.
+  constexpr int Depth = NumLines / 2;
+  std::string text = "fn F() { return\n";
+  PostorderBuilder expected;
+  expected.Begin();
+  expected.Leaf(ParseNodeKind::DeclaredName());
+  expected.Begin();
+  expected.Leaf(ParseNodeKind::ParameterListEnd());
+  expected.End(ParseNodeKind::ParameterList());
+  expected.Begin();
+  expected.Begin();
+  for (int i = 0; i < Depth; ++i) {
+    text += "(\n";
+    expected.Begin();
+  }
+  text += "x\n";
+  expected.Leaf(ParseNodeKind::NameReference());
+  for (int i = 0; i < Depth; ++i) {
+    text += ")\n";
+    expected.Leaf(ParseNodeKind::ParenExpressionEnd());
+    expected.End(ParseNodeKind::ParenExpression());
+  }
+  text += "; }\n";
+  expected.Leaf(ParseNodeKind::StatementEnd());
+  expected.End(ParseNodeKind::ReturnStatement());
+  expected.Leaf(ParseNodeKind::CodeBlockEnd());
+  expected.End(ParseNodeKind::CodeBlock());
+  expected.End(ParseNodeKind::FunctionDeclaration());
+  expected.Leaf(ParseNodeKind::FileEnd());
+
+  TokenizedBuffer& tokens = GetTokenizedBuffer(std::move(text));
+  ASSERT_FALSE(tokens.has_errors());
+  ParseTree tree = ParseTree::Parse(tokens, consumer);
+  EXPECT_FALSE(tree.has_errors());
+  EXPECT_THAT(tree, MatchParseTreePostorder(std::move(expected).Build()));
+  ExpectNodeStorageReserved(tokens, tree);
+}
+
+}  // namespace
@@ -43,6 +43,10 @@ TEST(PrecedenceTest, InfixVsPostfix) {
   EXPECT_TRUE(PrecedenceGroup::ForTrailing(TokenKind::Star(), true)->is_binary);
   EXPECT_FALSE(
       PrecedenceGroup::ForTrailing(TokenKind::Star(), false)->is_binary);
+  EXPECT_TRUE(PrecedenceGroup::HasInfixAndPostfixForms(TokenKind::Star()));
+  EXPECT_FALSE(PrecedenceGroup::HasInfixAndPostfixForms(TokenKind::Minus()));
+  EXPECT_FALSE(
+      PrecedenceGroup::HasInfixAndPostfixForms(TokenKind::MinusMinus()));
 
   // Infix `*` can appear in type contexts; binary `*` cannot.
   EXPECT_THAT(PrecedenceGroup::GetPriority(
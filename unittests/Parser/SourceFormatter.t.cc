@@ -0,0 +1,117 @@
+#include "Cocktail/Parser/SourceFormatter.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <forward_list>
+#include <string>
+
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lex/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::StrEq;
+
+constexpr llvm::StringLiteral TestFileName = "test.cocktail";
+
+class SourceFormatterTest : public ::testing::Test {
+ protected:
+  // Returns `text` formatted, checking that formatting it again changes
+  // nothing.
+  auto Format(llvm::StringRef text) -> std::string {
+    std::string formatted = FormatOnce(text);
+    EXPECT_THAT(FormatOnce(formatted), StrEq(formatted));
+    return formatted;
+  }
+
+  auto FormatOnce(llvm::StringRef text) -> std::string {
+    text_storage.push_front(text.str());
+    llvm::vfs::InMemoryFileSystem fs;
+    fs.addFile(TestFileName, /*ModificationTime=*/0,
+               llvm::MemoryBuffer::getMemBuffer(
+                   text_storage.front(), TestFileName,
+                   /*RequiresNullTerminator=*/false));
+    source_storage.push_front(
+        std::move(*SourceBuffer::CreateFromFile(fs, TestFileName, consumer)));
+    token_storage.push_front(
+        TokenizedBuffer::Lex(source_storage.front(), consumer));
+    ParseTree tree = ParseTree::Parse(token_storage.front(), consumer);
+    EXPECT_FALSE(token_storage.front().has_errors());
+    EXPECT_FALSE(tree.has_errors());
+    std::string formatted;
+    llvm::raw_string_ostream out(formatted);
+    FormatSource(source_storage.front(), token_storage.front(), tree, out);
+    out.flush();
+    return formatted;
+  }
+
+  std::forward_list<std::string> text_storage;
+  std::forward_list<SourceBuffer> source_storage;
+  std::forward_list<TokenizedBuffer> token_storage;
+  DiagnosticConsumer& consumer = NullDiagnosticConsumer();
+};
+
+TEST_F(SourceFormatterTest, Spacing) {
+  EXPECT_THAT(
+      Format("fn F(a: i32,b: i32)->i32{var x: i32=a+b;return x;}"),
+      StrEq("fn F(a: i32, b: i32) -> i32 {\n"
+            "  var x: i32 = a + b;\n"
+            "  return x;\n"
+            "}\n"));
+  EXPECT_THAT(Format("fn   G( )  {  H( 1 ,2 ) ;  }\n\n\n"),
+              StrEq("fn G() {\n"
+                    "  H(1, 2);\n"
+                    "}\n"));
+}
+
+TEST_F(SourceFormatterTest, BlocksAndComments) {
+  EXPECT_THAT(Format("// File comment.\n"
+                     "\n"
+                     "\n"
+                     "\n"
+                     "fn F() {\n"
+                     "      // Loops.\n"
+                     "  while (true) {   break; }\n"
+                     "  if (true) {}\n"
+                     "  else { G(); }\n"
+                     "\n"
+                     "\n"
+                     "  // Done.\n"
+                     "}\n"
+                     "// Trailing.\n"),
+              StrEq("// File comment.\n"
+                    "\n"
+                    "fn F() {\n"
+                    "  // Loops.\n"
+                    "  while (true) {\n"
+                    "    break;\n"
+                    "  }\n"
+                    "  if (true) {} else {\n"
+                    "    G();\n"
+                    "  }\n"
+                    "\n"
+                    "  // Done.\n"
+                    "}\n"
+                    "// Trailing.\n"));
+}
+
+TEST_F(SourceFormatterTest, ContinuationLines) {
+  EXPECT_THAT(Format("fn F() {\n"
+                     "G(1,\n"
+                     "2);\n"
+                     "}\n"),
+              StrEq("fn F() {\n"
+                    "  G(1,\n"
+                    "      2);\n"
+                    "}\n"));
+}
+
+}  // namespace
@@ -0,0 +1,144 @@
+#include "Cocktail/Semantics/SemanticsQueries.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <forward_list>
+#include <optional>
+#include <string>
+
+#include "Cocktail/Diagnostics/NullDiagnostics.h"
+#include "Cocktail/Lex/TokenizedBuffer.h"
+#include "Cocktail/Parser/ParseTree.h"
+#include "Cocktail/Source/SourceBuffer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace {
+
+using namespace Cocktail;
+
+using ::testing::Eq;
+using ::testing::Optional;
+
+constexpr llvm::StringLiteral TestFileName = "test.cocktail";
+
+class SemanticsQueriesTest : public ::testing::Test {
+ protected:
+  // The source refers to the text, which is kept with it.
+  auto GetSourceBuffer(llvm::StringRef text) -> SourceBuffer& {
+    text_storage.push_front(text.str());
+    llvm::vfs::InMemoryFileSystem fs;
+    fs.addFile(TestFileName, /*ModificationTime=*/0,
+               llvm::MemoryBuffer::getMemBuffer(
+                   text_storage.front(), TestFileName,
+                   /*RequiresNullTerminator=*/false));
+    source_storage.push_front(
+        std::move(*SourceBuffer::CreateFromFile(fs, TestFileName, consumer)));
+    return source_storage.front();
+  }
+
+  auto Parse(llvm::StringRef text) -> const ParseTree& {
+    token_storage.push_front(
+        TokenizedBuffer::Lex(GetSourceBuffer(text), consumer));
+    tree_storage.push_front(ParseTree::Parse(token_storage.front(), consumer));
+    return tree_storage.front();
+  }
+
+  // Edits the text last parsed from `before`, updating `queries`.
+  auto Edit(SemanticsQueries& queries, llvm::StringRef before,
+            const TokenizedBuffer::TextEdit& edit) -> void {
+    std::string after = before.str();
+    after.replace(edit.offset, edit.removed_length, edit.inserted_text.str());
+    TokenizedBuffer& previous = token_storage.front();
+    token_storage.push_front(TokenizedBuffer::Relex(
+        previous, GetSourceBuffer(after), edit, consumer));
+    llvm::Optional<ParseTree::TokenEdit> token_edit =
+        ParseTree::ComputeTokenEdit(previous, token_storage.front(), before,
+                                    edit);
+    ASSERT_TRUE(token_edit.hasValue());
+    tree_storage.push_front(ParseTree::Reparse(
+        tree_storage.front(), token_storage.front(), *token_edit, consumer));
+    queries.Update(token_storage.front(), tree_storage.front(), *token_edit);
+  }
+
+  static auto FindFunction(SemanticsQueries& queries, llvm::StringRef name)
+      -> int32_t {
+    llvm::ArrayRef<Semantics::Function> functions = queries.functions();
+    for (int32_t i = 0; i != static_cast<int32_t>(functions.size()); ++i) {
+      if (functions[i].name() == name) {
+        return i;
+      }
+    }
+    ADD_FAILURE() << "No function " << name.str();
+    return 0;
+  }
+
+  std::forward_list<std::string> text_storage;
+  std::forward_list<SourceBuffer> source_storage;
+  std::forward_list<TokenizedBuffer> token_storage;
+  std::forward_list<ParseTree> tree_storage;
+  DiagnosticConsumer& consumer = NullDiagnosticConsumer();
+};
+
+TEST_F(SemanticsQueriesTest, AnalyzesOnlyWhatIsAsked) {
+  const ParseTree& tree =
+      Parse("fn I() -> i32 {}\nfn F() { I(); }\nfn G(x: i32) { F(); }\n");
+  SemanticsQueries queries(token_storage.front(), tree, consumer);
+  int32_t f = FindFunction(queries, "F");
+  const SemanticsQueries::FunctionBody& body = queries.Body(f);
+  ASSERT_THAT(body.insts.size(), Eq(1));
+
+  // The call's type is the return type of `I`, the only signature built.
+  Semantics::TypeId i_type = queries.FunctionType(FindFunction(queries, "I"));
+  EXPECT_THAT(queries.ExpressionType(body.insts.node(0)),
+              Optional(queries.types().return_type(i_type)));
+  EXPECT_THAT(queries.stats().declarations, Eq(1));
+  EXPECT_THAT(queries.stats().signatures, Eq(1));
+  EXPECT_THAT(queries.stats().bodies, Eq(1));
+
+  // Nodes outside any function's declaration have no type.
+  EXPECT_THAT(queries.ExpressionType(*tree.roots().begin()), Eq(std::nullopt));
+}
+
+TEST_F(SemanticsQueriesTest, UpdateKeepsBodiesBeforeEdit) {
+  llvm::StringLiteral before = "fn I() -> i32 {}\nfn F() { I(); }\nfn G() {}\n";
+  const ParseTree& tree = Parse(before);
+  SemanticsQueries queries(token_storage.front(), tree, consumer);
+  queries.Body(FindFunction(queries, "F"));
+  queries.Body(FindFunction(queries, "G"));
+  ASSERT_THAT(queries.stats().bodies, Eq(2));
+
+  // Giving `G` a body leaves `F`'s alone.
+  Edit(queries, before,
+       {.offset = static_cast<int64_t>(before.rfind('}')),
+        .removed_length = 0,
+        .inserted_text = "I(); "});
+  queries.Body(FindFunction(queries, "F"));
+  EXPECT_THAT(queries.stats().bodies, Eq(2));
+  EXPECT_THAT(queries.Body(FindFunction(queries, "G")).insts.size(), Eq(1));
+  EXPECT_THAT(queries.stats().bodies, Eq(3));
+}
+
+TEST_F(SemanticsQueriesTest, UpdateDropsBodiesCallingEditedFunctions) {
+  llvm::StringLiteral before = "fn F() { G(); }\nfn G() {}\n";
+  const ParseTree& tree = Parse(before);
+  SemanticsQueries queries(token_storage.front(), tree, consumer);
+  queries.Body(FindFunction(queries, "F"));
+  ASSERT_THAT(queries.stats().bodies, Eq(1));
+
+  // `F` is before the edit, but the type of its call to `G` changes.
+  Edit(queries, before,
+       {.offset = static_cast<int64_t>(before.rfind(')')) + 1,
+        .removed_length = 0,
+        .inserted_text = " -> i32"});
+  const SemanticsQueries::FunctionBody& body =
+      queries.Body(FindFunction(queries, "F"));
+  EXPECT_THAT(queries.stats().bodies, Eq(2));
+  ASSERT_THAT(body.insts.size(), Eq(1));
+  EXPECT_THAT(body.insts.type(0),
+              Eq(queries.types().return_type(
+                  queries.FunctionType(FindFunction(queries, "G")))));
+}
+
+}  // namespace
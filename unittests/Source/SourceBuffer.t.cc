@@ -2,9 +2,20 @@
 
 #include <gtest/gtest.h>
 
+#include <optional>
+#include <string>
+
 #include "Cocktail/Common/Check.h"
+#include "Cocktail/Common/TaskScheduler.h"
 #include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 
 namespace Cocktail {
 namespace {
@@ -18,5 +29,103 @@ TEST(SourceBufferTest, MissingFile) {
   EXPECT_FALSE(buffer);
 }
 
+TEST(SourceBufferTest, ByteOrderMark) {
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(TestFileName, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer("\xEF\xBB\xBF"
+                                              "fn F() {}\n"));
+  auto buffer = SourceBuffer::CreateFromFile(fs, TestFileName,
+                                             ConsoleDiagnosticConsumer());
+  ASSERT_TRUE(buffer);
+  EXPECT_EQ(buffer->text(), "fn F() {}\n");
+  EXPECT_TRUE(buffer->is_ascii());
+}
+
+TEST(SourceBufferTest, Utf8) {
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(TestFileName, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer("var s = \"r\xC3\xA9" "al\";\n"));
+  auto buffer = SourceBuffer::CreateFromFile(fs, TestFileName,
+                                             ConsoleDiagnosticConsumer());
+  ASSERT_TRUE(buffer);
+  EXPECT_FALSE(buffer->is_ascii());
+}
+
+TEST(SourceBufferTest, InvalidUtf8) {
+  llvm::vfs::InMemoryFileSystem fs;
+  fs.addFile(TestFileName, /*ModificationTime=*/0,
+             llvm::MemoryBuffer::getMemBuffer("fn F() {}\n  // \xC0\xAF\n"));
+  struct : DiagnosticConsumer {
+    auto HandleDiagnostic(Diagnostic diagnostic) -> void override {
+      diagnostic.ResolveLocations();
+      diagnostics.push_back(std::move(diagnostic));
+    }
+    llvm::SmallVector<Diagnostic, 0> diagnostics;
+  } consumer;
+  auto buffer = SourceBuffer::CreateFromFile(fs, TestFileName, consumer);
+  EXPECT_FALSE(buffer);
+  ASSERT_EQ(consumer.diagnostics.size(), 1);
+  const DiagnosticLocation& location =
+      consumer.diagnostics[0].message.location();
+  EXPECT_EQ(consumer.diagnostics[0].message.kind, DiagnosticKind::InvalidUtf8);
+  EXPECT_EQ(location.line_number, 2);
+  EXPECT_EQ(location.column_number, 6);
+  EXPECT_EQ(location.line, "  // \xC0\xAF");
+}
+
+TEST(SourceBufferTest, CreateFromFiles) {
+  llvm::vfs::InMemoryFileSystem fs;
+  llvm::SmallVector<std::string> names;
+  for (int i = 0; i < 20; ++i) {
+    names.push_back(llvm::formatv("file{0}.cocktail", i).str());
+    fs.addFile(names.back(), /*ModificationTime=*/0,
+               llvm::MemoryBuffer::getMemBufferCopy(names.back()));
+  }
+  names.push_back("missing.cocktail");
+  llvm::SmallVector<llvm::StringRef> filenames(names.begin(), names.end());
+
+  TaskScheduler scheduler;
+  llvm::SmallVector<int> seen(filenames.size());
+  SourceBuffer::CreateFromFiles(
+      fs, filenames, scheduler, ConsoleDiagnosticConsumer(),
+      [&](int index, std::optional<SourceBuffer> buffer) {
+        ++seen[index];
+        if (filenames[index] == "missing.cocktail") {
+          EXPECT_FALSE(buffer);
+        } else {
+          ASSERT_TRUE(buffer);
+          EXPECT_EQ(buffer->filename(), filenames[index]);
+          EXPECT_EQ(buffer->text(), filenames[index]);
+        }
+      });
+  EXPECT_EQ(llvm::count(seen, 1), static_cast<int>(seen.size()));
+}
+
+TEST(SourceBufferTest, MissingMappedFile) {
+  auto buffer = SourceBuffer::CreateFromMappedFile(
+      "does/not/exist.cocktail", ConsoleDiagnosticConsumer());
+  EXPECT_FALSE(buffer);
+}
+
+TEST(SourceBufferTest, MappedFile) {
+  for (llvm::StringRef text : {"", "fn F() {}\n"}) {
+    llvm::SmallString<128> path;
+    int fd;
+    COCKTAIL_CHECK(!llvm::sys::fs::createTemporaryFile("test", "cocktail", fd,
+                                                       path));
+    llvm::FileRemover remover(path);
+    {
+      llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+      out << text;
+    }
+
+    auto buffer =
+        SourceBuffer::CreateFromMappedFile(path, ConsoleDiagnosticConsumer());
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(buffer->filename(), path);
+    EXPECT_EQ(buffer->text(), text);
+  }
+}
+
 }  // namespace
 }  // namespace Cocktail
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "Cocktail/Source/SourceBufferCache.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "Cocktail/Common/Check.h"
+#include "Cocktail/Diagnostics/DiagnosticEmitter.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace Cocktail {
+namespace {
+
+// Rewrites the file at `path`, giving it a modification time of `seconds`
+// after the epoch.
+auto WriteFile(llvm::StringRef path, llvm::StringRef text, int seconds)
+    -> void {
+  int fd;
+  COCKTAIL_CHECK(!llvm::sys::fs::openFileForWrite(path, fd));
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/false);
+    out << text;
+  }
+  COCKTAIL_CHECK(!llvm::sys::fs::setLastAccessAndModificationTime(
+      fd, llvm::sys::TimePoint<>(std::chrono::seconds(seconds))));
+  llvm::sys::fs::closeFile(fd);
+}
+
+class SourceBufferCacheTest : public ::testing::Test {
+ protected:
+  SourceBufferCacheTest() {
+    COCKTAIL_CHECK(
+        !llvm::sys::fs::createTemporaryFile("test", "cocktail", path_));
+    remover_.setFile(path_);
+  }
+
+  llvm::SmallString<128> path_;
+  llvm::FileRemover remover_;
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs_ =
+      llvm::vfs::getRealFileSystem();
+};
+
+TEST_F(SourceBufferCacheTest, MissingFile) {
+  SourceBufferCache cache(*fs_);
+  EXPECT_EQ(cache.Get("/not/a/real/file.cocktail",
+                      ConsoleDiagnosticConsumer()),
+            nullptr);
+}
+
+TEST_F(SourceBufferCacheTest, ReusesUnchangedFile) {
+  SourceBufferCache cache(*fs_);
+  WriteFile(path_, "fn F() {}\n", 1000);
+  auto first = cache.Get(path_, ConsoleDiagnosticConsumer());
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first->text(), "fn F() {}\n");
+  EXPECT_EQ(cache.Get(path_, ConsoleDiagnosticConsumer()), first);
+
+  // A new modification time means the file is read again.
+  WriteFile(path_, "fn G() {}\n", 2000);
+  auto second = cache.Get(path_, ConsoleDiagnosticConsumer());
+  ASSERT_NE(second, nullptr);
+  EXPECT_NE(second, first);
+  EXPECT_EQ(second->text(), "fn G() {}\n");
+  // Buffers that were handed out stay valid.
+  EXPECT_EQ(first->text(), "fn F() {}\n");
+
+  cache.Clear();
+  EXPECT_NE(cache.Get(path_, ConsoleDiagnosticConsumer()), second);
+}
+
+TEST_F(SourceBufferCacheTest, ContentHash) {
+  SourceBufferCache cache(*fs_, SourceBufferCache::Validation::ContentHash);
+  WriteFile(path_, "fn F() {}\n", 1000);
+  auto first = cache.Get(path_, ConsoleDiagnosticConsumer());
+  ASSERT_NE(first, nullptr);
+
+  // Touching the file without changing it keeps the buffer.
+  WriteFile(path_, "fn F() {}\n", 2000);
+  EXPECT_EQ(cache.Get(path_, ConsoleDiagnosticConsumer()), first);
+
+  WriteFile(path_, "fn G() {}\n", 3000);
+  auto second = cache.Get(path_, ConsoleDiagnosticConsumer());
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(second->text(), "fn G() {}\n");
+}
+
+}  // namespace
+}  // namespace Cocktail